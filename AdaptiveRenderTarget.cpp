@@ -0,0 +1,360 @@
+/***********************************************************************
+AdaptiveRenderTarget - Class to render the expensive surface passes into
+an off-screen frame buffer whose resolution adapts to a GPU frame time
+budget, and to re-present the last rendered frame while nothing changed.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "AdaptiveRenderTarget.h"
+
+#include <math.h>
+#include <GL/gl.h>
+#include <GL/GLExtensionManager.h>
+#include <GL/Extensions/GLARBDepthTexture.h>
+#include <GL/Extensions/GLARBFragmentShader.h>
+#include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBOcclusionQuery.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBVertexShader.h>
+#include <GL/Extensions/GLEXTFramebufferObject.h>
+#include <GL/GLContextData.h>
+
+#include "ShaderHelper.h"
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+bool equal(const AdaptiveRenderTarget::FrameKey& k1,const AdaptiveRenderTarget::FrameKey& k2)
+	{
+	if(k1.depthImageVersion!=k2.depthImageVersion||k1.settingsVersion!=k2.settingsVersion||k1.lightTrackerVersion!=k2.lightTrackerVersion)
+		return false;
+	const Scalar* e1=k1.projectionModelview.getMatrix().getEntries();
+	const Scalar* e2=k2.projectionModelview.getMatrix().getEntries();
+	for(int i=0;i<16;++i)
+		if(e1[i]!=e2[i])
+			return false;
+	return true;
+	}
+
+}
+
+/***********************************************
+Methods of class AdaptiveRenderTarget::DataItem:
+***********************************************/
+
+AdaptiveRenderTarget::DataItem::DataItem(void)
+	:framebufferObject(0),colorTextureObject(0),depthTextureObject(0),
+	 presentShader(0),
+	 haveTimerQueries(false),nextTimerQuery(0),
+	 frameTime(-1.0),renderScale(1.0f),
+	 savedFramebuffer(0),
+	 valid(false)
+	{
+	/* Initialize all required extensions: */
+	GLARBDepthTexture::initExtension();
+	GLARBFragmentShader::initExtension();
+	GLARBMultitexture::initExtension();
+	GLARBShaderObjects::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBVertexShader::initExtension();
+	GLEXTFramebufferObject::initExtension();
+	
+	/* Check whether the GPU time of rendered frames can be measured: */
+	haveTimerQueries=GLARBOcclusionQuery::isSupported()&&(GLExtensionManager::isExtensionSupported("GL_ARB_timer_query")||GLExtensionManager::isExtensionSupported("GL_EXT_timer_query"));
+	if(haveTimerQueries)
+		{
+		GLARBOcclusionQuery::initExtension();
+		glGenQueriesARB(numTimerQueries,timerQueries);
+		}
+	for(unsigned int i=0;i<numTimerQueries;++i)
+		timerQueryIssued[i]=false;
+	
+	for(int i=0;i<2;++i)
+		{
+		size[i]=0;
+		renderSize[i]=0;
+		viewportSize[i]=0;
+		}
+	}
+
+AdaptiveRenderTarget::DataItem::~DataItem(void)
+	{
+	/* Release all allocated buffers, textures, queries, and shaders: */
+	glDeleteFramebuffersEXT(1,&framebufferObject);
+	glDeleteTextures(1,&colorTextureObject);
+	glDeleteTextures(1,&depthTextureObject);
+	if(haveTimerQueries)
+		glDeleteQueriesARB(numTimerQueries,timerQueries);
+	glDeleteObjectARB(presentShader);
+	}
+
+/*************************************
+Methods of class AdaptiveRenderTarget:
+*************************************/
+
+void AdaptiveRenderTarget::updateRenderScale(AdaptiveRenderTarget::DataItem* dataItem) const
+	{
+	if(!dataItem->haveTimerQueries)
+		return;
+	
+	/* Retrieve all finished measurements, oldest first, without waiting for outstanding ones: */
+	bool measured=false;
+	for(unsigned int i=0;i<DataItem::numTimerQueries;++i)
+		{
+		unsigned int queryIndex=(dataItem->nextTimerQuery+i)%DataItem::numTimerQueries;
+		if(dataItem->timerQueryIssued[queryIndex])
+			{
+			GLuint available=0;
+			glGetQueryObjectuivARB(dataItem->timerQueries[queryIndex],GL_QUERY_RESULT_AVAILABLE_ARB,&available);
+			if(!available)
+				break;
+			
+			/* Fold the measurement into the running average: */
+			GLuint elapsed=0;
+			glGetQueryObjectuivARB(dataItem->timerQueries[queryIndex],GL_QUERY_RESULT_ARB,&elapsed);
+			double frameTime=double(elapsed)*1.0e-6;
+			if(dataItem->frameTime<0.0)
+				dataItem->frameTime=frameTime;
+			else
+				dataItem->frameTime=dataItem->frameTime*0.75+frameTime*0.25;
+			dataItem->timerQueryIssued[queryIndex]=false;
+			measured=true;
+			}
+		}
+	if(!measured)
+		return;
+	
+	/* Adapt the render scale; rendering time is roughly proportional to the number of rendered pixels: */
+	GLfloat newRenderScale=dataItem->renderScale;
+	if(dataItem->frameTime>timeBudget)
+		newRenderScale*=GLfloat(sqrt(timeBudget/dataItem->frameTime));
+	else if(dataItem->frameTime<timeBudget*0.75)
+		newRenderScale*=1.05f;
+	if(newRenderScale<minRenderScale)
+		newRenderScale=minRenderScale;
+	if(newRenderScale>1.0f)
+		newRenderScale=1.0f;
+	
+	/* Quantize the render scale to avoid re-scaling on every measurement: */
+	dataItem->renderScale=GLfloat(floor(newRenderScale*32.0f+0.5f))/32.0f;
+	}
+
+AdaptiveRenderTarget::AdaptiveRenderTarget(void)
+	:timeBudget(10.0),minRenderScale(0.5f)
+	{
+	}
+
+void AdaptiveRenderTarget::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	/* Create the frame buffer; its attachments are allocated when the first frame is rendered: */
+	glGenFramebuffersEXT(1,&dataItem->framebufferObject);
+	glGenTextures(1,&dataItem->colorTextureObject);
+	glGenTextures(1,&dataItem->depthTextureObject);
+	
+	/* Create the presentation shader: */
+	dataItem->presentShader=linkVertexAndFragmentShader("AdaptiveRenderPresentShader");
+	GLint* ulPtr=dataItem->presentShaderUniforms;
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->presentShader,"colorSampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->presentShader,"depthSampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->presentShader,"viewportOrigin");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->presentShader,"renderScale");
+	}
+
+void AdaptiveRenderTarget::setTimeBudget(double newTimeBudget)
+	{
+	timeBudget=newTimeBudget;
+	}
+
+void AdaptiveRenderTarget::setMinRenderScale(GLfloat newMinRenderScale)
+	{
+	if(newMinRenderScale<0.25f)
+		newMinRenderScale=0.25f;
+	if(newMinRenderScale>1.0f)
+		newMinRenderScale=1.0f;
+	minRenderScale=newMinRenderScale;
+	}
+
+bool AdaptiveRenderTarget::beginFrame(const int viewport[4],const AdaptiveRenderTarget::FrameKey& frameKey,int renderViewport[4],GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Adapt the render scale to the most recent GPU time measurements: */
+	updateRenderScale(dataItem);
+	
+	/* Re-present the held frame if it was rendered for the same viewport and contents: */
+	if(dataItem->valid&&!frameKey.animated&&!dataItem->frameKey.animated&&dataItem->viewportSize[0]==viewport[2]&&dataItem->viewportSize[1]==viewport[3]&&equal(dataItem->frameKey,frameKey))
+		return false;
+	
+	/* Save the currently-bound frame buffer: */
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&dataItem->savedFramebuffer);
+	
+	/* Bind the off-screen frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->framebufferObject);
+	
+	/* Check if the frame buffer's attachments need to be resized to the window viewport: */
+	if(dataItem->size[0]!=viewport[2]||dataItem->size[1]!=viewport[3])
+		{
+		/* Remember if the textures must still be attached to the frame buffer: */
+		bool mustAttachTextures=dataItem->size[0]==0&&dataItem->size[1]==0;
+		
+		for(int i=0;i<2;++i)
+			dataItem->size[i]=viewport[2+i];
+		
+		/* Resize the color texture; it is interpolated when upscaled into the window: */
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->colorTextureObject);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGBA8,dataItem->size[0],dataItem->size[1],0,GL_RGBA,GL_UNSIGNED_BYTE,0);
+		
+		/* Resize the depth texture; depth values must not be interpolated: */
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTextureObject);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_COMPARE_MODE_ARB,GL_NONE);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_DEPTH_TEXTURE_MODE_ARB,GL_LUMINANCE);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_DEPTH_COMPONENT24_ARB,dataItem->size[0],dataItem->size[1],0,GL_DEPTH_COMPONENT,GL_UNSIGNED_BYTE,0);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		if(mustAttachTextures)
+			{
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->colorTextureObject,0);
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_DEPTH_ATTACHMENT_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTextureObject,0);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+			}
+		}
+	
+	/* Render into the lower-left part of the frame buffer at the current render scale: */
+	for(int i=0;i<2;++i)
+		{
+		dataItem->renderSize[i]=GLsizei(floor(GLfloat(viewport[2+i])*dataItem->renderScale+0.5f));
+		if(dataItem->renderSize[i]<1)
+			dataItem->renderSize[i]=1;
+		}
+	renderViewport[0]=0;
+	renderViewport[1]=0;
+	renderViewport[2]=dataItem->renderSize[0];
+	renderViewport[3]=dataItem->renderSize[1];
+	
+	/* Set up OpenGL state for the off-screen frame; the window's clear color is used as the frame's background: */
+	glPushAttrib(GL_VIEWPORT_BIT|GL_SCISSOR_BIT|GL_DEPTH_BUFFER_BIT);
+	glViewport(renderViewport[0],renderViewport[1],renderViewport[2],renderViewport[3]);
+	glDisable(GL_SCISSOR_TEST);
+	glDepthMask(GL_TRUE);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	
+	/* Start measuring the GPU time of the frame: */
+	if(dataItem->haveTimerQueries&&!dataItem->timerQueryIssued[dataItem->nextTimerQuery])
+		glBeginQueryARB(GL_TIME_ELAPSED_EXT,dataItem->timerQueries[dataItem->nextTimerQuery]);
+	
+	/* Remember for which viewport and contents the frame is being rendered: */
+	for(int i=0;i<2;++i)
+		dataItem->viewportSize[i]=viewport[2+i];
+	dataItem->frameKey=frameKey;
+	
+	return true;
+	}
+
+void AdaptiveRenderTarget::endFrame(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Stop measuring the GPU time of the frame: */
+	if(dataItem->haveTimerQueries&&!dataItem->timerQueryIssued[dataItem->nextTimerQuery])
+		{
+		glEndQueryARB(GL_TIME_ELAPSED_EXT);
+		dataItem->timerQueryIssued[dataItem->nextTimerQuery]=true;
+		dataItem->nextTimerQuery=(dataItem->nextTimerQuery+1)%DataItem::numTimerQueries;
+		}
+	
+	/* Restore the window's viewport and frame buffer: */
+	glPopAttrib();
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->savedFramebuffer);
+	
+	/* Mark the held frame as presentable: */
+	dataItem->valid=true;
+	}
+
+void AdaptiveRenderTarget::present(GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	if(!dataItem->valid)
+		return;
+	
+	/* Set up OpenGL state to overwrite the window's color and depth values: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_ALWAYS);
+	glDepthMask(GL_TRUE);
+	
+	/* Bind the presentation shader: */
+	glUseProgramObjectARB(dataItem->presentShader);
+	const GLint* ulPtr=dataItem->presentShaderUniforms;
+	
+	/* Bind the frame's color and depth textures: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->colorTextureObject);
+	glUniform1iARB(*(ulPtr++),0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTextureObject);
+	glUniform1iARB(*(ulPtr++),1);
+	
+	/* Upload the transformation from window pixels to frame texels: */
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT,viewport);
+	glUniform2fARB(*(ulPtr++),GLfloat(viewport[0]),GLfloat(viewport[1]));
+	glUniform2fARB(*(ulPtr++),GLfloat(dataItem->renderSize[0])/GLfloat(dataItem->viewportSize[0]),GLfloat(dataItem->renderSize[1])/GLfloat(dataItem->viewportSize[1]));
+	
+	/* Draw a viewport-filling quad: */
+	glBegin(GL_QUADS);
+	glVertex2f(-1.0f,-1.0f);
+	glVertex2f(1.0f,-1.0f);
+	glVertex2f(1.0f,1.0f);
+	glVertex2f(-1.0f,1.0f);
+	glEnd();
+	
+	/* Unbind all textures and the presentation shader: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glUseProgramObjectARB(0);
+	
+	/* Restore OpenGL state: */
+	glPopAttrib();
+	}
@@ -0,0 +1,98 @@
+/***********************************************************************
+AdaptiveRenderTarget - Class to render the expensive surface passes into
+an off-screen frame buffer whose resolution adapts to a GPU frame time
+budget, and to re-present the last rendered frame while nothing changed.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef ADAPTIVERENDERTARGET_INCLUDED
+#define ADAPTIVERENDERTARGET_INCLUDED
+
+#include <GL/gl.h>
+#include <GL/GLObject.h>
+
+#include "Types.h"
+
+class AdaptiveRenderTarget:public GLObject
+	{
+	/* Embedded classes: */
+	public:
+	struct FrameKey // Structure identifying the contents of a rendered frame
+		{
+		/* Elements: */
+		public:
+		PTransform projectionModelview; // Projection and modelview matrix with which the frame was rendered
+		unsigned int depthImageVersion; // Version number of the depth image from which the frame was rendered
+		unsigned int settingsVersion; // Version number of the surface renderer's settings
+		unsigned int lightTrackerVersion; // Version number of the context's light source state
+		bool animated; // Flag whether the frame's contents change even if all version numbers stay the same, e.g., due to a running water simulation
+		};
+	
+	private:
+	struct DataItem:public GLObject::DataItem
+		{
+		/* Elements: */
+		public:
+		static const unsigned int numTimerQueries=4; // Number of timer queries in flight, to read back results without stalling the pipeline
+		GLuint framebufferObject; // Frame buffer object to render the expensive passes
+		GLuint colorTextureObject; // Color texture attached to the frame buffer
+		GLuint depthTextureObject; // Depth texture attached to the frame buffer
+		GLsizei size[2]; // Allocated size of the frame buffer's attachments
+		GLhandleARB presentShader; // Shader to upscale the rendered frame into the window and restore its depth values
+		GLint presentShaderUniforms[4]; // Locations of the presentation shader's uniform variables
+		bool haveTimerQueries; // Flag whether the context supports GPU timer queries
+		GLuint timerQueries[numTimerQueries]; // Timer queries measuring the GPU time of rendered frames
+		bool timerQueryIssued[numTimerQueries]; // Flags whether the respective timer query holds an outstanding measurement
+		unsigned int nextTimerQuery; // Index of the timer query to use for the next rendered frame
+		double frameTime; // Running average of GPU time per rendered frame in ms, or negative if not measured yet
+		GLfloat renderScale; // Current fraction of the window viewport size at which frames are rendered
+		GLsizei renderSize[2]; // Size of the most recently rendered frame
+		GLint savedFramebuffer; // Frame buffer bound when rendering of the current frame started
+		bool valid; // Flag whether the frame buffer holds a presentable frame
+		int viewportSize[2]; // Size of the window viewport for which the held frame was rendered
+		FrameKey frameKey; // Contents of the held frame
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	double timeBudget; // GPU time budget for the expensive passes in ms
+	GLfloat minRenderScale; // Smallest fraction of the window viewport size at which frames are rendered
+	
+	/* Private methods: */
+	void updateRenderScale(DataItem* dataItem) const; // Retrieves finished GPU time measurements and adapts the render scale to the time budget
+	
+	/* Constructors and destructors: */
+	public:
+	AdaptiveRenderTarget(void); // Creates an adaptive render target with a default time budget
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	void setTimeBudget(double newTimeBudget); // Sets the GPU time budget for the expensive passes in ms
+	void setMinRenderScale(GLfloat newMinRenderScale); // Sets the smallest fraction of the window viewport size at which frames are rendered; clamped to [0.25, 1]
+	bool beginFrame(const int viewport[4],const FrameKey& frameKey,int renderViewport[4],GLContextData& contextData) const; // Returns false if the held frame can be re-presented for the given window viewport and contents; otherwise redirects rendering into the off-screen frame buffer, returns the viewport to render into in renderViewport, and returns true
+	void endFrame(GLContextData& contextData) const; // Finishes rendering a frame started by a successful beginFrame call and restores the window's frame buffer
+	void present(GLContextData& contextData) const; // Upscales the held frame into the current window viewport, including its depth values
+	};
+
+#endif
@@ -0,0 +1,84 @@
+/***********************************************************************
+BakeDEMPyramid - Utility to bake a DEM grid file into a memory-mappable
+tiled DEM pyramid file for instant loading.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "DEMPyramid.h"
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	const char* gridFileName=0;
+	const char* pyramidFileName=0;
+	unsigned int tileSize=256;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"tileSize")==0&&i+1<argc)
+				{
+				++i;
+				tileSize=(unsigned int)(atoi(argv[i]));
+				}
+			else
+				{
+				gridFileName=0;
+				break;
+				}
+			}
+		else if(gridFileName==0)
+			gridFileName=argv[i];
+		else
+			pyramidFileName=argv[i];
+		}
+	if(gridFileName==0||tileSize==0)
+		{
+		std::cerr<<"Usage: "<<argv[0]<<" [-tileSize <tile size>] <DEM grid file name> [<pyramid file name>]"<<std::endl;
+		return 1;
+		}
+	
+	/* Replace the grid file's extension with the pyramid extension by default: */
+	std::string defaultPyramidFileName=gridFileName;
+	std::string::size_type extPos=defaultPyramidFileName.rfind('.');
+	if(extPos!=std::string::npos&&defaultPyramidFileName.find('/',extPos)==std::string::npos)
+		defaultPyramidFileName.erase(extPos);
+	defaultPyramidFileName.append(".demp");
+	if(pyramidFileName==0)
+		pyramidFileName=defaultPyramidFileName.c_str();
+	
+	/* Bake the pyramid: */
+	try
+		{
+		DEMPyramid::bake(gridFileName,pyramidFileName,tileSize);
+		}
+	catch(const std::exception& err)
+		{
+		std::cerr<<"BakeDEMPyramid: "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
@@ -0,0 +1,75 @@
+/***********************************************************************
+BakeSpriteAtlas - Utility to bake all dinosaur spritesheets into a
+single memory-mappable sprite atlas file for fast startup.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include "SpriteAtlas.h"
+#include "Config.h"
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	std::string spritesBasePath=std::string(CONFIG_SPRITEDIR)+"/";
+	const char* atlasFileName=0;
+	SpriteAtlas::Format format=SpriteAtlas::DXT5;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"rgba")==0)
+				format=SpriteAtlas::RGBA8;
+			else if(strcasecmp(argv[i]+1,"sprites")==0&&i+1<argc)
+				{
+				++i;
+				spritesBasePath=argv[i];
+				if(spritesBasePath.empty()||spritesBasePath[spritesBasePath.size()-1]!='/')
+					spritesBasePath.push_back('/');
+				}
+			else
+				{
+				std::cerr<<"Usage: "<<argv[0]<<" [-sprites <sprite directory>] [-rgba] [<atlas file name>]"<<std::endl;
+				return 1;
+				}
+			}
+		else
+			atlasFileName=argv[i];
+		}
+	std::string defaultAtlasFileName=SpriteAtlas::getDefaultFileName(spritesBasePath);
+	if(atlasFileName==0)
+		atlasFileName=defaultAtlasFileName.c_str();
+	
+	/* Bake the atlas: */
+	try
+		{
+		SpriteAtlas::bake(spritesBasePath,atlasFileName,format);
+		}
+	catch(const std::exception& err)
+		{
+		std::cerr<<"BakeSpriteAtlas: "<<err.what()<<std::endl;
+		return 1;
+		}
+	
+	return 0;
+	}
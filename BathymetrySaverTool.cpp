@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "BathymetrySaverTool.h"
 
+#include <stdio.h>
 #include <stdexcept>
 #include <iomanip>
 #include <Misc/PrintInteger.h>
@@ -34,8 +35,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <IO/OStream.h>
 #include <Comm/TCPPipe.h>
 #include <Math/Math.h>
+#include <Vrui/Vrui.h>
 
 #include "WaterTable2.h"
+#include "GridReadback.h"
 #include "Sandbox.h"
 
 /**********************************************************
@@ -43,7 +46,7 @@ Methods of class BathymetrySaverToolFactory::Configuration:
 **********************************************************/
 
 BathymetrySaverToolFactory::Configuration::Configuration(void)
-	:saveFileName("BathymetrySaverTool.dem"),
+	:saveFileName("BathymetrySaverTool.dem"),saveFormat("DEM"),saveInterval(0.0),
 	 postUpdate(false),postUpdatePort(80),postUpdatePage(""),
 	 postUpdateMessage("app.GenerateTileCache();"),
 	 gridScale(1.0)
@@ -53,6 +56,8 @@ BathymetrySaverToolFactory::Configuration::Configuration(void)
 void BathymetrySaverToolFactory::Configuration::read(const Misc::ConfigurationFileSection& cfs)
 	{
 	saveFileName=cfs.retrieveString("./saveFileName",saveFileName);
+	saveFormat=cfs.retrieveString("./saveFormat",saveFormat);
+	saveInterval=cfs.retrieveValue<double>("./saveInterval",saveInterval);
 	postUpdate=cfs.retrieveValue<bool>("./postUpdate",postUpdate);
 	postUpdateHostName=cfs.retrieveString("./postUpdateHostName",postUpdateHostName);
 	postUpdatePort=cfs.retrieveValue<int>("./postUpdatePort",postUpdatePort);
@@ -64,6 +69,8 @@ void BathymetrySaverToolFactory::Configuration::read(const Misc::ConfigurationFi
 void BathymetrySaverToolFactory::Configuration::write(Misc::ConfigurationFileSection& cfs) const
 	{
 	cfs.storeString("./saveFileName",saveFileName);
+	cfs.storeString("./saveFormat",saveFormat);
+	cfs.storeValue<double>("./saveInterval",saveInterval);
 	cfs.storeValue<bool>("./postUpdate",postUpdate);
 	cfs.storeString("./postUpdateHostName",postUpdateHostName);
 	cfs.storeValue<int>("./postUpdatePort",postUpdatePort);
@@ -153,6 +160,24 @@ std::ostream& printInt2(std::ostream& os,int value)
 	return os;
 	}
 
+void printInt6(char buffer[6],int value)
+	{
+	/* Write the value's digits right-aligned into the six-character field, like printInt2 but without stream formatting: */
+	bool negative=value<0;
+	unsigned int v=negative?(unsigned int)(-value):(unsigned int)(value);
+	int pos=6;
+	do
+		{
+		buffer[--pos]=char('0'+v%10U);
+		v/=10U;
+		}
+	while(v!=0U&&pos>0);
+	if(negative&&pos>0)
+		buffer[--pos]='-';
+	while(pos>0)
+		buffer[--pos]=' ';
+	}
+
 std::ostream& printFloat4(std::ostream& os,double value)
 	{
 	if(value!=0.0)
@@ -207,10 +232,10 @@ std::ostream& printFloat8(std::ostream& os,double value)
 
 }
 
-void BathymetrySaverTool::writeDEMFile(void) const
+void BathymetrySaverTool::writeDEMFile(const char* fileName,const GLfloat* grid) const
 	{
 	/* Open the output file as a std::ostream: */
-	IO::OStream demFile(IO::openFile(configuration.saveFileName.c_str(),IO::File::WriteOnly));
+	IO::OStream demFile(IO::openFile(fileName,IO::File::WriteOnly));
 	
 	/* Write the bathymetry name: */
 	static const char* fileHeader="Augmented Reality Sandbox bathymetry grid";
@@ -257,8 +282,8 @@ void BathymetrySaverTool::writeDEMFile(void) const
 	
 	/* Calculate and write the grid's elevation range: */
 	GLfloat elevMin,elevMax;
-	elevMin=elevMax=bathymetryBuffer[0];
-	const GLfloat* bbPtr=bathymetryBuffer+1;
+	elevMin=elevMax=grid[0];
+	const GLfloat* bbPtr=grid+1;
 	for(GLsizei count=factory->gridSize[1]*factory->gridSize[0]-1;count>0;--count,++bbPtr)
 		{
 		if(elevMin>*bbPtr)
@@ -308,6 +333,7 @@ void BathymetrySaverTool::writeDEMFile(void) const
 	size_t fileSize=864U;
 	
 	/* Write all grid columns: */
+	std::string record;
 	for(GLsizei column=0;column<factory->gridSize[0];++column)
 		{
 		/* Pad the current file size to a multiple of 1024: */
@@ -325,7 +351,7 @@ void BathymetrySaverTool::writeDEMFile(void) const
 		printFloat8(demFile,elevationBase); // Local datum elevation
 		
 		/* Calculate and write the profile's elevation range: */
-		const GLfloat* pPtr=bathymetryBuffer+column;
+		const GLfloat* pPtr=grid+column;
 		GLfloat elevMin,elevMax;
 		elevMin=elevMax=*pPtr;
 		pPtr+=factory->gridSize[0];
@@ -342,8 +368,9 @@ void BathymetrySaverTool::writeDEMFile(void) const
 		/* Update the file size: */
 		fileSize+=6*4+24*5;
 		
-		/* Quantize and write the profile's elevation postings: */
-		pPtr=bathymetryBuffer+column;
+		/* Quantize the profile's elevation postings into a buffer and write them in one go: */
+		record.clear();
+		pPtr=grid+column;
 		for(GLsizei count=factory->gridSize[1];count>0;--count,pPtr+=factory->gridSize[0])
 			{
 			/* Check if there is enough space left in the current 1024-character record: */
@@ -351,15 +378,18 @@ void BathymetrySaverTool::writeDEMFile(void) const
 			if(paddedSize-fileSize<10U) // Last four characters of each record need to be blank
 				{
 				/* Pad the record: */
-				for(;fileSize<paddedSize;++fileSize)
-					demFile<<' ';
+				record.append(paddedSize-fileSize,' ');
+				fileSize=paddedSize;
 				}
 			
 			/* Quantize and write the posting: */
 			double scaled=(double(*pPtr)*gs-elevationBase)*zScale;
-			printInt2(demFile,int(Math::floor(scaled+0.5)));
+			char posting[6];
+			printInt6(posting,int(Math::floor(scaled+0.5)));
+			record.append(posting,6);
 			fileSize+=6;
 			}
+		demFile.write(record.data(),record.size());
 		}
 	
 	/* Pad the current file size to a multiple of 1024: */
@@ -378,6 +408,33 @@ void BathymetrySaverTool::writeDEMFile(void) const
 		demFile<<' ';
 	}
 
+void BathymetrySaverTool::writeGridFile(const char* fileName,const GLfloat* grid) const
+	{
+	/* Open the output file: */
+	IO::FilePtr gridFile=IO::openFile(fileName,IO::File::WriteOnly);
+	gridFile->setEndianness(Misc::LittleEndian);
+	
+	/* Write the grid size and the same coverage as USGS DEM exports: */
+	double gs=configuration.gridScale;
+	static const double gridCenter[2]={609959.0, 4268028.0};
+	gridFile->write<int>(factory->gridSize[0]);
+	gridFile->write<int>(factory->gridSize[1]);
+	for(int i=0;i<2;++i)
+		gridFile->write<float>(float(gridCenter[i]-double(factory->gridSize[i]-1)*double(factory->cellSize[i])*gs*0.5));
+	for(int i=0;i<2;++i)
+		gridFile->write<float>(float(gridCenter[i]+double(factory->gridSize[i]-1)*double(factory->cellSize[i])*gs*0.5));
+	
+	/* Write the scaled elevation postings row by row: */
+	std::vector<float> row(factory->gridSize[0]);
+	const GLfloat* gPtr=grid;
+	for(GLsizei y=0;y<factory->gridSize[1];++y)
+		{
+		for(GLsizei x=0;x<factory->gridSize[0];++x,++gPtr)
+			row[x]=float(double(*gPtr)*gs);
+		gridFile->write<float>(&row[0],row.size());
+		}
+	}
+
 void BathymetrySaverTool::postUpdate(void) const
 	{
 	/* Connect to the HTTP server: */
@@ -579,25 +636,61 @@ void BathymetrySaverTool::postUpdate(void) const
 	// std::cout<<std::endl;
 	}
 
-void BathymetrySaverTool::readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData)
+void* BathymetrySaverTool::exportThreadMethod(void)
 	{
-	BathymetrySaverTool* thisPtr=static_cast<BathymetrySaverTool*>(userData);
-	
-	try
+	std::vector<GLfloat> grid;
+	while(true)
+		{
 		{
-		/* Export the bathymetry grid: */
-		thisPtr->writeDEMFile();
+		Threads::MutexCond::Lock exportLock(exportCond);
 		
-		if(thisPtr->configuration.postUpdate)
+		/* Wait until a new grid arrives or the tool shuts down: */
+		while(runExportThread&&!exportPending)
+			exportCond.wait(exportLock);
+		
+		/* Bail out once the last grid has been exported: */
+		if(!exportPending)
+			break;
+		
+		grid.swap(exportGrid);
+		exportPending=false;
+		}
+		
+		try
 			{
-			/* Send an update message to the configured web server: */
-			thisPtr->postUpdate();
+			/* Export the bathymetry grid into a temporary file and replace the save file with it, so that readers never see partial exports: */
+			std::string tempFileName=configuration.saveFileName+".tmp";
+			if(configuration.saveFormat=="Grid")
+				writeGridFile(tempFileName.c_str(),&grid[0]);
+			else
+				writeDEMFile(tempFileName.c_str(),&grid[0]);
+			if(rename(tempFileName.c_str(),configuration.saveFileName.c_str())!=0)
+				Misc::throwStdErr("Unable to replace file %s",configuration.saveFileName.c_str());
+			
+			if(configuration.postUpdate)
+				{
+				/* Send an update message to the configured web server: */
+				postUpdate();
+				}
+			}
+		catch(const std::runtime_error& err)
+			{
+			Misc::formattedUserError("Save Bathymetry: Unable to save bathymetry due to exception \"%s\"",err.what());
 			}
 		}
-	catch(const std::runtime_error& err)
-		{
-		Misc::formattedUserError("Save Bathymetry: Unable to save bathymetry due to exception \"%s\"",err.what());
-		}
+	
+	return 0;
+	}
+
+void BathymetrySaverTool::readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData)
+	{
+	BathymetrySaverTool* thisPtr=static_cast<BathymetrySaverTool*>(userData);
+	
+	/* Hand a copy of the grid to the export thread, replacing a grid that has not been exported yet: */
+	Threads::MutexCond::Lock exportLock(thisPtr->exportCond);
+	thisPtr->exportGrid.assign(bathymetryBuffer,bathymetryBuffer+size_t(factory->gridSize[1])*size_t(factory->gridSize[0]));
+	thisPtr->exportPending=true;
+	thisPtr->exportCond.signal();
 	}
 
 BathymetrySaverToolFactory* BathymetrySaverTool::initClass(WaterTable2* sWaterTable,Vrui::ToolManager& toolManager)
@@ -613,12 +706,27 @@ BathymetrySaverToolFactory* BathymetrySaverTool::initClass(WaterTable2* sWaterTa
 BathymetrySaverTool::BathymetrySaverTool(const Vrui::ToolFactory* factory,const Vrui::ToolInputAssignment& inputAssignment)
 	:Vrui::Tool(factory,inputAssignment),
 	 configuration(BathymetrySaverTool::factory->configuration),
-	 bathymetryBuffer(new GLfloat[BathymetrySaverTool::factory->gridSize[1]*BathymetrySaverTool::factory->gridSize[0]])
+	 bathymetryBuffer(new GLfloat[BathymetrySaverTool::factory->gridSize[1]*BathymetrySaverTool::factory->gridSize[0]]),
+	 exportPending(false),runExportThread(true),
+	 continuousExport(false),nextExportTime(0.0)
 	{
+	/* Start the background export thread: */
+	exportThread.start(this,&BathymetrySaverTool::exportThreadMethod);
 	}
 
 BathymetrySaverTool::~BathymetrySaverTool(void)
 	{
+	/* Make sure no outstanding grid read-back writes into the bathymetry buffer: */
+	application->gridReadback->cancelRequests(this);
+	
+	/* Shut down the export thread after it exported the last grid: */
+	{
+	Threads::MutexCond::Lock exportLock(exportCond);
+	runExportThread=false;
+	exportCond.signal();
+	}
+	exportThread.join();
+	
 	delete[] bathymetryBuffer;
 	}
 
@@ -643,7 +751,26 @@ void BathymetrySaverTool::buttonCallback(int buttonSlotIndex,Vrui::InputDevice::
 	{
 	if(cbData->newButtonState)
 		{
-		/* Request a bathymetry grid from the water table: */
-		application->gridRequest.requestGrids(bathymetryBuffer,0,&BathymetrySaverTool::readBackCallback,this);
+		if(configuration.saveInterval>0.0)
+			{
+			/* Toggle continuous export, starting with an immediate export: */
+			continuousExport=!continuousExport;
+			nextExportTime=Vrui::getApplicationTime();
+			}
+		else
+			{
+			/* Request a bathymetry grid from the water table: */
+			application->gridReadback->requestGrids(bathymetryBuffer,0,&BathymetrySaverTool::readBackCallback,this);
+			}
+		}
+	}
+
+void BathymetrySaverTool::frame(void)
+	{
+	/* Request a bathymetry grid when the next continuous export is due: */
+	if(continuousExport&&Vrui::getApplicationTime()>=nextExportTime)
+		{
+		if(application->gridReadback->requestGrids(bathymetryBuffer,0,&BathymetrySaverTool::readBackCallback,this))
+			nextExportTime=Vrui::getApplicationTime()+configuration.saveInterval;
 		}
 	}
@@ -24,6 +24,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define BATHYMETRYSAVERTOOL_INCLUDED
 
 #include <string>
+#include <vector>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
 #include <GL/gl.h>
 #include <Vrui/Tool.h>
 #include <Vrui/Application.h>
@@ -46,6 +49,8 @@ class BathymetrySaverToolFactory:public Vrui::ToolFactory
 		/* Elements: */
 		public:
 		std::string saveFileName; // Name of file to which to save the bathymetry grid
+		std::string saveFormat; // Format in which to save the bathymetry grid; "DEM" for USGS ASCII DEM, "Grid" for the binary grid format read by DEMTool
+		double saveInterval; // Interval in seconds between continuous exports while the tool is toggled on, or 0 to save once per button press
 		bool postUpdate; // Flag whether to post an update message to a web server after saving the bathymetry grid
 		std::string postUpdateHostName; // Name of web server to which to send update messages
 		int postUpdatePort; // TCP port number of web server to which to send update messages
@@ -89,11 +94,20 @@ class BathymetrySaverTool:public Vrui::Tool,public Vrui::Application::Tool<Sandb
 	static BathymetrySaverToolFactory* factory; // Pointer to the factory object for this class
 	BathymetrySaverToolFactory::Configuration configuration; // Configuration of this tool
 	GLfloat* bathymetryBuffer; // Bathymetry grid buffer
+	Threads::MutexCond exportCond; // Condition variable protecting the export grid and signaling new grids
+	std::vector<GLfloat> exportGrid; // Most recently read-back grid waiting to be exported
+	bool exportPending; // Flag whether the export grid holds a grid that has not been exported yet
+	volatile bool runExportThread; // Flag to keep the background export thread running
+	Threads::Thread exportThread; // Background thread writing export files and posting update messages
+	bool continuousExport; // Flag whether the tool is currently exporting at the configured interval
+	double nextExportTime; // Application time at which to request the next continuous export
 	
 	/* Private methods: */
-	void writeDEMFile(void) const; // Writes the bathymetry grid to a file in USGS DEM format
+	void writeDEMFile(const char* fileName,const GLfloat* grid) const; // Writes the given bathymetry grid to a file in USGS DEM format
+	void writeGridFile(const char* fileName,const GLfloat* grid) const; // Writes the given bathymetry grid to a file in binary grid format
 	void postUpdate(void) const; // Sends an update message to a web server
-	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback when a grid has been read back from the GPU
+	void* exportThreadMethod(void); // Method for the background export thread
+	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback when a grid has been read back from the GPU; hands the grid to the export thread
 	
 	/* Constructors and destructors: */
 	public:
@@ -106,6 +120,7 @@ class BathymetrySaverTool:public Vrui::Tool,public Vrui::Application::Tool<Sandb
 	virtual void storeState(Misc::ConfigurationFileSection& configFileSection) const;
 	virtual const Vrui::ToolFactory* getFactory(void) const;
 	virtual void buttonCallback(int buttonSlotIndex,Vrui::InputDevice::ButtonCallbackData* cbData);
+	virtual void frame(void);
 	};
 
 #endif
@@ -140,12 +140,187 @@ void CalibrateProjector::diskExtractionCallback(const Kinect::DiskExtractor::Dis
 	Vrui::requestUpdate();
 	}
 
+void CalibrateProjector::addTiePoint(const CalibrateProjector::TiePoint& tp)
+	{
+	tiePoints.push_back(tp);
+	
+	/* Create the tie point's associated two linear equations: */
+	double eq[2][12];
+	eq[0][0]=tp.o[0];
+	eq[0][1]=tp.o[1];
+	eq[0][2]=tp.o[2];
+	eq[0][3]=1.0;
+	eq[0][4]=0.0;
+	eq[0][5]=0.0;
+	eq[0][6]=0.0;
+	eq[0][7]=0.0;
+	eq[0][8]=-tp.p[0]*tp.o[0];
+	eq[0][9]=-tp.p[0]*tp.o[1];
+	eq[0][10]=-tp.p[0]*tp.o[2];
+	eq[0][11]=-tp.p[0];
+	
+	eq[1][0]=0.0;
+	eq[1][1]=0.0;
+	eq[1][2]=0.0;
+	eq[1][3]=0.0;
+	eq[1][4]=tp.o[0];
+	eq[1][5]=tp.o[1];
+	eq[1][6]=tp.o[2];
+	eq[1][7]=1.0;
+	eq[1][8]=-tp.p[1]*tp.o[0];
+	eq[1][9]=-tp.p[1]*tp.o[1];
+	eq[1][10]=-tp.p[1]*tp.o[2];
+	eq[1][11]=-tp.p[1];
+	
+	/* Insert the two equations into the least-squares system: */
+	for(int row=0;row<2;++row)
+		{
+		for(unsigned int i=0;i<12;++i)
+			for(unsigned int j=0;j<12;++j)
+				tiePointSystem(i,j)+=eq[row][i]*eq[row][j];
+		}
+	}
+
+bool CalibrateProjector::isTiePointConverged(void) const
+	{
+	/* Check if early termination is enabled and enough frames have been captured: */
+	size_t numFrames=tiePoints.size()-tiePointStart;
+	if(tiePointTolerance<=Scalar(0)||numFrames<minTiePointFrames)
+		return false;
+	
+	/* Calculate the mean of the current tie point's disk centers: */
+	OPoint::AffineCombiner cc;
+	for(std::vector<TiePoint>::const_iterator tpIt=tiePoints.begin()+tiePointStart;tpIt!=tiePoints.end();++tpIt)
+		cc.addPoint(tpIt->o);
+	OPoint mean=cc.getPoint();
+	
+	/* Compare the standard error of the mean against the tolerance: */
+	Scalar var(0);
+	for(std::vector<TiePoint>::const_iterator tpIt=tiePoints.begin()+tiePointStart;tpIt!=tiePoints.end();++tpIt)
+		var+=Geometry::sqrDist(tpIt->o,mean);
+	var/=Scalar(numFrames-1);
+	return var<=Math::sqr(tiePointTolerance)*Scalar(numFrames);
+	}
+
+bool CalibrateProjector::calcHomography(Math::Matrix& hom) const
+	{
+	/* Find the least square system's smallest eigenvalue: */
+	std::pair<Math::Matrix,Math::Matrix> qe=tiePointSystem.jacobiIteration();
+	unsigned int minEIndex=0;
+	double minE=Math::abs(qe.second(0,0));
+	for(unsigned int i=1;i<12;++i)
+		{
+		if(minE>Math::abs(qe.second(i,0)))
+			{
+			minEIndex=i;
+			minE=Math::abs(qe.second(i,0));
+			}
+		}
+	
+	/* Create the initial unscaled homography: */
+	for(int i=0;i<3;++i)
+		for(int j=0;j<4;++j)
+			hom(i,j)=qe.first(i*4+j,minEIndex);
+	
+	/* Scale the homography such that projected weights are positive distance from projector: */
+	double wLen=Math::sqrt(Math::sqr(hom(2,0))+Math::sqr(hom(2,1))+Math::sqr(hom(2,2)));
+	int numNegativeWeights=0;
+	for(std::vector<TiePoint>::const_iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
+		{
+		/* Calculate the object-space tie point's projected weight: */
+		double w=hom(2,3);
+		for(int j=0;j<3;++j)
+			w+=hom(2,j)*tpIt->o[j];
+		if(w<0.0)
+			++numNegativeWeights;
+		}
+	if(numNegativeWeights!=0&&numNegativeWeights!=int(tiePoints.size()))
+		return false;
+	if(numNegativeWeights>0)
+		wLen=-wLen;
+	for(int i=0;i<3;++i)
+		for(int j=0;j<4;++j)
+			hom(i,j)/=wLen;
+	
+	return true;
+	}
+
+double CalibrateProjector::calcReprojectionError(const Math::Matrix& hom,const CalibrateProjector::TiePoint& tp) const
+	{
+	Math::Matrix op(4,1);
+	for(int i=0;i<3;++i)
+		op(i)=tp.o[i];
+	op(3)=1.0;
+	
+	Math::Matrix pp=hom*op;
+	for(int i=0;i<2;++i)
+		pp(i)/=pp(2);
+	
+	return Math::sqrt(Math::sqr(pp(0)-tp.p[0])+Math::sqr(pp(1)-tp.p[1]));
+	}
+
+void CalibrateProjector::finishTiePoint(void)
+	{
+	/* Stop capturing this tie point: */
+	size_t numFrames=tiePoints.size()-tiePointStart;
+	std::cout<<"done after "<<numFrames<<" frames"<<std::endl;
+	capturingTiePoint=false;
+	
+	if(haveHomography)
+		{
+		/* Estimate the current calibration's accuracy by predicting the just-captured tie point's averaged disk center: */
+		TiePoint mean;
+		mean.p=tiePoints[tiePointStart].p;
+		OPoint::AffineCombiner cc;
+		for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin()+tiePointStart;tpIt!=tiePoints.end();++tpIt)
+			cc.addPoint(tpIt->o);
+		mean.o=cc.getPoint();
+		double error=calcReprojectionError(homography,mean);
+		std::cout<<"CalibrateProjector: Predicted reprojection error of new tie point: "<<error<<" pixels"<<std::endl;
+		
+		/* Count consecutive tie points that were predicted within tolerance: */
+		if(convergenceTolerance>0.0&&error<=convergenceTolerance)
+			++numConvergedTiePoints;
+		else
+			numConvergedTiePoints=0;
+		}
+	
+	/* Move to the next tie point: */
+	++tiePointIndex;
+	
+	if(tiePointIndex>=numTiePoints[0]*numTiePoints[1]||numConvergedTiePoints>=numConvergenceTiePoints)
+		{
+		if(tiePointIndex<numTiePoints[0]*numTiePoints[1])
+			std::cout<<"CalibrateProjector: Reprojection error converged after "<<tiePointIndex<<" tie points"<<std::endl;
+		
+		/* Calculate the calibration transformation: */
+		calcCalibration();
+		}
+	else if(tiePointIndex>=6)
+		{
+		/* Update the preliminary homography from the incrementally accumulated least-squares system: */
+		haveHomography=calcHomography(homography);
+		if(haveHomography)
+			{
+			double res=0.0;
+			for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
+				res+=Math::sqr(calcReprojectionError(homography,*tpIt));
+			res=Math::sqrt(res/double(tiePoints.size()));
+			std::cout<<"CalibrateProjector: Preliminary RMS calibration residual after "<<tiePointIndex<<" tie points: "<<res<<" pixels"<<std::endl;
+			}
+		}
+	}
+
 CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
-	 numTiePointFrames(60),numBackgroundFrames(120),
+	 numTiePointFrames(60),minTiePointFrames(10),tiePointTolerance(0.05),
+	 convergenceTolerance(0.0),numConvergenceTiePoints(2),
+	 numBackgroundFrames(120),
 	 camera(0),diskExtractor(0),projector(0),
 	 capturingBackground(false),capturingTiePoint(false),numCaptureFrames(0),
+	 tiePointSystem(12,12,0.0),tiePointStart(0),
 	 tiePointIndex(0),
+	 haveHomography(false),homography(3,4),numConvergedTiePoints(0),
 	 haveProjection(false),projection(4,4)
 	{
 	/* Register the custom tool class: */
@@ -227,6 +402,18 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 				if(i<argc)
 					blobMergeDepth=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"tpt")==0)
+				{
+				++i;
+				if(i<argc)
+					tiePointTolerance=Scalar(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"cet")==0)
+				{
+				++i;
+				if(i<argc)
+					convergenceTolerance=atof(argv[i]);
+				}
 			else if(strcasecmp(argv[i]+1,"tpf")==0)
 				{
 				++i;
@@ -274,6 +461,15 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 		std::cout<<"  -bmd <mamximum blob merge depth distance>"<<std::endl;
 		std::cout<<"     Maximum depth distance between adjacent pixels in the same blob."<<std::endl;
 		std::cout<<"     Default: 1"<<std::endl;
+		std::cout<<"  -tpt <tie point tolerance>"<<std::endl;
+		std::cout<<"     Stops capturing a tie point once the standard error of its averaged"<<std::endl;
+		std::cout<<"     disk center drops below the given distance in camera units (0: off)"<<std::endl;
+		std::cout<<"     Default: 0.05"<<std::endl;
+		std::cout<<"  -cet <reprojection error tolerance>"<<std::endl;
+		std::cout<<"     Finishes calibration early once the preliminary calibration predicts"<<std::endl;
+		std::cout<<"     two consecutive new tie points to within the given number of pixels"<<std::endl;
+		std::cout<<"     (0: off)"<<std::endl;
+		std::cout<<"     Default: 0"<<std::endl;
 		std::cout<<"  -tpf <tie point file name>"<<std::endl;
 		std::cout<<"     Reads initial calibration tie points from a CSV file"<<std::endl;
 		std::cout<<"  -pmf <projection matrix file name>"<<std::endl;
@@ -283,7 +479,7 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 		std::cout<<"     Generates a test projection matrix file"<<std::endl;
 		std::cout<<"     (does not require camera hardware)"<<std::endl;
 		}
-
+	
 	/* Check if we should generate a test projection matrix: */
 	if(generateTest)
 		{
@@ -291,7 +487,7 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 		{
 		IO::FilePtr projFile=IO::openFile(projectionMatrixFileName.c_str(),IO::File::WriteOnly);
 		projFile->setEndianness(Misc::LittleEndian);
-
+		
 		/* Write demo projection matrix (row-major) for sandbox at ~200cm:
 		   - sx=0.02, sy=0.025: Scale ~100x75cm sandbox to clip space
 		   - sz=0.005, tz=-1: Depth mapping
@@ -305,11 +501,11 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 		for(int i=0;i<16;++i)
 			projFile->write<double>(demoMatrix[i]);
 		} /* File closed here when projFile goes out of scope */
-
+		
 		std::cout<<"Generated demo projection matrix: "<<projectionMatrixFileName<<std::endl;
 		exit(0);
 		}
-
+	
 	/* Read the sandbox layout file: */
 	{
 	IO::ValueSource layoutSource(IO::openFile(sandboxLayoutFileName.c_str()));
@@ -354,7 +550,7 @@ CalibrateProjector::CalibrateProjector(int& argc,char**& argv)
 			for(int i=0;i<3;++i)
 				tp.o[i]=tiePointFile.readField<double>();
 			
-			tiePoints.push_back(tp);
+			addTiePoint(tp);
 			}
 		
 		if(tiePoints.size()>=size_t(numTiePoints[0]*numTiePoints[1]))
@@ -468,24 +664,12 @@ void CalibrateProjector::frame(void)
 			int y=(yIndex+1)*imageSize[1]/(numTiePoints[1]+1);
 			tp.p=PPoint(Scalar(x)+Scalar(0.5),Scalar(y)+Scalar(0.5));
 			tp.o=disk.center;
-			tiePoints.push_back(tp);
+			addTiePoint(tp);
 			
-			/* Check if that's enough: */
+			/* Check if that's enough, or if the averaged disk center has already settled: */
 			--numCaptureFrames;
-			if(numCaptureFrames==0)
-				{
-				/* Stop capturing this tie point and move to the next: */
-				std::cout<<"done"<<std::endl;
-				capturingTiePoint=false;
-				++tiePointIndex;
-				
-				/* Check if the calibration is complete: */
-				if(tiePointIndex>=numTiePoints[0]*numTiePoints[1])
-					{
-					/* Calculate the calibration transformation: */
-					calcCalibration();
-					}
-				}
+			if(numCaptureFrames==0||isTiePointConverged())
+				finishTiePoint();
 			}
 		}
 	
@@ -668,96 +852,19 @@ void CalibrateProjector::startTiePointCapture(void)
 	/* Start capturing a new tie point: */
 	capturingTiePoint=true;
 	numCaptureFrames=numTiePointFrames;
+	tiePointStart=tiePoints.size();
 	std::cout<<"CalibrateProjector: Capturing "<<numTiePointFrames<<" tie point frames..."<<std::flush;
 	}
 
 void CalibrateProjector::calcCalibration(void)
 	{
-	/* Create the least-squares system: */
-	Math::Matrix a(12,12,0.0);
-	
-	/* Process all tie points: */
-	for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
-		{
-		// DEBUGGING
-		// std::cout<<"Tie point: "<<tpIt->p[0]<<", "<<tpIt->p[1]<<", "<<tpIt->o[0]<<", "<<tpIt->o[1]<<", "<<tpIt->o[2]<<std::endl;
-		
-		/* Create the tie point's associated two linear equations: */
-		double eq[2][12];
-		eq[0][0]=tpIt->o[0];
-		eq[0][1]=tpIt->o[1];
-		eq[0][2]=tpIt->o[2];
-		eq[0][3]=1.0;
-		eq[0][4]=0.0;
-		eq[0][5]=0.0;
-		eq[0][6]=0.0;
-		eq[0][7]=0.0;
-		eq[0][8]=-tpIt->p[0]*tpIt->o[0];
-		eq[0][9]=-tpIt->p[0]*tpIt->o[1];
-		eq[0][10]=-tpIt->p[0]*tpIt->o[2];
-		eq[0][11]=-tpIt->p[0];
-		
-		eq[1][0]=0.0;
-		eq[1][1]=0.0;
-		eq[1][2]=0.0;
-		eq[1][3]=0.0;
-		eq[1][4]=tpIt->o[0];
-		eq[1][5]=tpIt->o[1];
-		eq[1][6]=tpIt->o[2];
-		eq[1][7]=1.0;
-		eq[1][8]=-tpIt->p[1]*tpIt->o[0];
-		eq[1][9]=-tpIt->p[1]*tpIt->o[1];
-		eq[1][10]=-tpIt->p[1]*tpIt->o[2];
-		eq[1][11]=-tpIt->p[1];
-		
-		/* Insert the two equations into the least-squares system: */
-		for(int row=0;row<2;++row)
-			{
-			for(unsigned int i=0;i<12;++i)
-				for(unsigned int j=0;j<12;++j)
-					a(i,j)+=eq[row][i]*eq[row][j];
-			}
-		}
-	
-	/* Find the least square system's smallest eigenvalue: */
-	std::pair<Math::Matrix,Math::Matrix> qe=a.jacobiIteration();
-	unsigned int minEIndex=0;
-	double minE=Math::abs(qe.second(0,0));
-	for(unsigned int i=1;i<12;++i)
-		{
-		if(minE>Math::abs(qe.second(i,0)))
-			{
-			minEIndex=i;
-			minE=Math::abs(qe.second(i,0));
-			}
-		}
-	
-	/* Create the initial unscaled homography: */
+	/* Solve the least-squares system accumulated from all tie points: */
 	Math::Matrix hom(3,4);
-	for(int i=0;i<3;++i)
-		for(int j=0;j<4;++j)
-			hom(i,j)=qe.first(i*4+j,minEIndex);
-	
-	/* Scale the homography such that projected weights are positive distance from projector: */
-	double wLen=Math::sqrt(Math::sqr(hom(2,0))+Math::sqr(hom(2,1))+Math::sqr(hom(2,2)));
-	int numNegativeWeights=0;
-	for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
+	if(calcHomography(hom))
 		{
-		/* Calculate the object-space tie point's projected weight: */
-		double w=hom(2,3);
-		for(int j=0;j<3;++j)
-			w+=hom(2,j)*tpIt->o[j];
-		if(w<0.0)
-			++numNegativeWeights;
-		}
-	if(numNegativeWeights==0||numNegativeWeights==int(tiePoints.size()))
-		{
-		/* Scale the homography: */
-		if(numNegativeWeights>0)
-			wLen=-wLen;
-		for(int i=0;i<3;++i)
-			for(int j=0;j<4;++j)
-				hom(i,j)/=wLen;
+		/* Keep the homography to estimate the accuracy of any further tie points: */
+		homography=hom;
+		haveHomography=true;
 		
 		/* Print the scaled homography: */
 		for(int i=0;i<3;++i)
@@ -771,18 +878,7 @@ void CalibrateProjector::calcCalibration(void)
 		/* Calculate the calibration residual: */
 		double res=0.0;
 		for(std::vector<TiePoint>::iterator tpIt=tiePoints.begin();tpIt!=tiePoints.end();++tpIt)
-			{
-			Math::Matrix op(4,1);
-			for(int i=0;i<3;++i)
-				op(i)=tpIt->o[i];
-			op(3)=1.0;
-			
-			Math::Matrix pp=hom*op;
-			for(int i=0;i<2;++i)
-				pp(i)/=pp(2);
-			
-			res+=Math::sqr(pp(0)-tpIt->p[0])+Math::sqr(pp(1)-tpIt->p[1]);
-			}
+			res+=Math::sqr(calcReprojectionError(hom,*tpIt));
 		res=Math::sqrt(res/double(tiePoints.size()));
 		std::cout<<"RMS calibration residual: "<<res<<std::endl;
 		
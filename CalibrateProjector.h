@@ -96,6 +96,10 @@ class CalibrateProjector:public Vrui::Application
 	ONTransform boxTransform; // Transformation from camera space to sandbox space (x along long sandbox axis, z up)
 	Box bbox; // Bounding box around the sandbox area
 	unsigned int numTiePointFrames; // Number of frames to capture per tie point
+	unsigned int minTiePointFrames; // Minimum number of frames to capture per tie point before checking for convergence
+	Scalar tiePointTolerance; // Standard error of a tie point's averaged disk center below which its capture ends early; 0 disables early termination
+	double convergenceTolerance; // Reprojection error of newly captured tie points in pixels below which the calibration ends early; 0 disables early termination
+	unsigned int numConvergenceTiePoints; // Number of consecutive tie points that must meet the reprojection error tolerance
 	unsigned int numBackgroundFrames; // Number of frames to capture for background removal
 	
 	Kinect::FrameSource* camera; // 3D video source to calibrate
@@ -107,7 +111,12 @@ class CalibrateProjector:public Vrui::Application
 	
 	Threads::TripleBuffer<Kinect::DiskExtractor::DiskList> diskList; // Triple buffer of lists of extracted disks
 	std::vector<TiePoint> tiePoints; // List of collected calibration tie points
+	Math::Matrix tiePointSystem; // Least-squares system accumulated from all collected tie points
+	size_t tiePointStart; // Index in the tie point list of the first frame of the tie point currently being captured
 	int tiePointIndex; // Index of the next tie point to be collected
+	bool haveHomography; // Flag if a preliminary homography has been computed from the tie points collected so far
+	Math::Matrix homography; // Preliminary homography used to estimate the reprojection error of newly captured tie points
+	unsigned int numConvergedTiePoints; // Number of consecutive captured tie points that met the reprojection error tolerance
 	bool haveProjection; // Flag if a projection matrix has been computed
 	Math::Matrix projection; // The current projection matrix
 	
@@ -120,6 +129,11 @@ class CalibrateProjector:public Vrui::Application
 	#endif
 	void backgroundCaptureCompleteCallback(Kinect::DirectFrameSource& camera); // Callback when the 3D camera is done capturing a background image
 	void diskExtractionCallback(const Kinect::DiskExtractor::DiskList& disks); // Called when a new list of disks has been extracted
+	void addTiePoint(const TiePoint& tp); // Adds a tie point to the tie point list and the least-squares system
+	bool isTiePointConverged(void) const; // Returns true if the averaged disk center of the tie point currently being captured is stable
+	bool calcHomography(Math::Matrix& hom) const; // Solves the least-squares system for a homography with positive projected weights; returns false if there is none
+	double calcReprojectionError(const Math::Matrix& hom,const TiePoint& tp) const; // Returns the distance in pixels between the given tie point's projection-space point and its object-space point projected by the given homography
+	void finishTiePoint(void); // Finishes capturing the current tie point and updates the preliminary calibration
 	
 	/* Constructors and destructors: */
 	public:
@@ -133,7 +147,7 @@ class CalibrateProjector:public Vrui::Application
 	/* New methods: */
 	void startBackgroundCapture(void); // Starts capturing a background frame
 	void startTiePointCapture(void); // Starts capturing an averaged depth frame
-	void calcCalibration(void); // Calculates the calibration transformation after all tie points have been collected
+	void calcCalibration(void); // Calculates the calibration transformation after all tie points have been collected, or after the reprojection error converged
 	};
 
 #endif
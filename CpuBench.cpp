@@ -0,0 +1,971 @@
+/***********************************************************************
+CpuBench - Offline micro-benchmark of the Augmented Reality Sandbox's
+CPU kernels on synthetic or recorded depth frames, reporting per-pixel
+and per-entity costs and comparing them against a baseline file.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <Misc/ThrowStdErr.h>
+#include <Misc/FunctionCalls.h>
+#include <IO/OpenFile.h>
+#include <IO/ValueSource.h>
+#include <IO/OStream.h>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <Geometry/Matrix.h>
+#include <Threads/MutexCond.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+#include "Types.h"
+#include "FrameFilter.h"
+#include "HandExtractor.h"
+#include "FindBlobs.h"
+#include "ValidPixelProperty.h"
+#include "TerrainQuery.h"
+#include "DinosaurEcosystem.h"
+#include "DepthReplaySource.h"
+#include "PerformanceProfiler.h"
+
+namespace {
+
+/**************
+Helper classes:
+**************/
+
+typedef Kinect::FrameSource::DepthPixel DepthPixel; // Type for raw depth pixels
+typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
+
+struct BenchResult // Structure for the result of one benchmark
+	{
+	/* Elements: */
+	public:
+	std::string name; // Benchmark name, without whitespace or commas
+	double value; // Best measured cost
+	const char* unit; // Unit of the measured cost
+	};
+
+class FilterSink // Class receiving output frames from a frame filter
+	{
+	/* Elements: */
+	public:
+	FrameFilter* filter; // The frame filter
+	Threads::MutexCond frameCond; // Condition variable signaling arrival of an output frame
+	unsigned int numFrames; // Number of received output frames
+	bool capture; // Flag whether to keep copies of the most recent output frame and its changed region
+	std::vector<float> lastFrame; // Copy of the most recent output frame if capture is enabled
+	PixelRect lastDirtyRegion; // Changed region of the most recent output frame if capture is enabled
+	
+	/* Constructors and destructors: */
+	FilterSink(void)
+		:filter(0),numFrames(0),capture(false)
+		{
+		}
+	
+	/* Methods: */
+	void outputFrame(const Kinect::FrameBuffer& frame) // Callback receiving an output frame
+		{
+		Threads::MutexCond::Lock frameLock(frameCond);
+		if(capture)
+			{
+			const float* framePtr=frame.getData<float>();
+			lastFrame.assign(framePtr,framePtr+frame.getSize(1)*frame.getSize(0));
+			lastDirtyRegion=filter->getOutputDirtyRegion();
+			}
+		filter->releaseFrame(frame);
+		++numFrames;
+		frameCond.signal();
+		}
+	void waitForFrames(unsigned int targetNumFrames) // Waits until the given number of output frames has been received
+		{
+		Threads::MutexCond::Lock frameLock(frameCond);
+		while(numFrames<targetNumFrames)
+			frameCond.wait(frameLock);
+		}
+	};
+
+class ForegroundProperty // Functor class to identify foreground pixels for blob extraction
+	{
+	/* Elements: */
+	private:
+	DepthPixel maxDepth; // Raw depth values below this are foreground
+	
+	/* Constructors and destructors: */
+	public:
+	ForegroundProperty(DepthPixel sMaxDepth)
+		:maxDepth(sMaxDepth)
+		{
+		}
+	
+	/* Methods: */
+	bool operator()(unsigned int x,unsigned int y,const DepthPixel& pixel) const
+		{
+		return pixel<maxDepth;
+		}
+	};
+
+class ReferenceValidPixelProperty // Functor class evaluating the full plane equations and color homography per pixel, against which ValidPixelProperty's lookup tables are checked
+	{
+	/* Elements: */
+	private:
+	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
+	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
+	Geometry::Matrix<float,3,4> colorDepthHomography; // Homography from 3D depth image space into 2D color image space
+	unsigned int colorSize[2]; // Width and height of color frames
+	
+	/* Constructors and destructors: */
+	public:
+	ReferenceValidPixelProperty(const float sMinPlane[4],const float sMaxPlane[4],const Geometry::Matrix<float,3,4>& sColorDepthHomography,const unsigned int sColorSize[2])
+		:colorDepthHomography(sColorDepthHomography)
+		{
+		for(int i=0;i<4;++i)
+			minPlane[i]=sMinPlane[i];
+		for(int i=0;i<4;++i)
+			maxPlane[i]=sMaxPlane[i];
+		for(int i=0;i<2;++i)
+			colorSize[i]=sColorSize[i];
+		}
+	
+	/* Methods: */
+	bool projectToColor(unsigned int x,unsigned int y,float pz,int& cx,int& cy) const
+		{
+		float px=float(x)+0.5f;
+		float py=float(y)+0.5f;
+		float cw=colorDepthHomography(2,0)*px+colorDepthHomography(2,1)*py+colorDepthHomography(2,2)*pz+colorDepthHomography(2,3);
+		cx=int(Math::floor((colorDepthHomography(0,0)*px+colorDepthHomography(0,1)*py+colorDepthHomography(0,2)*pz+colorDepthHomography(0,3))/cw));
+		cy=int(Math::floor((colorDepthHomography(1,0)*px+colorDepthHomography(1,1)*py+colorDepthHomography(1,2)*pz+colorDepthHomography(1,3))/cw));
+		return cx>=0&&cx<int(colorSize[0])&&cy>=0&&cy<int(colorSize[1]);
+		}
+	bool operator()(unsigned int x,unsigned int y,const DepthPixel& pixel) const
+		{
+		return operator()(x,y,float(pixel));
+		}
+	bool operator()(unsigned int x,unsigned int y,const float& pixel) const
+		{
+		float px=float(x)+0.5f;
+		float py=float(y)+0.5f;
+		float pz=pixel;
+		float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*pz+minPlane[3];
+		float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*pz+maxPlane[3];
+		return !(minD<0.0f||maxD>0.0f);
+		}
+	};
+
+/****************
+Helper functions:
+****************/
+
+void makeSyntheticFrames(const unsigned int size[2],unsigned int numFrames,std::vector<Kinect::FrameBuffer>& frames)
+	{
+	/* Create a noisy undulating sand surface with a hand moving across it in a circle: */
+	std::minstd_rand rng(1);
+	std::uniform_int_distribution<int> noise(-1,1);
+	std::uniform_int_distribution<int> dropout(0,99);
+	double palmRadius=double(size[0])*0.05;
+	for(unsigned int frameIndex=0;frameIndex<numFrames;++frameIndex)
+		{
+		Kinect::FrameBuffer frame(size[0],size[1],size[1]*size[0]*sizeof(DepthPixel));
+		double angle=2.0*Math::Constants<double>::pi*double(frameIndex)/double(numFrames);
+		double hx=double(size[0])*(0.5+0.3*Math::cos(angle));
+		double hy=double(size[1])*(0.5+0.3*Math::sin(angle));
+		DepthPixel* fPtr=frame.getData<DepthPixel>();
+		for(unsigned int y=0;y<size[1];++y)
+			for(unsigned int x=0;x<size[0];++x,++fPtr)
+				{
+				/* Check if the pixel is on the hand's palm or one of its four fingers: */
+				double dx=double(x)-hx;
+				double dy=double(y)-hy;
+				bool hand=dx*dx+dy*dy<=palmRadius*palmRadius;
+				for(int finger=0;finger<4&&!hand;++finger)
+					hand=dy>=0.0&&dy<palmRadius*2.2&&Math::abs(dx-(double(finger)-1.5)*palmRadius*0.5)<palmRadius*0.15;
+				
+				/* Simulate invalid pixels, the hand, or the sand surface: */
+				if(dropout(rng)==0)
+					*fPtr=DepthPixel(2047);
+				else if(hand)
+					*fPtr=DepthPixel(700+noise(rng));
+				else
+					*fPtr=DepthPixel(Math::floor(950.0+30.0*Math::sin(double(x)*0.02)*Math::cos(double(y)*0.03)+0.5)+noise(rng));
+				}
+		frames.push_back(frame);
+		}
+	}
+
+void loadRecordedFrames(const char* fileName,unsigned int maxNumFrames,unsigned int size[2],std::vector<Kinect::FrameBuffer>& frames,PixelDepthCorrection*& pixelDepthCorrection,PTransform& depthProjection)
+	{
+	/* Read the recording's parameters: */
+	DepthReplaySource replay(fileName,false,false);
+	for(int i=0;i<2;++i)
+		size[i]=replay.getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
+	Kinect::FrameSource::DepthCorrection* depthCorrection=replay.getDepthCorrectionParameters();
+	if(depthCorrection!=0)
+		{
+		pixelDepthCorrection=depthCorrection->getPixelCorrection(size);
+		delete depthCorrection;
+		}
+	depthProjection=replay.getIntrinsicParameters().depthProjection;
+	
+	/* Read the recording's depth frames: */
+	Kinect::FrameBuffer frame;
+	while(frames.size()<maxNumFrames&&replay.readDepthFrame(frame))
+		frames.push_back(frame);
+	if(frames.empty())
+		throw std::runtime_error("CpuBench: Depth recording does not contain any depth frames");
+	}
+
+double checkExponentialVariance(unsigned int numAveragingSlots,unsigned int numSamples)
+	{
+	/* Feed a noisy depth sequence with dropped samples into the frame filter's exponentially weighted statistics: */
+	std::minstd_rand rng(1);
+	std::normal_distribution<double> noise(800.0,2.0);
+	std::uniform_real_distribution<double> drop(0.0,1.0);
+	float alpha=1.0f/float(numAveragingSlots);
+	float weight=0.0f,mean=0.0f,deviation=0.0f;
+	std::vector<double> samples(numSamples);
+	std::vector<bool> valids(numSamples);
+	for(unsigned int i=0;i<numSamples;++i)
+		{
+		valids[i]=drop(rng)>=0.1;
+		samples[i]=Math::floor(noise(rng)+0.5);
+		if(valids[i])
+			FrameFilter::addExponentialSample(weight,mean,deviation,float(samples[i]),alpha);
+		else
+			{
+			weight*=1.0f-alpha;
+			deviation*=1.0f-alpha;
+			}
+		}
+	
+	/* Calculate the reference weighted sum of squared deviations, where sample i has weight alpha*(1-alpha)^(numSamples-1-i): */
+	double refWeight=0.0,refSum=0.0;
+	double sampleWeight=double(alpha);
+	for(unsigned int i=numSamples;i>0;--i,sampleWeight*=1.0-double(alpha))
+		if(valids[i-1])
+			{
+			refWeight+=sampleWeight;
+			refSum+=sampleWeight*samples[i-1];
+			}
+	double refMean=refSum/refWeight;
+	double refDeviation=0.0;
+	sampleWeight=double(alpha);
+	for(unsigned int i=numSamples;i>0;--i,sampleWeight*=1.0-double(alpha))
+		if(valids[i-1])
+			refDeviation+=sampleWeight*Math::sqr(samples[i-1]-refMean);
+	
+	/* Return the relative error of the incremental weighted variance: */
+	return Math::abs(double(deviation)/double(weight)-refDeviation/refWeight)/(refDeviation/refWeight);
+	}
+
+void makeValidPixelPlanes(const unsigned int size[2],float minPlane[4],float maxPlane[4],Geometry::Matrix<float,3,4>& colorDepthHomography)
+	{
+	/* Create a tilted band of valid depths between roughly 700 and 900 like a rain maker's elevation range: */
+	float tilt[2]={60.0f/float(size[0]),-40.0f/float(size[1])};
+	minPlane[0]=tilt[0];
+	minPlane[1]=tilt[1];
+	minPlane[2]=-1.0f;
+	minPlane[3]=890.0f;
+	maxPlane[0]=tilt[0];
+	maxPlane[1]=tilt[1];
+	maxPlane[2]=-1.0f;
+	maxPlane[3]=710.0f;
+	
+	/* Create a homography into a color image of the same size with a depth-dependent projective term: */
+	float h[3][4]=
+		{
+		{1.02f,0.013f,0.011f,-9.5f},
+		{-0.007f,0.98f,0.006f,4.25f},
+		{1.3e-5f,-2.1e-5f,1.1e-5f,0.991f}
+		};
+	for(int i=0;i<3;++i)
+		for(int j=0;j<4;++j)
+			colorDepthHomography(i,j)=h[i][j];
+	}
+
+void checkValidPixelProperty(const unsigned int size[2])
+	{
+	/* Create a lookup table-based pixel validity decider and a per-pixel reference: */
+	float minPlane[4],maxPlane[4];
+	Geometry::Matrix<float,3,4> colorDepthHomography;
+	makeValidPixelPlanes(size,minPlane,maxPlane,colorDepthHomography);
+	ValidPixelProperty vpp(minPlane,maxPlane,colorDepthHomography,size,size);
+	ReferenceValidPixelProperty ref(minPlane,maxPlane,colorDepthHomography,size);
+	
+	/* Compare both deciders at and around each pixel's plane crossings, where rounding differences would show: */
+	const float* planes[2]={minPlane,maxPlane};
+	for(unsigned int y=0;y<size[1];++y)
+		for(unsigned int x=0;x<size[0];++x)
+			for(int plane=0;plane<2;++plane)
+				{
+				const float* p=planes[plane];
+				float crossing=-(p[0]*(float(x)+0.5f)+p[1]*(float(y)+0.5f)+p[3])/p[2];
+				
+				/* Check raw integer depths: */
+				int rawCrossing=int(Math::floor(crossing));
+				for(int raw=rawCrossing-2;raw<=rawCrossing+2;++raw)
+					{
+					DepthPixel pixel=DepthPixel(raw);
+					if(vpp(x,y,pixel)!=ref(x,y,pixel))
+						Misc::throwStdErr("ValidPixelProperty differs from reference at pixel (%u, %u), raw depth %d",x,y,raw);
+					}
+				
+				/* Check float depths a few ulps around the crossing: */
+				float pz=crossing;
+				for(int i=0;i<4;++i)
+					pz=nextafterf(pz,0.0f);
+				for(int i=0;i<9;++i,pz=nextafterf(pz,2000.0f))
+					{
+					if(vpp(x,y,pz)!=ref(x,y,pz))
+						Misc::throwStdErr("ValidPixelProperty differs from reference at pixel (%u, %u), depth %.9g",x,y,pz);
+					
+					/* Check the projection into the color image: */
+					int cx,cy,refCx,refCy;
+					bool inside=vpp.projectToColor(x,y,pz,cx,cy);
+					bool refInside=ref.projectToColor(x,y,pz,refCx,refCy);
+					if(inside!=refInside||cx!=refCx||cy!=refCy)
+						Misc::throwStdErr("ValidPixelProperty color projection differs from reference at pixel (%u, %u), depth %.9g",x,y,pz);
+					}
+				}
+	}
+
+template <class PixelPropertyParam>
+double benchPixelProperty(const unsigned int size[2],const std::vector<Kinect::FrameBuffer>& frames,unsigned int numFrames,unsigned int numRepeats,const PixelPropertyParam& property,size_t& numValids)
+	{
+	/* Classify all pixels of the depth frames, keeping the best of several runs: */
+	double best=-1.0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		size_t runNumValids=0;
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int i=0;i<numFrames;++i)
+			{
+			const DepthPixel* fPtr=frames[i%frames.size()].getData<DepthPixel>();
+			for(unsigned int y=0;y<size[1];++y)
+				for(unsigned int x=0;x<size[0];++x,++fPtr)
+					if(property(x,y,*fPtr))
+						++runNumValids;
+			}
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/(double(numFrames)*double(size[1]*size[0]));
+		if(best<0.0||best>time)
+			best=time;
+		numValids=runNumValids;
+		}
+	
+	return best;
+	}
+
+unsigned int checkExponentialMinSamples(unsigned int numAveragingSlots)
+	{
+	/* Create a small exponentially averaging frame filter that requires a full averaging window of valid samples, and marks instable pixels: */
+	unsigned int size[2]={8,8};
+	PixelDepthCorrection* pixelDepthCorrection=new PixelDepthCorrection[size[1]*size[0]];
+	for(unsigned int i=0;i<size[1]*size[0];++i)
+		{
+		pixelDepthCorrection[i].scale=1.0f;
+		pixelDepthCorrection[i].offset=0.0f;
+		}
+	FilterSink sink;
+	sink.capture=true;
+	Plane basePlane(Plane::Vector(0,0,1),Scalar(0));
+	unsigned int numStableFrames=0;
+	{
+	FrameFilter filter(size,numAveragingSlots,pixelDepthCorrection,PTransform::identity,basePlane,1,FrameFilter::EXPONENTIAL);
+	filter.setStableParameters(numAveragingSlots,4);
+	filter.setRetainValids(false);
+	filter.setInstableValue(-1.0f);
+	filter.setSpatialFilter(false);
+	sink.filter=&filter;
+	filter.setOutputFrameFunction(Misc::createFunctionCall(&sink,&FilterSink::outputFrame));
+	
+	/* Feed constant frames until the first pixel becomes stable: */
+	Kinect::FrameBuffer frame(size[0],size[1],size[1]*size[0]*sizeof(DepthPixel));
+	DepthPixel* fPtr=frame.getData<DepthPixel>();
+	for(unsigned int i=0;i<size[1]*size[0];++i)
+		fPtr[i]=800;
+	while(numStableFrames<numAveragingSlots*2)
+		{
+		filter.receiveRawFrame(frame);
+		++numStableFrames;
+		sink.waitForFrames(numStableFrames);
+		if(sink.lastFrame[0]!=-1.0f)
+			break;
+		}
+	}
+	delete[] pixelDepthCorrection;
+	
+	/* Return the number of frames it took: */
+	return numStableFrames;
+	}
+
+void checkVectorizedFrameFilter(const unsigned int size[2],const std::vector<Kinect::FrameBuffer>& frames,unsigned int numFrames,unsigned int numThreads,bool retainValids)
+	{
+	/* Create per-pixel depth correction coefficients that are not exact in floating-point: */
+	std::minstd_rand rng(1);
+	std::uniform_real_distribution<float> scale(0.98f,1.02f);
+	std::uniform_real_distribution<float> offset(-5.0f,5.0f);
+	PixelDepthCorrection* pixelDepthCorrection=new PixelDepthCorrection[size[1]*size[0]];
+	for(unsigned int i=0;i<size[1]*size[0];++i)
+		{
+		pixelDepthCorrection[i].scale=scale(rng);
+		pixelDepthCorrection[i].offset=offset(rng);
+		}
+	
+	/* Create a scalar and a vectorized windowed frame filter with a tilted valid elevation range cutting through the frames' sand surface: */
+	FilterSink sinks[2];
+	Plane basePlane(Plane::Vector(0.013,-0.007,-1),Scalar(-1000));
+	unsigned int frameIndex;
+	{
+	FrameFilter* filters[2];
+	for(int i=0;i<2;++i)
+		{
+		filters[i]=new FrameFilter(size,30,pixelDepthCorrection,PTransform::identity,basePlane,numThreads,FrameFilter::WINDOWED);
+		filters[i]->setValidElevationInterval(PTransform::identity,basePlane,20.0,70.0);
+		filters[i]->setRetainValids(retainValids);
+		filters[i]->setInstableValue(-1.0f);
+		filters[i]->setVectorized(i!=0);
+		sinks[i].filter=filters[i];
+		sinks[i].capture=true;
+		filters[i]->setOutputFrameFunction(Misc::createFunctionCall(&sinks[i],&FilterSink::outputFrame));
+		}
+	
+	/* Feed both filters the same frames and compare their output frames and changed regions bit by bit: */
+	for(frameIndex=0;frameIndex<numFrames;++frameIndex)
+		{
+		for(int i=0;i<2;++i)
+			{
+			filters[i]->receiveRawFrame(frames[frameIndex%frames.size()]);
+			sinks[i].waitForFrames(frameIndex+1);
+			}
+		const PixelRect& r0=sinks[0].lastDirtyRegion;
+		const PixelRect& r1=sinks[1].lastDirtyRegion;
+		if(memcmp(&sinks[0].lastFrame[0],&sinks[1].lastFrame[0],size[1]*size[0]*sizeof(float))!=0||r0.min[0]!=r1.min[0]||r0.min[1]!=r1.min[1]||r0.max[0]!=r1.max[0]||r0.max[1]!=r1.max[1])
+			break;
+		}
+	
+	for(int i=0;i<2;++i)
+		delete filters[i];
+	}
+	delete[] pixelDepthCorrection;
+	
+	if(frameIndex<numFrames)
+		Misc::throwStdErr("Vectorized FrameFilter differs from scalar FrameFilter in frame %u with %u threads",frameIndex,numThreads);
+	}
+
+double benchFrameFilter(const unsigned int size[2],const std::vector<Kinect::FrameBuffer>& frames,unsigned int numWarmupFrames,unsigned int numFrames,unsigned int numRepeats,const PixelDepthCorrection* pixelDepthCorrection,const PTransform& depthProjection,unsigned int numThreads,FrameFilter::AveragingMode averagingMode,bool spatialFilter,bool vectorized)
+	{
+	/* Create a frame filter and feed it one frame at a time, waiting for each output frame; the sink must outlive the filter's threads: */
+	FilterSink sink;
+	Plane basePlane(Plane::Vector(0,0,1),Scalar(0));
+	FrameFilter filter(size,30,pixelDepthCorrection,depthProjection,basePlane,numThreads,averagingMode);
+	filter.setSpatialFilter(spatialFilter);
+	filter.setVectorized(vectorized);
+	sink.filter=&filter;
+	filter.setOutputFrameFunction(Misc::createFunctionCall(&sink,&FilterSink::outputFrame));
+	unsigned int frameIndex=0;
+	for(unsigned int i=0;i<numWarmupFrames;++i,++frameIndex)
+		{
+		filter.receiveRawFrame(frames[frameIndex%frames.size()]);
+		sink.waitForFrames(frameIndex+1);
+		}
+	
+	/* Keep the best of several measurement runs: */
+	double best=-1.0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int i=0;i<numFrames;++i,++frameIndex)
+			{
+			filter.receiveRawFrame(frames[frameIndex%frames.size()]);
+			sink.waitForFrames(frameIndex+1);
+			}
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/(double(numFrames)*double(size[1]*size[0]));
+		if(best<0.0||best>time)
+			best=time;
+		}
+	
+	return best;
+	}
+
+double benchHandExtractor(const unsigned int size[2],const std::vector<Kinect::FrameBuffer>& frames,unsigned int numFrames,unsigned int numRepeats,const PixelDepthCorrection* pixelDepthCorrection,const PTransform& depthProjection,bool coarseToFine,size_t& numHands)
+	{
+	/* Create a hand extractor processing frames in the calling thread: */
+	HandExtractor extractor(size,pixelDepthCorrection,depthProjection,false);
+	extractor.setCoarseToFine(coarseToFine);
+	HandExtractor::HandList hands;
+	
+	/* Keep the best of several measurement runs: */
+	double best=-1.0;
+	numHands=0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		size_t runNumHands=0;
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int i=0;i<numFrames;++i)
+			{
+			hands.clear();
+			extractor.extractHands(frames[i%frames.size()].getData<DepthPixel>(),hands,0);
+			runNumHands+=hands.size();
+			}
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/(double(numFrames)*double(size[1]*size[0]));
+		if(best<0.0||best>time)
+			best=time;
+		numHands=runNumHands;
+		}
+	
+	return best;
+	}
+
+double benchFindBlobs(const unsigned int size[2],const std::vector<Kinect::FrameBuffer>& frames,unsigned int numFrames,unsigned int numRepeats,DepthPixel blobDepth,unsigned int numThreads,size_t& numBlobs)
+	{
+	ForegroundProperty property(blobDepth);
+	
+	/* Keep the best of several measurement runs: */
+	double best=-1.0;
+	numBlobs=0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		size_t runNumBlobs=0;
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int i=0;i<numFrames;++i)
+			runNumBlobs+=findBlobs(size,frames[i%frames.size()].getData<DepthPixel>(),property,numThreads).size();
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/(double(numFrames)*double(size[1]*size[0]));
+		if(best<0.0||best>time)
+			best=time;
+		numBlobs=runNumBlobs;
+		}
+	
+	return best;
+	}
+
+void makeTerrainGrids(const unsigned int gridSize[2],const Scalar domainMin[3],const Scalar domainMax[3],std::vector<float>& bathymetry,std::vector<float>& waterLevel)
+	{
+	/* Create hilly vertex-centered bathymetry with pools in its valleys and a lava pit in one corner: */
+	bathymetry.resize((gridSize[1]-1)*(gridSize[0]-1));
+	float* bPtr=&bathymetry[0];
+	for(unsigned int y=0;y<gridSize[1]-1;++y)
+		for(unsigned int x=0;x<gridSize[0]-1;++x,++bPtr)
+			{
+			double nx=double(x)/double(gridSize[0]-2);
+			double ny=double(y)/double(gridSize[1]-2);
+			double elevation=20.0+15.0*Math::sin(nx*12.0)*Math::cos(ny*9.0);
+			if(nx<0.15&&ny<0.15)
+				elevation=-15.0;
+			*bPtr=float(elevation*(domainMax[2]-domainMin[2])/120.0);
+			}
+	
+	/* Fill all cell-centered water levels up to a common surface: */
+	waterLevel.resize(gridSize[1]*gridSize[0]);
+	float* wPtr=&waterLevel[0];
+	for(unsigned int y=0;y<gridSize[1];++y)
+		for(unsigned int x=0;x<gridSize[0];++x,++wPtr)
+			{
+			unsigned int bx=Math::min(x,gridSize[0]-2);
+			unsigned int by=Math::min(y,gridSize[1]-2);
+			*wPtr=Math::max(bathymetry[by*(gridSize[0]-1)+bx],12.0f);
+			}
+	}
+
+double benchTerrainQuery(const TerrainQuery& terrainQuery,const Scalar domainMin[3],const Scalar domainMax[3],unsigned int numQueries,unsigned int numRepeats)
+	{
+	/* Create a set of random query positions: */
+	std::minstd_rand rng(1);
+	std::uniform_real_distribution<Scalar> px(domainMin[0],domainMax[0]);
+	std::uniform_real_distribution<Scalar> py(domainMin[1],domainMax[1]);
+	std::vector<Point> points(65536);
+	for(std::vector<Point>::iterator pIt=points.begin();pIt!=points.end();++pIt)
+		*pIt=Point(px(rng),py(rng),Scalar(0));
+	
+	/* Query in batches of the size used by the dinosaur ecosystem: */
+	const size_t batchSize=16;
+	TerrainQuery::TerrainInfo infos[batchSize];
+	double best=-1.0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		size_t base=0;
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int i=0;i<numQueries;i+=batchSize)
+			{
+			terrainQuery.queryBatch(&points[base],batchSize,infos);
+			base=(base+batchSize)%points.size();
+			}
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/double((numQueries+batchSize-1)/batchSize*batchSize);
+		if(best<0.0||best>time)
+			best=time;
+		}
+	
+	return best;
+	}
+
+double benchDinosaurEcosystem(const TerrainQuery& terrainQuery,const Scalar domainMin[3],const Scalar domainMax[3],unsigned int population,unsigned int numSteps,unsigned int numRepeats,unsigned int numThreads)
+	{
+	/* Silence the ecosystem's spawn and death messages, which would otherwise dominate the measurement: */
+	std::cout.setstate(std::ios::failbit);
+	
+	/* Keep the best of several runs, each starting from the same population: */
+	double best=-1.0;
+	for(unsigned int repeat=0;repeat<numRepeats;++repeat)
+		{
+		/* Create an ecosystem and spawn all species in equal numbers at deterministic positions: */
+		DinosaurEcosystem ecosystem(numThreads,1);
+		DinosaurEcosystem::Bounds bounds;
+		bounds.minX=domainMin[0];
+		bounds.maxX=domainMax[0];
+		bounds.minY=domainMin[1];
+		bounds.maxY=domainMax[1];
+		bounds.minZ=domainMin[2];
+		bounds.maxZ=domainMax[2];
+		ecosystem.setBounds(bounds);
+		ecosystem.setTerrainQuery(&terrainQuery);
+		ecosystem.setSpeedScale(0.3);
+		std::minstd_rand rng(1);
+		std::uniform_real_distribution<Scalar> px(domainMin[0],domainMax[0]);
+		std::uniform_real_distribution<Scalar> py(domainMin[1],domainMax[1]);
+		for(unsigned int i=0;i<population;++i)
+			ecosystem.spawnDinosaur(DinosaurSpecies(i%DINO_NUM_SPECIES),Point(px(rng),py(rng),Scalar(0)));
+		
+		/* Run the ecosystem at a fixed frame rate: */
+		size_t numEntityUpdates=0;
+		double startTime=PerformanceProfiler::getTime();
+		for(unsigned int step=0;step<numSteps;++step)
+			{
+			numEntityUpdates+=ecosystem.getAliveCount();
+			ecosystem.update(1.0f/60.0f);
+			}
+		double time=(PerformanceProfiler::getTime()-startTime)*1.0e9/double(Math::max(numEntityUpdates,size_t(1)));
+		if(best<0.0||best>time)
+			best=time;
+		}
+	
+	std::cout.clear();
+	return best;
+	}
+
+void readBaseline(const char* fileName,std::vector<BenchResult>& baseline)
+	{
+	/* Read comma-separated benchmark names and costs, one per line: */
+	IO::ValueSource baselineSource(IO::openFile(fileName));
+	baselineSource.setPunctuation(",\n");
+	baselineSource.skipWs();
+	int line=1;
+	while(!baselineSource.eof())
+		{
+		BenchResult result;
+		result.name=baselineSource.readString();
+		if(!baselineSource.isLiteral(','))
+			Misc::throwStdErr("CpuBench: Format error in line %d of baseline file %s",line,fileName);
+		result.value=baselineSource.readNumber();
+		result.unit="";
+		if(!baselineSource.isLiteral('\n'))
+			Misc::throwStdErr("CpuBench: Format error in line %d of baseline file %s",line,fileName);
+		baseline.push_back(result);
+		++line;
+		}
+	}
+
+void writeBaseline(const char* fileName,const std::vector<BenchResult>& results)
+	{
+	IO::OStream baselineFile(IO::openFile(fileName,IO::File::WriteOnly));
+	baselineFile<<std::setprecision(6);
+	for(std::vector<BenchResult>::const_iterator rIt=results.begin();rIt!=results.end();++rIt)
+		baselineFile<<rIt->name<<','<<rIt->value<<'\n';
+	}
+
+void addResult(std::vector<BenchResult>& results,const std::string& name,double value,const char* unit)
+	{
+	BenchResult result;
+	result.name=name;
+	result.value=value;
+	result.unit=unit;
+	results.push_back(result);
+	std::cout<<std::setw(40)<<std::left<<name<<std::right<<std::fixed<<std::setprecision(3)<<std::setw(12)<<value<<' '<<unit<<std::endl;
+	}
+
+std::string threadSuffix(unsigned int numThreads)
+	{
+	char suffix[16];
+	snprintf(suffix,sizeof(suffix),"/t%u",numThreads);
+	return suffix;
+	}
+
+}
+
+int main(int argc,char* argv[])
+	{
+	/* Parse the command line: */
+	unsigned int size[2]={640,480};
+	const char* replayFileName=0;
+	unsigned int numWarmupFrames=30;
+	unsigned int numFrames=100;
+	unsigned int numRepeats=5;
+	unsigned int maxNumThreads=4;
+	DepthPixel blobDepth=800;
+	unsigned int gridSize[2]={640,480};
+	unsigned int numQueries=1000000;
+	std::vector<unsigned int> populations;
+	unsigned int numSteps=300;
+	const char* baselineFileName=0;
+	const char* saveBaselineFileName=0;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"size")==0&&i+2<argc)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					size[j]=Math::max((unsigned int)(atoi(argv[i])),8U);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"replay")==0&&i+1<argc)
+				{
+				++i;
+				replayFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"frames")==0&&i+1<argc)
+				{
+				++i;
+				numFrames=Math::max((unsigned int)(atoi(argv[i])),1U);
+				}
+			else if(strcasecmp(argv[i]+1,"repeats")==0&&i+1<argc)
+				{
+				++i;
+				numRepeats=Math::max((unsigned int)(atoi(argv[i])),1U);
+				}
+			else if(strcasecmp(argv[i]+1,"threads")==0&&i+1<argc)
+				{
+				++i;
+				maxNumThreads=Math::max((unsigned int)(atoi(argv[i])),1U);
+				}
+			else if(strcasecmp(argv[i]+1,"blobDepth")==0&&i+1<argc)
+				{
+				++i;
+				blobDepth=DepthPixel(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"gridSize")==0&&i+2<argc)
+				{
+				for(int j=0;j<2;++j)
+					{
+					++i;
+					gridSize[j]=Math::max((unsigned int)(atoi(argv[i])),3U);
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"queries")==0&&i+1<argc)
+				{
+				++i;
+				numQueries=Math::max((unsigned int)(atoi(argv[i])),1U);
+				}
+			else if(strcasecmp(argv[i]+1,"population")==0&&i+1<argc)
+				{
+				++i;
+				populations.push_back(Math::max((unsigned int)(atoi(argv[i])),1U));
+				}
+			else if(strcasecmp(argv[i]+1,"steps")==0&&i+1<argc)
+				{
+				++i;
+				numSteps=Math::max((unsigned int)(atoi(argv[i])),1U);
+				}
+			else if(strcasecmp(argv[i]+1,"baseline")==0&&i+1<argc)
+				{
+				++i;
+				baselineFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"saveBaseline")==0&&i+1<argc)
+				{
+				++i;
+				saveBaselineFileName=argv[i];
+				}
+			else
+				{
+				std::cerr<<"Usage: "<<argv[0]<<" [-size <width> <height>] [-replay <depth recording file name>] [-frames <number>] [-repeats <number>] [-threads <max number>] [-blobDepth <raw depth>] [-gridSize <width> <height>] [-queries <number>] [-population <number>]* [-steps <number>] [-baseline <file name>] [-saveBaseline <file name>]"<<std::endl;
+				return 1;
+				}
+			}
+		}
+	if(populations.empty())
+		{
+		/* Benchmark the default range of population sizes: */
+		for(unsigned int population=16;population<=1024;population*=4)
+			populations.push_back(population);
+		}
+	
+	/* Measure with one thread and with the maximum number of threads: */
+	std::vector<unsigned int> threadCounts;
+	threadCounts.push_back(1);
+	if(maxNumThreads>1)
+		threadCounts.push_back(maxNumThreads);
+	
+	std::vector<BenchResult> results;
+	PixelDepthCorrection* pixelDepthCorrection=0;
+	try
+		{
+		/* Create or load the depth frames: */
+		std::vector<Kinect::FrameBuffer> frames;
+		PTransform depthProjection=PTransform::identity;
+		if(replayFileName!=0)
+			loadRecordedFrames(replayFileName,numWarmupFrames+numFrames,size,frames,pixelDepthCorrection,depthProjection);
+		else
+			makeSyntheticFrames(size,numFrames,frames);
+		if(pixelDepthCorrection==0)
+			{
+			/* Create dummy per-pixel depth correction parameters: */
+			pixelDepthCorrection=new PixelDepthCorrection[size[1]*size[0]];
+			PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
+			for(unsigned int y=0;y<size[1];++y)
+				for(unsigned int x=0;x<size[0];++x,++pdcPtr)
+					{
+					pdcPtr->scale=1.0f;
+					pdcPtr->offset=0.0f;
+					}
+			}
+		std::cout<<"CpuBench: "<<frames.size()<<(replayFileName!=0?" recorded":" synthetic")<<" depth frames of size "<<size[0]<<"x"<<size[1]<<std::endl;
+		
+		/* Check the frame filter's exponentially weighted variance against a direct calculation: */
+		for(unsigned int numAveragingSlots=5;numAveragingSlots<=30;numAveragingSlots*=6)
+			{
+			double error=checkExponentialVariance(numAveragingSlots,1000);
+			std::cout<<"FrameFilter exponential variance over "<<numAveragingSlots<<" slots: relative error "<<error<<std::endl;
+			if(!(error<1.0e-3))
+				Misc::throwStdErr("FrameFilter exponential variance deviates from reference by %g",error);
+			}
+		
+		/* Check that the vectorized windowed frame filter produces exactly the same output as the scalar one: */
+		for(std::vector<unsigned int>::iterator tcIt=threadCounts.begin();tcIt!=threadCounts.end();++tcIt)
+			for(int retainValids=0;retainValids<2;++retainValids)
+				checkVectorizedFrameFilter(size,frames,numWarmupFrames+numFrames,*tcIt,retainValids!=0);
+		std::cout<<"FrameFilter vectorized windowed filter matches scalar filter"<<std::endl;
+		
+		/* Check that the exponentially weighted frame filter considers a pixel stable after exactly the minimum number of valid samples: */
+		for(unsigned int numAveragingSlots=1;numAveragingSlots<=60;++numAveragingSlots)
+			{
+			unsigned int numStableFrames=checkExponentialMinSamples(numAveragingSlots);
+			if(numStableFrames!=numAveragingSlots)
+				Misc::throwStdErr("FrameFilter exponential averaging over %u slots became stable after %u frames",numAveragingSlots,numStableFrames);
+			}
+		std::cout<<"FrameFilter exponential averaging becomes stable after exactly the minimum number of samples"<<std::endl;
+		
+		/* Check the rain maker's lookup table-based pixel validity decider against the per-pixel plane equations: */
+		checkValidPixelProperty(size);
+		std::cout<<"ValidPixelProperty lookup tables match per-pixel reference"<<std::endl;
+		
+		/* Benchmark the frame filter's temporal and spatial filter passes: */
+		for(std::vector<unsigned int>::iterator tcIt=threadCounts.begin();tcIt!=threadCounts.end();++tcIt)
+			{
+			addResult(results,"FrameFilter/windowed/scalar"+threadSuffix(*tcIt),benchFrameFilter(size,frames,numWarmupFrames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,*tcIt,FrameFilter::WINDOWED,false,false),"ns/pixel");
+			addResult(results,"FrameFilter/windowed"+threadSuffix(*tcIt),benchFrameFilter(size,frames,numWarmupFrames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,*tcIt,FrameFilter::WINDOWED,false,true),"ns/pixel");
+			addResult(results,"FrameFilter/windowed+spatial"+threadSuffix(*tcIt),benchFrameFilter(size,frames,numWarmupFrames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,*tcIt,FrameFilter::WINDOWED,true,true),"ns/pixel");
+			addResult(results,"FrameFilter/exponential+spatial"+threadSuffix(*tcIt),benchFrameFilter(size,frames,numWarmupFrames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,*tcIt,FrameFilter::EXPONENTIAL,true,true),"ns/pixel");
+			}
+		
+		/* Benchmark hand extraction at full resolution and coarse-to-fine: */
+		size_t numHands;
+		addResult(results,"HandExtractor/full",benchHandExtractor(size,frames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,false,numHands),"ns/pixel");
+		addResult(results,"HandExtractor/coarseToFine",benchHandExtractor(size,frames,numFrames,numRepeats,pixelDepthCorrection,depthProjection,true,numHands),"ns/pixel");
+		std::cout<<"  ("<<double(numHands)/double(numFrames)<<" hands per frame)"<<std::endl;
+		
+		/* Benchmark blob extraction: */
+		for(std::vector<unsigned int>::iterator tcIt=threadCounts.begin();tcIt!=threadCounts.end();++tcIt)
+			{
+			size_t numBlobs;
+			addResult(results,"findBlobs"+threadSuffix(*tcIt),benchFindBlobs(size,frames,numFrames,numRepeats,blobDepth,*tcIt,numBlobs),"ns/pixel");
+			std::cout<<"  ("<<double(numBlobs)/double(numFrames)<<" blobs per frame)"<<std::endl;
+			}
+		
+		/* Benchmark the rain maker's pixel validity decider with and without lookup tables: */
+		{
+		float minPlane[4],maxPlane[4];
+		Geometry::Matrix<float,3,4> colorDepthHomography;
+		makeValidPixelPlanes(size,minPlane,maxPlane,colorDepthHomography);
+		size_t numValids;
+		addResult(results,"ValidPixelProperty/reference",benchPixelProperty(size,frames,numFrames,numRepeats,ReferenceValidPixelProperty(minPlane,maxPlane,colorDepthHomography,size),numValids),"ns/pixel");
+		ValidPixelProperty vpp(minPlane,maxPlane,colorDepthHomography,size,size);
+		addResult(results,"ValidPixelProperty/lookup",benchPixelProperty(size,frames,numFrames,numRepeats,vpp,numValids),"ns/pixel");
+		std::cout<<"  ("<<double(numValids)/double(numFrames)<<" valid pixels per frame)"<<std::endl;
+		}
+		
+		/* Create a terrain query on synthetic grids: */
+		Scalar domainMin[3]={Scalar(-50),Scalar(-40),Scalar(-20)};
+		Scalar domainMax[3]={Scalar(50),Scalar(40),Scalar(100)};
+		std::vector<float> bathymetry,waterLevel;
+		makeTerrainGrids(gridSize,domainMin,domainMax,bathymetry,waterLevel);
+		TerrainQuery terrainQuery(gridSize[0],gridSize[1],domainMin,domainMax);
+		terrainQuery.setGrids(&bathymetry[0],&waterLevel[0]);
+		
+		/* Benchmark bilinear terrain sampling: */
+		addResult(results,"TerrainQuery/queryBatch",benchTerrainQuery(terrainQuery,domainMin,domainMax,numQueries,numRepeats),"ns/query");
+		
+		/* Benchmark the dinosaur ecosystem at all population sizes: */
+		for(std::vector<unsigned int>::iterator pIt=populations.begin();pIt!=populations.end();++pIt)
+			for(std::vector<unsigned int>::iterator tcIt=threadCounts.begin();tcIt!=threadCounts.end();++tcIt)
+				{
+				char name[64];
+				snprintf(name,sizeof(name),"DinosaurEcosystem/%u",*pIt);
+				addResult(results,name+threadSuffix(*tcIt),benchDinosaurEcosystem(terrainQuery,domainMin,domainMax,*pIt,numSteps,numRepeats,*tcIt),"ns/entity");
+				}
+		
+		/* Compare the results against a baseline: */
+		if(baselineFileName!=0)
+			{
+			std::vector<BenchResult> baseline;
+			readBaseline(baselineFileName,baseline);
+			std::cout<<std::endl<<"Comparison against baseline "<<baselineFileName<<":"<<std::endl;
+			for(std::vector<BenchResult>::iterator rIt=results.begin();rIt!=results.end();++rIt)
+				{
+				std::vector<BenchResult>::iterator bIt;
+				for(bIt=baseline.begin();bIt!=baseline.end()&&bIt->name!=rIt->name;++bIt)
+					;
+				std::cout<<std::setw(40)<<std::left<<rIt->name<<std::right;
+				if(bIt!=baseline.end()&&bIt->value>0.0)
+					{
+					double ratio=rIt->value/bIt->value;
+					std::cout<<std::setw(12)<<bIt->value<<" -> "<<std::setw(12)<<rIt->value<<' '<<rIt->unit<<" ("<<std::setprecision(2)<<ratio<<std::setprecision(3)<<"x)";
+					if(ratio>1.1)
+						std::cout<<" slower";
+					else if(ratio<0.9)
+						std::cout<<" faster";
+					}
+				else
+					std::cout<<" not in baseline";
+				std::cout<<std::endl;
+				}
+			}
+		
+		/* Save the results as a new baseline: */
+		if(saveBaselineFileName!=0)
+			writeBaseline(saveBaselineFileName,results);
+		}
+	catch(const std::exception& err)
+		{
+		std::cerr<<"CpuBench: "<<err.what()<<std::endl;
+		delete[] pixelDepthCorrection;
+		return 1;
+		}
+	
+	delete[] pixelDepthCorrection;
+	return 0;
+	}
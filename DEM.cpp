@@ -22,8 +22,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DEM.h"
 
+#include <Misc/FileNameExtensions.h>
 #include <IO/File.h>
 #include <IO/OpenFile.h>
+#include <Math/Math.h>
 #include <GL/gl.h>
 #include <GL/GLContextData.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
@@ -32,12 +34,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <Geometry/Matrix.h>
 
+#include "DEMPyramid.h"
+
 /******************************
 Methods of class DEM::DataItem:
 ******************************/
 
 DEM::DataItem::DataItem(void)
-	:textureObjectId(0)
+	:textureObjectId(0),regionVersion(0)
 	{
 	/* Check for and initialize all required OpenGL extensions: */
 	GLARBTextureFloat::initExtension();
@@ -65,12 +69,13 @@ void DEM::calcMatrix(void)
 	demTransform=PTransform(transform);
 	PTransform::Matrix& dtm=demTransform.getMatrix();
 	
-	/* Pre-multiply the projective transformation matrix with the DEM space to DEM pixel space transformation: */
+	/* Pre-multiply the projective transformation matrix with the DEM space to region pixel space transformation: */
 	PTransform dem;
-	dem.getMatrix()(0,0)=Scalar(demSize[0]-1)/(demBox[2]-demBox[0]);
-	dem.getMatrix()(0,3)=Scalar(0.5)-Scalar(demSize[0]-1)/(demBox[2]-demBox[0])*demBox[0];
-	dem.getMatrix()(1,1)=Scalar(demSize[1]-1)/(demBox[3]-demBox[1]);
-	dem.getMatrix()(1,3)=Scalar(0.5)-Scalar(demSize[1]-1)/(demBox[3]-demBox[1])*demBox[1];
+	Scalar levelScale=Scalar(1U<<regionLevel);
+	dem.getMatrix()(0,0)=Scalar(demSize[0]-1)/(demBox[2]-demBox[0])/levelScale;
+	dem.getMatrix()(0,3)=(Scalar(0.5)-Scalar(demSize[0]-1)/(demBox[2]-demBox[0])*demBox[0])/levelScale-Scalar(regionOrigin[0]);
+	dem.getMatrix()(1,1)=Scalar(demSize[1]-1)/(demBox[3]-demBox[1])/levelScale;
+	dem.getMatrix()(1,3)=(Scalar(0.5)-Scalar(demSize[1]-1)/(demBox[3]-demBox[1])*demBox[1])/levelScale-Scalar(regionOrigin[1]);
 	dem.getMatrix()(2,2)=Scalar(1)/verticalScale;
 	dem.getMatrix()(2,3)=verticalScaleBase-verticalScaleBase/verticalScale;
 	demTransform.leftMultiply(dem);
@@ -82,17 +87,54 @@ void DEM::calcMatrix(void)
 			*dtmPtr=GLfloat(dtm(i,j));
 	}
 
+void* DEM::loaderThreadMethod(void)
+	{
+	/* Copy the pending region out of the memory-mapped pyramid, which pages in only the tiles covering it: */
+	float* region=new float[size_t(pendingSize[1])*size_t(pendingSize[0])];
+	pyramid->extractRegion(pendingLevel,pendingOrigin,pendingSize,region);
+	
+	/* Hand the region to the main thread: */
+	{
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	pendingDem=region;
+	}
+	
+	return 0;
+	}
+
+void DEM::stopLoading(void)
+	{
+	if(loaderRunning)
+		{
+		loaderThread.join();
+		loaderRunning=false;
+		}
+	
+	/* Discard a region that was never installed: */
+	delete[] pendingDem;
+	pendingDem=0;
+	}
+
 DEM::DEM(void)
-	:dem(0),
+	:pyramid(0),averageElevation(0.0f),maxTextureSize(4096),
+	 dem(0),regionLevel(0),regionVersion(0),
+	 loaderRunning(false),pendingDem(0),pendingLevel(0),
 	 transform(OGTransform::identity),
 	 verticalScale(1),verticalScaleBase(0)
 	{
 	demSize[0]=demSize[1]=0;
+	for(int i=0;i<2;++i)
+		{
+		regionOrigin[i]=pendingOrigin[i]=0;
+		regionSize[i]=pendingSize[i]=0;
+		}
 	}
 
 DEM::~DEM(void)
 	{
+	stopLoading();
 	delete[] dem;
+	delete pyramid;
 	}
 
 void DEM::initContext(GLContextData& contextData) const
@@ -101,41 +143,150 @@ void DEM::initContext(GLContextData& contextData) const
 	DataItem* dataItem=new DataItem;
 	contextData.addDataItem(this,dataItem);
 	
-	/* Upload the DEM array into the texture object: */
+	/* Set up the texture object; the DEM region is uploaded when the texture is first bound: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,demSize[0],demSize[1],0,GL_LUMINANCE,GL_FLOAT,dem);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	}
 
 void DEM::load(const char* demFileName)
 	{
-	/* Read the DEM file: */
-	IO::FilePtr demFile=IO::openFile(demFileName);
-	demFile->setEndianness(Misc::LittleEndian);
-	demFile->read<int>(demSize,2);
-	dem=new float[demSize[1]*demSize[0]];
-	for(int i=0;i<4;++i)
-		demBox[i]=double(demFile->read<float>());
-	demFile->read<float>(dem,demSize[1]*demSize[0]);
+	/* Release a previously loaded DEM: */
+	stopLoading();
+	delete[] dem;
+	dem=0;
+	delete pyramid;
+	pyramid=0;
+	regionLevel=0;
+	for(int i=0;i<2;++i)
+		regionOrigin[i]=0;
+	
+	if(Misc::hasCaseExtension(demFileName,".demp"))
+		{
+		/* Memory-map the tiled DEM file and take the DEM's layout and statistics from its header: */
+		pyramid=new DEMPyramid(demFileName);
+		const DEMPyramid::Header& header=pyramid->getHeader();
+		for(int i=0;i<2;++i)
+			demSize[i]=int(header.demSize[i]);
+		for(int i=0;i<4;++i)
+			demBox[i]=Scalar(header.demBox[i]);
+		averageElevation=header.averageElevation;
+		}
+	else
+		{
+		/* Read the DEM file: */
+		IO::FilePtr demFile=IO::openFile(demFileName);
+		demFile->setEndianness(Misc::LittleEndian);
+		demFile->read<int>(demSize,2);
+		dem=new float[demSize[1]*demSize[0]];
+		for(int i=0;i<4;++i)
+			demBox[i]=double(demFile->read<float>());
+		demFile->read<float>(dem,demSize[1]*demSize[0]);
+		
+		/* Sum all elevation measurements to calculate the average elevation: */
+		double elevSum=0.0;
+		const float* demPtr=dem;
+		for(int i=demSize[1]*demSize[0];i>0;--i,++demPtr)
+			elevSum+=double(*demPtr);
+		averageElevation=float(elevSum/double(demSize[1]*demSize[0]));
+		
+		/* The entire grid is the DEM's only region: */
+		for(int i=0;i<2;++i)
+			regionSize[i]=(unsigned int)(demSize[i]);
+		++regionVersion;
+		}
 	
 	/* Update the DEM transformation: */
 	calcMatrix();
 	}
 
-float DEM::calcAverageElevation(void) const
+void DEM::loadRegion(const DEM::Box& box)
 	{
-	/* Sum all elevation measurements: */
-	double elevSum=0.0;
-	const float* demPtr=dem;
-	for(int i=demSize[1]*demSize[0];i>0;--i,++demPtr)
-		elevSum+=double(*demPtr);
-	
-	/* Return the average elevation: */
-	return float(elevSum/double(demSize[1]*demSize[0]));
+	if(pyramid==0)
+		return;
+	
+	/* Finish a previous region request: */
+	stopLoading();
+	
+	/* Find the range of full-resolution postings covered by the box's footprint in DEM space: */
+	Scalar pMin[2],pMax[2];
+	for(int i=0;i<2;++i)
+		{
+		pMin[i]=Scalar(demSize[i]-1);
+		pMax[i]=Scalar(0);
+		}
+	for(int v=0;v<8;++v)
+		{
+		Point demP=transform.transform(box.getVertex(v));
+		for(int i=0;i<2;++i)
+			{
+			Scalar p=(demP[i]-demBox[i])*Scalar(demSize[i]-1)/(demBox[2+i]-demBox[i]);
+			pMin[i]=Math::min(pMin[i],p);
+			pMax[i]=Math::max(pMax[i],p);
+			}
+		}
+	for(int i=0;i<2;++i)
+		{
+		pMin[i]=Math::max(pMin[i],Scalar(0));
+		pMax[i]=Math::min(pMax[i],Scalar(demSize[i]-1));
+		if(pMin[i]>pMax[i])
+			{
+			/* The box does not overlap the DEM; load the entire DEM instead: */
+			pMin[i]=Scalar(0);
+			pMax[i]=Scalar(demSize[i]-1);
+			}
+		}
+	
+	/* Find the finest pyramid level at which the range, plus a border of one posting for interpolation, fits into the maximum texture size: */
+	const DEMPyramid::Header& header=pyramid->getHeader();
+	unsigned int level=0;
+	while(level+1<header.numLevels&&Math::max(pMax[0]-pMin[0],pMax[1]-pMin[1])/Scalar(1U<<level)+Scalar(3)>Scalar(maxTextureSize))
+		++level;
+	
+	/* Convert the range to the level's postings: */
+	const DEMPyramid::Level& l=pyramid->getLevel(level);
+	Scalar levelScale=Scalar(1U<<level);
+	for(int i=0;i<2;++i)
+		{
+		int first=int(Math::floor((pMin[i]+Scalar(0.5))/levelScale-Scalar(0.5)))-1;
+		int last=int(Math::ceil((pMax[i]+Scalar(0.5))/levelScale-Scalar(0.5)))+1;
+		first=Math::max(first,0);
+		last=Math::min(last,int(l.levelSize[i])-1);
+		pendingOrigin[i]=(unsigned int)(first);
+		pendingSize[i]=(unsigned int)(last-first+1);
+		}
+	pendingLevel=level;
+	
+	/* Extract the region in the background: */
+	loaderRunning=true;
+	loaderThread.start(this,&DEM::loaderThreadMethod);
+	}
+
+bool DEM::update(void)
+	{
+	Threads::Mutex::Lock pendingLock(pendingMutex);
+	if(pendingDem==0)
+		return false;
+	
+	/* Install the pending region: */
+	delete[] dem;
+	dem=pendingDem;
+	pendingDem=0;
+	regionLevel=pendingLevel;
+	for(int i=0;i<2;++i)
+		{
+		regionOrigin[i]=pendingOrigin[i];
+		regionSize[i]=pendingSize[i];
+		}
+	++regionVersion;
+	
+	/* Update the DEM transformation to map into the new region: */
+	calcMatrix();
+	
+	return true;
 	}
 
 void DEM::setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase)
@@ -155,6 +306,13 @@ void DEM::bindTexture(GLContextData& contextData) const
 	
 	/* Bind the DEM texture: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->textureObjectId);
+	
+	/* Upload the current DEM region if the texture object is outdated: */
+	if(dataItem->regionVersion!=regionVersion&&dem!=0)
+		{
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,regionSize[0],regionSize[1],0,GL_LUMINANCE,GL_FLOAT,dem);
+		dataItem->regionVersion=regionVersion;
+		}
 	}
 
 void DEM::uploadDemTransform(GLint location) const
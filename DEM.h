@@ -23,20 +23,30 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef DEM_INCLUDED
 #define DEM_INCLUDED
 
+#include <Geometry/Box.h>
 #include <GL/gl.h>
 #include <GL/GLObject.h>
+#include <Threads/Mutex.h>
+#include <Threads/Thread.h>
 
 #include "Types.h"
 
+/* Forward declarations: */
+class DEMPyramid;
+
 class DEM:public GLObject
 	{
 	/* Embedded classes: */
+	public:
+	typedef Geometry::Box<Scalar,3> Box; // Type for bounding boxes
+	
 	private:
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
 		public:
 		GLuint textureObjectId; // ID of texture object holding digital elevation model
+		unsigned int regionVersion; // Version of the DEM region currently in the texture object
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -47,7 +57,21 @@ class DEM:public GLObject
 	private:
 	int demSize[2]; // Width and height of the DEM grid
 	Scalar demBox[4]; // Lower-left and upper-right corner coordinates of the DEM
-	float* dem; // Array of DEM elevation measurements
+	DEMPyramid* pyramid; // Memory-mapped tiled DEM file, or NULL if the DEM was loaded from a grid file
+	float averageElevation; // Average elevation of the full-resolution DEM
+	int maxTextureSize; // Maximum width and height of the DEM region uploaded to OpenGL
+	float* dem; // Array of DEM elevation measurements covering the current region
+	unsigned int regionLevel; // Pyramid level of the current region
+	unsigned int regionOrigin[2]; // Lower-left posting of the current region in its pyramid level
+	unsigned int regionSize[2]; // Width and height of the current region
+	unsigned int regionVersion; // Version number of the current region, incremented whenever a new region is installed
+	Threads::Thread loaderThread; // Background thread extracting a region from the pyramid
+	bool loaderRunning; // Flag whether the loader thread was started and not yet joined
+	Threads::Mutex pendingMutex; // Mutex protecting the region handed from the loader thread to the main thread
+	float* pendingDem; // Region extracted by the loader thread, or NULL
+	unsigned int pendingLevel; // Pyramid level of the pending region
+	unsigned int pendingOrigin[2]; // Lower-left posting of the pending region
+	unsigned int pendingSize[2]; // Width and height of the pending region
 	OGTransform transform; // Transformation from camera space to DEM space (z up)
 	Scalar verticalScale; // Vertical scale (exaggeration) factor
 	Scalar verticalScaleBase; // Base elevation around which vertical scale is applied
@@ -56,6 +80,8 @@ class DEM:public GLObject
 	
 	/* Private methods: */
 	void calcMatrix(void); // Calculates the camera space to DEM pixel space transformation
+	void* loaderThreadMethod(void); // Method for the background thread extracting the pending region
+	void stopLoading(void); // Waits for a running loader thread to finish
 	
 	/* Constructors and destructors: */
 	public:
@@ -66,12 +92,37 @@ class DEM:public GLObject
 	virtual void initContext(GLContextData& contextData) const;
 	
 	/* New methods: */
-	void load(const char* demFileName); // Loads the DEM from the given file
+	void load(const char* demFileName); // Loads the DEM from the given grid file, or memory-maps the given tiled DEM file (.demp) without reading its elevations
+	void setMaxTextureSize(int newMaxTextureSize) // Sets the maximum width and height of regions to be uploaded to OpenGL
+		{
+		maxTextureSize=newMaxTextureSize;
+		}
+	int getMaxTextureSize(void) const // Returns the maximum width and height of regions to be uploaded to OpenGL
+		{
+		return maxTextureSize;
+		}
+	void loadRegion(const Box& box); // Starts extracting the part of a tiled DEM seen from the given camera-space box in a background thread, at the finest pyramid level fitting the maximum texture size; must be called after setTransform; does nothing for DEMs loaded from grid files
+	bool update(void); // Installs a region finished by the background thread; returns true if a new region was installed; must be called from the main thread
+	bool isReady(void) const // Returns true if the DEM has at least one region to display
+		{
+		return dem!=0;
+		}
+	const int* getDemSize(void) const // Returns the width and height of the DEM grid
+		{
+		return demSize;
+		}
+	const float* getDemGrid(void) const // Returns the DEM's full-resolution elevation measurements in row-major order, or NULL if the DEM was loaded from a tiled DEM file
+		{
+		return pyramid==0?dem:0;
+		}
 	const Scalar* getDemBox(void) const // Returns the DEM's bounding box as lower-left x, lower-left y, upper-right x, upper-right y
 		{
 		return demBox;
 		}
-	float calcAverageElevation(void) const; // Calculates the average elevation of the DEM
+	float calcAverageElevation(void) const // Returns the average elevation of the DEM, as calculated when it was loaded
+		{
+		return averageElevation;
+		}
 	void setTransform(const OGTransform& newTransform,Scalar newVerticalScale,Scalar newVerticalScaleBase); // Sets the DEM transformation
 	const PTransform& getDemTransform(void) const // Returns the full transformation from camera space to vertically-scaled DEM pixel space
 		{
@@ -0,0 +1,246 @@
+/***********************************************************************
+DEMPyramid - Class to write and memory-map tiled digital elevation model
+files holding a mip pyramid of the elevation grid and precomputed
+elevation statistics.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DEMPyramid.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+#include <Misc/Endianness.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void downsample(const std::vector<float>& source,const unsigned int sourceSize[2],std::vector<float>& dest,unsigned int destSize[2])
+	{
+	/* Average each 2x2 block of source postings, clamping at the right and top edges: */
+	for(int i=0;i<2;++i)
+		destSize[i]=(sourceSize[i]+1)/2;
+	dest.resize(size_t(destSize[1])*size_t(destSize[0]));
+	float* dPtr=&dest[0];
+	for(unsigned int y=0;y<destSize[1];++y)
+		{
+		unsigned int y0=y*2;
+		unsigned int y1=std::min(y0+1,sourceSize[1]-1);
+		for(unsigned int x=0;x<destSize[0];++x,++dPtr)
+			{
+			unsigned int x0=x*2;
+			unsigned int x1=std::min(x0+1,sourceSize[0]-1);
+			const float* row0=&source[size_t(y0)*size_t(sourceSize[0])];
+			const float* row1=&source[size_t(y1)*size_t(sourceSize[0])];
+			*dPtr=(row0[x0]+row0[x1]+row1[x0]+row1[x1])*0.25f;
+			}
+		}
+	}
+
+}
+
+/***************************
+Methods of class DEMPyramid:
+***************************/
+
+DEMPyramid::DEMPyramid(const char* pyramidFileName)
+	:fd(-1),mapping(MAP_FAILED),mappingSize(0),
+	 header(0),levels(0)
+	{
+	/* Open and map the pyramid file: */
+	fd=open(pyramidFileName,O_RDONLY);
+	if(fd<0)
+		throw std::runtime_error(std::string("DEMPyramid: Unable to open pyramid file ")+pyramidFileName);
+	struct stat fileStats;
+	if(fstat(fd,&fileStats)==0)
+		{
+		mappingSize=size_t(fileStats.st_size);
+		if(mappingSize>=sizeof(Header))
+			mapping=mmap(0,mappingSize,PROT_READ,MAP_SHARED,fd,0);
+		}
+	if(mapping==MAP_FAILED)
+		{
+		close(fd);
+		throw std::runtime_error(std::string("DEMPyramid: Unable to map pyramid file ")+pyramidFileName);
+		}
+	
+	/* Validate the header and level table; the mapping is used in place, so a big-endian host will read a mismatching version number: */
+	header=static_cast<const Header*>(mapping);
+	levels=reinterpret_cast<const Level*>(header+1);
+	bool valid=memcmp(header->magic,"SARndboxDEMTile",16)==0&&header->version==fileVersion;
+	valid=valid&&header->tileSize>0&&header->numLevels>0&&header->demSize[0]>0&&header->demSize[1]>0;
+	valid=valid&&sizeof(Header)+header->numLevels*sizeof(Level)<=mappingSize;
+	size_t tileDataSize=size_t(header->tileSize)*size_t(header->tileSize)*sizeof(float);
+	for(unsigned int i=0;valid&&i<header->numLevels;++i)
+		valid=levels[i].dataOffset+size_t(levels[i].numTiles[1])*size_t(levels[i].numTiles[0])*tileDataSize<=mappingSize;
+	if(!valid)
+		{
+		munmap(mapping,mappingSize);
+		close(fd);
+		throw std::runtime_error(std::string("DEMPyramid: Invalid pyramid file ")+pyramidFileName);
+		}
+	}
+
+DEMPyramid::~DEMPyramid(void)
+	{
+	munmap(mapping,mappingSize);
+	close(fd);
+	}
+
+void DEMPyramid::bake(const char* gridFileName,const char* pyramidFileName,unsigned int tileSize)
+	{
+	/* Read the DEM grid file: */
+	IO::FilePtr gridFile=IO::openFile(gridFileName);
+	gridFile->setEndianness(Misc::LittleEndian);
+	int gridSize[2];
+	gridFile->read<int>(gridSize,2);
+	if(gridSize[0]<=0||gridSize[1]<=0)
+		throw std::runtime_error(std::string("DEMPyramid: Invalid DEM grid file ")+gridFileName);
+	float demBox[4];
+	gridFile->read<float>(demBox,4);
+	std::vector<std::vector<float> > levelGrids(1);
+	levelGrids[0].resize(size_t(gridSize[1])*size_t(gridSize[0]));
+	gridFile->read<float>(&levelGrids[0][0],levelGrids[0].size());
+	
+	/* Calculate the full-resolution grid's elevation statistics: */
+	const std::vector<float>& grid=levelGrids[0];
+	float elevationRange[2]={grid[0],grid[0]};
+	double elevSum=0.0;
+	for(std::vector<float>::const_iterator gIt=grid.begin();gIt!=grid.end();++gIt)
+		{
+		elevationRange[0]=std::min(elevationRange[0],*gIt);
+		elevationRange[1]=std::max(elevationRange[1],*gIt);
+		elevSum+=double(*gIt);
+		}
+	float averageElevation=float(elevSum/double(grid.size()));
+	
+	/* Create pyramid levels until a level fits into a single tile: */
+	std::vector<Level> levelTable;
+	Level level0;
+	for(int i=0;i<2;++i)
+		level0.levelSize[i]=(unsigned int)(gridSize[i]);
+	levelTable.push_back(level0);
+	while(levelTable.back().levelSize[0]>tileSize||levelTable.back().levelSize[1]>tileSize)
+		{
+		Level next;
+		levelGrids.push_back(std::vector<float>());
+		downsample(levelGrids[levelGrids.size()-2],levelTable.back().levelSize,levelGrids.back(),next.levelSize);
+		levelTable.push_back(next);
+		}
+	
+	/* Calculate the file layout: */
+	size_t tileDataSize=size_t(tileSize)*size_t(tileSize)*sizeof(float);
+	size_t tableEnd=sizeof(Header)+levelTable.size()*sizeof(Level);
+	size_t dataOffset=(tableEnd+dataAlignment-1)&~(dataAlignment-1);
+	for(std::vector<Level>::iterator lIt=levelTable.begin();lIt!=levelTable.end();++lIt)
+		{
+		for(int i=0;i<2;++i)
+			lIt->numTiles[i]=(lIt->levelSize[i]+tileSize-1)/tileSize;
+		lIt->dataOffset=dataOffset;
+		size_t levelDataSize=size_t(lIt->numTiles[1])*size_t(lIt->numTiles[0])*tileDataSize;
+		dataOffset+=(levelDataSize+dataAlignment-1)&~(dataAlignment-1);
+		}
+	
+	/* Write the header: */
+	IO::FilePtr file=IO::openFile(pyramidFileName,IO::File::WriteOnly);
+	file->setEndianness(Misc::LittleEndian);
+	char magic[16];
+	memset(magic,0,sizeof(magic));
+	strncpy(magic,"SARndboxDEMTile",sizeof(magic));
+	file->write(magic,sizeof(magic));
+	file->write<unsigned int>(fileVersion);
+	file->write<unsigned int>(levelTable[0].levelSize,2);
+	file->write<unsigned int>(tileSize);
+	file->write<unsigned int>((unsigned int)levelTable.size());
+	file->write<float>(demBox,4);
+	file->write<float>(elevationRange,2);
+	file->write<float>(averageElevation);
+	
+	/* Write the level table: */
+	for(std::vector<Level>::iterator lIt=levelTable.begin();lIt!=levelTable.end();++lIt)
+		{
+		file->write<unsigned int>(lIt->levelSize,2);
+		file->write<unsigned int>(lIt->numTiles,2);
+		file->write<unsigned long long>(lIt->dataOffset);
+		}
+	
+	/* Write each level's tiles, padded to the data alignment: */
+	std::vector<unsigned char> zeros(dataAlignment,0);
+	size_t filePos=tableEnd;
+	std::vector<float> tile(size_t(tileSize)*size_t(tileSize));
+	for(size_t l=0;l<levelTable.size();++l)
+		{
+		const Level& level=levelTable[l];
+		file->write(&zeros[0],level.dataOffset-filePos);
+		filePos=level.dataOffset;
+		for(unsigned int ty=0;ty<level.numTiles[1];++ty)
+			for(unsigned int tx=0;tx<level.numTiles[0];++tx)
+				{
+				/* Copy the tile's postings, replicating the level's last row and column into partial tiles: */
+				float* tPtr=&tile[0];
+				for(unsigned int y=0;y<tileSize;++y)
+					{
+					unsigned int gy=std::min(ty*tileSize+y,level.levelSize[1]-1);
+					const float* row=&levelGrids[l][size_t(gy)*size_t(level.levelSize[0])];
+					for(unsigned int x=0;x<tileSize;++x,++tPtr)
+						*tPtr=row[std::min(tx*tileSize+x,level.levelSize[0]-1)];
+					}
+				file->write<float>(&tile[0],tile.size());
+				filePos+=tileDataSize;
+				}
+		}
+	
+	std::cout<<"DEMPyramid: Wrote "<<levelTable.size()<<" levels of "<<tileSize<<"x"<<tileSize<<" tiles for a "<<gridSize[0]<<"x"<<gridSize[1]<<" DEM to "<<pyramidFileName<<std::endl;
+	}
+
+void DEMPyramid::extractRegion(unsigned int level,const unsigned int origin[2],const unsigned int size[2],float* region) const
+	{
+	unsigned int tileSize=header->tileSize;
+	float* rPtr=region;
+	for(unsigned int y=origin[1];y<origin[1]+size[1];++y)
+		{
+		/* Copy the row's span from each tile it crosses: */
+		unsigned int tileY=y/tileSize;
+		unsigned int rowInTile=y-tileY*tileSize;
+		unsigned int x=origin[0];
+		while(x<origin[0]+size[0])
+			{
+			unsigned int tileX=x/tileSize;
+			unsigned int colInTile=x-tileX*tileSize;
+			unsigned int span=std::min(tileSize-colInTile,origin[0]+size[0]-x);
+			const float* tPtr=getTile(level,tileX,tileY)+size_t(rowInTile)*size_t(tileSize)+colInTile;
+			memcpy(rPtr,tPtr,span*sizeof(float));
+			rPtr+=span;
+			x+=span;
+			}
+		}
+	}
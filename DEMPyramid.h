@@ -0,0 +1,95 @@
+/***********************************************************************
+DEMPyramid - Class to write and memory-map tiled digital elevation model
+files holding a mip pyramid of the elevation grid and precomputed
+elevation statistics.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DEMPYRAMID_INCLUDED
+#define DEMPYRAMID_INCLUDED
+
+#include <stddef.h>
+
+class DEMPyramid
+	{
+	/* Embedded classes: */
+	public:
+	struct Header // Structure for the file header; all values are stored in little-endian byte order
+		{
+		/* Elements: */
+		public:
+		char magic[16]; // File type identifier "SARndboxDEMTile"
+		unsigned int version; // File format version
+		unsigned int demSize[2]; // Width and height of the full-resolution DEM grid
+		unsigned int tileSize; // Width and height of every square tile in postings
+		unsigned int numLevels; // Number of pyramid levels; level 0 is the full-resolution grid
+		float demBox[4]; // Lower-left and upper-right corner coordinates of the DEM
+		float elevationRange[2]; // Minimum and maximum elevation of the full-resolution grid
+		float averageElevation; // Average elevation of the full-resolution grid
+		};
+	
+	struct Level // Structure for a level table entry, following the header
+		{
+		/* Elements: */
+		public:
+		unsigned int levelSize[2]; // Width and height of the level's grid; each level halves the previous one, rounding up
+		unsigned int numTiles[2]; // Number of tiles in x and y
+		unsigned long long dataOffset; // Offset of the level's tiles from the beginning of the file; page-aligned
+		};
+	
+	static const unsigned int fileVersion=1; // Current file format version
+	static const size_t dataAlignment=4096; // Alignment of level tile data in the file
+	
+	/* Elements: */
+	private:
+	int fd; // File descriptor of the mapped pyramid file, or -1
+	void* mapping; // Memory-mapped pyramid file
+	size_t mappingSize; // Size of the memory mapping in bytes
+	const Header* header; // Pointer to the file header inside the mapping
+	const Level* levels; // Pointer to the level table inside the mapping
+	
+	/* Constructors and destructors: */
+	public:
+	DEMPyramid(const char* pyramidFileName); // Memory-maps the given pyramid file; throws an exception if the file is missing or invalid
+	private:
+	DEMPyramid(const DEMPyramid& source); // Prohibit copy constructor
+	DEMPyramid& operator=(const DEMPyramid& source); // Prohibit assignment operator
+	public:
+	~DEMPyramid(void);
+	
+	/* Methods: */
+	static void bake(const char* gridFileName,const char* pyramidFileName,unsigned int tileSize); // Loads a DEM grid file and writes it into a pyramid file with tiles of the given size
+	const Header& getHeader(void) const // Returns the pyramid file header
+		{
+		return *header;
+		}
+	const Level& getLevel(unsigned int level) const // Returns the table entry of the given level
+		{
+		return levels[level];
+		}
+	const float* getTile(unsigned int level,unsigned int tileX,unsigned int tileY) const // Returns the memory-mapped postings of the given tile in row-major order
+		{
+		const Level& l=levels[level];
+		size_t tileIndex=size_t(tileY)*size_t(l.numTiles[0])+size_t(tileX);
+		return reinterpret_cast<const float*>(static_cast<const char*>(mapping)+l.dataOffset)+tileIndex*size_t(header->tileSize)*size_t(header->tileSize);
+		}
+	void extractRegion(unsigned int level,const unsigned int origin[2],const unsigned int size[2],float* region) const; // Copies the given rectangle of the given level, which must lie inside the level, into a row-major array
+	};
+
+#endif
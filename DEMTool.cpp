@@ -36,7 +36,7 @@ Methods of class DEMToolFactory:
 
 DEMToolFactory::DEMToolFactory(Vrui::ToolManager& toolManager)
 	:ToolFactory("DEMTool",toolManager),
-	 demSelectionHelper(Vrui::getWidgetManager(),"",".grid",IO::openDirectory("."))
+	 demSelectionHelper(Vrui::getWidgetManager(),"",".grid;.demp",IO::openDirectory("."))
 	{
 	/* Initialize tool layout: */
 	layout.setNumButtons(1);
@@ -132,6 +132,9 @@ void DEMTool::loadDEMFile(const char* demFileName)
 	
 	/* Set the DEM transformation: */
 	setTransform(demT*OGTransform(application->boxTransform),demVerticalScale,demT.getOrigin()[2]);
+	
+	/* Start extracting the part of a tiled DEM that covers the sandbox: */
+	loadRegion(application->bbox);
 	}
 
 void DEMTool::loadDEMFileCallback(GLMotif::FileSelectionDialog::OKCallbackData* cbData)
@@ -175,6 +178,7 @@ void DEMTool::configure(const Misc::ConfigurationFileSection& configFileSection)
 	
 	demVerticalShift=configFileSection.retrieveValue<Scalar>("./demVerticalShift",demVerticalShift);
 	demVerticalScale=configFileSection.retrieveValue<Scalar>("./demVerticalScale",demVerticalScale);
+	setMaxTextureSize(configFileSection.retrieveValue<int>("./demMaxTextureSize",getMaxTextureSize()));
 	}
 
 void DEMTool::initialize(void)
@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "DepthImageRenderer.h"
 
 #include <iostream>
+#include <Math/Math.h>
 #include <GL/gl.h>
 #include <GL/GLVertexArrayParts.h>
 #include <GL/GLContextData.h>
@@ -38,13 +39,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/GLTransformationWrappers.h>
 
 #include "ShaderHelper.h"
+#include "GPUFrameFilter.h"
 
 /*********************************************
 Methods of class DepthImageRenderer::DataItem:
 *********************************************/
 
 DepthImageRenderer::DataItem::DataItem(void)
-	:vertexBuffer(0),indexBuffer(0),
+	:vertexBuffer(0),
 	 depthTexture(0),depthTextureVersion(0),
 	 depthShader(0),elevationShader(0)
 	{
@@ -60,7 +62,7 @@ DepthImageRenderer::DataItem::DataItem(void)
 	
 	/* Allocate the buffers and textures: */
 	glGenBuffersARB(1,&vertexBuffer);
-	glGenBuffersARB(1,&indexBuffer);
+	glGenBuffersARB(numLods,indexBuffers);
 	glGenTextures(1,&depthTexture);
 	}
 
@@ -68,7 +70,7 @@ DepthImageRenderer::DataItem::~DataItem(void)
 	{
 	/* Release all allocated buffers, textures, and shaders: */
 	glDeleteBuffersARB(1,&vertexBuffer);
-	glDeleteBuffersARB(1,&indexBuffer);
+	glDeleteBuffersARB(numLods,indexBuffers);
 	glDeleteTextures(1,&depthTexture);
 	glDeleteObjectARB(depthShader);
 	glDeleteObjectARB(elevationShader);
@@ -78,13 +80,81 @@ DepthImageRenderer::DataItem::~DataItem(void)
 Methods of class DepthImageRenderer:
 ***********************************/
 
+void DepthImageRenderer::updateDepthTexture(DepthImageRenderer::DataItem* dataItem,GLContextData& contextData) const
+	{
+	/* Check if the texture is outdated: */
+	if(dataItem->depthTextureVersion!=depthImageVersion)
+		{
+		if(gpuFrameFilter!=0)
+			{
+			/* Enter all raw depth frames this context has not yet seen into the filter, in camera order, and filter the result directly into the depth texture: */
+			gpuFrameFilter->filterFrames(dataItem->depthTexture,contextData);
+			
+			/* Re-bind the depth texture, in case the filter changed texture bindings: */
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
+			}
+		else
+			{
+			/* Upload the new depth texture: */
+			glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_RED,GL_FLOAT,depthImage.getData<GLfloat>());
+			}
+		
+		/* Mark the depth texture as current: */
+		dataItem->depthTextureVersion=depthImageVersion;
+		}
+	}
+
+void DepthImageRenderer::drawTemplate(DepthImageRenderer::DataItem* dataItem,unsigned int lod,const PixelRect& region) const
+	{
+	/* Bind the vertex buffer and the level of detail's index buffer: */
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffers[lod]);
+	
+	/* Find the range of template vertex columns and rows covering the region: */
+	PixelRect r=region;
+	r.clamp(depthImageSize[0],depthImageSize[1]);
+	int step=1<<lod;
+	int vMin[2],vMax[2];
+	for(int i=0;i<2;++i)
+		{
+		vMin[i]=r.min[i]/step;
+		vMax[i]=(r.max[i]-1+step-1)/step;
+		if(vMax[i]>int(lodSize[lod][i])-1)
+			vMax[i]=int(lodSize[lod][i])-1;
+		}
+	
+	/* Draw the surface: */
+	GLVertexArrayParts::enable(Vertex::getPartsMask());
+	glVertexPointer(static_cast<const Vertex*>(0));
+	if(!r.isEmpty()&&vMax[0]>vMin[0])
+		{
+		/* Draw one partial quad strip for each pair of adjacent template vertex rows inside the region: */
+		GLsizei stripLength=(vMax[0]-vMin[0]+1)*2;
+		GLuint* indexPtr=0;
+		indexPtr+=vMin[1]*lodSize[lod][0]*2+vMin[0]*2;
+		for(int y=vMin[1]+1;y<=vMax[1];++y,indexPtr+=lodSize[lod][0]*2)
+			glDrawElements(GL_QUAD_STRIP,stripLength,GL_UNSIGNED_INT,indexPtr);
+		}
+	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	
+	/* Unbind the vertex and index buffers: */
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
+	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
+	}
+
 DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
-	:depthImageVersion(0)
+	:gpuFrameFilter(0),
+	 depthImageVersion(0)
 	{
 	/* Copy the depth image size: */
 	for(int i=0;i<2;++i)
 		depthImageSize[i]=sDepthImageSize[i];
 	
+	/* Calculate the template mesh sizes at all levels of detail; coarse meshes always include the last pixel row and column: */
+	for(unsigned int lod=0;lod<numLods;++lod)
+		for(int i=0;i<2;++i)
+			lodSize[lod][i]=(depthImageSize[i]-1+(1U<<lod)-1)/(1U<<lod)+1;
+	
 	/* Initialize the depth image: */
 	depthImage=Kinect::FrameBuffer(depthImageSize[0],depthImageSize[1],depthImageSize[1]*depthImageSize[0]*sizeof(float));
 	float* diPtr=depthImage.getData<float>();
@@ -92,6 +162,7 @@ DepthImageRenderer::DepthImageRenderer(const unsigned int sDepthImageSize[2])
 		for(unsigned int x=0;x<depthImageSize[0];++x,++diPtr)
 			*diPtr=0.0f;
 	++depthImageVersion;
+	dirtyRegions[depthImageVersion%numDirtyRegions]=PixelRect(0,0,depthImageSize[0],depthImageSize[1]);
 	}
 
 void DepthImageRenderer::initContext(GLContextData& contextData) const
@@ -132,17 +203,27 @@ void DepthImageRenderer::initContext(GLContextData& contextData) const
 	glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
 	
-	/* Upload the surface's triangle indices into the index buffer: */
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,(depthImageSize[1]-1)*depthImageSize[0]*2*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
-	GLuint* iPtr=static_cast<GLuint*>(glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,GL_WRITE_ONLY_ARB));
-	for(unsigned int y=1;y<depthImageSize[1];++y)
-		for(unsigned int x=0;x<depthImageSize[0];++x,iPtr+=2)
+	/* Upload the surface's triangle indices at all levels of detail into the index buffers: */
+	for(unsigned int lod=0;lod<numLods;++lod)
+		{
+		glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffers[lod]);
+		glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,(lodSize[lod][1]-1)*lodSize[lod][0]*2*sizeof(GLuint),0,GL_STATIC_DRAW_ARB);
+		GLuint* iPtr=static_cast<GLuint*>(glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,GL_WRITE_ONLY_ARB));
+		unsigned int step=1U<<lod;
+		for(unsigned int y=1;y<lodSize[lod][1];++y)
 			{
-			iPtr[0]=GLuint(y*depthImageSize[0]+x);
-			iPtr[1]=GLuint((y-1)*depthImageSize[0]+x);
+			/* Find the pixel rows of the pair of template vertex rows: */
+			unsigned int y0=Math::min((y-1)*step,depthImageSize[1]-1);
+			unsigned int y1=Math::min(y*step,depthImageSize[1]-1);
+			for(unsigned int x=0;x<lodSize[lod][0];++x,iPtr+=2)
+				{
+				unsigned int px=Math::min(x*step,depthImageSize[0]-1);
+				iPtr[0]=GLuint(y1*depthImageSize[0]+px);
+				iPtr[1]=GLuint(y0*depthImageSize[0]+px);
+				}
 			}
-	glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+		glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+		}
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
 	
 	/* Initialize the depth image texture: */
@@ -151,7 +232,7 @@ void DepthImageRenderer::initContext(GLContextData& contextData) const
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE32F_ARB,depthImageSize[0],depthImageSize[1],0,GL_LUMINANCE,GL_FLOAT,0);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,depthImageSize[0],depthImageSize[1],0,GL_RED,GL_FLOAT,0);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
 	/* Create the depth rendering shader: */
@@ -221,11 +302,39 @@ void DepthImageRenderer::setBasePlane(const Plane& newBasePlane)
 		basePlaneDicEq[i]=GLfloat(dpm(0,i)*bpn[0]+dpm(1,i)*bpn[1]+dpm(2,i)*bpn[2]-dpm(3,i)*bpo);
 	}
 
+void DepthImageRenderer::setGPUFrameFilter(const GPUFrameFilter* newGPUFrameFilter)
+	{
+	gpuFrameFilter=newGPUFrameFilter;
+	}
+
 void DepthImageRenderer::setDepthImage(const Kinect::FrameBuffer& newDepthImage)
+	{
+	/* Update the depth image and mark all pixels as changed: */
+	setDepthImage(newDepthImage,PixelRect(0,0,depthImageSize[0],depthImageSize[1]));
+	}
+
+void DepthImageRenderer::setDepthImage(const Kinect::FrameBuffer& newDepthImage,const PixelRect& dirtyRegion)
 	{
 	/* Update the depth image: */
 	depthImage=newDepthImage;
 	++depthImageVersion;
+	
+	/* Remember the new version's region of changed pixels: */
+	dirtyRegions[depthImageVersion%numDirtyRegions]=dirtyRegion;
+	}
+
+bool DepthImageRenderer::getDirtyRegion(unsigned int sinceVersion,PixelRect& dirtyRegion) const
+	{
+	/* Bail out if the requested version is too old: */
+	if(sinceVersion==0||depthImageVersion-sinceVersion>=numDirtyRegions)
+		return false;
+	
+	/* Combine the changed pixel regions of all versions since the requested one: */
+	dirtyRegion=PixelRect();
+	for(unsigned int version=sinceVersion+1;version<=depthImageVersion;++version)
+		dirtyRegion.addRect(dirtyRegions[version%numDirtyRegions]);
+	
+	return true;
 	}
 
 Scalar DepthImageRenderer::intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const
@@ -265,18 +374,9 @@ void DepthImageRenderer::bindDepthTexture(GLContextData& contextData) const
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
-	/* Bind the depth image texture: */
+	/* Bind the depth image texture and bring it up-to-date: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
-	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	updateDepthTexture(dataItem,contextData);
 	}
 
 void DepthImageRenderer::renderSurfaceTemplate(GLContextData& contextData) const
@@ -284,24 +384,17 @@ void DepthImageRenderer::renderSurfaceTemplate(GLContextData& contextData) const
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
-	/* Bind the vertex and index buffers: */
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	
-	/* Draw the surface template: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
-	
-	/* Unbind the vertex and index buffers: */
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
+	/* Draw the full-resolution surface template: */
+	drawTemplate(dataItem,0,PixelRect(0,0,depthImageSize[0],depthImageSize[1]));
 	}
 
 void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLContextData& contextData) const
+	{
+	/* Render the full-resolution surface: */
+	renderDepth(projectionModelview,0,contextData);
+	}
+
+void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,unsigned int lod,GLContextData& contextData) const
 	{
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
@@ -309,23 +402,10 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	/* Bind the depth rendering shader: */
 	glUseProgramObjectARB(dataItem->depthShader);
 	
-	/* Bind the vertex and index buffers: */
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	
 	/* Bind the depth image texture: */
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
-	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	updateDepthTexture(dataItem,contextData);
 	glUniform1iARB(dataItem->depthShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the combined projection, modelview, and depth projection matrix: */
@@ -334,23 +414,28 @@ void DepthImageRenderer::renderDepth(const PTransform& projectionModelview,GLCon
 	glUniformARB(dataItem->depthShaderUniforms[1],pmvdp);
 	
 	/* Draw the surface: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	drawTemplate(dataItem,lod<numLods?lod:numLods-1,PixelRect(0,0,depthImageSize[0],depthImageSize[1]));
 	
-	/* Unbind all textures and buffers: */
+	/* Unbind all textures: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
 	
 	/* Unbind the depth rendering shader: */
 	glUseProgramObjectARB(0);
 	}
 
 void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,GLContextData& contextData) const
+	{
+	/* Render the entire surface: */
+	renderElevation(projectionModelview,PixelRect(0,0,depthImageSize[0],depthImageSize[1]),contextData);
+	}
+
+void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,const PixelRect& region,GLContextData& contextData) const
+	{
+	/* Render the region at full resolution: */
+	renderElevation(projectionModelview,region,0,contextData);
+	}
+
+void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,const PixelRect& region,unsigned int lod,GLContextData& contextData) const
 	{
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
@@ -361,16 +446,7 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	/* Set up the depth image texture: */
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthTexture);
-	
-	/* Check if the texture is outdated: */
-	if(dataItem->depthTextureVersion!=depthImageVersion)
-		{
-		/* Upload the new depth texture: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,depthImageSize[0],depthImageSize[1],GL_LUMINANCE,GL_FLOAT,depthImage.getData<GLfloat>());
-		
-		/* Mark the depth texture as current: */
-		dataItem->depthTextureVersion=depthImageVersion;
-		}
+	updateDepthTexture(dataItem,contextData);
 	glUniform1iARB(dataItem->elevationShaderUniforms[0],0); // Tell the shader that the depth texture is in texture unit 0
 	
 	/* Upload the base plane equation in depth image space: */
@@ -384,21 +460,10 @@ void DepthImageRenderer::renderElevation(const PTransform& projectionModelview,G
 	pmvdp*=depthProjection;
 	glUniformARB(dataItem->elevationShaderUniforms[3],pmvdp);
 	
-	/* Bind the vertex and index buffers: */
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,dataItem->vertexBuffer);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->indexBuffer);
-	
 	/* Draw the surface: */
-	GLVertexArrayParts::enable(Vertex::getPartsMask());
-	glVertexPointer(static_cast<const Vertex*>(0));
-	GLuint* indexPtr=0;
-	for(unsigned int y=1;y<depthImageSize[1];++y,indexPtr+=depthImageSize[0]*2)
-		glDrawElements(GL_QUAD_STRIP,depthImageSize[0]*2,GL_UNSIGNED_INT,indexPtr);
-	GLVertexArrayParts::disable(Vertex::getPartsMask());
+	drawTemplate(dataItem,lod<numLods?lod:numLods-1,region);
 	
-	/* Unbind all textures and buffers: */
-	glBindBufferARB(GL_ARRAY_BUFFER_ARB,0);
-	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,0);
+	/* Unbind all textures: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
 	/* Unbind the elevation rendering shader: */
@@ -411,26 +476,26 @@ Scalar DepthImageRenderer::getHeightAt(Scalar worldX, Scalar worldY, const Scala
 	static int debugCount = 0;
 	bool doDebug = (debugCount < 10);
 	if(doDebug) ++debugCount;
-
+	
 	if(doDebug)
 		std::cerr << "getHeightAt: worldX=" << worldX << " worldY=" << worldY << std::endl;
-
+	
 	/* Map world coordinates to normalized [0,1] using domain bounds */
 	Scalar nx = (worldX - domainMin[0]) / (domainMax[0] - domainMin[0]);
 	Scalar ny = (worldY - domainMin[1]) / (domainMax[1] - domainMin[1]);
-
+	
 	/* Map to pixel coordinates */
 	Scalar px = nx * Scalar(depthImageSize[0]);
 	Scalar py = ny * Scalar(depthImageSize[1]);
-
+	
 	/* Convert to integer pixel indices */
 	int ipx = int(px);
 	int ipy = int(py);
-
+	
 	if(doDebug)
 		std::cerr << "  -> normalized: (" << nx << ", " << ny << ") -> pixel: (" << ipx << ", " << ipy << ")"
 		          << " (imageSize: " << depthImageSize[0] << "x" << depthImageSize[1] << ")" << std::endl;
-
+	
 	/* Check bounds */
 	if(ipx < 0 || ipy < 0 ||
 	   ipx >= int(depthImageSize[0]) ||
@@ -440,33 +505,33 @@ Scalar DepthImageRenderer::getHeightAt(Scalar worldX, Scalar worldY, const Scala
 			std::cerr << "  -> OUT OF BOUNDS, returning domain midpoint" << std::endl;
 		return (domainMin[2] + domainMax[2]) * Scalar(0.5);
 		}
-
-	/* Sample depth from the depth image */
-	const float* depthData = depthImage.getData<float>();
+	
+	/* Sample depth from the depth image; there is no CPU-side filtered depth image when filtering on the GPU */
+	const float* depthData = gpuFrameFilter == 0 ? depthImage.getData<float>() : 0;
 	if(depthData == 0)
 		{
 		if(doDebug)
 			std::cerr << "  -> NO DEPTH DATA, returning domain midpoint" << std::endl;
 		return (domainMin[2] + domainMax[2]) * Scalar(0.5);
 		}
-
+	
 	float depth = depthData[ipy * depthImageSize[0] + ipx];
 	if(doDebug)
 		std::cerr << "  -> sampled depth=" << depth << std::endl;
-
+	
 	if(depth <= 0.0f)
 		{
 		if(doDebug)
 			std::cerr << "  -> INVALID DEPTH, returning domain midpoint" << std::endl;
 		return (domainMin[2] + domainMax[2]) * Scalar(0.5);
 		}
-
+	
 	/* Transform depth image point back to world space to get world Z */
 	Point depthImagePoint(px, py, Scalar(depth));
 	Point worldPoint = depthProjection.transform(depthImagePoint);
-
+	
 	if(doDebug)
 		std::cerr << "  -> worldZ=" << worldPoint[2] << std::endl;
-
+	
 	return worldPoint[2];
 	}
@@ -33,9 +33,15 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "Types.h"
 
+/* Forward declarations: */
+class GPUFrameFilter;
+
 class DepthImageRenderer:public GLObject
 	{
 	/* Embedded classes: */
+	public:
+	static const unsigned int numLods=4; // Number of template mesh levels of detail; level l uses every 2^l-th depth image pixel in each direction
+	
 	private:
 	typedef GLGeometry::Vertex<void,0,void,0,void,GLfloat,2> Vertex; // Type for template vertices
 	
@@ -46,7 +52,7 @@ class DepthImageRenderer:public GLObject
 		
 		/* OpenGL state management: */
 		GLuint vertexBuffer; // ID of vertex buffer object holding surface's template vertices
-		GLuint indexBuffer; // ID of index buffer object holding surface's triangles
+		GLuint indexBuffers[numLods]; // IDs of index buffer objects holding surface's triangles at each level of detail
 		GLuint depthTexture; // ID of texture object holding surface's vertex elevations in depth image space
 		unsigned int depthTextureVersion; // Version number of the depth image texture
 		
@@ -63,16 +69,24 @@ class DepthImageRenderer:public GLObject
 	
 	/* Elements: */
 	unsigned int depthImageSize[2]; // Size of depth image texture
+	unsigned int lodSize[numLods][2]; // Number of template vertices in each row and column at each level of detail
 	Kinect::LensDistortion lensDistortion; // 2D lens distortion parameters
 	PTransform depthProjection; // Projection matrix from depth image space into 3D camera space
 	GLfloat depthProjectionMatrix[16]; // Same, in GLSL-compatible format
 	GLfloat weightDicEq[4]; // Equation to calculate the weight of a depth image-space point in 3D camera space
 	Plane basePlane; // Base plane to calculate surface elevation
 	GLfloat basePlaneDicEq[4]; // Base plane equation in depth image space in GLSL-compatible format
+	const GPUFrameFilter* gpuFrameFilter; // Optional filter turning raw depth images into filtered depth textures on the GPU
 	
 	/* Transient state: */
-	Kinect::FrameBuffer depthImage; // The most recent float-pixel depth image
+	Kinect::FrameBuffer depthImage; // The most recent float-pixel depth image, or raw depth image if a GPU frame filter is set
 	unsigned int depthImageVersion; // Version number of the depth image
+	static const unsigned int numDirtyRegions=16; // Number of recent depth image versions for which changed pixel regions are retained
+	PixelRect dirtyRegions[numDirtyRegions]; // Regions of pixels that changed in recent depth image versions, indexed by version number modulo array size
+	
+	/* Private methods: */
+	void updateDepthTexture(DataItem* dataItem,GLContextData& contextData) const; // Brings the bound depth image texture up-to-date with the current depth image
+	void drawTemplate(DataItem* dataItem,unsigned int lod,const PixelRect& region) const; // Draws the part of the template mesh at the given level of detail covering the given region of depth image pixels using current OpenGL settings
 	
 	/* Constructors and destructors: */
 	public:
@@ -101,7 +115,10 @@ class DepthImageRenderer:public GLObject
 	void setDepthProjection(const PTransform& newDepthProjection); // Sets a new depth unprojection matrix
 	void setIntrinsics(const Kinect::FrameSource::IntrinsicParameters& ips); // Sets a new depth unprojection matrix and, if present, 2D lens distortion parameters
 	void setBasePlane(const Plane& newBasePlane); // Sets a new base plane for elevation rendering
+	void setGPUFrameFilter(const GPUFrameFilter* newGPUFrameFilter); // Sets a GPU frame filter; subsequent depth images are raw depth frames filtered on the GPU
 	void setDepthImage(const Kinect::FrameBuffer& newDepthImage); // Sets a new depth image for subsequent surface rendering
+	void setDepthImage(const Kinect::FrameBuffer& newDepthImage,const PixelRect& dirtyRegion); // Sets a new depth image that differs from the previous one only inside the given region of pixels
+	bool getDirtyRegion(unsigned int sinceVersion,PixelRect& dirtyRegion) const; // Returns the region of pixels that changed between the given and the current depth image versions; returns false if the region is unknown
 	Scalar intersectLine(const Point& p0,const Point& p1,Scalar elevationMin,Scalar elevationMax) const; // Intersects a line segment with the current depth image in camera space; returns intersection point's parameter along line
 	unsigned int getDepthImageVersion(void) const // Returns the version number of the current depth image
 		{
@@ -111,7 +128,10 @@ class DepthImageRenderer:public GLObject
 	void bindDepthTexture(GLContextData& contextData) const; // Binds the up-to-date depth texture image to the currently active texture unit
 	void renderSurfaceTemplate(GLContextData& contextData) const; // Renders the template quad strip mesh using current OpenGL settings
 	void renderDepth(const PTransform& projectionModelview,GLContextData& contextData) const; // Renders the surface into a pure depth buffer, for early z culling or shadow passes etc.
+	void renderDepth(const PTransform& projectionModelview,unsigned int lod,GLContextData& contextData) const; // Ditto, using the template mesh at the given level of detail
 	void renderElevation(const PTransform& projectionModelview,GLContextData& contextData) const; // Renders the surface's elevation relative to the base plane into the current one-component floating-point valued frame buffer
+	void renderElevation(const PTransform& projectionModelview,const PixelRect& region,GLContextData& contextData) const; // Ditto, but only renders the part of the surface spanned by the given region of depth image pixels
+	void renderElevation(const PTransform& projectionModelview,const PixelRect& region,unsigned int lod,GLContextData& contextData) const; // Ditto, using the template mesh at the given level of detail
 	Scalar getHeightAt(Scalar worldX, Scalar worldY, const Scalar domainMin[3], const Scalar domainMax[3]) const; // Returns the terrain height at the given world X,Y position by sampling the depth image, using domain bounds for coordinate mapping
 	};
 
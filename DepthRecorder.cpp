@@ -0,0 +1,286 @@
+/***********************************************************************
+DepthRecorder - Class to record raw depth and optional color frames into
+a compact delta-compressed file for reproducible replay.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DepthRecorder.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <IO/OpenFile.h>
+
+/*
+Depth delta encoding: Each token byte either encodes a run of 1 to 128
+unchanged pixels (0x00-0x7f), a single small difference between -32
+and 31 (0x80-0xbf), or is followed by a 16-bit little-endian difference
+for a single pixel (0xc0). Differences wrap around modulo 2^16.
+*/
+
+/******************************
+Methods of class DepthRecorder:
+******************************/
+
+void DepthRecorder::writeFrame(const DepthRecorder::QueuedFrame& qf)
+	{
+	const Kinect::FrameBuffer& frame=qf.frame;
+	if(qf.depth)
+		{
+		size_t numPixels=size_t(depthSize[1])*size_t(depthSize[0]);
+		const DepthPixel* depth=frame.getData<DepthPixel>();
+		if(havePreviousDepth)
+			{
+			/* Write the frame's differences to the previous depth frame: */
+			encodeDepthDelta(depth,&previousDepth[0],numPixels,encodeBuffer);
+			file->write<Misc::UInt8>(DEPTH_DELTA);
+			file->write<Misc::Float64>(frame.timeStamp);
+			file->write<Misc::UInt32>(Misc::UInt32(encodeBuffer.size()));
+			if(!encodeBuffer.empty())
+				file->write<Byte>(&encodeBuffer[0],encodeBuffer.size());
+			}
+		else
+			{
+			/* Write the first depth frame raw: */
+			file->write<Misc::UInt8>(DEPTH_KEYFRAME);
+			file->write<Misc::Float64>(frame.timeStamp);
+			file->write<Misc::UInt32>(Misc::UInt32(numPixels*sizeof(DepthPixel)));
+			file->write<Misc::UInt16>(depth,numPixels);
+			previousDepth.resize(numPixels);
+			havePreviousDepth=true;
+			}
+		
+		/* Remember the frame as reference for the next one: */
+		std::copy(depth,depth+numPixels,previousDepth.begin());
+		++numDepthFrames;
+		}
+	else
+		{
+		/* Write the color frame raw: */
+		size_t frameSize=size_t(colorSize[1])*size_t(colorSize[0])*3;
+		file->write<Misc::UInt8>(COLOR_FRAME);
+		file->write<Misc::Float64>(frame.timeStamp);
+		file->write<Misc::UInt32>(Misc::UInt32(frameSize));
+		file->write<Byte>(frame.getData<Byte>(),frameSize);
+		}
+	}
+
+void* DepthRecorder::writerThreadMethod(void)
+	{
+	while(true)
+		{
+		QueuedFrame qf;
+		{
+		Threads::MutexCond::Lock queueLock(queueCond);
+		
+		/* Wait until a new frame arrives or the recorder shuts down: */
+		while(runWriterThread&&queue.empty())
+			queueCond.wait(queueLock);
+		
+		/* Bail out once all queued frames have been written: */
+		if(queue.empty())
+			break;
+		
+		qf=queue.front();
+		queue.pop_front();
+		}
+		
+		/* Write the frame outside the lock: */
+		writeFrame(qf);
+		}
+	
+	return 0;
+	}
+
+DepthRecorder::DepthRecorder(const char* fileName,const unsigned int sDepthSize[2],const unsigned int sColorSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const Kinect::FrameSource::DepthCorrection* depthCorrection)
+	:file(IO::openFile(fileName,IO::File::WriteOnly)),
+	 maxQueueSize(64),
+	 runWriterThread(true),
+	 havePreviousDepth(false),
+	 numDepthFrames(0),numDroppedFrames(0)
+	{
+	/* Copy the frame sizes: */
+	for(int i=0;i<2;++i)
+		{
+		depthSize[i]=sDepthSize[i];
+		colorSize[i]=sColorSize!=0?sColorSize[i]:0U;
+		}
+	
+	/* Write the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	file->write<Misc::UInt32>(fileTag);
+	file->write<Misc::UInt32>(fileVersion);
+	for(int i=0;i<2;++i)
+		file->write<Misc::UInt32>(depthSize[i]);
+	for(int i=0;i<2;++i)
+		file->write<Misc::UInt32>(colorSize[i]);
+	
+	/* Write the camera's intrinsic parameters: */
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			file->write<Misc::Float64>(ips.depthProjection.getMatrix()(i,j));
+	ips.depthLensDistortion.write(*file);
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			file->write<Misc::Float64>(ips.colorProjection.getMatrix()(i,j));
+	ips.colorLensDistortion.write(*file);
+	
+	/* Write the camera's depth correction parameters: */
+	file->write<Misc::UInt8>(depthCorrection!=0?1:0);
+	if(depthCorrection!=0)
+		depthCorrection->write(*file);
+	
+	/* Start the background writer thread: */
+	writerThread.start(this,&DepthRecorder::writerThreadMethod);
+	}
+
+DepthRecorder::~DepthRecorder(void)
+	{
+	/* Shut down the writer thread after it wrote all queued frames: */
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	runWriterThread=false;
+	queueCond.signal();
+	}
+	writerThread.join();
+	
+	/* Mark the end of the recording: */
+	file->write<Misc::UInt8>(END_OF_RECORDING);
+	file->flush();
+	
+	std::cout<<"DepthRecorder: Recorded "<<numDepthFrames<<" depth frames, dropped "<<numDroppedFrames<<" frames"<<std::endl;
+	}
+
+void DepthRecorder::encodeDepthDelta(const DepthRecorder::DepthPixel* depth,const DepthRecorder::DepthPixel* reference,size_t numPixels,std::vector<DepthRecorder::Byte>& encoded)
+	{
+	encoded.clear();
+	size_t zeroRun=0;
+	for(size_t i=0;i<numPixels;++i)
+		{
+		Misc::UInt16 delta=Misc::UInt16(depth[i]-reference[i]);
+		if(delta==0)
+			{
+			/* Extend the current run of unchanged pixels: */
+			if(++zeroRun==128)
+				{
+				encoded.push_back(Byte(127));
+				zeroRun=0;
+				}
+			continue;
+			}
+		
+		/* Flush the current run of unchanged pixels: */
+		if(zeroRun>0)
+			{
+			encoded.push_back(Byte(zeroRun-1));
+			zeroRun=0;
+			}
+		
+		/* Encode the difference in one or three bytes: */
+		int sDelta=int(Misc::SInt16(delta));
+		if(sDelta>=-32&&sDelta<32)
+			encoded.push_back(Byte(0x80+(sDelta+32)));
+		else
+			{
+			encoded.push_back(Byte(0xc0));
+			encoded.push_back(Byte(delta&0xffU));
+			encoded.push_back(Byte(delta>>8));
+			}
+		}
+	if(zeroRun>0)
+		encoded.push_back(Byte(zeroRun-1));
+	}
+
+void DepthRecorder::decodeDepthDelta(const DepthRecorder::Byte* encoded,size_t encodedSize,DepthRecorder::DepthPixel* depth,size_t numPixels)
+	{
+	const Byte* ePtr=encoded;
+	const Byte* eEnd=encoded+encodedSize;
+	size_t pixel=0;
+	while(ePtr!=eEnd)
+		{
+		Byte token=*(ePtr++);
+		if(token<0x80)
+			{
+			/* Skip a run of unchanged pixels: */
+			pixel+=size_t(token)+1;
+			if(pixel>numPixels)
+				throw std::runtime_error("DepthRecorder::decodeDepthDelta: Run exceeds frame");
+			continue;
+			}
+		
+		if(pixel>=numPixels)
+			throw std::runtime_error("DepthRecorder::decodeDepthDelta: Difference exceeds frame");
+		if(token<0xc0)
+			{
+			/* Apply a small difference: */
+			depth[pixel]=DepthPixel(depth[pixel]+Misc::UInt16(int(token)-0x80-32));
+			}
+		else if(token==0xc0&&eEnd-ePtr>=2)
+			{
+			/* Apply a full 16-bit difference: */
+			Misc::UInt16 delta=Misc::UInt16(ePtr[0])|(Misc::UInt16(ePtr[1])<<8);
+			ePtr+=2;
+			depth[pixel]=DepthPixel(depth[pixel]+delta);
+			}
+		else
+			throw std::runtime_error("DepthRecorder::decodeDepthDelta: Malformed token");
+		++pixel;
+		}
+	}
+
+void DepthRecorder::receiveRawFrame(const Kinect::FrameBuffer& newFrame)
+	{
+	Threads::MutexCond::Lock queueLock(queueCond);
+	
+	/* Drop the frame if the writer thread fell behind: */
+	if(queue.size()>=maxQueueSize)
+		{
+		++numDroppedFrames;
+		return;
+		}
+	
+	/* Queue the frame and wake up the writer thread: */
+	QueuedFrame qf;
+	qf.depth=true;
+	qf.frame=newFrame;
+	queue.push_back(qf);
+	queueCond.signal();
+	}
+
+void DepthRecorder::receiveColorFrame(const Kinect::FrameBuffer& newFrame)
+	{
+	if(colorSize[0]==0||colorSize[1]==0)
+		return;
+	
+	Threads::MutexCond::Lock queueLock(queueCond);
+	
+	/* Drop the frame if the writer thread fell behind: */
+	if(queue.size()>=maxQueueSize)
+		{
+		++numDroppedFrames;
+		return;
+		}
+	
+	/* Queue the frame and wake up the writer thread: */
+	QueuedFrame qf;
+	qf.depth=false;
+	qf.frame=newFrame;
+	queue.push_back(qf);
+	queueCond.signal();
+	}
@@ -0,0 +1,98 @@
+/***********************************************************************
+DepthRecorder - Class to record raw depth and optional color frames into
+a compact delta-compressed file for reproducible replay.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DEPTHRECORDER_INCLUDED
+#define DEPTHRECORDER_INCLUDED
+
+#include <stddef.h>
+#include <deque>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+class DepthRecorder
+	{
+	/* Embedded classes: */
+	public:
+	typedef Kinect::FrameSource::DepthPixel DepthPixel; // Type for raw depth pixels
+	typedef Misc::UInt8 Byte; // Type for encoded frame data
+	
+	static const Misc::UInt32 fileTag=0x52444e53U; // Tag identifying depth recording files ("SNDR" in little-endian order)
+	static const Misc::UInt32 fileVersion=1; // Current version of the depth recording file format
+	
+	enum RecordType // Enumerated type for frame records in a depth recording file
+		{
+		DEPTH_KEYFRAME=0, // Raw depth frame
+		DEPTH_DELTA=1, // Depth frame encoded relative to the previous depth frame
+		COLOR_FRAME=2, // Raw RGB color frame
+		END_OF_RECORDING=3 // Marker after the last frame record
+		};
+	
+	private:
+	struct QueuedFrame // Structure for a frame waiting to be written
+		{
+		/* Elements: */
+		public:
+		bool depth; // Flag whether the frame is a depth or color frame
+		Kinect::FrameBuffer frame; // The frame
+		};
+	
+	/* Elements: */
+	IO::FilePtr file; // The recording file
+	unsigned int depthSize[2]; // Size of recorded depth frames
+	unsigned int colorSize[2]; // Size of recorded color frames, or 0 if no color frames are recorded
+	Threads::MutexCond queueCond; // Condition variable protecting the frame queue and signaling new frames
+	std::deque<QueuedFrame> queue; // Frames received but not yet written
+	size_t maxQueueSize; // Maximum number of queued frames before new frames are dropped
+	volatile bool runWriterThread; // Flag to keep the background writer thread running
+	Threads::Thread writerThread; // Background thread encoding and writing frames
+	std::vector<DepthPixel> previousDepth; // Most recently written depth frame
+	bool havePreviousDepth; // Flag whether a depth frame was already written
+	std::vector<Byte> encodeBuffer; // Scratch buffer for encoded depth frames
+	unsigned int numDepthFrames; // Number of written depth frames
+	unsigned int numDroppedFrames; // Number of frames dropped because the writer thread fell behind
+	
+	/* Private methods: */
+	void writeFrame(const QueuedFrame& qf); // Encodes and writes the given frame
+	void* writerThreadMethod(void); // Method for the background writer thread
+	
+	/* Constructors and destructors: */
+	public:
+	DepthRecorder(const char* fileName,const unsigned int sDepthSize[2],const unsigned int sColorSize[2],const Kinect::FrameSource::IntrinsicParameters& ips,const Kinect::FrameSource::DepthCorrection* depthCorrection); // Creates a recording file for depth frames and, if color size is not null, color frames of the given sizes; depth correction can be null
+	private:
+	DepthRecorder(const DepthRecorder& source); // Prohibit copy constructor
+	DepthRecorder& operator=(const DepthRecorder& source); // Prohibit assignment operator
+	public:
+	~DepthRecorder(void); // Writes all queued frames and closes the recording file
+	
+	/* Methods: */
+	static void encodeDepthDelta(const DepthPixel* depth,const DepthPixel* reference,size_t numPixels,std::vector<Byte>& encoded); // Encodes the differences between the given depth frame and reference frame into the given buffer
+	static void decodeDepthDelta(const Byte* encoded,size_t encodedSize,DepthPixel* depth,size_t numPixels); // Applies the given encoded differences to the given depth frame, which must hold the reference frame; throws exception on malformed data
+	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to queue a new raw depth frame for recording
+	void receiveColorFrame(const Kinect::FrameBuffer& newFrame); // Called to queue a new color frame for recording; ignored if the recording has no color stream
+	};
+
+#endif
@@ -0,0 +1,277 @@
+/***********************************************************************
+DepthReplaySource - Frame source replaying a depth recording written by
+a DepthRecorder at recorded or maximum speed.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DepthReplaySource.h"
+
+#include <time.h>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <iostream>
+#include <Misc/SizedTypes.h>
+#include <Misc/FunctionCalls.h>
+#include <IO/OpenFile.h>
+#include <Kinect/FrameBuffer.h>
+
+#include "DepthRecorder.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+double getTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)*1.0e-9;
+	}
+
+void sleepUntil(double time)
+	{
+	double delay=time-getTime();
+	if(delay>0.0)
+		{
+		struct timespec interval;
+		interval.tv_sec=time_t(delay);
+		interval.tv_nsec=long((delay-double(interval.tv_sec))*1.0e9);
+		nanosleep(&interval,0);
+		}
+	}
+
+}
+
+/**********************************
+Methods of class DepthReplaySource:
+**********************************/
+
+void* DepthReplaySource::replayThreadMethod(void)
+	{
+	bool firstFrame=true;
+	double firstTimeStamp=0.0;
+	double startTime=getTime();
+	double replayStartTime=startTime;
+	unsigned int numDepthFrames=0;
+	try
+		{
+		while(runReplayThread)
+			{
+			/* Read the next depth frame: */
+			Kinect::FrameBuffer frame;
+			if(!readDepthFrame(frame))
+				{
+				if(!loop)
+					break;
+				
+				/* Restart the recording and its time base: */
+				rewind();
+				firstFrame=true;
+				continue;
+				}
+			
+			/* Wait until the frame's recorded time when replaying in real time: */
+			if(firstFrame)
+				{
+				firstTimeStamp=frame.timeStamp;
+				startTime=getTime();
+				firstFrame=false;
+				}
+			else if(realTime)
+				sleepUntil(startTime+(frame.timeStamp-firstTimeStamp));
+			
+			/* Pass the depth frame to the depth callback: */
+			if(depthStreamingCallback!=0)
+				(*depthStreamingCallback)(frame);
+			++numDepthFrames;
+			}
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"DepthReplaySource: Stopping replay due to exception "<<err.what()<<std::endl;
+		}
+	
+	/* Report the replay throughput: */
+	double elapsed=getTime()-replayStartTime;
+	std::cout<<"DepthReplaySource: Replayed "<<numDepthFrames<<" depth frames in "<<elapsed<<" s";
+	if(elapsed>0.0)
+		std::cout<<" ("<<double(numDepthFrames)/elapsed<<" frames/s)";
+	std::cout<<std::endl;
+	
+	return 0;
+	}
+
+DepthReplaySource::DepthReplaySource(const char* fileName,bool sRealTime,bool sLoop)
+	:file(IO::openSeekableFile(fileName)),
+	 depthCorrection(0),
+	 realTime(sRealTime),loop(sLoop),
+	 haveKeyframe(false),
+	 colorStreamingCallback(0),depthStreamingCallback(0),
+	 runReplayThread(false)
+	{
+	/* Check the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	if(file->read<Misc::UInt32>()!=DepthRecorder::fileTag)
+		throw std::runtime_error("DepthReplaySource: File is not a depth recording");
+	if(file->read<Misc::UInt32>()!=DepthRecorder::fileVersion)
+		throw std::runtime_error("DepthReplaySource: Unsupported depth recording version");
+	
+	/* Read the frame sizes: */
+	for(int i=0;i<2;++i)
+		frameSizes[DEPTH][i]=file->read<Misc::UInt32>();
+	for(int i=0;i<2;++i)
+		frameSizes[COLOR][i]=file->read<Misc::UInt32>();
+	
+	/* Read the camera's intrinsic parameters: */
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			ips.depthProjection.getMatrix()(i,j)=file->read<Misc::Float64>();
+	ips.depthLensDistortion.read(*file);
+	for(int i=0;i<4;++i)
+		for(int j=0;j<4;++j)
+			ips.colorProjection.getMatrix()(i,j)=file->read<Misc::Float64>();
+	ips.colorLensDistortion.read(*file);
+	
+	/* Read the camera's depth correction parameters: */
+	if(file->read<Misc::UInt8>()!=0)
+		depthCorrection=new DepthCorrection(*file);
+	
+	/* Remember where the frame records start for looping: */
+	framesOffset=file->getReadPos();
+	
+	/* Allocate the depth frame reconstruction buffer: */
+	depth.resize(size_t(frameSizes[DEPTH][1])*size_t(frameSizes[DEPTH][0]),DepthPixel(0));
+	}
+
+DepthReplaySource::~DepthReplaySource(void)
+	{
+	stopStreaming();
+	delete depthCorrection;
+	}
+
+Kinect::FrameSource::DepthCorrection* DepthReplaySource::getDepthCorrectionParameters(void)
+	{
+	/* Return a copy of the recorded parameters for the caller to delete: */
+	return depthCorrection!=0?new DepthCorrection(*depthCorrection):0;
+	}
+
+Kinect::FrameSource::IntrinsicParameters DepthReplaySource::getIntrinsicParameters(void)
+	{
+	return ips;
+	}
+
+Kinect::FrameSource::ExtrinsicParameters DepthReplaySource::getExtrinsicParameters(void)
+	{
+	/* The recording does not store a camera pose: */
+	return ExtrinsicParameters::identity;
+	}
+
+const unsigned int* DepthReplaySource::getActualFrameSize(int sensor) const
+	{
+	return frameSizes[sensor];
+	}
+
+void DepthReplaySource::startStreaming(Kinect::FrameSource::StreamingCallback* newColorStreamingCallback,Kinect::FrameSource::StreamingCallback* newDepthStreamingCallback)
+	{
+	/* Stop a running replay and install the new callbacks: */
+	stopStreaming();
+	colorStreamingCallback=newColorStreamingCallback;
+	depthStreamingCallback=newDepthStreamingCallback;
+	
+	/* Start replaying from the first frame: */
+	rewind();
+	runReplayThread=true;
+	replayThread.start(this,&DepthReplaySource::replayThreadMethod);
+	}
+
+void DepthReplaySource::stopStreaming(void)
+	{
+	if(runReplayThread)
+		{
+		/* Shut down the replay thread: */
+		runReplayThread=false;
+		replayThread.join();
+		}
+	
+	/* Release the streaming callbacks: */
+	delete colorStreamingCallback;
+	colorStreamingCallback=0;
+	delete depthStreamingCallback;
+	depthStreamingCallback=0;
+	}
+
+void DepthReplaySource::rewind(void)
+	{
+	file->setReadPosAbs(framesOffset);
+	haveKeyframe=false;
+	}
+
+bool DepthReplaySource::readDepthFrame(Kinect::FrameBuffer& frame)
+	{
+	size_t numPixels=depth.size();
+	while(true)
+		{
+		/* Read the next record header: */
+		Misc::UInt8 recordType=file->read<Misc::UInt8>();
+		if(recordType==DepthRecorder::END_OF_RECORDING)
+			return false;
+		double timeStamp=file->read<Misc::Float64>();
+		size_t payloadSize=file->read<Misc::UInt32>();
+		
+		if(recordType==DepthRecorder::COLOR_FRAME)
+			{
+			/* Read the color frame and pass it to the color callback, or skip it: */
+			Kinect::FrameBuffer colorFrame(frameSizes[COLOR][0],frameSizes[COLOR][1],payloadSize);
+			file->read<DepthRecorder::Byte>(colorFrame.getData<DepthRecorder::Byte>(),payloadSize);
+			colorFrame.timeStamp=timeStamp;
+			if(colorStreamingCallback!=0)
+				(*colorStreamingCallback)(colorFrame);
+			continue;
+			}
+		
+		/* Reconstruct the depth frame: */
+		if(recordType==DepthRecorder::DEPTH_KEYFRAME)
+			{
+			if(payloadSize!=numPixels*sizeof(DepthPixel))
+				throw std::runtime_error("DepthReplaySource: Invalid keyframe size");
+			file->read<Misc::UInt16>(&depth[0],numPixels);
+			haveKeyframe=true;
+			}
+		else if(recordType==DepthRecorder::DEPTH_DELTA&&haveKeyframe)
+			{
+			encoded.resize(payloadSize);
+			if(payloadSize>0)
+				{
+				file->read<DepthRecorder::Byte>(&encoded[0],payloadSize);
+				DepthRecorder::decodeDepthDelta(&encoded[0],payloadSize,&depth[0],numPixels);
+				}
+			}
+		else
+			throw std::runtime_error("DepthReplaySource: Invalid frame record");
+		
+		/* Return a copy of the depth frame: */
+		frame=Kinect::FrameBuffer(frameSizes[DEPTH][0],frameSizes[DEPTH][1],numPixels*sizeof(DepthPixel));
+		std::copy(depth.begin(),depth.end(),frame.getData<DepthPixel>());
+		frame.timeStamp=timeStamp;
+		return true;
+		}
+	}
@@ -0,0 +1,72 @@
+/***********************************************************************
+DepthReplaySource - Frame source replaying a depth recording written by
+a DepthRecorder at recorded or maximum speed.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DEPTHREPLAYSOURCE_INCLUDED
+#define DEPTHREPLAYSOURCE_INCLUDED
+
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <IO/SeekableFile.h>
+#include <Threads/Thread.h>
+#include <Kinect/FrameSource.h>
+
+class DepthReplaySource:public Kinect::FrameSource
+	{
+	/* Elements: */
+	private:
+	IO::SeekableFilePtr file; // The depth recording file
+	IO::SeekableFile::Offset framesOffset; // Position of the first frame record in the file
+	unsigned int frameSizes[2][2]; // Sizes of color and depth frames, indexed by sensor; color size is 0 if there is no color stream
+	IntrinsicParameters ips; // The recorded camera's intrinsic parameters
+	DepthCorrection* depthCorrection; // The recorded camera's depth correction parameters, or NULL
+	bool realTime; // Flag whether to replay frames at their recorded intervals instead of as fast as possible
+	bool loop; // Flag whether to restart the recording after the last frame
+	std::vector<DepthPixel> depth; // The most recently reconstructed depth frame
+	std::vector<Misc::UInt8> encoded; // Scratch buffer for delta-encoded depth frames
+	bool haveKeyframe; // Flag whether the reconstructed depth frame is based on a keyframe
+	StreamingCallback* colorStreamingCallback; // Callback receiving replayed color frames, or NULL
+	StreamingCallback* depthStreamingCallback; // Callback receiving replayed depth frames
+	volatile bool runReplayThread; // Flag to keep the replay thread running
+	Threads::Thread replayThread; // Background thread reading and delivering frames
+	
+	/* Private methods: */
+	void* replayThreadMethod(void); // Method for the background replay thread
+	
+	/* Constructors and destructors: */
+	public:
+	DepthReplaySource(const char* fileName,bool sRealTime,bool sLoop); // Opens the given depth recording for replay at recorded or maximum speed, optionally looping
+	virtual ~DepthReplaySource(void);
+	
+	/* Methods from Kinect::FrameSource: */
+	virtual DepthCorrection* getDepthCorrectionParameters(void);
+	virtual IntrinsicParameters getIntrinsicParameters(void);
+	virtual ExtrinsicParameters getExtrinsicParameters(void);
+	virtual const unsigned int* getActualFrameSize(int sensor) const;
+	virtual void startStreaming(StreamingCallback* newColorStreamingCallback,StreamingCallback* newDepthStreamingCallback);
+	virtual void stopStreaming(void);
+	
+	/* New methods: */
+	void rewind(void); // Restarts reading from the first frame of the recording; must not be called while streaming
+	bool readDepthFrame(Kinect::FrameBuffer& frame); // Reads the next depth frame, passing any preceding color frames to the color callback; returns false at the end of the recording; must not be called while streaming
+	};
+
+#endif
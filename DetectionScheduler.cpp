@@ -0,0 +1,200 @@
+/***********************************************************************
+DetectionScheduler - Class to run frame-paced detection stages, such as
+hand extraction, on a bounded pool of worker threads with per-stage
+rate limits and priorities, dropping stale frames when stages fall
+behind.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "DetectionScheduler.h"
+
+#include <time.h>
+#include <Misc/FunctionCalls.h>
+
+/***********************************
+Methods of class DetectionScheduler:
+***********************************/
+
+double DetectionScheduler::getTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)*1.0e-9;
+	}
+
+void* DetectionScheduler::workerThreadMethod(void)
+	{
+	Stage* finishedStage=0;
+	double finishedLatency=0.0;
+	while(true)
+		{
+		Stage* stage=0;
+		Kinect::FrameBuffer frame;
+		double submitTime;
+		{
+		Threads::MutexCond::Lock stageLock(stageCond);
+		
+		if(finishedStage!=0)
+			{
+			/* Update the counters of the stage that just finished processing a frame: */
+			StageStats& stats=finishedStage->stats;
+			++stats.numProcessed;
+			stats.lastLatency=finishedLatency;
+			stats.averageLatency+=(finishedLatency-stats.averageLatency)/double(stats.numProcessed);
+			if(stats.maxLatency<finishedLatency)
+				stats.maxLatency=finishedLatency;
+			finishedStage->busy=false;
+			finishedStage=0;
+			}
+		
+		/* Wait until an idle stage has a pending frame or the scheduler shuts down: */
+		while(runWorkers)
+			{
+			/* Find the highest-priority idle stage with a pending frame: */
+			for(std::vector<Stage*>::iterator sIt=stages.begin();sIt!=stages.end();++sIt)
+				if((*sIt)->havePending&&!(*sIt)->busy&&(stage==0||stage->priority<(*sIt)->priority))
+					stage=*sIt;
+			if(stage!=0)
+				break;
+			
+			stageCond.wait(stageLock);
+			}
+		
+		/* Bail out if the scheduler is shutting down: */
+		if(!runWorkers)
+			break;
+		
+		/* Take the stage's pending frame: */
+		frame=stage->pendingFrame;
+		submitTime=stage->pendingTime;
+		stage->pendingFrame=Kinect::FrameBuffer();
+		stage->havePending=false;
+		stage->busy=true;
+		}
+		
+		/* Process the frame outside the lock: */
+		(*stage->function)(frame);
+		finishedStage=stage;
+		finishedLatency=getTime()-submitTime;
+		}
+	
+	return 0;
+	}
+
+DetectionScheduler::DetectionScheduler(unsigned int sNumWorkers)
+	:runWorkers(true),
+	 numWorkers(sNumWorkers>0?sNumWorkers:1),
+	 workers(0)
+	{
+	/* Start the worker threads: */
+	workers=new Threads::Thread[numWorkers];
+	for(unsigned int i=0;i<numWorkers;++i)
+		workers[i].start(this,&DetectionScheduler::workerThreadMethod);
+	}
+
+DetectionScheduler::~DetectionScheduler(void)
+	{
+	/* Shut down the worker threads: */
+	{
+	Threads::MutexCond::Lock stageLock(stageCond);
+	runWorkers=false;
+	stageCond.broadcast();
+	}
+	for(unsigned int i=0;i<numWorkers;++i)
+		workers[i].join();
+	delete[] workers;
+	
+	/* Delete all stages: */
+	for(std::vector<Stage*>::iterator sIt=stages.begin();sIt!=stages.end();++sIt)
+		{
+		delete (*sIt)->function;
+		delete *sIt;
+		}
+	}
+
+unsigned int DetectionScheduler::addStage(const char* name,double rate,int priority,DetectionScheduler::StageFunction* function)
+	{
+	/* Create a new stage: */
+	Stage* newStage=new Stage;
+	newStage->name=name;
+	newStage->interval=rate>0.0?1.0/rate:0.0;
+	newStage->priority=priority;
+	newStage->function=function;
+	newStage->havePending=false;
+	newStage->pendingTime=0.0;
+	newStage->busy=false;
+	newStage->nextRunTime=0.0;
+	newStage->stats.numProcessed=0;
+	newStage->stats.numSkipped=0;
+	newStage->stats.numDropped=0;
+	newStage->stats.lastLatency=0.0;
+	newStage->stats.averageLatency=0.0;
+	newStage->stats.maxLatency=0.0;
+	
+	/* Add the stage to the list: */
+	Threads::MutexCond::Lock stageLock(stageCond);
+	stages.push_back(newStage);
+	return stages.size()-1;
+	}
+
+void DetectionScheduler::setStageRate(unsigned int stageIndex,double newRate)
+	{
+	Threads::MutexCond::Lock stageLock(stageCond);
+	stages[stageIndex]->interval=newRate>0.0?1.0/newRate:0.0;
+	}
+
+void DetectionScheduler::submitFrame(unsigned int stageIndex,const Kinect::FrameBuffer& frame)
+	{
+	double now=getTime();
+	Threads::MutexCond::Lock stageLock(stageCond);
+	Stage& stage=*stages[stageIndex];
+	
+	/* Skip the frame if it arrives too early for the stage's rate, allowing for half an interval of jitter in frame arrival: */
+	if(now+stage.interval*0.5<stage.nextRunTime)
+		{
+		++stage.stats.numSkipped;
+		return;
+		}
+	
+	/* Advance the stage's schedule, without catching up after falling behind: */
+	stage.nextRunTime+=stage.interval;
+	if(stage.nextRunTime<now)
+		stage.nextRunTime=now;
+	
+	/* Replace a stale pending frame the stage did not get to yet: */
+	if(stage.havePending)
+		++stage.stats.numDropped;
+	stage.pendingFrame=frame;
+	stage.havePending=true;
+	stage.pendingTime=now;
+	
+	/* Wake up a worker: */
+	stageCond.signal();
+	}
+
+std::string DetectionScheduler::getStageName(unsigned int stageIndex) const
+	{
+	return stages[stageIndex]->name;
+	}
+
+DetectionScheduler::StageStats DetectionScheduler::getStageStats(unsigned int stageIndex)
+	{
+	Threads::MutexCond::Lock stageLock(stageCond);
+	return stages[stageIndex]->stats;
+	}
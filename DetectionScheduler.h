@@ -0,0 +1,107 @@
+/***********************************************************************
+DetectionScheduler - Class to run frame-paced detection stages, such as
+hand extraction, on a bounded pool of worker threads with per-stage
+rate limits and priorities, dropping stale frames when stages fall
+behind.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef DETECTIONSCHEDULER_INCLUDED
+#define DETECTIONSCHEDULER_INCLUDED
+
+#include <string>
+#include <vector>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <Kinect/FrameBuffer.h>
+
+/* Forward declarations: */
+namespace Misc {
+template <class ParameterParam>
+class FunctionCall;
+}
+
+class DetectionScheduler
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::FunctionCall<const Kinect::FrameBuffer&> StageFunction; // Type for functions processing a frame in a stage
+	
+	struct StageStats // Structure holding a stage's frame and latency counters
+		{
+		/* Elements: */
+		public:
+		unsigned int numProcessed; // Number of frames processed by the stage
+		unsigned int numSkipped; // Number of frames skipped to maintain the stage's rate
+		unsigned int numDropped; // Number of accepted frames replaced by newer ones before the stage got to them
+		double lastLatency; // Time from submission to end of processing of the most recent frame in seconds
+		double averageLatency; // Average time from submission to end of processing in seconds
+		double maxLatency; // Maximum time from submission to end of processing in seconds
+		};
+	
+	private:
+	struct Stage // Structure representing a detection stage
+		{
+		/* Elements: */
+		public:
+		std::string name; // Stage name for reporting
+		double interval; // Minimum average interval between processed frames in seconds, or 0 to process every frame
+		int priority; // Stage priority; stages with higher priorities get workers first
+		StageFunction* function; // Function processing a frame
+		Kinect::FrameBuffer pendingFrame; // Frame waiting to be processed
+		bool havePending; // Flag if there is a frame waiting to be processed
+		double pendingTime; // Submission time of the pending frame
+		bool busy; // Flag if a worker is currently processing a frame for this stage
+		double nextRunTime; // Earliest submission time at which to accept the next frame
+		StageStats stats; // The stage's counters
+		};
+	
+	/* Elements: */
+	Threads::MutexCond stageCond; // Condition variable protecting the stage list and signaling pending frames
+	std::vector<Stage*> stages; // List of registered stages
+	volatile bool runWorkers; // Flag to keep the worker threads running
+	unsigned int numWorkers; // Number of worker threads
+	Threads::Thread* workers; // Array of worker threads
+	
+	/* Private methods: */
+	static double getTime(void); // Returns the current monotonic time in seconds
+	void* workerThreadMethod(void); // Method run by the worker threads
+	
+	/* Constructors and destructors: */
+	public:
+	DetectionScheduler(unsigned int sNumWorkers); // Creates a scheduler with the given number of worker threads
+	private:
+	DetectionScheduler(const DetectionScheduler& source); // Prohibit copy constructor
+	DetectionScheduler& operator=(const DetectionScheduler& source); // Prohibit assignment operator
+	public:
+	~DetectionScheduler(void);
+	
+	/* Methods: */
+	unsigned int addStage(const char* name,double rate,int priority,StageFunction* function); // Adds a stage processing frames at most at the given rate in Hz (0 for every frame) with the given priority; adopts function object; returns stage index
+	void setStageRate(unsigned int stageIndex,double newRate); // Sets the maximum rate of the given stage in Hz
+	void submitFrame(unsigned int stageIndex,const Kinect::FrameBuffer& frame); // Submits a new frame to the given stage
+	unsigned int getNumStages(void) const // Returns the number of registered stages
+		{
+		return stages.size();
+		}
+	std::string getStageName(unsigned int stageIndex) const; // Returns the name of the given stage
+	StageStats getStageStats(unsigned int stageIndex); // Returns a snapshot of the given stage's counters
+	};
+
+#endif
@@ -203,3 +203,55 @@ std::string getSpritesheetPath(DinosaurSpecies species, DinosaurAction action)
 
 	return path;
 	}
+
+/********************************
+Methods of struct DinosaurStore:
+********************************/
+
+unsigned int DinosaurStore::add(DinosaurSpecies newSpecies, const Point& newPosition)
+	{
+	unsigned int id = species.size();
+
+	/* Set identity */
+	species.push_back(newSpecies);
+
+	/* Set position and AI state */
+	position.push_back(newPosition);
+	velocity.push_back(Vector(0.0, 0.0, 0.0));
+	targetPosition.push_back(newPosition);
+	aiState.push_back(AI_IDLE);
+	targetDinoId.push_back(0);
+	stateTimer.push_back(0.0f);
+	respawnTimer.push_back(0.0f);
+	isAlive.push_back(1);
+	rng.push_back(std::minstd_rand());
+
+	/* Set animation state */
+	currentAction.push_back(ACTION_IDLE);
+	direction.push_back(DIR_S);
+	currentFrame.push_back(0);
+	animationTimer.push_back(0.0f);
+	frameTime.push_back(1.0f / 12.0f);
+	isVisible.push_back(1);
+	alpha.push_back(1.0f);
+
+	/* New dinosaurs have the highest ID, so the lists stay sorted */
+	alive.push_back(id);
+	visible.push_back(id);
+
+	return id;
+	}
+
+void DinosaurStore::updateLists(void)
+	{
+	alive.clear();
+	visible.clear();
+	unsigned int numDinos = species.size();
+	for(unsigned int id = 0; id < numDinos; ++id)
+		{
+		if(isAlive[id])
+			alive.push_back(id);
+		if(isVisible[id])
+			visible.push_back(id);
+		}
+	}
@@ -24,6 +24,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define DINOSAUR_INCLUDED
 
 #include <string>
+#include <vector>
+#include <random>
 #include "Types.h"
 
 /* Enumeration for dinosaur species */
@@ -100,36 +102,53 @@ struct DinosaurSpeciesInfo
 	int framesPerAction[ACTION_NUM_ACTIONS]; // Animation frame counts
 	};
 
-/* Main dinosaur entity structure */
-struct Dinosaur
+/* Structure-of-arrays storage of all dinosaur entities; a dinosaur's ID is its index into the component arrays */
+struct DinosaurStore
 	{
 	/* Identity */
-	DinosaurSpecies species;       // What kind of dinosaur
-	unsigned int id;               // Unique identifier
-
-	/* Position and movement */
-	Point position;                // Current 3D position (x, y, elevation)
-	Vector velocity;               // Current velocity vector
-	Point targetPosition;          // Where we're trying to go
-	Scalar targetElevation;        // Terrain height at current position
-
-	/* Animation state */
-	DinosaurAction currentAction;  // Current animation (walk, run, etc.)
-	DinosaurDirection direction;   // Facing direction (0-7)
-	int currentFrame;              // Current animation frame
-	float animationTimer;          // Time accumulator for animation
-	float frameTime;               // Seconds per frame
-
-	/* AI state */
-	DinosaurAIState aiState;       // Current behavior state
-	unsigned int targetDinoId;     // ID of dinosaur being chased/fled from
-	float stateTimer;              // Time in current state
-	float respawnTimer;            // Countdown to respawn after death
-
-	/* Flags */
-	bool isAlive;                  // False when dead/waiting for respawn
-	bool isVisible;                // For fade in/out effects
-	float alpha;                   // Opacity for fade effects
+	std::vector<DinosaurSpecies> species;          // What kind of dinosaur
+
+	/* Hot simulation components */
+	std::vector<Point> position;                   // Current 3D position (x, y, elevation)
+	std::vector<Vector> velocity;                  // Current velocity vector
+	std::vector<Point> targetPosition;             // Where we're trying to go
+	std::vector<DinosaurAIState> aiState;          // Current behavior state
+	std::vector<unsigned int> targetDinoId;        // ID of dinosaur being chased/fled from
+	std::vector<float> stateTimer;                 // Time in current state
+	std::vector<float> respawnTimer;               // Countdown to respawn after death
+	std::vector<unsigned char> isAlive;            // False when dead/waiting for respawn
+	std::vector<std::minstd_rand> rng;             // Per-dinosaur random number stream
+
+	/* Animation and rendering components */
+	std::vector<DinosaurAction> currentAction;     // Current animation (walk, run, etc.)
+	std::vector<DinosaurDirection> direction;      // Facing direction (0-7)
+	std::vector<int> currentFrame;                 // Current animation frame
+	std::vector<float> animationTimer;             // Time accumulator for animation
+	std::vector<float> frameTime;                  // Seconds per frame
+	std::vector<unsigned char> isVisible;          // For fade in/out effects
+	std::vector<float> alpha;                      // Opacity for fade effects
+
+	/* Compact index lists, in ascending ID order */
+	std::vector<unsigned int> alive;               // IDs of alive dinosaurs
+	std::vector<unsigned int> visible;             // IDs of visible dinosaurs
+
+	/* Methods */
+	unsigned int size(void) const { return species.size(); }
+	unsigned int add(DinosaurSpecies newSpecies, const Point& newPosition); // Appends an idle, alive dinosaur and returns its ID
+	void updateLists(void); // Rebuilds the alive and visible lists from the component flags
+	};
+
+/* Read-only view of the visible dinosaurs for rendering */
+struct DinosaurView
+	{
+	unsigned int numVisible;                       // Number of visible dinosaurs
+	const unsigned int* visible;                   // IDs of visible dinosaurs
+	const DinosaurSpecies* species;                // Per-ID component arrays
+	const Point* position;
+	const DinosaurAction* currentAction;
+	const DinosaurDirection* direction;
+	const int* currentFrame;
+	const float* alpha;
 	};
 
 /* Helper functions */
@@ -27,18 +27,22 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <algorithm>
 #include <chrono>
 
-#include "WaterTable2.h"
 #include "TerrainQuery.h"
 
 /**********************************
 Methods of class DinosaurEcosystem:
 **********************************/
 
-DinosaurEcosystem::DinosaurEcosystem(const WaterTable2* sWaterTable)
-	:waterTable(sWaterTable),
-	 terrainQuery(0),
-	 nextDinosaurId(0),
-	 randomFloat(0.0f, 1.0f),
+DinosaurEcosystem::DinosaurEcosystem(unsigned int sNumThreads, unsigned int sSeed)
+	:terrainQuery(0),
+	 cellSize(1.0),
+	 seed(sSeed),
+	 numThreads(sNumThreads > 0 ? sNumThreads : 1U),
+	 workerThreads(0),
+	 workerBarrier(0),
+	 runWorkers(true),
+	 currentPhase(PHASE_AI),
+	 currentDeltaTime(0.0f),
 	 handFleeRadius(0.15),           // Flee from hands within this radius
 	 predatorSightRange(0.20),       // Predators can see this far
 	 fleeDistance(0.25),             // Flee this far before calming down
@@ -46,8 +50,9 @@ DinosaurEcosystem::DinosaurEcosystem(const WaterTable2* sWaterTable)
 	 animationSpeed(12.0f),          // 12 frames per second
 	 speedScale(1.0)                 // Default speed scale
 	{
-	/* Initialize random number generator with time-based seed */
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+	/* Initialize the spawning random number stream, with a time-based seed if none was given */
+	if(seed == 0)
+		seed = (unsigned int)(std::chrono::system_clock::now().time_since_epoch().count());
 	rng.seed(seed);
 
 	/* Set default bounds (will be updated later) */
@@ -57,10 +62,35 @@ DinosaurEcosystem::DinosaurEcosystem(const WaterTable2* sWaterTable)
 	bounds.maxY = 0.4;
 	bounds.minZ = -20.0;
 	bounds.maxZ = 100.0;
+
+	numCells[0] = numCells[1] = 0;
+
+	/* Steer away from hazards within reach of the dinosaurs' avoidance probes */
+	navigationField.setRepulsionRange(0.04);
+
+	/* Start the update worker threads */
+	bandAttacks.resize(numThreads);
+	if(numThreads > 1)
+		{
+		workerBarrier = new Threads::Barrier(numThreads);
+		workerThreads = new Threads::Thread[numThreads - 1];
+		for(unsigned int i = 1; i < numThreads; ++i)
+			workerThreads[i - 1].start(this, &DinosaurEcosystem::workerThreadMethod, i);
+		}
 	}
 
 DinosaurEcosystem::~DinosaurEcosystem(void)
 	{
+	/* Release the worker threads so they can shut down */
+	if(numThreads > 1)
+		{
+		runWorkers = false;
+		workerBarrier->synchronize();
+		for(unsigned int i = 1; i < numThreads; ++i)
+			workerThreads[i - 1].join();
+		delete[] workerThreads;
+		delete workerBarrier;
+		}
 	}
 
 void DinosaurEcosystem::setBounds(const Bounds& newBounds)
@@ -71,6 +101,7 @@ void DinosaurEcosystem::setBounds(const Bounds& newBounds)
 void DinosaurEcosystem::setTerrainQuery(const TerrainQuery* query)
 	{
 	terrainQuery = query;
+	navigationField.invalidate();
 	}
 
 void DinosaurEcosystem::setSpeedScale(Scalar scale)
@@ -78,6 +109,12 @@ void DinosaurEcosystem::setSpeedScale(Scalar scale)
 	speedScale = scale;
 	}
 
+void DinosaurEcosystem::updateNavigationField(void)
+	{
+	if(terrainQuery != 0)
+		navigationField.update(*terrainQuery, bounds.minX, bounds.maxX, bounds.minY, bounds.maxY);
+	}
+
 DinosaurEcosystem::TerrainInfo DinosaurEcosystem::queryTerrain(const Point& pos) const
 	{
 	TerrainInfo info;
@@ -95,26 +132,45 @@ DinosaurEcosystem::TerrainInfo DinosaurEcosystem::queryTerrain(const Point& pos)
 		return info;
 		}
 
-	/* Fallback to domain midpoint if TerrainQuery not available */
-	if(waterTable != 0)
+	/* Fallback to domain midpoint if TerrainQuery has no grids yet */
+	if(terrainQuery != 0)
+		info.elevation = terrainQuery->query(pos[0], pos[1]).terrainHeight;
+
+	return info;
+	}
+
+void DinosaurEcosystem::queryTerrainBatch(const Point* positions, size_t numPositions, TerrainInfo* infos) const
+	{
+	/* Use TerrainQuery if available, sampling the whole batch from one snapshot */
+	if(terrainQuery != 0 && terrainQuery->isDataValid())
 		{
-		const WaterTable2::Box& domain = waterTable->getDomain();
-		info.elevation = (domain.min[2] + domain.max[2]) * 0.5;
+		TerrainQuery::TerrainInfo tqInfos[maxTerrainBatchSize];
+		for(size_t base = 0; base < numPositions; base += maxTerrainBatchSize)
+			{
+			size_t count = std::min(numPositions - base, size_t(maxTerrainBatchSize));
+			terrainQuery->queryBatch(positions + base, count, tqInfos);
+			for(size_t i = 0; i < count; ++i)
+				{
+				infos[base + i].elevation = tqInfos[i].terrainHeight;
+				infos[base + i].waterDepth = tqInfos[i].waterDepth;
+				infos[base + i].isLava = (tqInfos[i].type == TerrainQuery::TERRAIN_LAVA);
+				}
+			}
+		return;
 		}
 
-	return info;
+	/* Fall back to per-position queries */
+	for(size_t i = 0; i < numPositions; ++i)
+		infos[i] = queryTerrain(positions[i]);
 	}
 
-bool DinosaurEcosystem::isPositionSafe(const Point& pos) const
+bool DinosaurEcosystem::isTerrainSafe(const Point& pos, const TerrainInfo& terrain) const
 	{
 	/* Check bounds */
 	if(pos[0] < bounds.minX || pos[0] > bounds.maxX ||
 	   pos[1] < bounds.minY || pos[1] > bounds.maxY)
 		return false;
 
-	/* Query terrain */
-	TerrainInfo terrain = queryTerrain(pos);
-
 	/* Unsafe if lava or deep water */
 	if(terrain.isLava)
 		return false;
@@ -124,27 +180,62 @@ bool DinosaurEcosystem::isPositionSafe(const Point& pos) const
 	return true;
 	}
 
-Point DinosaurEcosystem::findValidSpawnPosition(void)
+bool DinosaurEcosystem::isPositionSafe(const Point& pos) const
+	{
+	/* Check bounds before querying terrain */
+	if(pos[0] < bounds.minX || pos[0] > bounds.maxX ||
+	   pos[1] < bounds.minY || pos[1] > bounds.maxY)
+		return false;
+
+	/* Look up the navigation field if it is current */
+	if(navigationField.isValid())
+		return navigationField.isSafe(pos[0], pos[1]);
+
+	return isTerrainSafe(pos, queryTerrain(pos));
+	}
+
+Point DinosaurEcosystem::findValidSpawnPosition(std::minstd_rand& stream)
 	{
 	std::cout << "findValidSpawnPosition: bounds X[" << bounds.minX << " to " << bounds.maxX << "]"
 	          << " Y[" << bounds.minY << " to " << bounds.maxY << "]" << std::endl;
 
-	/* Try random positions until we find a safe one */
-	for(int attempts = 0; attempts < 100; ++attempts)
+	/* Pick a random position inside a random safe spawn cell of the navigation field if there are any */
+	size_t numSpawnCells = navigationField.isValid() ? navigationField.getNumSpawnCells() : 0;
+	if(numSpawnCells > 0)
 		{
-		Point pos;
-		pos[0] = bounds.minX + randomFloat(rng) * (bounds.maxX - bounds.minX);
-		pos[1] = bounds.minY + randomFloat(rng) * (bounds.maxY - bounds.minY);
-		pos[2] = 0.0; // Will be updated from terrain query
+		size_t cell = std::min(size_t(randomFloat(stream) * float(numSpawnCells)), numSpawnCells - 1);
+		Scalar fx = randomFloat(stream);
+		Scalar fy = randomFloat(stream);
+		Point pos = navigationField.getSpawnPosition(cell, fx, fy);
+		pos[2] = queryTerrain(pos).elevation;
+		std::cout << "  -> FOUND spawn pos: (" << pos[0] << ", " << pos[1] << ", " << pos[2] << ")" << std::endl;
+		return pos;
+		}
 
-		/* Get actual terrain height at this position */
-		TerrainInfo terrain = queryTerrain(pos);
-		pos[2] = terrain.elevation;
+	/* Try batches of random positions until we find a safe one */
+	Point candidates[maxTerrainBatchSize];
+	TerrainInfo terrains[maxTerrainBatchSize];
+	for(int attempts = 0; attempts < 100; attempts += maxTerrainBatchSize)
+		{
+		int count = std::min(100 - attempts, int(maxTerrainBatchSize));
+		for(int i = 0; i < count; ++i)
+			{
+			candidates[i][0] = bounds.minX + randomFloat(stream) * (bounds.maxX - bounds.minX);
+			candidates[i][1] = bounds.minY + randomFloat(stream) * (bounds.maxY - bounds.minY);
+			candidates[i][2] = 0.0; // Will be updated from terrain query
+			}
 
-		if(isPositionSafe(pos))
+		/* Get actual terrain at all candidate positions at once */
+		queryTerrainBatch(candidates, count, terrains);
+		for(int i = 0; i < count; ++i)
 			{
-			std::cout << "  -> FOUND spawn pos: (" << pos[0] << ", " << pos[1] << ", " << pos[2] << ")" << std::endl;
-			return pos;
+			if(isTerrainSafe(candidates[i], terrains[i]))
+				{
+				Point pos = candidates[i];
+				pos[2] = terrains[i].elevation;
+				std::cout << "  -> FOUND spawn pos: (" << pos[0] << ", " << pos[1] << ", " << pos[2] << ")" << std::endl;
+				return pos;
+				}
 			}
 		}
 
@@ -164,56 +255,42 @@ Point DinosaurEcosystem::findValidSpawnPosition(void)
 
 void DinosaurEcosystem::spawnDinosaurRandom(DinosaurSpecies species)
 	{
-	Point pos = findValidSpawnPosition();
+	Point pos = findValidSpawnPosition(rng);
 	spawnDinosaur(species, pos);
 	}
 
 unsigned int DinosaurEcosystem::spawnDinosaur(DinosaurSpecies species, const Point& position)
 	{
-	Dinosaur dino;
-
-	/* Set identity */
-	dino.species = species;
-	dino.id = nextDinosaurId++;
-
-	/* Set position */
-	dino.position = position;
-	dino.velocity = Vector(0.0, 0.0, 0.0);
-	dino.targetPosition = position;
-	dino.targetElevation = position[2];
-
-	/* Set animation state */
-	dino.currentAction = ACTION_IDLE;
-	dino.direction = static_cast<DinosaurDirection>(int(randomFloat(rng) * 8) % 8);
-	dino.currentFrame = 0;
-	dino.animationTimer = 0.0f;
-	dino.frameTime = 1.0f / animationSpeed;
-
-	/* Set AI state */
-	dino.aiState = AI_IDLE;
-	dino.targetDinoId = 0;
-	dino.stateTimer = randomFloat(rng) * 2.0f; // Stagger initial behaviors
-	dino.respawnTimer = 0.0f;
+	/* Append the new dinosaur's components; its ID is its index */
+	unsigned int d = dinos.add(species, position);
+	previousPositions.push_back(position);
+	previousAlive.push_back(1);
+	renderPositions.push_back(position);
 
-	/* Set flags */
-	dino.isAlive = true;
-	dino.isVisible = true;
-	dino.alpha = 1.0f;
+	/* Seed the dinosaur's own random number stream from the ecosystem seed and its ID */
+	std::seed_seq streamSeed = {seed, d};
+	dinos.rng[d].seed(streamSeed);
 
-	dinosaurs.push_back(dino);
+	/* Randomize facing direction and stagger initial behaviors */
+	dinos.direction[d] = static_cast<DinosaurDirection>(int(randomFloat(dinos.rng[d]) * 8) % 8);
+	dinos.frameTime[d] = 1.0f / animationSpeed;
+	dinos.stateTimer[d] = randomFloat(dinos.rng[d]) * 2.0f;
 
 	const DinosaurSpeciesInfo& info = getSpeciesInfo(species);
 	std::cout << "DinosaurEcosystem: Spawned " << info.name
-	          << " #" << dino.id << " at ("
+	          << " #" << d << " at ("
 	          << position[0] << ", " << position[1] << ")" << std::endl;
 
-	return dino.id;
+	return d;
 	}
 
 void DinosaurEcosystem::spawnInitialPopulation(void)
 	{
 	std::cout << "DinosaurEcosystem: Spawning initial population..." << std::endl;
 
+	/* Prepare spawn cells from the current terrain */
+	updateNavigationField();
+
 	/* Herbivores */
 	for(int i = 0; i < 5; ++i)
 		spawnDinosaurRandom(DINO_TRICERATOPS);
@@ -234,7 +311,7 @@ void DinosaurEcosystem::spawnInitialPopulation(void)
 	spawnDinosaurRandom(DINO_RAPTOR_BLUE);
 	spawnDinosaurRandom(DINO_RAPTOR_RED);
 
-	std::cout << "DinosaurEcosystem: Spawned " << dinosaurs.size()
+	std::cout << "DinosaurEcosystem: Spawned " << dinos.size()
 	          << " dinosaurs" << std::endl;
 	}
 
@@ -243,36 +320,26 @@ void DinosaurEcosystem::setDetectedHands(const std::vector<Point>& hands)
 	detectedHands = hands;
 	}
 
-bool DinosaurEcosystem::findNearestThreat(const Dinosaur& dino, Point& threatPos, Scalar& distance) const
+bool DinosaurEcosystem::findNearestThreat(unsigned int d, Point& threatPos, Scalar& distance) const
 	{
 	distance = 999999.0;
 	bool foundThreat = false;
 
 	/* Check for nearby predators */
-	for(const Dinosaur& other : dinosaurs)
+	const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
+	Scalar predatorDist;
+	unsigned int predator;
+	if(findNearestDinosaur(d, true, info.sightRange, predator, predatorDist))
 		{
-		if(!other.isAlive || other.id == dino.id)
-			continue;
-
-		if(isPredator(other.species))
-			{
-			Vector diff = other.position - dino.position;
-			Scalar dist = Geometry::mag(diff);
-			const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
-
-			if(dist < info.sightRange && dist < distance)
-				{
-				distance = dist;
-				threatPos = other.position;
-				foundThreat = true;
-				}
-			}
+		distance = predatorDist;
+		threatPos = dinos.position[predator];
+		foundThreat = true;
 		}
 
 	/* Check for nearby hands */
 	for(const Point& hand : detectedHands)
 		{
-		Vector diff = hand - dino.position;
+		Vector diff = hand - dinos.position[d];
 		Scalar dist = Geometry::mag(diff);
 
 		if(dist < handFleeRadius && dist < distance)
@@ -284,11 +351,11 @@ bool DinosaurEcosystem::findNearestThreat(const Dinosaur& dino, Point& threatPos
 		}
 
 	/* Check for nearby lava */
-	TerrainInfo terrain = queryTerrain(dino.position);
+	TerrainInfo terrain = queryTerrain(dinos.position[d]);
 	if(terrain.isLava)
 		{
 		/* Find direction away from lowest point (center of sandbox usually) */
-		threatPos = dino.position;
+		threatPos = dinos.position[d];
 		threatPos[2] = terrain.elevation;  // Use current terrain elevation
 		distance = 0.01;  // Very close threat!
 		foundThreat = true;
@@ -297,76 +364,41 @@ bool DinosaurEcosystem::findNearestThreat(const Dinosaur& dino, Point& threatPos
 	return foundThreat;
 	}
 
-bool DinosaurEcosystem::findNearestPrey(const Dinosaur& predator, unsigned int& preyId, Scalar& distance) const
+bool DinosaurEcosystem::findNearestPrey(unsigned int p, unsigned int& preyId, Scalar& distance) const
 	{
 	distance = 999999.0;
 	bool foundPrey = false;
 
-	const DinosaurSpeciesInfo& predInfo = getSpeciesInfo(predator.species);
-
-	for(const Dinosaur& other : dinosaurs)
-		{
-		if(!other.isAlive || other.id == predator.id)
-			continue;
-
-		if(isHerbivore(other.species))
-			{
-			Vector diff = other.position - predator.position;
-			Scalar dist = Geometry::mag(diff);
+	const DinosaurSpeciesInfo& predInfo = getSpeciesInfo(dinos.species[p]);
 
-			if(dist < predInfo.sightRange && dist < distance)
-				{
-				distance = dist;
-				preyId = other.id;
-				foundPrey = true;
-				}
-			}
-		}
+	if(findNearestDinosaur(p, false, predInfo.sightRange, preyId, distance))
+		foundPrey = true;
 
 	return foundPrey;
 	}
 
-Vector DinosaurEcosystem::calculateAvoidanceVector(const Dinosaur& dino) const
+Vector DinosaurEcosystem::calculateAvoidanceVector(unsigned int d) const
 	{
 	Vector avoidance(0.0, 0.0, 0.0);
 
 	/* Avoid sandbox boundaries */
 	Scalar boundaryMargin = 0.05;
 
-	if(dino.position[0] < bounds.minX + boundaryMargin)
+	if(dinos.position[d][0] < bounds.minX + boundaryMargin)
 		avoidance[0] += 1.0;
-	if(dino.position[0] > bounds.maxX - boundaryMargin)
+	if(dinos.position[d][0] > bounds.maxX - boundaryMargin)
 		avoidance[0] -= 1.0;
-	if(dino.position[1] < bounds.minY + boundaryMargin)
+	if(dinos.position[d][1] < bounds.minY + boundaryMargin)
 		avoidance[1] += 1.0;
-	if(dino.position[1] > bounds.maxY - boundaryMargin)
+	if(dinos.position[d][1] > bounds.maxY - boundaryMargin)
 		avoidance[1] -= 1.0;
 
-	/* Avoid lava (check nearby positions) */
-	Scalar checkDist = 0.03;
-	for(int dx = -1; dx <= 1; ++dx)
+	/* Avoid lava and water by looking up the precomputed repulsion of the navigation cell */
+	if(navigationField.isValid())
 		{
-		for(int dy = -1; dy <= 1; ++dy)
-			{
-			if(dx == 0 && dy == 0)
-				continue;
-
-			Point checkPos = dino.position;
-			checkPos[0] += dx * checkDist;
-			checkPos[1] += dy * checkDist;
-
-			TerrainInfo terrain = queryTerrain(checkPos);
-			if(terrain.isLava)
-				{
-				avoidance[0] -= dx * 2.0;
-				avoidance[1] -= dy * 2.0;
-				}
-			if(terrain.waterDepth > 0.0)
-				{
-				avoidance[0] -= dx * 1.0;
-				avoidance[1] -= dy * 1.0;
-				}
-			}
+		const NavigationField::Cell& cell = navigationField.getCell(dinos.position[d][0], dinos.position[d][1]);
+		avoidance[0] += cell.repulsion[0];
+		avoidance[1] += cell.repulsion[1];
 		}
 
 	/* Normalize if non-zero */
@@ -377,32 +409,50 @@ Vector DinosaurEcosystem::calculateAvoidanceVector(const Dinosaur& dino) const
 	return avoidance;
 	}
 
-Point DinosaurEcosystem::calculateHerdCenter(const Dinosaur& dino) const
+Point DinosaurEcosystem::calculateHerdCenter(unsigned int d) const
 	{
 	Point center(0.0, 0.0, 0.0);
 	int count = 0;
 
-	for(const Dinosaur& other : dinosaurs)
-		{
-		if(!other.isAlive || other.id == dino.id)
-			continue;
-
-		/* Only herd with same species */
-		if(other.species == dino.species)
+	/* Only visit grid cells overlapping the herd radius */
+	Scalar herdRadius = 0.15;
+	Point corner = dinos.position[d];
+	corner[0] -= herdRadius;
+	corner[1] -= herdRadius;
+	int cellMin[2];
+	getCell(corner, cellMin);
+	corner[0] += 2.0 * herdRadius;
+	corner[1] += 2.0 * herdRadius;
+	int cellMax[2];
+	getCell(corner, cellMax);
+
+	for(int cy = cellMin[1]; cy <= cellMax[1]; ++cy)
+		for(int cx = cellMin[0]; cx <= cellMax[0]; ++cx)
 			{
-			Vector diff = other.position - dino.position;
-			Scalar dist = Geometry::mag(diff);
-
-			/* Only consider nearby herd members */
-			if(dist < 0.15)
+			int cellIndex = cy * numCells[0] + cx;
+			for(unsigned int e = cellStarts[cellIndex]; e < cellStarts[cellIndex + 1]; ++e)
 				{
-				center[0] += other.position[0];
-				center[1] += other.position[1];
-				center[2] += other.position[2];
-				++count;
+				unsigned int o = cellEntries[e];
+				if(!dinos.isAlive[o] || o == d)
+					continue;
+
+				/* Only herd with same species */
+				if(dinos.species[o] == dinos.species[d])
+					{
+					Vector diff = dinos.position[o] - dinos.position[d];
+					Scalar dist = Geometry::mag(diff);
+
+					/* Only consider nearby herd members */
+					if(dist < herdRadius)
+						{
+						center[0] += dinos.position[o][0];
+						center[1] += dinos.position[o][1];
+						center[2] += dinos.position[o][2];
+						++count;
+						}
+					}
 				}
 			}
-		}
 
 	if(count > 0)
 		{
@@ -413,164 +463,268 @@ Point DinosaurEcosystem::calculateHerdCenter(const Dinosaur& dino) const
 		}
 
 	/* No herd members nearby, return current position */
-	return dino.position;
+	return dinos.position[d];
 	}
 
-Point DinosaurEcosystem::chooseWanderTarget(const Dinosaur& dino)
+Point DinosaurEcosystem::chooseWanderTarget(unsigned int d)
 	{
 	/* Wander within 30% of sandbox width */
 	Scalar wanderRadius = (bounds.maxX - bounds.minX) * 0.3;
 
 	for(int attempts = 0; attempts < 20; ++attempts)
 		{
-		Scalar angle = randomFloat(rng) * 2.0 * M_PI;
-		Scalar dist = randomFloat(rng) * wanderRadius;
+		Scalar angle = randomFloat(dinos.rng[d]) * 2.0 * M_PI;
+		Scalar dist = randomFloat(dinos.rng[d]) * wanderRadius;
 
 		Point target;
-		target[0] = dino.position[0] + std::cos(angle) * dist;
-		target[1] = dino.position[1] + std::sin(angle) * dist;
-		target[2] = dino.position[2];
+		target[0] = dinos.position[d][0] + std::cos(angle) * dist;
+		target[1] = dinos.position[d][1] + std::sin(angle) * dist;
+		target[2] = dinos.position[d][2];
 
 		if(isPositionSafe(target))
 			return target;
 		}
 
-	/* Fallback: random position within bounds (not just center) */
+	/* Fallback: random safe spawn cell of the navigation field if there are any */
+	size_t numSpawnCells = navigationField.isValid() ? navigationField.getNumSpawnCells() : 0;
+	if(numSpawnCells > 0)
+		{
+		size_t cell = std::min(size_t(randomFloat(dinos.rng[d]) * float(numSpawnCells)), numSpawnCells - 1);
+		Scalar fx = randomFloat(dinos.rng[d]);
+		Scalar fy = randomFloat(dinos.rng[d]);
+		Point target = navigationField.getSpawnPosition(cell, fx, fy);
+		target[2] = dinos.position[d][2];
+		return target;
+		}
+
+	/* Otherwise, random position within bounds (not just center) */
 	Point target;
-	target[0] = bounds.minX + randomFloat(rng) * (bounds.maxX - bounds.minX);
-	target[1] = bounds.minY + randomFloat(rng) * (bounds.maxY - bounds.minY);
-	target[2] = dino.position[2];
+	target[0] = bounds.minX + randomFloat(dinos.rng[d]) * (bounds.maxX - bounds.minX);
+	target[1] = bounds.minY + randomFloat(dinos.rng[d]) * (bounds.maxY - bounds.minY);
+	target[2] = dinos.position[d][2];
 	return target;
 	}
 
-void DinosaurEcosystem::updateDinosaurAI(Dinosaur& dino, float deltaTime)
+void DinosaurEcosystem::rebuildSpatialIndex(void)
 	{
-	if(!dino.isAlive)
+	unsigned int numAlive = dinos.alive.size();
+
+	/* Size the cells to hold about one dinosaur each on average */
+	Scalar width = std::max(bounds.maxX - bounds.minX, Scalar(1.0e-6));
+	Scalar height = std::max(bounds.maxY - bounds.minY, Scalar(1.0e-6));
+	cellSize = std::sqrt(width * height / Scalar(std::max(numAlive, 1U)));
+	numCells[0] = std::max(1, std::min(int(std::ceil(width / cellSize)), 256));
+	numCells[1] = std::max(1, std::min(int(std::ceil(height / cellSize)), 256));
+	cellSize = std::max(width / Scalar(numCells[0]), height / Scalar(numCells[1]));
+
+	/* Sort alive dinosaurs into cells with a counting sort */
+	int totalCells = numCells[0] * numCells[1];
+	cellStarts.assign(totalCells + 1, 0);
+	for(unsigned int d : dinos.alive)
+		{
+		int cell[2];
+		getCell(dinos.position[d], cell);
+		++cellStarts[cell[1] * numCells[0] + cell[0] + 1];
+		}
+	for(int i = 0; i < totalCells; ++i)
+		cellStarts[i + 1] += cellStarts[i];
+
+	cellEntries.resize(numAlive);
+	std::vector<unsigned int> cellFill(cellStarts.begin(), cellStarts.end() - 1);
+	for(unsigned int d : dinos.alive)
+		{
+		int cell[2];
+		getCell(dinos.position[d], cell);
+		cellEntries[cellFill[cell[1] * numCells[0] + cell[0]]++] = d;
+		}
+	}
+
+void DinosaurEcosystem::getCell(const Point& pos, int cell[2]) const
+	{
+	int cx = int(std::floor((pos[0] - bounds.minX) / cellSize));
+	int cy = int(std::floor((pos[1] - bounds.minY) / cellSize));
+	cell[0] = std::max(0, std::min(cx, numCells[0] - 1));
+	cell[1] = std::max(0, std::min(cy, numCells[1] - 1));
+	}
+
+bool DinosaurEcosystem::findNearestDinosaur(unsigned int d, bool predators, Scalar range, unsigned int& nearest, Scalar& distance) const
+	{
+	bool found = false;
+	distance = range;
+
+	/* Visit rings of cells around the dinosaur's cell, closest first */
+	int center[2];
+	getCell(dinos.position[d], center);
+	int maxRing = std::max(std::max(center[0], numCells[0] - 1 - center[0]), std::max(center[1], numCells[1] - 1 - center[1]));
+	for(int ring = 0; ring <= maxRing; ++ring)
+		{
+		/* Stop once no cell in this ring can contain anything closer than the current best */
+		if(Scalar(ring - 1) * cellSize >= distance)
+			break;
+
+		int cyMin = std::max(center[1] - ring, 0);
+		int cyMax = std::min(center[1] + ring, numCells[1] - 1);
+		for(int cy = cyMin; cy <= cyMax; ++cy)
+			{
+			/* Interior rows of the ring only contribute their two end cells */
+			bool edgeRow = cy == center[1] - ring || cy == center[1] + ring;
+			int step = edgeRow || ring == 0 ? 1 : 2 * ring;
+			for(int cx = center[0] - ring; cx <= center[0] + ring; cx += step)
+				{
+				if(cx < 0 || cx >= numCells[0])
+					continue;
+
+				int cellIndex = cy * numCells[0] + cx;
+				for(unsigned int e = cellStarts[cellIndex]; e < cellStarts[cellIndex + 1]; ++e)
+					{
+					unsigned int o = cellEntries[e];
+					if(!dinos.isAlive[o] || o == d || isPredator(dinos.species[o]) != predators)
+						continue;
+
+					Vector diff = dinos.position[o] - dinos.position[d];
+					Scalar dist = Geometry::mag(diff);
+					if(dist < distance)
+						{
+						distance = dist;
+						nearest = o;
+						found = true;
+						}
+					}
+				}
+			}
+		}
+
+	return found;
+	}
+
+void DinosaurEcosystem::updateDinosaurAI(unsigned int d, float deltaTime, std::vector<Attack>& attacks)
+	{
+	if(!dinos.isAlive[d])
 		{
 		/* Handle respawn timer */
-		if(dino.aiState == AI_DEAD)
+		if(dinos.aiState[d] == AI_DEAD)
 			{
-			dino.respawnTimer -= deltaTime;
-			if(dino.respawnTimer <= 0.0f)
+			dinos.respawnTimer[d] -= deltaTime;
+			if(dinos.respawnTimer[d] <= 0.0f)
 				{
 				/* Respawn at new location */
-				Point newPos = findValidSpawnPosition();
-				dino.position = newPos;
-				dino.isAlive = true;
-				dino.isVisible = true;
-				dino.alpha = 1.0f;
-				dino.aiState = AI_IDLE;
-				dino.currentAction = ACTION_IDLE;
-				dino.stateTimer = 0.0f;
-
-				const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
+				Point newPos = findValidSpawnPosition(dinos.rng[d]);
+				dinos.position[d] = newPos;
+				dinos.isAlive[d] = true;
+				dinos.isVisible[d] = true;
+				dinos.alpha[d] = 1.0f;
+				dinos.aiState[d] = AI_IDLE;
+				dinos.currentAction[d] = ACTION_IDLE;
+				dinos.stateTimer[d] = 0.0f;
+
+				const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
 				std::cout << "DinosaurEcosystem: " << info.name
-				          << " #" << dino.id << " respawned!" << std::endl;
+				          << " #" << d << " respawned!" << std::endl;
 				}
 			}
 		return;
 		}
 
-	dino.stateTimer += deltaTime;
+	dinos.stateTimer[d] += deltaTime;
 
-	const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
+	const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
 
-	if(isHerbivore(dino.species))
+	if(isHerbivore(dinos.species[d]))
 		{
 		/* Herbivore AI */
 		Point threatPos;
 		Scalar threatDist;
 
-		if(findNearestThreat(dino, threatPos, threatDist))
+		if(findNearestThreat(d, threatPos, threatDist))
 			{
 			/* Threat detected - FLEE! */
-			dino.aiState = AI_FLEEING;
-			dino.currentAction = ACTION_RUN;
+			dinos.aiState[d] = AI_FLEEING;
+			dinos.currentAction[d] = ACTION_RUN;
 
 			/* Run away from threat */
-			Vector fleeDir = dino.position - threatPos;
+			Vector fleeDir = dinos.position[d] - threatPos;
 			Scalar mag = Geometry::mag(fleeDir);
 			if(mag > 0.001)
 				fleeDir = fleeDir / mag;
 
 			/* Add some randomness to flee direction */
-			fleeDir[0] += (randomFloat(rng) - 0.5) * 0.3;
-			fleeDir[1] += (randomFloat(rng) - 0.5) * 0.3;
+			fleeDir[0] += (randomFloat(dinos.rng[d]) - 0.5) * 0.3;
+			fleeDir[1] += (randomFloat(dinos.rng[d]) - 0.5) * 0.3;
 			mag = Geometry::mag(fleeDir);
 			if(mag > 0.001)
 				fleeDir = fleeDir / mag;
 
-			dino.velocity = fleeDir * info.runSpeed * speedScale;
-			dino.stateTimer = 0.0f;
+			dinos.velocity[d] = fleeDir * info.runSpeed * speedScale;
+			dinos.stateTimer[d] = 0.0f;
 			}
-		else if(dino.aiState == AI_FLEEING)
+		else if(dinos.aiState[d] == AI_FLEEING)
 			{
 			/* Continue fleeing for a bit after threat disappears */
-			if(dino.stateTimer > 2.0f)
+			if(dinos.stateTimer[d] > 2.0f)
 				{
-				dino.aiState = AI_WANDERING;
-				dino.currentAction = ACTION_WALK;
-				dino.targetPosition = chooseWanderTarget(dino);
-				dino.stateTimer = 0.0f;
+				dinos.aiState[d] = AI_WANDERING;
+				dinos.currentAction[d] = ACTION_WALK;
+				dinos.targetPosition[d] = chooseWanderTarget(d);
+				dinos.stateTimer[d] = 0.0f;
 				}
 			}
-		else if(dino.aiState == AI_IDLE)
+		else if(dinos.aiState[d] == AI_IDLE)
 			{
 			/* Occasionally start grazing or wandering */
-			if(dino.stateTimer > 1.0f + randomFloat(rng) * 3.0f)
+			if(dinos.stateTimer[d] > 1.0f + randomFloat(dinos.rng[d]) * 3.0f)
 				{
-				if(randomFloat(rng) < 0.3f)
+				if(randomFloat(dinos.rng[d]) < 0.3f)
 					{
 					/* Start grazing */
-					dino.aiState = AI_GRAZING;
-					dino.currentAction = ACTION_IDLE;
-					dino.velocity = Vector(0.0, 0.0, 0.0);
+					dinos.aiState[d] = AI_GRAZING;
+					dinos.currentAction[d] = ACTION_IDLE;
+					dinos.velocity[d] = Vector(0.0, 0.0, 0.0);
 					}
 				else
 					{
 					/* Start wandering */
-					dino.aiState = AI_WANDERING;
-					dino.currentAction = ACTION_WALK;
-					dino.targetPosition = chooseWanderTarget(dino);
+					dinos.aiState[d] = AI_WANDERING;
+					dinos.currentAction[d] = ACTION_WALK;
+					dinos.targetPosition[d] = chooseWanderTarget(d);
 
 					/* Consider herd - bias toward herd center */
-					Point herdCenter = calculateHerdCenter(dino);
-					dino.targetPosition[0] = dino.targetPosition[0] * 0.6 + herdCenter[0] * 0.4;
-					dino.targetPosition[1] = dino.targetPosition[1] * 0.6 + herdCenter[1] * 0.4;
+					Point herdCenter = calculateHerdCenter(d);
+					dinos.targetPosition[d][0] = dinos.targetPosition[d][0] * 0.6 + herdCenter[0] * 0.4;
+					dinos.targetPosition[d][1] = dinos.targetPosition[d][1] * 0.6 + herdCenter[1] * 0.4;
 					}
-				dino.stateTimer = 0.0f;
+				dinos.stateTimer[d] = 0.0f;
 				}
 			}
-		else if(dino.aiState == AI_GRAZING)
+		else if(dinos.aiState[d] == AI_GRAZING)
 			{
 			/* Graze for a while then wander */
-			if(dino.stateTimer > 2.0f + randomFloat(rng) * 4.0f)
+			if(dinos.stateTimer[d] > 2.0f + randomFloat(dinos.rng[d]) * 4.0f)
 				{
-				dino.aiState = AI_WANDERING;
-				dino.currentAction = ACTION_WALK;
-				dino.targetPosition = chooseWanderTarget(dino);
-				dino.stateTimer = 0.0f;
+				dinos.aiState[d] = AI_WANDERING;
+				dinos.currentAction[d] = ACTION_WALK;
+				dinos.targetPosition[d] = chooseWanderTarget(d);
+				dinos.stateTimer[d] = 0.0f;
 				}
 			}
-		else if(dino.aiState == AI_WANDERING)
+		else if(dinos.aiState[d] == AI_WANDERING)
 			{
 			/* Move toward target */
-			Vector toTarget = dino.targetPosition - dino.position;
+			Vector toTarget = dinos.targetPosition[d] - dinos.position[d];
 			Scalar distToTarget = Geometry::mag(toTarget);
 
 			if(distToTarget < 0.02)
 				{
 				/* Reached target, become idle */
-				dino.aiState = AI_IDLE;
-				dino.currentAction = ACTION_IDLE;
-				dino.velocity = Vector(0.0, 0.0, 0.0);
-				dino.stateTimer = 0.0f;
+				dinos.aiState[d] = AI_IDLE;
+				dinos.currentAction[d] = ACTION_IDLE;
+				dinos.velocity[d] = Vector(0.0, 0.0, 0.0);
+				dinos.stateTimer[d] = 0.0f;
 				}
 			else
 				{
 				/* Move toward target */
 				toTarget = toTarget / distToTarget;
-				dino.velocity = toTarget * info.walkSpeed * speedScale;
+				dinos.velocity[d] = toTarget * info.walkSpeed * speedScale;
 				}
 			}
 		}
@@ -581,152 +735,129 @@ void DinosaurEcosystem::updateDinosaurAI(Dinosaur& dino, float deltaTime)
 		Scalar preyDist;
 
 		/* First check for lava/water - predators also flee these */
-		TerrainInfo terrain = queryTerrain(dino.position);
+		TerrainInfo terrain = queryTerrain(dinos.position[d]);
 		if(terrain.isLava)
 			{
-			dino.aiState = AI_FLEEING;
-			dino.currentAction = ACTION_RUN;
+			dinos.aiState[d] = AI_FLEEING;
+			dinos.currentAction[d] = ACTION_RUN;
 
 			/* Run toward center (away from lava) */
 			Point center;
 			center[0] = (bounds.minX + bounds.maxX) * 0.5;
 			center[1] = (bounds.minY + bounds.maxY) * 0.5;
-			Vector fleeDir = center - dino.position;
+			Vector fleeDir = center - dinos.position[d];
 			Scalar mag = Geometry::mag(fleeDir);
 			if(mag > 0.001)
 				fleeDir = fleeDir / mag;
 
-			dino.velocity = fleeDir * info.runSpeed * speedScale;
+			dinos.velocity[d] = fleeDir * info.runSpeed * speedScale;
 			return;
 			}
 
-		if(findNearestPrey(dino, preyId, preyDist))
+		if(findNearestPrey(d, preyId, preyDist))
 			{
 			/* Found prey - start hunting */
-			dino.aiState = AI_HUNTING;
-			dino.targetDinoId = preyId;
+			dinos.aiState[d] = AI_HUNTING;
+			dinos.targetDinoId[d] = preyId;
 
-			/* Find the prey dinosaur */
-			for(const Dinosaur& prey : dinosaurs)
+			/* Chase or attack the prey */
 				{
-				if(prey.id == preyId)
-					{
-					Vector toTarget = prey.position - dino.position;
-					Scalar dist = Geometry::mag(toTarget);
+				Vector toTarget = dinos.position[preyId] - dinos.position[d];
+				Scalar dist = Geometry::mag(toTarget);
 
-					if(dist < info.attackRange)
-						{
-						/* Close enough to attack! */
-						dino.aiState = AI_ATTACKING;
-						dino.currentAction = ACTION_ATTACK;
-						dino.velocity = Vector(0.0, 0.0, 0.0);
-						dino.stateTimer = 0.0f;
-						}
-					else
-						{
-						/* Chase the prey */
-						dino.currentAction = ACTION_RUN;
-						if(dist > 0.001)
-							toTarget = toTarget / dist;
-						dino.velocity = toTarget * info.runSpeed * speedScale;
-						}
-					break;
+				if(dist < info.attackRange)
+					{
+					/* Close enough to attack! */
+					dinos.aiState[d] = AI_ATTACKING;
+					dinos.currentAction[d] = ACTION_ATTACK;
+					dinos.velocity[d] = Vector(0.0, 0.0, 0.0);
+					dinos.stateTimer[d] = 0.0f;
+					}
+				else
+					{
+					/* Chase the prey */
+					dinos.currentAction[d] = ACTION_RUN;
+					if(dist > 0.001)
+						toTarget = toTarget / dist;
+					dinos.velocity[d] = toTarget * info.runSpeed * speedScale;
 					}
 				}
 			}
-		else if(dino.aiState == AI_ATTACKING)
+		else if(dinos.aiState[d] == AI_ATTACKING)
 			{
 			/* Finish attack animation */
-			if(dino.stateTimer > 1.0f)
+			if(dinos.stateTimer[d] > 1.0f)
 				{
-				/* Find and kill the prey */
-				for(Dinosaur& prey : dinosaurs)
-					{
-					if(prey.id == dino.targetDinoId && prey.isAlive)
-						{
-						Vector diff = prey.position - dino.position;
-						if(Geometry::mag(diff) < info.attackRange * 2.0)
-							{
-							/* Prey caught! */
-							prey.isAlive = false;
-							prey.aiState = AI_DYING;
-							prey.currentAction = ACTION_DIE;
-							prey.currentFrame = 0;
-							prey.stateTimer = 0.0f;
-							prey.velocity = Vector(0.0, 0.0, 0.0);
-
-							const DinosaurSpeciesInfo& preyInfo = getSpeciesInfo(prey.species);
-							std::cout << "DinosaurEcosystem: " << info.name
-							          << " caught " << preyInfo.name << "!" << std::endl;
-							}
-						break;
-						}
-					}
-
-				dino.aiState = AI_IDLE;
-				dino.currentAction = ACTION_IDLE;
-				dino.stateTimer = 0.0f;
+				/* Record the attack; caught prey is killed once all dinosaurs have run their AI */
+				Attack attack;
+				attack.predator = d;
+				attack.prey = dinos.targetDinoId[d];
+				attacks.push_back(attack);
+
+				dinos.aiState[d] = AI_IDLE;
+				dinos.currentAction[d] = ACTION_IDLE;
+				dinos.stateTimer[d] = 0.0f;
 				}
 			}
 		else
 			{
 			/* No prey visible - wander/patrol */
-			if(dino.aiState != AI_WANDERING || dino.stateTimer > 5.0f)
+			if(dinos.aiState[d] != AI_WANDERING || dinos.stateTimer[d] > 5.0f)
 				{
-				dino.aiState = AI_WANDERING;
-				dino.currentAction = ACTION_WALK;
-				dino.targetPosition = chooseWanderTarget(dino);
-				dino.stateTimer = 0.0f;
+				dinos.aiState[d] = AI_WANDERING;
+				dinos.currentAction[d] = ACTION_WALK;
+				dinos.targetPosition[d] = chooseWanderTarget(d);
+				dinos.stateTimer[d] = 0.0f;
 				}
 
 			/* Move toward target */
-			Vector toTarget = dino.targetPosition - dino.position;
+			Vector toTarget = dinos.targetPosition[d] - dinos.position[d];
 			Scalar distToTarget = Geometry::mag(toTarget);
 
 			if(distToTarget > 0.02)
 				{
 				toTarget = toTarget / distToTarget;
-				dino.velocity = toTarget * info.walkSpeed * speedScale;
+				dinos.velocity[d] = toTarget * info.walkSpeed * speedScale;
 				}
 			else
 				{
-				dino.velocity = Vector(0.0, 0.0, 0.0);
+				dinos.velocity[d] = Vector(0.0, 0.0, 0.0);
 				}
 			}
 		}
 
 	/* Apply avoidance (boundaries, water, lava) */
-	Vector avoidance = calculateAvoidanceVector(dino);
+	Vector avoidance = calculateAvoidanceVector(d);
 	if(Geometry::mag(avoidance) > 0.001)
 		{
-		dino.velocity = dino.velocity + avoidance * info.walkSpeed * speedScale * 0.5;
+		dinos.velocity[d] = dinos.velocity[d] + avoidance * info.walkSpeed * speedScale * 0.5;
 		}
 	}
 
-void DinosaurEcosystem::updateDinosaurAnimation(Dinosaur& dino, float deltaTime)
+void DinosaurEcosystem::updateDinosaurAnimation(unsigned int d, float deltaTime)
 	{
 	/* Handle dying animation specially */
-	if(dino.aiState == AI_DYING)
+	if(dinos.aiState[d] == AI_DYING)
 		{
-		dino.animationTimer += deltaTime;
-		if(dino.animationTimer >= dino.frameTime)
+		dinos.animationTimer[d] += deltaTime;
+		if(dinos.animationTimer[d] >= dinos.frameTime[d])
 			{
-			dino.animationTimer -= dino.frameTime;
-			dino.currentFrame++;
+			dinos.animationTimer[d] -= dinos.frameTime[d];
+			dinos.currentFrame[d]++;
 
-			const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
-			if(dino.currentFrame >= info.framesPerAction[ACTION_DIE])
+			const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
+			if(dinos.currentFrame[d] >= info.framesPerAction[ACTION_DIE])
 				{
 				/* Death animation complete, start fading */
-				dino.currentFrame = info.framesPerAction[ACTION_DIE] - 1;
-				dino.alpha -= deltaTime * 0.5f;
+				dinos.currentFrame[d] = info.framesPerAction[ACTION_DIE] - 1;
+				dinos.alpha[d] -= deltaTime * 0.5f;
 
-				if(dino.alpha <= 0.0f)
+				if(dinos.alpha[d] <= 0.0f)
 					{
 					/* Fully faded, start respawn timer */
-					dino.aiState = AI_DEAD;
-					dino.isVisible = false;
-					dino.respawnTimer = respawnDelay;
+					dinos.aiState[d] = AI_DEAD;
+					dinos.isVisible[d] = false;
+					dinos.respawnTimer[d] = respawnDelay;
 					}
 				}
 			}
@@ -734,89 +865,227 @@ void DinosaurEcosystem::updateDinosaurAnimation(Dinosaur& dino, float deltaTime)
 		}
 
 	/* Normal animation update */
-	dino.animationTimer += deltaTime;
-	if(dino.animationTimer >= dino.frameTime)
+	dinos.animationTimer[d] += deltaTime;
+	if(dinos.animationTimer[d] >= dinos.frameTime[d])
 		{
-		dino.animationTimer -= dino.frameTime;
-		dino.currentFrame++;
+		dinos.animationTimer[d] -= dinos.frameTime[d];
+		dinos.currentFrame[d]++;
 
-		const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
-		int maxFrames = info.framesPerAction[dino.currentAction];
-		if(dino.currentFrame >= maxFrames)
-			dino.currentFrame = 0;
+		const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
+		int maxFrames = info.framesPerAction[dinos.currentAction[d]];
+		if(dinos.currentFrame[d] >= maxFrames)
+			dinos.currentFrame[d] = 0;
 		}
 
 	/* Update direction based on velocity */
-	if(Geometry::mag(dino.velocity) > 0.001)
+	if(Geometry::mag(dinos.velocity[d]) > 0.001)
 		{
-		dino.direction = calculateDirection(dino.velocity);
+		dinos.direction[d] = calculateDirection(dinos.velocity[d]);
 		}
 	}
 
-void DinosaurEcosystem::updateDinosaurMovement(Dinosaur& dino, float deltaTime)
+void DinosaurEcosystem::updateDinosaurMovement(unsigned int d, float deltaTime)
 	{
-	if(!dino.isAlive)
+	if(!dinos.isAlive[d])
 		return;
 
 	/* Update position */
-	dino.position[0] += dino.velocity[0] * deltaTime;
-	dino.position[1] += dino.velocity[1] * deltaTime;
+	dinos.position[d][0] += dinos.velocity[d][0] * deltaTime;
+	dinos.position[d][1] += dinos.velocity[d][1] * deltaTime;
 
 	/* Clamp to bounds */
-	dino.position[0] = std::max(bounds.minX, std::min(bounds.maxX, dino.position[0]));
-	dino.position[1] = std::max(bounds.minY, std::min(bounds.maxY, dino.position[1]));
+	dinos.position[d][0] = std::max(bounds.minX, std::min(bounds.maxX, dinos.position[d][0]));
+	dinos.position[d][1] = std::max(bounds.minY, std::min(bounds.maxY, dinos.position[d][1]));
 
 	/* Update elevation (terrain following) */
-	TerrainInfo terrain = queryTerrain(dino.position);
+	TerrainInfo terrain = queryTerrain(dinos.position[d]);
 	Scalar targetZ = terrain.elevation;
 
 	/* Check for hazards - despawn if in lava or water */
 	if(terrain.isLava || terrain.waterDepth > 0.0)
 		{
 		/* Dinosaur walked into hazard - trigger death */
-		dino.isAlive = false;
-		dino.aiState = AI_DYING;
-		dino.currentAction = ACTION_DIE;
-		dino.currentFrame = 0;
-		dino.stateTimer = 0.0f;
-		dino.velocity = Vector(0.0, 0.0, 0.0);
-
-		const DinosaurSpeciesInfo& info = getSpeciesInfo(dino.species);
+		dinos.isAlive[d] = false;
+		dinos.aiState[d] = AI_DYING;
+		dinos.currentAction[d] = ACTION_DIE;
+		dinos.currentFrame[d] = 0;
+		dinos.stateTimer[d] = 0.0f;
+		dinos.velocity[d] = Vector(0.0, 0.0, 0.0);
+
+		const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[d]);
 		std::cout << "DinosaurEcosystem: " << info.name
-		          << " #" << dino.id << " fell into hazard!" << std::endl;
+		          << " #" << d << " fell into hazard!" << std::endl;
 		return;
 		}
 
 	/* Smooth elevation following */
 	Scalar elevationSpeed = 0.1;
-	dino.position[2] += (targetZ - dino.position[2]) * elevationSpeed;
+	dinos.position[d][2] += (targetZ - dinos.position[d][2]) * elevationSpeed;
+	}
+
+void DinosaurEcosystem::processBand(unsigned int bandIndex)
+	{
+	switch(currentPhase)
+		{
+		case PHASE_AI:
+			{
+			/* Run AI on this band of all dinosaurs, including dead ones waiting to respawn */
+			unsigned int numDinos = dinos.size();
+			unsigned int begin = (numDinos * bandIndex) / numThreads;
+			unsigned int end = (numDinos * (bandIndex + 1)) / numThreads;
+			bandAttacks[bandIndex].clear();
+			for(unsigned int d = begin; d < end; ++d)
+				updateDinosaurAI(d, currentDeltaTime, bandAttacks[bandIndex]);
+			break;
+			}
+
+		case PHASE_MOVEMENT:
+			{
+			/* Move this band of the alive dinosaurs */
+			unsigned int numAlive = dinos.alive.size();
+			unsigned int begin = (numAlive * bandIndex) / numThreads;
+			unsigned int end = (numAlive * (bandIndex + 1)) / numThreads;
+			for(unsigned int i = begin; i < end; ++i)
+				updateDinosaurMovement(dinos.alive[i], currentDeltaTime);
+			break;
+			}
+
+		case PHASE_ANIMATION:
+			{
+			/* Animate this band of the visible dinosaurs, including dying ones */
+			unsigned int numVisible = dinos.visible.size();
+			unsigned int begin = (numVisible * bandIndex) / numThreads;
+			unsigned int end = (numVisible * (bandIndex + 1)) / numThreads;
+			for(unsigned int i = begin; i < end; ++i)
+				updateDinosaurAnimation(dinos.visible[i], currentDeltaTime);
+			break;
+			}
+		}
+	}
+
+void DinosaurEcosystem::runPhase(UpdatePhase phase)
+	{
+	currentPhase = phase;
+
+	/* Start all worker threads on the phase, process the first band, and wait until all bands are done */
+	if(numThreads > 1)
+		workerBarrier->synchronize();
+	processBand(0);
+	if(numThreads > 1)
+		workerBarrier->synchronize();
+	}
+
+void* DinosaurEcosystem::workerThreadMethod(unsigned int bandIndex)
+	{
+	while(true)
+		{
+		/* Wait until the frame thread starts a new phase or shuts down */
+		workerBarrier->synchronize();
+
+		/* Bail out if the ecosystem is being destroyed */
+		if(!runWorkers)
+			break;
+
+		/* Process this thread's band of the current phase and signal completion */
+		processBand(bandIndex);
+		workerBarrier->synchronize();
+		}
+
+	return 0;
+	}
+
+void DinosaurEcosystem::resolveAttacks(void)
+	{
+	/* Bands cover ascending ID ranges, so attacks are resolved in ascending predator order for any thread count */
+	for(unsigned int band = 0; band < numThreads; ++band)
+		for(const Attack& attack : bandAttacks[band])
+			{
+			unsigned int prey = attack.prey;
+			unsigned int predator = attack.predator;
+			if(prey >= dinos.size() || !dinos.isAlive[prey])
+				continue;
+
+			Vector diff = dinos.position[prey] - dinos.position[predator];
+			const DinosaurSpeciesInfo& info = getSpeciesInfo(dinos.species[predator]);
+			if(Geometry::mag(diff) < info.attackRange * 2.0)
+				{
+				/* Prey caught! */
+				dinos.isAlive[prey] = false;
+				dinos.aiState[prey] = AI_DYING;
+				dinos.currentAction[prey] = ACTION_DIE;
+				dinos.currentFrame[prey] = 0;
+				dinos.stateTimer[prey] = 0.0f;
+				dinos.velocity[prey] = Vector(0.0, 0.0, 0.0);
+
+				const DinosaurSpeciesInfo& preyInfo = getSpeciesInfo(dinos.species[prey]);
+				std::cout << "DinosaurEcosystem: " << info.name
+				          << " caught " << preyInfo.name << "!" << std::endl;
+				}
+			}
 	}
 
 void DinosaurEcosystem::update(float deltaTime)
 	{
-	/* Update all dinosaurs */
-	for(Dinosaur& dino : dinosaurs)
+	/* Remember the state before the update for interpolation */
+	previousPositions = dinos.position;
+	previousAlive = dinos.isAlive;
+
+	/* Pick up terrain changes; the navigation field is read-only during all update phases */
+	updateNavigationField();
+
+	/* Bin alive dinosaurs for neighbor queries; during the AI phase, dinosaurs only write their own state and read others' unchanged positions through the index */
+	rebuildSpatialIndex();
+	currentDeltaTime = deltaTime;
+
+	/* Run AI on all dinosaurs, then kill caught prey */
+	runPhase(PHASE_AI);
+	resolveAttacks();
+
+	/* Move the dinosaurs that are alive after the AI phase */
+	dinos.updateLists();
+	runPhase(PHASE_MOVEMENT);
+
+	/* Animate all visible dinosaurs */
+	runPhase(PHASE_ANIMATION);
+
+	/* Update the index lists for rendering and the next frame */
+	dinos.updateLists();
+
+	/* Render the updated state until the next interpolation */
+	renderPositions = dinos.position;
+	}
+
+void DinosaurEcosystem::interpolate(float weight)
+	{
+	for(unsigned int d : dinos.visible)
 		{
-		updateDinosaurAI(dino, deltaTime);
-		updateDinosaurAnimation(dino, deltaTime);
-		updateDinosaurMovement(dino, deltaTime);
+		/* Do not interpolate across deaths and respawns, which teleport dinosaurs */
+		if(previousAlive[d] && dinos.isAlive[d])
+			renderPositions[d] = Geometry::affineCombination(previousPositions[d], dinos.position[d], Scalar(weight));
+		else
+			renderPositions[d] = dinos.position[d];
 		}
 	}
 
-unsigned int DinosaurEcosystem::getAliveCount(void) const
+DinosaurView DinosaurEcosystem::getView(void) const
 	{
-	unsigned int count = 0;
-	for(const Dinosaur& dino : dinosaurs)
-		if(dino.isAlive)
-			++count;
-	return count;
+	DinosaurView view;
+	view.numVisible = dinos.visible.size();
+	view.visible = dinos.visible.data();
+	view.species = dinos.species.data();
+	view.position = renderPositions.data();
+	view.currentAction = dinos.currentAction.data();
+	view.direction = dinos.direction.data();
+	view.currentFrame = dinos.currentFrame.data();
+	view.alpha = dinos.alpha.data();
+	return view;
 	}
 
 unsigned int DinosaurEcosystem::getHerbivoreCount(void) const
 	{
 	unsigned int count = 0;
-	for(const Dinosaur& dino : dinosaurs)
-		if(dino.isAlive && isHerbivore(dino.species))
+	for(unsigned int d : dinos.alive)
+		if(isHerbivore(dinos.species[d]))
 			++count;
 	return count;
 	}
@@ -824,8 +1093,8 @@ unsigned int DinosaurEcosystem::getHerbivoreCount(void) const
 unsigned int DinosaurEcosystem::getPredatorCount(void) const
 	{
 	unsigned int count = 0;
-	for(const Dinosaur& dino : dinosaurs)
-		if(dino.isAlive && isPredator(dino.species))
+	for(unsigned int d : dinos.alive)
+		if(isPredator(dinos.species[d]))
 			++count;
 	return count;
 	}
@@ -25,12 +25,14 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <vector>
 #include <random>
+#include <Threads/Thread.h>
+#include <Threads/Barrier.h>
 
 #include "Types.h"
 #include "Dinosaur.h"
+#include "NavigationField.h"
 
 /* Forward declarations */
-class WaterTable2;
 class TerrainQuery;
 
 class DinosaurEcosystem
@@ -56,16 +58,50 @@ class DinosaurEcosystem
 
 	private:
 
+	/* Attack recorded during the AI phase and resolved afterwards */
+	struct Attack
+		{
+		unsigned int predator, prey;
+		};
+
+	/* Phases of an update run by all update threads */
+	enum UpdatePhase
+		{
+		PHASE_AI = 0,
+		PHASE_MOVEMENT,
+		PHASE_ANIMATION
+		};
+
 	/* Elements: */
-	const WaterTable2* waterTable;           // For domain bounds (legacy)
+	static const unsigned int maxTerrainBatchSize = 16; // Maximum number of positions sampled per terrain query batch
 	const TerrainQuery* terrainQuery;        // For terrain/water queries
 	Bounds bounds;                       // Sandbox boundaries
-	std::vector<Dinosaur> dinosaurs;     // All dinosaur instances
-	unsigned int nextDinosaurId;         // For unique IDs
+	DinosaurStore dinos;                 // Component arrays of all dinosaur instances
+	NavigationField navigationField;     // Coarse hazard grid rebuilt whenever the terrain query's grids change
+
+	/* Render state interpolated between the two most recent updates */
+	std::vector<Point> previousPositions;        // Positions before the most recent update
+	std::vector<unsigned char> previousAlive;    // Alive flags before the most recent update
+	std::vector<Point> renderPositions;          // Positions handed out to renderers
+
+	/* Uniform grid spatial index of alive dinosaurs, rebuilt every update */
+	Scalar cellSize;                     // Edge length of square grid cells
+	int numCells[2];                     // Number of grid cells in x and y
+	std::vector<unsigned int> cellStarts;  // Index of each cell's first entry in cellEntries, plus one end index
+	std::vector<unsigned int> cellEntries; // Indices of alive dinosaurs, sorted by grid cell
 
 	/* Random number generation */
-	std::mt19937 rng;
-	std::uniform_real_distribution<float> randomFloat;
+	unsigned int seed;                   // Seed of the spawning stream and all per-dinosaur streams
+	std::minstd_rand rng;                // Stream for spawning the initial population
+
+	/* Parallel update state */
+	unsigned int numThreads;             // Number of threads running each update phase, including the frame thread
+	Threads::Thread* workerThreads;      // Array of additional worker threads
+	Threads::Barrier* workerBarrier;     // Barrier synchronizing the frame thread and all worker threads
+	bool runWorkers;                     // Flag to keep the worker threads running
+	UpdatePhase currentPhase;            // Phase currently being run
+	float currentDeltaTime;              // Time step of the update currently being run
+	std::vector<std::vector<Attack> > bandAttacks; // Attacks recorded by each band during the AI phase
 
 	/* Simulation parameters */
 	Scalar handFleeRadius;               // Distance to flee from hands
@@ -80,46 +116,82 @@ class DinosaurEcosystem
 
 	/* Private methods: */
 
+	/* Rebuild the navigation field if the terrain query's grids or the bounds changed */
+	void updateNavigationField(void);
+
 	/* Spawn a dinosaur at a random valid position */
 	void spawnDinosaurRandom(DinosaurSpecies species);
 
 	/* Find a valid spawn position avoiding water and lava */
-	Point findValidSpawnPosition(void);
+	Point findValidSpawnPosition(std::minstd_rand& stream);
 
 	/* Query terrain at a position */
 	TerrainInfo queryTerrain(const Point& pos) const;
 
-	/* Update a single dinosaur's AI */
-	void updateDinosaurAI(Dinosaur& dino, float deltaTime);
+	/* Query terrain at a batch of positions */
+	void queryTerrainBatch(const Point* positions, size_t numPositions, TerrainInfo* infos) const;
+
+	/* Check if a position with already queried terrain is safe */
+	bool isTerrainSafe(const Point& pos, const TerrainInfo& terrain) const;
+
+	/* Rebuild the spatial index from current dinosaur positions */
+	void rebuildSpatialIndex(void);
+
+	/* Get the spatial index cell containing a position, clamped to the grid */
+	void getCell(const Point& pos, int cell[2]) const;
+
+	/* Find the nearest alive predator or herbivore within range of a dinosaur using the spatial index */
+	bool findNearestDinosaur(unsigned int d, bool predators, Scalar range, unsigned int& nearest, Scalar& distance) const;
+
+	/* Draw a uniformly distributed number in [0, 1) from a random number stream */
+	static float randomFloat(std::minstd_rand& stream)
+		{
+		return std::uniform_real_distribution<float>(0.0f, 1.0f)(stream);
+		}
+
+	/* Run one update phase on a band of dinosaurs */
+	void processBand(unsigned int bandIndex);
+
+	/* Run the current update phase on all update threads */
+	void runPhase(UpdatePhase phase);
+
+	/* Method for additional update worker threads */
+	void* workerThreadMethod(unsigned int bandIndex);
+
+	/* Kill caught prey after the AI phase, in ascending predator order */
+	void resolveAttacks(void);
+
+	/* Update a single dinosaur's AI; attacks are recorded into the given list */
+	void updateDinosaurAI(unsigned int d, float deltaTime, std::vector<Attack>& attacks);
 
 	/* Update dinosaur animation */
-	void updateDinosaurAnimation(Dinosaur& dino, float deltaTime);
+	void updateDinosaurAnimation(unsigned int d, float deltaTime);
 
 	/* Update dinosaur movement */
-	void updateDinosaurMovement(Dinosaur& dino, float deltaTime);
+	void updateDinosaurMovement(unsigned int d, float deltaTime);
 
 	/* Find nearest threat (predator, hand, or lava) for herbivore */
-	bool findNearestThreat(const Dinosaur& dino, Point& threatPos, Scalar& distance) const;
+	bool findNearestThreat(unsigned int d, Point& threatPos, Scalar& distance) const;
 
 	/* Find nearest prey for predator */
-	bool findNearestPrey(const Dinosaur& predator, unsigned int& preyId, Scalar& distance) const;
+	bool findNearestPrey(unsigned int p, unsigned int& preyId, Scalar& distance) const;
 
 	/* Check if position is safe (no water, no lava) */
 	bool isPositionSafe(const Point& pos) const;
 
 	/* Steer away from hazards (water, lava, bounds) */
-	Vector calculateAvoidanceVector(const Dinosaur& dino) const;
+	Vector calculateAvoidanceVector(unsigned int d) const;
 
 	/* Calculate herd center for herbivore */
-	Point calculateHerdCenter(const Dinosaur& dino) const;
+	Point calculateHerdCenter(unsigned int d) const;
 
 	/* Choose a random wander target */
-	Point chooseWanderTarget(const Dinosaur& dino);
+	Point chooseWanderTarget(unsigned int d);
 
 	public:
 
 	/* Constructors and destructors: */
-	DinosaurEcosystem(const WaterTable2* sWaterTable);
+	DinosaurEcosystem(unsigned int sNumThreads = 1, unsigned int sSeed = 0); // Seed 0 picks a time-based seed
 	~DinosaurEcosystem(void);
 
 	/* Methods: */
@@ -139,17 +211,20 @@ class DinosaurEcosystem
 	/* Spawn a specific dinosaur at a position */
 	unsigned int spawnDinosaur(DinosaurSpecies species, const Point& position);
 
-	/* Update all dinosaurs (call every frame) */
+	/* Update all dinosaurs (call every frame, or at a fixed rate) */
 	void update(float deltaTime);
 
+	/* Interpolate rendered positions between the two most recent updates; weight 0 shows the state before and 1 the state after the most recent update */
+	void interpolate(float weight);
+
 	/* Update hand positions for flee behavior */
 	void setDetectedHands(const std::vector<Point>& hands);
 
-	/* Get all dinosaurs for rendering */
-	const std::vector<Dinosaur>& getDinosaurs(void) const { return dinosaurs; }
+	/* Get a view of the visible dinosaurs for rendering, at their most recently interpolated positions; valid until the next update, interpolation, or spawn */
+	DinosaurView getView(void) const;
 
 	/* Get number of alive dinosaurs */
-	unsigned int getAliveCount(void) const;
+	unsigned int getAliveCount(void) const { return dinos.alive.size(); }
 
 	/* Get number of dinosaurs by role */
 	unsigned int getHerbivoreCount(void) const;
@@ -33,17 +33,23 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include <GL/gl.h>
 #include <GL/GLContextData.h>
+#include <GL/Extensions/GLARBDrawInstanced.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
+#include <GL/Extensions/GLARBInstancedArrays.h>
 #include <GL/Extensions/GLARBMultitexture.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBTextureCompression.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
 #include <GL/Extensions/GLARBVertexBufferObject.h>
 #include <GL/Extensions/GLARBVertexShader.h>
+#include <GL/Extensions/GLEXTTextureArray.h>
+#include <GL/Extensions/GLEXTTextureCompressionS3TC.h>
 #include <GL/GLTransformationWrappers.h>
 
 #include "WaterTable2.h"
 #include "ShaderHelper.h"
+#include "SpriteAtlas.h"
 #include "Config.h"
 
 /********************************************
@@ -52,6 +58,10 @@ Methods of class DinosaurRenderer::DataItem:
 
 DinosaurRenderer::DataItem::DataItem(void)
 	:quadVertexBuffer(0),
+	 haveInstancing(false),
+	 spriteArrayTexture(0),
+	 instanceBuffer(0),
+	 instancedSpriteShader(0),
 	 spriteShader(0)
 	{
 	/* Initialize all required extensions: */
@@ -61,8 +71,29 @@ DinosaurRenderer::DataItem::DataItem(void)
 	GLARBVertexBufferObject::initExtension();
 	GLARBVertexShader::initExtension();
 
+	/* Check for instanced rendering and texture array support: */
+	haveInstancing = GLARBDrawInstanced::isSupported() && GLARBInstancedArrays::isSupported() && GLEXTTextureArray::isSupported();
+	if(haveInstancing)
+		{
+		GLARBDrawInstanced::initExtension();
+		GLARBInstancedArrays::initExtension();
+		GLEXTTextureArray::initExtension();
+		}
+
 	/* Allocate vertex buffer for quad: */
 	glGenBuffersARB(1, &quadVertexBuffer);
+
+	/* Allocate instanced rendering resources: */
+	if(haveInstancing)
+		{
+		glGenTextures(1, &spriteArrayTexture);
+		glGenBuffersARB(1, &instanceBuffer);
+		}
+	for(int i = 0; i < DINO_NUM_SPECIES * ACTION_NUM_ACTIONS; ++i)
+		{
+		layerValid[i] = false;
+		layerScales[i][0] = layerScales[i][1] = 1.0f;
+		}
 	}
 
 DinosaurRenderer::DataItem::~DataItem(void)
@@ -70,6 +101,14 @@ DinosaurRenderer::DataItem::~DataItem(void)
 	/* Release vertex buffer: */
 	glDeleteBuffersARB(1, &quadVertexBuffer);
 
+	/* Release instanced rendering resources: */
+	if(spriteArrayTexture != 0)
+		glDeleteTextures(1, &spriteArrayTexture);
+	if(instanceBuffer != 0)
+		glDeleteBuffersARB(1, &instanceBuffer);
+	if(instancedSpriteShader != 0)
+		glDeleteObjectARB(instancedSpriteShader);
+
 	/* Release all textures: */
 	for(auto& pair : spriteTextures)
 		glDeleteTextures(1, &pair.second);
@@ -131,8 +170,36 @@ Methods of class DinosaurRenderer:
 DinosaurRenderer::DinosaurRenderer(const WaterTable2* sWaterTable)
 	:waterTable(sWaterTable),
 	 spriteWorldSize(0.05),      // Default sprite size in world units
-	 spritesBasePath(std::string(CONFIG_SPRITEDIR) + "/")
+	 spritesBasePath(std::string(CONFIG_SPRITEDIR) + "/"),
+	 spriteAtlas(0)
+	{
+	openSpriteAtlas();
+	}
+
+DinosaurRenderer::~DinosaurRenderer(void)
 	{
+	delete spriteAtlas;
+	}
+
+void DinosaurRenderer::openSpriteAtlas(void)
+	{
+	delete spriteAtlas;
+	spriteAtlas = 0;
+
+	/* Map the baked atlas; fall back to loading individual spritesheets if there is none */
+	std::string atlasFileName = SpriteAtlas::getDefaultFileName(spritesBasePath);
+	try
+		{
+		spriteAtlas = new SpriteAtlas(atlasFileName.c_str());
+		std::cout << "DinosaurRenderer: Mapped sprite atlas " << atlasFileName << std::endl;
+		}
+	catch(const std::exception& err)
+		{
+		std::cout << "DinosaurRenderer: No usable sprite atlas (" << err.what() << "); loading individual spritesheets" << std::endl;
+		}
+
+	/* Replace estimated spritesheet metadata with the atlas's metadata table */
+	spritesheetInfoCache.clear();
 	}
 
 void DinosaurRenderer::initContext(GLContextData& contextData) const
@@ -178,11 +245,139 @@ void DinosaurRenderer::initContext(GLContextData& contextData) const
 	*(ulPtr++) = glGetUniformLocationARB(dataItem->spriteShader, "frameSize");
 	*(ulPtr++) = glGetUniformLocationARB(dataItem->spriteShader, "spriteAlpha");
 	*(ulPtr++) = glGetUniformLocationARB(dataItem->spriteShader, "upVector");
+
+	if(dataItem->haveInstancing)
+		{
+		/* Create the instanced sprite rendering shader; fall back to per-sprite rendering if it fails */
+		try
+			{
+			dataItem->instancedSpriteShader = linkVertexAndFragmentShader("SpriteInstancedShader");
+			}
+		catch(const std::exception& err)
+			{
+			std::cerr << "DinosaurRenderer: Failed to compile SpriteInstancedShader (" << err.what() << ")" << std::endl;
+			dataItem->instancedSpriteShader = 0;
+			}
+		dataItem->haveInstancing = dataItem->instancedSpriteShader != 0;
+		}
+
+	if(dataItem->haveInstancing)
+		{
+		ulPtr = dataItem->instancedSpriteShaderUniforms;
+		*(ulPtr++) = glGetUniformLocationARB(dataItem->instancedSpriteShader, "spriteArraySampler");
+		*(ulPtr++) = glGetUniformLocationARB(dataItem->instancedSpriteShader, "projectionModelviewMatrix");
+		*(ulPtr++) = glGetUniformLocationARB(dataItem->instancedSpriteShader, "spriteSize");
+		GLint* alPtr = dataItem->instanceAttributeLocations;
+		*(alPtr++) = glGetAttribLocationARB(dataItem->instancedSpriteShader, "instancePosition");
+		*(alPtr++) = glGetAttribLocationARB(dataItem->instancedSpriteShader, "instanceFrame");
+		*(alPtr++) = glGetAttribLocationARB(dataItem->instancedSpriteShader, "instanceLayer");
+
+		/* Load all spritesheets up front so that drawing never stalls on image loading */
+		loadSpriteArray(dataItem);
+		}
+	}
+
+bool DinosaurRenderer::uploadSpriteAtlas(DataItem* dataItem) const
+	{
+	if(spriteAtlas == 0)
+		return false;
+
+	/* Check that the atlas's layers fit the sprite texture array and its format is supported */
+	const SpriteAtlas::Header& header = spriteAtlas->getHeader();
+	if(header.numLayers != DINO_NUM_SPECIES * ACTION_NUM_ACTIONS)
+		return false;
+	bool compressed = header.format == SpriteAtlas::DXT5;
+	if(compressed)
+		{
+		if(!GLARBTextureCompression::isSupported() || !GLEXTTextureCompressionS3TC::isSupported())
+			return false;
+		GLARBTextureCompression::initExtension();
+		GLEXTTextureCompressionS3TC::initExtension();
+		}
+
+	/* Allocate the texture array and upload each layer straight from the mapped file */
+	GLenum internalFormat = compressed ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA8;
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, dataItem->spriteArrayTexture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, internalFormat, header.layerSize[0], header.layerSize[1], header.numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	for(unsigned int layer = 0; layer < header.numLayers; ++layer)
+		{
+		const SpriteAtlas::Layer& layerInfo = spriteAtlas->getLayer(layer);
+		dataItem->layerValid[layer] = layerInfo.valid != 0;
+		if(!dataItem->layerValid[layer])
+			continue;
+
+		if(compressed)
+			glCompressedTexSubImage3DARB(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, layer, header.layerSize[0], header.layerSize[1], 1, internalFormat, header.layerDataSize, spriteAtlas->getLayerData(layer));
+		else
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, layer, header.layerSize[0], header.layerSize[1], 1, GL_RGBA, GL_UNSIGNED_BYTE, spriteAtlas->getLayerData(layer));
+		dataItem->layerScales[layer][0] = GLfloat(layerInfo.sheetSize[0]) / GLfloat(header.layerSize[0]);
+		dataItem->layerScales[layer][1] = GLfloat(layerInfo.sheetSize[1]) / GLfloat(header.layerSize[1]);
+		}
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+
+	return true;
+	}
+
+void DinosaurRenderer::loadSpriteArray(DataItem* dataItem) const
+	{
+	/* Use the baked atlas if possible */
+	if(uploadSpriteAtlas(dataItem))
+		return;
+
+	/* Load all spritesheets and find the largest one: */
+	const int numLayers = DINO_NUM_SPECIES * ACTION_NUM_ACTIONS;
+	std::vector<Images::RGBAImage> images(numLayers);
+	unsigned int layerSize[2] = {1, 1};
+	for(int layer = 0; layer < numLayers; ++layer)
+		{
+		DinosaurSpecies species = DinosaurSpecies(layer / ACTION_NUM_ACTIONS);
+		DinosaurAction action = DinosaurAction(layer % ACTION_NUM_ACTIONS);
+		std::string path = spritesBasePath + getSpritesheetPath(species, action);
+		try
+			{
+			images[layer] = Images::readTransparentImageFile(path.c_str());
+			dataItem->layerValid[layer] = true;
+			for(int i = 0; i < 2; ++i)
+				if(layerSize[i] < images[layer].getSize(i))
+					layerSize[i] = images[layer].getSize(i);
+			}
+		catch(const std::exception& e)
+			{
+			/* Sprites with missing spritesheets are not drawn, as in the per-sprite path: */
+			std::cerr << "DinosaurRenderer: Failed to load sprite: " << path << " (" << e.what() << ")" << std::endl;
+			}
+		}
+
+	/* Allocate the texture array and upload each spritesheet into the lower-left corner of its layer: */
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, dataItem->spriteArrayTexture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, GL_RGBA8, layerSize[0], layerSize[1], numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	for(int layer = 0; layer < numLayers; ++layer)
+		if(dataItem->layerValid[layer])
+			{
+			unsigned int width = images[layer].getSize(0);
+			unsigned int height = images[layer].getSize(1);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, images[layer].getPixels());
+			dataItem->layerScales[layer][0] = GLfloat(width) / GLfloat(layerSize[0]);
+			dataItem->layerScales[layer][1] = GLfloat(height) / GLfloat(layerSize[1]);
+			}
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+
+	std::cout << "DinosaurRenderer: Loaded spritesheets into " << layerSize[0] << "x" << layerSize[1]
+	          << "x" << numLayers << " sprite texture array" << std::endl;
 	}
 
 void DinosaurRenderer::setSpritesBasePath(const std::string& path)
 	{
 	spritesBasePath = path;
+	openSpriteAtlas();
 	}
 
 void DinosaurRenderer::setSpriteSize(Scalar size)
@@ -191,12 +386,12 @@ void DinosaurRenderer::setSpriteSize(Scalar size)
 	}
 
 void DinosaurRenderer::render(
-	const std::vector<Dinosaur>& dinosaurs,
+	const DinosaurView& dinosaurs,
 	const PTransform& projection,
 	const OGTransform& modelview,
 	GLContextData& contextData) const
 	{
-	if(dinosaurs.empty())
+	if(dinosaurs.numVisible == 0)
 		return;
 
 	/* Get the data item: */
@@ -208,6 +403,13 @@ void DinosaurRenderer::render(
 	PTransform projectionModelview = projection;
 	projectionModelview *= modelview;
 
+	/* Draw all sprites at once if supported */
+	if(dataItem->haveInstancing)
+		{
+		renderInstanced(dinosaurs, projectionModelview, dataItem);
+		return;
+		}
+
 	/* Enable blending for transparency */
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -247,14 +449,13 @@ void DinosaurRenderer::render(
 	glVertexPointer(3, GL_FLOAT, 5 * sizeof(GLfloat), (void*)0);
 	glTexCoordPointer(2, GL_FLOAT, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
 
-	/* Render each dinosaur */
-	for(const Dinosaur& dino : dinosaurs)
+	/* Render each visible dinosaur */
+	for(unsigned int i = 0; i < dinosaurs.numVisible; ++i)
 		{
-		if(!dino.isVisible)
-			continue;
+		unsigned int d = dinosaurs.visible[i];
 
 		/* Get texture for this dinosaur's current action */
-		std::string texturePath = spritesBasePath + getSpritesheetPath(dino.species, dino.currentAction);
+		std::string texturePath = spritesBasePath + getSpritesheetPath(dinosaurs.species[d], dinosaurs.currentAction[d]);
 		GLuint textureId = dataItem->getOrLoadTexture(texturePath);
 		if(textureId == 0)
 			continue;
@@ -263,12 +464,12 @@ void DinosaurRenderer::render(
 
 		/* Set dinosaur position */
 		glUniform3fARB(posUniform,
-			GLfloat(dino.position[0]),
-			GLfloat(dino.position[1]),
-			GLfloat(dino.position[2]));
+			GLfloat(dinosaurs.position[d][0]),
+			GLfloat(dinosaurs.position[d][1]),
+			GLfloat(dinosaurs.position[d][2]));
 
 		/* Set alpha for fade effects */
-		glUniform1fARB(alphaUniform, dino.alpha);
+		glUniform1fARB(alphaUniform, dinosaurs.alpha[d]);
 
 		/* Calculate frame offset in texture
 		   Spritesheets are organized as:
@@ -279,10 +480,10 @@ void DinosaurRenderer::render(
 		const int numDirections = 8;
 
 		/* Map our direction enum to spritesheet row order */
-		int dirRow = static_cast<int>(dino.direction);
+		int dirRow = static_cast<int>(dinosaurs.direction[d]);
 
 		/* Calculate UV offset and size for the current frame */
-		float frameU = float(dino.currentFrame) / float(numFrames);
+		float frameU = float(dinosaurs.currentFrame[d]) / float(numFrames);
 		float frameV = float(dirRow) / float(numDirections);
 		float frameSizeU = 1.0f / float(numFrames);
 		float frameSizeV = 1.0f / float(numDirections);
@@ -306,6 +507,102 @@ void DinosaurRenderer::render(
 	glDisable(GL_BLEND);
 	}
 
+void DinosaurRenderer::renderInstanced(const DinosaurView& dinosaurs, const PTransform& projectionModelview, DataItem* dataItem) const
+	{
+	/* Spritesheets consist of 8 rows of directions and 15 columns of frames, as in the per-sprite path */
+	const int numFrames = 15;
+	const int numDirections = 8;
+	const GLsizei instanceSize = 9; // Position, alpha, frame offset, frame size, layer
+
+	/* Orphan the instance buffer and stream in the attributes of all drawable sprites */
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, dataItem->instanceBuffer);
+	glBufferDataARB(GL_ARRAY_BUFFER_ARB, dinosaurs.numVisible * instanceSize * sizeof(GLfloat), 0, GL_STREAM_DRAW_ARB);
+	GLfloat* iPtr = static_cast<GLfloat*>(glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB));
+	if(iPtr == 0)
+		{
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		return;
+		}
+	GLsizei numInstances = 0;
+	for(unsigned int i = 0; i < dinosaurs.numVisible; ++i)
+		{
+		unsigned int d = dinosaurs.visible[i];
+		int layer = SpriteAtlas::getLayerIndex(dinosaurs.species[d], dinosaurs.currentAction[d]);
+		if(!dataItem->layerValid[layer])
+			continue;
+
+		const GLfloat* scale = dataItem->layerScales[layer];
+		*(iPtr++) = GLfloat(dinosaurs.position[d][0]);
+		*(iPtr++) = GLfloat(dinosaurs.position[d][1]);
+		*(iPtr++) = GLfloat(dinosaurs.position[d][2]);
+		*(iPtr++) = dinosaurs.alpha[d];
+		*(iPtr++) = GLfloat(dinosaurs.currentFrame[d]) / GLfloat(numFrames) * scale[0];
+		*(iPtr++) = GLfloat(static_cast<int>(dinosaurs.direction[d])) / GLfloat(numDirections) * scale[1];
+		*(iPtr++) = scale[0] / GLfloat(numFrames);
+		*(iPtr++) = scale[1] / GLfloat(numDirections);
+		*(iPtr++) = GLfloat(layer);
+		++numInstances;
+		}
+	glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+	if(numInstances == 0)
+		{
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+		return;
+		}
+
+	/* Enable blending for transparency, and disable depth writing but keep depth testing */
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	/* Bind the instanced sprite shader and the sprite texture array */
+	glUseProgramObjectARB(dataItem->instancedSpriteShader);
+	const GLint* ulPtr = dataItem->instancedSpriteShaderUniforms;
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, dataItem->spriteArrayTexture);
+	glUniform1iARB(*(ulPtr++), 0);
+	glUniformARB(*(ulPtr++), projectionModelview);
+	glUniform2fARB(*(ulPtr++), GLfloat(spriteWorldSize), GLfloat(spriteWorldSize));
+
+	/* Set up the per-instance attributes from the instance buffer */
+	const GLint* alPtr = dataItem->instanceAttributeLocations;
+	const GLsizei stride = instanceSize * sizeof(GLfloat);
+	static const GLint attributeComponents[3] = {4, 4, 1};
+	static const GLsizei attributeOffsets[3] = {0, 4, 8};
+	for(int i = 0; i < 3; ++i)
+		{
+		glEnableVertexAttribArrayARB(alPtr[i]);
+		glVertexAttribPointerARB(alPtr[i], attributeComponents[i], GL_FLOAT, GL_FALSE, stride, (void*)(attributeOffsets[i] * sizeof(GLfloat)));
+		glVertexAttribDivisorARB(alPtr[i], 1);
+		}
+
+	/* Set up the shared sprite quad */
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, dataItem->quadVertexBuffer);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 5 * sizeof(GLfloat), (void*)0);
+	glTexCoordPointer(2, GL_FLOAT, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+	/* Draw all sprites */
+	glDrawArraysInstancedARB(GL_QUADS, 0, 4, numInstances);
+
+	/* Clean up */
+	for(int i = 0; i < 3; ++i)
+		{
+		glVertexAttribDivisorARB(alPtr[i], 0);
+		glDisableVertexAttribArrayARB(alPtr[i]);
+		}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+	glUseProgramObjectARB(0);
+
+	/* Restore state */
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	}
+
 const DinosaurRenderer::SpritesheetInfo& DinosaurRenderer::getSpritesheetInfo(
 	DinosaurSpecies species, DinosaurAction action)
 	{
@@ -316,8 +613,25 @@ const DinosaurRenderer::SpritesheetInfo& DinosaurRenderer::getSpritesheetInfo(
 	if(it != spritesheetInfoCache.end())
 		return it->second;
 
-	/* Create default info (will be updated when texture is loaded) */
+	/* Take the metadata from the baked atlas if there is one */
 	SpritesheetInfo info;
+	if(spriteAtlas != 0)
+		{
+		const SpriteAtlas::Layer& layer = spriteAtlas->getLayer(SpriteAtlas::getLayerIndex(species, action));
+		if(layer.valid != 0)
+			{
+			info.textureWidth = layer.sheetSize[0];
+			info.textureHeight = layer.sheetSize[1];
+			info.frameWidth = layer.frameSize[0];
+			info.frameHeight = layer.frameSize[1];
+			info.numFrames = layer.numFrames;
+			info.numDirections = layer.numDirections;
+			spritesheetInfoCache[path] = info;
+			return spritesheetInfoCache[path];
+			}
+		}
+
+	/* Create default info (will be updated when texture is loaded) */
 	info.textureWidth = 960;   // Estimated based on sprite pack
 	info.textureHeight = 512;
 	info.frameWidth = 64;
@@ -35,6 +35,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 /* Forward declarations */
 class WaterTable2;
+class SpriteAtlas;
 
 class DinosaurRenderer:public GLObject
 	{
@@ -61,6 +62,16 @@ class DinosaurRenderer:public GLObject
 		/* OpenGL state management: */
 		GLuint quadVertexBuffer;  // Vertex buffer for sprite quad
 
+		/* Instanced rendering state: */
+		bool haveInstancing;      // Flag whether instanced rendering from a sprite texture array is supported
+		GLuint spriteArrayTexture; // Texture array holding all spritesheets, one layer per species and action
+		bool layerValid[DINO_NUM_SPECIES * ACTION_NUM_ACTIONS]; // Flags whether each layer's spritesheet was loaded
+		GLfloat layerScales[DINO_NUM_SPECIES * ACTION_NUM_ACTIONS][2]; // Fraction of each layer covered by its spritesheet
+		GLuint instanceBuffer;    // Vertex buffer streaming per-instance sprite attributes
+		GLhandleARB instancedSpriteShader; // Shader program for instanced sprite rendering
+		GLint instancedSpriteShaderUniforms[3]; // Uniform locations
+		GLint instanceAttributeLocations[3]; // Per-instance attribute locations
+
 		/* Texture management - one per species per action */
 		std::map<std::string, GLuint> spriteTextures;
 
@@ -80,13 +91,21 @@ class DinosaurRenderer:public GLObject
 	const WaterTable2* waterTable;     // For terrain queries
 	Scalar spriteWorldSize;            // Size of sprites in world units
 	std::string spritesBasePath;       // Base path to sprites folder
+	SpriteAtlas* spriteAtlas;          // Memory-mapped baked sprite atlas shared by all contexts, or 0 if none was baked
 
 	/* Spritesheet metadata cache */
 	std::map<std::string, SpritesheetInfo> spritesheetInfoCache;
 
+	/* Private methods: */
+	void openSpriteAtlas(void); // Maps the sprite atlas baked from the current sprites folder, if there is one
+	bool uploadSpriteAtlas(DataItem* dataItem) const; // Uploads the baked sprite atlas into the data item's sprite texture array; returns false if not possible
+	void loadSpriteArray(DataItem* dataItem) const; // Loads all spritesheets into the data item's sprite texture array
+	void renderInstanced(const DinosaurView& dinosaurs, const PTransform& projectionModelview, DataItem* dataItem) const; // Renders all visible dinosaurs with one instanced draw call
+
 	/* Constructors and destructors: */
 	public:
 	DinosaurRenderer(const WaterTable2* sWaterTable);
+	virtual ~DinosaurRenderer(void);
 
 	/* Methods from GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
@@ -99,9 +118,9 @@ class DinosaurRenderer:public GLObject
 	/* Set the world-space size of sprites */
 	void setSpriteSize(Scalar size);
 
-	/* Render all dinosaurs */
+	/* Render all visible dinosaurs */
 	void render(
-		const std::vector<Dinosaur>& dinosaurs,
+		const DinosaurView& dinosaurs,
 		const PTransform& projection,
 		const OGTransform& modelview,
 		GLContextData& contextData) const;
@@ -0,0 +1,268 @@
+/***********************************************************************
+ElevationCache - Class to share half-pixel offset pixel-corner elevation
+textures between all surface renderers of an OpenGL context, rendering
+each texture at most once per depth image version and view.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "ElevationCache.h"
+
+#include <math.h>
+#include <GL/gl.h>
+#include <GL/Extensions/GLARBTextureFloat.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBTextureRg.h>
+#include <GL/Extensions/GLEXTFramebufferObject.h>
+#include <GL/GLContextData.h>
+
+#include "DepthImageRenderer.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+bool equal(const PTransform& t1,const PTransform& t2)
+	{
+	const Scalar* e1=t1.getMatrix().getEntries();
+	const Scalar* e2=t2.getMatrix().getEntries();
+	for(int i=0;i<16;++i)
+		if(e1[i]!=e2[i])
+			return false;
+	return true;
+	}
+
+bool equal(const Plane& p1,const Plane& p2)
+	{
+	return p1.getNormal()==p2.getNormal()&&p1.getOffset()==p2.getOffset();
+	}
+
+}
+
+/*****************************************
+Methods of class ElevationCache::DataItem:
+*****************************************/
+
+ElevationCache::DataItem::DataItem(void)
+	:useCounter(0)
+	{
+	/* Initialize all required extensions: */
+	GLARBTextureFloat::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBTextureRg::initExtension();
+	GLEXTFramebufferObject::initExtension();
+	
+	/* Initialize all cache slots: */
+	for(unsigned int i=0;i<numSlots;++i)
+		{
+		Slot& s=slots[i];
+		s.framebufferObject=0;
+		s.depthBufferObject=0;
+		s.colorTextureObject=0;
+		for(int j=0;j<2;++j)
+			{
+			s.size[j]=0;
+			s.viewportSize[j]=0;
+			}
+		s.resolutionFraction=0.0f;
+		s.valid=false;
+		s.depthImageVersion=0;
+		s.lastUse=0;
+		}
+	}
+
+ElevationCache::DataItem::~DataItem(void)
+	{
+	/* Release all allocated buffers and textures: */
+	for(unsigned int i=0;i<numSlots;++i)
+		{
+		glDeleteFramebuffersEXT(1,&slots[i].framebufferObject);
+		glDeleteRenderbuffersEXT(1,&slots[i].depthBufferObject);
+		glDeleteTextures(1,&slots[i].colorTextureObject);
+		}
+	}
+
+/*******************************
+Methods of class ElevationCache:
+*******************************/
+
+void ElevationCache::renderSlot(ElevationCache::Slot& slot,const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData) const
+	{
+	/* Save the currently-bound frame buffer and clear color: */
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	GLfloat currentClearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
+	
+	/* Check if the slot's frame buffer needs to be created: */
+	if(slot.framebufferObject==0)
+		{
+		glGenFramebuffersEXT(1,&slot.framebufferObject);
+		glGenRenderbuffersEXT(1,&slot.depthBufferObject);
+		glGenTextures(1,&slot.colorTextureObject);
+		}
+	
+	/* Bind the slot's frame buffer object: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,slot.framebufferObject);
+	
+	/* Calculate the reduced-resolution size of the pixel-corner grid: */
+	GLsizei renderSize[2];
+	for(int i=0;i<2;++i)
+		renderSize[i]=GLsizei(ceil(GLfloat(viewport[2+i])*resolutionFraction));
+	
+	/* Check if the frame buffer needs to be resized: */
+	if(slot.size[0]!=renderSize[0]+1||slot.size[1]!=renderSize[1]+1||slot.resolutionFraction!=resolutionFraction)
+		{
+		/* Remember if the render buffers must still be attached to the frame buffer: */
+		bool mustAttachBuffers=slot.size[0]==0&&slot.size[1]==0;
+		
+		/* Update the frame buffer size: */
+		for(int i=0;i<2;++i)
+			slot.size[i]=renderSize[i]+1;
+		
+		/* Resize the depth buffer: */
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,slot.depthBufferObject);
+		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT,GL_DEPTH_COMPONENT,slot.size[0],slot.size[1]);
+		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,0);
+		
+		/* Resize the color texture; reduced-resolution textures are interpolated when sampled at window pixel positions: */
+		GLenum filter=resolutionFraction<1.0f?GL_LINEAR:GL_NEAREST;
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,slot.colorTextureObject);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,filter);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,filter);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,slot.size[0],slot.size[1],0,GL_LUMINANCE,GL_UNSIGNED_BYTE,0);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+		
+		if(mustAttachBuffers)
+			{
+			glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,GL_DEPTH_ATTACHMENT_EXT,GL_RENDERBUFFER_EXT,slot.depthBufferObject);
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,slot.colorTextureObject,0);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+			glReadBuffer(GL_NONE);
+			}
+		}
+	
+	/* Extend the viewport to render the corners of all pixels: */
+	glViewport(0,0,slot.size[0],slot.size[1]);
+	glClearColor(0.0f,0.0f,0.0f,1.0f);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	
+	/* Shift the projection matrix by half a pixel to render the corners of the final pixels: */
+	PTransform shiftedProjectionModelview=projectionModelview;
+	PTransform::Matrix& spmm=shiftedProjectionModelview.getMatrix();
+	Scalar xs=Scalar(renderSize[0])/Scalar(renderSize[0]+1);
+	Scalar ys=Scalar(renderSize[1])/Scalar(renderSize[1]+1);
+	for(int j=0;j<4;++j)
+		{
+		spmm(0,j)*=xs;
+		spmm(1,j)*=ys;
+		}
+	
+	/* Render the surface elevation into the half-pixel offset frame buffer: */
+	depthImageRenderer->renderElevation(shiftedProjectionModelview,contextData);
+	
+	/* Restore the original viewport: */
+	glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
+	
+	/* Restore the original clear color and frame buffer binding: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+	
+	/* Remember the view for which the slot was rendered: */
+	for(int i=0;i<2;++i)
+		slot.viewportSize[i]=viewport[2+i];
+	slot.resolutionFraction=resolutionFraction;
+	slot.projectionModelview=projectionModelview;
+	slot.basePlane=depthImageRenderer->getBasePlane();
+	slot.valid=true;
+	slot.depthImageVersion=depthImageRenderer->getDepthImageVersion();
+	}
+
+ElevationCache::ElevationCache(const DepthImageRenderer* sDepthImageRenderer)
+	:depthImageRenderer(sDepthImageRenderer),
+	 resolutionFraction(1.0f)
+	{
+	}
+
+void ElevationCache::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	}
+
+void ElevationCache::setResolutionFraction(GLfloat newResolutionFraction)
+	{
+	/* Clamp the fraction to a sensible range; cached textures are re-rendered on their next use: */
+	if(newResolutionFraction<0.125f)
+		newResolutionFraction=0.125f;
+	if(newResolutionFraction>1.0f)
+		newResolutionFraction=1.0f;
+	resolutionFraction=newResolutionFraction;
+	}
+
+GLuint ElevationCache::getPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLfloat textureScale[2],GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	++dataItem->useCounter;
+	
+	/* Find a slot rendered for the same view, or the least recently used slot: */
+	Slot* slot=0;
+	Slot* lruSlot=&dataItem->slots[0];
+	for(unsigned int i=0;i<DataItem::numSlots&&slot==0;++i)
+		{
+		Slot& s=dataItem->slots[i];
+		if(s.valid&&s.viewportSize[0]==viewport[2]&&s.viewportSize[1]==viewport[3]&&s.resolutionFraction==resolutionFraction&&equal(s.projectionModelview,projectionModelview)&&equal(s.basePlane,depthImageRenderer->getBasePlane()))
+			slot=&s;
+		else if(lruSlot->valid&&(!s.valid||s.lastUse<lruSlot->lastUse))
+			lruSlot=&s;
+		}
+	
+	if(slot!=0)
+		{
+		/* Check if the depth image changed since the slot was rendered: */
+		unsigned int depthImageVersion=depthImageRenderer->getDepthImageVersion();
+		if(slot->depthImageVersion!=depthImageVersion)
+			{
+			/* Skip re-rendering if none of the depth image's pixels changed in the meantime: */
+			PixelRect dirtyRegion;
+			if(depthImageRenderer->getDirtyRegion(slot->depthImageVersion,dirtyRegion)&&dirtyRegion.isEmpty())
+				slot->depthImageVersion=depthImageVersion;
+			else
+				renderSlot(*slot,viewport,projectionModelview,contextData);
+			}
+		}
+	else
+		{
+		/* Render the view into the least recently used slot: */
+		slot=lruSlot;
+		renderSlot(*slot,viewport,projectionModelview,contextData);
+		}
+	slot->lastUse=dataItem->useCounter;
+	
+	/* Return the scale from window pixel to texel coordinates: */
+	for(int i=0;i<2;++i)
+		textureScale[i]=viewport[2+i]>0?GLfloat(slot->size[i]-1)/GLfloat(viewport[2+i]):1.0f;
+	
+	return slot->colorTextureObject;
+	}
@@ -0,0 +1,92 @@
+/***********************************************************************
+ElevationCache - Class to share half-pixel offset pixel-corner elevation
+textures between all surface renderers of an OpenGL context, rendering
+each texture at most once per depth image version and view.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef ELEVATIONCACHE_INCLUDED
+#define ELEVATIONCACHE_INCLUDED
+
+#include <GL/gl.h>
+#include <GL/GLObject.h>
+
+#include "Types.h"
+
+/* Forward declarations: */
+class DepthImageRenderer;
+
+class ElevationCache:public GLObject
+	{
+	/* Embedded classes: */
+	private:
+	struct Slot // Structure for a cached pixel-corner elevation texture
+		{
+		/* Elements: */
+		public:
+		GLuint framebufferObject; // Frame buffer object used to render the pixel-corner elevations
+		GLuint depthBufferObject; // Depth render buffer for the frame buffer
+		GLuint colorTextureObject; // One-component floating-point color texture holding the pixel-corner elevations
+		GLsizei size[2]; // Current width and height of the frame buffer
+		int viewportSize[2]; // Width and height of the viewport for which the texture was rendered
+		GLfloat resolutionFraction; // Resolution fraction for which the texture was rendered
+		PTransform projectionModelview; // Projection and modelview matrix for which the texture was rendered
+		Plane basePlane; // Elevation base plane for which the texture was rendered
+		bool valid; // Flag whether the slot holds a rendered texture
+		unsigned int depthImageVersion; // Version number of the depth image for which the texture was rendered
+		unsigned int lastUse; // Value of the context's use counter when the slot was last requested
+		};
+	
+	struct DataItem:public GLObject::DataItem
+		{
+		/* Elements: */
+		public:
+		static const unsigned int numSlots=4; // Number of distinct views cached per context, e.g., for stereo or several windows sharing a context
+		Slot slots[numSlots]; // Cached pixel-corner elevation textures
+		unsigned int useCounter; // Counter incremented on every request, to find the least recently used slot
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	const DepthImageRenderer* depthImageRenderer; // Renderer for low-level surface rendering
+	GLfloat resolutionFraction; // Fraction of viewport resolution at which pixel-corner elevations are rendered
+	
+	/* Private methods: */
+	void renderSlot(Slot& slot,const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData) const; // Renders pixel-corner elevations for the given view into the given slot
+	
+	/* Constructors and destructors: */
+	public:
+	ElevationCache(const DepthImageRenderer* sDepthImageRenderer); // Creates a cache for the given depth image renderer
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	GLfloat getResolutionFraction(void) const // Returns the fraction of viewport resolution at which pixel-corner elevations are rendered
+		{
+		return resolutionFraction;
+		}
+	void setResolutionFraction(GLfloat newResolutionFraction); // Sets the fraction of viewport resolution at which pixel-corner elevations are rendered; clamped to (0, 1]
+	GLuint getPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLfloat textureScale[2],GLContextData& contextData) const; // Returns a rectangle texture of half-pixel offset elevations for the given view, rendering it only if the cached texture is outdated; returns the scale from window pixel to texel coordinates in textureScale
+	};
+
+#endif
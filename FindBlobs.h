@@ -71,6 +71,8 @@ class PixelProperty // Class to check whether a pixel should be considered part
 
 template <class PixelParam,class PixelPropertyParam>
 std::vector<Blob<PixelParam> > findBlobs(const unsigned int size[2],const PixelParam* frame,const PixelPropertyParam& property); // Extracts all connected blobs from the given frame whose pixels have the given property
+template <class PixelParam,class PixelPropertyParam>
+std::vector<Blob<PixelParam> > findBlobs(const unsigned int size[2],const PixelParam* frame,const PixelPropertyParam& property,unsigned int numThreads); // Ditto, labeling horizontal bands of the frame in the given number of threads and merging blobs across band seams; the property must be safe to evaluate concurrently
 
 #ifndef FINDBLOBS_IMPLEMENTATION
 #include "FindBlobs.icpp"
@@ -27,192 +27,550 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Geometry/HVector.h>
 #include <Geometry/Matrix.h>
 
+#include "PerformanceProfiler.h"
+
+#ifdef __SSE2__
+
+#include <emmintrin.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline __m128i mullo32(__m128i a,__m128i b) // Multiplies four pairs of 32-bit integers, keeping the low 32 bits of each product
+	{
+	__m128i even=_mm_mul_epu32(a,b);
+	__m128i odd=_mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+	}
+
+}
+
+#endif
+
 /****************************
 Methods of class FrameFilter:
 ****************************/
 
-void* FrameFilter::filterThreadMethod(void)
+unsigned int FrameFilter::filterRowVectorized(const FrameFilter::RawDepth* inputData,float* outputData,unsigned int y,PixelRect& dirtyRegion)
 	{
-	unsigned int lastInputFrameVersion=0;
+	#ifdef __SSE2__
 	
-	while(true)
-		{
-		Kinect::FrameBuffer frame;
+	/* Bail out if the per-pixel statistics could exceed the range of signed integers, or if depth correction coefficients are not packed float pairs: */
+	if(numAveragingSlots>=32768U||sizeof(PixelDepthCorrection)!=2*sizeof(float))
+		return 0;
+	
+	/* Broadcast the filter parameters: */
+	float py=float(y)+0.5f;
+	__m128 minPlane0=_mm_set1_ps(minPlane[0]);
+	__m128 minPlane1y=_mm_set1_ps(minPlane[1]*py);
+	__m128 minPlane2=_mm_set1_ps(minPlane[2]);
+	__m128 minPlane3=_mm_set1_ps(minPlane[3]);
+	__m128 maxPlane0=_mm_set1_ps(maxPlane[0]);
+	__m128 maxPlane1y=_mm_set1_ps(maxPlane[1]*py);
+	__m128 maxPlane2=_mm_set1_ps(maxPlane[2]);
+	__m128 maxPlane3=_mm_set1_ps(maxPlane[3]);
+	__m128 zero=_mm_setzero_ps();
+	__m128 hyst=_mm_set1_ps(hysteresis);
+	__m128 instable=_mm_set1_ps(instableValue);
+	__m128 absMask=_mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128i invalidVal=_mm_set1_epi16(short(2048));
+	__m128i retainMask=currentRetainValids?_mm_set1_epi32(-1):_mm_setzero_si128();
+	__m128i signBias=_mm_set1_epi32(int(0x80000000U));
+	__m128i minSamples=_mm_xor_si128(_mm_set1_epi32(int(minNumSamples)),signBias);
+	__m128i maxVar=_mm_set1_epi32(int(maxVariance));
+	
+	/* Process the row in groups of eight pixels, calculating exactly what the scalar loop in filterRowBand does: */
+	unsigned int offset=y*size[0];
+	const RawDepth* ifPtr=inputData+offset;
+	RawDepth* abPtr=averagingBuffer+averagingSlotIndex*size[1]*size[0]+offset;
+	unsigned int* cPtr=validCountBuffer+offset;
+	unsigned int* sPtr=sumBuffer+offset;
+	unsigned int* ssPtr=sumSquaresBuffer+offset;
+	float* ofPtr=validBuffer+offset;
+	float* nofPtr=outputData+offset;
+	const float* pdcPtr=reinterpret_cast<const float*>(pixelDepthCorrection+offset);
+	unsigned int xEnd=size[0]&~7U;
+	for(unsigned int x=0;x<xEnd;x+=8,ifPtr+=8,abPtr+=8,cPtr+=8,sPtr+=8,ssPtr+=8,ofPtr+=8,nofPtr+=8,pdcPtr+=16)
 		{
-		Threads::MutexCond::Lock inputLock(inputCond);
+		__m128i newVal=_mm_loadu_si128(reinterpret_cast<const __m128i*>(ifPtr));
+		__m128i oldVal=_mm_loadu_si128(reinterpret_cast<const __m128i*>(abPtr));
 		
-		/* Wait until a new frame arrives or the program shuts down: */
-		while(runFilterThread&&lastInputFrameVersion==inputFrameVersion)
-			inputCond.wait(inputLock);
+		/* Depth-correct the new values and plug them into the minimum and maximum plane equations, four pixels at a time: */
+		__m128i newVals[2];
+		newVals[0]=_mm_unpacklo_epi16(newVal,_mm_setzero_si128());
+		newVals[1]=_mm_unpackhi_epi16(newVal,_mm_setzero_si128());
+		__m128 scales[2],offsets[2];
+		__m128i valids[2];
+		for(int i=0;i<2;++i)
+			{
+			__m128 pdc0=_mm_loadu_ps(pdcPtr+i*8);
+			__m128 pdc1=_mm_loadu_ps(pdcPtr+i*8+4);
+			scales[i]=_mm_shuffle_ps(pdc0,pdc1,_MM_SHUFFLE(2,0,2,0));
+			offsets[i]=_mm_shuffle_ps(pdc0,pdc1,_MM_SHUFFLE(3,1,3,1));
+			__m128 newCVal=_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(newVals[i]),scales[i]),offsets[i]);
+			float px0=float(x+i*4);
+			__m128 px=_mm_set_ps(px0+3.5f,px0+2.5f,px0+1.5f,px0+0.5f);
+			__m128 minD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(minPlane0,px),minPlane1y),_mm_mul_ps(minPlane2,newCVal)),minPlane3);
+			__m128 maxD=_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(maxPlane0,px),maxPlane1y),_mm_mul_ps(maxPlane2,newCVal)),maxPlane3);
+			valids[i]=_mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(minD,zero),_mm_cmple_ps(maxD,zero)));
+			}
+		__m128i valid=_mm_packs_epi32(valids[0],valids[1]);
 		
-		/* Bail out if the program is shutting down: */
-		if(!runFilterThread)
-			break;
+		/* Store valid new values, or invalid values unless previous values are retained: */
+		__m128i keep=_mm_or_si128(_mm_and_si128(retainMask,oldVal),_mm_andnot_si128(retainMask,invalidVal));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(abPtr),_mm_or_si128(_mm_and_si128(valid,newVal),_mm_andnot_si128(valid,keep)));
 		
-		/* Work on the new frame: */
-		frame=inputFrame;
-		lastInputFrameVersion=inputFrameVersion;
+		/* Remove valid previous values from the statistics if they were overwritten: */
+		__m128i remove=_mm_andnot_si128(_mm_cmpeq_epi16(oldVal,invalidVal),_mm_or_si128(valid,_mm_xor_si128(retainMask,_mm_set1_epi32(-1))));
+		
+		/* Calculate the squares of the new and previous values: */
+		__m128i newSqLo=_mm_mullo_epi16(newVal,newVal);
+		__m128i newSqHi=_mm_mulhi_epu16(newVal,newVal);
+		__m128i oldSqLo=_mm_mullo_epi16(oldVal,oldVal);
+		__m128i oldSqHi=_mm_mulhi_epu16(oldVal,oldVal);
+		__m128i newSqs[2],oldSqs[2],oldVals[2],adds[2],removes[2];
+		newSqs[0]=_mm_unpacklo_epi16(newSqLo,newSqHi);
+		newSqs[1]=_mm_unpackhi_epi16(newSqLo,newSqHi);
+		oldSqs[0]=_mm_unpacklo_epi16(oldSqLo,oldSqHi);
+		oldSqs[1]=_mm_unpackhi_epi16(oldSqLo,oldSqHi);
+		oldVals[0]=_mm_unpacklo_epi16(oldVal,_mm_setzero_si128());
+		oldVals[1]=_mm_unpackhi_epi16(oldVal,_mm_setzero_si128());
+		adds[0]=_mm_unpacklo_epi16(valid,valid);
+		adds[1]=_mm_unpackhi_epi16(valid,valid);
+		removes[0]=_mm_unpacklo_epi16(remove,remove);
+		removes[1]=_mm_unpackhi_epi16(remove,remove);
+		
+		int updates=0;
+		for(int i=0;i<2;++i)
+			{
+			/* Update the pixels' statistics; masks are all ones, i.e., -1, where true: */
+			__m128i c=_mm_loadu_si128(reinterpret_cast<const __m128i*>(cPtr+i*4));
+			__m128i s=_mm_loadu_si128(reinterpret_cast<const __m128i*>(sPtr+i*4));
+			__m128i ss=_mm_loadu_si128(reinterpret_cast<const __m128i*>(ssPtr+i*4));
+			c=_mm_add_epi32(_mm_sub_epi32(c,adds[i]),removes[i]);
+			s=_mm_sub_epi32(_mm_add_epi32(s,_mm_and_si128(adds[i],newVals[i])),_mm_and_si128(removes[i],oldVals[i]));
+			ss=_mm_sub_epi32(_mm_add_epi32(ss,_mm_and_si128(adds[i],newSqs[i])),_mm_and_si128(removes[i],oldSqs[i]));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(cPtr+i*4),c);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sPtr+i*4),s);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(ssPtr+i*4),ss);
+			
+			/* Check if the pixels are considered "stable," using unsigned wrap-around arithmetic like the scalar loop: */
+			__m128i lhs=_mm_xor_si128(mullo32(ss,c),signBias);
+			__m128i rhs=_mm_xor_si128(_mm_add_epi32(mullo32(mullo32(maxVar,c),c),mullo32(s,s)),signBias);
+			__m128 stable=_mm_castsi128_ps(_mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi32(minSamples,_mm_xor_si128(c,signBias)),_mm_cmpgt_epi32(lhs,rhs)),_mm_set1_epi32(-1)));
+			
+			/* Update the output pixel values of stable pixels whose new depth-corrected running mean is outside the previous value's envelope: */
+			__m128 of=_mm_loadu_ps(ofPtr+i*4);
+			__m128 newFiltered=_mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_cvtepi32_ps(s),_mm_cvtepi32_ps(c)),scales[i]),offsets[i]);
+			__m128 update=_mm_and_ps(stable,_mm_cmpge_ps(_mm_and_ps(_mm_sub_ps(newFiltered,of),absMask),hyst));
+			of=_mm_or_ps(_mm_and_ps(update,newFiltered),_mm_andnot_ps(update,of));
+			_mm_storeu_ps(ofPtr+i*4,of);
+			
+			/* Leave stable pixels and retained instable pixels at their previous values, and assign the default value to other instable pixels: */
+			__m128 output=_mm_or_ps(stable,_mm_castsi128_ps(retainMask));
+			_mm_storeu_ps(nofPtr+i*4,_mm_or_ps(_mm_and_ps(output,of),_mm_andnot_ps(output,instable)));
+			
+			updates|=_mm_movemask_ps(update)<<(i*4);
+			}
+		
+		/* Add changed output pixels to the dirty region: */
+		for(unsigned int i=0;updates!=0;++i,updates>>=1)
+			if(updates&0x1)
+				dirtyRegion.addPixel(x+i,y);
 		}
+	
+	return xEnd;
+	
+	#else
+	
+	return 0;
+	
+	#endif
+	}
+
+void FrameFilter::filterRowBand(const FrameFilter::RawDepth* inputData,float* outputData,unsigned int yBegin,unsigned int yEnd,PixelRect& dirtyRegion)
+	{
+	/* Enter the new frame into the averaging buffer and calculate the output frame's pixel values: */
+	unsigned int offset=yBegin*size[0];
+	const RawDepth* ifPtr=inputData+offset;
+	RawDepth* abPtr=averagingBuffer+averagingSlotIndex*size[1]*size[0]+offset;
+	unsigned int* cPtr=validCountBuffer+offset;
+	unsigned int* sPtr=sumBuffer+offset;
+	unsigned int* ssPtr=sumSquaresBuffer+offset;
+	float* ofPtr=validBuffer+offset;
+	float* nofPtr=outputData+offset;
+	const PixelDepthCorrection* pdcPtr=pixelDepthCorrection+offset;
+	for(unsigned int y=yBegin;y<yEnd;++y)
+		{
+		float py=float(y)+0.5f;
 		
-		/* Prepare a new output frame: */
-		Kinect::FrameBuffer& newOutputFrame=outputFrames.startNewValue();
+		/* Process a prefix of the row with vector instructions if requested: */
+		unsigned int x=0;
+		if(currentVectorized)
+			{
+			x=filterRowVectorized(inputData,outputData,y,dirtyRegion);
+			ifPtr+=x;
+			pdcPtr+=x;
+			abPtr+=x;
+			cPtr+=x;
+			sPtr+=x;
+			ssPtr+=x;
+			ofPtr+=x;
+			nofPtr+=x;
+			}
 		
-		/* Enter the new frame into the averaging buffer and calculate the output frame's pixel values: */
-		const RawDepth* ifPtr=inputFrame.getData<RawDepth>();
-		RawDepth* abPtr=averagingBuffer+averagingSlotIndex*size[1]*size[0];
-		unsigned int* sPtr=statBuffer;
-		float* ofPtr=validBuffer;
-		float* nofPtr=newOutputFrame.getData<float>();
-		const PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
-		for(unsigned int y=0;y<size[1];++y)
+		/* Process the rest of the row: */
+		for(;x<size[0];++x,++ifPtr,++pdcPtr,++abPtr,++cPtr,++sPtr,++ssPtr,++ofPtr,++nofPtr)
 			{
-			float py=float(y)+0.5f;
-			for(unsigned int x=0;x<size[0];++x,++ifPtr,++pdcPtr,++abPtr,sPtr+=3,++ofPtr,++nofPtr)
+			float px=float(x)+0.5f;
+			
+			unsigned int oldVal=*abPtr;
+			unsigned int newVal=*ifPtr;
+			
+			/* Depth-correct the new value: */
+			float newCVal=pdcPtr->correct(newVal);
+			
+			/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
+			if(minD>=0.0f&&maxD<=0.0f)
 				{
-				float px=float(x)+0.5f;
-				
-				unsigned int oldVal=*abPtr;
-				unsigned int newVal=*ifPtr;
+				/* Store the new input value: */
+				*abPtr=newVal;
 				
-				/* Depth-correct the new value: */
-				float newCVal=pdcPtr->correct(newVal);
+				/* Update the pixel's statistics: */
+				++*cPtr; // Number of valid samples
+				*sPtr+=newVal; // Sum of valid samples
+				*ssPtr+=newVal*newVal; // Sum of squares of valid samples
 				
-				/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
-				float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
-				float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
-				if(minD>=0.0f&&maxD<=0.0f)
+				/* Check if the previous value in the averaging buffer was valid: */
+				if(oldVal!=2048U)
 					{
-					/* Store the new input value: */
-					*abPtr=newVal;
-					
-					/* Update the pixel's statistics: */
-					++sPtr[0]; // Number of valid samples
-					sPtr[1]+=newVal; // Sum of valid samples
-					sPtr[2]+=newVal*newVal; // Sum of squares of valid samples
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
-					}
-				else if(!retainValids)
-					{
-					/* Store an invalid input value: */
-					*abPtr=2048U;
-					
-					/* Check if the previous value in the averaging buffer was valid: */
-					if(oldVal!=2048U)
-						{
-						--sPtr[0]; // Number of valid samples
-						sPtr[1]-=oldVal; // Sum of valid samples
-						sPtr[2]-=oldVal*oldVal; // Sum of squares of valid samples
-						}
+					--*cPtr; // Number of valid samples
+					*sPtr-=oldVal; // Sum of valid samples
+					*ssPtr-=oldVal*oldVal; // Sum of squares of valid samples
 					}
+				}
+			else if(!currentRetainValids)
+				{
+				/* Store an invalid input value: */
+				*abPtr=2048U;
 				
-				/* Check if the pixel is considered "stable": */
-				if(sPtr[0]>=minNumSamples&&sPtr[2]*sPtr[0]<=maxVariance*sPtr[0]*sPtr[0]+sPtr[1]*sPtr[1])
+				/* Check if the previous value in the averaging buffer was valid: */
+				if(oldVal!=2048U)
 					{
-					/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
-					float newFiltered=pdcPtr->correct(float(sPtr[1])/float(sPtr[0]));
-					if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
-						{
-						/* Set the output pixel value to the depth-corrected running mean: */
-						*nofPtr=*ofPtr=newFiltered;
-						}
-					else
-						{
-						/* Leave the pixel at its previous value: */
-						*nofPtr=*ofPtr;
-						}
+					--*cPtr; // Number of valid samples
+					*sPtr-=oldVal; // Sum of valid samples
+					*ssPtr-=oldVal*oldVal; // Sum of squares of valid samples
 					}
-				else if(retainValids)
+				}
+			
+			/* Check if the pixel is considered "stable": */
+			if(*cPtr>=minNumSamples&&*ssPtr**cPtr<=maxVariance**cPtr**cPtr+*sPtr**sPtr)
+				{
+				/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
+				float newFiltered=pdcPtr->correct(float(*sPtr)/float(*cPtr));
+				if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
 					{
-					/* Leave the pixel at its previous value: */
-					*nofPtr=*ofPtr;
+					/* Set the output pixel value to the depth-corrected running mean: */
+					*nofPtr=*ofPtr=newFiltered;
+					dirtyRegion.addPixel(x,y);
 					}
 				else
 					{
-					/* Assign default value to instable pixels: */
-					*nofPtr=instableValue;
+					/* Leave the pixel at its previous value: */
+					*nofPtr=*ofPtr;
 					}
 				}
+			else if(currentRetainValids)
+				{
+				/* Leave the pixel at its previous value: */
+				*nofPtr=*ofPtr;
+				}
+			else
+				{
+				/* Assign default value to instable pixels: */
+				*nofPtr=instableValue;
+				}
 			}
-		
-		/* Go to the next averaging slot: */
-		if(++averagingSlotIndex==numAveragingSlots)
-			averagingSlotIndex=0U;
-		
-		/* Apply a spatial filter if requested: */
-		if(spatialFilter)
+		}
+	}
+
+void FrameFilter::filterRowBandExponential(const FrameFilter::RawDepth* inputData,float* outputData,unsigned int yBegin,unsigned int yEnd,PixelRect& dirtyRegion)
+	{
+	/* Calculate the weight of each new sample such that the averaging window has the same effective length as the windowed average: */
+	float alpha=1.0f/float(numAveragingSlots);
+	float decay=1.0f-alpha;
+	float minWeight=calcMinExponentialWeight(alpha,minNumSamples);
+	float maxVar=float(maxVariance);
+	
+	/* Enter the new frame into the exponentially weighted statistics and calculate the output frame's pixel values: */
+	unsigned int offset=yBegin*size[0];
+	const RawDepth* ifPtr=inputData+offset;
+	float* wPtr=weightBuffer+offset;
+	float* mPtr=meanBuffer+offset;
+	float* dPtr=deviationBuffer+offset;
+	float* ofPtr=validBuffer+offset;
+	float* nofPtr=outputData+offset;
+	const PixelDepthCorrection* pdcPtr=pixelDepthCorrection+offset;
+	for(unsigned int y=yBegin;y<yEnd;++y)
+		{
+		float py=float(y)+0.5f;
+		for(unsigned int x=0;x<size[0];++x,++ifPtr,++pdcPtr,++wPtr,++mPtr,++dPtr,++ofPtr,++nofPtr)
 			{
-			for(int filterPass=0;filterPass<2;++filterPass)
+			float px=float(x)+0.5f;
+			
+			float newVal=float(*ifPtr);
+			
+			/* Depth-correct the new value: */
+			float newCVal=pdcPtr->correct(newVal);
+			
+			/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+			float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*newCVal+minPlane[3];
+			float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*newCVal+maxPlane[3];
+			if(minD>=0.0f&&maxD<=0.0f)
+				{
+				/* Decay the pixel's statistics and add the new value with weight alpha: */
+				addExponentialSample(*wPtr,*mPtr,*dPtr,newVal,alpha);
+				}
+			else if(!currentRetainValids)
 				{
-				/* Low-pass filter the entire output frame in-place: */
-				for(unsigned int x=0;x<size[0];++x)
+				/* Decay the pixel's statistics without adding a new sample: */
+				*wPtr*=decay;
+				*dPtr*=decay;
+				}
+			
+			/* Check if the pixel is considered "stable": */
+			if(*wPtr>=minWeight&&*dPtr<=maxVar**wPtr)
+				{
+				/* Check if the new depth-corrected running mean is outside the previous value's envelope: */
+				float newFiltered=pdcPtr->correct(*mPtr);
+				if(Math::abs(newFiltered-*ofPtr)>=hysteresis)
 					{
-					/* Get a pointer to the current column: */
-					float* colPtr=newOutputFrame.getData<float>()+x;
-					
-					/* Filter the first pixel in the column: */
-					float lastVal=*colPtr;
-					*colPtr=(colPtr[0]*2.0f+colPtr[size[0]])/3.0f;
-					colPtr+=size[0];
-					
-					/* Filter the interior pixels in the column: */
-					for(unsigned int y=1;y<size[1]-1;++y,colPtr+=size[0])
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*colPtr;
-						*colPtr=(lastVal+colPtr[0]*2.0f+colPtr[size[0]])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the column: */
-					*colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
+					/* Set the output pixel value to the depth-corrected running mean: */
+					*nofPtr=*ofPtr=newFiltered;
+					dirtyRegion.addPixel(x,y);
 					}
-				float* rowPtr=newOutputFrame.getData<float>();
-				for(unsigned int y=0;y<size[1];++y)
+				else
 					{
-					/* Filter the first pixel in the row: */
-					float lastVal=*rowPtr;
-					*rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
-					++rowPtr;
-					
-					/* Filter the interior pixels in the row: */
-					for(unsigned int x=1;x<size[0]-1;++x,++rowPtr)
-						{
-						/* Filter the pixel: */
-						float nextLastVal=*rowPtr;
-						*rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
-						lastVal=nextLastVal;
-						}
-					
-					/* Filter the last pixel in the row: */
-					*rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
-					++rowPtr;
+					/* Leave the pixel at its previous value: */
+					*nofPtr=*ofPtr;
 					}
 				}
+			else if(currentRetainValids)
+				{
+				/* Leave the pixel at its previous value: */
+				*nofPtr=*ofPtr;
+				}
+			else
+				{
+				/* Assign default value to instable pixels: */
+				*nofPtr=instableValue;
+				}
+			}
+		}
+	}
+
+void FrameFilter::spatialFilterColumns(float* outputData,unsigned int xBegin,unsigned int xEnd)
+	{
+	/* Low-pass filter the given range of columns of the output frame in-place: */
+	for(unsigned int x=xBegin;x<xEnd;++x)
+		{
+		/* Get a pointer to the current column: */
+		float* colPtr=outputData+x;
+		
+		/* Filter the first pixel in the column: */
+		float lastVal=*colPtr;
+		*colPtr=(colPtr[0]*2.0f+colPtr[size[0]])/3.0f;
+		colPtr+=size[0];
+		
+		/* Filter the interior pixels in the column: */
+		for(unsigned int y=1;y<size[1]-1;++y,colPtr+=size[0])
+			{
+			/* Filter the pixel: */
+			float nextLastVal=*colPtr;
+			*colPtr=(lastVal+colPtr[0]*2.0f+colPtr[size[0]])*0.25f;
+			lastVal=nextLastVal;
+			}
+		
+		/* Filter the last pixel in the column: */
+		*colPtr=(lastVal+colPtr[0]*2.0f)/3.0f;
+		}
+	}
+
+void FrameFilter::spatialFilterRows(float* outputData,unsigned int yBegin,unsigned int yEnd)
+	{
+	/* Low-pass filter the given range of rows of the output frame in-place: */
+	float* rowPtr=outputData+yBegin*size[0];
+	for(unsigned int y=yBegin;y<yEnd;++y)
+		{
+		/* Filter the first pixel in the row: */
+		float lastVal=*rowPtr;
+		*rowPtr=(rowPtr[0]*2.0f+rowPtr[1])/3.0f;
+		++rowPtr;
+		
+		/* Filter the interior pixels in the row: */
+		for(unsigned int x=1;x<size[0]-1;++x,++rowPtr)
+			{
+			/* Filter the pixel: */
+			float nextLastVal=*rowPtr;
+			*rowPtr=(lastVal+rowPtr[0]*2.0f+rowPtr[1])*0.25f;
+			lastVal=nextLastVal;
+			}
+		
+		/* Filter the last pixel in the row: */
+		*rowPtr=(lastVal+rowPtr[0]*2.0f)/3.0f;
+		++rowPtr;
+		}
+	}
+
+void FrameFilter::synchronizeFilterThreads(void)
+	{
+	if(numThreads>1)
+		workerBarrier->synchronize();
+	}
+
+void FrameFilter::processFrameBand(unsigned int bandIndex)
+	{
+	/* Calculate this band's row and column ranges: */
+	unsigned int yBegin=(size[1]*bandIndex)/numThreads;
+	unsigned int yEnd=(size[1]*(bandIndex+1))/numThreads;
+	unsigned int xBegin=(size[0]*bandIndex)/numThreads;
+	unsigned int xEnd=(size[0]*(bandIndex+1))/numThreads;
+	
+	/* Run the temporal filter on this band's rows: */
+	bandDirtyRegions[bandIndex]=PixelRect();
+	if(averagingMode==EXPONENTIAL)
+		filterRowBandExponential(currentInputData,currentOutputData,yBegin,yEnd,bandDirtyRegions[bandIndex]);
+	else
+		filterRowBand(currentInputData,currentOutputData,yBegin,yEnd,bandDirtyRegions[bandIndex]);
+	
+	/* Apply a spatial filter if requested: */
+	if(currentSpatialFilter)
+		{
+		for(int filterPass=0;filterPass<2;++filterPass)
+			{
+			/* Wait until all bands are done before filtering columns, which cross band boundaries: */
+			synchronizeFilterThreads();
+			spatialFilterColumns(currentOutputData,xBegin,xEnd);
+			
+			/* Wait until all columns are done before filtering rows: */
+			synchronizeFilterThreads();
+			spatialFilterRows(currentOutputData,yBegin,yEnd);
+			}
+		}
+	
+	/* Wait until the entire frame is done: */
+	synchronizeFilterThreads();
+	}
+
+void* FrameFilter::filterWorkerThreadMethod(unsigned int bandIndex)
+	{
+	while(true)
+		{
+		/* Wait until the background filtering thread starts a new frame or shuts down: */
+		workerBarrier->synchronize();
+		
+		/* Bail out if the program is shutting down: */
+		if(!runFilterThread)
+			break;
+		
+		/* Process this thread's band of the new frame: */
+		processFrameBand(bandIndex);
+		}
+	
+	return 0;
+	}
+
+void* FrameFilter::filterThreadMethod(void)
+	{
+	unsigned int lastInputFrameVersion=0;
+	
+	while(true)
+		{
+		Kinect::FrameBuffer frame;
+		{
+		Threads::MutexCond::Lock inputLock(inputCond);
+		
+		/* Wait until a new frame arrives or the program shuts down: */
+		while(runFilterThread&&lastInputFrameVersion==inputFrameVersion)
+			inputCond.wait(inputLock);
+		
+		/* Bail out if the program is shutting down: */
+		if(!runFilterThread)
+			break;
+		
+		/* Work on the new frame: */
+		frame=inputFrame;
+		lastInputFrameVersion=inputFrameVersion;
+		}
+		
+		/* Get a new output frame that is not used by any receiver: */
+		Kinect::FrameBuffer newOutputFrame=outputFramePool.acquireFrame();
+		
+		{
+		/* Measure the time spent filtering the new frame: */
+		PerformanceProfiler::CpuTimer filterTimer(profiler,profilerStage);
+		
+		/* Start all worker threads on the new frame and process the first band: */
+		currentInputData=frame.getData<RawDepth>();
+		currentOutputData=newOutputFrame.getData<float>();
+		currentSpatialFilter=spatialFilter;
+		currentRetainValids=retainValids;
+		currentVectorized=vectorized;
+		synchronizeFilterThreads();
+		processFrameBand(0);
+		
+		/* Combine the bands' changed pixel regions: */
+		if(currentRetainValids)
+			{
+			outputDirtyRegion=PixelRect();
+			for(unsigned int i=0;i<numThreads;++i)
+				outputDirtyRegion.addRect(bandDirtyRegions[i]);
+			
+			/* Account for the spatial filter spreading changes by one pixel per pass: */
+			if(currentSpatialFilter)
+				outputDirtyRegion.expand(2).clamp(size[0],size[1]);
+			}
+		else
+			{
+			/* Instable pixels can flip to the instable value at any time; mark the entire frame as changed: */
+			outputDirtyRegion=PixelRect(0,0,size[0],size[1]);
 			}
 		
-		/* Finalize the new output frame in the output buffer: */
-		outputFrames.postNewValue();
+		/* Go to the next averaging slot: */
+		if(averagingMode==WINDOWED&&++averagingSlotIndex==numAveragingSlots)
+			averagingSlotIndex=0U;
+		}
 		
-		/* Pass the new output frame to the registered receiver: */
+		/* Pass the new output frame to the registered receiver, which will release it when done, or release it right away: */
 		if(outputFrameFunction!=0)
 			(*outputFrameFunction)(newOutputFrame);
+		else
+			outputFramePool.releaseFrame(newOutputFrame);
 		}
 	
+	/* Release all worker threads so they can shut down: */
+	synchronizeFilterThreads();
+	
 	return 0;
 	}
 
-FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane)
+FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const FrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane,unsigned int sNumThreads,FrameFilter::AveragingMode sAveragingMode)
 	:pixelDepthCorrection(sPixelDepthCorrection),
+	 averagingMode(sAveragingMode),
 	 averagingBuffer(0),
-	 statBuffer(0),
-	 outputFrameFunction(0)
+	 validCountBuffer(0),sumBuffer(0),sumSquaresBuffer(0),
+	 weightBuffer(0),meanBuffer(0),deviationBuffer(0),
+	 outputFramePool(sSize,sSize[1]*sSize[0]*sizeof(float),4),
+	 outputFrameFunction(0),
+	 numThreads(sNumThreads>0?sNumThreads:1U),workerThreads(0),workerBarrier(0),
+	 currentInputData(0),currentOutputData(0),currentSpatialFilter(false),currentRetainValids(true),currentVectorized(true),
+	 bandDirtyRegions(0),
+	 profiler(0),profilerStage(0)
 	{
 	/* Remember the frame size: */
 	for(int i=0;i<2;++i)
@@ -224,23 +582,43 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 	/* Initialize the valid depth range: */
 	setValidDepthInterval(0U,2046U);
 	
-	/* Initialize the averaging buffer: */
 	numAveragingSlots=sNumAveragingSlots;
-	averagingBuffer=new RawDepth[numAveragingSlots*size[1]*size[0]];
-	RawDepth* abPtr=averagingBuffer;
-	for(unsigned int i=0;i<numAveragingSlots;++i)
-		for(unsigned int y=0;y<size[1];++y)
-			for(unsigned int x=0;x<size[0];++x,++abPtr)
-				*abPtr=2048U; // Mark sample as invalid
 	averagingSlotIndex=0U;
-	
-	/* Initialize the statistics buffer: */
-	statBuffer=new unsigned int[size[1]*size[0]*3];
-	unsigned int* sbPtr=statBuffer;
-	for(unsigned int y=0;y<size[1];++y)
-		for(unsigned int x=0;x<size[0];++x)
-			for(int i=0;i<3;++i,++sbPtr)
-				*sbPtr=0;
+	unsigned int numPixels=size[1]*size[0];
+	if(averagingMode==EXPONENTIAL)
+		{
+		/* Initialize the exponentially weighted statistics buffers: */
+		weightBuffer=new float[numPixels];
+		meanBuffer=new float[numPixels];
+		deviationBuffer=new float[numPixels];
+		for(unsigned int i=0;i<numPixels;++i)
+			{
+			weightBuffer[i]=0.0f;
+			meanBuffer[i]=0.0f;
+			deviationBuffer[i]=0.0f;
+			}
+		}
+	else
+		{
+		/* Initialize the averaging buffer: */
+		averagingBuffer=new RawDepth[numAveragingSlots*numPixels];
+		RawDepth* abPtr=averagingBuffer;
+		for(unsigned int i=0;i<numAveragingSlots;++i)
+			for(unsigned int y=0;y<size[1];++y)
+				for(unsigned int x=0;x<size[0];++x,++abPtr)
+					*abPtr=2048U; // Mark sample as invalid
+		
+		/* Initialize the statistics buffers: */
+		validCountBuffer=new unsigned int[numPixels];
+		sumBuffer=new unsigned int[numPixels];
+		sumSquaresBuffer=new unsigned int[numPixels];
+		for(unsigned int i=0;i<numPixels;++i)
+			{
+			validCountBuffer[i]=0;
+			sumBuffer[i]=0;
+			sumSquaresBuffer[i]=0;
+			}
+		}
 	
 	/* Initialize the stability criterion: */
 	minNumSamples=(numAveragingSlots+1)/2;
@@ -252,6 +630,9 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 	/* Enable spatial filtering: */
 	spatialFilter=true;
 	
+	/* Use vector instructions where available: */
+	vectorized=true;
+	
 	/* Convert the base plane equation from camera space to depth-image space: */
 	PTransform::HVector basePlaneCc(basePlane.getNormal());
 	basePlaneCc[3]=-basePlane.getOffset();
@@ -265,12 +646,19 @@ FrameFilter::FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingS
 		for(unsigned int x=0;x<size[0];++x,++vbPtr)
 			*vbPtr=float(-((double(x)+0.5)*basePlaneDic[0]+(double(y)+0.5)*basePlaneDic[1]+basePlaneDic[3])/basePlaneDic[2]);
 	
-	/* Initialize the output frame buffer: */
-	for(int i=0;i<3;++i)
-		outputFrames.getBuffer(i)=Kinect::FrameBuffer(size[0],size[1],size[1]*size[0]*sizeof(float));
+	/* Initialize the per-band changed pixel regions: */
+	bandDirtyRegions=new PixelRect[numThreads];
+	outputDirtyRegion=PixelRect(0,0,size[0],size[1]);
 	
-	/* Start the filtering thread: */
+	/* Start the filtering thread and any additional worker threads: */
 	runFilterThread=true;
+	if(numThreads>1)
+		{
+		workerBarrier=new Threads::Barrier(numThreads);
+		workerThreads=new Threads::Thread[numThreads-1];
+		for(unsigned int i=1;i<numThreads;++i)
+			workerThreads[i-1].start(this,&FrameFilter::filterWorkerThreadMethod,i);
+		}
 	filterThread.start(this,&FrameFilter::filterThreadMethod);
 	}
 
@@ -283,11 +671,21 @@ FrameFilter::~FrameFilter(void)
 	inputCond.signal();
 	}
 	filterThread.join();
+	for(unsigned int i=1;i<numThreads;++i)
+		workerThreads[i-1].join();
+	delete[] workerThreads;
+	delete workerBarrier;
 	
 	/* Release all allocated buffers: */
 	delete[] averagingBuffer;
-	delete[] statBuffer;
+	delete[] validCountBuffer;
+	delete[] sumBuffer;
+	delete[] sumSquaresBuffer;
+	delete[] weightBuffer;
+	delete[] meanBuffer;
+	delete[] deviationBuffer;
 	delete[] validBuffer;
+	delete[] bandDirtyRegions;
 	delete outputFrameFunction;
 	}
 
@@ -349,12 +747,25 @@ void FrameFilter::setSpatialFilter(bool newSpatialFilter)
 	spatialFilter=newSpatialFilter;
 	}
 
+void FrameFilter::setVectorized(bool newVectorized)
+	{
+	vectorized=newVectorized;
+	}
+
 void FrameFilter::setOutputFrameFunction(FrameFilter::OutputFrameFunction* newOutputFrameFunction)
 	{
 	delete outputFrameFunction;
 	outputFrameFunction=newOutputFrameFunction;
 	}
 
+void FrameFilter::setProfiler(PerformanceProfiler* newProfiler)
+	{
+	/* Register the filter's stage before publishing the profiler to the filtering thread: */
+	if(newProfiler!=0)
+		profilerStage=newProfiler->addStage("FrameFilter",false);
+	profiler=newProfiler;
+	}
+
 void FrameFilter::receiveRawFrame(const Kinect::FrameBuffer& newFrame)
 	{
 	Threads::MutexCond::Lock inputLock(inputCond);
@@ -24,19 +24,22 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef FRAMEFILTER_INCLUDED
 #define FRAMEFILTER_INCLUDED
 
+#include <Math/Math.h>
 #include <Threads/Thread.h>
+#include <Threads/Barrier.h>
 #include <Threads/MutexCond.h>
-#include <Threads/TripleBuffer.h>
 #include <Kinect/FrameBuffer.h>
 #include <Kinect/FrameSource.h>
 
 #include "Types.h"
+#include "FramePool.h"
 
 /* Forward declarations: */
 namespace Misc {
 template <class ParameterParam>
 class FunctionCall;
 }
+class PerformanceProfiler;
 
 class FrameFilter
 	{
@@ -47,6 +50,12 @@ class FrameFilter
 	typedef Misc::FunctionCall<const Kinect::FrameBuffer&> OutputFrameFunction; // Type for functions called when a new output frame is ready
 	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
 	
+	enum AveragingMode // Enumerated type for methods to calculate per-pixel depth statistics
+		{
+		WINDOWED, // Exact statistics over a ring buffer of the most recent numAveragingSlots samples
+		EXPONENTIAL // Exponentially weighted statistics with an effective window length of numAveragingSlots samples; memory use independent of window length
+		};
+	
 	/* Elements: */
 	private:
 	unsigned int size[2]; // Width and height of processed frames
@@ -58,26 +67,53 @@ class FrameFilter
 	Threads::Thread filterThread; // The background filtering thread
 	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
 	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
-	unsigned int numAveragingSlots; // Number of slots in each pixel's averaging buffer
-	RawDepth* averagingBuffer; // Buffer to calculate running averages of each pixel's depth value
+	AveragingMode averagingMode; // Method to calculate per-pixel depth statistics
+	unsigned int numAveragingSlots; // Number of slots in each pixel's averaging buffer, or effective window length in exponential mode
+	RawDepth* averagingBuffer; // Slot-major buffer to calculate running averages of each pixel's depth value in windowed mode
 	unsigned int averagingSlotIndex; // Index of averaging slot in which to store the next frame's depth values
-	unsigned int* statBuffer; // Buffer retaining the running means and variances of each pixel's depth value
+	unsigned int* validCountBuffer; // Buffer retaining the number of valid samples of each pixel in windowed mode
+	unsigned int* sumBuffer; // Buffer retaining the sum of valid samples of each pixel in windowed mode
+	unsigned int* sumSquaresBuffer; // Buffer retaining the sum of squares of valid samples of each pixel in windowed mode
+	float* weightBuffer; // Buffer retaining the total weight of valid samples of each pixel in exponential mode
+	float* meanBuffer; // Buffer retaining the weighted mean of valid samples of each pixel in exponential mode
+	float* deviationBuffer; // Buffer retaining the weighted sum of squared deviations of valid samples of each pixel in exponential mode
 	unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
 	unsigned int maxVariance; // Maximum variance to consider a pixel stable
 	float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
 	bool retainValids; // Flag whether to retain previous stable values if a new pixel in instable, or reset to a default value
 	float instableValue; // Value to assign to instable pixels if retainValids is false
 	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
+	bool vectorized; // Flag whether to run the windowed temporal filter with vector instructions where available
 	float* validBuffer; // Buffer holding the most recent stable depth value for each pixel
-	Threads::TripleBuffer<Kinect::FrameBuffer> outputFrames; // Triple buffer of output frames
+	FramePool outputFramePool; // Pool of output frames recycled between the filter and its consumers
 	OutputFrameFunction* outputFrameFunction; // Function called when a new output frame is ready
+	unsigned int numThreads; // Number of threads processing bands of each frame, including the background filtering thread
+	Threads::Thread* workerThreads; // Array of additional worker threads processing bands of each frame
+	Threads::Barrier* workerBarrier; // Barrier synchronizing the background filtering thread and all worker threads
+	const RawDepth* currentInputData; // Depth values of the input frame currently being processed
+	float* currentOutputData; // Depth values of the output frame currently being processed
+	bool currentSpatialFilter; // Spatial filtering flag for the frame currently being processed
+	bool currentRetainValids; // Valid retention flag for the frame currently being processed
+	bool currentVectorized; // Vectorization flag for the frame currently being processed
+	PixelRect* bandDirtyRegions; // Array of regions of changed output pixels found by each filtering thread in its band of the current frame
+	PixelRect outputDirtyRegion; // Region of output pixels that changed in the most recent output frame
+	PerformanceProfiler* profiler; // Profiler measuring the CPU time spent filtering each frame, or NULL
+	unsigned int profilerStage; // Index of the frame filter's stage in the profiler
 	
 	/* Private methods: */
+	unsigned int filterRowVectorized(const RawDepth* inputData,float* outputData,unsigned int y,PixelRect& dirtyRegion); // Runs the windowed temporal filter on a prefix of the given row with vector instructions; returns the number of processed pixels, or 0 if no vector instructions are available
+	void filterRowBand(const RawDepth* inputData,float* outputData,unsigned int yBegin,unsigned int yEnd,PixelRect& dirtyRegion); // Runs the windowed temporal filter on the given range of rows; adds changed output pixels to the given region
+	void filterRowBandExponential(const RawDepth* inputData,float* outputData,unsigned int yBegin,unsigned int yEnd,PixelRect& dirtyRegion); // Runs the exponentially weighted temporal filter on the given range of rows; adds changed output pixels to the given region
+	void spatialFilterColumns(float* outputData,unsigned int xBegin,unsigned int xEnd); // Runs one vertical spatial filter pass on the given range of columns
+	void spatialFilterRows(float* outputData,unsigned int yBegin,unsigned int yEnd); // Runs one horizontal spatial filter pass on the given range of rows
+	void synchronizeFilterThreads(void); // Waits until all filtering threads reach the same point
+	void processFrameBand(unsigned int bandIndex); // Processes the given band of the current frame; must be called by all filtering threads
+	void* filterWorkerThreadMethod(unsigned int bandIndex); // Method for additional filtering worker threads
 	void* filterThreadMethod(void); // Method for the background filtering thread
 	
 	/* Constructors and destructors: */
 	public:
-	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane); // Creates a filter for frames of the given size and the given running average length
+	FrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane,unsigned int sNumThreads=1,AveragingMode sAveragingMode=WINDOWED); // Creates a filter for frames of the given size and the given running average length, processing each frame with the given number of threads and averaging method
 	~FrameFilter(void); // Destroys the frame filter
 	
 	/* Methods: */
@@ -88,15 +124,29 @@ class FrameFilter
 	void setRetainValids(bool newRetainValids); // Sets whether the filter retains previous stable values for instable pixels
 	void setInstableValue(float newInstableValue); // Sets the depth value to assign to instable pixels
 	void setSpatialFilter(bool newSpatialFilter); // Sets the spatial filtering flag
+	void setVectorized(bool newVectorized); // Sets whether the windowed temporal filter uses vector instructions where available; results are identical either way
 	void setOutputFrameFunction(OutputFrameFunction* newOutputFrameFunction); // Sets the output function; adopts given functor object
+	void setProfiler(PerformanceProfiler* newProfiler); // Registers a stage with the given profiler and measures the CPU time spent filtering each frame
 	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to receive a new raw depth frame
-	bool lockNewFrame(void) // Locks the most recently produced output frame for reading; returns true if the locked frame is new
+	static void addExponentialSample(float& weight,float& mean,float& deviation,float newVal,float alpha) // Decays a pixel's exponentially weighted total weight, mean, and sum of squared deviations, and adds a new sample with weight alpha
+		{
+		weight=weight*(1.0f-alpha)+alpha;
+		float delta=newVal-mean;
+		mean+=delta*(alpha/weight);
+		deviation=deviation*(1.0f-alpha)+delta*(newVal-mean)*alpha;
+		}
+	static float calcMinExponentialWeight(float alpha,unsigned int minNumSamples) // Returns the total weight threshold that a pixel's exponentially weighted statistics cross with the given number of consecutive valid samples
+		{
+		/* After n samples the total weight is 1-(1-alpha)^n; aim at n-1/2 samples, between the weights after n-1 and n samples, so that rounding in the incremental update can not miss the threshold: */
+		return 1.0f-Math::pow(1.0f-alpha,float(minNumSamples)-0.5f);
+		}
+	const PixelRect& getOutputDirtyRegion(void) const // Returns the region of pixels that changed in the output frame currently being passed to the output function; only valid inside the output function
 		{
-		return outputFrames.lockNewValue();
+		return outputDirtyRegion;
 		}
-	const Kinect::FrameBuffer& getLockedFrame(void) const // Returns the most recently locked output frame
+	void releaseFrame(const Kinect::FrameBuffer& frame) // Called by the output function's receiver when it no longer needs a previously received output frame
 		{
-		return outputFrames.getLockedValue();
+		outputFramePool.releaseFrame(frame);
 		}
 	};
 
@@ -0,0 +1,85 @@
+/***********************************************************************
+FramePool - Class to recycle frame buffers of a fixed size between the
+producer and consumers of a stream of frames.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "FramePool.h"
+
+/**************************
+Methods of class FramePool:
+**************************/
+
+FramePool::FramePool(const unsigned int sSize[2],size_t sBufferSize,unsigned int numInitialFrames)
+	:bufferSize(sBufferSize)
+	{
+	/* Remember the frame size: */
+	for(int i=0;i<2;++i)
+		size[i]=sSize[i];
+	
+	/* Allocate the initial set of frames: */
+	slots.reserve(numInitialFrames);
+	for(unsigned int i=0;i<numInitialFrames;++i)
+		{
+		Slot newSlot;
+		newSlot.frame=Kinect::FrameBuffer(size[0],size[1],bufferSize);
+		newSlot.leased=false;
+		slots.push_back(newSlot);
+		}
+	}
+
+unsigned int FramePool::getNumFrames(void)
+	{
+	Threads::Mutex::Lock poolLock(poolMutex);
+	return slots.size();
+	}
+
+Kinect::FrameBuffer FramePool::acquireFrame(void)
+	{
+	Threads::Mutex::Lock poolLock(poolMutex);
+	
+	/* Hand out the first frame that is not currently leased: */
+	for(std::vector<Slot>::iterator sIt=slots.begin();sIt!=slots.end();++sIt)
+		if(!sIt->leased)
+			{
+			sIt->leased=true;
+			return sIt->frame;
+			}
+	
+	/* All frames are in use; grow the pool: */
+	Slot newSlot;
+	newSlot.frame=Kinect::FrameBuffer(size[0],size[1],bufferSize);
+	newSlot.leased=true;
+	slots.push_back(newSlot);
+	return newSlot.frame;
+	}
+
+void FramePool::releaseFrame(const Kinect::FrameBuffer& frame)
+	{
+	Threads::Mutex::Lock poolLock(poolMutex);
+	
+	/* Find the pooled frame sharing the given frame's memory block: */
+	const unsigned char* buffer=frame.getData<unsigned char>();
+	for(std::vector<Slot>::iterator sIt=slots.begin();sIt!=slots.end();++sIt)
+		if(sIt->frame.getData<unsigned char>()==buffer)
+			{
+			sIt->leased=false;
+			break;
+			}
+	}
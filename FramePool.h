@@ -0,0 +1,59 @@
+/***********************************************************************
+FramePool - Class to recycle frame buffers of a fixed size between the
+producer and consumers of a stream of frames.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef FRAMEPOOL_INCLUDED
+#define FRAMEPOOL_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Threads/Mutex.h>
+#include <Kinect/FrameBuffer.h>
+
+class FramePool
+	{
+	/* Embedded classes: */
+	private:
+	struct Slot // Structure for a pooled frame
+		{
+		/* Elements: */
+		public:
+		Kinect::FrameBuffer frame; // The pooled frame, sharing its memory block with all handed-out copies
+		bool leased; // Flag if the frame is currently handed out
+		};
+	
+	/* Elements: */
+	unsigned int size[2]; // Width and height of pooled frames
+	size_t bufferSize; // Size of each pooled frame's memory block in bytes
+	Threads::Mutex poolMutex; // Mutex protecting the pool
+	std::vector<Slot> slots; // List of pooled frames
+	
+	/* Constructors and destructors: */
+	public:
+	FramePool(const unsigned int sSize[2],size_t sBufferSize,unsigned int numInitialFrames); // Creates a pool of frames of the given size and memory block size
+	
+	/* Methods: */
+	unsigned int getNumFrames(void); // Returns the number of frames allocated by the pool
+	Kinect::FrameBuffer acquireFrame(void); // Returns a frame that is not used by anyone else; only allocates a new frame if all pooled frames are in use
+	void releaseFrame(const Kinect::FrameBuffer& frame); // Returns a previously acquired frame to the pool; ignores frames not belonging to the pool
+	};
+
+#endif
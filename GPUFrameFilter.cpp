@@ -0,0 +1,444 @@
+/***********************************************************************
+GPUFrameFilter - Class to filter streams of depth frames arriving from a
+depth camera on the GPU, writing stable and hole-filled depth values
+directly into a depth image texture.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GPUFrameFilter.h"
+
+#include <stdio.h>
+#include <Geometry/HVector.h>
+#include <Geometry/Matrix.h>
+#include <GL/gl.h>
+#include <GL/GLContextData.h>
+#include <GL/Extensions/GLARBDrawBuffers.h>
+#include <GL/Extensions/GLARBFragmentShader.h>
+#include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBTextureFloat.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBTextureRg.h>
+#include <GL/Extensions/GLARBVertexShader.h>
+#include <GL/Extensions/GLEXTFramebufferObject.h>
+
+#include "FrameFilter.h"
+#include "ShaderHelper.h"
+
+/*****************************************
+Methods of class GPUFrameFilter::DataItem:
+*****************************************/
+
+GPUFrameFilter::DataItem::DataItem(void)
+	:rawDepthTexture(0),depthCorrectionTexture(0),currentStat(0),numFilteredFrames(0),
+	 filterFramebufferObject(0),attachedDepthTexture(0),
+	 temporalShader(0),spatialShader(0)
+	{
+	for(int i=0;i<2;++i)
+		{
+		statTextures[i]=0;
+		filterTextures[i]=0;
+		}
+	
+	/* Initialize all required OpenGL extensions: */
+	GLARBDrawBuffers::initExtension();
+	GLARBFragmentShader::initExtension();
+	GLARBMultitexture::initExtension();
+	GLARBShaderObjects::initExtension();
+	GLARBTextureFloat::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBTextureRg::initExtension();
+	GLARBVertexShader::initExtension();
+	GLEXTFramebufferObject::initExtension();
+	}
+
+GPUFrameFilter::DataItem::~DataItem(void)
+	{
+	/* Delete all allocated shaders, textures, and buffers: */
+	glDeleteTextures(1,&rawDepthTexture);
+	glDeleteTextures(1,&depthCorrectionTexture);
+	glDeleteTextures(2,statTextures);
+	glDeleteTextures(2,filterTextures);
+	glDeleteFramebuffersEXT(1,&filterFramebufferObject);
+	glDeleteObjectARB(temporalShader);
+	glDeleteObjectARB(spatialShader);
+	}
+
+/*******************************
+Methods of class GPUFrameFilter:
+*******************************/
+
+GPUFrameFilter::GPUFrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const GPUFrameFilter::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane)
+	:depthCorrection(0),initialStats(0),
+	 numAveragingSlots(sNumAveragingSlots),
+	 numReceivedFrames(0)
+	{
+	/* Remember the frame size: */
+	for(int i=0;i<2;++i)
+		size[i]=sSize[i];
+	
+	/* Initialize the valid depth range: */
+	setValidDepthInterval(0U,2046U);
+	
+	/* Initialize the stability criterion: */
+	minNumSamples=(numAveragingSlots+1)/2;
+	maxVariance=4;
+	hysteresis=0.1f;
+	retainValids=true;
+	instableValue=0.0;
+	
+	/* Enable spatial filtering: */
+	spatialFilter=true;
+	
+	/* Convert the per-pixel depth correction coefficients into texture format: */
+	depthCorrection=new GLfloat[size[1]*size[0]*2];
+	GLfloat* dcPtr=depthCorrection;
+	const PixelDepthCorrection* pdcPtr=sPixelDepthCorrection;
+	for(unsigned int y=0;y<size[1];++y)
+		for(unsigned int x=0;x<size[0];++x,++pdcPtr,dcPtr+=2)
+			{
+			dcPtr[0]=pdcPtr->scale;
+			dcPtr[1]=pdcPtr->offset;
+			}
+	
+	/* Convert the base plane equation from camera space to depth-image space: */
+	PTransform::HVector basePlaneCc(basePlane.getNormal());
+	basePlaneCc[3]=-basePlane.getOffset();
+	PTransform::HVector basePlaneDic(depthProjection.getMatrix().transposeMultiply(basePlaneCc));
+	basePlaneDic/=Geometry::mag(basePlaneDic.toVector());
+	
+	/* Initialize the statistics such that all pixels start out with no valid samples and a stable value on the base plane: */
+	initialStats=new GLfloat[size[1]*size[0]*4];
+	GLfloat* isPtr=initialStats;
+	for(unsigned int y=0;y<size[1];++y)
+		for(unsigned int x=0;x<size[0];++x,isPtr+=4)
+			{
+			isPtr[0]=0.0f;
+			isPtr[1]=0.0f;
+			isPtr[2]=0.0f;
+			isPtr[3]=float(-((double(x)+0.5)*basePlaneDic[0]+(double(y)+0.5)*basePlaneDic[1]+basePlaneDic[3])/basePlaneDic[2]);
+			}
+	}
+
+GPUFrameFilter::~GPUFrameFilter(void)
+	{
+	delete[] depthCorrection;
+	delete[] initialStats;
+	}
+
+void GPUFrameFilter::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	{
+	/* Create the raw depth frame texture: */
+	glGenTextures(1,&dataItem->rawDepthTexture);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->rawDepthTexture);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_LUMINANCE16,size[0],size[1],0,GL_LUMINANCE,GL_UNSIGNED_SHORT,0);
+	}
+	
+	{
+	/* Create the depth correction texture: */
+	glGenTextures(1,&dataItem->depthCorrectionTexture);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthCorrectionTexture);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RG32F,size[0],size[1],0,GL_RG,GL_FLOAT,depthCorrection);
+	}
+	
+	{
+	/* Create the statistics textures: */
+	glGenTextures(2,dataItem->statTextures);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGBA32F_ARB,size[0],size[1],0,GL_RGBA,GL_FLOAT,initialStats);
+		}
+	}
+	
+	{
+	/* Create the spatial filter textures: */
+	glGenTextures(2,dataItem->filterTextures);
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,size[0],size[1],0,GL_RED,GL_FLOAT,0);
+		}
+	}
+	
+	/* Protect the created textures: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Save the currently bound frame buffer: */
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	{
+	/* Create the filtering frame buffer and attach the statistics and spatial filter textures; the depth image texture will be attached to color attachment 4 on first use: */
+	glGenFramebuffersEXT(1,&dataItem->filterFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->filterFramebufferObject);
+	for(int i=0;i<2;++i)
+		{
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[i],0);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT2_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[i],0);
+		}
+	glReadBuffer(GL_NONE);
+	}
+	
+	/* Restore the previously bound frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	
+	/* Create a simple vertex shader to render quads in pixel space: */
+	static const char* vertexShaderSourceTemplate="void main(){gl_Position=vec4(gl_Vertex.x*%f-1.0,gl_Vertex.y*%f-1.0,0.0,1.0);}";
+	char vertexShaderSource[256];
+	snprintf(vertexShaderSource,sizeof(vertexShaderSource),vertexShaderSourceTemplate,2.0/double(size[0]),2.0/double(size[1]));
+	
+	/* Create the temporal filter shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("DepthFilterTemporalShader");
+	dataItem->temporalShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->temporalShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->temporalShader,"rawDepthSampler");
+	dataItem->temporalShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->temporalShader,"depthCorrectionSampler");
+	dataItem->temporalShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->temporalShader,"statSampler");
+	dataItem->temporalShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->temporalShader,"minPlane");
+	dataItem->temporalShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->temporalShader,"maxPlane");
+	dataItem->temporalShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->temporalShader,"alpha");
+	dataItem->temporalShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->temporalShader,"minWeight");
+	dataItem->temporalShaderUniformLocations[7]=glGetUniformLocationARB(dataItem->temporalShader,"maxVariance");
+	dataItem->temporalShaderUniformLocations[8]=glGetUniformLocationARB(dataItem->temporalShader,"hysteresis");
+	dataItem->temporalShaderUniformLocations[9]=glGetUniformLocationARB(dataItem->temporalShader,"retainValids");
+	dataItem->temporalShaderUniformLocations[10]=glGetUniformLocationARB(dataItem->temporalShader,"instableValue");
+	}
+	
+	/* Create the spatial filter shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("DepthFilterSpatialShader");
+	dataItem->spatialShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->spatialShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->spatialShader,"depthSampler");
+	dataItem->spatialShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->spatialShader,"filterStep");
+	dataItem->spatialShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->spatialShader,"depthImageSize");
+	}
+	}
+
+void GPUFrameFilter::setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth)
+	{
+	/* Set the equations for the minimum and maximum plane in depth image space: */
+	minPlane[0]=0.0f;
+	minPlane[1]=0.0f;
+	minPlane[2]=1.0f;
+	minPlane[3]=-float(newMinDepth)+0.5f;
+	maxPlane[0]=0.0f;
+	maxPlane[1]=0.0f;
+	maxPlane[2]=1.0f;
+	maxPlane[3]=-float(newMaxDepth)-0.5f;
+	}
+
+void GPUFrameFilter::setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation)
+	{
+	/* Calculate the equations of the minimum and maximum elevation planes in camera space: */
+	PTransform::HVector minPlaneCc(basePlane.getNormal());
+	minPlaneCc[3]=-(basePlane.getOffset()+newMinElevation*basePlane.getNormal().mag());
+	PTransform::HVector maxPlaneCc(basePlane.getNormal());
+	maxPlaneCc[3]=-(basePlane.getOffset()+newMaxElevation*basePlane.getNormal().mag());
+	
+	/* Transform the plane equations to depth image space and flip and swap the min and max planes because elevation increases opposite to raw depth: */
+	PTransform::HVector minPlaneDic(depthProjection.getMatrix().transposeMultiply(minPlaneCc));
+	double minPlaneScale=-1.0/Geometry::mag(minPlaneDic.toVector());
+	for(int i=0;i<4;++i)
+		maxPlane[i]=float(minPlaneDic[i]*minPlaneScale);
+	PTransform::HVector maxPlaneDic(depthProjection.getMatrix().transposeMultiply(maxPlaneCc));
+	double maxPlaneScale=-1.0/Geometry::mag(maxPlaneDic.toVector());
+	for(int i=0;i<4;++i)
+		minPlane[i]=float(maxPlaneDic[i]*maxPlaneScale);
+	}
+
+void GPUFrameFilter::setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance)
+	{
+	minNumSamples=newMinNumSamples;
+	maxVariance=newMaxVariance;
+	}
+
+void GPUFrameFilter::setHysteresis(float newHysteresis)
+	{
+	hysteresis=newHysteresis;
+	}
+
+void GPUFrameFilter::setRetainValids(bool newRetainValids)
+	{
+	retainValids=newRetainValids;
+	}
+
+void GPUFrameFilter::setInstableValue(float newInstableValue)
+	{
+	instableValue=newInstableValue;
+	}
+
+void GPUFrameFilter::setSpatialFilter(bool newSpatialFilter)
+	{
+	spatialFilter=newSpatialFilter;
+	}
+
+void GPUFrameFilter::receiveRawFrame(const Kinect::FrameBuffer& rawFrame)
+	{
+	Threads::Mutex::Lock frameQueueLock(frameQueueMutex);
+	frameQueue[numReceivedFrames%numQueuedFrames]=rawFrame;
+	++numReceivedFrames;
+	}
+
+void GPUFrameFilter::filterFrames(GLuint depthTexture,GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Collect all raw frames this context has not entered yet, in sequence order; frames older than the queue are lost: */
+	Kinect::FrameBuffer rawFrames[numQueuedFrames];
+	unsigned int numRawFrames=0;
+	{
+	Threads::Mutex::Lock frameQueueLock(frameQueueMutex);
+	unsigned int first=dataItem->numFilteredFrames;
+	if(numReceivedFrames-first>numQueuedFrames)
+		first=numReceivedFrames-numQueuedFrames;
+	for(unsigned int sequence=first;sequence!=numReceivedFrames;++sequence,++numRawFrames)
+		rawFrames[numRawFrames]=frameQueue[sequence%numQueuedFrames];
+	dataItem->numFilteredFrames=numReceivedFrames;
+	}
+	if(numRawFrames==0)
+		return;
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	GLint currentTextureUnit;
+	glGetIntegerv(GL_ACTIVE_TEXTURE_ARB,&currentTextureUnit);
+	GLhandleARB currentShader=glGetHandleARB(GL_PROGRAM_OBJECT_ARB);
+	
+	/* Bind the filtering frame buffer and attach the destination depth image texture if necessary: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->filterFramebufferObject);
+	if(dataItem->attachedDepthTexture!=depthTexture)
+		{
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT4_EXT,GL_TEXTURE_RECTANGLE_ARB,depthTexture,0);
+		dataItem->attachedDepthTexture=depthTexture;
+		}
+	glViewport(0,0,size[0],size[1]);
+	
+	/* Set up the temporal filter shader: */
+	float alpha=1.0f/float(numAveragingSlots);
+	glUseProgramObjectARB(dataItem->temporalShader);
+	glUniform1iARB(dataItem->temporalShaderUniformLocations[0],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->depthCorrectionTexture);
+	glUniform1iARB(dataItem->temporalShaderUniformLocations[1],1);
+	glUniform1iARB(dataItem->temporalShaderUniformLocations[2],2);
+	glUniform4fvARB(dataItem->temporalShaderUniformLocations[3],1,minPlane);
+	glUniform4fvARB(dataItem->temporalShaderUniformLocations[4],1,maxPlane);
+	glUniform1fARB(dataItem->temporalShaderUniformLocations[5],alpha);
+	glUniform1fARB(dataItem->temporalShaderUniformLocations[6],FrameFilter::calcMinExponentialWeight(alpha,minNumSamples));
+	glUniform1fARB(dataItem->temporalShaderUniformLocations[7],float(maxVariance));
+	glUniform1fARB(dataItem->temporalShaderUniformLocations[8],hysteresis);
+	glUniform1iARB(dataItem->temporalShaderUniformLocations[9],retainValids?1:0);
+	glUniform1fARB(dataItem->temporalShaderUniformLocations[10],instableValue);
+	
+	/* Enter each raw frame into the statistics; the last frame's temporally filtered depth image goes into either the spatial filter's input or the final depth image texture: */
+	for(unsigned int i=0;i<numRawFrames;++i)
+		{
+		/* Upload the raw depth frame: */
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->rawDepthTexture);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_LUMINANCE,GL_UNSIGNED_SHORT,rawFrames[i].getData<RawDepth>());
+		
+		/* Write the new statistics and the temporally filtered depth image: */
+		GLenum drawBuffers[2]={GLenum(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentStat)),spatialFilter?GL_COLOR_ATTACHMENT2_EXT:GL_COLOR_ATTACHMENT4_EXT};
+		glDrawBuffersARB(2,drawBuffers);
+		glActiveTextureARB(GL_TEXTURE2_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->statTextures[dataItem->currentStat]);
+		
+		/* Run the temporal filter: */
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		
+		/* Flip the statistics textures: */
+		dataItem->currentStat=1-dataItem->currentStat;
+		}
+	
+	/* Unbind the depth correction and statistics textures: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	
+	if(spatialFilter)
+		{
+		/* Set up the spatial filter shader: */
+		glUseProgramObjectARB(dataItem->spatialShader);
+		glUniform1iARB(dataItem->spatialShaderUniformLocations[0],0);
+		glUniform2fARB(dataItem->spatialShaderUniformLocations[2],GLfloat(size[0]),GLfloat(size[1]));
+		
+		/* Run two pairs of vertical and horizontal filter passes, ending in the final depth image texture: */
+		for(int pass=0;pass<4;++pass)
+			{
+			glDrawBuffer(pass==3?GL_COLOR_ATTACHMENT4_EXT:GL_COLOR_ATTACHMENT2_EXT+(1-pass%2));
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->filterTextures[pass%2]);
+			if(pass%2==0)
+				glUniform2fARB(dataItem->spatialShaderUniformLocations[1],0.0f,1.0f);
+			else
+				glUniform2fARB(dataItem->spatialShaderUniformLocations[1],1.0f,0.0f);
+			
+			glBegin(GL_QUADS);
+			glVertex2i(0,0);
+			glVertex2i(size[0],0);
+			glVertex2i(size[0],size[1]);
+			glVertex2i(0,size[1]);
+			glEnd();
+			}
+		}
+	
+	/* Restore OpenGL state: */
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(currentTextureUnit);
+	glUseProgramObjectARB(currentShader);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	}
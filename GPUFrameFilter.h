@@ -0,0 +1,104 @@
+/***********************************************************************
+GPUFrameFilter - Class to filter streams of depth frames arriving from a
+depth camera on the GPU, writing stable and hole-filled depth values
+directly into a depth image texture.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GPUFRAMEFILTER_INCLUDED
+#define GPUFRAMEFILTER_INCLUDED
+
+#include <Threads/Mutex.h>
+#include <GL/gl.h>
+#include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/GLObject.h>
+#include <Kinect/FrameBuffer.h>
+#include <Kinect/FrameSource.h>
+
+#include "Types.h"
+
+class GPUFrameFilter:public GLObject
+	{
+	/* Embedded classes: */
+	public:
+	typedef unsigned short RawDepth; // Data type for raw depth values
+	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
+	
+	private:
+	struct DataItem:public GLObject::DataItem // Structure storing per-context OpenGL state
+		{
+		/* Elements: */
+		public:
+		GLuint rawDepthTexture; // Texture object holding the most recent raw depth frame
+		GLuint depthCorrectionTexture; // Texture object holding per-pixel depth correction scales and offsets
+		GLuint statTextures[2]; // Double-buffered texture objects holding per-pixel weight, mean, deviation, and stable value
+		int currentStat; // Index of the statistics texture holding the current statistics
+		unsigned int numFilteredFrames; // Number of received raw frames entered into this context's statistics, including skipped ones
+		GLuint filterTextures[2]; // Texture objects holding intermediate results of the spatial filter
+		GLuint filterFramebufferObject; // Frame buffer used for all filtering passes
+		GLuint attachedDepthTexture; // Depth image texture currently attached to the filtering frame buffer
+		GLhandleARB temporalShader; // Shader to update per-pixel statistics from a raw depth frame
+		GLint temporalShaderUniformLocations[11];
+		GLhandleARB spatialShader; // Shader to run one pass of the separable spatial filter
+		GLint spatialShaderUniformLocations[3];
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	unsigned int size[2]; // Width and height of processed frames
+	GLfloat* depthCorrection; // Interleaved per-pixel depth correction scales and offsets
+	GLfloat* initialStats; // Initial per-pixel statistics, with stable values on the base plane
+	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
+	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
+	unsigned int numAveragingSlots; // Effective length of the exponentially weighted averaging window
+	unsigned int minNumSamples; // Minimum number of valid samples needed to consider a pixel stable
+	unsigned int maxVariance; // Maximum variance to consider a pixel stable
+	float hysteresis; // Amount by which a new filtered value has to differ from the current value to update
+	bool retainValids; // Flag whether to retain previous stable values if a new pixel in instable, or reset to a default value
+	float instableValue; // Value to assign to instable pixels if retainValids is false
+	bool spatialFilter; // Flag whether to apply a spatial filter to time-averaged depth values
+	static const unsigned int numQueuedFrames=8; // Number of most recent raw frames retained for contexts that did not filter them yet
+	mutable Threads::Mutex frameQueueMutex; // Mutex serializing access to the raw frame queue
+	Kinect::FrameBuffer frameQueue[numQueuedFrames]; // Ring of the most recent raw frames, indexed by sequence number modulo queue length
+	unsigned int numReceivedFrames; // Sequence number of the next received raw frame
+	
+	/* Constructors and destructors: */
+	public:
+	GPUFrameFilter(const unsigned int sSize[2],unsigned int sNumAveragingSlots,const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& depthProjection,const Plane& basePlane); // Creates a filter for frames of the given size and the given running average length
+	virtual ~GPUFrameFilter(void);
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	void setValidDepthInterval(unsigned int newMinDepth,unsigned int newMaxDepth); // Sets the interval of depth values considered by the depth image filter
+	void setValidElevationInterval(const PTransform& depthProjection,const Plane& basePlane,double newMinElevation,double newMaxElevation); // Sets the interval of elevations relative to the given base plane considered by the depth image filter
+	void setStableParameters(unsigned int newMinNumSamples,unsigned int newMaxVariance); // Sets the statistical properties to consider a pixel stable
+	void setHysteresis(float newHysteresis); // Sets the stable value hysteresis envelope
+	void setRetainValids(bool newRetainValids); // Sets whether the filter retains previous stable values for instable pixels
+	void setInstableValue(float newInstableValue); // Sets the depth value to assign to instable pixels
+	void setSpatialFilter(bool newSpatialFilter); // Sets the spatial filtering flag
+	void receiveRawFrame(const Kinect::FrameBuffer& rawFrame); // Queues a new raw depth frame to be entered into the statistics of all OpenGL contexts; can be called from any thread
+	void filterFrames(GLuint depthTexture,GLContextData& contextData) const; // Enters all raw depth frames received since the previous call in this context into the filter in order, and writes the filtered depth image into the given one-component floating-point rectangle texture; resets texture bindings on units 0-2
+	};
+
+#endif
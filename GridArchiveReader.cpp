@@ -0,0 +1,181 @@
+/***********************************************************************
+GridArchiveReader - Class to read and scrub through bathymetry and water
+level grid archives written by GridArchiver.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridArchiveReader.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <IO/OpenFile.h>
+
+#include "GridCodec.h"
+
+/**********************************
+Methods of class GridArchiveReader:
+**********************************/
+
+bool GridArchiveReader::readIndex(void)
+	{
+	/* Check for a trailer at the end of the file: */
+	IO::SeekableFile::Offset fileSize=file->getSize();
+	if(fileSize<IO::SeekableFile::Offset(GridArchiver::headerSize+GridArchiver::trailerSize))
+		return false;
+	file->setReadPosAbs(fileSize-IO::SeekableFile::Offset(GridArchiver::trailerSize));
+	IO::SeekableFile::Offset indexOffset=IO::SeekableFile::Offset(file->read<Misc::UInt64>());
+	if(file->read<Misc::UInt32>()!=GridArchiver::indexTag||indexOffset<IO::SeekableFile::Offset(GridArchiver::headerSize)||indexOffset+5>fileSize)
+		return false;
+	
+	/* Read the index record: */
+	file->setReadPosAbs(indexOffset);
+	if(file->read<Misc::UInt8>()!=GridArchiver::INDEX)
+		return false;
+	size_t numEntries=file->read<Misc::UInt32>();
+	if(indexOffset+5+IO::SeekableFile::Offset(numEntries*17)+IO::SeekableFile::Offset(GridArchiver::trailerSize)!=fileSize)
+		return false;
+	index.resize(numEntries);
+	for(std::vector<GridArchiver::IndexEntry>::iterator iIt=index.begin();iIt!=index.end();++iIt)
+		{
+		iIt->timeStamp=file->read<Misc::Float64>();
+		iIt->offset=file->read<Misc::UInt64>();
+		iIt->keyframe=file->read<Misc::UInt8>()!=0;
+		}
+	
+	return true;
+	}
+
+void GridArchiveReader::scanIndex(void)
+	{
+	/* Read frame record headers until the end of the file or the first incomplete record: */
+	index.clear();
+	IO::SeekableFile::Offset fileSize=file->getSize();
+	IO::SeekableFile::Offset recordOffset=GridArchiver::headerSize;
+	while(recordOffset+13<=fileSize)
+		{
+		file->setReadPosAbs(recordOffset);
+		Misc::UInt8 recordType=file->read<Misc::UInt8>();
+		if(recordType!=GridArchiver::KEYFRAME&&recordType!=GridArchiver::DELTA_FRAME)
+			break;
+		GridArchiver::IndexEntry entry;
+		entry.timeStamp=file->read<Misc::Float64>();
+		entry.offset=recordOffset;
+		entry.keyframe=recordType==GridArchiver::KEYFRAME;
+		IO::SeekableFile::Offset frameSize=file->read<Misc::UInt32>();
+		if(recordOffset+13+frameSize>fileSize)
+			break;
+		index.push_back(entry);
+		recordOffset+=13+frameSize;
+		}
+	}
+
+void GridArchiveReader::decodeFrame(size_t frameIndex)
+	{
+	/* Read the frame record: */
+	file->setReadPosAbs(IO::SeekableFile::Offset(index[frameIndex].offset)+9);
+	size_t frameSize=file->read<Misc::UInt32>();
+	frameBuffer.resize(frameSize);
+	file->read(&frameBuffer.front(),frameSize);
+	
+	/* Decode the frame on top of the current grid pair: */
+	gridCodec->decode(&frameBuffer.front(),frameSize,&quantizedGrids.front());
+	currentFrame=frameIndex;
+	}
+
+GridArchiveReader::GridArchiveReader(const char* fileName)
+	:file(IO::openSeekableFile(fileName)),
+	 gridCodec(0),
+	 currentFrame(0)
+	{
+	/* Check the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	if(file->read<Misc::UInt32>()!=GridArchiver::fileTag)
+		throw std::runtime_error("GridArchiveReader: File is not a grid archive");
+	if(file->read<Misc::UInt32>()!=GridArchiver::fileVersion)
+		throw std::runtime_error("GridArchiveReader: Unsupported grid archive version");
+	
+	/* Read the water table layout and quantization range: */
+	for(int i=0;i<2;++i)
+		gridSize[i]=file->read<Misc::UInt32>();
+	for(int i=0;i<2;++i)
+		cellSize[i]=file->read<Misc::Float32>();
+	for(int i=0;i<2;++i)
+		elevationRange[i]=file->read<Misc::Float32>();
+	file->read<Misc::UInt32>(); // Keyframe interval is implied by the index
+	if(gridSize[0]<2||gridSize[1]<2)
+		throw std::runtime_error("GridArchiveReader: Invalid grid size in grid archive");
+	
+	/* Read the index, or reconstruct it if the archive was not closed properly: */
+	if(!readIndex())
+		{
+		std::cout<<"GridArchiveReader: Archive "<<fileName<<" has no index; scanning frame records"<<std::endl;
+		scanIndex();
+		}
+	if(index.empty()||!index.front().keyframe)
+		throw std::runtime_error("GridArchiveReader: Grid archive contains no frames");
+	
+	/* Create the grid pair decoder and mark the current grid pair as undefined: */
+	gridCodec=new GridCodec(gridSize);
+	quantizedGrids.resize(gridCodec->getNumValues(),0);
+	currentFrame=index.size();
+	}
+
+GridArchiveReader::~GridArchiveReader(void)
+	{
+	delete gridCodec;
+	}
+
+bool GridArchiveReader::seek(double time)
+	{
+	/* Find the last frame archived at or before the given time using binary search: */
+	size_t l=0;
+	size_t r=index.size();
+	while(r-l>1)
+		{
+		size_t m=(l+r)/2;
+		if(index[m].timeStamp<=time)
+			l=m;
+		else
+			r=m;
+		}
+	if(l==currentFrame)
+		return false;
+	
+	/* Find the keyframe from which to decode, or continue from the current frame if that is closer: */
+	size_t start=l;
+	while(!index[start].keyframe)
+		--start;
+	if(currentFrame<l&&currentFrame>=start)
+		start=currentFrame+1;
+	
+	/* Decode all frames up to the target frame: */
+	try
+		{
+		for(size_t frameIndex=start;frameIndex<=l;++frameIndex)
+			decodeFrame(frameIndex);
+		}
+	catch(const std::runtime_error&)
+		{
+		/* Mark the current grid pair as undefined and re-throw the exception: */
+		currentFrame=index.size();
+		throw;
+		}
+	
+	return true;
+	}
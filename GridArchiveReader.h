@@ -0,0 +1,96 @@
+/***********************************************************************
+GridArchiveReader - Class to read and scrub through bathymetry and water
+level grid archives written by GridArchiver.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDARCHIVEREADER_INCLUDED
+#define GRIDARCHIVEREADER_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <IO/SeekableFile.h>
+
+#include "GridArchiver.h"
+
+/* Forward declarations: */
+class GridCodec;
+
+class GridArchiveReader
+	{
+	/* Elements: */
+	private:
+	IO::SeekableFilePtr file; // The archive file
+	unsigned int gridSize[2]; // Width and height of the archived water table's cell-centered quantity grid
+	float cellSize[2]; // Width and height of each archived water table cell
+	float elevationRange[2]; // Elevation range to which the archived grids were quantized
+	std::vector<GridArchiver::IndexEntry> index; // Index of all frame records in the archive
+	GridCodec* gridCodec; // Codec to decode archived grid pairs
+	std::vector<Misc::UInt8> frameBuffer; // Buffer to read encoded frames
+	std::vector<Misc::UInt16> quantizedGrids; // Most recently decoded quantized grid pair
+	size_t currentFrame; // Index of the most recently decoded frame, or index.size() if no frame has been decoded yet
+	
+	/* Private methods: */
+	bool readIndex(void); // Reads the archive's index record via its trailer; returns false if the archive was not closed properly
+	void scanIndex(void); // Reconstructs the index by scanning all complete frame records
+	void decodeFrame(size_t frameIndex); // Decodes the given frame on top of the current grid pair
+	
+	/* Constructors and destructors: */
+	public:
+	GridArchiveReader(const char* fileName); // Opens the given grid archive; throws exception if the file is not a valid grid archive
+	private:
+	GridArchiveReader(const GridArchiveReader& source); // Prohibit copy constructor
+	GridArchiveReader& operator=(const GridArchiveReader& source); // Prohibit assignment operator
+	public:
+	~GridArchiveReader(void);
+	
+	/* Methods: */
+	const unsigned int* getGridSize(void) const // Returns the archived water table's grid size
+		{
+		return gridSize;
+		}
+	const float* getCellSize(void) const // Returns the archived water table's cell size
+		{
+		return cellSize;
+		}
+	const float* getElevationRange(void) const // Returns the archive's quantization elevation range
+		{
+		return elevationRange;
+		}
+	size_t getNumFrames(void) const // Returns the number of archived frames
+		{
+		return index.size();
+		}
+	double getStartTime(void) const // Returns the time stamp of the first archived frame
+		{
+		return index.front().timeStamp;
+		}
+	double getEndTime(void) const // Returns the time stamp of the last archived frame
+		{
+		return index.back().timeStamp;
+		}
+	bool seek(double time); // Decodes the last frame archived at or before the given time, or the first frame; returns true if the current grid pair changed
+	const Misc::UInt16* getQuantizedGrids(void) const // Returns the current quantized bathymetry grid followed by the current quantized water level grid
+		{
+		return &quantizedGrids.front();
+		}
+	};
+
+#endif
@@ -0,0 +1,227 @@
+/***********************************************************************
+GridArchiver - Class to append bathymetry and water level grid snapshots
+to a compressed, indexed time-series archive file in a background
+thread.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridArchiver.h"
+
+#include <stdexcept>
+#include <iostream>
+#include <IO/OpenFile.h>
+
+#include "WaterTable2.h"
+#include "GridReadback.h"
+#include "GridCodec.h"
+
+/*
+Archive layout: A 36-byte header holding the file tag and version, the
+water table's grid size and cell size, the quantization elevation
+range, and the keyframe interval, followed by frame records. Each frame
+record holds its record type, its time stamp, and the size-prefixed
+GridCodec frame. A closed archive ends with an index record listing all
+frame records and a trailer pointing to the index record; archives of
+crashed sessions lack both, and can be indexed by scanning.
+*/
+
+/*****************************
+Methods of class GridArchiver:
+*****************************/
+
+void GridArchiver::writeFrame(double timeStamp,const GLfloat* bathymetry,const GLfloat* waterLevel)
+	{
+	/* Quantize the corner-centered bathymetry grid followed by the cell-centered water level grid: */
+	GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
+	GLfloat eOffset=0.5f-elevationRange[0]*eScale;
+	size_t numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+	size_t numWaterLevelValues=size_t(gridSize[1])*size_t(gridSize[0]);
+	GridCodec::quantize(bathymetry,numBathymetryValues,eScale,eOffset,&quantizedGrids[0]);
+	GridCodec::quantize(waterLevel,numWaterLevelValues,eScale,eOffset,&quantizedGrids[numBathymetryValues]);
+	
+	/* Encode a keyframe at the start of each chunk of frames, and a delta frame otherwise: */
+	IndexEntry entry;
+	entry.timeStamp=timeStamp;
+	entry.offset=fileOffset;
+	entry.keyframe=index.size()%keyframeInterval==0;
+	gridCodec->encode(&quantizedGrids[0],entry.keyframe?0:&referenceGrids[0],encodedFrame);
+	
+	/* Append the frame record: */
+	file->write<Misc::UInt8>(entry.keyframe?KEYFRAME:DELTA_FRAME);
+	file->write<Misc::Float64>(timeStamp);
+	file->write<Misc::UInt32>(Misc::UInt32(encodedFrame.size()));
+	file->write<Misc::UInt8>(&encodedFrame[0],encodedFrame.size());
+	file->flush();
+	fileOffset+=13+encodedFrame.size();
+	index.push_back(entry);
+	
+	/* Keep the archived grid pair as reference for the next delta frame: */
+	quantizedGrids.swap(referenceGrids);
+	}
+
+void* GridArchiver::archiveThreadMethod(void)
+	{
+	unsigned int handledGeneration=0;
+	unsigned int writtenGeneration=0;
+	while(true)
+		{
+		double timeStamp;
+		{
+		Threads::MutexCond::Lock archiveLock(archiveCond);
+		
+		/* Wait until a new snapshot is published or the archiver shuts down: */
+		while(runArchiveThread&&notifiedGeneration==handledGeneration)
+			archiveCond.wait(archiveLock);
+		
+		/* Bail out once the last notified snapshot has been archived: */
+		if(notifiedGeneration==handledGeneration)
+			break;
+		
+		handledGeneration=notifiedGeneration;
+		timeStamp=notifiedTime;
+		}
+		
+		/* Archive the most recent snapshot unless it was already archived: */
+		const GridReadback::Snapshot* snapshot=gridReadback->acquireSnapshot();
+		if(snapshot!=0)
+			{
+			try
+				{
+				if(snapshot->getGeneration()!=writtenGeneration)
+					{
+					writtenGeneration=snapshot->getGeneration();
+					writeFrame(timeStamp,snapshot->getBathymetry(),snapshot->getWaterLevel());
+					}
+				}
+			catch(const std::runtime_error& err)
+				{
+				std::cerr<<"GridArchiver: Stopping archive due to exception "<<err.what()<<std::endl;
+				gridReadback->releaseSnapshot(snapshot);
+				break;
+				}
+			gridReadback->releaseSnapshot(snapshot);
+			}
+		}
+	
+	return 0;
+	}
+
+GridArchiver::GridArchiver(const char* fileName,const WaterTable2* waterTable,GridReadback* sGridReadback,double sArchiveInterval,unsigned int sKeyframeInterval)
+	:gridReadback(sGridReadback),
+	 file(IO::openFile(fileName,IO::File::WriteOnly)),
+	 fileOffset(0),
+	 archiveInterval(sArchiveInterval),keyframeInterval(sKeyframeInterval>0?sKeyframeInterval:1),
+	 nextArchiveTime(0.0),seenGeneration(0),
+	 notifiedGeneration(0),notifiedTime(0.0),
+	 runArchiveThread(true),
+	 gridCodec(0)
+	{
+	/* Retrieve the water table's grid size and elevation range, and add the same safety margin as the remote server: */
+	for(int i=0;i<2;++i)
+		gridSize[i]=waterTable->getSize()[i];
+	elevationRange[0]=waterTable->getDomain().min[2];
+	elevationRange[1]=waterTable->getDomain().max[2];
+	elevationRange[0]-=(elevationRange[1]-elevationRange[0])*0.05f;
+	elevationRange[1]+=(elevationRange[1]-elevationRange[0])*0.05f;
+	
+	/* Write the file header: */
+	file->setEndianness(Misc::LittleEndian);
+	file->write<Misc::UInt32>(fileTag);
+	file->write<Misc::UInt32>(fileVersion);
+	for(int i=0;i<2;++i)
+		file->write<Misc::UInt32>(gridSize[i]);
+	for(int i=0;i<2;++i)
+		file->write<Misc::Float32>(waterTable->getCellSize()[i]);
+	for(int i=0;i<2;++i)
+		file->write<Misc::Float32>(elevationRange[i]);
+	file->write<Misc::UInt32>(keyframeInterval);
+	fileOffset=headerSize;
+	
+	/* Create the grid pair codec and allocate the buffers for quantized grid pairs: */
+	unsigned int codecGridSize[2];
+	for(int i=0;i<2;++i)
+		codecGridSize[i]=gridSize[i];
+	gridCodec=new GridCodec(codecGridSize);
+	quantizedGrids.resize(gridCodec->getNumValues());
+	referenceGrids.resize(gridCodec->getNumValues());
+	
+	/* Start the background archive thread: */
+	archiveThread.start(this,&GridArchiver::archiveThreadMethod);
+	}
+
+GridArchiver::~GridArchiver(void)
+	{
+	/* Shut down the archive thread after it archived the last notified snapshot: */
+	{
+	Threads::MutexCond::Lock archiveLock(archiveCond);
+	runArchiveThread=false;
+	archiveCond.signal();
+	}
+	archiveThread.join();
+	
+	try
+		{
+		/* Write the index record and the trailer pointing to it: */
+		Misc::UInt64 indexOffset=fileOffset;
+		file->write<Misc::UInt8>(INDEX);
+		file->write<Misc::UInt32>(Misc::UInt32(index.size()));
+		for(std::vector<IndexEntry>::iterator iIt=index.begin();iIt!=index.end();++iIt)
+			{
+			file->write<Misc::Float64>(iIt->timeStamp);
+			file->write<Misc::UInt64>(iIt->offset);
+			file->write<Misc::UInt8>(iIt->keyframe?1:0);
+			}
+		file->write<Misc::UInt64>(indexOffset);
+		file->write<Misc::UInt32>(indexTag);
+		file->flush();
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"GridArchiver: Unable to write archive index due to exception "<<err.what()<<std::endl;
+		}
+	
+	std::cout<<"GridArchiver: Archived "<<index.size()<<" grid snapshots"<<std::endl;
+	
+	delete gridCodec;
+	}
+
+void GridArchiver::frame(double applicationTime)
+	{
+	/* Check if a new snapshot has been published, which might have been requested by another consumer: */
+	unsigned int generation=gridReadback->getSnapshotGeneration();
+	if(generation!=seenGeneration)
+		{
+		seenGeneration=generation;
+		
+		/* Wake up the archive thread only if the archive interval has passed since the last archived snapshot: */
+		if(applicationTime>=nextArchiveTime)
+			{
+			Threads::MutexCond::Lock archiveLock(archiveCond);
+			notifiedGeneration=generation;
+			notifiedTime=applicationTime;
+			archiveCond.signal();
+			
+			nextArchiveTime=applicationTime+archiveInterval;
+			}
+		}
+	
+	/* Request a new shared grid snapshot once the archive interval has passed; repeated requests are ignored while one is being read back: */
+	if(applicationTime>=nextArchiveTime)
+		gridReadback->requestSnapshot();
+	}
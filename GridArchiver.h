@@ -0,0 +1,104 @@
+/***********************************************************************
+GridArchiver - Class to append bathymetry and water level grid snapshots
+to a compressed, indexed time-series archive file in a background
+thread.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDARCHIVER_INCLUDED
+#define GRIDARCHIVER_INCLUDED
+
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <Threads/Thread.h>
+#include <Threads/MutexCond.h>
+#include <GL/gl.h>
+
+/* Forward declarations: */
+class WaterTable2;
+class GridReadback;
+class GridCodec;
+
+class GridArchiver
+	{
+	/* Embedded classes: */
+	public:
+	static const Misc::UInt32 fileTag=0x41444e53U; // Tag identifying grid archive files ("SNDA" in little-endian order)
+	static const Misc::UInt32 indexTag=0x49444e53U; // Tag identifying the trailer pointing to a grid archive's index ("SNDI" in little-endian order)
+	static const Misc::UInt32 fileVersion=1; // Current version of the grid archive file format
+	static const size_t headerSize=36; // Size of the file header in bytes
+	static const size_t trailerSize=12; // Size of the index trailer at the end of a closed archive in bytes
+	
+	enum RecordType // Enumerated type for records in a grid archive file
+		{
+		KEYFRAME=0, // Grid pair encoded relative to zero grids
+		DELTA_FRAME=1, // Grid pair encoded relative to the previous record's grid pair
+		INDEX=2 // Table of all frame records, written when the archive is closed
+		};
+	
+	struct IndexEntry // Structure describing one frame record in the archive
+		{
+		/* Elements: */
+		public:
+		double timeStamp; // Application time at which the frame's grids were read back
+		Misc::UInt64 offset; // Position of the frame record in the file
+		bool keyframe; // Flag whether the frame can be decoded without its predecessors
+		};
+	
+	/* Elements: */
+	private:
+	GridReadback* gridReadback; // Service reading back the water table's grids
+	GLsizei gridSize[2]; // Width and height of the water table's cell-centered quantity grid
+	GLfloat elevationRange[2]; // Elevation range to which grids are quantized
+	IO::FilePtr file; // The archive file
+	Misc::UInt64 fileOffset; // Number of bytes written to the archive file so far
+	double archiveInterval; // Minimum time interval between archived grid snapshots
+	unsigned int keyframeInterval; // Number of frames between keyframes
+	double nextArchiveTime; // Application time at or after which the next published grid snapshot is archived
+	unsigned int seenGeneration; // Generation of the most recent published snapshot noticed by the frame method, whether archived or not
+	Threads::MutexCond archiveCond; // Condition variable protecting the notification state and signaling new snapshots
+	unsigned int notifiedGeneration; // Generation of the most recent snapshot the archive thread was notified of
+	double notifiedTime; // Application time at which the most recent snapshot was noticed
+	volatile bool runArchiveThread; // Flag to keep the archive thread running
+	Threads::Thread archiveThread; // Background thread encoding and writing snapshots
+	GridCodec* gridCodec; // Codec to encode grid pairs; only accessed by the archive thread
+	std::vector<Misc::UInt16> quantizedGrids; // Quantized grid pair of the most recent snapshot
+	std::vector<Misc::UInt16> referenceGrids; // Quantized grid pair of the previously archived snapshot
+	std::vector<Misc::UInt8> encodedFrame; // Encoded frame of the most recent snapshot
+	std::vector<IndexEntry> index; // Index of all written frame records
+	
+	/* Private methods: */
+	void writeFrame(double timeStamp,const GLfloat* bathymetry,const GLfloat* waterLevel); // Quantizes, encodes, and appends the given grid pair
+	void* archiveThreadMethod(void); // Method for the background archive thread
+	
+	/* Constructors and destructors: */
+	public:
+	GridArchiver(const char* fileName,const WaterTable2* waterTable,GridReadback* sGridReadback,double sArchiveInterval,unsigned int sKeyframeInterval); // Creates an archive file for the given water table's grids, archived at the given interval with a keyframe every given number of frames
+	private:
+	GridArchiver(const GridArchiver& source); // Prohibit copy constructor
+	GridArchiver& operator=(const GridArchiver& source); // Prohibit assignment operator
+	public:
+	~GridArchiver(void); // Writes all pending snapshots and the archive index and closes the archive file
+	
+	/* Methods: */
+	void frame(double applicationTime); // Called from the AR Sandbox's frame method
+	};
+
+#endif
@@ -0,0 +1,266 @@
+/***********************************************************************
+GridCodec - Class to encode pairs of quantized bathymetry and water level
+grids as compact frames for streaming to remote clients, using temporal
+delta encoding against the previously sent grids, skipping of unchanged
+tiles, and zlib compression.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridCodec.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <zlib.h>
+
+/**************************
+Methods of class GridCodec:
+**************************/
+
+/*********************************************************************
+Frame layout: one flags byte, the payload's uncompressed size as a
+little-endian 32-bit integer, and the optionally deflated payload. The
+payload holds one bit per tile in both grids flagging changed tiles,
+followed by the low bytes and then the high bytes of the modular
+differences between new and reference values inside changed tiles, in
+tile order and row-major within each tile. Splitting the differences
+into byte planes puts the mostly zero high bytes next to each other,
+which makes them almost free to compress.
+*********************************************************************/
+
+GridCodec::GridCodec(const unsigned int gridSize[2])
+	:numValues(0),numTiles(0)
+	{
+	/* Set up the corner-centered bathymetry grid and the cell-centered water level grid: */
+	for(int g=0;g<2;++g)
+		{
+		Grid& grid=grids[g];
+		for(int i=0;i<2;++i)
+			{
+			grid.size[i]=g==0?gridSize[i]-1:gridSize[i];
+			grid.numTiles[i]=(grid.size[i]+tileSize-1)/tileSize;
+			}
+		grid.offset=numValues;
+		numValues+=size_t(grid.size[1])*size_t(grid.size[0]);
+		numTiles+=size_t(grid.numTiles[1])*size_t(grid.numTiles[0]);
+		}
+	maskSize=(numTiles+7)/8;
+	
+	/* Allocate the scratch buffers: */
+	payload.reserve(maskSize+numValues*sizeof(Value));
+	deltas.reserve(numValues);
+	}
+
+void GridCodec::quantize(const float* source,size_t numValues,float eScale,float eOffset,GridCodec::Value* dest)
+	{
+	/* Clamp with branch-free selects so the compiler can vectorize the loop: */
+	for(size_t i=0;i<numValues;++i)
+		{
+		float se=source[i]*eScale+eOffset;
+		se=se>0.0f?se:0.0f;
+		se=se<65535.0f?se:65535.0f;
+		dest[i]=Value(se);
+		}
+	}
+
+void GridCodec::encode(const GridCodec::Value* values,const GridCodec::Value* reference,std::vector<GridCodec::Byte>& frame)
+	{
+	encodeTiles(values,reference,0,0,frame);
+	}
+
+void GridCodec::encodeTiles(const GridCodec::Value* values,const GridCodec::Value* reference,const GridCodec::Byte* selectedTiles,const GridCodec::Byte* keyTiles,std::vector<GridCodec::Byte>& frame)
+	{
+	/* Collect the differences of all changed selected tiles and flag them in the tile mask: */
+	payload.assign(maskSize,Byte(0));
+	deltas.clear();
+	size_t tileIndex=0;
+	for(int g=0;g<2;++g)
+		{
+		const Grid& grid=grids[g];
+		const Value* gValues=values+grid.offset;
+		const Value* gReference=reference!=0?reference+grid.offset:0;
+		for(unsigned int ty=0;ty<grid.numTiles[1];++ty)
+			{
+			unsigned int y0=ty*tileSize;
+			unsigned int y1=y0+tileSize<grid.size[1]?y0+tileSize:grid.size[1];
+			for(unsigned int tx=0;tx<grid.numTiles[0];++tx,++tileIndex)
+				{
+				/* Treat unselected tiles as unchanged: */
+				if(selectedTiles!=0&&!testTile(selectedTiles,tileIndex))
+					continue;
+				
+				unsigned int x0=tx*tileSize;
+				unsigned int x1=x0+tileSize<grid.size[0]?x0+tileSize:grid.size[0];
+				
+				/* Append the tile's differences, or its values if it is a key tile, and retract them again if the tile did not change: */
+				size_t tileStart=deltas.size();
+				Value changed(0);
+				bool delta=gReference!=0&&(keyTiles==0||!testTile(keyTiles,tileIndex));
+				for(unsigned int y=y0;y<y1;++y)
+					{
+					const Value* vRow=gValues+size_t(y)*grid.size[0];
+					if(delta)
+						{
+						const Value* rRow=gReference+size_t(y)*grid.size[0];
+						for(unsigned int x=x0;x<x1;++x)
+							{
+							Value delta=Value(vRow[x]-rRow[x]);
+							changed|=delta;
+							deltas.push_back(delta);
+							}
+						}
+					else
+						{
+						for(unsigned int x=x0;x<x1;++x)
+							{
+							changed|=vRow[x];
+							deltas.push_back(vRow[x]);
+							}
+						}
+					}
+				if(changed!=0)
+					payload[tileIndex>>3]|=Byte(1U<<(tileIndex&0x7U));
+				else
+					deltas.resize(tileStart);
+				}
+			}
+		}
+	
+	/* Append the byte planes of the collected differences: */
+	size_t numDeltas=deltas.size();
+	payload.resize(maskSize+numDeltas*2);
+	Byte* lowPtr=&payload[maskSize];
+	Byte* highPtr=lowPtr+numDeltas;
+	for(size_t i=0;i<numDeltas;++i)
+		{
+		lowPtr[i]=Byte(deltas[i]&0xffU);
+		highPtr[i]=Byte(deltas[i]>>8);
+		}
+	
+	/* Write the frame header: */
+	uLong payloadSize=uLong(payload.size());
+	frame.resize(5+compressBound(payloadSize));
+	frame[0]=reference!=0?Byte(0):Byte(KEYFRAME);
+	for(int i=0;i<4;++i)
+		frame[1+i]=Byte((payloadSize>>(i*8))&0xffU);
+	
+	/* Deflate the payload with the fastest compression level, and store it verbatim if that does not pay off: */
+	uLongf compressedSize=uLongf(frame.size()-5);
+	if(compress2(&frame[5],&compressedSize,&payload[0],payloadSize,1)==Z_OK&&compressedSize<payloadSize)
+		{
+		frame[0]|=Byte(DEFLATED);
+		frame.resize(5+compressedSize);
+		}
+	else
+		{
+		memcpy(&frame[5],&payload[0],payloadSize);
+		frame.resize(5+payloadSize);
+		}
+	}
+
+void GridCodec::decode(const GridCodec::Byte* frame,size_t frameSize,GridCodec::Value* values)
+	{
+	decodeTiles(frame,frameSize,0,values);
+	}
+
+void GridCodec::decodeTiles(const GridCodec::Byte* frame,size_t frameSize,const GridCodec::Byte* keyTiles,GridCodec::Value* values)
+	{
+	/* Read the frame header: */
+	if(frameSize<5)
+		throw std::runtime_error("GridCodec::decode: Truncated frame header");
+	Byte flags=frame[0];
+	uLong payloadSize=0;
+	for(int i=0;i<4;++i)
+		payloadSize|=uLong(frame[1+i])<<(i*8);
+	if(payloadSize<maskSize||(payloadSize-maskSize)%2!=0||payloadSize>maskSize+numValues*2)
+		throw std::runtime_error("GridCodec::decode: Invalid payload size");
+	
+	/* Retrieve the uncompressed payload: */
+	payload.resize(payloadSize);
+	if(flags&DEFLATED)
+		{
+		uLongf uncompressedSize=payloadSize;
+		if(uncompress(&payload[0],&uncompressedSize,frame+5,uLong(frameSize-5))!=Z_OK||uncompressedSize!=payloadSize)
+			throw std::runtime_error("GridCodec::decode: Corrupted compressed payload");
+		}
+	else
+		{
+		if(frameSize-5!=payloadSize)
+			throw std::runtime_error("GridCodec::decode: Truncated payload");
+		memcpy(&payload[0],frame+5,payloadSize);
+		}
+	
+	/* Keyframes replace the previous grids, and key tiles replace the previous tiles: */
+	if(flags&KEYFRAME)
+		memset(values,0,numValues*sizeof(Value));
+	else if(keyTiles!=0)
+		{
+		size_t tileIndex=0;
+		for(int g=0;g<2;++g)
+			{
+			const Grid& grid=grids[g];
+			Value* gValues=values+grid.offset;
+			for(unsigned int ty=0;ty<grid.numTiles[1];++ty)
+				{
+				unsigned int y0=ty*tileSize;
+				unsigned int y1=y0+tileSize<grid.size[1]?y0+tileSize:grid.size[1];
+				for(unsigned int tx=0;tx<grid.numTiles[0];++tx,++tileIndex)
+					if(testTile(keyTiles,tileIndex))
+						{
+						unsigned int x0=tx*tileSize;
+						unsigned int x1=x0+tileSize<grid.size[0]?x0+tileSize:grid.size[0];
+						for(unsigned int y=y0;y<y1;++y)
+							memset(gValues+size_t(y)*grid.size[0]+x0,0,size_t(x1-x0)*sizeof(Value));
+						}
+				}
+			}
+		}
+	
+	/* Apply the differences of all changed tiles: */
+	size_t numDeltas=(payloadSize-maskSize)/2;
+	const Byte* lowPtr=&payload[0]+maskSize;
+	const Byte* highPtr=lowPtr+numDeltas;
+	size_t deltaIndex=0;
+	size_t tileIndex=0;
+	for(int g=0;g<2;++g)
+		{
+		const Grid& grid=grids[g];
+		Value* gValues=values+grid.offset;
+		for(unsigned int ty=0;ty<grid.numTiles[1];++ty)
+			{
+			unsigned int y0=ty*tileSize;
+			unsigned int y1=y0+tileSize<grid.size[1]?y0+tileSize:grid.size[1];
+			for(unsigned int tx=0;tx<grid.numTiles[0];++tx,++tileIndex)
+				if(testTile(&payload[0],tileIndex))
+					{
+					unsigned int x0=tx*tileSize;
+					unsigned int x1=x0+tileSize<grid.size[0]?x0+tileSize:grid.size[0];
+					if(deltaIndex+size_t(y1-y0)*size_t(x1-x0)>numDeltas)
+						throw std::runtime_error("GridCodec::decode: Tile mask does not match payload");
+					for(unsigned int y=y0;y<y1;++y)
+						{
+						Value* vRow=gValues+size_t(y)*grid.size[0];
+						for(unsigned int x=x0;x<x1;++x,++deltaIndex)
+							vRow[x]=Value(vRow[x]+(Value(lowPtr[deltaIndex])|(Value(highPtr[deltaIndex])<<8)));
+						}
+					}
+			}
+		}
+	if(deltaIndex!=numDeltas)
+		throw std::runtime_error("GridCodec::decode: Tile mask does not match payload");
+	}
@@ -0,0 +1,96 @@
+/***********************************************************************
+GridCodec - Class to encode pairs of quantized bathymetry and water level
+grids as compact frames for streaming to remote clients, using temporal
+delta encoding against the previously sent grids, skipping of unchanged
+tiles, and zlib compression.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDCODEC_INCLUDED
+#define GRIDCODEC_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+
+class GridCodec
+	{
+	/* Embedded classes: */
+	public:
+	typedef Misc::UInt16 Value; // Type for quantized grid values
+	typedef Misc::UInt8 Byte; // Type for encoded frame data
+	
+	static const unsigned int protocolVersion=2; // Highest version of the streaming protocol supported by this codec; version 2 adds view-dependent level-of-detail streaming
+	static const unsigned int tileSize=16; // Width and height of tiles that are skipped if unchanged
+	
+	private:
+	struct Grid // Structure describing the tiling of one grid
+		{
+		/* Elements: */
+		public:
+		unsigned int size[2]; // Width and height of the grid
+		unsigned int numTiles[2]; // Number of tiles in x and y
+		size_t offset; // Offset of the grid's first value in a grid pair
+		};
+	
+	enum FrameFlags // Enumerated type for bits in a frame's flags byte
+		{
+		KEYFRAME=0x1, // Frame encodes the grids relative to zero instead of the previous grids
+		DEFLATED=0x2 // Frame payload is zlib-compressed
+		};
+	
+	/* Elements: */
+	Grid grids[2]; // Tilings of the bathymetry and water level grids
+	size_t numValues; // Total number of values in a grid pair
+	size_t numTiles; // Total number of tiles in a grid pair
+	size_t maskSize; // Size of the tile change mask in bytes
+	std::vector<Byte> payload; // Scratch buffer for uncompressed frame payloads
+	std::vector<Value> deltas; // Scratch buffer for delta values of changed tiles
+	
+	/* Private methods: */
+	static bool testTile(const Byte* tileMask,size_t tileIndex) // Returns true if the given tile is set in the given tile mask
+		{
+		return (tileMask[tileIndex>>3]&(1U<<(tileIndex&0x7U)))!=0;
+		}
+	
+	/* Constructors and destructors: */
+	public:
+	GridCodec(const unsigned int gridSize[2]); // Creates a codec for the corner-centered bathymetry and cell-centered water level grids of a water table of the given cell-centered grid size
+	
+	/* Methods: */
+	size_t getNumValues(void) const // Returns the total number of values in a bathymetry and water level grid pair
+		{
+		return numValues;
+		}
+	size_t getNumTiles(void) const // Returns the total number of tiles in a grid pair, bathymetry tiles first, each grid's tiles in row-major order
+		{
+		return numTiles;
+		}
+	size_t getMaskSize(void) const // Returns the size of a tile mask holding one bit per tile, in bytes
+		{
+		return maskSize;
+		}
+	static void quantize(const float* source,size_t numValues,float eScale,float eOffset,Value* dest); // Quantizes the given elevations with the given scale and offset, clamping to the value range
+	void encode(const Value* values,const Value* reference,std::vector<Byte>& frame); // Encodes the given grid pair relative to the given reference grid pair, or as a keyframe if reference is null, into the given frame buffer
+	void encodeTiles(const Value* values,const Value* reference,const Byte* selectedTiles,const Byte* keyTiles,std::vector<Byte>& frame); // Ditto, but only encodes tiles set in the given tile mask, or all tiles if null, and encodes tiles set in the given key tile mask relative to zero
+	void decode(const Byte* frame,size_t frameSize,Value* values); // Decodes the given frame on top of the given grid pair, which must hold the previously decoded grids; throws exception on malformed frames
+	void decodeTiles(const Byte* frame,size_t frameSize,const Byte* keyTiles,Value* values); // Ditto, but first clears all tiles set in the given key tile mask, or none if null
+	};
+
+#endif
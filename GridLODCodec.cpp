@@ -0,0 +1,249 @@
+/***********************************************************************
+GridLODCodec - Class to encode pairs of quantized bathymetry and water
+level grids as view-dependent level-of-detail messages for streaming to
+remote clients, consisting of a coarse base layer covering the entire
+water table and full-resolution tiles inside a client's region of
+interest.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridLODCodec.h"
+
+#include <string.h>
+#include <stdexcept>
+#include <Math/Math.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void writeSize(size_t size,GridCodec::Byte* dest)
+	{
+	for(int i=0;i<4;++i)
+		dest[i]=GridCodec::Byte((size>>(i*8))&0xffU);
+	}
+
+size_t readSize(const GridCodec::Byte* source)
+	{
+	size_t result=0;
+	for(int i=0;i<4;++i)
+		result|=size_t(source[i])<<(i*8);
+	return result;
+	}
+
+}
+
+/*****************************
+Methods of class GridLODCodec:
+*****************************/
+
+/*********************************************************************
+Message layout: the encoded base layer's size as a little-endian
+32-bit integer, the base layer encoded as a regular grid frame, a mask
+with one bit per full-resolution tile flagging the tiles inside the
+detail region, a mask flagging the detail tiles that are encoded
+relative to zero instead of the previous grids because the receiver
+did not hold them at full resolution before, and the detail tiles
+encoded as a grid frame. All tiles outside the detail region are
+interpolated from the base layer by the receiver.
+*********************************************************************/
+
+void GridLODCodec::upsampleTile(const GridLODCodec::Grid& grid,const GridLODCodec::Value* baseValues,GridLODCodec::Value* values,unsigned int tx,unsigned int ty) const
+	{
+	const Value* gBase=baseValues+grid.baseOffset;
+	Value* gValues=values+grid.offset;
+	unsigned int x0=tx*GridCodec::tileSize;
+	unsigned int x1=x0+GridCodec::tileSize<grid.size[0]?x0+GridCodec::tileSize:grid.size[0];
+	unsigned int y0=ty*GridCodec::tileSize;
+	unsigned int y1=y0+GridCodec::tileSize<grid.size[1]?y0+GridCodec::tileSize:grid.size[1];
+	for(unsigned int y=y0;y<y1;++y)
+		{
+		/* Find the pair of base layer rows bracketing the grid row: */
+		float by=float(y)*grid.baseScale[1];
+		unsigned int by0=(unsigned int)(by);
+		if(by0>grid.baseSize[1]-1)
+			by0=grid.baseSize[1]-1;
+		unsigned int by1=by0+1<grid.baseSize[1]?by0+1:by0;
+		float wy=by-float(by0);
+		const Value* row0=gBase+size_t(by0)*grid.baseSize[0];
+		const Value* row1=gBase+size_t(by1)*grid.baseSize[0];
+		
+		Value* vRow=gValues+size_t(y)*grid.size[0];
+		for(unsigned int x=x0;x<x1;++x)
+			{
+			/* Find the pair of base layer columns bracketing the grid column: */
+			float bx=float(x)*grid.baseScale[0];
+			unsigned int bx0=(unsigned int)(bx);
+			if(bx0>grid.baseSize[0]-1)
+				bx0=grid.baseSize[0]-1;
+			unsigned int bx1=bx0+1<grid.baseSize[0]?bx0+1:bx0;
+			float wx=bx-float(bx0);
+			
+			/* Interpolate bilinearly: */
+			float v0=float(row0[bx0])*(1.0f-wx)+float(row0[bx1])*wx;
+			float v1=float(row1[bx0])*(1.0f-wx)+float(row1[bx1])*wx;
+			vRow[x]=Value(v0*(1.0f-wy)+v1*wy+0.5f);
+			}
+		}
+	}
+
+GridLODCodec::GridLODCodec(const unsigned int gridSize[2],unsigned int sBaseFactor)
+	:baseFactor(sBaseFactor>0?sBaseFactor:1),
+	 detailCodec(gridSize),
+	 baseCodec(0)
+	{
+	/* Calculate the base layer's size such that it keeps at least one bathymetry vertex in each direction: */
+	unsigned int baseGridSize[2];
+	for(int i=0;i<2;++i)
+		{
+		baseGridSize[i]=(gridSize[i]+baseFactor-1)/baseFactor;
+		if(baseGridSize[i]<2)
+			baseGridSize[i]=2;
+		}
+	baseCodec=new GridCodec(baseGridSize);
+	
+	/* Set up the corner-centered bathymetry grid and the cell-centered water level grid: */
+	size_t offset=0;
+	size_t baseOffset=0;
+	size_t numTiles=0;
+	for(int g=0;g<2;++g)
+		{
+		Grid& grid=grids[g];
+		for(int i=0;i<2;++i)
+			{
+			grid.size[i]=g==0?gridSize[i]-1:gridSize[i];
+			grid.numTiles[i]=(grid.size[i]+GridCodec::tileSize-1)/GridCodec::tileSize;
+			grid.baseSize[i]=g==0?baseGridSize[i]-1:baseGridSize[i];
+			
+			/* Map the first and last grid lines onto the first and last base layer grid lines: */
+			grid.baseScale[i]=grid.size[i]>1?float(grid.baseSize[i]-1)/float(grid.size[i]-1):0.0f;
+			}
+		grid.offset=offset;
+		offset+=size_t(grid.size[1])*size_t(grid.size[0]);
+		grid.baseOffset=baseOffset;
+		baseOffset+=size_t(grid.baseSize[1])*size_t(grid.baseSize[0]);
+		numTiles+=size_t(grid.numTiles[1])*size_t(grid.numTiles[0]);
+		}
+	
+	/* Calculate the centers of all tiles in water table cell units; bathymetry vertices sit on cell corners, water levels on cell centers: */
+	tileCenters.reserve(numTiles*2);
+	for(int g=0;g<2;++g)
+		{
+		const Grid& grid=grids[g];
+		float origin=g==0?1.0f:0.5f;
+		for(unsigned int ty=0;ty<grid.numTiles[1];++ty)
+			{
+			unsigned int y0=ty*GridCodec::tileSize;
+			unsigned int y1=y0+GridCodec::tileSize<grid.size[1]?y0+GridCodec::tileSize:grid.size[1];
+			for(unsigned int tx=0;tx<grid.numTiles[0];++tx)
+				{
+				unsigned int x0=tx*GridCodec::tileSize;
+				unsigned int x1=x0+GridCodec::tileSize<grid.size[0]?x0+GridCodec::tileSize:grid.size[0];
+				tileCenters.push_back(origin+float(x0+x1-1)*0.5f);
+				tileCenters.push_back(origin+float(y0+y1-1)*0.5f);
+				}
+			}
+		}
+	tileRadius=float(GridCodec::tileSize)*Math::sqrt(0.5f);
+	}
+
+GridLODCodec::~GridLODCodec(void)
+	{
+	delete baseCodec;
+	}
+
+void GridLODCodec::downsample(const GridLODCodec::Value* values,GridLODCodec::Value* baseValues) const
+	{
+	for(int g=0;g<2;++g)
+		{
+		const Grid& grid=grids[g];
+		const Value* gValues=values+grid.offset;
+		Value* bPtr=baseValues+grid.baseOffset;
+		
+		/* Sample the grid at the full-resolution grid point closest to each base layer grid point: */
+		for(unsigned int by=0;by<grid.baseSize[1];++by)
+			{
+			unsigned int y=grid.baseSize[1]>1?(by*(grid.size[1]-1)+(grid.baseSize[1]-1)/2)/(grid.baseSize[1]-1):0;
+			const Value* vRow=gValues+size_t(y)*grid.size[0];
+			for(unsigned int bx=0;bx<grid.baseSize[0];++bx,++bPtr)
+				{
+				unsigned int x=grid.baseSize[0]>1?(bx*(grid.size[0]-1)+(grid.baseSize[0]-1)/2)/(grid.baseSize[0]-1):0;
+				*bPtr=vRow[x];
+				}
+			}
+		}
+	}
+
+void GridLODCodec::encodeBase(const GridLODCodec::Value* baseValues,const GridLODCodec::Value* baseReference,std::vector<GridLODCodec::Byte>& baseFrame)
+	{
+	baseCodec->encode(baseValues,baseReference,baseFrame);
+	}
+
+void GridLODCodec::encodeMessage(const std::vector<GridLODCodec::Byte>& baseFrame,const GridLODCodec::Value* values,const GridLODCodec::Value* reference,const GridLODCodec::Byte* detailTiles,const GridLODCodec::Byte* keyTiles,std::vector<GridLODCodec::Byte>& message)
+	{
+	/* Encode the detail tiles: */
+	detailCodec.encodeTiles(values,reference,detailTiles,keyTiles,detailFrame);
+	
+	/* Assemble the message: */
+	size_t maskSize=detailCodec.getMaskSize();
+	message.resize(4+baseFrame.size()+maskSize*2+detailFrame.size());
+	Byte* mPtr=&message[0];
+	writeSize(baseFrame.size(),mPtr);
+	mPtr+=4;
+	memcpy(mPtr,&baseFrame[0],baseFrame.size());
+	mPtr+=baseFrame.size();
+	memcpy(mPtr,detailTiles,maskSize);
+	mPtr+=maskSize;
+	memcpy(mPtr,keyTiles,maskSize);
+	mPtr+=maskSize;
+	memcpy(mPtr,&detailFrame[0],detailFrame.size());
+	}
+
+void GridLODCodec::decode(const GridLODCodec::Byte* message,size_t messageSize,GridLODCodec::Value* baseValues,GridLODCodec::Value* values)
+	{
+	/* Decode the base layer: */
+	if(messageSize<4)
+		throw std::runtime_error("GridLODCodec::decode: Truncated message header");
+	size_t baseFrameSize=readSize(message);
+	size_t maskSize=detailCodec.getMaskSize();
+	if(baseFrameSize>messageSize-4||messageSize-4-baseFrameSize<maskSize*2)
+		throw std::runtime_error("GridLODCodec::decode: Truncated message");
+	const Byte* mPtr=message+4;
+	baseCodec->decode(mPtr,baseFrameSize,baseValues);
+	mPtr+=baseFrameSize;
+	
+	/* Decode the detail tiles: */
+	const Byte* detailTiles=mPtr;
+	const Byte* keyTiles=mPtr+maskSize;
+	mPtr+=maskSize*2;
+	detailCodec.decodeTiles(mPtr,messageSize-size_t(mPtr-message),keyTiles,values);
+	
+	/* Fill all tiles outside the detail region from the base layer: */
+	size_t tileIndex=0;
+	for(int g=0;g<2;++g)
+		{
+		const Grid& grid=grids[g];
+		for(unsigned int ty=0;ty<grid.numTiles[1];++ty)
+			for(unsigned int tx=0;tx<grid.numTiles[0];++tx,++tileIndex)
+				if((detailTiles[tileIndex>>3]&(1U<<(tileIndex&0x7U)))==0)
+					upsampleTile(grid,baseValues,values,tx,ty);
+		}
+	}
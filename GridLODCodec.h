@@ -0,0 +1,110 @@
+/***********************************************************************
+GridLODCodec - Class to encode pairs of quantized bathymetry and water
+level grids as view-dependent level-of-detail messages for streaming to
+remote clients, consisting of a coarse base layer covering the entire
+water table and full-resolution tiles inside a client's region of
+interest.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDLODCODEC_INCLUDED
+#define GRIDLODCODEC_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+
+#include "GridCodec.h"
+
+class GridLODCodec
+	{
+	/* Embedded classes: */
+	public:
+	typedef GridCodec::Value Value; // Type for quantized grid values
+	typedef GridCodec::Byte Byte; // Type for encoded message data
+	
+	private:
+	struct Grid // Structure describing one full-resolution grid and its base layer
+		{
+		/* Elements: */
+		public:
+		unsigned int size[2]; // Width and height of the full-resolution grid
+		unsigned int numTiles[2]; // Number of full-resolution tiles in x and y
+		size_t offset; // Offset of the grid's first value in a full-resolution grid pair
+		unsigned int baseSize[2]; // Width and height of the grid's base layer
+		size_t baseOffset; // Offset of the base layer's first value in a base layer grid pair
+		float baseScale[2]; // Scale factors from full-resolution grid indices to base layer grid indices
+		};
+	
+	/* Elements: */
+	unsigned int baseFactor; // Ratio between the full-resolution grid size and the base layer grid size
+	Grid grids[2]; // Layouts of the bathymetry and water level grids
+	GridCodec detailCodec; // Codec for full-resolution grid pairs
+	GridCodec* baseCodec; // Codec for base layer grid pairs
+	std::vector<float> tileCenters; // Centers of all full-resolution tiles in water table cell units, interleaved x and y
+	float tileRadius; // Radius of a full-resolution tile's bounding circle in water table cell units
+	std::vector<Byte> detailFrame; // Scratch buffer for encoded full-resolution tiles
+	
+	/* Private methods: */
+	void upsampleTile(const Grid& grid,const Value* baseValues,Value* values,unsigned int tx,unsigned int ty) const; // Fills the given full-resolution tile by interpolating the given base layer
+	
+	/* Constructors and destructors: */
+	public:
+	GridLODCodec(const unsigned int gridSize[2],unsigned int sBaseFactor); // Creates a codec for the grids of a water table of the given cell-centered grid size and a base layer reduced in resolution by the given factor
+	private:
+	GridLODCodec(const GridLODCodec& source); // Prohibit copy constructor
+	GridLODCodec& operator=(const GridLODCodec& source); // Prohibit assignment operator
+	public:
+	~GridLODCodec(void);
+	
+	/* Methods: */
+	unsigned int getBaseFactor(void) const // Returns the base layer's resolution reduction factor
+		{
+		return baseFactor;
+		}
+	size_t getNumValues(void) const // Returns the total number of values in a full-resolution grid pair
+		{
+		return detailCodec.getNumValues();
+		}
+	size_t getNumBaseValues(void) const // Returns the total number of values in a base layer grid pair
+		{
+		return baseCodec->getNumValues();
+		}
+	size_t getNumTiles(void) const // Returns the total number of full-resolution tiles
+		{
+		return detailCodec.getNumTiles();
+		}
+	size_t getMaskSize(void) const // Returns the size of a full-resolution tile mask in bytes
+		{
+		return detailCodec.getMaskSize();
+		}
+	const float* getTileCenter(size_t tileIndex) const // Returns the center of the given full-resolution tile in water table cell units
+		{
+		return &tileCenters[tileIndex*2];
+		}
+	float getTileRadius(void) const // Returns the radius of a full-resolution tile's bounding circle in water table cell units
+		{
+		return tileRadius;
+		}
+	void downsample(const Value* values,Value* baseValues) const; // Samples the given full-resolution grid pair into the given base layer grid pair
+	void encodeBase(const Value* baseValues,const Value* baseReference,std::vector<Byte>& baseFrame); // Encodes the given base layer grid pair relative to the given reference base layer, or as a keyframe if reference is null
+	void encodeMessage(const std::vector<Byte>& baseFrame,const Value* values,const Value* reference,const Byte* detailTiles,const Byte* keyTiles,std::vector<Byte>& message); // Combines the given encoded base layer with the given full-resolution grid pair's tiles set in the given detail tile mask, encoded relative to the given reference grid pair except for tiles set in the given key tile mask
+	void decode(const Byte* message,size_t messageSize,Value* baseValues,Value* values); // Decodes the given message on top of the given base layer and full-resolution grid pairs, which must hold the previously decoded grids, and fills all tiles outside the message's detail region from the base layer; throws exception on malformed messages
+	};
+
+#endif
@@ -0,0 +1,354 @@
+/***********************************************************************
+GridReadback - Class to read back bathymetry and water level grids from
+a water table asynchronously and distribute them to any number of
+requesters.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "GridReadback.h"
+
+#include <string.h>
+#include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <GL/Extensions/GLARBVertexBufferObject.h>
+#include <GL/GLContextData.h>
+
+#include "WaterTable2.h"
+
+/***************************************
+Methods of class GridReadback::DataItem:
+***************************************/
+
+GridReadback::DataItem::DataItem(void)
+	:nextBatch(0)
+	{
+	for(unsigned int i=0;i<numBatches;++i)
+		{
+		batches[i].bathymetryBuffer=0;
+		batches[i].waterLevelBuffer=0;
+		batches[i].haveBathymetry=false;
+		batches[i].haveWaterLevel=false;
+		batches[i].fence=0;
+		}
+	
+	/* Initialize all required OpenGL extensions: */
+	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
+	GLARBSync::initExtension();
+	GLARBTextureRectangle::initExtension();
+	GLARBVertexBufferObject::initExtension();
+	}
+
+GridReadback::DataItem::~DataItem(void)
+	{
+	/* Delete all allocated buffers and fences: */
+	for(unsigned int i=0;i<numBatches;++i)
+		{
+		glDeleteBuffersARB(1,&batches[i].bathymetryBuffer);
+		glDeleteBuffersARB(1,&batches[i].waterLevelBuffer);
+		if(batches[i].fence!=0)
+			glDeleteSync(batches[i].fence);
+		}
+	}
+
+/***************************************
+Methods of class GridReadback::Snapshot:
+***************************************/
+
+GridReadback::Snapshot::Snapshot(const GLsizei bathymetrySize[2],const GLsizei waterLevelSize[2])
+	:refCount(0)
+	{
+	/* Allocate the grids: */
+	bathymetry=new GLfloat[size_t(bathymetrySize[1])*size_t(bathymetrySize[0])];
+	waterLevel=new GLfloat[size_t(waterLevelSize[1])*size_t(waterLevelSize[0])];
+	}
+
+GridReadback::Snapshot::~Snapshot(void)
+	{
+	delete[] bathymetry;
+	delete[] waterLevel;
+	}
+
+/*****************************
+Methods of class GridReadback:
+*****************************/
+
+void GridReadback::completeBatch(GridReadback::DataItem* dataItem,unsigned int batchIndex)
+	{
+	Batch& batch=dataItem->batches[batchIndex];
+	
+	/* Keep requesters from cancelling until their buffers have been written and they have been notified: */
+	Threads::Mutex::Lock completionLock(completionMutex);
+	
+	/* Take all requests served by the batch out of the request list: */
+	std::vector<Request> completed;
+	{
+	Threads::Mutex::Lock requestLock(requestMutex);
+	std::vector<Request>::iterator keepIt=requests.begin();
+	for(std::vector<Request>::iterator rIt=requests.begin();rIt!=requests.end();++rIt)
+		{
+		if(rIt->owner==dataItem&&rIt->batch==batchIndex)
+			completed.push_back(*rIt);
+		else
+			*(keepIt++)=*rIt;
+		}
+	requests.erase(keepIt,requests.end());
+	}
+	
+	/* Copy the read-back grids into all requesters' buffers: */
+	if(batch.haveBathymetry)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.bathymetryBuffer);
+		const GLfloat* grid=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(grid!=0)
+			{
+			size_t gridSize=size_t(bathymetrySize[1])*size_t(bathymetrySize[0])*sizeof(GLfloat);
+			for(std::vector<Request>::iterator rIt=completed.begin();rIt!=completed.end();++rIt)
+				if(rIt->bathymetryBuffer!=0)
+					memcpy(rIt->bathymetryBuffer,grid,gridSize);
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		}
+	if(batch.haveWaterLevel)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.waterLevelBuffer);
+		const GLfloat* grid=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(grid!=0)
+			{
+			size_t gridSize=size_t(waterLevelSize[1])*size_t(waterLevelSize[0])*sizeof(GLfloat);
+			for(std::vector<Request>::iterator rIt=completed.begin();rIt!=completed.end();++rIt)
+				if(rIt->waterLevelBuffer!=0)
+					memcpy(rIt->waterLevelBuffer,grid,gridSize);
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	
+	/* Retire the batch: */
+	glDeleteSync(batch.fence);
+	batch.fence=0;
+	
+	/* Notify all requesters: */
+	for(std::vector<Request>::iterator rIt=completed.begin();rIt!=completed.end();++rIt)
+		(*rIt->callback)(rIt->bathymetryBuffer,rIt->waterLevelBuffer,rIt->callbackData);
+	}
+
+void GridReadback::snapshotCallback(GLfloat*,GLfloat*,void* userData)
+	{
+	GridReadback* thisPtr=static_cast<GridReadback*>(userData);
+	
+	/* Publish the completed snapshot, which inherits the pending readback's reference: */
+	Threads::Mutex::Lock snapshotLock(thisPtr->snapshotMutex);
+	Snapshot* snapshot=thisPtr->pendingSnapshot;
+	thisPtr->pendingSnapshot=0;
+	snapshot->generation=++thisPtr->snapshotGeneration;
+	if(thisPtr->currentSnapshot!=0)
+		--thisPtr->currentSnapshot->refCount;
+	thisPtr->currentSnapshot=snapshot;
+	}
+
+GridReadback::GridReadback(const WaterTable2* sWaterTable)
+	:waterTable(sWaterTable),
+	 currentSnapshot(0),pendingSnapshot(0),snapshotGeneration(0)
+	{
+	/* Retrieve the water table's grid sizes: */
+	for(int i=0;i<2;++i)
+		{
+		bathymetrySize[i]=waterTable->getBathymetrySize(i);
+		waterLevelSize[i]=waterTable->getSize()[i];
+		}
+	}
+
+GridReadback::~GridReadback(void)
+	{
+	/* Delete all snapshots: */
+	for(std::vector<Snapshot*>::iterator sIt=snapshots.begin();sIt!=snapshots.end();++sIt)
+		delete *sIt;
+	}
+
+void GridReadback::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	
+	/* Create the readback pixel buffers: */
+	for(unsigned int i=0;i<DataItem::numBatches;++i)
+		{
+		Batch& batch=dataItem->batches[i];
+		glGenBuffersARB(1,&batch.bathymetryBuffer);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.bathymetryBuffer);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,size_t(bathymetrySize[1])*size_t(bathymetrySize[0])*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+		glGenBuffersARB(1,&batch.waterLevelBuffer);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.waterLevelBuffer);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,size_t(waterLevelSize[1])*size_t(waterLevelSize[0])*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+
+bool GridReadback::requestGrids(GLfloat* newBathymetryBuffer,GLfloat* newWaterLevelBuffer,GridReadback::CallbackFunction newCallback,void* newCallbackData)
+	{
+	Threads::Mutex::Lock requestLock(requestMutex);
+	
+	/* Deny the request if the requester is still waiting for a previous one: */
+	for(std::vector<Request>::iterator rIt=requests.begin();rIt!=requests.end();++rIt)
+		if(rIt->callback==newCallback&&rIt->callbackData==newCallbackData)
+			return false;
+	
+	/* Queue the request: */
+	Request newRequest;
+	newRequest.bathymetryBuffer=newBathymetryBuffer;
+	newRequest.waterLevelBuffer=newWaterLevelBuffer;
+	newRequest.callback=newCallback;
+	newRequest.callbackData=newCallbackData;
+	newRequest.owner=0;
+	newRequest.batch=0;
+	requests.push_back(newRequest);
+	
+	return true;
+	}
+
+void GridReadback::cancelRequests(void* callbackData)
+	{
+	/* Wait until any batch completion copying into the requester's buffers has finished: */
+	Threads::Mutex::Lock completionLock(completionMutex);
+	Threads::Mutex::Lock requestLock(requestMutex);
+	
+	/* Remove all of the requester's requests; their batches will still complete, but not write into the requester's buffers: */
+	std::vector<Request>::iterator keepIt=requests.begin();
+	for(std::vector<Request>::iterator rIt=requests.begin();rIt!=requests.end();++rIt)
+		if(rIt->callbackData!=callbackData)
+			*(keepIt++)=*rIt;
+	requests.erase(keepIt,requests.end());
+	}
+
+void GridReadback::requestSnapshot(void)
+	{
+	Snapshot* snapshot=0;
+	{
+	Threads::Mutex::Lock snapshotLock(snapshotMutex);
+	
+	/* Bail out if a snapshot is already being read back: */
+	if(pendingSnapshot!=0)
+		return;
+	
+	/* Find a snapshot that is no longer held by anyone, or allocate a new one: */
+	for(std::vector<Snapshot*>::iterator sIt=snapshots.begin();sIt!=snapshots.end()&&snapshot==0;++sIt)
+		if((*sIt)->refCount==0)
+			snapshot=*sIt;
+	if(snapshot==0)
+		{
+		snapshot=new Snapshot(bathymetrySize,waterLevelSize);
+		snapshots.push_back(snapshot);
+		}
+	
+	/* Hold the snapshot until its readback completes: */
+	++snapshot->refCount;
+	pendingSnapshot=snapshot;
+	}
+	
+	/* Request both grids into the snapshot: */
+	requestGrids(snapshot->bathymetry,snapshot->waterLevel,&GridReadback::snapshotCallback,this);
+	}
+
+unsigned int GridReadback::getSnapshotGeneration(void)
+	{
+	Threads::Mutex::Lock snapshotLock(snapshotMutex);
+	return snapshotGeneration;
+	}
+
+const GridReadback::Snapshot* GridReadback::acquireSnapshot(void)
+	{
+	Threads::Mutex::Lock snapshotLock(snapshotMutex);
+	if(currentSnapshot!=0)
+		++currentSnapshot->refCount;
+	return currentSnapshot;
+	}
+
+void GridReadback::releaseSnapshot(const GridSource::Snapshot* snapshot)
+	{
+	Threads::Mutex::Lock snapshotLock(snapshotMutex);
+	--const_cast<Snapshot*>(static_cast<const Snapshot*>(snapshot))->refCount;
+	}
+
+void GridReadback::process(GLContextData& contextData)
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Complete all finished batches in the order in which they were issued, without waiting for any: */
+	for(unsigned int i=0;i<DataItem::numBatches;++i)
+		{
+		unsigned int batchIndex=(dataItem->nextBatch+i)%DataItem::numBatches;
+		Batch& batch=dataItem->batches[batchIndex];
+		if(batch.fence!=0)
+			{
+			GLenum waitResult=glClientWaitSync(batch.fence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+			if(waitResult!=GL_ALREADY_SIGNALED&&waitResult!=GL_CONDITION_SATISFIED)
+				break;
+			completeBatch(dataItem,batchIndex);
+			}
+		}
+	
+	/* Bail out if all batches are still in flight: */
+	Batch& batch=dataItem->batches[dataItem->nextBatch];
+	if(batch.fence!=0)
+		return;
+	
+	/* Assign all pending requests to the next batch and determine which grids they want: */
+	batch.haveBathymetry=false;
+	batch.haveWaterLevel=false;
+	unsigned int numRequests=0;
+	{
+	Threads::Mutex::Lock requestLock(requestMutex);
+	for(std::vector<Request>::iterator rIt=requests.begin();rIt!=requests.end();++rIt)
+		if(rIt->owner==0)
+			{
+			rIt->owner=dataItem;
+			rIt->batch=dataItem->nextBatch;
+			batch.haveBathymetry=batch.haveBathymetry||rIt->bathymetryBuffer!=0;
+			batch.haveWaterLevel=batch.haveWaterLevel||rIt->waterLevelBuffer!=0;
+			++numRequests;
+			}
+	}
+	if(numRequests==0)
+		return;
+	
+	/* Queue asynchronous reads of the requested grids into the batch's pixel buffers: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	if(batch.haveBathymetry)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.bathymetryBuffer);
+		waterTable->bindBathymetryTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		}
+	if(batch.haveWaterLevel)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,batch.waterLevelBuffer);
+		waterTable->bindQuantityTexture(contextData);
+		glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,0);
+		}
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	batch.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	
+	/* Advance the batch ring: */
+	dataItem->nextBatch=(dataItem->nextBatch+1)%DataItem::numBatches;
+	}
@@ -0,0 +1,132 @@
+/***********************************************************************
+GridReadback - Class to read back bathymetry and water level grids from
+a water table asynchronously and distribute them to any number of
+requesters.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDREADBACK_INCLUDED
+#define GRIDREADBACK_INCLUDED
+
+#include <vector>
+#include <Threads/Mutex.h>
+#include <GL/gl.h>
+#include <GL/Extensions/GLARBSync.h>
+#include <GL/GLObject.h>
+
+#include "GridSource.h"
+
+/* Forward declarations: */
+class WaterTable2;
+
+class GridReadback:public GLObject,public GridSource
+	{
+	/* Embedded classes: */
+	public:
+	typedef void (*CallbackFunction)(GLfloat*,GLfloat*,void*); // Type for callback functions
+	
+	class Snapshot:public GridSource::Snapshot // Class for a shared, versioned pair of read-back grids
+		{
+		friend class GridReadback;
+		
+		/* Elements: */
+		private:
+		unsigned int refCount; // Number of readers and pending readbacks holding the snapshot; protected by the snapshot mutex
+		
+		/* Constructors and destructors: */
+		Snapshot(const GLsizei bathymetrySize[2],const GLsizei waterLevelSize[2]); // Allocates grids of the given sizes
+		~Snapshot(void);
+		};
+	
+	private:
+	struct DataItem;
+	
+	struct Request // Structure holding a request's parameters
+		{
+		/* Elements: */
+		public:
+		GLfloat* bathymetryBuffer; // Pointer to a buffer to hold the requested bathymetry grid if requested
+		GLfloat* waterLevelBuffer; // Pointer to a buffer to hold the requested water level grid if requested
+		CallbackFunction callback; // Function to call when the grid(s) has/have been read back
+		void* callbackData; // Additional data element to pass to callback function
+		const DataItem* owner; // Context data item whose readback serves the request, or 0 if the request is still pending
+		unsigned int batch; // Index of the readback batch serving the request
+		};
+	
+	struct Batch // Structure for a readback in flight
+		{
+		/* Elements: */
+		public:
+		GLuint bathymetryBuffer; // Pixel buffer object receiving the bathymetry grid
+		GLuint waterLevelBuffer; // Pixel buffer object receiving the water level grid
+		bool haveBathymetry,haveWaterLevel; // Flags which grids were read back by this batch
+		GLsync fence; // Fence signaling completion of the readback, or 0 if the batch is not in flight
+		};
+	
+	struct DataItem:public GLObject::DataItem // Structure holding per-context state
+		{
+		/* Elements: */
+		public:
+		static const unsigned int numBatches=2; // Number of readbacks that can be in flight at the same time
+		Batch batches[numBatches]; // Ring of readback batches
+		unsigned int nextBatch; // Index of the batch to issue next
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	const WaterTable2* waterTable; // Water table whose grids are read back
+	GLsizei bathymetrySize[2]; // Width and height of the bathymetry grid
+	GLsizei waterLevelSize[2]; // Width and height of the water level grid
+	Threads::Mutex completionMutex; // Mutex held while completed requests are copied into their requesters' buffers and notified, so that cancelling requests waits for copies in flight; acquired before requestMutex
+	Threads::Mutex requestMutex; // Mutex serializing access to the request list
+	std::vector<Request> requests; // List of pending and in-flight requests
+	Threads::Mutex snapshotMutex; // Mutex protecting the snapshot pool and snapshot reference counts
+	std::vector<Snapshot*> snapshots; // Pool of allocated snapshots
+	Snapshot* currentSnapshot; // Most recently published snapshot, or 0
+	Snapshot* pendingSnapshot; // Snapshot being filled by an outstanding readback, or 0
+	unsigned int snapshotGeneration; // Generation number of the most recently published snapshot
+	
+	/* Private methods: */
+	void completeBatch(DataItem* dataItem,unsigned int batchIndex); // Distributes the results of a completed batch to its requesters
+	static void snapshotCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback publishing a completed snapshot
+	
+	/* Constructors and destructors: */
+	public:
+	GridReadback(const WaterTable2* sWaterTable); // Creates a readback service for the given water table
+	virtual ~GridReadback(void);
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* Methods from GridSource: */
+	virtual void requestSnapshot(void);
+	virtual unsigned int getSnapshotGeneration(void);
+	virtual const Snapshot* acquireSnapshot(void);
+	virtual void releaseSnapshot(const GridSource::Snapshot* snapshot);
+	
+	/* New methods: */
+	bool requestGrids(GLfloat* newBathymetryBuffer,GLfloat* newWaterLevelBuffer,CallbackFunction newCallback,void* newCallbackData); // Requests a grid read-back; returns false if the same requester already has a request outstanding
+	void cancelRequests(void* callbackData); // Cancels all outstanding requests of the requester identified by the given callback data; waits for a copy into the requester's buffers or a callback in progress, so the buffers can be released afterwards; must not be called from a callback
+	void process(GLContextData& contextData); // Completes finished readbacks and issues at most one new readback serving all pending requests; must be called after the water table's simulation step
+	};
+
+#endif
@@ -0,0 +1,72 @@
+/***********************************************************************
+GridSource - Abstract base class for sources of shared, versioned
+snapshots of bathymetry and water level grids.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef GRIDSOURCE_INCLUDED
+#define GRIDSOURCE_INCLUDED
+
+class GridSource
+	{
+	/* Embedded classes: */
+	public:
+	class Snapshot // Base class for shared, versioned pairs of grids
+		{
+		/* Elements: */
+		protected:
+		unsigned int generation; // Generation number of the snapshot; increases with every published snapshot
+		float* bathymetry; // Vertex-centered bathymetry grid
+		float* waterLevel; // Cell-centered water level grid
+		
+		/* Constructors and destructors: */
+		Snapshot(void)
+			:generation(0),bathymetry(0),waterLevel(0)
+			{
+			}
+		
+		/* Methods: */
+		public:
+		unsigned int getGeneration(void) const // Returns the snapshot's generation number
+			{
+			return generation;
+			}
+		const float* getBathymetry(void) const // Returns the bathymetry grid
+			{
+			return bathymetry;
+			}
+		const float* getWaterLevel(void) const // Returns the water level grid
+			{
+			return waterLevel;
+			}
+		};
+	
+	/* Constructors and destructors: */
+	virtual ~GridSource(void)
+		{
+		}
+	
+	/* Methods: */
+	virtual void requestSnapshot(void) =0; // Requests a new shared snapshot unless one is already being produced
+	virtual unsigned int getSnapshotGeneration(void) =0; // Returns the generation number of the most recently published snapshot, or 0
+	virtual const Snapshot* acquireSnapshot(void) =0; // Returns the most recently published snapshot, or 0; the snapshot's grids remain valid until it is released
+	virtual void releaseSnapshot(const Snapshot* snapshot) =0; // Releases a snapshot previously returned by acquireSnapshot
+	};
+
+#endif
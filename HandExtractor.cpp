@@ -21,12 +21,15 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "HandExtractor.h"
 
+#include <string.h>
 #include <Misc/Utility.h>
 #include <Misc/FunctionCalls.h>
 #include <Math/Math.h>
 #include <Math/Interval.h>
 #include <Geometry/Vector.h>
 
+#include "PerformanceProfiler.h"
+
 // DEBUGGING
 #include <iostream>
 
@@ -223,11 +226,57 @@ Static elements of class HandExtractor:
 const unsigned short HandExtractor::invalidBlobId=0xffffU;
 const int HandExtractor::walkDx[8]={ 1, 1, 0,-1,-1,-1, 0, 1};
 const int HandExtractor::walkDy[8]={ 0, 1, 1, 1, 0,-1,-1,-1};
+const unsigned int HandExtractor::coarseScale=4;
 
 /******************************
 Methods of class HandExtractor:
 ******************************/
 
+void HandExtractor::findActiveCells(const HandExtractor::DepthPixel* depthFrame)
+	{
+	/* Sample the depth frame at the centers of the coarse cells: */
+	unsigned char* cfPtr=coarseForeground;
+	for(unsigned int cy=0;cy<coarseSize[1];++cy)
+		{
+		unsigned int y=Misc::min(cy*coarseScale+coarseScale/2,depthFrameSize[1]-1);
+		const DepthPixel* dfRowPtr=depthFrame+y*depthFrameSize[0];
+		for(unsigned int cx=0;cx<coarseSize[0];++cx,++cfPtr)
+			{
+			unsigned int x=Misc::min(cx*coarseScale+coarseScale/2,depthFrameSize[0]-1);
+			*cfPtr=dfRowPtr[x]<=maxFgDepth?1:0;
+			}
+		}
+	
+	/* Grow the foreground samples by the coarse margin to cover blob edges lost by subsampling: */
+	memset(activeCells,0,size_t(coarseSize[1])*size_t(coarseSize[0]));
+	int margin=int(coarseMargin);
+	cfPtr=coarseForeground;
+	for(int cy=0;cy<int(coarseSize[1]);++cy)
+		for(int cx=0;cx<int(coarseSize[0]);++cx,++cfPtr)
+			if(*cfPtr)
+				{
+				int y0=Misc::max(cy-margin,0);
+				int y1=Misc::min(cy+margin+1,int(coarseSize[1]));
+				int x0=Misc::max(cx-margin,0);
+				int x1=Misc::min(cx+margin+1,int(coarseSize[0]));
+				for(int y=y0;y<y1;++y)
+					memset(activeCells+(y*int(coarseSize[0])+x0),1,x1-x0);
+				}
+	
+	/* Always process the surroundings of hands detected in the previous frame, so that thin fingers missed on the coarse level stay intact: */
+	for(std::vector<TrackedHand>::iterator thIt=trackedHands.begin();thIt!=trackedHands.end();++thIt)
+		{
+		float r=thIt->radius*1.5f+float(coarseMargin*coarseScale);
+		int y0=Misc::max(int(Math::floor((thIt->y-r)/float(coarseScale))),0);
+		int y1=Misc::min(int(Math::floor((thIt->y+r)/float(coarseScale)))+1,int(coarseSize[1]));
+		int x0=Misc::max(int(Math::floor((thIt->x-r)/float(coarseScale))),0);
+		int x1=Misc::min(int(Math::floor((thIt->x+r)/float(coarseScale)))+1,int(coarseSize[0]));
+		for(int y=y0;y<y1;++y)
+			if(x0<x1)
+				memset(activeCells+(y*int(coarseSize[0])+x0),1,x1-x0);
+		}
+	}
+
 void* HandExtractor::extractorThreadMethod(void)
 	{
 	unsigned int lastInputFrameVersion=0;
@@ -251,24 +300,14 @@ void* HandExtractor::extractorThreadMethod(void)
 		lastInputFrameVersion=inputFrameVersion;
 		}
 		
-		/* Prepare a new output hand list: */
-		HandList& newHandList=extractedHands.startNewValue();
-		
-		/* Extract hands from the new input frame: */
-		extractHands(frame.getData<DepthPixel>(),newHandList,0);
-		
-		/* Finalize the new extracted hands list in the output buffer: */
-		extractedHands.postNewValue();
-		
-		/* Pass the new output frame to the registered receiver: */
-		if(handsExtractedFunction!=0)
-			(*handsExtractedFunction)(newHandList);
+		/* Process the new input frame: */
+		processRawFrame(frame);
 		}
 	
 	return 0;
 	}
 
-HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExtractor::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection)
+HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExtractor::PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection,bool startExtractorThread)
 	:pixelDepthCorrection(sPixelDepthCorrection),depthProjection(sDepthProjection),
 	 inputFrameVersion(0),runExtractorThread(false),
 	 maxFgDepth(0x07ffU-1U),maxDepthDist(1),minBlobSize(1500),maxBlobSize(150000),
@@ -276,7 +315,9 @@ HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExt
 	 snakeLength(50),snake(0),
 	 maxCornerEnterDist(28),minCenterDist(10),minCornerExitDist(32),
 	 minHandProbability(0.15f),
-	 handsExtractedFunction(0)
+	 coarseToFine(false),coarseForeground(0),activeCells(0),coarseMargin(2),
+	 handsExtractedFunction(0),
+	 profiler(0),profilerStage(0)
 	{
 	/* Copy the depth frame size: */
 	for(int i=0;i<2;++i)
@@ -297,6 +338,12 @@ HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExt
 	for(unsigned int y=1;y<depthFrameSize[1]+2;++y,biPtr-=biStride)
 		*biPtr=invalidBlobId;
 	
+	/* Allocate the coarse level images: */
+	for(int i=0;i<2;++i)
+		coarseSize[i]=(depthFrameSize[i]+coarseScale-1)/coarseScale;
+	coarseForeground=new unsigned char[coarseSize[1]*coarseSize[0]];
+	activeCells=new unsigned char[coarseSize[1]*coarseSize[0]];
+	
 	/* Calculate the array of edge walking pointer offsets: */
 	for(int i=0;i<8;++i)
 		walkOffsets[i]=walkDy[i]*biStride+walkDx[i];
@@ -304,22 +351,30 @@ HandExtractor::HandExtractor(const unsigned int sDepthFrameSize[2],const HandExt
 	/* Initialize the edge walking snake: */
 	setSnakeLength(snakeLength);
 	
-	/* Start the hand extraction thread: */
-	runExtractorThread=true;
-	extractorThread.start(this,&HandExtractor::extractorThreadMethod);
+	if(startExtractorThread)
+		{
+		/* Start the hand extraction thread: */
+		runExtractorThread=true;
+		extractorThread.start(this,&HandExtractor::extractorThreadMethod);
+		}
 	}
 
 HandExtractor::~HandExtractor(void)
 	{
-	/* Shut down the extraction thread: */
-	{
-	Threads::MutexCond::Lock inputLock(inputCond);
-	runExtractorThread=false;
-	inputCond.signal();
-	}
-	extractorThread.join();
+	if(runExtractorThread)
+		{
+		/* Shut down the extraction thread: */
+		{
+		Threads::MutexCond::Lock inputLock(inputCond);
+		runExtractorThread=false;
+		inputCond.signal();
+		}
+		extractorThread.join();
+		}
 	
 	delete[] blobIdImage;
+	delete[] coarseForeground;
+	delete[] activeCells;
 	delete[] snake;
 	}
 
@@ -355,6 +410,12 @@ void HandExtractor::setCornerDists(int newMaxCornerEnterDist,int newMinCenterDis
 	minCornerExitDist=newMinCornerExitDist;
 	}
 
+void HandExtractor::setCoarseToFine(bool newCoarseToFine,unsigned int newCoarseMargin)
+	{
+	coarseToFine=newCoarseToFine;
+	coarseMargin=newCoarseMargin;
+	}
+
 void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,HandExtractor::HandList& hands,Images::RGBImage* blobImage)
 	{
 	Images::RGBImage::Color* imgPtr=0;
@@ -365,82 +426,110 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 		imgPtr=blobImage->replacePixels();
 		}
 	
-	/* Extract all four-connected foreground blobs from the given depth frame: */
+	/* Find regions of interest on the coarse level: */
+	if(coarseToFine)
+		findActiveCells(depthFrame);
+	
+	/* Extract all four-connected foreground blobs from the given depth frame, or from its regions of interest: */
 	std::vector<Span> spans;
 	unsigned int numSpans=0;
 	unsigned int lastRowSpan=0;
 	const DepthPixel* dfRowPtr=depthFrame;
 	for(unsigned int y=0;y<depthFrameSize[1];++y,dfRowPtr+=depthFrameSize[0])
 		{
-		const DepthPixel* dfPtr=dfRowPtr;
 		unsigned int rowSpan=numSpans;
-		unsigned int x=0;
-		while(true)
+		const unsigned char* acRow=coarseToFine?activeCells+(y/coarseScale)*coarseSize[0]:0;
+		unsigned int cx=0;
+		bool rowDone=false;
+		while(!rowDone)
 			{
-			/* Find the beginning of the next foreground span: */
-			for(;x<depthFrameSize[0]&&*dfPtr>maxFgDepth;++x,++dfPtr)
-				;
-			if(x>=depthFrameSize[0])
-				break;
-			
-			/* Start a new foreground span: */
-			Span newSpan;
-			newSpan.y=y;
-			newSpan.start=x;
-			
-			/* Trace out the current foreground span: */
-			DepthPixel lastDepth=*dfPtr;
-			++x;
-			++dfPtr;
-			for(;x<depthFrameSize[0]&&*dfPtr<=maxFgDepth&&*dfPtr+maxDepthDist>=lastDepth&&*dfPtr<=lastDepth+maxDepthDist;++x,++dfPtr)
-				lastDepth=*dfPtr;
-			
-			/* Finalize and store the new foreground span: */
-			newSpan.end=x;
-			newSpan.parent=numSpans;
-			newSpan.numPixels=newSpan.end-newSpan.start;
-			newSpan.blobId=invalidBlobId;
-			spans.push_back(newSpan);
-			++numSpans;
-			
-			/* Skip any spans from the previous row that were just passed by: */
-			for(;lastRowSpan<rowSpan&&spans[lastRowSpan].end<newSpan.start;++lastRowSpan)
-				;
+			/* Find the next run of pixels to process in the current row: */
+			unsigned int runStart=0;
+			unsigned int runEnd=depthFrameSize[0];
+			if(acRow!=0)
+				{
+				for(;cx<coarseSize[0]&&!acRow[cx];++cx)
+					;
+				if(cx>=coarseSize[0])
+					break;
+				runStart=cx*coarseScale;
+				for(;cx<coarseSize[0]&&acRow[cx];++cx)
+					;
+				runEnd=Misc::min(cx*coarseScale,depthFrameSize[0]);
+				rowDone=cx>=coarseSize[0];
+				}
+			else
+				rowDone=true;
 			
-			/* Check if the current span links up with any from the previous row: */
-			for(unsigned int lrs=lastRowSpan;lrs<rowSpan&&spans[lrs].start<=newSpan.end;++lrs)
+			const DepthPixel* dfPtr=dfRowPtr+runStart;
+			unsigned int x=runStart;
+			while(true)
 				{
-				/* Check if the two spans have depth in common: */
-				unsigned int o1=Misc::max(newSpan.start,spans[lrs].start);
-				unsigned int o2=Misc::min(newSpan.end,spans[lrs].end);
-				const DepthPixel* lrsPtr1=dfRowPtr+o1;
-				const DepthPixel* lrsPtr0=lrsPtr1-depthFrameSize[0];
-				bool canLink=false;
-				for(unsigned int o=o1;o<o2&&!canLink;++o,++lrsPtr0,++lrsPtr1)
-					canLink=*lrsPtr0+maxDepthDist>=*lrsPtr1&&*lrsPtr0<=*lrsPtr1+maxDepthDist;
+				/* Find the beginning of the next foreground span: */
+				for(;x<runEnd&&*dfPtr>maxFgDepth;++x,++dfPtr)
+					;
+				if(x>=runEnd)
+					break;
+				
+				/* Start a new foreground span: */
+				Span newSpan;
+				newSpan.y=y;
+				newSpan.start=x;
+				
+				/* Trace out the current foreground span: */
+				DepthPixel lastDepth=*dfPtr;
+				++x;
+				++dfPtr;
+				for(;x<runEnd&&*dfPtr<=maxFgDepth&&*dfPtr+maxDepthDist>=lastDepth&&*dfPtr<=lastDepth+maxDepthDist;++x,++dfPtr)
+					lastDepth=*dfPtr;
 				
-				/* Merge the two spans if they can link: */
-				if(canLink)
+				/* Finalize and store the new foreground span: */
+				newSpan.end=x;
+				newSpan.parent=numSpans;
+				newSpan.numPixels=newSpan.end-newSpan.start;
+				newSpan.blobId=invalidBlobId;
+				spans.push_back(newSpan);
+				++numSpans;
+				
+				/* Skip any spans from the previous row that were just passed by: */
+				for(;lastRowSpan<rowSpan&&spans[lastRowSpan].end<newSpan.start;++lastRowSpan)
+					;
+				
+				/* Check if the current span links up with any from the previous row: */
+				for(unsigned int lrs=lastRowSpan;lrs<rowSpan&&spans[lrs].start<=newSpan.end;++lrs)
 					{
-					/* Find the roots of the two spans' respective subtrees: */
-					unsigned int root1=lrs;
-					while(root1!=spans[root1].parent)
-						root1=spans[root1].parent;
-					unsigned int root2=numSpans-1;
-					while(root2!=spans[root2].parent)
-						root2=spans[root2].parent;
+					/* Check if the two spans have depth in common: */
+					unsigned int o1=Misc::max(newSpan.start,spans[lrs].start);
+					unsigned int o2=Misc::min(newSpan.end,spans[lrs].end);
+					const DepthPixel* lrsPtr1=dfRowPtr+o1;
+					const DepthPixel* lrsPtr0=lrsPtr1-depthFrameSize[0];
+					bool canLink=false;
+					for(unsigned int o=o1;o<o2&&!canLink;++o,++lrsPtr0,++lrsPtr1)
+						canLink=*lrsPtr0+maxDepthDist>=*lrsPtr1&&*lrsPtr0<=*lrsPtr1+maxDepthDist;
 					
-					if(root1<root2)
-						{
-						/* Make the first span the new root: */
-						spans[root2].parent=root1;
-						spans[root1].numPixels+=spans[root2].numPixels;
-						}
-					else if(root1>root2)
+					/* Merge the two spans if they can link: */
+					if(canLink)
 						{
-						/* Make the second span the new root: */
-						spans[root1].parent=root2;
-						spans[root2].numPixels+=spans[root1].numPixels;
+						/* Find the roots of the two spans' respective subtrees: */
+						unsigned int root1=lrs;
+						while(root1!=spans[root1].parent)
+							root1=spans[root1].parent;
+						unsigned int root2=numSpans-1;
+						while(root2!=spans[root2].parent)
+							root2=spans[root2].parent;
+						
+						if(root1<root2)
+							{
+							/* Make the first span the new root: */
+							spans[root2].parent=root1;
+							spans[root1].numPixels+=spans[root2].numPixels;
+							}
+						else if(root1>root2)
+							{
+							/* Make the second span the new root: */
+							spans[root1].parent=root2;
+							spans[root2].numPixels+=spans[root1].numPixels;
+							}
 						}
 					}
 				}
@@ -566,8 +655,9 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			}
 		}
 	
-	/* Initialize the result list: */
+	/* Initialize the result list and the list of tracked hands for the next frame: */
 	hands.clear();
+	trackedHands.clear();
 	
 	/* Walk around the edges of all foreground blobs in counter-clockwise order and decide whether they are hand-shaped: */
 	EdgePixel* snakeEnd=snake+snakeLength;
@@ -874,6 +964,13 @@ void HandExtractor::extractHands(const HandExtractor::DepthPixel* depthFrame,Han
 			newHand.radius=Geometry::dist(newHand.center,depthProjection.transform(Point(center[0]+radius,center[1],depth)));
 			hands.push_back(newHand);
 			
+			/* Track the hand in depth image space for the next frame: */
+			TrackedHand newTrackedHand;
+			newTrackedHand.x=center[0];
+			newTrackedHand.y=center[1];
+			newTrackedHand.radius=radius;
+			trackedHands.push_back(newTrackedHand);
+			
 			// DEBUGGING
 			// std::cout<<"Hand in camera space: "<<newHand.center[0]<<", "<<newHand.center[1]<<", "<<newHand.center[2]<<", "<<newHand.radius<<std::endl;
 			}
@@ -892,6 +989,33 @@ void HandExtractor::setHandsExtractedFunction(HandExtractor::HandsExtractedFunct
 	handsExtractedFunction=newHandsExtractedFunction;
 	}
 
+void HandExtractor::setProfiler(PerformanceProfiler* newProfiler)
+	{
+	/* Register the extractor's stage before publishing the profiler to the extraction thread: */
+	if(newProfiler!=0)
+		profilerStage=newProfiler->addStage("HandExtractor",false);
+	profiler=newProfiler;
+	}
+
+void HandExtractor::processRawFrame(const Kinect::FrameBuffer& frame)
+	{
+	/* Prepare a new output hand list: */
+	HandList& newHandList=extractedHands.startNewValue();
+	
+	/* Extract hands from the frame: */
+	{
+	PerformanceProfiler::CpuTimer extractTimer(profiler,profilerStage);
+	extractHands(frame.getData<DepthPixel>(),newHandList,0);
+	}
+	
+	/* Finalize the new extracted hands list in the output buffer: */
+	extractedHands.postNewValue();
+	
+	/* Pass the new output frame to the registered receiver: */
+	if(handsExtractedFunction!=0)
+		(*handsExtractedFunction)(newHandList);
+	}
+
 void HandExtractor::receiveRawFrame(const Kinect::FrameBuffer& newFrame)
 	{
 	Threads::MutexCond::Lock inputLock(inputCond);
@@ -39,6 +39,7 @@ namespace Misc {
 template <class ParameterParam>
 class FunctionCall;
 }
+class PerformanceProfiler;
 
 class HandExtractor
 	{
@@ -66,7 +67,15 @@ class HandExtractor
 		int x,y; // Position of edge pixel in depth frame
 		const unsigned short* biPtr; // Pointer to edge pixel in blob ID image
 		};
-
+	
+	struct TrackedHand // Helper structure storing a hand detected in the previous frame
+		{
+		/* Elements: */
+		public:
+		float x,y; // Position of hand center in depth frame
+		float radius; // Hand radius in depth frame pixels
+		};
+	
 	/* Elements: */
 	private:
 	unsigned int depthFrameSize[2]; // Size of incoming depth frames
@@ -94,16 +103,26 @@ class HandExtractor
 	int minCenterDist; // Minimum distance from snake's center to line defined by its head and tail to enter corner state
 	int minCornerExitDist; // Minimum distance between snake's head and tail to leave corner state
 	float minHandProbability; // Minimum probability rating at which to accept a blob as a hand
+	bool coarseToFine; // Flag whether to restrict full-resolution blob extraction to regions of interest found on a coarse level
+	static const unsigned int coarseScale; // Subsampling factor between the depth frame and the coarse level
+	unsigned int coarseSize[2]; // Size of the coarse level
+	unsigned char* coarseForeground; // Image of foreground flags sampled at the coarse level
+	unsigned char* activeCells; // Image of flags marking coarse cells inside regions of interest
+	unsigned int coarseMargin; // Number of coarse cells by which to grow coarse foreground regions
+	std::vector<TrackedHand> trackedHands; // Hands detected in the previous frame, whose surroundings are always processed at full resolution
 	
 	Threads::TripleBuffer<HandList> extractedHands; // Triple buffer of lists of extracted hands
 	HandsExtractedFunction* handsExtractedFunction; // Function called when a new list of extracted hands is ready
+	PerformanceProfiler* profiler; // Profiler measuring the CPU time spent extracting hands from each frame, or NULL
+	unsigned int profilerStage; // Index of the hand extractor's stage in the profiler
 	
 	/* Private methods: */
+	void findActiveCells(const DepthPixel* depthFrame); // Marks coarse cells around foreground samples and previously detected hands as regions of interest
 	void* extractorThreadMethod(void); // Method for the background hand extraction thread
 	
 	/* Constructors and destructors: */
 	public:
-	HandExtractor(const unsigned int sDepthFrameSize[2],const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection); // Creates a hand extractor for depth frames of the given size
+	HandExtractor(const unsigned int sDepthFrameSize[2],const PixelDepthCorrection* sPixelDepthCorrection,const PTransform& sDepthProjection,bool startExtractorThread=true); // Creates a hand extractor for depth frames of the given size; if startExtractorThread is false, frames must be passed to processRawFrame by the caller
 	private:
 	HandExtractor(const HandExtractor& source); // Prohibit copy constructor
 	HandExtractor& operator=(const HandExtractor& source); // Prohibit assignment operator
@@ -148,9 +167,16 @@ class HandExtractor
 		return minCornerExitDist;
 		}
 	void setCornerDists(int newMaxCornerEnterDist,int newMinCenterDist,int newMinCornerExitDist); // Sets distances between snake's head and tail to enter and exit corner state, respectively
+	bool getCoarseToFine(void) const // Returns true if full-resolution blob extraction is restricted to regions of interest
+		{
+		return coarseToFine;
+		}
+	void setCoarseToFine(bool newCoarseToFine,unsigned int newCoarseMargin=2); // Enables or disables coarse-to-fine extraction, growing coarse foreground regions by the given number of coarse cells
 	void extractHands(const DepthPixel* depthFrame,HandList& hands,Images::RGBImage* blobImage); // Extracts hands from the given depth frame
 	void setHandsExtractedFunction(HandsExtractedFunction* newHandsExtractedFunction); // Sets the output function; adopts given functor object
-	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to receive a new raw depth frame
+	void setProfiler(PerformanceProfiler* newProfiler); // Registers a stage with the given profiler and measures the CPU time spent extracting hands from each frame
+	void processRawFrame(const Kinect::FrameBuffer& frame); // Extracts hands from the given raw depth frame in the calling thread and posts the result
+	void receiveRawFrame(const Kinect::FrameBuffer& newFrame); // Called to receive a new raw depth frame for the background extraction thread
 	bool lockNewExtractedHands(void) // Locks the most recently produced output list of extracted hands for reading; returns true if the locked list is new
 		{
 		return extractedHands.lockNewValue();
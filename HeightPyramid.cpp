@@ -0,0 +1,84 @@
+/***********************************************************************
+HeightPyramid - Class for min/max quadtrees over the cells of a height
+field grid to accelerate line segment intersection tests.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "HeightPyramid.h"
+
+#include <algorithm>
+
+/******************************
+Methods of class HeightPyramid:
+******************************/
+
+HeightPyramid::HeightPyramid(void)
+	{
+	}
+
+void HeightPyramid::build(const Misc::UInt16* heights,const unsigned int gridSize[2],GLfloat heightScale,GLfloat heightOffset)
+	{
+	/* Size the base level to the grid's cells: */
+	levels.resize(1);
+	Level& base=levels[0];
+	for(int i=0;i<2;++i)
+		base.size[i]=gridSize[i]-1;
+	base.ranges.resize(size_t(base.size[1])*size_t(base.size[0])*2);
+	
+	/* Bound each cell's bilinear patch by the heights of its four corners; dequantization preserves order: */
+	GLfloat* rPtr=&base.ranges[0];
+	for(unsigned int y=0;y<base.size[1];++y)
+		{
+		const Misc::UInt16* row0=heights+size_t(y)*size_t(gridSize[0]);
+		const Misc::UInt16* row1=row0+gridSize[0];
+		for(unsigned int x=0;x<base.size[0];++x,rPtr+=2)
+			{
+			rPtr[0]=GLfloat(std::min(std::min(row0[x],row0[x+1]),std::min(row1[x],row1[x+1])))*heightScale+heightOffset;
+			rPtr[1]=GLfloat(std::max(std::max(row0[x],row0[x+1]),std::max(row1[x],row1[x+1])))*heightScale+heightOffset;
+			}
+		}
+	
+	/* Merge 2x2 blocks of nodes until a level consists of a single node: */
+	while(levels.back().size[0]>1||levels.back().size[1]>1)
+		{
+		levels.push_back(Level());
+		const Level& child=levels[levels.size()-2];
+		Level& parent=levels.back();
+		for(int i=0;i<2;++i)
+			parent.size[i]=(child.size[i]+1)/2;
+		parent.ranges.resize(size_t(parent.size[1])*size_t(parent.size[0])*2);
+		GLfloat* pPtr=&parent.ranges[0];
+		for(unsigned int y=0;y<parent.size[1];++y)
+			{
+			unsigned int y0=y*2;
+			unsigned int y1=std::min(y0+1,child.size[1]-1);
+			for(unsigned int x=0;x<parent.size[0];++x,pPtr+=2)
+				{
+				unsigned int x0=x*2;
+				unsigned int x1=std::min(x0+1,child.size[0]-1);
+				const GLfloat* c00=&child.ranges[(size_t(y0)*size_t(child.size[0])+x0)*2];
+				const GLfloat* c01=&child.ranges[(size_t(y0)*size_t(child.size[0])+x1)*2];
+				const GLfloat* c10=&child.ranges[(size_t(y1)*size_t(child.size[0])+x0)*2];
+				const GLfloat* c11=&child.ranges[(size_t(y1)*size_t(child.size[0])+x1)*2];
+				pPtr[0]=std::min(std::min(c00[0],c01[0]),std::min(c10[0],c11[0]));
+				pPtr[1]=std::max(std::max(c00[1],c01[1]),std::max(c10[1],c11[1]));
+				}
+			}
+		}
+	}
@@ -0,0 +1,67 @@
+/***********************************************************************
+HeightPyramid - Class for min/max quadtrees over the cells of a height
+field grid to accelerate line segment intersection tests.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef HEIGHTPYRAMID_INCLUDED
+#define HEIGHTPYRAMID_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+#include <Misc/SizedTypes.h>
+#include <GL/gl.h>
+
+class HeightPyramid
+	{
+	/* Embedded classes: */
+	private:
+	struct Level // Structure for a pyramid level
+		{
+		/* Elements: */
+		public:
+		unsigned int size[2]; // Number of nodes in x and y
+		std::vector<GLfloat> ranges; // Minimum and maximum heights of all nodes in row-major order, interleaved
+		};
+	
+	/* Elements: */
+	std::vector<Level> levels; // Pyramid levels; level 0 holds the grid's cells, the last level holds a single node
+	
+	/* Constructors and destructors: */
+	public:
+	HeightPyramid(void); // Creates an empty pyramid
+	
+	/* Methods: */
+	void build(const Misc::UInt16* heights,const unsigned int gridSize[2],GLfloat heightScale,GLfloat heightOffset); // Rebuilds the pyramid for the given row-major grid of quantized vertex heights of the given width and height, which must be at least 2x2, using the given positive dequantization scale and offset
+	unsigned int getNumLevels(void) const // Returns the number of pyramid levels
+		{
+		return (unsigned int)(levels.size());
+		}
+	const unsigned int* getLevelSize(unsigned int level) const // Returns the number of nodes of the given level in x and y
+		{
+		return levels[level].size;
+		}
+	const GLfloat* getRange(unsigned int level,unsigned int x,unsigned int y) const // Returns the minimum and maximum heights inside the given node of the given level
+		{
+		const Level& l=levels[level];
+		return &l.ranges[(size_t(y)*size_t(l.size[0])+size_t(x))*2];
+		}
+	};
+
+#endif
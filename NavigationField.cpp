@@ -0,0 +1,206 @@
+/***********************************************************************
+NavigationField - Class for a coarse grid of terrain hazards, distances
+to the nearest hazard, repulsion vectors, and safe spawn cells, rebuilt
+whenever the terrain query's grids change so that dinosaur AI can
+navigate with constant-time lookups.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "NavigationField.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "TerrainQuery.h"
+
+/********************************
+Methods of class NavigationField:
+********************************/
+
+NavigationField::NavigationField(void)
+	:maxCells(128),
+	 repulsionRange(0.04),
+	 dataVersion(0),
+	 valid(false)
+	{
+	origin[0] = origin[1] = 0.0;
+	extent[0] = extent[1] = 0.0;
+	numCells[0] = numCells[1] = 0;
+	cellSize[0] = cellSize[1] = 1.0;
+	}
+
+Scalar NavigationField::cellDist2(int index0, int index1) const
+	{
+	Scalar dx = Scalar(index0 % numCells[0] - index1 % numCells[0]) * cellSize[0];
+	Scalar dy = Scalar(index0 / numCells[0] - index1 / numCells[0]) * cellSize[1];
+	return dx * dx + dy * dy;
+	}
+
+void NavigationField::relax(std::vector<int>& nearest, int index, int x, int y) const
+	{
+	/* Adopt the neighbor's nearest hazard if it is closer than the cell's own */
+	if(x < 0 || x >= numCells[0] || y < 0 || y >= numCells[1])
+		return;
+	int candidate = nearest[y * numCells[0] + x];
+	if(candidate >= 0 && (nearest[index] < 0 || cellDist2(index, candidate) < cellDist2(index, nearest[index])))
+		nearest[index] = candidate;
+	}
+
+void NavigationField::build(const TerrainQuery& terrainQuery)
+	{
+	/* Sample the terrain at all cell corners in one batch */
+	int numCorners[2] = {numCells[0] + 1, numCells[1] + 1};
+	std::vector<Point> corners(size_t(numCorners[1]) * size_t(numCorners[0]));
+	std::vector<Point>::iterator cIt = corners.begin();
+	for(int y = 0; y < numCorners[1]; ++y)
+		for(int x = 0; x < numCorners[0]; ++x, ++cIt)
+			*cIt = Point(origin[0] + Scalar(x) * cellSize[0], origin[1] + Scalar(y) * cellSize[1], Scalar(0));
+	std::vector<TerrainQuery::TerrainInfo> infos(corners.size());
+	terrainQuery.queryBatch(&corners[0], corners.size(), &infos[0]);
+
+	/* Classify the corners the same way dinosaurs judge terrain safety */
+	std::vector<unsigned char> cornerTypes(infos.size());
+	for(size_t i = 0; i < infos.size(); ++i)
+		{
+		if(infos[i].type == TerrainQuery::TERRAIN_LAVA)
+			cornerTypes[i] = CELL_LAVA;
+		else if(infos[i].waterDepth > 0.0)
+			cornerTypes[i] = CELL_WATER;
+		else
+			cornerTypes[i] = CELL_SAFE;
+		}
+
+	/* Classify each cell by its most dangerous corner, and seed the nearest hazard search with all hazard cells */
+	size_t numTotalCells = size_t(numCells[1]) * size_t(numCells[0]);
+	cells.resize(numTotalCells);
+	std::vector<int> nearest(numTotalCells, -1);
+	for(int y = 0; y < numCells[1]; ++y)
+		{
+		const unsigned char* ct0 = &cornerTypes[size_t(y) * size_t(numCorners[0])];
+		const unsigned char* ct1 = ct0 + numCorners[0];
+		for(int x = 0; x < numCells[0]; ++x)
+			{
+			int index = y * numCells[0] + x;
+			cells[index].type = std::max(std::max(ct0[x], ct0[x + 1]), std::max(ct1[x], ct1[x + 1]));
+			if(cells[index].type != CELL_SAFE)
+				nearest[index] = index;
+			}
+		}
+
+	/* Propagate nearest hazards with a forward and a backward raster pass over the 8-neighborhood */
+	for(int y = 0; y < numCells[1]; ++y)
+		for(int x = 0; x < numCells[0]; ++x)
+			{
+			int index = y * numCells[0] + x;
+			relax(nearest, index, x - 1, y);
+			relax(nearest, index, x - 1, y - 1);
+			relax(nearest, index, x, y - 1);
+			relax(nearest, index, x + 1, y - 1);
+			}
+	for(int y = numCells[1] - 1; y >= 0; --y)
+		for(int x = numCells[0] - 1; x >= 0; --x)
+			{
+			int index = y * numCells[0] + x;
+			relax(nearest, index, x + 1, y);
+			relax(nearest, index, x + 1, y + 1);
+			relax(nearest, index, x, y + 1);
+			relax(nearest, index, x - 1, y + 1);
+			}
+
+	/* Derive safety distances, repulsion vectors, and spawn cells from the nearest hazards */
+	spawnCells.clear();
+	for(int index = 0; index < int(numTotalCells); ++index)
+		{
+		Cell& cell = cells[index];
+		cell.repulsion[0] = cell.repulsion[1] = 0.0f;
+		if(nearest[index] < 0)
+			{
+			cell.safety = -1.0f;
+			spawnCells.push_back(index);
+			continue;
+			}
+
+		Scalar dist = std::sqrt(cellDist2(index, nearest[index]));
+		cell.safety = float(dist);
+		if(dist > repulsionRange)
+			{
+			spawnCells.push_back(index);
+			}
+		else if(dist > 0.0)
+			{
+			/* Push away from the nearest hazard, twice as hard from lava */
+			Scalar weight = (cells[nearest[index]].type == CELL_LAVA ? 2.0 : 1.0) / dist;
+			cell.repulsion[0] = float(Scalar(index % numCells[0] - nearest[index] % numCells[0]) * cellSize[0] * weight);
+			cell.repulsion[1] = float(Scalar(index / numCells[0] - nearest[index] / numCells[0]) * cellSize[1] * weight);
+			}
+		}
+	}
+
+void NavigationField::setResolution(int newMaxCells)
+	{
+	maxCells = std::max(1, newMaxCells);
+	valid = false;
+	}
+
+void NavigationField::setRepulsionRange(Scalar newRepulsionRange)
+	{
+	repulsionRange = newRepulsionRange;
+	valid = false;
+	}
+
+bool NavigationField::update(const TerrainQuery& terrainQuery, Scalar minX, Scalar maxX, Scalar minY, Scalar maxY)
+	{
+	/* Lookups fall back to the terrain query until it has data */
+	if(!terrainQuery.isDataValid())
+		{
+		valid = false;
+		return false;
+		}
+
+	/* Bail out if the field is current */
+	Scalar newExtent[2] = {std::max(maxX - minX, Scalar(1.0e-6)), std::max(maxY - minY, Scalar(1.0e-6))};
+	bool areaChanged = minX != origin[0] || minY != origin[1] || newExtent[0] != extent[0] || newExtent[1] != extent[1];
+	if(valid && !areaChanged && terrainQuery.getDataVersion() == dataVersion)
+		return false;
+
+	/* Lay out square-ish cells with the configured number of cells along the longer side */
+	origin[0] = minX;
+	origin[1] = minY;
+	extent[0] = newExtent[0];
+	extent[1] = newExtent[1];
+	Scalar targetCellSize = std::max(extent[0], extent[1]) / Scalar(maxCells);
+	for(int i = 0; i < 2; ++i)
+		{
+		numCells[i] = std::max(1, std::min(int(std::ceil(extent[i] / targetCellSize - 1.0e-6)), maxCells));
+		cellSize[i] = extent[i] / Scalar(numCells[i]);
+		}
+	
+	build(terrainQuery);
+	dataVersion = terrainQuery.getDataVersion();
+	valid = true;
+	return true;
+	}
+
+Point NavigationField::getSpawnPosition(size_t spawnCellIndex, Scalar fx, Scalar fy) const
+	{
+	unsigned int index = spawnCells[spawnCellIndex];
+	unsigned int cx = index % (unsigned int)(numCells[0]);
+	unsigned int cy = index / (unsigned int)(numCells[0]);
+	return Point(origin[0] + (Scalar(cx) + fx) * cellSize[0], origin[1] + (Scalar(cy) + fy) * cellSize[1], Scalar(0));
+	}
@@ -0,0 +1,115 @@
+/***********************************************************************
+NavigationField - Class for a coarse grid of terrain hazards, distances
+to the nearest hazard, repulsion vectors, and safe spawn cells, rebuilt
+whenever the terrain query's grids change so that dinosaur AI can
+navigate with constant-time lookups.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef NAVIGATIONFIELD_INCLUDED
+#define NAVIGATIONFIELD_INCLUDED
+
+#include <stddef.h>
+#include <vector>
+
+#include "Types.h"
+
+/* Forward declarations */
+class TerrainQuery;
+
+class NavigationField
+	{
+	/* Embedded classes: */
+	public:
+
+	/* Hazard classification of a navigation cell */
+	enum CellType
+		{
+		CELL_SAFE = 0,  // Dry terrain above the lava threshold at all cell corners
+		CELL_WATER,     // Water at one or more cell corners
+		CELL_LAVA       // Lava at one or more cell corners
+		};
+
+	/* Navigation state of a cell */
+	struct Cell
+		{
+		unsigned char type;   // Hazard classification
+		float safety;         // Distance from the cell center to the nearest hazard cell center, or a negative value if there is no hazard
+		float repulsion[2];   // Vector pushing away from the nearest hazard if it is within the repulsion range, weighted by hazard type
+		};
+
+	/* Elements: */
+	private:
+	int maxCells;                   // Number of cells along the longer side of the navigation area
+	Scalar repulsionRange;          // Distance to hazards inside which cells repel
+	Scalar origin[2];               // Lower-left corner of the navigation area
+	Scalar extent[2];               // Width and height of the navigation area
+	int numCells[2];                // Number of cells in x and y
+	Scalar cellSize[2];             // Width and height of each cell
+	std::vector<Cell> cells;        // Cells in row-major order
+	std::vector<unsigned int> spawnCells; // Indices of safe cells outside the repulsion range of all hazards
+	unsigned int dataVersion;       // Version of the terrain query data the field was built from
+	bool valid;                     // True after the field was built from valid terrain data
+
+	/* Private methods */
+	Scalar cellDist2(int index0, int index1) const; // Squared distance between the centers of two cells
+	void relax(std::vector<int>& nearest, int index, int x, int y) const; // Propagates the nearest hazard of cell (x, y) to the given cell
+	void build(const TerrainQuery& terrainQuery);
+
+	public:
+
+	/* Constructors and destructors */
+	NavigationField(void);
+
+	/* Methods */
+
+	/* Configuration; changes invalidate the field until the next update */
+	void setResolution(int newMaxCells);
+	void setRepulsionRange(Scalar newRepulsionRange);
+
+	/* Rebuild the field over the given area if the terrain query's data or the area changed; returns true if the field was rebuilt */
+	bool update(const TerrainQuery& terrainQuery, Scalar minX, Scalar maxX, Scalar minY, Scalar maxY);
+
+	/* Force a rebuild on the next update, e.g., after switching terrain queries */
+	void invalidate(void) { valid = false; }
+
+	/* Check if the field was built from valid terrain data */
+	bool isValid(void) const { return valid; }
+
+	/* Look up the cell containing the given position, clamped to the navigation area */
+	const Cell& getCell(Scalar x, Scalar y) const
+		{
+		int cx = int((x - origin[0]) / cellSize[0]);
+		int cy = int((y - origin[1]) / cellSize[1]);
+		cx = cx < 0 ? 0 : (cx >= numCells[0] ? numCells[0] - 1 : cx);
+		cy = cy < 0 ? 0 : (cy >= numCells[1] ? numCells[1] - 1 : cy);
+		return cells[size_t(cy) * size_t(numCells[0]) + size_t(cx)];
+		}
+
+	/* Check if the cell containing the given position is free of hazards */
+	bool isSafe(Scalar x, Scalar y) const { return getCell(x, y).type == CELL_SAFE; }
+
+	/* Get the number of safe spawn cells */
+	size_t getNumSpawnCells(void) const { return spawnCells.size(); }
+
+	/* Get the position at the given fractional offsets in [0, 1) inside the given spawn cell; the elevation is left at zero */
+	Point getSpawnPosition(size_t spawnCellIndex, Scalar fx, Scalar fy) const;
+	};
+
+#endif
@@ -0,0 +1,300 @@
+/***********************************************************************
+PerformanceProfiler - Class to collect rolling statistics of the CPU and
+GPU time spent in named processing stages, using non-blocking OpenGL
+timestamp queries for stages running on the GPU.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "PerformanceProfiler.h"
+
+#include <time.h>
+#include <math.h>
+#include <Misc/ThrowStdErr.h>
+#include <GL/GLExtensionManager.h>
+#include <GL/Extensions/GLARBOcclusionQuery.h>
+#include <GL/GLContextData.h>
+
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+const unsigned int maxNumPendingQueries=256; // Maximum number of unretrieved GPU measurements per context before new measurements are skipped
+const char histogramLevels[]=" .:-=+*#"; // Characters rendering histogram bins of increasing relative sample counts
+
+unsigned int getHistogramBin(double time)
+	{
+	/* Find the logarithmic bin containing the given time in ms: */
+	int bin=time>0.0?int(floor(log(time)/log(2.0)))+6:0;
+	if(bin<0)
+		bin=0;
+	if(bin>=int(PerformanceProfiler::numHistogramBins))
+		bin=PerformanceProfiler::numHistogramBins-1;
+	return (unsigned int)(bin);
+	}
+
+}
+
+/************************************************
+Methods of class PerformanceProfiler::CpuTimer:
+************************************************/
+
+PerformanceProfiler::CpuTimer::CpuTimer(PerformanceProfiler* sProfiler,unsigned int sStageIndex)
+	:profiler(sProfiler),stageIndex(sStageIndex),
+	 startTime(profiler!=0?PerformanceProfiler::getTime():0.0)
+	{
+	}
+
+PerformanceProfiler::CpuTimer::~CpuTimer(void)
+	{
+	if(profiler!=0)
+		profiler->addSample(stageIndex,(PerformanceProfiler::getTime()-startTime)*1000.0);
+	}
+
+/************************************************
+Methods of class PerformanceProfiler::GpuTimer:
+************************************************/
+
+PerformanceProfiler::GpuTimer::GpuTimer(PerformanceProfiler* sProfiler,unsigned int sStageIndex,GLContextData& sContextData)
+	:profiler(sProfiler),stageIndex(sStageIndex),contextData(sContextData)
+	{
+	if(profiler!=0)
+		profiler->beginGpuStage(stageIndex,contextData);
+	}
+
+PerformanceProfiler::GpuTimer::~GpuTimer(void)
+	{
+	if(profiler!=0)
+		profiler->endGpuStage(stageIndex,contextData);
+	}
+
+/************************************************
+Methods of class PerformanceProfiler::DataItem:
+************************************************/
+
+PerformanceProfiler::DataItem::DataItem(void)
+	:haveTimestamps(false),
+	 glQueryCounterProc(0),glGetQueryObjectui64vProc(0)
+	{
+	/* Check whether the context supports timestamp queries, which can be nested unlike elapsed-time queries: */
+	if(GLARBOcclusionQuery::isSupported()&&GLExtensionManager::isExtensionSupported("GL_ARB_timer_query"))
+		{
+		GLARBOcclusionQuery::initExtension();
+		glQueryCounterProc=GLExtensionManager::getFunction<PFNGLQUERYCOUNTERPROC>("glQueryCounter");
+		glGetQueryObjectui64vProc=GLExtensionManager::getFunction<PFNGLGETQUERYOBJECTUI64VPROC>("glGetQueryObjectui64v");
+		haveTimestamps=glQueryCounterProc!=0&&glGetQueryObjectui64vProc!=0;
+		}
+	
+	for(unsigned int i=0;i<maxNumStages;++i)
+		open[i]=false;
+	}
+
+PerformanceProfiler::DataItem::~DataItem(void)
+	{
+	/* Release all query objects: */
+	for(std::vector<TimestampQuery>::iterator fqIt=freeQueries.begin();fqIt!=freeQueries.end();++fqIt)
+		glDeleteQueriesARB(2,fqIt->queries);
+	for(std::deque<TimestampQuery>::iterator pqIt=pendingQueries.begin();pqIt!=pendingQueries.end();++pqIt)
+		glDeleteQueriesARB(2,pqIt->queries);
+	for(unsigned int i=0;i<maxNumStages;++i)
+		if(open[i])
+			glDeleteQueriesARB(2,openQueries[i].queries);
+	}
+
+/************************************
+Methods of class PerformanceProfiler:
+************************************/
+
+PerformanceProfiler::PerformanceProfiler(void)
+	:numStages(0)
+	{
+	}
+
+void PerformanceProfiler::initContext(GLContextData& contextData) const
+	{
+	/* Create a data item and add it to the context: */
+	DataItem* dataItem=new DataItem;
+	contextData.addDataItem(this,dataItem);
+	}
+
+double PerformanceProfiler::getTime(void)
+	{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return double(now.tv_sec)+double(now.tv_nsec)*1.0e-9;
+	}
+
+unsigned int PerformanceProfiler::addStage(const char* name,bool gpu)
+	{
+	Threads::Mutex::Lock stageLock(stageMutex);
+	
+	if(numStages>=maxNumStages)
+		Misc::throwStdErr("PerformanceProfiler::addStage: Too many stages");
+	
+	/* Initialize the new stage: */
+	Stage& s=stages[numStages];
+	s.name=name;
+	s.gpu=gpu;
+	s.numSamples=0;
+	s.nextSample=0;
+	
+	return numStages++;
+	}
+
+void PerformanceProfiler::addSample(unsigned int stageIndex,double time)
+	{
+	Threads::Mutex::Lock stageLock(stageMutex);
+	
+	/* Store the sample in the stage's history: */
+	Stage& s=stages[stageIndex];
+	s.history[s.nextSample]=time;
+	if(++s.nextSample==historySize)
+		s.nextSample=0;
+	++s.numSamples;
+	}
+
+void PerformanceProfiler::beginGpuStage(unsigned int stageIndex,GLContextData& contextData)
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Bail out if timestamps are unsupported, the stage is already being measured, or results are not retrieved: */
+	if(!dataItem->haveTimestamps||dataItem->open[stageIndex]||dataItem->pendingQueries.size()>=maxNumPendingQueries)
+		return;
+	
+	/* Get a free query pair: */
+	TimestampQuery& tq=dataItem->openQueries[stageIndex];
+	if(!dataItem->freeQueries.empty())
+		{
+		tq=dataItem->freeQueries.back();
+		dataItem->freeQueries.pop_back();
+		}
+	else
+		glGenQueriesARB(2,tq.queries);
+	tq.stageIndex=stageIndex;
+	
+	/* Record the start timestamp: */
+	dataItem->glQueryCounterProc(tq.queries[0],GL_TIMESTAMP);
+	dataItem->open[stageIndex]=true;
+	}
+
+void PerformanceProfiler::endGpuStage(unsigned int stageIndex,GLContextData& contextData)
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	if(!dataItem->open[stageIndex])
+		return;
+	
+	/* Record the end timestamp and queue the measurement for retrieval: */
+	TimestampQuery& tq=dataItem->openQueries[stageIndex];
+	dataItem->glQueryCounterProc(tq.queries[1],GL_TIMESTAMP);
+	dataItem->pendingQueries.push_back(tq);
+	dataItem->open[stageIndex]=false;
+	}
+
+void PerformanceProfiler::processGpuResults(GLContextData& contextData)
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Retrieve finished measurements in issue order; the GPU finishes them in the same order: */
+	while(!dataItem->pendingQueries.empty())
+		{
+		TimestampQuery& tq=dataItem->pendingQueries.front();
+		GLint available=0;
+		glGetQueryObjectivARB(tq.queries[1],GL_QUERY_RESULT_AVAILABLE_ARB,&available);
+		if(!available)
+			break;
+		
+		/* Add the measurement to its stage: */
+		GLuint64 timestamps[2];
+		for(int i=0;i<2;++i)
+			dataItem->glGetQueryObjectui64vProc(tq.queries[i],GL_QUERY_RESULT_ARB,&timestamps[i]);
+		addSample(tq.stageIndex,double(timestamps[1]-timestamps[0])*1.0e-6);
+		
+		/* Recycle the query pair: */
+		dataItem->freeQueries.push_back(tq);
+		dataItem->pendingQueries.pop_front();
+		}
+	}
+
+PerformanceProfiler::StageStats PerformanceProfiler::getStageStats(unsigned int stageIndex) const
+	{
+	Threads::Mutex::Lock stageLock(stageMutex);
+	
+	StageStats result;
+	const Stage& s=stages[stageIndex];
+	result.numSamples=s.numSamples;
+	result.last=0.0;
+	result.average=0.0;
+	result.min=0.0;
+	result.max=0.0;
+	for(unsigned int i=0;i<numHistogramBins;++i)
+		result.histogram[i]=0;
+	
+	/* Accumulate all retained samples: */
+	unsigned int numRetained=s.numSamples<historySize?s.numSamples:historySize;
+	if(numRetained>0)
+		{
+		result.last=s.history[(s.nextSample+historySize-1)%historySize];
+		result.min=result.max=result.last;
+		for(unsigned int i=0;i<numRetained;++i)
+			{
+			double sample=s.history[(s.nextSample+historySize-1-i)%historySize];
+			result.average+=sample;
+			if(result.min>sample)
+				result.min=sample;
+			if(result.max<sample)
+				result.max=sample;
+			++result.histogram[getHistogramBin(sample)];
+			}
+		result.average/=double(numRetained);
+		}
+	
+	return result;
+	}
+
+std::string PerformanceProfiler::formatHistogram(const PerformanceProfiler::StageStats& stats)
+	{
+	/* Find the largest bin: */
+	unsigned int maxCount=0;
+	for(unsigned int i=0;i<numHistogramBins;++i)
+		if(maxCount<stats.histogram[i])
+			maxCount=stats.histogram[i];
+	
+	/* Render each bin as a character of increasing density: */
+	const unsigned int numLevels=sizeof(histogramLevels)-1;
+	std::string result;
+	result.push_back('[');
+	for(unsigned int i=0;i<numHistogramBins;++i)
+		{
+		unsigned int level=0;
+		if(stats.histogram[i]>0)
+			level=1+(stats.histogram[i]*(numLevels-2))/maxCount;
+		result.push_back(histogramLevels[level]);
+		}
+	result.push_back(']');
+	
+	return result;
+	}
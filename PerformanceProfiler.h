@@ -0,0 +1,154 @@
+/***********************************************************************
+PerformanceProfiler - Class to collect rolling statistics of the CPU and
+GPU time spent in named processing stages, using non-blocking OpenGL
+timestamp queries for stages running on the GPU.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef PERFORMANCEPROFILER_INCLUDED
+#define PERFORMANCEPROFILER_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <Threads/Mutex.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/GLObject.h>
+
+class PerformanceProfiler:public GLObject
+	{
+	/* Embedded classes: */
+	public:
+	static const unsigned int maxNumStages=32; // Maximum number of stages that can be registered
+	static const unsigned int historySize=128; // Number of most recent samples retained per stage
+	static const unsigned int numHistogramBins=12; // Number of bins in stage time histograms; bin i counts samples between 2^(i-6) and 2^(i-5) ms, the outer bins are open-ended
+	
+	struct StageStats // Structure for the statistics of a stage's most recent samples
+		{
+		/* Elements: */
+		public:
+		unsigned int numSamples; // Total number of samples taken since the stage was registered
+		double last; // Most recent sample in ms
+		double average; // Average of retained samples in ms
+		double min,max; // Range of retained samples in ms
+		unsigned int histogram[numHistogramBins]; // Histogram of retained samples
+		};
+	
+	class CpuTimer // Helper class to measure the CPU time spent in a scope; does nothing if the profiler is NULL
+		{
+		/* Elements: */
+		private:
+		PerformanceProfiler* profiler;
+		unsigned int stageIndex;
+		double startTime;
+		
+		/* Constructors and destructors: */
+		public:
+		CpuTimer(PerformanceProfiler* sProfiler,unsigned int sStageIndex);
+		~CpuTimer(void);
+		};
+	
+	class GpuTimer // Helper class to measure the GPU time spent on the OpenGL commands issued in a scope; does nothing if the profiler is NULL
+		{
+		/* Elements: */
+		private:
+		PerformanceProfiler* profiler;
+		unsigned int stageIndex;
+		GLContextData& contextData;
+		
+		/* Constructors and destructors: */
+		public:
+		GpuTimer(PerformanceProfiler* sProfiler,unsigned int sStageIndex,GLContextData& sContextData);
+		~GpuTimer(void);
+		};
+	
+	private:
+	struct Stage // Structure for a registered stage
+		{
+		/* Elements: */
+		public:
+		std::string name; // Stage name used in displays and statistics dumps
+		bool gpu; // Flag whether the stage measures GPU time
+		unsigned int numSamples; // Total number of samples taken
+		unsigned int nextSample; // Index of the history slot receiving the next sample
+		double history[historySize]; // Ring buffer of most recent samples in ms
+		};
+	
+	struct TimestampQuery // Structure for a pair of timestamp queries bracketing one GPU stage measurement
+		{
+		/* Elements: */
+		public:
+		GLuint queries[2]; // Queries for the start and end timestamps
+		unsigned int stageIndex; // Index of the measured stage
+		};
+	
+	struct DataItem:public GLObject::DataItem
+		{
+		/* Elements: */
+		public:
+		bool haveTimestamps; // Flag whether the context supports GPU timestamp queries
+		PFNGLQUERYCOUNTERPROC glQueryCounterProc; // Entry point of glQueryCounter
+		PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64vProc; // Entry point of glGetQueryObjectui64v
+		std::vector<TimestampQuery> freeQueries; // Query pairs available for new measurements
+		std::deque<TimestampQuery> pendingQueries; // Query pairs of finished measurements whose results were not yet retrieved, in issue order
+		TimestampQuery openQueries[maxNumStages]; // Query pairs of measurements currently in progress
+		bool open[maxNumStages]; // Flags whether a measurement is in progress for each stage
+		
+		/* Constructors and destructors: */
+		DataItem(void);
+		virtual ~DataItem(void);
+		};
+	
+	/* Elements: */
+	mutable Threads::Mutex stageMutex; // Mutex serializing access to the stages' sample histories
+	unsigned int numStages; // Number of registered stages
+	Stage stages[maxNumStages]; // Array of registered stages
+	
+	/* Constructors and destructors: */
+	public:
+	PerformanceProfiler(void); // Creates a profiler with no stages
+	
+	/* Methods from GLObject: */
+	virtual void initContext(GLContextData& contextData) const;
+	
+	/* New methods: */
+	static double getTime(void); // Returns the current monotonic time in seconds
+	unsigned int addStage(const char* name,bool gpu); // Registers a new stage and returns its index
+	unsigned int getNumStages(void) const // Returns the number of registered stages
+		{
+		return numStages;
+		}
+	const std::string& getStageName(unsigned int stageIndex) const // Returns the name of the given stage
+		{
+		return stages[stageIndex].name;
+		}
+	bool isGpuStage(unsigned int stageIndex) const // Returns true if the given stage measures GPU time
+		{
+		return stages[stageIndex].gpu;
+		}
+	void addSample(unsigned int stageIndex,double time); // Adds a sample in ms to the given stage; can be called from any thread
+	void beginGpuStage(unsigned int stageIndex,GLContextData& contextData); // Starts measuring the GPU time of the given stage in the given OpenGL context
+	void endGpuStage(unsigned int stageIndex,GLContextData& contextData); // Stops measuring the GPU time of the given stage in the given OpenGL context
+	void processGpuResults(GLContextData& contextData); // Adds the results of all finished GPU measurements in the given OpenGL context without waiting for outstanding ones
+	StageStats getStageStats(unsigned int stageIndex) const; // Returns statistics of the given stage's retained samples
+	static std::string formatHistogram(const StageStats& stats); // Returns a one-line text rendering of the given stage statistics' histogram
+	};
+
+#endif
@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Geometry/Plane.h>
 
 #include "FindBlobs.h"
+#include "ValidPixelProperty.h"
 
 template <>
 class BlobProperty<unsigned short> // Class to calculate the 3D centroid of a blob in depth image space
@@ -110,94 +111,6 @@ class BlobProperty<float> // Class to calculate the 3D centroid of a blob in dep
 		}
 	};
 
-class ValidPixelProperty // Functor class to identify valid pixels in raw depth frames
-	{
-	/* Elements: */
-	private:
-	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
-	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
-	Geometry::Matrix<float,3,4> colorDepthHomography; // Homography from 3D depth image space into 2D color image space
-	unsigned int colorSize[2]; // Width and height of color frames
-	const unsigned char* colorFrame; // The current color frame
-	
-	/* Constructors and destructors: */
-	public:
-	ValidPixelProperty(const float sMinPlane[4],const float sMaxPlane[4],const Geometry::Matrix<float,3,4>& sColorDepthHomography,const unsigned int sColorSize[2])
-		:colorDepthHomography(sColorDepthHomography),
-		 colorFrame(0)
-		{
-		/* Copy the min and max plane equations: */
-		for(int i=0;i<4;++i)
-			minPlane[i]=sMinPlane[i];
-		for(int i=0;i<4;++i)
-			maxPlane[i]=sMaxPlane[i];
-		
-		/* Copy the color image size: */
-		for(int i=0;i<2;++i)
-			colorSize[i]=sColorSize[i];
-		}
-	
-	/* Methods: */
-	public:
-	void setColorFrame(const unsigned char* newColorFrame) // Sets the color frame for the next blob extraction
-		{
-		colorFrame=newColorFrame;
-		}
-	bool operator()(unsigned int x,unsigned int y,const unsigned short& pixel) const
-		{
-		return operator()(x,y,float(pixel));
-		}
-	bool operator()(unsigned int x,unsigned int y,const float& pixel) const
-		{
-		/* Plug the pixel into the plane equations to determine its validity: */
-		float px=float(x)+0.5f;
-		float py=float(y)+0.5f;
-		float pz=pixel;
-		float minD=minPlane[0]*px+minPlane[1]*py+minPlane[2]*pz+minPlane[3];
-		float maxD=maxPlane[0]*px+maxPlane[1]*py+maxPlane[2]*pz+maxPlane[3];
-		if(minD<0.0f||maxD>0.0f)
-			return false;
-		
-		#if 0
-		
-		/* Project the pixel into the color frame: */
-		Geometry::ComponentArray<float,3> colorPos=colorDepthHomography*Geometry::ComponentArray<float,4>(px,py,pz,1.0f);
-		int cx=int(Math::floor(colorPos[0]/colorPos[2]));
-		int cy=int(Math::floor(colorPos[1]/colorPos[2]));
-		if(cx<0||cx>=colorSize[0]||cy<0||cy>=colorSize[1])
-			return false;
-		
-		#if 0
-		
-		/* Check if the pixel is mostly black-ish: */
-		const unsigned char* rgb=colorFrame+((cy*colorSize[0]+cx)*3);
-		return rgb[0]<64U&&rgb[1]<64U&&rgb[2]<64U;
-		
-		#else
-		
-		/* Normalize the pixel's color: */
-		const unsigned char* rgb=colorFrame+((cy*colorSize[0]+cx)*3);
-		unsigned char max=rgb[0];
-		for(int i=1;i<3;++i)
-			if(max<rgb[i])
-				max=rgb[i];
-		float rgb0[3];
-		for(int i=0;i<3;++i)
-			rgb0[i]=float(rgb[i])/float(max);
-		
-		/* Check if the color is red-ish: */
-		return rgb0[0]>=0.8f&&rgb0[1]<0.25f&&rgb0[2]<0.25f;
-		
-		#endif
-		
-		#else
-		
-		return true;
-		
-		#endif
-		}
-	};
-
 /**************************
 Methods of class RainMaker:
 **************************/
@@ -207,7 +120,7 @@ inline
 void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,RainMaker::BlobList& blobsCc)
 	{
 	/* Extract raw blobs from the depth frame: */
-	std::vector< ::Blob<DepthPixelParam> > blobsDic=findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp);
+	std::vector< ::Blob<DepthPixelParam> > blobsDic=findBlobs(depthSize,depthFrame.getData<DepthPixelParam>(),vpp,numThreads);
 	
 	/* Transform all blobs larger than the threshold to camera space: */
 	blobsCc.reserve(blobsDic.size());
@@ -233,17 +146,39 @@ void RainMaker::extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPi
 			}
 	}
 
+void RainMaker::updateColorDepthHomography(void)
+	{
+	/* Calculate the direct homography from depth image space to color image space: */
+	PTransform hom=PTransform::scale(PTransform::Scale(double(colorSize[0]),double(colorSize[1]),1.0)); // Go to color image space
+	hom*=colorProjection; // Go to color texture space
+	
+	/* Remove the superfluous z component row: */
+	for(int i=0;i<2;++i)
+		for(int j=0;j<4;++j)
+			colorDepthHomography(i,j)=float(hom.getMatrix()(i,j));
+	for(int j=0;j<4;++j)
+		colorDepthHomography(2,j)=float(hom.getMatrix()(3,j));
+	}
+
 void* RainMaker::detectionThreadMethod(void)
 	{
 	unsigned int lastInputDepthFrameVersion=0;
 	unsigned int lastInputColorFrameVersion=0;
 	
 	/* Create a pixel validity decider: */
-	ValidPixelProperty vpp(minPlane,maxPlane,colorDepthHomography,colorSize);
+	unsigned int lastHomographyVersion;
+	Geometry::Matrix<float,3,4> homography;
+	{
+	Threads::MutexCond::Lock inputLock(inputCond);
+	lastHomographyVersion=homographyVersion;
+	homography=colorDepthHomography;
+	}
+	ValidPixelProperty vpp(minPlane,maxPlane,homography,depthSize,colorSize);
 	
 	while(true)
 		{
 		Kinect::FrameBuffer depthFrame,colorFrame;
+		bool homographyChanged;
 		{
 		Threads::MutexCond::Lock inputLock(inputCond);
 		
@@ -260,8 +195,20 @@ void* RainMaker::detectionThreadMethod(void)
 		colorFrame=inputColorFrame;
 		lastInputDepthFrameVersion=inputDepthFrameVersion;
 		lastInputColorFrameVersion=inputColorFrameVersion;
+		
+		/* Pick up a changed color homography: */
+		homographyChanged=lastHomographyVersion!=homographyVersion;
+		if(homographyChanged)
+			{
+			lastHomographyVersion=homographyVersion;
+			homography=colorDepthHomography;
+			}
 		}
 		
+		/* Rebuild the pixel validity decider's lookup table if the color homography changed: */
+		if(homographyChanged)
+			vpp.setColorDepthHomography(homography);
+		
 		if(outputBlobsFunction!=0)
 			{
 			/* Set the most recent color frame in the pixel validator: */
@@ -284,6 +231,7 @@ void* RainMaker::detectionThreadMethod(void)
 
 RainMaker::RainMaker(const unsigned int sDepthSize[2],const unsigned int sColorSize[2],const RainMaker::PTransform& sDepthProjection,const RainMaker::PTransform& sColorProjection,const RainMaker::Plane& basePlane,double minElevation,double maxElevation,int sMinBlobSize)
 	:depthIsFloat(false),
+	 numThreads(1),
 	 outputBlobsFunction(0)
 	{
 	/* Remember the frame sizes: */
@@ -296,16 +244,9 @@ RainMaker::RainMaker(const unsigned int sDepthSize[2],const unsigned int sColorS
 	depthProjection=sDepthProjection;
 	colorProjection=sColorProjection;
 	
-	/* Calculate the direct homography from depth image space to color image space: */
-	PTransform hom=PTransform::scale(PTransform::Scale(double(colorSize[0]),double(colorSize[1]),1.0)); // Go to color image space
-	hom*=colorProjection; // Go to color texture space
-	
-	/* Remove the superfluous z component row: */
-	for(int i=0;i<2;++i)
-		for(int j=0;j<4;++j)
-			colorDepthHomography(i,j)=float(hom.getMatrix()(i,j));
-	for(int j=0;j<4;++j)
-		colorDepthHomography(2,j)=float(hom.getMatrix()(3,j));
+	/* Calculate the initial homography from depth image space to color image space: */
+	homographyVersion=0;
+	updateColorDepthHomography();
 	
 	/* Initialize the input frame slot: */
 	inputDepthFrameVersion=0;
@@ -354,6 +295,21 @@ void RainMaker::setDepthIsFloat(bool newDepthIsFloat)
 	depthIsFloat=newDepthIsFloat;
 	}
 
+void RainMaker::setNumThreads(unsigned int newNumThreads)
+	{
+	numThreads=newNumThreads>0?newNumThreads:1;
+	}
+
+void RainMaker::setColorProjection(const RainMaker::PTransform& newColorProjection)
+	{
+	Threads::MutexCond::Lock inputLock(inputCond);
+	
+	/* Update the color homography and tell the detection thread to rebuild its lookup table: */
+	colorProjection=newColorProjection;
+	updateColorDepthHomography();
+	++homographyVersion;
+	}
+
 void RainMaker::setOutputBlobsFunction(RainMaker::OutputBlobsFunction* newOutputBlobsFunction)
 	{
 	delete outputBlobsFunction;
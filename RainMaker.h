@@ -70,9 +70,11 @@ class RainMaker
 	PTransform depthProjection; // Projective transformation from depth image space to camera space
 	PTransform colorProjection; // Projective transformation from camera space to color image space
 	Geometry::Matrix<float,3,4> colorDepthHomography; // Homography from 3D depth image space into 2D color image space
+	unsigned int homographyVersion; // Version number of the color homography, protected by the input condition variable's mutex
 	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
 	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
 	int minBlobSize; // Minimum size of objects to be detected
+	unsigned int numThreads; // Number of threads to use for blob extraction
 	Threads::MutexCond inputCond; // Condition variable to signal arrival of a new input frame
 	Kinect::FrameBuffer inputDepthFrame; // The most recent input depth frame
 	unsigned int inputDepthFrameVersion; // Version number of input depth frame
@@ -83,6 +85,7 @@ class RainMaker
 	OutputBlobsFunction* outputBlobsFunction; // Function called when a new (potentially empty) object list has been extracted
 	
 	/* Private methods: */
+	void updateColorDepthHomography(void); // Calculates the homography from depth image space to color image space from the current projections
 	template <class DepthPixelParam>
 	void extractBlobs(const Kinect::FrameBuffer& depthFrame,const ValidPixelProperty& vpp,BlobList& blobsCc);
 	void* detectionThreadMethod(void); // Method for the object detection thread
@@ -94,6 +97,8 @@ class RainMaker
 	
 	/* Methods: */
 	void setDepthIsFloat(bool newDepthIsFloat); // Sets whether incoming depth frames have float pixel values
+	void setColorProjection(const PTransform& newColorProjection); // Sets a new projection from camera space to color image space after the color camera was re-calibrated
+	void setNumThreads(unsigned int newNumThreads); // Sets the number of threads to use for blob extraction
 	void setOutputBlobsFunction(OutputBlobsFunction* newOutputBlobsFunction); // Sets the output function; adopts given functor object
 	void receiveRawDepthFrame(const Kinect::FrameBuffer& newDepthFrame); // Called to receive a new raw depth frame
 	void receiveRawColorFrame(const Kinect::FrameBuffer& newColorFrame); // Called to receive a new raw color frame
@@ -23,6 +23,13 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include "RemoteServer.h"
 
 #include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
 #include <Misc/SizedTypes.h>
 #include <Misc/MessageLogger.h>
 #include <Math/Math.h>
@@ -33,6 +40,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/GLTransformationWrappers.h>
 
 #include "WaterTable2.h"
+#include "GridReadback.h"
+#include "GridCodec.h"
+#include "GridLODCodec.h"
 #include "Sandbox.h"
 
 /*************************************
@@ -42,7 +52,10 @@ Methods of class RemoteServer::Client:
 RemoteServer::Client::Client(RemoteServer* sServer)
 	:server(sServer),
 	 clientPipe(server->listenSocket),
-	 state(START)
+	 state(START),
+	 protocolVersion(0),
+	 havePosition(false),
+	 sendOffset(0),listeningForWrite(false)
 	{
 	}
 
@@ -120,54 +133,156 @@ bool RemoteServer::newConnectionCallback(Threads::EventDispatcher::ListenerKey e
 	return false;
 	}
 
-bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData)
+void RemoteServer::readClientMessage(RemoteServer::Client* client)
 	{
-	/* Get a pointer to the client object: */
-	Client* client=static_cast<Client*>(userData);
-	RemoteServer* server=client->server;
-	
-	try
+	/* Handle incoming message based on the client's state: */
+	switch(client->state)
 		{
-		/* Handle incoming message based on the client's state: */
-		switch(client->state)
+		case Client::START:
 			{
-			case Client::START:
+			/* Read an endianness token; clients supporting compressed streaming send a different token: */
+			Misc::UInt32 token=client->clientPipe.read<Misc::UInt32>();
+			if(token==0x78563412U||token==0x21436587U)
+				client->clientPipe.setSwapOnRead(true);
+			else if(token!=0x12345678U&&token!=0x87654321U)
+				throw std::runtime_error("Invalid endianness token");
+			
+			if(token==0x87654321U||token==0x21436587U)
 				{
-				/* Read an endianness token: */
-				Misc::UInt32 token=client->clientPipe.read<Misc::UInt32>();
-				if(token==0x78563412U)
-					client->clientPipe.setSwapOnRead(true);
-				else if(token!=0x12345678U)
-					throw std::runtime_error("Invalid endianness token");
+				/* Agree on the highest protocol version supported by both sides and tell the client: */
+				unsigned int clientVersion=client->clientPipe.read<Misc::UInt32>();
+				client->protocolVersion=clientVersion<GridCodec::protocolVersion?clientVersion:GridCodec::protocolVersion;
+				client->clientPipe.write<Misc::UInt32>(client->protocolVersion);
 				
-				/* Go to the next state: */
-				client->state=Client::STREAMING;
-				++server->numClients;
-				break;
+				if(client->protocolVersion>=2)
+					{
+					/* Tell the client the base layer's resolution reduction factor; the client does not hold any full-resolution tiles yet: */
+					client->clientPipe.write<Misc::UInt32>(lodCodec->getBaseFactor());
+					client->detailTiles.assign(lodCodec->getMaskSize(),Misc::UInt8(0));
+					client->sentDetailTiles=client->detailTiles;
+					}
+				client->clientPipe.flush();
 				}
 			
-			case Client::STREAMING:
+			/* Go to the next state: */
+			client->state=Client::STREAMING;
+			++numClients;
+			break;
+			}
+		
+		case Client::STREAMING:
+			{
+			/* Read the message token: */
+			unsigned int token=client->clientPipe.read<Misc::UInt16>();
+			switch(token)
 				{
-				/* Read the message token: */
-				unsigned int token=client->clientPipe.read<Misc::UInt16>();
-				switch(token)
-					{
-					case 0: // Position update message
-						Misc::Float32 pos[3];
-						client->clientPipe.read(pos,3);
-						client->position=Vrui::Point(pos);
-						Misc::Float32 dir[3];
-						client->clientPipe.read(dir,3);
-						client->direction=Vrui::Vector(dir);
-						break;
-					
-					default:
-						throw std::runtime_error("Invalid client message");
-					}
-				break;
+				case 0: // Position update message
+					Misc::Float32 pos[3];
+					client->clientPipe.read(pos,3);
+					client->position=Vrui::Point(pos);
+					Misc::Float32 dir[3];
+					client->clientPipe.read(dir,3);
+					client->direction=Vrui::Vector(dir);
+					client->havePosition=true;
+					break;
+				
+				default:
+					throw std::runtime_error("Invalid client message");
 				}
+			break;
 			}
 		}
+	}
+
+void RemoteServer::sendQueuedFrames(RemoteServer::Client* client)
+	{
+	/* Write queued messages directly to the client's socket until it would block: */
+	int fd=client->clientPipe.getFd();
+	while(!client->sendQueue.empty())
+		{
+		QueuedFrame& front=client->sendQueue.front();
+		const std::vector<Misc::UInt8>& data=front.frame->data;
+		ssize_t numSent=send(fd,&data[client->sendOffset],data.size()-client->sendOffset,MSG_DONTWAIT|MSG_NOSIGNAL);
+		if(numSent>=0)
+			{
+			/* Remove the front message once it has been sent completely, and remember the grids the client holds after decoding it: */
+			client->sendOffset+=size_t(numSent);
+			if(client->sendOffset==data.size())
+				{
+				client->sentReference=front.state;
+				client->sentDetailTiles.swap(front.detailTiles);
+				client->sendQueue.pop_front();
+				client->sendOffset=0;
+				}
+			}
+		else if(errno==EAGAIN||errno==EWOULDBLOCK)
+			break;
+		else if(errno!=EINTR)
+			throw std::runtime_error(std::string("Unable to send to client due to error ")+strerror(errno));
+		}
+	
+	/* Wait for the client's socket to accept more data while there are unsent messages: */
+	bool needWrite=!client->sendQueue.empty();
+	if(client->listeningForWrite!=needWrite)
+		{
+		dispatcher.setIOEventListenerEventTypeMask(client->listenerKey,needWrite?Threads::EventDispatcher::Read|Threads::EventDispatcher::Write:Threads::EventDispatcher::Read);
+		client->listeningForWrite=needWrite;
+		}
+	}
+
+void RemoteServer::dropUnsentFrames(RemoteServer::Client* client)
+	{
+	/* Keep only the front message if part of it is already on the wire: */
+	size_t numKeep=client->sendOffset>0?1:0;
+	if(client->sendQueue.size()<=numKeep)
+		return;
+	client->sendQueue.resize(numKeep);
+	
+	/* Rewind the client's reference to the grids it will hold after decoding the remaining message, or the last completely sent one: */
+	if(numKeep>0)
+		{
+		client->reference=client->sendQueue.front().state;
+		client->detailTiles=client->sendQueue.front().detailTiles;
+		}
+	else
+		{
+		client->reference=client->sentReference;
+		client->detailTiles=client->sentDetailTiles;
+		}
+	}
+
+RemoteServer::FramePtr RemoteServer::createFrame(const void* data,size_t dataSize,bool sizePrefix)
+	{
+	/* Copy the data in the server's native byte order, which clients adapt to via the endianness token: */
+	FramePtr frame(new Frame);
+	size_t prefixSize=sizePrefix?sizeof(Misc::UInt32):0;
+	frame->data.resize(prefixSize+dataSize);
+	if(sizePrefix)
+		{
+		Misc::UInt32 size=Misc::UInt32(dataSize);
+		memcpy(&frame->data[0],&size,sizeof(Misc::UInt32));
+		}
+	memcpy(&frame->data[prefixSize],data,dataSize);
+	
+	return frame;
+	}
+
+bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData)
+	{
+	/* Get a pointer to the client object: */
+	Client* client=static_cast<Client*>(userData);
+	RemoteServer* server=client->server;
+	
+	try
+		{
+		/* Continue sending queued messages if the client's socket accepts more data: */
+		if(eventType&Threads::EventDispatcher::Write)
+			server->sendQueuedFrames(client);
+		
+		/* Handle an incoming message: */
+		if(eventType&Threads::EventDispatcher::Read)
+			server->readClientMessage(client);
+		}
 	catch(const std::runtime_error& err)
 		{
 		/* Disconnect the client or something: */
@@ -181,6 +296,56 @@ bool RemoteServer::clientMessageCallback(Threads::EventDispatcher::ListenerKey e
 	return false;
 	}
 
+void RemoteServer::quantizeGrids(const GLfloat* bathymetry,const GLfloat* waterLevel,Misc::UInt16* quantizedGrids) const
+	{
+	/* Calculate elevation quantization factors: */
+	GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
+	GLfloat eOffset=0.5f-elevationRange[0]*eScale;
+	
+	/* Quantize the corner-centered bathymetry grid followed by the cell-centered water level grid: */
+	size_t numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+	size_t numWaterLevelValues=size_t(gridSize[1])*size_t(gridSize[0]);
+	GridCodec::quantize(bathymetry,numBathymetryValues,eScale,eOffset,quantizedGrids);
+	GridCodec::quantize(waterLevel,numWaterLevelValues,eScale,eOffset,quantizedGrids+numBathymetryValues);
+	}
+
+void RemoteServer::selectDetailTiles(const RemoteServer::Client* client,Misc::UInt8* tileMask) const
+	{
+	memset(tileMask,0,lodCodec->getMaskSize());
+	
+	/* Send only the base layer until the client's position is known: */
+	if(!client->havePosition)
+		return;
+	
+	/* Project the client's viewing direction into the grid plane: */
+	GLfloat dir[2];
+	for(int i=0;i<2;++i)
+		dir[i]=GLfloat(client->direction[i]);
+	GLfloat dirLen=Math::sqrt(dir[0]*dir[0]+dir[1]*dir[1]);
+	
+	/* Flag all tiles whose bounding circles overlap the near region or the field of view: */
+	GLfloat tileRadius=lodCodec->getTileRadius()*Math::max(cellSize[0],cellSize[1]);
+	size_t numTiles=lodCodec->getNumTiles();
+	for(size_t tileIndex=0;tileIndex<numTiles;++tileIndex)
+		{
+		const float* center=lodCodec->getTileCenter(tileIndex);
+		GLfloat d[2];
+		for(int i=0;i<2;++i)
+			d[i]=center[i]*cellSize[i]-GLfloat(client->position[i]);
+		GLfloat dist=Math::sqrt(d[0]*d[0]+d[1]*d[1]);
+		bool detail=dist<=detailRadius+tileRadius;
+		if(!detail&&dist<=viewRadius+tileRadius&&dirLen>0.0f)
+			{
+			/* Widen the field of view by the angle the tile's bounding circle subtends: */
+			GLfloat cosAngle=(d[0]*dir[0]+d[1]*dir[1])/(dist*dirLen);
+			GLfloat angle=Math::acos(Math::max(Math::min(cosAngle,1.0f),-1.0f));
+			detail=angle<=viewHalfAngle+Math::asin(Math::min(tileRadius/dist,1.0f));
+			}
+		if(detail)
+			tileMask[tileIndex>>3]|=Misc::UInt8(1U<<(tileIndex&0x7U));
+		}
+	}
+
 void* RemoteServer::communicationThreadMethod(void)
 	{
 	/* Dispatch events on the communications socket(s) until stopped by the main thread: */
@@ -199,86 +364,160 @@ void* RemoteServer::communicationThreadMethod(void)
 				}
 		clientPositions.postNewValue();
 		
-		/* Check if there is a new grid pair: */
-		if(grids.lockNewValue())
+		/* Check if there is a new shared grid snapshot: */
+		const GridReadback::Snapshot* snapshot=sandbox->gridReadback->acquireSnapshot();
+		if(snapshot!=0&&snapshot->getGeneration()!=sentGeneration)
 			{
-			/* Send the new grid pair to all connected clients in streaming state: */
+			/* Quantize the new grid pair once for all clients into a new grid state, which remains alive while any client references it: */
+			sentGeneration=snapshot->getGeneration();
+			GridStatePtr state(new GridState);
+			state->grids.resize(gridCodec->getNumValues());
+			quantizeGrids(snapshot->getBathymetry(),snapshot->getWaterLevel(),&state->grids.front());
+			const GridState* previous=previousState.getPointer();
+			
+			/* Queue the grid pair for all connected clients in streaming state, encoding each shared message at most once: */
+			FramePtr deltaMessage,keyMessage,rawMessage;
+			bool haveDeltaMessage=false;
+			bool haveKeyMessage=false;
+			bool haveRawMessage=false;
+			bool haveBaseDeltaFrame=false;
+			bool haveBaseKeyFrame=false;
 			std::vector<Client*> deadClients;
-			const GLfloat* bathymetry=grids.getLockedValue().bathymetry;
-			const GLfloat* waterLevel=grids.getLockedValue().waterLevel;
 			for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
 				if((*cIt)->state==Client::STREAMING)
 					{
-					/* Calculate elevation quantization factors: */
-					GLfloat eScale=65535.0f/(elevationRange[1]-elevationRange[0]);
-					GLfloat eOffset=0.5f-elevationRange[0]*eScale;
+					Client* client=*cIt;
 					
-					try
+					/* Replace any stale messages of a client that fell behind with the new grid pair, which is then encoded against the last grids the client will actually receive: */
+					dropUnsentFrames(client);
+					const GridState* reference=client->reference.getPointer();
+					
+					QueuedFrame queuedFrame;
+					if(client->protocolVersion>=2)
 						{
-						Comm::TCPPipe& clientPipe=(*cIt)->clientPipe;
+						/* Sample the shared base layer: */
+						if(state->baseGrids.empty())
+							{
+							state->baseGrids.resize(lodCodec->getNumBaseValues());
+							lodCodec->downsample(&state->grids.front(),&state->baseGrids.front());
+							}
 						
-						/* Send the bathymetry grid: */
-						const GLfloat* bPtr=bathymetry;
-						for(GLsizei y=0;y<gridSize[1]-1;++y)
-							for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
+						/* Encode the base layer, sharing it between all clients that received the previous snapshot, and resend all full-resolution tiles after a keyframe: */
+						const std::vector<Misc::UInt8>* baseFrame;
+						if(reference==0)
+							{
+							if(!haveBaseKeyFrame)
 								{
-								GLfloat se=*bPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
+								lodCodec->encodeBase(&state->baseGrids.front(),0,baseKeyFrame);
+								haveBaseKeyFrame=true;
 								}
-						
-						/* Send the water level grid: */
-						const GLfloat* wlPtr=waterLevel;
-						for(GLsizei y=0;y<gridSize[1];++y)
-							for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
+							baseFrame=&baseKeyFrame;
+							std::fill(client->detailTiles.begin(),client->detailTiles.end(),Misc::UInt8(0));
+							}
+						else if(reference==previous)
+							{
+							if(!haveBaseDeltaFrame)
 								{
-								GLfloat se=*wlPtr*eScale+eOffset;
-								if(se<=0.0f)
-									clientPipe.write<Misc::UInt16>(0U);
-								else if(se>=65535.0f)
-									clientPipe.write<Misc::UInt16>(65535U);
-								else
-									clientPipe.write<Misc::UInt16>(Misc::UInt16(se));
+								lodCodec->encodeBase(&state->baseGrids.front(),&previous->baseGrids.front(),baseDeltaFrame);
+								haveBaseDeltaFrame=true;
 								}
+							baseFrame=&baseDeltaFrame;
+							}
+						else
+							{
+							lodCodec->encodeBase(&state->baseGrids.front(),&reference->baseGrids.front(),clientBaseFrame);
+							baseFrame=&clientBaseFrame;
+							}
+						
+						/* Select the client's full-resolution tiles; tiles the client does not hold yet are sent relative to zero: */
+						selectDetailTiles(client,&newDetailTiles.front());
+						for(size_t i=0;i<newDetailTiles.size();++i)
+							keyTiles[i]=newDetailTiles[i]&~client->detailTiles[i];
+						client->detailTiles.swap(newDetailTiles);
 						
-						/* Finish the message: */
-						clientPipe.flush();
+						/* Combine the base layer and the client's full-resolution tiles into a message for this client only: */
+						lodCodec->encodeMessage(*baseFrame,&state->grids.front(),reference!=0?&reference->grids.front():0,&client->detailTiles.front(),&keyTiles.front(),encodedFrame);
+						queuedFrame.frame=createFrame(&encodedFrame.front(),encodedFrame.size(),true);
+						queuedFrame.state=state;
+						queuedFrame.detailTiles=client->detailTiles;
+						}
+					else if(client->protocolVersion>=1)
+						{
+						if(reference==0)
+							{
+							if(!haveKeyMessage)
+								{
+								gridCodec->encode(&state->grids.front(),0,encodedFrame);
+								keyMessage=createFrame(&encodedFrame.front(),encodedFrame.size(),true);
+								haveKeyMessage=true;
+								}
+							queuedFrame.frame=keyMessage;
+							}
+						else if(reference==previous)
+							{
+							if(!haveDeltaMessage)
+								{
+								gridCodec->encode(&state->grids.front(),&previous->grids.front(),encodedFrame);
+								deltaMessage=createFrame(&encodedFrame.front(),encodedFrame.size(),true);
+								haveDeltaMessage=true;
+								}
+							queuedFrame.frame=deltaMessage;
+							}
+						else
+							{
+							/* Encode a delta frame against the older grids held by a client that fell behind: */
+							gridCodec->encode(&state->grids.front(),&reference->grids.front(),encodedFrame);
+							queuedFrame.frame=createFrame(&encodedFrame.front(),encodedFrame.size(),true);
+							}
+						queuedFrame.state=state;
+						}
+					else
+						{
+						/* Send both raw grids as a single message: */
+						if(!haveRawMessage)
+							{
+							rawMessage=createFrame(&state->grids.front(),state->grids.size()*sizeof(Misc::UInt16),false);
+							haveRawMessage=true;
+							}
+						queuedFrame.frame=rawMessage;
+						}
+					client->reference=queuedFrame.state;
+					client->sendQueue.push_back(queuedFrame);
+					
+					try
+						{
+						/* Send as much as the client's socket accepts without blocking: */
+						sendQueuedFrames(client);
 						}
 					catch(const std::runtime_error& err)
 						{
 						/* Disconnect the client: */
 						Misc::formattedConsoleWarning("RemoteServer: Disconnecting client due to exception %s",err.what());
-						deadClients.push_back(*cIt);
+						deadClients.push_back(client);
 						}
 					}
 			
+			/* Keep the sent grid pair as reference for the next shared delta frames: */
+			previousState=state;
+			
 			/* Disconnect all dead clients: */
 			for(std::vector<Client*>::iterator dcIt=deadClients.begin();dcIt!=deadClients.end();++dcIt)
 				disconnectClient(*dcIt,true);
 			}
+		if(snapshot!=0)
+			sandbox->gridReadback->releaseSnapshot(snapshot);
 		}
 	
 	return 0;
 	}
 
-void RemoteServer::readBackCallback(GLfloat*,GLfloat*,void* userData)
-	{
-	RemoteServer* thisPtr=static_cast<RemoteServer*>(userData);
-	
-	/* Post the new grids to the grid triple buffer and wake up the communication thread: */
-	thisPtr->grids.postNewValue();
-	thisPtr->dispatcher.interrupt();
-	}
-
-RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInterval)
+RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInterval,unsigned int baseFactor,GLfloat sDetailRadius,GLfloat sViewRadius,GLfloat viewAngle)
 	:sandbox(sSandbox),
 	 listenSocket(listenPortId,0),
 	 numClients(0),
-	 requestInterval(sRequestInterval),nextRequestTime(0.0)
+	 requestInterval(sRequestInterval),nextRequestTime(0.0),
+	 notifiedGeneration(0),sentGeneration(0),
+	 detailRadius(sDetailRadius),viewRadius(sViewRadius),viewHalfAngle(Math::rad(viewAngle)*0.5f)
 	{
 	/* Ignore SIGPIPE and leave handling of pipe errors to TCP sockets: */
 	struct sigaction sigPipeAction;
@@ -301,9 +540,16 @@ RemoteServer::RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInt
 	elevationRange[0]-=(elevationRange[1]-elevationRange[0])*0.05f;
 	elevationRange[1]+=(elevationRange[1]-elevationRange[0])*0.05f;
 	
-	/* Allocate the bathymetry and water level grids: */
-	for(int i=0;i<3;++i)
-		grids.getBuffer(i).init(gridSize);
+	/* Create the grid pair codec: */
+	unsigned int codecGridSize[2];
+	for(int i=0;i<2;++i)
+		codecGridSize[i]=gridSize[i];
+	gridCodec=new GridCodec(codecGridSize);
+	
+	/* Create the level-of-detail codec and allocate its buffers: */
+	lodCodec=new GridLODCodec(codecGridSize,baseFactor);
+	newDetailTiles.resize(lodCodec->getMaskSize());
+	keyTiles.resize(lodCodec->getMaskSize());
 	
 	/* Start listening for incoming connections on the listening sockets: */
 	dispatcher.addIOEventListener(listenSocket.getFd(),Threads::EventDispatcher::Read,newConnectionCallback,this);
@@ -319,6 +565,9 @@ RemoteServer::~RemoteServer(void)
 	/* Disconnect all clients: */
 	for(std::vector<Client*>::iterator cIt=clients.begin();cIt!=clients.end();++cIt)
 		delete *cIt;
+	
+	delete gridCodec;
+	delete lodCodec;
 	}
 
 void RemoteServer::frame(double applicationTime)
@@ -329,13 +578,19 @@ void RemoteServer::frame(double applicationTime)
 	/* Check if it's time to request a new set of grids: */
 	if(numClients>0&&applicationTime>=nextRequestTime)
 		{
-		/* Request new grids: */
-		GridBuffers& gb=grids.startNewValue();
-		if(sandbox->gridRequest.requestGrids(gb.bathymetry,gb.waterLevel,&RemoteServer::readBackCallback,this))
-			{
-			/* Push the next request time forward: */
-			nextRequestTime=(Math::floor(applicationTime/requestInterval)+1.0)*requestInterval;
-			}
+		/* Request a new shared grid snapshot, which may also serve other consumers: */
+		sandbox->gridReadback->requestSnapshot();
+		
+		/* Push the next request time forward: */
+		nextRequestTime=(Math::floor(applicationTime/requestInterval)+1.0)*requestInterval;
+		}
+	
+	/* Wake up the communication thread if a new snapshot has been published: */
+	unsigned int generation=sandbox->gridReadback->getSnapshotGeneration();
+	if(numClients>0&&generation!=notifiedGeneration)
+		{
+		notifiedGeneration=generation;
+		dispatcher.interrupt();
 		}
 	}
 
@@ -24,6 +24,10 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #define REMOTESERVER_INCLUDED
 
 #include <vector>
+#include <deque>
+#include <Misc/SizedTypes.h>
+#include <Misc/Autopointer.h>
+#include <Threads/RefCounted.h>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -37,36 +41,40 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 /* Forward declarations: */
 class GLContextData;
+class GridCodec;
+class GridLODCodec;
 class Sandbox;
 
 class RemoteServer
 	{
 	/* Embedded classes: */
 	private:
-	struct GridBuffers // Structure representing a pair of grids
+	struct Frame:public Threads::RefCounted // Structure for a message in wire format, shared by the send queues of all clients receiving it
 		{
 		/* Elements: */
 		public:
-		GLfloat* bathymetry;
-		GLfloat* waterLevel;
-		
-		/* Constructors and destructors: */
-		GridBuffers(void)
-			:bathymetry(0),waterLevel(0)
-			{
-			}
-		~GridBuffers(void)
-			{
-			delete[] bathymetry;
-			delete[] waterLevel;
-			}
-		
-		/* Methods: */
-		void init(const GLsizei gridSize[2]) // Initializes the grids
-			{
-			bathymetry=new GLfloat[(gridSize[1]-1)*(gridSize[0]-1)];
-			waterLevel=new GLfloat[gridSize[1]*gridSize[0]];
-			}
+		std::vector<Misc::UInt8> data; // The message's bytes
+		};
+	
+	typedef Misc::Autopointer<Frame> FramePtr; // Type for pointers to shared messages
+	
+	struct GridState:public Threads::RefCounted // Structure for the quantized grids of a sent snapshot, shared by all clients decoding it
+		{
+		/* Elements: */
+		public:
+		std::vector<Misc::UInt16> grids; // Quantized bathymetry and water level grids back-to-back in wire format
+		std::vector<Misc::UInt16> baseGrids; // Base layer of the quantized grids; only sampled if the snapshot was sent to a level-of-detail client
+		};
+	
+	typedef Misc::Autopointer<GridState> GridStatePtr; // Type for pointers to shared grid states
+	
+	struct QueuedFrame // Structure for a message in a client's send queue
+		{
+		/* Elements: */
+		public:
+		FramePtr frame; // The message
+		GridStatePtr state; // Grids held by the client after decoding the message; null for raw messages
+		std::vector<Misc::UInt8> detailTiles; // Mask of full-resolution tiles held by the client after decoding the message
 		};
 	
 	struct Client // Structure representing a remote client
@@ -83,8 +91,17 @@ class RemoteServer
 		Comm::TCPPipe clientPipe; // Pipe connected to the remote client
 		Threads::EventDispatcher::ListenerKey listenerKey; // Key with which this client is listening for I/O events
 		ClientStates state; // Client's protocol state
+		unsigned int protocolVersion; // Streaming protocol version agreed upon with the client; 0 for raw grids
+		bool havePosition; // Flag if the client has sent its position at least once
 		Vrui::Point position; // Client's current position in grid space
 		Vrui::Vector direction; // Client's current viewing direction in grid space
+		GridStatePtr reference; // Grids held by the client after decoding all queued messages, against which the next delta frame is encoded; null if the client needs a keyframe
+		std::vector<Misc::UInt8> detailTiles; // Mask of full-resolution tiles held by the client after decoding all queued level-of-detail messages
+		GridStatePtr sentReference; // Grids held by the client after decoding the most recent completely sent message
+		std::vector<Misc::UInt8> sentDetailTiles; // Mask of full-resolution tiles held by the client after decoding the most recent completely sent message
+		std::deque<QueuedFrame> sendQueue; // Messages waiting to be sent to the client; holds at most the message currently being sent and the most recent one
+		size_t sendOffset; // Number of bytes of the front message in the send queue that have already been sent
+		bool listeningForWrite; // Flag whether the client's event listener currently waits for the client's socket to accept more data
 		
 		/* Constructors and destructors: */
 		Client(RemoteServer* sServer); // Connects a remote client from a pending incoming connection on the listening socket
@@ -103,18 +120,36 @@ class RemoteServer
 	Threads::TripleBuffer<std::vector<Vrui::ONTransform> > clientPositions; // Triple buffer of lists of positions/orientations of connected clients
 	double requestInterval; // Time interval between requests fro new bathymetry and water level grids
 	double nextRequestTime; // Application time at which to request the next bathymetry and water level grids
-	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of arrays to receive bathymetry and water level grids
+	unsigned int notifiedGeneration; // Generation of the most recent grid snapshot the communication thread was woken up for
+	unsigned int sentGeneration; // Generation of the most recent grid snapshot sent to clients; only accessed by the communication thread
+	GridStatePtr previousState; // Quantized grids of the most recently sent snapshot, against which shared delta frames are encoded; only accessed by the communication thread
+	GridCodec* gridCodec; // Codec to encode grid pairs for clients using the compressed streaming protocol
+	std::vector<Misc::UInt8> encodedFrame; // Scratch buffer for encoding grid pairs
+	GridLODCodec* lodCodec; // Codec to encode grid pairs for clients using the level-of-detail streaming protocol
+	GLfloat detailRadius; // Radius around a client's position inside which grids are sent at full resolution
+	GLfloat viewRadius; // Radius inside a client's field of view inside which grids are sent at full resolution
+	GLfloat viewHalfAngle; // Half the opening angle of a client's field of view in radians
+	std::vector<Misc::UInt8> baseDeltaFrame; // Base layer of the current snapshot encoded as delta frame relative to the previous snapshot
+	std::vector<Misc::UInt8> baseKeyFrame; // Base layer of the current snapshot encoded as keyframe
+	std::vector<Misc::UInt8> clientBaseFrame; // Base layer of the current snapshot encoded as delta frame relative to an individual client's reference
+	std::vector<Misc::UInt8> newDetailTiles; // Scratch mask of full-resolution tiles selected for a client
+	std::vector<Misc::UInt8> keyTiles; // Scratch mask of full-resolution tiles to be sent to a client relative to zero
 	
 	/* Private methods: */
 	void disconnectClient(Client* client,bool removeListener); // Disconnects the given client after a communications error
 	static bool newConnectionCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a connection attempt is made at the listening socket
-	static bool clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message is received from a connected client
+	static bool clientMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message is received from a connected client, or when a client's socket accepts more queued data
+	void readClientMessage(Client* client); // Reads and handles a message from the given client
+	void sendQueuedFrames(Client* client); // Sends as much of the given client's send queue as its socket accepts without blocking; throws exception on communication errors
+	void dropUnsentFrames(Client* client); // Drops all messages from the given client's send queue whose sending has not started, and rewinds the client's reference to the grids it will hold after the remaining messages
+	FramePtr createFrame(const void* data,size_t dataSize,bool sizePrefix); // Creates a shared message holding the given data, optionally preceded by the data's size
+	void quantizeGrids(const GLfloat* bathymetry,const GLfloat* waterLevel,Misc::UInt16* quantizedGrids) const; // Quantizes the given bathymetry and water level grids into the given wire-format buffer
+	void selectDetailTiles(const Client* client,Misc::UInt8* tileMask) const; // Flags all full-resolution tiles near the given client's position or inside its field of view in the given tile mask
 	void* communicationThreadMethod(void); // Method handling communication with connected clients in the background
-	static void readBackCallback(GLfloat* bathymetryBuffer,GLfloat* waterLevelBuffer,void* userData); // Callback called when new property grids have been read back from the GPU
 	
 	/* Constructors and destructors: */
 	public:
-	RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInterval); // Creates a remote server for the given water table and listening port ID
+	RemoteServer(Sandbox* sSandbox,int listenPortId,double sRequestInterval,unsigned int baseFactor,GLfloat sDetailRadius,GLfloat sViewRadius,GLfloat viewAngle); // Creates a remote server for the given water table and listening port ID, sending level-of-detail clients a base layer reduced in resolution by the given factor and full-resolution tiles inside the given radius around them or inside the given radius and opening angle in degrees along their viewing direction
 	~RemoteServer(void);
 	
 	/* Methods: */
@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -44,6 +45,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <IO/File.h>
 #include <IO/ValueSource.h>
 #include <IO/OpenFile.h>
+#include <Threads/Thread.h>
 #include <Comm/OpenPipe.h>
 #include <Math/Math.h>
 #include <Math/Constants.h>
@@ -100,17 +102,27 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #endif
 
 #include "FrameFilter.h"
+#include "GPUFrameFilter.h"
 #include "DepthImageRenderer.h"
 #include "ElevationColorMap.h"
 #include "DEM.h"
+#include "ElevationCache.h"
 #include "SurfaceRenderer.h"
+#include "AdaptiveRenderTarget.h"
 #include "WaterTable2.h"
 #include "HandExtractor.h"
+#include "DetectionScheduler.h"
 #include "RemoteServer.h"
+#include "GridArchiver.h"
 #include "WaterRenderer.h"
 #include "DinosaurEcosystem.h"
 #include "DinosaurRenderer.h"
 #include "TerrainQuery.h"
+#include "GridReadback.h"
+#include "DepthRecorder.h"
+#include "DepthReplaySource.h"
+#include "PerformanceProfiler.h"
+#include "StartupProfile.h"
 #include "GlobalWaterTool.h"
 #include "LocalWaterTool.h"
 #include "DEMTool.h"
@@ -124,6 +136,7 @@ Methods of class Sandbox::DataItem:
 
 Sandbox::DataItem::DataItem(void)
 	:waterTableTime(0.0),
+	 ownsWaterSimulation(false),mirroredSnapshotGeneration(0),
 	 shadowFramebufferObject(0),shadowDepthTextureObject(0)
 	{
 	/* Check if all required extensions are supported: */
@@ -168,12 +181,11 @@ Sandbox::RenderSettings::RenderSettings(void)
 	 useShadows(false),
 	 elevationColorMap(0),
 	 useContourLines(true),contourLineSpacing(0.75f),
-	 renderWaterSurface(false),waterOpacity(2.0f),
+	 renderWaterSurface(false),depthPrepass(false),waterOpacity(2.0f),
 	 comicStyle(false),
-	 surfaceRenderer(0),waterRenderer(0)
+	 surfaceRenderer(0),waterRenderer(0),adaptiveRenderTarget(0),
+	 pendingProjectorTransformName(CONFIG_DEFAULTPROJECTIONMATRIXFILENAME)
 	{
-	/* Load the default projector transformation: */
-	loadProjectorTransform(CONFIG_DEFAULTPROJECTIONMATRIXFILENAME);
 	}
 
 Sandbox::RenderSettings::RenderSettings(const Sandbox::RenderSettings& source)
@@ -182,9 +194,10 @@ Sandbox::RenderSettings::RenderSettings(const Sandbox::RenderSettings& source)
 	 useShadows(source.useShadows),
 	 elevationColorMap(source.elevationColorMap!=0?new ElevationColorMap(*source.elevationColorMap):0),
 	 useContourLines(source.useContourLines),contourLineSpacing(source.contourLineSpacing),
-	 renderWaterSurface(source.renderWaterSurface),waterOpacity(source.waterOpacity),
+	 renderWaterSurface(source.renderWaterSurface),depthPrepass(source.depthPrepass),waterOpacity(source.waterOpacity),
 	 comicStyle(source.comicStyle),
-	 surfaceRenderer(0),waterRenderer(0)
+	 surfaceRenderer(0),waterRenderer(0),adaptiveRenderTarget(0),
+	 pendingProjectorTransformName(source.pendingProjectorTransformName),pendingHeightMapName(source.pendingHeightMapName)
 	{
 	}
 
@@ -192,6 +205,7 @@ Sandbox::RenderSettings::~RenderSettings(void)
 	{
 	delete surfaceRenderer;
 	delete waterRenderer;
+	delete adaptiveRenderTarget;
 	delete elevationColorMap;
 	}
 
@@ -248,23 +262,66 @@ void Sandbox::RenderSettings::loadHeightMap(const char* heightMapName)
 		}
 	}
 
+void Sandbox::RenderSettings::loadPendingFiles(void)
+	{
+	if(!pendingProjectorTransformName.empty())
+		{
+		loadProjectorTransform(pendingProjectorTransformName.c_str());
+		pendingProjectorTransformName.clear();
+		}
+	if(!pendingHeightMapName.empty())
+		{
+		loadHeightMap(pendingHeightMapName.c_str());
+		pendingHeightMapName.clear();
+		}
+	}
+
 /************************
 Methods of class Sandbox:
 ************************/
 
 void Sandbox::rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer)
 	{
+	/* Record the received frame: */
+	if(depthRecorder!=0)
+		depthRecorder->receiveRawFrame(frameBuffer);
+	
 	/* Pass the received frame to the frame filter and the hand extractor: */
 	if(frameFilter!=0&&!pauseUpdates)
 		frameFilter->receiveRawFrame(frameBuffer);
-	if(handExtractor!=0)
+	if(gpuFrameFilter!=0&&!pauseUpdates)
+		{
+		/* Queue the raw frame for the GPU frame filter, which enters every camera frame into the statistics of every OpenGL context: */
+		gpuFrameFilter->receiveRawFrame(frameBuffer);
+		
+		/* Notify the depth image renderer of the new frame: */
+		Threads::Mutex::Lock filteredFramesLock(filteredFramesMutex);
+		FilteredFrame& slot=filteredFrames.startNewValue();
+		slot.frame=frameBuffer;
+		pendingDirtyRegion=PixelRect(0,0,frameSize[0],frameSize[1]);
+		filteredFrames.postNewValue();
+		Vrui::requestUpdate();
+		}
+	if(detectionScheduler!=0)
+		detectionScheduler->submitFrame(handDetectionStage,frameBuffer);
+	else if(handExtractor!=0)
 		handExtractor->receiveRawFrame(frameBuffer);
 	}
 
 void Sandbox::receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer)
 	{
-	/* Put the new frame into the frame input buffer: */
-	filteredFrames.postNewValue(frameBuffer);
+	{
+	Threads::Mutex::Lock filteredFramesLock(filteredFramesMutex);
+	
+	/* Grab the frame input buffer slot to be overwritten; its previous frame is neither locked nor the most recent, and can be returned to the frame filter's pool: */
+	FilteredFrame& slot=filteredFrames.startNewValue();
+	frameFilter->releaseFrame(slot.frame);
+	
+	/* Put the new frame into the frame input buffer, and merge the region of pixels that changed since the previous frame with those of all frames the foreground thread has not yet seen: */
+	slot.frame=frameBuffer;
+	pendingDirtyRegion.addRect(frameFilter->getOutputDirtyRegion());
+	filteredFrames.postNewValue();
+	}
 	
 	/* Wake up the foreground thread: */
 	Vrui::requestUpdate();
@@ -284,10 +341,20 @@ void Sandbox::toggleDEM(DEM* dem)
 		activeDem=dem;
 		}
 	
-	/* Enable DEM matching in all surface renderers that use a fixed projector matrix, i.e., in all physical sandboxes: */
+	/* Install a region the DEM may have finished loading in the background while inactive: */
+	if(activeDem!=0)
+		activeDem->update();
+	
+	updateDemMatching();
+	}
+
+void Sandbox::updateDemMatching(void)
+	{
+	/* Enable DEM matching in all surface renderers that use a fixed projector matrix, i.e., in all physical sandboxes, once the active DEM has data to display: */
+	DEM* matchDem=activeDem!=0&&activeDem->isReady()?activeDem:0;
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		if(rsIt->fixProjectorView)
-			rsIt->surfaceRenderer->setDem(activeDem);
+			rsIt->surfaceRenderer->setDem(matchDem);
 	}
 
 void Sandbox::addWater(GLContextData& contextData) const
@@ -348,6 +415,40 @@ void Sandbox::waterAttenuationSliderCallback(GLMotif::TextFieldSlider::ValueChan
 	waterTable->setAttenuation(GLfloat(1.0-cbData->value));
 	}
 
+void Sandbox::runWaterSimulation(GLfloat totalTimeStep,GLContextData& contextData) const
+	{
+	if(waterBatchSteps)
+		{
+		/* Issue all simulation steps at once and let the GPU select their step sizes; the water table carries any unspent time over to the next frame: */
+		waterTable->setMaxStepSize(totalTimeStep);
+		waterTable->runSimulationSteps(totalTimeStep,waterMaxSteps,contextData);
+		return;
+		}
+	unsigned int numSteps=0;
+	while(numSteps<waterMaxSteps-1U&&totalTimeStep>1.0e-8f)
+		{
+		/* Run with a self-determined time step to maintain stability: */
+		waterTable->setMaxStepSize(totalTimeStep);
+		GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
+		totalTimeStep-=timeStep;
+		++numSteps;
+		}
+	#if 0
+	if(totalTimeStep>1.0e-8f)
+		{
+		std::cout<<'.'<<std::flush;
+		/* Force the final step to avoid simulation slow-down: */
+		waterTable->setMaxStepSize(totalTimeStep);
+		GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
+		totalTimeStep-=timeStep;
+		++numSteps;
+		}
+	#else
+	if(totalTimeStep>1.0e-8f)
+		std::cout<<"Ran out of time by "<<totalTimeStep<<std::endl;
+	#endif
+	}
+
 GLMotif::PopupMenu* Sandbox::createMainMenu(void)
 	{
 	/* Create a popup shell to hold the main menu: */
@@ -439,6 +540,18 @@ GLMotif::PopupWindow* Sandbox::createWaterControlDialog(void)
 	waterAttenuationSlider->setValue(1.0-double(waterTable->getAttenuation()));
 	waterAttenuationSlider->getValueChangedCallbacks().add(this,&Sandbox::waterAttenuationSliderCallback);
 	
+	if(profiler!=0)
+		{
+		/* Add a statistics display for each profiler stage: */
+		for(unsigned int i=0;i<profiler->getNumStages();++i)
+			{
+			std::string labelName="ProfilerStage";
+			labelName.append(profiler->getStageName(i));
+			new GLMotif::Label((labelName+"NameLabel").c_str(),waterControlDialog,profiler->getStageName(i).c_str());
+			profilerStatsLabels.push_back(new GLMotif::Label((labelName+"StatsLabel").c_str(),waterControlDialog,"-"));
+			}
+		}
+	
 	waterControlDialog->manageChild();
 	
 	return waterControlDialogPopup;
@@ -459,6 +572,12 @@ void printUsage(void)
 	std::cout<<"  -remote [<listening port ID>]"<<std::endl;
 	std::cout<<"     Creates a data streaming server listening on TCP port <listening port ID>"<<std::endl;
 	std::cout<<"     Default listening port ID: 26000"<<std::endl;
+	std::cout<<"  -archive <grid archive file name>"<<std::endl;
+	std::cout<<"     Continuously archives the bathymetry and water level grids into a"<<std::endl;
+	std::cout<<"     compressed time-series file for replay in SARndboxClient"<<std::endl;
+	std::cout<<"  -archiveRate <archive rate in Hz>"<<std::endl;
+	std::cout<<"     Sets the rate at which grids are archived"<<std::endl;
+	std::cout<<"     Default: 5"<<std::endl;
 	std::cout<<"  -c <camera index>"<<std::endl;
 	std::cout<<"     Selects the local 3D camera of the given index (0: first camera"<<std::endl;
 	std::cout<<"     on USB bus)"<<std::endl;
@@ -466,6 +585,15 @@ void printUsage(void)
 	std::cout<<"  -f <frame file name prefix>"<<std::endl;
 	std::cout<<"     Reads a pre-recorded 3D video stream from a pair of color/depth"<<std::endl;
 	std::cout<<"     files of the given file name prefix"<<std::endl;
+	std::cout<<"  -record <depth recording file name>"<<std::endl;
+	std::cout<<"     Records all raw depth frames into a compact depth recording file"<<std::endl;
+	std::cout<<"  -replay <depth recording file name>"<<std::endl;
+	std::cout<<"     Replays a depth recording instead of reading from a 3D camera"<<std::endl;
+	std::cout<<"  -replayMaxSpeed"<<std::endl;
+	std::cout<<"     Replays depth recordings as fast as possible instead of at their"<<std::endl;
+	std::cout<<"     recorded frame rate"<<std::endl;
+	std::cout<<"  -replayLoop"<<std::endl;
+	std::cout<<"     Restarts depth recordings after their last frame"<<std::endl;
 	std::cout<<"  -s <scale factor>"<<std::endl;
 	std::cout<<"     Scale factor from real sandbox to simulated terrain"<<std::endl;
 	std::cout<<"     Default: 100.0 (1:100 scale, 1cm in sandbox is 1m in terrain"<<std::endl;
@@ -496,6 +624,22 @@ void printUsage(void)
 	std::cout<<"     Sets the relative speed of the water simulation and the maximum"<<std::endl;
 	std::cout<<"     number of simulation steps per frame"<<std::endl;
 	std::cout<<"     Default: 1.0 30"<<std::endl;
+	std::cout<<"  -simRate <simulation rate>"<<std::endl;
+	std::cout<<"     Advances the water and dinosaur simulations on a fixed-timestep clock"<<std::endl;
+	std::cout<<"     of the given rate in Hz independent of the rendering frame rate;"<<std::endl;
+	std::cout<<"     0 advances them once per rendered frame"<<std::endl;
+	std::cout<<"     Default: 0"<<std::endl;
+	std::cout<<"  -wsw <window index>"<<std::endl;
+	std::cout<<"     Runs the water simulation only in the OpenGL context of the window"<<std::endl;
+	std::cout<<"     of the given index, and mirrors its water and bathymetry grids into"<<std::endl;
+	std::cout<<"     all other contexts; -1 simulates separately in every context"<<std::endl;
+	std::cout<<"     Default: -1"<<std::endl;
+	std::cout<<"  -wsr <step size readback latency> <step size safety factor>"<<std::endl;
+	std::cout<<"     Reads back the water simulation's maximum step size asynchronously,"<<std::endl;
+	std::cout<<"     using the most recent completed value multiplied by the given safety"<<std::endl;
+	std::cout<<"     factor, and waiting only for values queued at least the given number"<<std::endl;
+	std::cout<<"     of frames ago; latency 0 uses blocking readback"<<std::endl;
+	std::cout<<"     Default: 0 0.5"<<std::endl;
 	std::cout<<"  -rer <min rain elevation> <max rain elevation>"<<std::endl;
 	std::cout<<"     Sets the elevation range of the rain cloud level relative to the"<<std::endl;
 	std::cout<<"     ground plane in cm"<<std::endl;
@@ -542,6 +686,11 @@ void printUsage(void)
 	std::cout<<"     Renders water surface as geometric surface"<<std::endl;
 	std::cout<<"  -rwt"<<std::endl;
 	std::cout<<"     Renders water surface as texture"<<std::endl;
+	std::cout<<"  -cws"<<std::endl;
+	std::cout<<"     Renders a depth-only prepass of the surface, so that the surface shading"<<std::endl;
+	std::cout<<"     pass only shades visible fragments; works with -rws and -rwt"<<std::endl;
+	std::cout<<"  -ncws"<<std::endl;
+	std::cout<<"     Renders the surface without a depth-only prepass"<<std::endl;
 	std::cout<<"  -wo <water opacity>"<<std::endl;
 	std::cout<<"     Sets the water depth at which water appears opaque in cm"<<std::endl;
 	std::cout<<"     Default: 2.0"<<std::endl;
@@ -552,16 +701,140 @@ void printUsage(void)
 	std::cout<<"     Optional scale parameter sets sprite size (default: 0.3)"<<std::endl;
 	}
 
+class CameraOpener // Class to open the selected 3D camera and to retrieve its calibration on a background thread
+	{
+	/* Elements: */
+	public:
+	const char* replayFileName; // Name of a depth recording to replay, or NULL
+	bool replayRealTime,replayLoop; // Replay pacing flags
+	const char* frameFilePrefix; // Prefix of pre-recorded 3D video files, or NULL
+	const char* kinectServerName; // Host name and optional port of a 3D camera server, or NULL
+	unsigned int cameraIndex; // Index of the local 3D camera device
+	const Misc::ConfigurationFileSection* cameraConfigurationSection; // Configuration section for the local 3D camera device
+	StartupProfile* startupProfile; // Profile receiving the camera phase
+	Kinect::FrameSource* camera; // The opened camera
+	unsigned int frameSize[2]; // Camera's depth frame size
+	Kinect::FrameSource::DepthCorrection* depthCorrection; // Camera's depth correction parameters, or NULL
+	PixelDepthCorrection* pixelDepthCorrection; // Camera's per-pixel depth correction evaluated on the depth frame's pixel grid
+	Kinect::FrameSource::IntrinsicParameters cameraIps; // Camera's unscaled intrinsic parameters
+	std::string error; // Message of an exception thrown while opening the camera, or empty
+	
+	/* Constructors and destructors: */
+	CameraOpener(void)
+		:replayFileName(0),replayRealTime(false),replayLoop(false),
+		 frameFilePrefix(0),kinectServerName(0),cameraIndex(0),cameraConfigurationSection(0),
+		 startupProfile(0),
+		 camera(0),depthCorrection(0),pixelDepthCorrection(0)
+		{
+		}
+	
+	/* Methods: */
+	void* openThreadMethod(void);
+	};
+
+void* CameraOpener::openThreadMethod(void)
+	{
+	StartupProfile::Phase phase(startupProfile,"Open camera and load depth correction");
+	
+	try
+		{
+		if(replayFileName!=0)
+			{
+			/* Open the selected depth recording: */
+			camera=new DepthReplaySource(replayFileName,replayRealTime,replayLoop);
+			}
+		else if(frameFilePrefix!=0)
+			{
+			/* Open the selected pre-recorded 3D video files: */
+			std::string colorFileName=frameFilePrefix;
+			colorFileName.append(".color");
+			std::string depthFileName=frameFilePrefix;
+			depthFileName.append(".depth");
+			camera=new Kinect::FileFrameSource(IO::openFile(colorFileName.c_str()),IO::openFile(depthFileName.c_str()));
+			}
+		else if(kinectServerName!=0)
+			{
+			/* Split the server name into host name and port: */
+			const char* colonPtr=0;
+			for(const char* snPtr=kinectServerName;*snPtr!='\0';++snPtr)
+				if(*snPtr==':')
+					colonPtr=snPtr;
+			std::string hostName;
+			int port;
+			if(colonPtr!=0)
+				{
+				/* Extract host name and port: */
+				hostName=std::string(kinectServerName,colonPtr);
+				port=atoi(colonPtr+1);
+				}
+			else
+				{
+				/* Use complete host name and default port: */
+				hostName=kinectServerName;
+				port=26000;
+				}
+			
+			/* Open a multiplexed frame source for the given server host name and port number: */
+			Kinect::MultiplexedFrameSource* source=Kinect::MultiplexedFrameSource::create(Comm::openTCPPipe(hostName.c_str(),port));
+			
+			/* Use the server's first component stream as the camera device: */
+			camera=source->getStream(0);
+			}
+		else
+			{
+			/* Open the 3D camera device of the selected index: */
+			Kinect::DirectFrameSource* realCamera=Kinect::openDirectFrameSource(cameraIndex,false);
+			realCamera->configure(*cameraConfigurationSection);
+			camera=realCamera;
+			}
+		for(int i=0;i<2;++i)
+			frameSize[i]=camera->getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
+		
+		/* Get the camera's per-pixel depth correction parameters and evaluate it on the depth frame's pixel grid: */
+		depthCorrection=camera->getDepthCorrectionParameters();
+		if(depthCorrection!=0)
+			{
+			pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
+			}
+		else
+			{
+			/* Create dummy per-pixel depth correction parameters: */
+			pixelDepthCorrection=new PixelDepthCorrection[frameSize[1]*frameSize[0]];
+			PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
+			for(unsigned int y=0;y<frameSize[1];++y)
+				for(unsigned int x=0;x<frameSize[0];++x,++pdcPtr)
+					{
+					pdcPtr->scale=1.0f;
+					pdcPtr->offset=0.0f;
+					}
+			}
+		
+		/* Get the camera's intrinsic parameters: */
+		cameraIps=camera->getIntrinsicParameters();
+		}
+	catch(const std::runtime_error& err)
+		{
+		/* Hand the exception to the main thread: */
+		error=err.what();
+		}
+	
+	return 0;
+	}
+
 }
 
 Sandbox::Sandbox(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
-	 remoteServer(0),
-	 camera(0),pixelDepthCorrection(0),
-	 frameFilter(0),pauseUpdates(false),
-	 depthImageRenderer(0),
-	 waterTable(0),
-	 handExtractor(0),addWaterFunction(0),addWaterFunctionRegistered(false),
+	 remoteServer(0),gridArchiver(0),
+	 camera(0),depthRecorder(0),pixelDepthCorrection(0),
+	 frameFilter(0),gpuFrameFilter(0),pauseUpdates(false),
+	 depthImageRenderer(0),elevationCache(0),
+	 waterTable(0),waterBatchSteps(false),
+	 simulationRate(0.0),maxSimulationTicks(4),simulationClock(0.0),numSimulationTicks(0),
+	 waterSimulationWindow(-1),
+	 handExtractor(0),detectionScheduler(0),handDetectionStage(0),addWaterFunction(0),addWaterFunctionRegistered(false),
+	 gridReadback(0),
+	 profiler(0),startupProfile(new StartupProfile),startupFrameTime(0.0),
 	 sun(0),
 	 activeDem(0),
 	 mainMenu(0),pauseUpdatesToggle(0),waterControlDialog(0),
@@ -590,26 +863,64 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	unsigned int minNumSamples=cfg.retrieveValue<unsigned int>("./minNumSamples",10);
 	unsigned int maxVariance=cfg.retrieveValue<unsigned int>("./maxVariance",2);
 	float hysteresis=cfg.retrieveValue<float>("./hysteresis",0.1f);
+	unsigned int numFilterThreads=cfg.retrieveValue<unsigned int>("./numFilterThreads",1U);
+	bool exponentialAveraging=cfg.retrieveValue<bool>("./exponentialAveraging",false);
+	bool useGPUFrameFilter=cfg.retrieveValue<bool>("./gpuFrameFilter",false);
 	Misc::FixedArray<unsigned int,2> wtSize;
 	wtSize[0]=640;
 	wtSize[1]=480;
 	wtSize=cfg.retrieveValue<Misc::FixedArray<unsigned int,2> >("./waterTableSize",wtSize);
 	waterSpeed=cfg.retrieveValue<double>("./waterSpeed",1.0);
 	waterMaxSteps=cfg.retrieveValue<unsigned int>("./waterMaxSteps",30U);
+	waterBatchSteps=cfg.retrieveValue<bool>("./waterBatchSteps",false);
+	waterSimulationWindow=cfg.retrieveValue<int>("./waterSimulationWindow",-1);
+	simulationRate=cfg.retrieveValue<double>("./simulationRate",0.0);
+	maxSimulationTicks=cfg.retrieveValue<unsigned int>("./maxSimulationTicks",4U);
+	bool waterFusedIntegration=cfg.retrieveValue<bool>("./waterFusedIntegration",false);
+	bool waterIncrementalBathymetry=cfg.retrieveValue<bool>("./waterIncrementalBathymetry",false);
+	unsigned int waterBathymetryLod=cfg.retrieveValue<unsigned int>("./waterBathymetryLod",0U);
+	unsigned int waterTileSize=cfg.retrieveValue<unsigned int>("./waterTileSize",0U);
+	float waterTileMinDepth=cfg.retrieveValue<float>("./waterTileMinDepth",0.01f);
+	unsigned int waterStepSizeReadbackLatency=cfg.retrieveValue<unsigned int>("./waterStepSizeReadbackLatency",0U);
+	float waterStepSizeReadbackSafety=cfg.retrieveValue<float>("./waterStepSizeReadbackSafety",0.5f);
+	bool waterHalfIntermediates=cfg.retrieveValue<bool>("./waterHalfIntermediates",false);
 	Math::Interval<double> rainElevationRange=cfg.retrieveValue<Math::Interval<double> >("./rainElevationRange",Math::Interval<double>(-1000.0,1000.0));
 	rainStrength=cfg.retrieveValue<GLfloat>("./rainStrength",0.25f);
 	double evaporationRate=cfg.retrieveValue<double>("./evaporationRate",0.0);
 	float demDistScale=cfg.retrieveValue<float>("./demDistScale",1.0f);
+	GLfloat contourLineResolution=cfg.retrieveValue<GLfloat>("./contourLineResolution",1.0f);
+	bool precompileSurfaceShaders=cfg.retrieveValue<bool>("./precompileSurfaceShaders",true);
+	bool adaptiveRendering=cfg.retrieveValue<bool>("./adaptiveRendering",false);
+	double renderTimeBudget=cfg.retrieveValue<double>("./renderTimeBudget",10.0);
+	GLfloat minRenderScale=cfg.retrieveValue<GLfloat>("./minRenderScale",0.5f);
+	bool enableProfiling=cfg.retrieveValue<bool>("./enableProfiling",false);
+	bool handCoarseToFine=cfg.retrieveValue<bool>("./handCoarseToFine",false);
+	unsigned int numDetectionThreads=cfg.retrieveValue<unsigned int>("./numDetectionThreads",0U);
+	double handDetectionRate=cfg.retrieveValue<double>("./handDetectionRate",30.0);
+	int handDetectionPriority=cfg.retrieveValue<int>("./handDetectionPriority",1);
 	std::string controlPipeName=cfg.retrieveString("./controlPipeName","");
+	unsigned int archiveKeyframeInterval=cfg.retrieveValue<unsigned int>("./archiveKeyframeInterval",50U);
+	unsigned int remoteBaseFactor=cfg.retrieveValue<unsigned int>("./remoteBaseFactor",4U);
+	GLfloat remoteDetailRadius=cfg.retrieveValue<GLfloat>("./remoteDetailRadius",20.0f);
+	GLfloat remoteViewRadius=cfg.retrieveValue<GLfloat>("./remoteViewRadius",60.0f);
+	GLfloat remoteViewAngle=cfg.retrieveValue<GLfloat>("./remoteViewAngle",90.0f);
+	unsigned int numDinosaurThreads=cfg.retrieveValue<unsigned int>("./numDinosaurThreads",1U);
+	unsigned int dinosaurSeed=cfg.retrieveValue<unsigned int>("./dinosaurSeed",0U);
 	
 	/* Process command line parameters: */
 	bool printHelp=false;
 	bool enableDinosaurs=false;
 	Scalar dinosaurScale=0.3;
 	const char* frameFilePrefix=0;
+	const char* recordFileName=0;
+	const char* replayFileName=0;
+	bool replayRealTime=true;
+	bool replayLoop=false;
 	const char* kinectServerName=0;
 	bool useRemoteServer=false;
 	int remoteServerPortId=26000;
+	const char* archiveFileName=0;
+	double archiveRate=5.0;
 	int windowIndex=0;
 	renderSettings.push_back(RenderSettings());
 	for(int i=1;i<argc;++i)
@@ -629,6 +940,16 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				
 				useRemoteServer=true;
 				}
+			else if(strcasecmp(argv[i]+1,"archive")==0)
+				{
+				++i;
+				archiveFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"archiveRate")==0)
+				{
+				++i;
+				archiveRate=atof(argv[i]);
+				}
 			else if(strcasecmp(argv[i]+1,"c")==0)
 				{
 				++i;
@@ -639,6 +960,20 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				frameFilePrefix=argv[i];
 				}
+			else if(strcasecmp(argv[i]+1,"record")==0)
+				{
+				++i;
+				recordFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"replay")==0)
+				{
+				++i;
+				replayFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"replayMaxSpeed")==0)
+				replayRealTime=false;
+			else if(strcasecmp(argv[i]+1,"replayLoop")==0)
+				replayLoop=true;
 			else if(strcasecmp(argv[i]+1,"p")==0)
 				{
 				++i;
@@ -717,6 +1052,29 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				++i;
 				waterMaxSteps=atoi(argv[i]);
 				}
+			else if(strcasecmp(argv[i]+1,"simRate")==0)
+				{
+				if(i+1>=argc)
+					Misc::throwStdErr("Sandbox: Missing argument for -simRate flag (expected: -simRate <rate>)");
+				++i;
+				simulationRate=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"wsw")==0)
+				{
+				if(i+1>=argc)
+					Misc::throwStdErr("Sandbox: Missing argument for -wsw flag (expected: -wsw <window index>)");
+				++i;
+				waterSimulationWindow=atoi(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"wsr")==0)
+				{
+				if(i+2>=argc)
+					Misc::throwStdErr("Sandbox: Missing arguments for -wsr flag (expected: -wsr <latency> <safety>)");
+				++i;
+				waterStepSizeReadbackLatency=(unsigned int)(atoi(argv[i]));
+				++i;
+				waterStepSizeReadbackSafety=float(atof(argv[i]));
+				}
 			else if(strcasecmp(argv[i]+1,"rer")==0)
 				{
 				if(i+2>=argc)
@@ -759,9 +1117,9 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				renderSettings.back().fixProjectorView=true;
 				if(i+1<argc&&argv[i+1][0]!='-')
 					{
-					/* Load the projector transformation file specified in the next argument: */
+					/* Select the projector transformation file specified in the next argument, to be loaded while the camera opens: */
 					++i;
-					renderSettings.back().loadProjectorTransform(argv[i]);
+					renderSettings.back().pendingProjectorTransformName=argv[i];
 					}
 				}
 			else if(strcasecmp(argv[i]+1,"nhs")==0)
@@ -776,19 +1134,20 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				{
 				delete renderSettings.back().elevationColorMap;
 				renderSettings.back().elevationColorMap=0;
+				renderSettings.back().pendingHeightMapName.clear();
 				}
 			else if(strcasecmp(argv[i]+1,"uhm")==0)
 				{
 				if(i+1<argc&&argv[i+1][0]!='-')
 					{
-					/* Load the height color map file specified in the next argument: */
+					/* Select the height color map file specified in the next argument, to be loaded while the camera opens: */
 					++i;
-					renderSettings.back().loadHeightMap(argv[i]);
+					renderSettings.back().pendingHeightMapName=argv[i];
 					}
 				else
 					{
-					/* Load the default height color map: */
-					renderSettings.back().loadHeightMap(CONFIG_DEFAULTHEIGHTCOLORMAPFILENAME);
+					/* Select the default height color map: */
+					renderSettings.back().pendingHeightMapName=CONFIG_DEFAULTHEIGHTCOLORMAPFILENAME;
 					}
 				}
 			else if(strcasecmp(argv[i]+1,"ncl")==0)
@@ -807,6 +1166,10 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				renderSettings.back().renderWaterSurface=true;
 			else if(strcasecmp(argv[i]+1,"rwt")==0)
 				renderSettings.back().renderWaterSurface=false;
+			else if(strcasecmp(argv[i]+1,"cws")==0)
+				renderSettings.back().depthPrepass=true;
+			else if(strcasecmp(argv[i]+1,"ncws")==0)
+				renderSettings.back().depthPrepass=false;
 			else if(strcasecmp(argv[i]+1,"wo")==0)
 				{
 				++i;
@@ -838,98 +1201,76 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	/* Print usage help if requested: */
 	if(printHelp)
 		printUsage();
+	startupProfile->addPhase("Parse configuration and command line",startupProfile->getStartTime(),PerformanceProfiler::getTime());
+	
+	/* Open the camera and retrieve its calibration on a background thread while loading the remaining configuration files: */
+	CameraOpener cameraOpener;
+	cameraOpener.replayFileName=replayFileName;
+	cameraOpener.replayRealTime=replayRealTime;
+	cameraOpener.replayLoop=replayLoop;
+	cameraOpener.frameFilePrefix=frameFilePrefix;
+	cameraOpener.kinectServerName=kinectServerName;
+	cameraOpener.cameraIndex=cameraIndex;
+	Misc::ConfigurationFileSection cameraConfigurationSection=cfg.getSection(cameraConfiguration.c_str());
+	cameraOpener.cameraConfigurationSection=&cameraConfigurationSection;
+	cameraOpener.startupProfile=startupProfile;
+	Threads::Thread cameraOpenerThread;
+	cameraOpenerThread.start(&cameraOpener,&CameraOpener::openThreadMethod);
 	
-	if(frameFilePrefix!=0)
-		{
-		/* Open the selected pre-recorded 3D video files: */
-		std::string colorFileName=frameFilePrefix;
-		colorFileName.append(".color");
-		std::string depthFileName=frameFilePrefix;
-		depthFileName.append(".depth");
-		camera=new Kinect::FileFrameSource(IO::openFile(colorFileName.c_str()),IO::openFile(depthFileName.c_str()));
-		}
-	else if(kinectServerName!=0)
+	{
+	StartupProfile::Phase phase(startupProfile,"Load projector transformations and height maps");
+	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
+		rsIt->loadPendingFiles();
+	}
+	
+	/* Read the sandbox layout file: */
+	Geometry::Plane<double,3> basePlane;
+	Geometry::Point<double,3> basePlaneCorners[4];
+	try
 		{
-		/* Split the server name into host name and port: */
-		const char* colonPtr=0;
-		for(const char* snPtr=kinectServerName;*snPtr!='\0';++snPtr)
-			if(*snPtr==':')
-				colonPtr=snPtr;
-		std::string hostName;
-		int port;
-		if(colonPtr!=0)
-			{
-			/* Extract host name and port: */
-			hostName=std::string(kinectServerName,colonPtr);
-			port=atoi(colonPtr+1);
-			}
-		else
-			{
-			/* Use complete host name and default port: */
-			hostName=kinectServerName;
-			port=26000;
-			}
+		StartupProfile::Phase phase(startupProfile,"Load sandbox layout");
+		IO::ValueSource layoutSource(IO::openFile(sandboxLayoutFileName.c_str()));
+		layoutSource.skipWs();
 		
-		/* Open a multiplexed frame source for the given server host name and port number: */
-		Kinect::MultiplexedFrameSource* source=Kinect::MultiplexedFrameSource::create(Comm::openTCPPipe(hostName.c_str(),port));
+		/* Read the base plane equation: */
+		std::string s=layoutSource.readLine();
+		basePlane=Misc::ValueCoder<Geometry::Plane<double,3> >::decode(s.c_str(),s.c_str()+s.length());
+		basePlane.normalize();
 		
-		/* Use the server's first component stream as the camera device: */
-		camera=source->getStream(0);
+		/* Read the corners of the base quadrilateral and project them into the base plane: */
+		for(int i=0;i<4;++i)
+			{
+			layoutSource.skipWs();
+			s=layoutSource.readLine();
+			basePlaneCorners[i]=basePlane.project(Misc::ValueCoder<Geometry::Point<double,3> >::decode(s.c_str(),s.c_str()+s.length()));
+			}
 		}
-	else
+	catch(...)
 		{
-		/* Open the 3D camera device of the selected index: */
-		Kinect::DirectFrameSource* realCamera=Kinect::openDirectFrameSource(cameraIndex,false);
-		Misc::ConfigurationFileSection cameraConfigurationSection=cfg.getSection(cameraConfiguration.c_str());
-		realCamera->configure(cameraConfigurationSection);
-		camera=realCamera;
+		/* Wait for the camera before bailing out: */
+		cameraOpenerThread.join();
+		delete cameraOpener.depthCorrection;
+		throw;
 		}
-	for(int i=0;i<2;++i)
-		frameSize[i]=camera->getActualFrameSize(Kinect::FrameSource::DEPTH)[i];
 	
-	/* Get the camera's per-pixel depth correction parameters and evaluate it on the depth frame's pixel grid: */
-	Kinect::FrameSource::DepthCorrection* depthCorrection=camera->getDepthCorrectionParameters();
-	if(depthCorrection!=0)
-		{
-		pixelDepthCorrection=depthCorrection->getPixelCorrection(frameSize);
-		delete depthCorrection;
-		}
-	else
+	/* Wait for the camera: */
+	cameraOpenerThread.join();
+	camera=cameraOpener.camera;
+	pixelDepthCorrection=cameraOpener.pixelDepthCorrection;
+	if(!cameraOpener.error.empty())
 		{
-		/* Create dummy per-pixel depth correction parameters: */
-		pixelDepthCorrection=new PixelDepthCorrection[frameSize[1]*frameSize[0]];
-		PixelDepthCorrection* pdcPtr=pixelDepthCorrection;
-		for(unsigned int y=0;y<frameSize[1];++y)
-			for(unsigned int x=0;x<frameSize[0];++x,++pdcPtr)
-				{
-				pdcPtr->scale=1.0f;
-				pdcPtr->offset=0.0f;
-				}
+		delete cameraOpener.depthCorrection;
+		throw std::runtime_error(cameraOpener.error);
 		}
+	for(int i=0;i<2;++i)
+		frameSize[i]=cameraOpener.frameSize[i];
+	Kinect::FrameSource::DepthCorrection* depthCorrection=cameraOpener.depthCorrection;
+	cameraIps=cameraOpener.cameraIps;
 	
-	/* Get the camera's intrinsic parameters: */
-	cameraIps=camera->getIntrinsicParameters();
-	
-	/* Read the sandbox layout file: */
-	Geometry::Plane<double,3> basePlane;
-	Geometry::Point<double,3> basePlaneCorners[4];
-	{
-	IO::ValueSource layoutSource(IO::openFile(sandboxLayoutFileName.c_str()));
-	layoutSource.skipWs();
-	
-	/* Read the base plane equation: */
-	std::string s=layoutSource.readLine();
-	basePlane=Misc::ValueCoder<Geometry::Plane<double,3> >::decode(s.c_str(),s.c_str()+s.length());
-	basePlane.normalize();
-	
-	/* Read the corners of the base quadrilateral and project them into the base plane: */
-	for(int i=0;i<4;++i)
-		{
-		layoutSource.skipWs();
-		s=layoutSource.readLine();
-		basePlaneCorners[i]=basePlane.project(Misc::ValueCoder<Geometry::Point<double,3> >::decode(s.c_str(),s.c_str()+s.length()));
-		}
-	}
+	/* Create a depth recorder storing the camera's unscaled calibration with the raw depth frames: */
+	if(recordFileName!=0)
+		depthRecorder=new DepthRecorder(recordFileName,frameSize,0,cameraIps,depthCorrection);
+	delete depthCorrection;
 	
 	/* Limit the valid elevation range to the intersection of the extents of all height color maps: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
@@ -965,27 +1306,71 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	evaporationRate*=sf;
 	demDistScale*=sf;
 	
-	/* Create the frame filter object: */
-	frameFilter=new FrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane);
-	frameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
-	frameFilter->setStableParameters(minNumSamples,maxVariance);
-	frameFilter->setHysteresis(hysteresis);
-	frameFilter->setSpatialFilter(true);
-	frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+	if(enableProfiling)
+		{
+		/* Create the profiler and register the application's own stages: */
+		profiler=new PerformanceProfiler;
+		profilerStages[0]=profiler->addStage("Bathymetry",true);
+		profilerStages[1]=profiler->addStage("GridReadback",true);
+		profilerStages[2]=profiler->addStage("Surface",true);
+		profilerStages[3]=profiler->addStage("WaterSurface",true);
+		profilerStages[4]=profiler->addStage("Dinosaurs",true);
+		profilerStages[5]=profiler->addStage("DinosaurEcosystem",false);
+		}
+	
+	{
+	StartupProfile::Phase phase(startupProfile,"Create depth frame filters and hand extractor");
+	if(useGPUFrameFilter)
+		{
+		/* Create the GPU frame filter object: */
+		gpuFrameFilter=new GPUFrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane);
+		gpuFrameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
+		gpuFrameFilter->setStableParameters(minNumSamples,maxVariance);
+		gpuFrameFilter->setHysteresis(hysteresis);
+		gpuFrameFilter->setSpatialFilter(true);
+		}
+	else
+		{
+		/* Create the frame filter object: */
+		frameFilter=new FrameFilter(frameSize,numAveragingSlots,pixelDepthCorrection,cameraIps.depthProjection,basePlane,numFilterThreads,exponentialAveraging?FrameFilter::EXPONENTIAL:FrameFilter::WINDOWED);
+		frameFilter->setValidElevationInterval(cameraIps.depthProjection,basePlane,elevationRange.getMin(),elevationRange.getMax());
+		frameFilter->setStableParameters(minNumSamples,maxVariance);
+		frameFilter->setHysteresis(hysteresis);
+		frameFilter->setSpatialFilter(true);
+		frameFilter->setOutputFrameFunction(Misc::createFunctionCall(this,&Sandbox::receiveFilteredFrame));
+		frameFilter->setProfiler(profiler);
+		}
 	
 	if(waterSpeed>0.0)
 		{
-		/* Create the hand extractor object: */
-		handExtractor=new HandExtractor(frameSize,pixelDepthCorrection,cameraIps.depthProjection);
+		/* Create the hand extractor object, running on its own thread unless there is a shared detection scheduler: */
+		handExtractor=new HandExtractor(frameSize,pixelDepthCorrection,cameraIps.depthProjection,numDetectionThreads==0);
+		handExtractor->setCoarseToFine(handCoarseToFine);
+		handExtractor->setProfiler(profiler);
+		
+		if(numDetectionThreads>0)
+			{
+			/* Create the detection scheduler and register the hand extractor as a rate-limited stage: */
+			detectionScheduler=new DetectionScheduler(numDetectionThreads);
+			handDetectionStage=detectionScheduler->addStage("Hands",handDetectionRate,handDetectionPriority,Misc::createFunctionCall(handExtractor,&HandExtractor::processRawFrame));
+			}
 		}
+	}
 	
 	/* Start streaming depth frames: */
 	camera->startStreaming(0,Misc::createFunctionCall(this,&Sandbox::rawDepthFrameDispatcher));
 	
+	{
+	StartupProfile::Phase phase(startupProfile,"Create depth image renderer and water simulation");
 	/* Create the depth image renderer: */
 	depthImageRenderer=new DepthImageRenderer(frameSize);
 	depthImageRenderer->setIntrinsics(cameraIps);
 	depthImageRenderer->setBasePlane(basePlane);
+	depthImageRenderer->setGPUFrameFilter(gpuFrameFilter);
+	
+	/* Create the pixel-corner elevation cache shared by all surface renderers: */
+	elevationCache=new ElevationCache(depthImageRenderer);
+	elevationCache->setResolutionFraction(contourLineResolution);
 	
 	{
 	/* Calculate the transformation from camera space to sandbox space: */
@@ -1016,11 +1401,21 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		waterTable=new WaterTable2(wtSize[0],wtSize[1],depthImageRenderer,basePlaneCorners);
 		waterTable->setElevationRange(elevationRange.getMin(),rainElevationRange.getMax());
 		waterTable->setWaterDeposit(evaporationRate);
+		waterTable->setStepSizeReadback(waterStepSizeReadbackLatency,waterStepSizeReadbackSafety);
+		waterTable->setFusedIntegration(waterFusedIntegration);
+		waterTable->setIncrementalBathymetry(waterIncrementalBathymetry);
+		waterTable->setBathymetryLod(waterBathymetryLod);
+		waterTable->setTileSize(GLsizei(waterTileSize),waterTileMinDepth);
+		waterTable->setHalfPrecision(waterHalfIntermediates);
+		waterTable->setProfiler(profiler);
 		
 		/* Register a render function with the water table: */
 		addWaterFunction=Misc::createFunctionCall(this,&Sandbox::addWater);
 		waterTable->addRenderFunction(addWaterFunction);
 		addWaterFunctionRegistered=true;
+		
+		/* Create the service reading back the water table's grids: */
+		gridReadback=new GridReadback(waterTable);
 		}
 	
 	if(useRemoteServer)
@@ -1028,7 +1423,7 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		/* Create a remote server: */
 		try
 			{
-			remoteServer=new RemoteServer(this,remoteServerPortId,1.0/30.0);
+			remoteServer=new RemoteServer(this,remoteServerPortId,1.0/30.0,remoteBaseFactor,remoteDetailRadius,remoteViewRadius,remoteViewAngle);
 			}
 		catch(const std::runtime_error& err)
 			{
@@ -1036,6 +1431,27 @@ Sandbox::Sandbox(int& argc,char**& argv)
 			}
 		}
 	
+	if(archiveFileName!=0)
+		{
+		if(gridReadback!=0&&archiveRate>0.0)
+			{
+			/* Create a grid archiver: */
+			try
+				{
+				gridArchiver=new GridArchiver(archiveFileName,waterTable,gridReadback,1.0/archiveRate,archiveKeyframeInterval);
+				}
+			catch(const std::runtime_error& err)
+				{
+				Misc::formattedConsoleError("Sandbox: Unable to create grid archive %s due to exception %s",archiveFileName,err.what());
+				}
+			}
+		else
+			Misc::formattedConsoleWarning("Sandbox: Ignoring -archive option because the water simulation is disabled or the archive rate is invalid");
+		}
+	}
+	
+	{
+	StartupProfile::Phase phase(startupProfile,"Create surface renderers");
 	/* Initialize all surface renderers: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		{
@@ -1049,12 +1465,13 @@ Sandbox::Sandbox(int& argc,char**& argv)
 			}
 		
 		/* Initialize the surface renderer: */
-		rsIt->surfaceRenderer=new SurfaceRenderer(depthImageRenderer);
+		rsIt->surfaceRenderer=new SurfaceRenderer(depthImageRenderer,elevationCache);
 		rsIt->surfaceRenderer->setDrawContourLines(rsIt->useContourLines);
 		rsIt->surfaceRenderer->setContourLineDistance(rsIt->contourLineSpacing);
 		rsIt->surfaceRenderer->setElevationColorMap(rsIt->elevationColorMap);
 		rsIt->surfaceRenderer->setIlluminate(rsIt->hillshade);
 		rsIt->surfaceRenderer->setComicStyle(rsIt->comicStyle);
+		rsIt->surfaceRenderer->setPrecompileShaderVariants(precompileSurfaceShaders);
 		if(waterTable!=0)
 			{
 			if(rsIt->renderWaterSurface)
@@ -1070,7 +1487,16 @@ Sandbox::Sandbox(int& argc,char**& argv)
 				}
 			}
 		rsIt->surfaceRenderer->setDemDistScale(demDistScale);
+		
+		if(adaptiveRendering)
+			{
+			/* Create an adaptive render target to re-present unchanged frames and to meet the GPU time budget: */
+			rsIt->adaptiveRenderTarget=new AdaptiveRenderTarget;
+			rsIt->adaptiveRenderTarget->setTimeBudget(renderTimeBudget);
+			rsIt->adaptiveRenderTarget->setMinRenderScale(minRenderScale);
+			}
 		}
+	}
 	
 	#if 0
 	/* Create a fixed-position light source: */
@@ -1085,20 +1511,29 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	terrainQuery=0;
 	if(waterTable!=0)
 		{
-		terrainQuery=new TerrainQuery(waterTable);
+		const GLsizei* size=waterTable->getSize();
+		const WaterTable2::Box& domain=waterTable->getDomain();
+		Scalar domainMin[3],domainMax[3];
+		for(int i=0;i<3;++i)
+			{
+			domainMin[i]=domain.min[i];
+			domainMax[i]=domain.max[i];
+			}
+		terrainQuery=new TerrainQuery(size[0],size[1],domainMin,domainMax);
 		}
-
+	
 	/* Initialize the dinosaur ecosystem */
 	dinosaurEcosystem=0;
 	dinosaurRenderer=0;
 	dinosaursEnabled=enableDinosaurs;
-	if(waterTable!=0)
+	if(waterTable!=0&&dinosaursEnabled)
 		{
-		/* Create dinosaur ecosystem and renderer */
-		dinosaurEcosystem=new DinosaurEcosystem(waterTable);
+		/* Create dinosaur ecosystem and renderer only when requested, so that the sprite atlas is not loaded otherwise: */
+		StartupProfile::Phase phase(startupProfile,"Create dinosaur ecosystem");
+		dinosaurEcosystem=new DinosaurEcosystem(numDinosaurThreads,dinosaurSeed);
 		dinosaurRenderer=new DinosaurRenderer(waterTable);
 		dinosaurRenderer->setSpriteSize(dinosaurScale);
-
+		
 		/* Set sandbox bounds from bbox */
 		DinosaurEcosystem::Bounds dinoBounds;
 		dinoBounds.minX=bbox.min[0];
@@ -1108,21 +1543,23 @@ Sandbox::Sandbox(int& argc,char**& argv)
 		dinoBounds.minZ=bbox.min[2];
 		dinoBounds.maxZ=bbox.max[2];
 		dinosaurEcosystem->setBounds(dinoBounds);
-
+		
 		/* Set terrain query system for proper height/water sampling */
 		dinosaurEcosystem->setTerrainQuery(terrainQuery);
-
+		
 		/* Set movement speed scale to match sprite size */
 		dinosaurEcosystem->setSpeedScale(dinosaurScale);
-
+		
 		/* Spawn initial dinosaur population */
 		dinosaurEcosystem->spawnInitialPopulation();
-
+		
 		std::cout<<"Dinosaur ecosystem initialized with "
 		         <<dinosaurEcosystem->getHerbivoreCount()<<" herbivores and "
 		         <<dinosaurEcosystem->getPredatorCount()<<" predators"<<std::endl;
 		}
-
+	
+	{
+	StartupProfile::Phase phase(startupProfile,"Create user interface and tools");
 	/* Create the GUI: */
 	mainMenu=createMainMenu();
 	Vrui::setMainMenu(mainMenu);
@@ -1136,6 +1573,7 @@ Sandbox::Sandbox(int& argc,char**& argv)
 	if(waterTable!=0)
 		BathymetrySaverTool::initClass(waterTable,*Vrui::getToolManager());
 	addEventTool("Pause Topography",0,0);
+	}
 	
 	if(!controlPipeName.empty())
 		{
@@ -1157,18 +1595,26 @@ Sandbox::~Sandbox(void)
 	/* Stop streaming depth frames: */
 	camera->stopStreaming();
 	delete camera;
+	delete depthRecorder;
 	delete frameFilter;
+	delete gpuFrameFilter;
 	
 	/* Delete helper objects: */
 	delete dinosaurEcosystem;
 	delete dinosaurRenderer;
 	delete terrainQuery;
 	delete waterTable;
+	delete elevationCache;
 	delete depthImageRenderer;
+	delete detectionScheduler;
 	delete handExtractor;
 	delete addWaterFunction;
 	delete[] pixelDepthCorrection;
 	delete remoteServer;
+	delete gridArchiver;
+	delete gridReadback;
+	delete profiler;
+	delete startupProfile;
 	
 	delete mainMenu;
 	delete waterControlDialog;
@@ -1183,6 +1629,7 @@ void Sandbox::toolDestructionCallback(Vrui::ToolManager::ToolDestructionCallback
 		{
 		/* Deactivate the active DEM tool: */
 		activeDem=0;
+		updateDemMatching();
 		}
 	}
 
@@ -1237,15 +1684,67 @@ bool isToken(const std::string& token,const char* pattern)
 
 void Sandbox::frame(void)
 	{
+	if(startupProfile!=0)
+		{
+		/* Print the startup profile once the first frame, including the initialization of all OpenGL contexts, has been displayed: */
+		double now=PerformanceProfiler::getTime();
+		if(startupFrameTime==0.0)
+			startupFrameTime=now;
+		else
+			{
+			startupProfile->addPhase("Initialize OpenGL contexts and display first frame",startupFrameTime,now);
+			startupProfile->print(std::cout);
+			delete startupProfile;
+			startupProfile=0;
+			}
+		}
+	
+	if(simulationRate>0.0)
+		{
+		/* Determine how many fixed-rate simulation ticks are due in this frame: */
+		double tickInterval=1.0/simulationRate;
+		simulationClock+=Vrui::getFrameTime();
+		numSimulationTicks=0;
+		while(simulationClock>=tickInterval&&numSimulationTicks<maxSimulationTicks)
+			{
+			simulationClock-=tickInterval;
+			++numSimulationTicks;
+			}
+		
+		/* Drop any remaining backlog so that a slow frame does not cause ever longer catch-up frames: */
+		if(simulationClock>=tickInterval)
+			simulationClock=Math::mod(simulationClock,tickInterval);
+		}
+	
 	/* Call the remote server's frame method: */
 	if(remoteServer!=0)
 		remoteServer->frame(Vrui::getApplicationTime());
 	
+	/* Call the grid archiver's frame method: */
+	if(gridArchiver!=0)
+		gridArchiver->frame(Vrui::getApplicationTime());
+	
+	/* Start DEM matching once the active DEM's region finished loading in the background: */
+	if(activeDem!=0&&activeDem->update())
+		updateDemMatching();
+	
 	/* Check if the filtered frame has been updated: */
-	if(filteredFrames.lockNewValue())
+	bool newFilteredFrame;
+	PixelRect filteredFrameDirtyRegion;
+	{
+	Threads::Mutex::Lock filteredFramesLock(filteredFramesMutex);
+	newFilteredFrame=filteredFrames.lockNewValue();
+	if(newFilteredFrame)
+		{
+		/* Take over the merged dirty region of the locked frame and all frames skipped before it: */
+		filteredFrameDirtyRegion=pendingDirtyRegion;
+		pendingDirtyRegion=PixelRect();
+		}
+	}
+	if(newFilteredFrame)
 		{
 		/* Update the depth image renderer's depth image: */
-		depthImageRenderer->setDepthImage(filteredFrames.getLockedValue());
+		depthImageRenderer->setDepthImage(filteredFrames.getLockedValue().frame,filteredFrameDirtyRegion);
 		}
 	
 	if(handExtractor!=0)
@@ -1269,10 +1768,19 @@ void Sandbox::frame(void)
 		#endif
 		}
 	
+	if(waterTable!=0)
+		{
+		/* Rasterize the water sources again before the next simulation step, as hands and water tools may have moved since the last frame: */
+		waterTable->invalidateWaterSources();
+		
+		/* Age pending step size readbacks: */
+		waterTable->startFrame();
+		}
+	
 	/* Update all surface renderers: */
 	for(std::vector<RenderSettings>::iterator rsIt=renderSettings.begin();rsIt!=renderSettings.end();++rsIt)
 		rsIt->surfaceRenderer->setAnimationTime(Vrui::getApplicationTime());
-
+	
 	/* Update dinosaur ecosystem */
 	if(dinosaurEcosystem!=0 && dinosaursEnabled)
 		{
@@ -1289,12 +1797,21 @@ void Sandbox::frame(void)
 				}
 			dinosaurEcosystem->setDetectedHands(handPositions);
 			}
-
-		/* Update dinosaur simulation */
-		float deltaTime=float(Vrui::getFrameTime());
-		dinosaurEcosystem->update(deltaTime);
+		
+		/* Update dinosaur simulation, once per frame or once per fixed-rate simulation tick: */
+		PerformanceProfiler::CpuTimer ecosystemTimer(profiler,profilerStages[5]);
+		if(simulationRate>0.0)
+			{
+			for(unsigned int tick=0;tick<numSimulationTicks;++tick)
+				dinosaurEcosystem->update(float(1.0/simulationRate));
+			
+			/* Render the dinosaurs between the two most recent ticks according to the time elapsed since the last one: */
+			dinosaurEcosystem->interpolate(float(simulationClock*simulationRate));
+			}
+		else
+			dinosaurEcosystem->update(float(Vrui::getFrameTime()));
 		}
-
+	
 	/* Check if there is a control command on the control pipe: */
 	if(controlPipeFd>=0)
 		{
@@ -1507,6 +2024,38 @@ void Sandbox::frame(void)
 					else
 						std::cerr<<"Wrong number of arguments for dippingBedThickness control pipe command"<<std::endl;
 					}
+				else if(isToken(tokens[0],"detectionStats"))
+					{
+					if(detectionScheduler!=0)
+						{
+						/* Print the frame and latency counters of all detection stages: */
+						for(unsigned int i=0;i<detectionScheduler->getNumStages();++i)
+							{
+							DetectionScheduler::StageStats stats=detectionScheduler->getStageStats(i);
+							std::cout<<"Detection stage "<<detectionScheduler->getStageName(i)<<": "<<stats.numProcessed<<" processed, "<<stats.numSkipped<<" skipped, "<<stats.numDropped<<" dropped, latency "<<stats.lastLatency*1000.0<<" ms (avg "<<stats.averageLatency*1000.0<<" ms, max "<<stats.maxLatency*1000.0<<" ms)"<<std::endl;
+							}
+						}
+					else
+						std::cerr<<"No detection scheduler for detectionStats control pipe command"<<std::endl;
+					}
+				else if(isToken(tokens[0],"profileStats"))
+					{
+					if(profiler!=0)
+						{
+						/* Print the statistics of all profiler stages in a machine-readable format: */
+						for(unsigned int i=0;i<profiler->getNumStages();++i)
+							{
+							PerformanceProfiler::StageStats stats=profiler->getStageStats(i);
+							std::cout<<"profile stage="<<profiler->getStageName(i)<<" type="<<(profiler->isGpuStage(i)?"gpu":"cpu")<<" samples="<<stats.numSamples;
+							std::cout<<" last="<<stats.last<<" avg="<<stats.average<<" min="<<stats.min<<" max="<<stats.max<<" histogram=";
+							for(unsigned int bin=0;bin<PerformanceProfiler::numHistogramBins;++bin)
+								std::cout<<(bin>0?",":"")<<stats.histogram[bin];
+							std::cout<<std::endl;
+							}
+						}
+					else
+						std::cerr<<"Profiling is disabled for profileStats control pipe command"<<std::endl;
+					}
 				else
 					std::cerr<<"Unrecognized control pipe command "<<tokens[0]<<std::endl;
 				}
@@ -1517,6 +2066,15 @@ void Sandbox::frame(void)
 		{
 		/* Update the frame rate display: */
 		frameRateTextField->setValue(1.0/Vrui::getCurrentFrameTime());
+		
+		/* Update the profiler stage displays: */
+		for(unsigned int i=0;i<profilerStatsLabels.size();++i)
+			{
+			PerformanceProfiler::StageStats stats=profiler->getStageStats(i);
+			char statsText[80];
+			snprintf(statsText,sizeof(statsText),"%7.3f ms avg %7.3f ms max %s",stats.average,stats.max,PerformanceProfiler::formatHistogram(stats).c_str());
+			profilerStatsLabels[i]->setString(statsText);
+			}
 		}
 	
 	if(pauseUpdates)
@@ -1536,71 +2094,68 @@ void Sandbox::display(GLContextData& contextData) const
 		;
 	const RenderSettings& rs=windowIndex<int(renderSettings.size())?renderSettings[windowIndex]:renderSettings.back();
 	
+	/* Collect finished GPU measurements from previous frames: */
+	if(profiler!=0)
+		profiler->processGpuResults(contextData);
+	
+	/* Check if this window runs the water simulation for its context, or if the context mirrors a simulation run elsewhere: */
+	bool simulationWindow=waterSimulationWindow<0||waterSimulationWindow>=Vrui::getNumWindows()||windowIndex==waterSimulationWindow;
+	if(simulationWindow)
+		dataItem->ownsWaterSimulation=true;
+	
 	/* Check if the water simulation state needs to be updated: */
-	if(waterTable!=0&&dataItem->waterTableTime!=Vrui::getApplicationTime())
+	if(waterTable!=0&&simulationWindow&&dataItem->waterTableTime!=Vrui::getApplicationTime())
 		{
-		/* Retrieve a potential pending grid read-back request: */
-		GridRequest::Request request=gridRequest.getRequest();
-		
 		/* Update the water table's bathymetry grid: */
+		{
+		PerformanceProfiler::GpuTimer bathymetryTimer(profiler,profilerStages[0],contextData);
 		waterTable->updateBathymetry(contextData);
+		}
 		
-		/* Check if the grid request is active and wants bathymetry data: */
-		if(request.isActive()&&request.bathymetryBuffer!=0)
+		/* Run the water flow simulation's main pass, once per frame or once per fixed-rate simulation tick: */
+		if(simulationRate>0.0)
 			{
-			/* Read back the current bathymetry grid: */
-			waterTable->bindBathymetryTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.bathymetryBuffer);
-			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			for(unsigned int tick=0;tick<numSimulationTicks;++tick)
+				runWaterSimulation(GLfloat(waterSpeed/simulationRate),contextData);
 			}
+		else
+			runWaterSimulation(GLfloat(Vrui::getFrameTime()*waterSpeed),contextData);
 		
-		/* Run the water flow simulation's main pass: */
-		GLfloat totalTimeStep=GLfloat(Vrui::getFrameTime()*waterSpeed);
-		unsigned int numSteps=0;
-		while(numSteps<waterMaxSteps-1U&&totalTimeStep>1.0e-8f)
-			{
-			/* Run with a self-determined time step to maintain stability: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(false,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
-			}
-		#if 0
-		if(totalTimeStep>1.0e-8f)
-			{
-			std::cout<<'.'<<std::flush;
-			/* Force the final step to avoid simulation slow-down: */
-			waterTable->setMaxStepSize(totalTimeStep);
-			GLfloat timeStep=waterTable->runSimulationStep(true,contextData);
-			totalTimeStep-=timeStep;
-			++numSteps;
-			}
-		#else
-		if(totalTimeStep>1.0e-8f)
-			std::cout<<"Ran out of time by "<<totalTimeStep<<std::endl;
-		#endif
+		/* Request new grids for the terrain query cache: */
+		if(terrainQuery!=0)
+			terrainQuery->update(*gridReadback);
 		
-		/* Check if the grid request is active and wants water level data: */
-		if(request.isActive()&&request.waterLevelBuffer!=0)
-			{
-			/* Read back the current water level grid: */
-			waterTable->bindQuantityTexture(contextData);
-			glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,request.waterLevelBuffer);
-			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
-			}
+		/* Read back a fresh snapshot on every frame for the mirroring contexts: */
+		if(waterSimulationWindow>=0)
+			gridReadback->requestSnapshot();
 		
-		/* Finish an active grid request: */
-		if(request.isActive())
-			request.complete();
+		/* Deliver finished grid read-backs and start a new one for all pending requests: */
+		{
+		PerformanceProfiler::GpuTimer readbackTimer(profiler,profilerStages[1],contextData);
+		gridReadback->process(contextData);
+		}
 		
 		/* Mark the water simulation state as up-to-date for this frame: */
 		dataItem->waterTableTime=Vrui::getApplicationTime();
-
-		/* Update terrain query cache from GPU textures */
-		if(terrainQuery!=0)
-			terrainQuery->update(contextData);
 		}
-
+	else if(waterTable!=0&&!dataItem->ownsWaterSimulation&&dataItem->waterTableTime!=Vrui::getApplicationTime())
+		{
+		/* Mirror the most recent grid snapshot read back from the simulating context: */
+		if(gridReadback->getSnapshotGeneration()!=dataItem->mirroredSnapshotGeneration)
+			{
+			const GridReadback::Snapshot* snapshot=gridReadback->acquireSnapshot();
+			if(snapshot!=0)
+				{
+				waterTable->setMirroredState(snapshot->getBathymetry(),snapshot->getWaterLevel(),contextData);
+				dataItem->mirroredSnapshotGeneration=snapshot->getGeneration();
+				gridReadback->releaseSnapshot(snapshot);
+				}
+			}
+		
+		/* Mark the mirrored water state as up-to-date for this frame: */
+		dataItem->waterTableTime=Vrui::getApplicationTime();
+		}
+	
 	/* Calculate the projection matrix: */
 	PTransform projection=ds.projection;
 	if(rs.fixProjectorView&&rs.projectorTransformValid)
@@ -1618,199 +2173,252 @@ void Sandbox::display(GLContextData& contextData) const
 		glMaterial(GLMaterialEnums::FRONT,rs.surfaceMaterial);
 		}
 	
-	#if 0
-	if(rs.hillshade&&rs.useShadows)
+	/* Check if the expensive surface passes must be rendered, or if the previous frame can be re-presented: */
+	int renderViewport[4];
+	for(int i=0;i<4;++i)
+		renderViewport[i]=ds.viewport[i];
+	bool renderSurface=true;
+	if(rs.adaptiveRenderTarget!=0)
 		{
-		/* Set up OpenGL state: */
-		glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT|GL_POLYGON_BIT);
-		
-		GLLightTracker& lt=*contextData.getLightTracker();
-		
-		/* Save the currently-bound frame buffer and viewport: */
-		GLint currentFrameBuffer;
-		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
-		GLint currentViewport[4];
-		glGetIntegerv(GL_VIEWPORT,currentViewport);
-		
-		/*******************************************************************
-		First rendering pass: Global ambient illumination only
-		*******************************************************************/
-		
-		/* Draw the surface mesh: */
-		surfaceRenderer->glRenderGlobalAmbientHeightMap(dataItem->heightColorMapObject,contextData);
-		
-		/*******************************************************************
-		Second rendering pass: Add local illumination for every light source
-		*******************************************************************/
-		
-		/* Enable additive rendering: */
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE,GL_ONE);
-		glDepthFunc(GL_LEQUAL);
-		glDepthMask(GL_FALSE);
-		
-		for(int lightSourceIndex=0;lightSourceIndex<lt.getMaxNumLights();++lightSourceIndex)
-			if(lt.getLightState(lightSourceIndex).isEnabled())
-				{
-				/***************************************************************
-				First step: Render to the light source's shadow map
-				***************************************************************/
-				
-				/* Set up OpenGL state to render to the shadow map: */
-				glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->shadowFramebufferObject);
-				glViewport(0,0,dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
-				glDepthMask(GL_TRUE);
-				glClear(GL_DEPTH_BUFFER_BIT);
-				glCullFace(GL_FRONT);
-				
-				/*************************************************************
-				Calculate the shadow projection matrix:
-				*************************************************************/
-				
-				/* Get the light source position in eye space: */
-				Geometry::HVector<float,3> lightPosEc;
-				glGetLightfv(GL_LIGHT0+lightSourceIndex,GL_POSITION,lightPosEc.getComponents());
-				
-				/* Transform the light source position to camera space: */
-				Vrui::ONTransform::HVector lightPosCc=Vrui::getDisplayState(contextData).modelviewNavigational.inverseTransform(Vrui::ONTransform::HVector(lightPosEc));
-				
-				/* Calculate the direction vector from the center of the bounding box to the light source: */
-				Point bboxCenter=Geometry::mid(bbox.min,bbox.max);
-				Vrui::Vector lightDirCc=Vrui::Vector(lightPosCc.getComponents())-Vrui::Vector(bboxCenter.getComponents())*lightPosCc[3];
-				
-				/* Build a transformation that aligns the light direction with the positive z axis: */
-				Vrui::ONTransform shadowModelview=Vrui::ONTransform::rotate(Vrui::Rotation::rotateFromTo(lightDirCc,Vrui::Vector(0,0,1)));
-				shadowModelview*=Vrui::ONTransform::translateToOriginFrom(bboxCenter);
-				
-				/* Create a projection matrix, based on whether the light is positional or directional: */
-				PTransform shadowProjection(0.0);
-				if(lightPosEc[3]!=0.0f)
+		AdaptiveRenderTarget::FrameKey frameKey;
+		frameKey.projectionModelview=projection;
+		frameKey.projectionModelview*=ds.modelviewNavigational;
+		frameKey.depthImageVersion=depthImageRenderer->getDepthImageVersion();
+		frameKey.settingsVersion=rs.surfaceRenderer->getSettingsVersion();
+		frameKey.lightTrackerVersion=contextData.getLightTracker()->getVersion();
+		frameKey.animated=waterTable!=0;
+		renderSurface=rs.adaptiveRenderTarget->beginFrame(ds.viewport,frameKey,renderViewport,contextData);
+		}
+	
+	if(renderSurface)
+		{
+		#if 0
+		if(rs.hillshade&&rs.useShadows)
+			{
+			/* Set up OpenGL state: */
+			glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_ENABLE_BIT|GL_POLYGON_BIT);
+			
+			GLLightTracker& lt=*contextData.getLightTracker();
+			
+			/* Save the currently-bound frame buffer and viewport: */
+			GLint currentFrameBuffer;
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+			GLint currentViewport[4];
+			glGetIntegerv(GL_VIEWPORT,currentViewport);
+			
+			/*******************************************************************
+			First rendering pass: Global ambient illumination only
+			*******************************************************************/
+			
+			/* Draw the surface mesh: */
+			surfaceRenderer->glRenderGlobalAmbientHeightMap(dataItem->heightColorMapObject,contextData);
+			
+			/*******************************************************************
+			Second rendering pass: Add local illumination for every light source
+			*******************************************************************/
+			
+			/* Enable additive rendering: */
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE,GL_ONE);
+			glDepthFunc(GL_LEQUAL);
+			glDepthMask(GL_FALSE);
+			
+			for(int lightSourceIndex=0;lightSourceIndex<lt.getMaxNumLights();++lightSourceIndex)
+				if(lt.getLightState(lightSourceIndex).isEnabled())
 					{
-					/* Modify the modelview transformation such that the light source is at the origin: */
-					shadowModelview.leftMultiply(Vrui::ONTransform::translate(Vrui::Vector(0,0,-lightDirCc.mag())));
+					/***************************************************************
+					First step: Render to the light source's shadow map
+					***************************************************************/
+					
+					/* Set up OpenGL state to render to the shadow map: */
+					glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->shadowFramebufferObject);
+					glViewport(0,0,dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
+					glDepthMask(GL_TRUE);
+					glClear(GL_DEPTH_BUFFER_BIT);
+					glCullFace(GL_FRONT);
+					
+					/*************************************************************
+					Calculate the shadow projection matrix:
+					*************************************************************/
+					
+					/* Get the light source position in eye space: */
+					Geometry::HVector<float,3> lightPosEc;
+					glGetLightfv(GL_LIGHT0+lightSourceIndex,GL_POSITION,lightPosEc.getComponents());
 					
-					/***********************************************************
-					Create a perspective projection:
-					***********************************************************/
+					/* Transform the light source position to camera space: */
+					Vrui::ONTransform::HVector lightPosCc=Vrui::getDisplayState(contextData).modelviewNavigational.inverseTransform(Vrui::ONTransform::HVector(lightPosEc));
 					
-					/* Calculate the perspective bounding box of the surface bounding box in eye space: */
-					Box pBox=Box::empty;
-					for(int i=0;i<8;++i)
+					/* Calculate the direction vector from the center of the bounding box to the light source: */
+					Point bboxCenter=Geometry::mid(bbox.min,bbox.max);
+					Vrui::Vector lightDirCc=Vrui::Vector(lightPosCc.getComponents())-Vrui::Vector(bboxCenter.getComponents())*lightPosCc[3];
+					
+					/* Build a transformation that aligns the light direction with the positive z axis: */
+					Vrui::ONTransform shadowModelview=Vrui::ONTransform::rotate(Vrui::Rotation::rotateFromTo(lightDirCc,Vrui::Vector(0,0,1)));
+					shadowModelview*=Vrui::ONTransform::translateToOriginFrom(bboxCenter);
+					
+					/* Create a projection matrix, based on whether the light is positional or directional: */
+					PTransform shadowProjection(0.0);
+					if(lightPosEc[3]!=0.0f)
 						{
-						Point bc=shadowModelview.transform(bbox.getVertex(i));
-						pBox.addPoint(Point(-bc[0]/bc[2],-bc[1]/bc[2],-bc[2]));
+						/* Modify the modelview transformation such that the light source is at the origin: */
+						shadowModelview.leftMultiply(Vrui::ONTransform::translate(Vrui::Vector(0,0,-lightDirCc.mag())));
+						
+						/***********************************************************
+						Create a perspective projection:
+						***********************************************************/
+						
+						/* Calculate the perspective bounding box of the surface bounding box in eye space: */
+						Box pBox=Box::empty;
+						for(int i=0;i<8;++i)
+							{
+							Point bc=shadowModelview.transform(bbox.getVertex(i));
+							pBox.addPoint(Point(-bc[0]/bc[2],-bc[1]/bc[2],-bc[2]));
+							}
+						
+						/* Upload the frustum matrix: */
+						double l=pBox.min[0]*pBox.min[2];
+						double r=pBox.max[0]*pBox.min[2];
+						double b=pBox.min[1]*pBox.min[2];
+						double t=pBox.max[1]*pBox.min[2];
+						double n=pBox.min[2];
+						double f=pBox.max[2];
+						shadowProjection.getMatrix()(0,0)=2.0*n/(r-l);
+						shadowProjection.getMatrix()(0,2)=(r+l)/(r-l);
+						shadowProjection.getMatrix()(1,1)=2.0*n/(t-b);
+						shadowProjection.getMatrix()(1,2)=(t+b)/(t-b);
+						shadowProjection.getMatrix()(2,2)=-(f+n)/(f-n);
+						shadowProjection.getMatrix()(2,3)=-2.0*f*n/(f-n);
+						shadowProjection.getMatrix()(3,2)=-1.0;
+						}
+					else
+						{
+						/***********************************************************
+						Create a perspective projection:
+						***********************************************************/
+						
+						/* Transform the bounding box with the modelview transformation: */
+						Box bboxEc=bbox;
+						bboxEc.transform(shadowModelview);
+						
+						/* Upload the ortho matrix: */
+						double l=bboxEc.min[0];
+						double r=bboxEc.max[0];
+						double b=bboxEc.min[1];
+						double t=bboxEc.max[1];
+						double n=-bboxEc.max[2];
+						double f=-bboxEc.min[2];
+						shadowProjection.getMatrix()(0,0)=2.0/(r-l);
+						shadowProjection.getMatrix()(0,3)=-(r+l)/(r-l);
+						shadowProjection.getMatrix()(1,1)=2.0/(t-b);
+						shadowProjection.getMatrix()(1,3)=-(t+b)/(t-b);
+						shadowProjection.getMatrix()(2,2)=-2.0/(f-n);
+						shadowProjection.getMatrix()(2,3)=-(f+n)/(f-n);
+						shadowProjection.getMatrix()(3,3)=1.0;
 						}
 					
-					/* Upload the frustum matrix: */
-					double l=pBox.min[0]*pBox.min[2];
-					double r=pBox.max[0]*pBox.min[2];
-					double b=pBox.min[1]*pBox.min[2];
-					double t=pBox.max[1]*pBox.min[2];
-					double n=pBox.min[2];
-					double f=pBox.max[2];
-					shadowProjection.getMatrix()(0,0)=2.0*n/(r-l);
-					shadowProjection.getMatrix()(0,2)=(r+l)/(r-l);
-					shadowProjection.getMatrix()(1,1)=2.0*n/(t-b);
-					shadowProjection.getMatrix()(1,2)=(t+b)/(t-b);
-					shadowProjection.getMatrix()(2,2)=-(f+n)/(f-n);
-					shadowProjection.getMatrix()(2,3)=-2.0*f*n/(f-n);
-					shadowProjection.getMatrix()(3,2)=-1.0;
-					}
-				else
-					{
-					/***********************************************************
-					Create a perspective projection:
-					***********************************************************/
+					/* Multiply the shadow modelview matrix onto the shadow projection matrix: */
+					shadowProjection*=shadowModelview;
+					
+					/* Draw the surface into the shadow buffer: */
+					surfaceRenderer->glRenderDepthOnly(shadowProjection,contextData);
 					
-					/* Transform the bounding box with the modelview transformation: */
-					Box bboxEc=bbox;
-					bboxEc.transform(shadowModelview);
+					/* Reset OpenGL state: */
+					glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+					glViewport(currentViewport[0],currentViewport[1],currentViewport[2],currentViewport[3]);
+					glCullFace(GL_BACK);
+					glDepthMask(GL_FALSE);
 					
-					/* Upload the ortho matrix: */
-					double l=bboxEc.min[0];
-					double r=bboxEc.max[0];
-					double b=bboxEc.min[1];
-					double t=bboxEc.max[1];
-					double n=-bboxEc.max[2];
-					double f=-bboxEc.min[2];
-					shadowProjection.getMatrix()(0,0)=2.0/(r-l);
-					shadowProjection.getMatrix()(0,3)=-(r+l)/(r-l);
-					shadowProjection.getMatrix()(1,1)=2.0/(t-b);
-					shadowProjection.getMatrix()(1,3)=-(t+b)/(t-b);
-					shadowProjection.getMatrix()(2,2)=-2.0/(f-n);
-					shadowProjection.getMatrix()(2,3)=-(f+n)/(f-n);
-					shadowProjection.getMatrix()(3,3)=1.0;
+					#if SAVEDEPTH
+					/* Save the depth image: */
+					{
+					glBindTexture(GL_TEXTURE_2D,dataItem->shadowDepthTextureObject);
+					GLfloat* depthTextureImage=new GLfloat[dataItem->shadowBufferSize[1]*dataItem->shadowBufferSize[0]];
+					glGetTexImage(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT,GL_FLOAT,depthTextureImage);
+					glBindTexture(GL_TEXTURE_2D,0);
+					Images::RGBImage dti(dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
+					GLfloat* dtiPtr=depthTextureImage;
+					Images::RGBImage::Color* ciPtr=dti.modifyPixels();
+					for(int y=0;y<dataItem->shadowBufferSize[1];++y)
+						for(int x=0;x<dataItem->shadowBufferSize[0];++x,++dtiPtr,++ciPtr)
+							{
+							GLColor<GLfloat,3> tc(*dtiPtr,*dtiPtr,*dtiPtr);
+							*ciPtr=tc;
+							}
+					delete[] depthTextureImage;
+					Images::writeImageFile(dti,"DepthImage.png");
 					}
-				
-				/* Multiply the shadow modelview matrix onto the shadow projection matrix: */
-				shadowProjection*=shadowModelview;
-				
-				/* Draw the surface into the shadow buffer: */
-				surfaceRenderer->glRenderDepthOnly(shadowProjection,contextData);
-				
-				/* Reset OpenGL state: */
-				glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
-				glViewport(currentViewport[0],currentViewport[1],currentViewport[2],currentViewport[3]);
-				glCullFace(GL_BACK);
-				glDepthMask(GL_FALSE);
-				
-				#if SAVEDEPTH
-				/* Save the depth image: */
-				{
-				glBindTexture(GL_TEXTURE_2D,dataItem->shadowDepthTextureObject);
-				GLfloat* depthTextureImage=new GLfloat[dataItem->shadowBufferSize[1]*dataItem->shadowBufferSize[0]];
-				glGetTexImage(GL_TEXTURE_2D,0,GL_DEPTH_COMPONENT,GL_FLOAT,depthTextureImage);
-				glBindTexture(GL_TEXTURE_2D,0);
-				Images::RGBImage dti(dataItem->shadowBufferSize[0],dataItem->shadowBufferSize[1]);
-				GLfloat* dtiPtr=depthTextureImage;
-				Images::RGBImage::Color* ciPtr=dti.modifyPixels();
-				for(int y=0;y<dataItem->shadowBufferSize[1];++y)
-					for(int x=0;x<dataItem->shadowBufferSize[0];++x,++dtiPtr,++ciPtr)
-						{
-						GLColor<GLfloat,3> tc(*dtiPtr,*dtiPtr,*dtiPtr);
-						*ciPtr=tc;
-						}
-				delete[] depthTextureImage;
-				Images::writeImageFile(dti,"DepthImage.png");
-				}
-				#endif
-				
-				/* Draw the surface using the shadow texture: */
-				rs.surfaceRenderer->glRenderShadowedIlluminatedHeightMap(dataItem->heightColorMapObject,dataItem->shadowDepthTextureObject,shadowProjection,contextData);
-				}
+					#endif
+					
+					/* Draw the surface using the shadow texture: */
+					rs.surfaceRenderer->glRenderShadowedIlluminatedHeightMap(dataItem->heightColorMapObject,dataItem->shadowDepthTextureObject,shadowProjection,contextData);
+					}
+			
+			/* Reset OpenGL state: */
+			glPopAttrib();
+			}
+		else
+		#endif
+		if(rs.depthPrepass)
+			{
+			/* Lay down the surface's depth at full resolution so that the fragment-heavy surface shader only runs on visible fragments, and the water surface is depth-tested against it as usual: */
+			glPushAttrib(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+			glColorMask(GL_FALSE,GL_FALSE,GL_FALSE,GL_FALSE);
+			PTransform projectionModelview=projection;
+			projectionModelview*=ds.modelviewNavigational;
+			depthImageRenderer->renderDepth(projectionModelview,0,contextData);
+			
+			/* Shade the surface against the prepassed depth buffer: */
+			glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+			glDepthFunc(GL_LEQUAL);
+			glDepthMask(GL_FALSE);
+			PerformanceProfiler::GpuTimer surfaceTimer(profiler,profilerStages[2],contextData);
+			rs.surfaceRenderer->renderSinglePass(renderViewport,projection,ds.modelviewNavigational,contextData);
+			glPopAttrib();
+			}
+		else
+			{
+			/* Render the surface in a single pass: */
+			PerformanceProfiler::GpuTimer surfaceTimer(profiler,profilerStages[2],contextData);
+			rs.surfaceRenderer->renderSinglePass(renderViewport,projection,ds.modelviewNavigational,contextData);
+			}
 		
-		/* Reset OpenGL state: */
-		glPopAttrib();
-		}
-	else
-	#endif
-		{
-		/* Render the surface in a single pass: */
-		rs.surfaceRenderer->renderSinglePass(ds.viewport,projection,ds.modelviewNavigational,contextData);
+		if(rs.waterRenderer!=0)
+			{
+			/* Draw the water surface: */
+			glMaterialAmbientAndDiffuse(GLMaterialEnums::FRONT,GLColor<GLfloat,4>(0.0f,0.5f,0.8f));
+			glMaterialSpecular(GLMaterialEnums::FRONT,GLColor<GLfloat,4>(1.0f,1.0f,1.0f));
+			glMaterialShininess(GLMaterialEnums::FRONT,64.0f);
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+			PerformanceProfiler::GpuTimer waterSurfaceTimer(profiler,profilerStages[3],contextData);
+			rs.waterRenderer->render(projection,ds.modelviewNavigational,contextData);
+			glDisable(GL_BLEND);
+			}
+		
+		if(rs.adaptiveRenderTarget!=0)
+			{
+			/* Finish rendering into the off-screen frame buffer: */
+			rs.adaptiveRenderTarget->endFrame(contextData);
+			}
 		}
 	
-	if(rs.waterRenderer!=0)
+	if(rs.adaptiveRenderTarget!=0)
 		{
-		/* Draw the water surface: */
-		glMaterialAmbientAndDiffuse(GLMaterialEnums::FRONT,GLColor<GLfloat,4>(0.0f,0.5f,0.8f));
-		glMaterialSpecular(GLMaterialEnums::FRONT,GLColor<GLfloat,4>(1.0f,1.0f,1.0f));
-		glMaterialShininess(GLMaterialEnums::FRONT,64.0f);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
-		rs.waterRenderer->render(projection,ds.modelviewNavigational,contextData);
-		glDisable(GL_BLEND);
+		/* Upscale the held frame into the window: */
+		rs.adaptiveRenderTarget->present(contextData);
 		}
-
+	
 	/* Draw dinosaurs */
 	if(dinosaurRenderer!=0 && dinosaursEnabled && dinosaurEcosystem!=0)
 		{
+		PerformanceProfiler::GpuTimer dinosaursTimer(profiler,profilerStages[4],contextData);
 		dinosaurRenderer->render(
-			dinosaurEcosystem->getDinosaurs(),
+			dinosaurEcosystem->getView(),
 			projection,
 			ds.modelviewNavigational,
 			contextData);
 		}
-
+	
 	/* Call the remote server's render method: */
 	if(remoteServer!=0)
 		{
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SANDBOX_INCLUDED
 #define SANDBOX_INCLUDED
 
+#include <string>
 #include <Threads/Mutex.h>
 #include <Threads/TripleBuffer.h>
 #include <Geometry/Box.h>
@@ -51,6 +52,7 @@ class FunctionCall;
 }
 class GLContextData;
 namespace GLMotif {
+class Label;
 class PopupMenu;
 class PopupWindow;
 class TextField;
@@ -62,18 +64,27 @@ namespace Kinect {
 class Camera;
 }
 class FrameFilter;
+class GPUFrameFilter;
 class DepthImageRenderer;
 class ElevationColorMap;
 class DEM;
+class ElevationCache;
 class SurfaceRenderer;
 class WaterTable2;
 class HandExtractor;
+class DetectionScheduler;
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction;
 class RemoteServer;
+class GridArchiver;
 class WaterRenderer;
+class AdaptiveRenderTarget;
 class DinosaurEcosystem;
 class DinosaurRenderer;
 class TerrainQuery;
+class GridReadback;
+class DepthRecorder;
+class PerformanceProfiler;
+class StartupProfile;
 
 class Sandbox:public Vrui::Application,public GLObject
 	{
@@ -83,11 +94,20 @@ class Sandbox:public Vrui::Application,public GLObject
 	typedef Geometry::OrthonormalTransformation<Scalar,3> ONTransform; // Type for rigid body transformations
 	typedef Kinect::FrameSource::DepthCorrection::PixelCorrection PixelDepthCorrection; // Type for per-pixel depth correction factors
 	
+	struct FilteredFrame // Structure for filtered depth frames passed from the frame filter to the foreground thread
+		{
+		/* Elements: */
+		public:
+		Kinect::FrameBuffer frame; // The filtered depth frame
+		};
+	
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
 		public:
 		double waterTableTime; // Simulation time stamp of the water table in this OpenGL context
+		bool ownsWaterSimulation; // Flag whether this OpenGL context runs the water simulation instead of mirroring it from another context
+		unsigned int mirroredSnapshotGeneration; // Generation of the grid snapshot most recently mirrored into this OpenGL context's water table
 		GLsizei shadowBufferSize[2]; // Size of the shadow rendering frame buffer
 		GLuint shadowFramebufferObject; // Frame buffer object to render shadow maps
 		GLuint shadowDepthTextureObject; // Depth texture for the shadow rendering frame buffer
@@ -97,71 +117,6 @@ class Sandbox:public Vrui::Application,public GLObject
 		virtual ~DataItem(void);
 		};
 	
-	struct GridRequest // Structure representing a request to read back bathymetry and/or water level grids from the GPU
-		{
-		/* Embedded classes: */
-		public:
-		typedef void (*CallbackFunction)(GLfloat*,GLfloat*,void*); // Type for callback functions
-		
-		struct Request // Structure holding a request's parameters
-			{
-			/* Elements: */
-			public:
-			GLfloat* bathymetryBuffer; // Pointer to a buffer to hold the requested bathymetry grid if requested
-			GLfloat* waterLevelBuffer; // Pointer to a buffer to hold the requested water level grid if requested
-			CallbackFunction callback; // Function to call when the grid(s) has/have been read back
-			void* callbackData; // Additional data element to pass to callback function
-			
-			/* Constructors and destructors: */
-			Request(void) // Creates an inactive request
-				:bathymetryBuffer(0),waterLevelBuffer(0),callback(0),callbackData(0)
-				{
-				}
-			
-			/* Methods: */
-			bool isActive(void) const // Returns true if there is a pending request
-				{
-				return callback!=0;
-				}
-			void complete(void) // Calls the read-back callback
-				{
-				(*callback)(bathymetryBuffer,waterLevelBuffer,callbackData);
-				}
-			};
-		
-		/* Elements: */
-		Threads::Mutex mutex; // Mutex serializing access to the request structure
-		Request currentRequest; // The currently pending grid request
-		
-		/* Constructors and destructors: */
-		GridRequest(void) // Creates an inactive grid request
-			{
-			}
-		
-		/* Methods: */
-		bool requestGrids(GLfloat* newBathymetryBuffer,GLfloat* newWaterLevelBuffer,CallbackFunction newCallback,void* newCallbackData) // Requests a grid read-back; returns true if request has been granted
-			{
-			Threads::Mutex::Lock lock(mutex);
-			if(currentRequest.callback==0)
-				{
-				currentRequest.bathymetryBuffer=newBathymetryBuffer;
-				currentRequest.waterLevelBuffer=newWaterLevelBuffer;
-				currentRequest.callback=newCallback;
-				currentRequest.callbackData=newCallbackData;
-				return true;
-				}
-			else
-				return false;
-			}
-		Request getRequest(void) // Returns the current grid request and deactivates it
-			{
-			Threads::Mutex::Lock lock(mutex);
-			Request result=currentRequest;
-			currentRequest.callback=0;
-			return result;
-			}
-		};
-	
 	struct RenderSettings // Structure to hold per-window rendering settings
 		{
 		/* Elements: */
@@ -176,10 +131,14 @@ class Sandbox:public Vrui::Application,public GLObject
 		bool useContourLines; // Flag whether to draw elevation contour lines
 		GLfloat contourLineSpacing; // Spacing between adjacent contour lines in cm
 		bool renderWaterSurface; // Flag whether to render the water surface as a geometric surface
+		bool depthPrepass; // Flag whether to lay down the surface's depth in a prepass before shading it
 		GLfloat waterOpacity; // Opacity factor for water when rendered as texture
 		bool comicStyle; // Flag for comic/cartoon rendering style
 		SurfaceRenderer* surfaceRenderer; // Surface rendering object for this window
 		WaterRenderer* waterRenderer; // A renderer to render the water surface as geometry
+		AdaptiveRenderTarget* adaptiveRenderTarget; // Off-screen target to re-present unchanged frames and to render the surface at reduced resolution under load, or NULL
+		std::string pendingProjectorTransformName; // Name of a projector transformation file selected but not yet loaded, or empty
+		std::string pendingHeightMapName; // Name of a height map file selected but not yet loaded, or empty
 		
 		/* Constructors and destructors: */
 		RenderSettings(void); // Creates default rendering settings
@@ -189,6 +148,7 @@ class Sandbox:public Vrui::Application,public GLObject
 		/* Methods: */
 		void loadProjectorTransform(const char* projectorTransformName); // Loads a projector transformation from the given file
 		void loadHeightMap(const char* heightMapName); // Loads the selected height map
+		void loadPendingFiles(void); // Loads the projector transformation and height map files selected while parsing the command line
 		};
 	
 	friend class GlobalWaterTool;
@@ -200,25 +160,43 @@ class Sandbox:public Vrui::Application,public GLObject
 	/* Elements: */
 	private:
 	RemoteServer* remoteServer; // A server to stream bathymetry and water level grids to remote clients
+	GridArchiver* gridArchiver; // Optional archiver appending bathymetry and water level grids to a time-series file
 	Kinect::FrameSource* camera; // The Kinect camera device
+	DepthRecorder* depthRecorder; // Optional recorder writing all raw depth frames to a file for later replay
 	unsigned int frameSize[2]; // Width and height of the camera's depth frames
 	PixelDepthCorrection* pixelDepthCorrection; // Buffer of per-pixel depth correction coefficients
 	Kinect::FrameSource::IntrinsicParameters cameraIps; // Intrinsic parameters of the Kinect camera
 	FrameFilter* frameFilter; // Processing object to filter raw depth frames from the Kinect camera
+	GPUFrameFilter* gpuFrameFilter; // Processing object to filter raw depth frames from the Kinect camera on the GPU, replacing the CPU frame filter
 	bool pauseUpdates; // Pauses updates of the topography
-	Threads::TripleBuffer<Kinect::FrameBuffer> filteredFrames; // Triple buffer for incoming filtered depth frames
+	Threads::TripleBuffer<FilteredFrame> filteredFrames; // Triple buffer for incoming filtered depth frames
+	Threads::Mutex filteredFramesMutex; // Mutex serializing posting and locking filtered frames with merging their dirty regions
+	PixelRect pendingDirtyRegion; // Union of the dirty regions of all filtered frames posted since the foreground thread last locked a frame
 	DepthImageRenderer* depthImageRenderer; // Object managing the current filtered depth image
+	ElevationCache* elevationCache; // Pixel-corner elevation textures shared by all surface renderers
 	ONTransform boxTransform; // Transformation from camera space to baseplane space (x along long sandbox axis, z up)
 	Scalar boxSize; // Radius of sphere around sandbox area
 	Box bbox; // Bounding box around all potential surfaces
 	WaterTable2* waterTable; // Water flow simulation object
 	double waterSpeed; // Relative speed of water flow simulation
 	unsigned int waterMaxSteps; // Maximum number of water simulation steps per frame
+	bool waterBatchSteps; // Flag whether to issue all water simulation steps of a frame at once, with step sizes selected on the GPU
+	double simulationRate; // Rate of the fixed-timestep clock advancing the water and ecosystem simulations in Hz, or 0 to advance them once per frame
+	unsigned int maxSimulationTicks; // Maximum number of fixed-rate simulation ticks per frame; any further backlog is dropped
+	double simulationClock; // Frame time accumulated since the most recent fixed-rate simulation tick
+	unsigned int numSimulationTicks; // Number of fixed-rate simulation ticks to run in the current frame
+	int waterSimulationWindow; // Index of the window whose OpenGL context alone runs the water simulation while all other contexts mirror its grids, or -1 to simulate in every context
 	GLfloat rainStrength; // Amount of water deposited by rain tools and objects on each water simulation step
 	HandExtractor* handExtractor; // Object to detect splayed hands above the sand surface to make rain
+	DetectionScheduler* detectionScheduler; // Optional shared worker pool running frame-paced detection stages
+	unsigned int handDetectionStage; // Index of the hand extraction stage in the detection scheduler
 	const AddWaterFunction* addWaterFunction; // Render function registered with the water table
 	bool addWaterFunctionRegistered; // Flag if the water adding function is currently registered with the water table
-	mutable GridRequest gridRequest; // Structure holding pending grid read-back requests
+	GridReadback* gridReadback; // Service reading back bathymetry and water level grids for any number of requesters
+	PerformanceProfiler* profiler; // Optional profiler collecting the CPU and GPU times of all processing and rendering passes
+	unsigned int profilerStages[6]; // Profiler stage indices of the bathymetry update, grid readback, surface, water surface, dinosaur rendering, and dinosaur simulation passes
+	StartupProfile* startupProfile; // Timing breakdown of application startup; printed and deleted once the first frame has been displayed
+	double startupFrameTime; // Time at which the first frame was processed while the startup profile is still open, or 0.0
 	std::vector<RenderSettings> renderSettings; // List of per-window rendering settings
 	Vrui::Lightsource* sun; // An external fixed light source
 	DEM* activeDem; // The currently active DEM
@@ -229,17 +207,20 @@ class Sandbox:public Vrui::Application,public GLObject
 	GLMotif::TextFieldSlider* waterMaxStepsSlider;
 	GLMotif::TextField* frameRateTextField;
 	GLMotif::TextFieldSlider* waterAttenuationSlider;
+	std::vector<GLMotif::Label*> profilerStatsLabels; // Labels displaying the statistics of each profiler stage in the water control dialog
 	int controlPipeFd; // File descriptor of an optional named pipe to send control commands to a running AR Sandbox
 	DinosaurEcosystem* dinosaurEcosystem; // Dinosaur ecosystem simulation
 	DinosaurRenderer* dinosaurRenderer; // Renderer for dinosaur sprites
 	TerrainQuery* terrainQuery; // Terrain and water query system
 	bool dinosaursEnabled; // Flag to enable/disable dinosaur rendering
-
+	
 	/* Private methods: */
 	void rawDepthFrameDispatcher(const Kinect::FrameBuffer& frameBuffer); // Callback receiving raw depth frames from the Kinect camera; forwards them to the frame filter and rain maker objects
 	void receiveFilteredFrame(const Kinect::FrameBuffer& frameBuffer); // Callback receiving filtered depth frames from the filter object
 	void toggleDEM(DEM* dem); // Sets or toggles the currently active DEM
+	void updateDemMatching(void); // Hands the active DEM to all physical sandboxes' surface renderers once it is ready to display
 	void addWater(GLContextData& contextData) const; // Function to render geometry that adds water to the water table
+	void runWaterSimulation(GLfloat totalTimeStep,GLContextData& contextData) const; // Advances the water flow simulation by the given time in at most the maximum number of steps
 	void pauseUpdatesCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData);
 	void showWaterControlDialogCallback(Misc::CallbackData* cbData);
 	void waterSpeedSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData);
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "SandboxClient.h"
 
+#include <string.h>
 #include <string>
 #include <stdexcept>
 #include <iostream>
@@ -36,6 +37,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/GLLightTracker.h>
 #include <GL/GLContextData.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRg.h>
@@ -49,6 +51,16 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Vrui/Lightsource.h>
 #include <Vrui/LightsourceManager.h>
 #include <Vrui/ToolManager.h>
+#include <GLMotif/StyleSheet.h>
+#include <GLMotif/WidgetManager.h>
+#include <GLMotif/PopupWindow.h>
+#include <GLMotif/RowColumn.h>
+#include <GLMotif/Label.h>
+#include <GLMotif/TextField.h>
+
+#include "GridCodec.h"
+#include "GridLODCodec.h"
+#include "GridArchiveReader.h"
 
 /****************************************************
 Static eleemnts of class SandboxClient::TeleportTool:
@@ -272,7 +284,7 @@ Methods of class SandboxClient::DataItem:
 ****************************************/
 
 SandboxClient::DataItem::DataItem(void)
-	:bathymetryTexture(0),waterTexture(0),textureVersion(0),
+	:bathymetryTexture(0),waterTexture(0),textureVersion(0),nextUploadBuffer(0),
 	 bathymetryVertexBuffer(0),bathymetryIndexBuffer(0),
 	 waterVertexBuffer(0),waterIndexBuffer(0),
 	 bathymetryVertexShader(0),bathymetryFragmentShader(0),bathymetryShaderProgram(0),
@@ -280,6 +292,7 @@ SandboxClient::DataItem::DataItem(void)
 	{
 	/* Initialize required OpenGL extensions: */
 	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
 	GLARBTextureRectangle::initExtension();
 	GLARBTextureFloat::initExtension();
 	GLARBTextureRg::initExtension();
@@ -297,6 +310,7 @@ SandboxClient::DataItem::DataItem(void)
 	glGenBuffersARB(1,&bathymetryIndexBuffer);
 	glGenBuffersARB(1,&waterVertexBuffer);
 	glGenBuffersARB(1,&waterIndexBuffer);
+	glGenBuffersARB(numUploadBuffers,uploadBuffers);
 	
 	/* Create shader objects: */
 	bathymetryVertexShader=glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
@@ -322,6 +336,7 @@ SandboxClient::DataItem::~DataItem(void)
 	glDeleteBuffersARB(1,&bathymetryIndexBuffer);
 	glDeleteBuffersARB(1,&waterVertexBuffer);
 	glDeleteBuffersARB(1,&waterIndexBuffer);
+	glDeleteBuffersARB(numUploadBuffers,uploadBuffers);
 	glDeleteObjectARB(bathymetryVertexShader);
 	glDeleteObjectARB(bathymetryFragmentShader);
 	glDeleteObjectARB(bathymetryShaderProgram);
@@ -334,31 +349,248 @@ SandboxClient::DataItem::~DataItem(void)
 Methods of class SandboxClient:
 ******************************/
 
+void SandboxClient::storeGrids(const Misc::UInt16* quantized,SandboxClient::GridBuffers& gridBuffers) const
+	{
+	/* Copy the quantized bathymetry and water level grids; they are dequantized on the GPU: */
+	size_t numBathymetryValues=size_t(gridSize[1]-1)*size_t(gridSize[0]-1);
+	size_t numWaterLevelValues=size_t(gridSize[1])*size_t(gridSize[0]);
+	memcpy(gridBuffers.bathymetry,quantized,numBathymetryValues*sizeof(Misc::UInt16));
+	memcpy(gridBuffers.waterLevel,quantized+numBathymetryValues,numWaterLevelValues*sizeof(Misc::UInt16));
+	}
+
 void SandboxClient::readGrids(void)
 	{
 	/* Start a new set of grids: */
 	GridBuffers& gb=grids.startNewValue();
 	
-	/* Calculate elevation quantization factors: */
-	GLfloat eScale=(elevationRange[1]-elevationRange[0])/65535.0f;
-	GLfloat eOffset=elevationRange[0];
-	
-	/* Receive the bathymetry grid: */
-	GLfloat* bPtr=gb.bathymetry;
-	for(GLsizei y=0;y<gridSize[1]-1;++y)
-		for(GLsizei x=0;x<gridSize[0]-1;++x,++bPtr)
-			*bPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
-	
-	/* Receive the water level grid: */
-	GLfloat* wlPtr=gb.waterLevel;
-	for(GLsizei y=0;y<gridSize[1];++y)
-		for(GLsizei x=0;x<gridSize[0];++x,++wlPtr)
-			*wlPtr=GLfloat(pipe->read<Misc::UInt16>())*eScale+eOffset;
+	if(protocolVersion>=2)
+		{
+		/* Receive a level-of-detail message and decode it on top of the previous grids: */
+		size_t messageSize=pipe->read<Misc::UInt32>();
+		frameBuffer.resize(messageSize);
+		pipe->read(&frameBuffer.front(),messageSize);
+		lodCodec->decode(&frameBuffer.front(),messageSize,&baseGrids.front(),&quantizedGrids.front());
+		
+		/* Store the assembled full-resolution bathymetry and water level grids: */
+		storeGrids(&quantizedGrids.front(),gb);
+		}
+	else if(protocolVersion>=1)
+		{
+		/* Receive a compressed frame and decode it on top of the previous grids: */
+		size_t frameSize=pipe->read<Misc::UInt32>();
+		frameBuffer.resize(frameSize);
+		pipe->read(&frameBuffer.front(),frameSize);
+		gridCodec->decode(&frameBuffer.front(),frameSize,&quantizedGrids.front());
+		
+		/* Store the quantized bathymetry and water level grids: */
+		storeGrids(&quantizedGrids.front(),gb);
+		}
+	else
+		{
+		/* Receive the quantized bathymetry and water level grids: */
+		pipe->read<Misc::UInt16>(gb.bathymetry,size_t(gridSize[1]-1)*size_t(gridSize[0]-1));
+		pipe->read<Misc::UInt16>(gb.waterLevel,size_t(gridSize[1])*size_t(gridSize[0]));
+		}
 	
 	/* Post the new set of grids: */
 	grids.postNewValue();
 	}
 
+void SandboxClient::replayArchive(double newReplayTime)
+	{
+	/* Clamp the replay time to the archive's time range: */
+	replayTime=newReplayTime;
+	if(replayTime<archiveReader->getStartTime())
+		replayTime=archiveReader->getStartTime();
+	if(replayTime>archiveReader->getEndTime())
+		replayTime=archiveReader->getEndTime();
+	
+	try
+		{
+		/* Decode the archived frame at the replay time and post it if it differs from the current one: */
+		if(archiveReader->seek(replayTime))
+			{
+			storeGrids(archiveReader->getQuantizedGrids(),grids.startNewValue());
+			grids.postNewValue();
+			}
+		}
+	catch(const std::runtime_error& err)
+		{
+		std::cerr<<"SandboxClient: Unable to replay grid archive due to exception "<<err.what()<<std::endl;
+		replayPlaying=false;
+		}
+	}
+
+void SandboxClient::replayTimeSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData)
+	{
+	/* Jump to the selected archive time: */
+	replayArchive(archiveReader->getStartTime()+cbData->value);
+	}
+
+void SandboxClient::replayPlayToggleCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData)
+	{
+	replayPlaying=cbData->set;
+	
+	/* Restart from the beginning if playback is started at the end of the archive: */
+	if(replayPlaying&&replayTime>=archiveReader->getEndTime())
+		replayArchive(archiveReader->getStartTime());
+	}
+
+GLMotif::PopupWindow* SandboxClient::createReplayDialog(void)
+	{
+	const GLMotif::StyleSheet& ss=*Vrui::getUiStyleSheet();
+	
+	/* Create a popup window shell: */
+	GLMotif::PopupWindow* replayDialogPopup=new GLMotif::PopupWindow("ReplayDialogPopup",Vrui::getWidgetManager(),"Grid Archive Replay");
+	replayDialogPopup->setResizableFlags(true,false);
+	
+	GLMotif::RowColumn* replayDialog=new GLMotif::RowColumn("ReplayDialog",replayDialogPopup,false);
+	replayDialog->setOrientation(GLMotif::RowColumn::VERTICAL);
+	replayDialog->setPacking(GLMotif::RowColumn::PACK_TIGHT);
+	replayDialog->setNumMinorWidgets(2);
+	
+	new GLMotif::Label("ReplayTimeLabel",replayDialog,"Time");
+	
+	replayTimeSlider=new GLMotif::TextFieldSlider("ReplayTimeSlider",replayDialog,8,ss.fontHeight*20.0f);
+	replayTimeSlider->getTextField()->setFieldWidth(7);
+	replayTimeSlider->getTextField()->setPrecision(1);
+	replayTimeSlider->getTextField()->setFloatFormat(GLMotif::TextField::FIXED);
+	replayTimeSlider->setSliderMapping(GLMotif::TextFieldSlider::LINEAR);
+	replayTimeSlider->setValueRange(0.0,archiveReader->getEndTime()-archiveReader->getStartTime(),0.1);
+	replayTimeSlider->setValue(replayTime-archiveReader->getStartTime());
+	replayTimeSlider->getValueChangedCallbacks().add(this,&SandboxClient::replayTimeSliderCallback);
+	
+	new GLMotif::Label("ReplayPlayLabel",replayDialog,"Playback");
+	
+	replayPlayToggle=new GLMotif::ToggleButton("ReplayPlayToggle",replayDialog,"Play");
+	replayPlayToggle->setToggle(replayPlaying);
+	replayPlayToggle->getValueChangedCallbacks().add(this,&SandboxClient::replayPlayToggleCallback);
+	
+	replayDialog->manageChild();
+	
+	return replayDialogPopup;
+	}
+
+SandboxClient::Scalar SandboxClient::intersectCell(const SandboxClient::Point& gp0,const SandboxClient::Vector& gd,const GLsizei cp[2],SandboxClient::Scalar cl0,SandboxClient::Scalar cl1) const
+	{
+	/* Intersect the line segment with the bilinear surface patch of the given cell: */
+	const Misc::UInt16* cell=grids.getLockedValue().bathymetry+(cp[1]*(gridSize[0]-1)+cp[0]);
+	Scalar c0=getElevation(cell[0]);
+	Scalar c1=getElevation(cell[1]);
+	Scalar c2=getElevation(cell[gridSize[0]-1]);
+	Scalar c3=getElevation(cell[gridSize[0]]);
+	Scalar cx0=Scalar(cp[0]);
+	Scalar cx1=Scalar(cp[0]+1);
+	Scalar cy0=Scalar(cp[1]);
+	Scalar cy1=Scalar(cp[1]+1);
+	Scalar fxy=c0-c1+c3-c2;
+	Scalar fx=(c1-c0)*cy1-(c3-c2)*cy0;
+	Scalar fy=(c2-c0)*cx1-(c3-c1)*cx0;
+	Scalar f=(c0*cx1-c1*cx0)*cy1-(c2*cx1-c3*cx0)*cy0;
+	Scalar a=fxy*gd[0]*gd[1];
+	Scalar bc0=(fxy*gp0[1]+fx);
+	Scalar bc1=(fxy*gp0[0]+fy);
+	Scalar b=bc0*gd[0]+bc1*gd[1]-gd[2];
+	Scalar c=bc0*gp0[0]+bc1*gp0[1]-gp0[2]-fxy*gp0[0]*gp0[1]+f;
+	Scalar il=cl1;
+	if(a!=Scalar(0))
+		{
+		/* Solve the quadratic equation and use the smaller valid solution: */
+		Scalar det=b*b-Scalar(4)*a*c;
+		if(det>=Scalar(0))
+			{
+			det=Math::sqrt(det);
+			if(a>Scalar(0))
+				{
+				/* Test the smaller intersection first: */
+				il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
+				if(il<cl0)
+					il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
+				}
+			else
+				{
+				/* Test the smaller intersection first: */
+				il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
+				if(il<cl0)
+					il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
+				}
+			}
+		}
+	else
+		{
+		/* Solve the linear equation: */
+		il=-c/b;
+		}
+	
+	/* Check if the intersection is valid: */
+	return il>=cl0&&il<cl1?il:Scalar(1);
+	}
+
+SandboxClient::Scalar SandboxClient::intersectNode(unsigned int level,GLsizei nx,GLsizei ny,const SandboxClient::Point& gp0,const SandboxClient::Vector& gd,SandboxClient::Scalar l0,SandboxClient::Scalar l1) const
+	{
+	/* Skip the node if the line segment passes entirely above the node's highest point: */
+	Scalar z0=gp0[2]+gd[2]*l0;
+	Scalar z1=gp0[2]+gd[2]*l1;
+	if(Math::min(z0,z1)>Scalar(heightPyramid.getRange(level,nx,ny)[1]))
+		return Scalar(1);
+	
+	/* Intersect the line segment with the cell's surface at the lowest level: */
+	if(level==0)
+		{
+		GLsizei cp[2]={nx,ny};
+		return intersectCell(gp0,gd,cp,l0,l1);
+		}
+	
+	/* Find the split coordinates between the node's children, or mark axes along which the node has a single child: */
+	const unsigned int* childSize=heightPyramid.getLevelSize(level-1);
+	GLsizei child0[2]={nx*2,ny*2};
+	bool split[2];
+	Scalar splitCoord[2];
+	for(int i=0;i<2;++i)
+		{
+		split[i]=GLsizei(childSize[i])>child0[i]+1;
+		splitCoord[i]=Scalar((child0[i]+1)<<(level-1));
+		}
+	
+	/* Find the child containing the line segment's entry point: */
+	Point gp=gp0+gd*l0;
+	int ci[2];
+	for(int i=0;i<2;++i)
+		ci[i]=split[i]&&(gp[i]>splitCoord[i]||(gp[i]==splitCoord[i]&&gd[i]>Scalar(0)))?1:0;
+	
+	/* Visit the children crossed by the line segment in front-to-back order: */
+	Scalar cl0=l0;
+	while(cl0<l1)
+		{
+		/* Calculate the line parameter where the line segment leaves the current child: */
+		Scalar cl1=l1;
+		int exit=-1;
+		for(int i=0;i<2;++i)
+			if(split[i]&&((ci[i]==0&&gd[i]>Scalar(0))||(ci[i]==1&&gd[i]<Scalar(0))))
+				{
+				Scalar el=(splitCoord[i]-gp0[i])/gd[i];
+				if(cl1>el)
+					{
+					cl1=el;
+					exit=i;
+					}
+				}
+		
+		/* Intersect the line segment with the current child: */
+		Scalar il=intersectNode(level-1,child0[0]+ci[0],child0[1]+ci[1],gp0,gd,cl0,cl1);
+		if(il<Scalar(1))
+			return il;
+		
+		/* Go to the next child: */
+		if(exit<0)
+			break;
+		ci[exit]=1-ci[exit];
+		cl0=cl1;
+		}
+	
+	return Scalar(1);
+	}
+
 SandboxClient::Scalar SandboxClient::intersectLine(const SandboxClient::Point& p0,const SandboxClient::Point& p1) const
 	{
 	/* Convert the points to grid coordinates: */
@@ -408,96 +640,10 @@ SandboxClient::Scalar SandboxClient::intersectLine(const SandboxClient::Point& p
 	if(l0>=l1)
 		return Scalar(1);
 	
-	/* Find the grid cell containing the first point: */
-	Point gp=Geometry::affineCombination(gp0,gp1,l0);
-	GLsizei cp[2];
-	for(int i=0;i<2;++i)
-		cp[i]=Math::clamp(GLsizei(Math::floor(gp[i])),GLsizei(0),gridSize[i]-3);
-	Scalar cl0=l0;
-	while(cl0<l1)
-		{
-		/* Calculate the line parameter where the line segment leaves the current cell: */
-		Scalar cl1=l1;
-		int exit=-1;
-		for(int i=0;i<2;++i)
-			{
-			Scalar el=cl1;
-			if(gp0[i]<gp1[i])
-				el=(Scalar(cp[i]+1)-gp0[i])/gd[i];
-			else if(gp0[i]>gp1[i])
-				el=(Scalar(cp[i])-gp0[i])/gd[i];
-			if(cl1>el)
-				{
-				cl1=el;
-				exit=i;
-				}
-			}
-		
-		/* Intersect the line segment with the surface inside the current cell: */
-		const GLfloat* cell=grids.getLockedValue().bathymetry+(cp[1]*(gridSize[0]-1)+cp[0]);
-		Scalar c0=cell[0];
-		Scalar c1=cell[1];
-		Scalar c2=cell[gridSize[0]-1];
-		Scalar c3=cell[gridSize[0]];
-		Scalar cx0=Scalar(cp[0]);
-		Scalar cx1=Scalar(cp[0]+1);
-		Scalar cy0=Scalar(cp[1]);
-		Scalar cy1=Scalar(cp[1]+1);
-		Scalar fxy=c0-c1+c3-c2;
-		Scalar fx=(c1-c0)*cy1-(c3-c2)*cy0;
-		Scalar fy=(c2-c0)*cx1-(c3-c1)*cx0;
-		Scalar f=(c0*cx1-c1*cx0)*cy1-(c2*cx1-c3*cx0)*cy0;
-		Scalar a=fxy*gd[0]*gd[1];
-		Scalar bc0=(fxy*gp0[1]+fx);
-		Scalar bc1=(fxy*gp0[0]+fy);
-		Scalar b=bc0*gd[0]+bc1*gd[1]-gd[2];
-		Scalar c=bc0*gp0[0]+bc1*gp0[1]-gp0[2]-fxy*gp0[0]*gp0[1]+f;
-		Scalar il=cl1;
-		if(a!=Scalar(0))
-			{
-			/* Solve the quadratic equation and use the smaller valid solution: */
-			Scalar det=b*b-Scalar(4)*a*c;
-			if(det>=Scalar(0))
-				{
-				det=Math::sqrt(det);
-				if(a>Scalar(0))
-					{
-					/* Test the smaller intersection first: */
-					il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
-					if(il<cl0)
-						il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
-					}
-				else
-					{
-					/* Test the smaller intersection first: */
-					il=b>=Scalar(0)?(Scalar(2)*c)/(-b-det):(-b+det)/(Scalar(2)*a);
-					if(il<cl0)
-						il=b>=Scalar(0)?(-b-det)/(Scalar(2)*a):(Scalar(2)*c)/(-b+det);
-					}
-				}
-			}
-		else
-			{
-			/* Solve the linear equation: */
-			il=-c/b;
-			}
-		
-		/* Check if the intersection is valid: */
-		if(il>=cl0&&il<cl1)
-			return il;
-		
-		/* Go to the next cell: */
-		if(exit>=0)
-			{
-			if(gd[exit]<Scalar(0))
-				--cp[exit];
-			else
-				++cp[exit];
-			}
-		cl0=cl1;
-		}
-	
-	return Scalar(1);
+	/* Traverse the bathymetry's min/max pyramid from its root node: */
+	if(heightPyramid.getNumLevels()==0)
+		return Scalar(1);
+	return intersectNode(heightPyramid.getNumLevels()-1,0,0,gp0,gd,l0,l1);
 	}
 
 bool SandboxClient::serverMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData)
@@ -535,17 +681,17 @@ void SandboxClient::alignSurfaceFrame(Vrui::SurfaceNavigationTool::AlignmentData
 	Point base=alignmentData.surfaceFrame.getOrigin();
 	
 	/* Snap the base point to the terrain: */
-	GLfloat* bathymetry=grids.getLockedValue().bathymetry;
+	const Misc::UInt16* bathymetry=grids.getLockedValue().bathymetry;
 	Scalar dx=base[0]/Scalar(cellSize[0])-Scalar(0.5);
 	GLsizei gx=Math::clamp(GLsizei(Math::floor(dx)),GLsizei(0),gridSize[0]-GLsizei(3));
 	dx-=gx;
 	Scalar dy=base[1]/Scalar(cellSize[1])-Scalar(0.5);
 	GLsizei gy=Math::clamp(GLsizei(Math::floor(dy)),GLsizei(0),gridSize[1]-GLsizei(3));
 	dy-=gy;
-	GLfloat* cell=bathymetry+(gy*(gridSize[0]-1)+gx);
-	Scalar b0=cell[0]*(Scalar(1)-dx)+cell[1]*dx;
+	const Misc::UInt16* cell=bathymetry+(gy*(gridSize[0]-1)+gx);
+	Scalar b0=getElevation(cell[0])*(Scalar(1)-dx)+getElevation(cell[1])*dx;
 	cell+=gridSize[0]-1;
-	Scalar b1=cell[0]*(Scalar(1)-dx)+cell[1]*dx;
+	Scalar b1=getElevation(cell[0])*(Scalar(1)-dx)+getElevation(cell[1])*dx;
 	base[2]=b0*(Scalar(1)-dy)+b1*dy;
 	
 	/* Align the frame with the bathymetry surface's x and y directions: */
@@ -560,7 +706,8 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 	std::string bathymetryVertexShaderFunctions;
 	std::string bathymetryVertexShaderUniforms="\
 	uniform sampler2DRect bathymetrySampler; // Sampler for the bathymetry texture\n\
-	uniform vec2 bathymetryCellSize; // Cell size of the bathymetry grid\n";
+	uniform vec2 bathymetryCellSize; // Cell size of the bathymetry grid\n\
+	uniform vec2 elevationScale; // Scale and offset to convert normalized quantized elevations to elevations\n";
 	std::string bathymetryVertexShaderVaryings="\
 	varying float dist; // Eye-space distance to vertex for fogging\n";
 	std::string bathymetryVertexShaderMain="\
@@ -568,12 +715,12 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 		{\n\
 		/* Get the vertex's grid-space z coordinate from the bathymetry texture: */\n\
 		vec4 vertexGc=gl_Vertex;\n\
-		vertexGc.z=texture2DRect(bathymetrySampler,vertexGc.xy).r;\n\
+		vertexGc.z=texture2DRect(bathymetrySampler,vertexGc.xy).r*elevationScale.x+elevationScale.y;\n\
 		\n\
 		/* Calculate the vertex's grid-space normal vector: */\n\
 		vec3 normalGc;\n\
-		normalGc.x=(texture2DRect(bathymetrySampler,vec2(vertexGc.x-1.0,vertexGc.y)).r-texture2DRect(bathymetrySampler,vec2(vertexGc.x+1.0,vertexGc.y)).r)*bathymetryCellSize.y;\n\
-		normalGc.y=(texture2DRect(bathymetrySampler,vec2(vertexGc.x,vertexGc.y-1.0)).r-texture2DRect(bathymetrySampler,vec2(vertexGc.x,vertexGc.y+1.0)).r)*bathymetryCellSize.x;\n\
+		normalGc.x=(texture2DRect(bathymetrySampler,vec2(vertexGc.x-1.0,vertexGc.y)).r-texture2DRect(bathymetrySampler,vec2(vertexGc.x+1.0,vertexGc.y)).r)*(bathymetryCellSize.y*elevationScale.x);\n\
+		normalGc.y=(texture2DRect(bathymetrySampler,vec2(vertexGc.x,vertexGc.y-1.0)).r-texture2DRect(bathymetrySampler,vec2(vertexGc.x,vertexGc.y+1.0)).r)*(bathymetryCellSize.x*elevationScale.x);\n\
 		normalGc.z=2.0*bathymetryCellSize.x*bathymetryCellSize.y;\n\
 		\n\
 		/* Transform the vertex and its normal vector from grid space to eye space for illumination: */\n\
@@ -636,6 +783,7 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 	dataItem->bathymetryShaderUniforms[1]=glGetUniformLocationARB(dataItem->bathymetryShaderProgram,"bathymetryCellSize");
 	dataItem->bathymetryShaderUniforms[2]=glGetUniformLocationARB(dataItem->bathymetryShaderProgram,"waterColor");
 	dataItem->bathymetryShaderUniforms[3]=glGetUniformLocationARB(dataItem->bathymetryShaderProgram,"waterOpacity");
+	dataItem->bathymetryShaderUniforms[4]=glGetUniformLocationARB(dataItem->bathymetryShaderProgram,"elevationScale");
 	
 	/* Create the water surface vertex shader source code: */
 	std::string waterVertexShaderDefines="\
@@ -644,24 +792,25 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 	std::string waterVertexShaderUniforms="\
 	uniform sampler2DRect bathymetrySampler; // Sampler for the bathymetry texture\n\
 	uniform sampler2DRect waterSampler; // Sampler for the water surface texture\n\
-	uniform vec2 waterCellSize; // Cell size of the water surface grid\n";
+	uniform vec2 waterCellSize; // Cell size of the water surface grid\n\
+	uniform vec2 elevationScale; // Scale and offset to convert normalized quantized elevations to elevations\n";
 	std::string waterVertexShaderMain="\
 	void main()\n\
 		{\n\
 		/* Get the vertex's grid-space z coordinate from the water surface texture: */\n\
 		vec4 vertexGc=gl_Vertex;\n\
-		vertexGc.z=texture2DRect(waterSampler,vertexGc.xy).r;\n\
+		vertexGc.z=texture2DRect(waterSampler,vertexGc.xy).r*elevationScale.x+elevationScale.y;\n\
 		\n\
 		/* Get the bathymetry elevation at the same location: */\n\
 		float bathy=(texture2DRect(bathymetrySampler,vertexGc.xy-vec2(1.0,1.0)).r\n\
 		            +texture2DRect(bathymetrySampler,vertexGc.xy-vec2(1.0,0.0)).r\n\
 		            +texture2DRect(bathymetrySampler,vertexGc.xy-vec2(0.0,1.0)).r\n\
-		            +texture2DRect(bathymetrySampler,vertexGc.xy-vec2(0.0,0.0)).r)*0.25;\n\
+		            +texture2DRect(bathymetrySampler,vertexGc.xy-vec2(0.0,0.0)).r)*(0.25*elevationScale.x)+elevationScale.y;\n\
 		\n\
 		/* Calculate the vertex's grid-space normal vector: */\n\
 		vec3 normalGc;\n\
-		normalGc.x=(texture2DRect(waterSampler,vec2(vertexGc.x-1.0,vertexGc.y)).r-texture2DRect(waterSampler,vec2(vertexGc.x+1.0,vertexGc.y)).r)*waterCellSize.y;\n\
-		normalGc.y=(texture2DRect(waterSampler,vec2(vertexGc.x,vertexGc.y-1.0)).r-texture2DRect(waterSampler,vec2(vertexGc.x,vertexGc.y+1.0)).r)*waterCellSize.x;\n\
+		normalGc.x=(texture2DRect(waterSampler,vec2(vertexGc.x-1.0,vertexGc.y)).r-texture2DRect(waterSampler,vec2(vertexGc.x+1.0,vertexGc.y)).r)*(waterCellSize.y*elevationScale.x);\n\
+		normalGc.y=(texture2DRect(waterSampler,vec2(vertexGc.x,vertexGc.y-1.0)).r-texture2DRect(waterSampler,vec2(vertexGc.x,vertexGc.y+1.0)).r)*(waterCellSize.x*elevationScale.x);\n\
 		normalGc.z=1.0*waterCellSize.x*waterCellSize.y;\n\
 		\n\
 		/* Transform the vertex and its normal vector from grid space to eye space for illumination: */\n\
@@ -720,6 +869,7 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 	dataItem->waterShaderUniforms[0]=glGetUniformLocationARB(dataItem->waterShaderProgram,"bathymetrySampler");
 	dataItem->waterShaderUniforms[1]=glGetUniformLocationARB(dataItem->waterShaderProgram,"waterSampler");
 	dataItem->waterShaderUniforms[2]=glGetUniformLocationARB(dataItem->waterShaderProgram,"waterCellSize");
+	dataItem->waterShaderUniforms[3]=glGetUniformLocationARB(dataItem->waterShaderProgram,"elevationScale");
 	
 	/* Mark the bathymetry shader as up-to-date: */
 	dataItem->lightStateVersion=lightTracker.getVersion();
@@ -728,74 +878,154 @@ void SandboxClient::compileShaders(SandboxClient::DataItem* dataItem,const GLLig
 SandboxClient::SandboxClient(int& argc,char**& argv)
 	:Vrui::Application(argc,argv),
 	 pipe(0),
+	 protocolVersion(0),gridCodec(0),lodCodec(0),
+	 archiveReader(0),replayTime(0.0),replayPlaying(false),
+	 replayDialog(0),replayTimeSlider(0),replayPlayToggle(0),
 	 gridVersion(0),
 	 sun(0),underwater(false)
 	{
 	/* Parse the command line: */
 	const char* serverName=0;
 	int serverPortId=26000;
+	bool legacyProtocol=false;
+	const char* archiveFileName=0;
 	for(int argi=1;argi<argc;++argi)
 		{
 		if(argv[argi][0]=='-')
 			{
-			std::cerr<<"SandboxClient: Ignoring command line option "<<argv[argi]<<std::endl;
+			if(strcasecmp(argv[argi]+1,"legacyProtocol")==0)
+				legacyProtocol=true;
+			else if(strcasecmp(argv[argi]+1,"archive")==0&&argi+1<argc)
+				{
+				++argi;
+				archiveFileName=argv[argi];
+				}
+			else
+				std::cerr<<"SandboxClient: Ignoring command line option "<<argv[argi]<<std::endl;
 			}
 		else if(serverName==0)
 			serverName=argv[argi];
 		else
 			std::cerr<<"SandboxClient: Ignoring command line argument "<<argv[argi]<<std::endl;
 		}
-	if(serverName==0)
-		throw std::runtime_error("SandboxClient: No server name provided");
-	
-	/* Connect to the AR Sandbox server: */
-	pipe=new Comm::TCPPipe(serverName,serverPortId);
-	
-	/* Send an endianness token to the server: */
-	pipe->write<Misc::UInt32>(0x12345678U);
-	pipe->flush();
-	
-	/* Receive an endianness token from the server: */
-	Misc::UInt32 token=pipe->read<Misc::UInt32>();
-	if(token==0x78563412U)
-		pipe->setSwapOnRead(true);
-	else if(token!=0x12345678U)
-		{
-		delete pipe;
-		throw std::runtime_error("SandboxClient: Invalid response from remote AR Sandbox");
-		}
-	
-	try
+	if(archiveFileName!=0)
 		{
-		/* Receive the remote AR Sandbox's water table grid size, cell size, and elevation range: */
+		/* Open the grid archive and retrieve its water table grid size, cell size, and elevation range: */
+		archiveReader=new GridArchiveReader(archiveFileName);
 		for(int i=0;i<2;++i)
 			{
-			gridSize[i]=pipe->read<Misc::UInt32>();
-			cellSize[i]=pipe->read<Misc::Float32>();
+			gridSize[i]=archiveReader->getGridSize()[i];
+			cellSize[i]=archiveReader->getCellSize()[i];
+			elevationRange[i]=archiveReader->getElevationRange()[i];
 			}
-		for(int i=0;i<2;++i)
-			elevationRange[i]=pipe->read<Misc::Float32>();
 		
 		/* Initialize the grid buffers: */
 		for(int i=0;i<3;++i)
 			grids.getBuffer(i).init(gridSize);
 		
-		/* Read the initial set of grids: */
-		readGrids();
+		/* Decode and post the first archived set of grids: */
+		try
+			{
+			replayTime=archiveReader->getStartTime();
+			archiveReader->seek(replayTime);
+			}
+		catch(const std::runtime_error& err)
+			{
+			/* Close the grid archive and re-throw the exception: */
+			delete archiveReader;
+			throw;
+			}
+		storeGrids(archiveReader->getQuantizedGrids(),grids.startNewValue());
+		grids.postNewValue();
 		}
-	catch(const std::runtime_error& err)
+	else
 		{
-		/* Disconnect from the remote AR Sandbox: */
-		delete pipe;
+		if(serverName==0)
+			throw std::runtime_error("SandboxClient: No server name provided");
+		
+		/* Connect to the AR Sandbox server: */
+		pipe=new Comm::TCPPipe(serverName,serverPortId);
+		
+		/* Send an endianness token to the server; the versioned token requests compressed streaming: */
+		if(legacyProtocol)
+			pipe->write<Misc::UInt32>(0x12345678U);
+		else
+			{
+			pipe->write<Misc::UInt32>(0x87654321U);
+			pipe->write<Misc::UInt32>(GridCodec::protocolVersion);
+			}
+		pipe->flush();
+		
+		/* Receive an endianness token from the server: */
+		Misc::UInt32 token=pipe->read<Misc::UInt32>();
+		if(token==0x78563412U)
+			pipe->setSwapOnRead(true);
+		else if(token!=0x12345678U)
+			{
+			delete pipe;
+			throw std::runtime_error("SandboxClient: Invalid response from remote AR Sandbox");
+			}
+		
+		try
+			{
+			/* Receive the remote AR Sandbox's water table grid size, cell size, and elevation range: */
+			for(int i=0;i<2;++i)
+				{
+				gridSize[i]=pipe->read<Misc::UInt32>();
+				cellSize[i]=pipe->read<Misc::Float32>();
+				}
+			for(int i=0;i<2;++i)
+				elevationRange[i]=pipe->read<Misc::Float32>();
+			
+			/* Initialize the grid buffers: */
+			for(int i=0;i<3;++i)
+				grids.getBuffer(i).init(gridSize);
+			
+			if(!legacyProtocol)
+				{
+				/* Receive the agreed-upon streaming protocol version: */
+				protocolVersion=pipe->read<Misc::UInt32>();
+				if(protocolVersion>GridCodec::protocolVersion)
+					throw std::runtime_error("SandboxClient: Unsupported protocol version from remote AR Sandbox");
+				
+				/* Create the grid frame decoder: */
+				unsigned int codecGridSize[2];
+				for(int i=0;i<2;++i)
+					codecGridSize[i]=gridSize[i];
+				if(protocolVersion>=2)
+					{
+					/* Receive the base layer's resolution reduction factor and create the level-of-detail decoder: */
+					unsigned int baseFactor=pipe->read<Misc::UInt32>();
+					lodCodec=new GridLODCodec(codecGridSize,baseFactor);
+					quantizedGrids.resize(lodCodec->getNumValues(),0);
+					baseGrids.resize(lodCodec->getNumBaseValues(),0);
+					}
+				else
+					{
+					gridCodec=new GridCodec(codecGridSize);
+					quantizedGrids.resize(gridCodec->getNumValues(),0);
+					}
+				}
+			
+			/* Read the initial set of grids: */
+			readGrids();
+			}
+		catch(const std::runtime_error& err)
+			{
+			/* Disconnect from the remote AR Sandbox: */
+			delete gridCodec;
+			delete lodCodec;
+			delete pipe;
+			
+			/* Re-throw the exception: */
+			throw;
+			}
 		
-		/* Re-throw the exception: */
-		throw;
+		/* Start listening on the TCP pipe: */
+		dispatcher.addIOEventListener(pipe->getFd(),Threads::EventDispatcher::Read,serverMessageCallback,this);
+		communicationThread.start(this,&SandboxClient::communicationThreadMethod);
 		}
 	
-	/* Start listening on the TCP pipe: */
-	dispatcher.addIOEventListener(pipe->getFd(),Threads::EventDispatcher::Read,serverMessageCallback,this);
-	communicationThread.start(this,&SandboxClient::communicationThreadMethod);
-	
 	/* Set the linear unit to scale the AR Sandbox 1:100: */
 	Vrui::getCoordinateManager()->setUnit(Geometry::LinearUnit(Geometry::LinearUnit::METER,0.01));
 	
@@ -808,14 +1038,30 @@ SandboxClient::SandboxClient(int& argc,char**& argv)
 	
 	/* Create tool classes: */
 	TeleportTool::initClass();
+	
+	if(archiveReader!=0)
+		{
+		/* Create and show the replay dialog: */
+		replayDialog=createReplayDialog();
+		Vrui::popupPrimaryWidget(replayDialog);
+		}
 	}
 
 SandboxClient::~SandboxClient(void)
 	{
-	/* Disconnect from the remote AR Sandbox: */
-	dispatcher.stop();
-	communicationThread.join();
+	if(pipe!=0)
+		{
+		/* Disconnect from the remote AR Sandbox: */
+		dispatcher.stop();
+		communicationThread.join();
+		}
+	delete gridCodec;
+	delete lodCodec;
 	delete pipe;
+	
+	/* Close the grid archive: */
+	delete replayDialog;
+	delete archiveReader;
 	}
 
 void SandboxClient::toolCreationCallback(Vrui::ToolManager::ToolCreationCallbackData* cbData)
@@ -834,13 +1080,33 @@ void SandboxClient::toolCreationCallback(Vrui::ToolManager::ToolCreationCallback
 
 void SandboxClient::frame(void)
 	{
-	/* Lock the most recent grid buffers: */
+	if(archiveReader!=0&&replayPlaying)
+		{
+		/* Advance the replay time in real time and stop at the end of the archive: */
+		replayArchive(replayTime+Vrui::getFrameTime());
+		replayTimeSlider->setValue(replayTime-archiveReader->getStartTime());
+		if(replayTime>=archiveReader->getEndTime())
+			{
+			replayPlaying=false;
+			replayPlayToggle->setToggle(false);
+			}
+		else
+			Vrui::scheduleUpdate(Vrui::getNextAnimationTime());
+		}
+	
+	/* Lock the most recent grid buffers and rebuild the bathymetry's min/max pyramid: */
 	if(grids.lockNewValue())
+		{
 		++gridVersion;
+		unsigned int bathymetrySize[2];
+		for(int i=0;i<2;++i)
+			bathymetrySize[i]=gridSize[i]-1;
+		heightPyramid.build(grids.getLockedValue().bathymetry,bathymetrySize,(elevationRange[1]-elevationRange[0])/65535.0f,elevationRange[0]);
+		}
 	
 	/* Calculate the position of the main viewer's head in grid space: */
 	Point head=Vrui::getHeadPosition();
-	GLfloat* waterLevel=grids.getLockedValue().waterLevel;
+	const Misc::UInt16* waterLevel=grids.getLockedValue().waterLevel;
 	Scalar dx=head[0]/Scalar(cellSize[0]);
 	GLsizei gx=GLsizei(Math::floor(dx));
 	dx-=gx;
@@ -849,23 +1115,58 @@ void SandboxClient::frame(void)
 	dy-=gy;
 	if(gx>=0&&gx<gridSize[0]-1&&gy>=0&&gy<gridSize[1]-1)
 		{
-		GLfloat* cell=waterLevel+(gy*gridSize[0]+gx);
-		Scalar b0=cell[0]*(Scalar(1)-dx)+cell[1]*dx;
+		const Misc::UInt16* cell=waterLevel+(gy*gridSize[0]+gx);
+		Scalar b0=getElevation(cell[0])*(Scalar(1)-dx)+getElevation(cell[1])*dx;
 		cell+=gridSize[0];
-		Scalar b1=cell[0]*(Scalar(1)-dx)+cell[1]*dx;
+		Scalar b1=getElevation(cell[0])*(Scalar(1)-dx)+getElevation(cell[1])*dx;
 		Scalar water=b0*(Scalar(1)-dy)+b1*dy;
 		underwater=head[2]<=water;
 		}
 	else
 		underwater=false;
 	
-	/* Send the current head position to the remote AR Sandbox: */
-	Geometry::Point<Misc::Float32,3> fhead(head);
-	pipe->write<Misc::UInt16>(0);
-	pipe->write(fhead.getComponents(),3);
-	Geometry::Vector<Misc::Float32,3> fview(Vrui::getViewDirection());
-	pipe->write(fview.getComponents(),3);
-	pipe->flush();
+	if(pipe!=0)
+		{
+		/* Send the current head position to the remote AR Sandbox: */
+		Geometry::Point<Misc::Float32,3> fhead(head);
+		pipe->write<Misc::UInt16>(0);
+		pipe->write(fhead.getComponents(),3);
+		Geometry::Vector<Misc::Float32,3> fview(Vrui::getViewDirection());
+		pipe->write(fview.getComponents(),3);
+		pipe->flush();
+		}
+	}
+
+void SandboxClient::uploadGrid(SandboxClient::DataItem* dataItem,GLsizei width,GLsizei height,const Misc::UInt16* grid)
+	{
+	/* Allow rows of quantized values that are not padded to four bytes: */
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,2);
+	
+	/* Copy the grid into the next pixel buffer in the ring, orphaning its previous contents so the copy does not wait for an upload still in flight: */
+	size_t gridDataSize=size_t(height)*size_t(width)*sizeof(Misc::UInt16);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,dataItem->uploadBuffers[dataItem->nextUploadBuffer]);
+	glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB,gridDataSize,0,GL_STREAM_DRAW_ARB);
+	void* bufferPtr=glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,GL_WRITE_ONLY_ARB);
+	if(bufferPtr!=0)
+		{
+		memcpy(bufferPtr,grid,gridDataSize);
+		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		
+		/* Upload the grid from the pixel buffer; the transfer runs asynchronously on the GPU: */
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,width,height,GL_RED,GL_UNSIGNED_SHORT,0);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+		}
+	else
+		{
+		/* Fall back to uploading the grid directly: */
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB,0);
+		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,width,height,GL_RED,GL_UNSIGNED_SHORT,grid);
+		}
+	if(++dataItem->nextUploadBuffer==DataItem::numUploadBuffers)
+		dataItem->nextUploadBuffer=0;
+	
+	glPopClientAttrib();
 	}
 
 void SandboxClient::display(GLContextData& contextData) const
@@ -893,7 +1194,7 @@ void SandboxClient::display(GLContextData& contextData) const
 	if(dataItem->textureVersion!=gridVersion)
 		{
 		/* Upload the new bathymetry grid: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,gridSize[0]-1,gridSize[1]-1,GL_RED,GL_FLOAT,grids.getLockedValue().bathymetry);
+		uploadGrid(dataItem,gridSize[0]-1,gridSize[1]-1,grids.getLockedValue().bathymetry);
 		}
 	glUniform1iARB(dataItem->bathymetryShaderUniforms[0],0);
 	
@@ -904,6 +1205,7 @@ void SandboxClient::display(GLContextData& contextData) const
 	glUniform2fARB(dataItem->bathymetryShaderUniforms[1],cellSize[0],cellSize[1]);
 	glUniform4fARB(dataItem->bathymetryShaderUniforms[2],0.2f,0.5f,0.8f,1.0f);
 	glUniform1fARB(dataItem->bathymetryShaderUniforms[3],underwater?0.1f:0.0f);
+	glUniform2fARB(dataItem->bathymetryShaderUniforms[4],elevationRange[1]-elevationRange[0],elevationRange[0]);
 	
 	/* Draw the bathymetry: */
 	{
@@ -927,7 +1229,7 @@ void SandboxClient::display(GLContextData& contextData) const
 	if(dataItem->textureVersion!=gridVersion)
 		{
 		/* Upload the new water surface grid: */
-		glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,gridSize[0],gridSize[1],GL_RED,GL_FLOAT,grids.getLockedValue().waterLevel);
+		uploadGrid(dataItem,gridSize[0],gridSize[1],grids.getLockedValue().waterLevel);
 		}
 	glUniform1iARB(dataItem->waterShaderUniforms[1],1);
 	
@@ -936,6 +1238,7 @@ void SandboxClient::display(GLContextData& contextData) const
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,dataItem->waterIndexBuffer);
 	
 	glUniform2fARB(dataItem->waterShaderUniforms[2],cellSize[0],cellSize[1]);
+	glUniform2fARB(dataItem->waterShaderUniforms[3],elevationRange[1]-elevationRange[0],elevationRange[0]);
 	
 	if(underwater)
 		glCullFace(GL_FRONT);
@@ -991,7 +1294,7 @@ void SandboxClient::initContext(GLContextData& contextData) const
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,gridSize[0]-1,gridSize[1]-1,0,GL_RED,GL_FLOAT,0);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R16,gridSize[0]-1,gridSize[1]-1,0,GL_RED,GL_UNSIGNED_SHORT,0);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
 	/* Create the water surface elevation texture: */
@@ -1000,7 +1303,7 @@ void SandboxClient::initContext(GLContextData& contextData) const
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,gridSize[0],gridSize[1],0,GL_RED,GL_FLOAT,0);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R16,gridSize[0],gridSize[1],0,GL_RED,GL_UNSIGNED_SHORT,0);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
 	/* Upload the grid of bathymetry template vertices into the vertex buffer: */
@@ -23,6 +23,8 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SANDBOXCLIENT_INCLUDED
 #define SANDBOXCLIENT_INCLUDED
 
+#include <vector>
+#include <Misc/SizedTypes.h>
 #include <Threads/Thread.h>
 #include <Threads/TripleBuffer.h>
 #include <Threads/EventDispatcher.h>
@@ -35,15 +37,25 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/GLSphereRenderer.h>
 #include <GL/GLCylinderRenderer.h>
 #include <GL/GLGeometryVertex.h>
+#include <GLMotif/ToggleButton.h>
+#include <GLMotif/TextFieldSlider.h>
 #include <Vrui/Application.h>
 #include <Vrui/GenericToolFactory.h>
 #include <Vrui/SurfaceNavigationTool.h>
 
+#include "HeightPyramid.h"
+
 /* Forward declarations: */
 namespace Comm {
 class TCPPipe;
 }
 class GLLightTracker;
+class GridCodec;
+class GridLODCodec;
+class GridArchiveReader;
+namespace GLMotif {
+class PopupWindow;
+}
 namespace Vrui {
 class Lightsource;
 }
@@ -56,12 +68,12 @@ class SandboxClient:public Vrui::Application,public GLObject
 	typedef Vrui::Point Point;
 	typedef Vrui::Vector Vector;
 	
-	struct GridBuffers // Structure representing a pair of grids
+	struct GridBuffers // Structure representing a pair of quantized grids
 		{
 		/* Elements: */
 		public:
-		GLfloat* bathymetry;
-		GLfloat* waterLevel;
+		Misc::UInt16* bathymetry;
+		Misc::UInt16* waterLevel;
 		
 		/* Constructors and destructors: */
 		GridBuffers(void)
@@ -77,8 +89,8 @@ class SandboxClient:public Vrui::Application,public GLObject
 		/* Methods: */
 		void init(const GLsizei gridSize[2]) // Initializes the grids
 			{
-			bathymetry=new GLfloat[(gridSize[1]-1)*(gridSize[0]-1)];
-			waterLevel=new GLfloat[gridSize[1]*gridSize[0]];
+			bathymetry=new Misc::UInt16[(gridSize[1]-1)*(gridSize[0]-1)];
+			waterLevel=new Misc::UInt16[gridSize[1]*gridSize[0]];
 			}
 		};
 	
@@ -107,7 +119,7 @@ class SandboxClient:public Vrui::Application,public GLObject
 		/* Private methods: */
 		void applyNavState(void) const; // Sets the navigation transformation based on the tool's current navigation state
 		void initNavState(void); // Initializes the tool's navigation state when it is activated
-		
+			
 			/* Constructors and destructors: */
 		public:
 		static void initClass(void); // Initializes the teleport tool class's factory class
@@ -127,9 +139,12 @@ class SandboxClient:public Vrui::Application,public GLObject
 		{
 		/* Elements: */
 		public:
-		GLuint bathymetryTexture; // ID of texture object holding bathymetry vertex elevations
-		GLuint waterTexture; // ID of texture object holding water surface vertex elevations
+		GLuint bathymetryTexture; // ID of texture object holding quantized bathymetry vertex elevations
+		GLuint waterTexture; // ID of texture object holding quantized water surface vertex elevations
 		unsigned int textureVersion; // Version number of bathymetry and water grids stored in textures
+		static const unsigned int numUploadBuffers=3; // Number of pixel buffers used to stream grids into the textures
+		GLuint uploadBuffers[numUploadBuffers]; // IDs of pixel buffer objects used to stream grids into the textures
+		unsigned int nextUploadBuffer; // Index of the pixel buffer to use for the next grid upload
 		GLuint bathymetryVertexBuffer; // ID of vertex buffer object holding bathymetry's template vertices
 		GLuint bathymetryIndexBuffer; // ID of index buffer object holding bathymetry's triangles
 		GLuint waterVertexBuffer; // ID of vertex buffer object holding water surface's template vertices
@@ -137,11 +152,11 @@ class SandboxClient:public Vrui::Application,public GLObject
 		GLhandleARB bathymetryVertexShader; // Vertex shader to render the bathymetry
 		GLhandleARB bathymetryFragmentShader; // Fragment shader to render the bathymetry
 		GLhandleARB bathymetryShaderProgram; // Shader program to render the bathymetry
-		GLint bathymetryShaderUniforms[4]; // Locations of the bathymetry shader's uniform variables
+		GLint bathymetryShaderUniforms[5]; // Locations of the bathymetry shader's uniform variables
 		GLhandleARB waterVertexShader; // Vertex shader to render the water surface
 		GLhandleARB waterFragmentShader; // Fragment shader to render the water surface
 		GLhandleARB waterShaderProgram; // Shader program to render the water surface
-		GLint waterShaderUniforms[3]; // Locations of the water surface shader's uniform variables
+		GLint waterShaderUniforms[4]; // Locations of the water surface shader's uniform variables
 		unsigned int lightStateVersion; // Version number for current lighting state reflected in the bathymetry and water surface shader programs
 		
 		/* Constructors and destructors: */
@@ -154,20 +169,45 @@ class SandboxClient:public Vrui::Application,public GLObject
 	GLsizei gridSize[2]; // Width and height of the water table's cell-centered quantity grid
 	GLfloat cellSize[2]; // Width and height of each water table cell
 	GLfloat elevationRange[2]; // Minimum and maximum valid elevations
+	unsigned int protocolVersion; // Streaming protocol version agreed upon with the remote AR Sandbox; 0 for raw grids
+	GridCodec* gridCodec; // Codec to decode compressed grid frames
+	GridLODCodec* lodCodec; // Codec to decode level-of-detail grid messages
+	std::vector<Misc::UInt8> frameBuffer; // Buffer to receive compressed grid frames
+	std::vector<Misc::UInt16> quantizedGrids; // Most recently decoded quantized bathymetry and water level grids, reference for the next delta frame
+	std::vector<Misc::UInt16> baseGrids; // Most recently decoded base layer of level-of-detail grid messages, reference for the next delta frame
+	GridArchiveReader* archiveReader; // Grid archive replayed instead of connecting to a remote AR Sandbox, or null
+	double replayTime; // Current time stamp in the replayed grid archive
+	bool replayPlaying; // Flag whether the grid archive is currently being played back in real time
+	GLMotif::PopupWindow* replayDialog; // Dialog to scrub through the replayed grid archive
+	GLMotif::TextFieldSlider* replayTimeSlider; // Slider selecting the current replay time
+	GLMotif::ToggleButton* replayPlayToggle; // Toggle to start and stop playback
 	Threads::EventDispatcher dispatcher; // Dispatcher for events on the TCP pipe
 	Threads::Thread communicationThread; // Thread to handle communication with the remote AR Sandbox in the background
 	Threads::TripleBuffer<GridBuffers> grids; // Triple buffer of bathymetry and water level grids
 	unsigned int gridVersion; // Version number of currently locked grids
+	HeightPyramid heightPyramid; // Min/max pyramid over the currently locked bathymetry grid to accelerate line segment intersections
 	Vrui::Lightsource* sun; // Light source representing the sun
 	bool underwater; // Flag if the main viewer's head is currently under water
 	
 	/* Private methods: */
+	Scalar getElevation(Misc::UInt16 value) const // Returns the elevation represented by the given quantized grid value
+		{
+		return Scalar(elevationRange[0])+Scalar(value)*(Scalar(elevationRange[1])-Scalar(elevationRange[0]))/Scalar(65535);
+		}
+	void storeGrids(const Misc::UInt16* quantized,GridBuffers& gridBuffers) const; // Copies a quantized bathymetry and water level grid pair into the given grid buffers
 	void readGrids(void); // Reads a new set of bathymetry and water level grids from the remote AR Sandbox
+	void replayArchive(double newReplayTime); // Posts the archived set of grids at the given replay time
+	void replayTimeSliderCallback(GLMotif::TextFieldSlider::ValueChangedCallbackData* cbData);
+	void replayPlayToggleCallback(GLMotif::ToggleButton::ValueChangedCallbackData* cbData);
+	GLMotif::PopupWindow* createReplayDialog(void);
+	Scalar intersectCell(const Point& gp0,const Vector& gd,const GLsizei cp[2],Scalar cl0,Scalar cl1) const; // Intersects a line segment in grid coordinates with the given bathymetry cell inside the given parameter interval; returns 1.0 if there is no intersection
+	Scalar intersectNode(unsigned int level,GLsizei nx,GLsizei ny,const Point& gp0,const Vector& gd,Scalar l0,Scalar l1) const; // Intersects a line segment in grid coordinates with the given node of the bathymetry's min/max pyramid inside the given parameter interval; returns 1.0 if there is no intersection
 	Scalar intersectLine(const Point& p0,const Point& p1) const; // Returns the intersection parameter of a line segment with the bathymetry; returns 1.0 if there is no intersection
 	static bool serverMessageCallback(Threads::EventDispatcher::ListenerKey eventKey,int eventType,void* userData); // Callback called when a message arrives from the remote AR Sandbox
 	void* communicationThreadMethod(void); // Method handling communication with the remote AR Sandbox in the background
 	void alignSurfaceFrame(Vrui::SurfaceNavigationTool::AlignmentData& alignmentData); // Aligns the surface frame of a surface navigation tool with the bathymetry surface
 	void compileShaders(DataItem* dataItem,const GLLightTracker& lightTracker) const; // Compiles the bathymetry and water surface shader programs based on current lighting state
+	static void uploadGrid(DataItem* dataItem,GLsizei width,GLsizei height,const Misc::UInt16* grid); // Uploads the given quantized grid into the currently bound texture through the next pixel buffer in the data item's ring
 	
 	/* Constructors and destructors: */
 	public:
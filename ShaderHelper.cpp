@@ -21,14 +21,122 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "ShaderHelper.h"
 
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string>
+#include <vector>
+#include <stdexcept>
+#include <Misc/SizedTypes.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
 #include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/GLExtensionManager.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 #include <GL/Extensions/GLARBVertexShader.h>
 
 #include "Config.h"
 
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+const char programBinaryMagic[16]="SARndboxProgram"; // Identifier at the beginning of program binary cache files
+
+struct ProgramBinaryFunctions // Structure holding the entry points of GL_ARB_get_program_binary in the current OpenGL context
+	{
+	/* Elements: */
+	public:
+	PFNGLGETPROGRAMIVPROC glGetProgramivProc;
+	PFNGLGETPROGRAMBINARYPROC glGetProgramBinaryProc;
+	PFNGLPROGRAMBINARYPROC glProgramBinaryProc;
+	
+	/* Methods: */
+	bool init(void) // Retrieves the entry points; returns false if the current context does not support program binaries in any format
+		{
+		if(!GLExtensionManager::isExtensionSupported("GL_ARB_get_program_binary"))
+			return false;
+		GLint numFormats=0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&numFormats);
+		if(numFormats<=0)
+			return false;
+		glGetProgramivProc=GLExtensionManager::getFunction<PFNGLGETPROGRAMIVPROC>("glGetProgramiv");
+		glGetProgramBinaryProc=GLExtensionManager::getFunction<PFNGLGETPROGRAMBINARYPROC>("glGetProgramBinary");
+		glProgramBinaryProc=GLExtensionManager::getFunction<PFNGLPROGRAMBINARYPROC>("glProgramBinary");
+		return glGetProgramivProc!=0&&glGetProgramBinaryProc!=0&&glProgramBinaryProc!=0;
+		}
+	};
+
+std::string getProgramBinaryCacheDirectory(bool create)
+	{
+	/* Follow the XDG base directory specification: */
+	std::string result;
+	const char* cacheHome=getenv("XDG_CACHE_HOME");
+	if(cacheHome!=0&&cacheHome[0]!='\0')
+		result=cacheHome;
+	else
+		{
+		const char* home=getenv("HOME");
+		if(home==0||home[0]=='\0')
+			return std::string();
+		result=home;
+		result.append("/.cache");
+		}
+	if(create)
+		mkdir(result.c_str(),0755);
+	result.append("/SARndbox");
+	if(create)
+		mkdir(result.c_str(),0755);
+	
+	return result;
+	}
+
+std::string getProgramBinaryFileName(const std::string& fullKey,bool createDirectory)
+	{
+	/* Get the cache directory: */
+	std::string result=getProgramBinaryCacheDirectory(createDirectory);
+	if(result.empty())
+		return result;
+	
+	/* Hash the key using 64-bit FNV-1a: */
+	Misc::UInt64 hash=0xcbf29ce484222325ULL;
+	for(std::string::const_iterator kIt=fullKey.begin();kIt!=fullKey.end();++kIt)
+		{
+		hash^=Misc::UInt64((unsigned char)(*kIt));
+		hash*=0x100000001b3ULL;
+		}
+	char hashName[32];
+	snprintf(hashName,sizeof(hashName),"/%016llx.bin",(unsigned long long)hash);
+	result.append(hashName);
+	
+	return result;
+	}
+
+std::string getFullProgramKey(const std::string& programKey)
+	{
+	/* Prefix the key with the OpenGL driver's identification, as program binaries are only valid for the driver that created them: */
+	std::string result;
+	const GLenum names[3]={GL_VENDOR,GL_RENDERER,GL_VERSION};
+	for(int i=0;i<3;++i)
+		{
+		const GLubyte* name=glGetString(names[i]);
+		if(name!=0)
+			result.append(reinterpret_cast<const char*>(name));
+		result.push_back('\n');
+		}
+	result.append(programKey);
+	
+	return result;
+	}
+
+}
+
 GLhandleARB compileVertexShader(const char* vertexShaderFileName)
 	{
 	/* Construct the full shader source file name: */
@@ -68,3 +176,127 @@ GLhandleARB linkVertexAndFragmentShader(const char* shaderFileName)
 	
 	return shaderProgram;
 	}
+
+std::string readShaderSource(const char* shaderFileName)
+	{
+	/* Construct the full shader source file name: */
+	std::string fullShaderFileName=CONFIG_SHADERDIR;
+	fullShaderFileName.push_back('/');
+	fullShaderFileName.append(shaderFileName);
+	
+	/* Read the entire file: */
+	IO::FilePtr file=IO::openFile(fullShaderFileName.c_str());
+	std::string result;
+	char buffer[4096];
+	size_t readSize;
+	while((readSize=file->readUpTo(buffer,sizeof(buffer)))>0)
+		result.append(buffer,readSize);
+	
+	return result;
+	}
+
+GLhandleARB loadProgramBinary(const std::string& programKey)
+	{
+	/* Bail out if the current context does not support program binaries: */
+	ProgramBinaryFunctions pbf;
+	if(!pbf.init())
+		return 0;
+	
+	/* Find the cache file for the given key: */
+	std::string fullKey=getFullProgramKey(programKey);
+	std::string fileName=getProgramBinaryFileName(fullKey,false);
+	if(fileName.empty())
+		return 0;
+	
+	try
+		{
+		/* Open the cache file and check its header and full key to guard against hash collisions: */
+		IO::FilePtr file=IO::openFile(fileName.c_str());
+		file->setEndianness(Misc::LittleEndian);
+		char magic[16];
+		file->read(magic,sizeof(magic));
+		if(memcmp(magic,programBinaryMagic,sizeof(magic))!=0)
+			return 0;
+		Misc::UInt32 keySize=file->read<Misc::UInt32>();
+		if(keySize!=fullKey.size())
+			return 0;
+		std::vector<char> key(keySize);
+		file->read(&key[0],keySize);
+		if(memcmp(&key[0],fullKey.data(),keySize)!=0)
+			return 0;
+		
+		/* Read the program binary: */
+		GLenum binaryFormat=GLenum(file->read<Misc::UInt32>());
+		Misc::UInt32 binarySize=file->read<Misc::UInt32>();
+		if(binarySize==0)
+			return 0;
+		std::vector<char> binary(binarySize);
+		file->read(&binary[0],binarySize);
+		
+		/* Create a shader program from the binary; the driver rejects binaries it can no longer use: */
+		GLhandleARB result=glCreateProgramObjectARB();
+		pbf.glProgramBinaryProc(result,binaryFormat,&binary[0],GLsizei(binarySize));
+		GLint linkStatus=GL_FALSE;
+		pbf.glGetProgramivProc(result,GL_LINK_STATUS,&linkStatus);
+		if(!linkStatus)
+			{
+			glDeleteObjectARB(result);
+			result=0;
+			}
+		
+		return result;
+		}
+	catch(const std::runtime_error&)
+		{
+		/* Treat missing or truncated cache files as cache misses: */
+		return 0;
+		}
+	}
+
+void saveProgramBinary(const std::string& programKey,GLhandleARB program)
+	{
+	/* Bail out if the current context does not support program binaries: */
+	ProgramBinaryFunctions pbf;
+	if(!pbf.init())
+		return;
+	
+	/* Retrieve the program binary: */
+	GLint binarySize=0;
+	pbf.glGetProgramivProc(program,GL_PROGRAM_BINARY_LENGTH,&binarySize);
+	if(binarySize<=0)
+		return;
+	std::vector<char> binary(binarySize);
+	GLsizei binaryLength=0;
+	GLenum binaryFormat=0;
+	pbf.glGetProgramBinaryProc(program,binarySize,&binaryLength,&binaryFormat,&binary[0]);
+	if(binaryLength<=0)
+		return;
+	
+	/* Find the cache file for the given key: */
+	std::string fullKey=getFullProgramKey(programKey);
+	std::string fileName=getProgramBinaryFileName(fullKey,true);
+	if(fileName.empty())
+		return;
+	
+	try
+		{
+		/* Write the cache entry to a temporary file first, so concurrent readers never see partial entries: */
+		std::string tempFileName=fileName;
+		tempFileName.append(".tmp");
+		{
+		IO::FilePtr file=IO::openFile(tempFileName.c_str(),IO::File::WriteOnly);
+		file->setEndianness(Misc::LittleEndian);
+		file->write(programBinaryMagic,sizeof(programBinaryMagic));
+		file->write<Misc::UInt32>(Misc::UInt32(fullKey.size()));
+		file->write(fullKey.data(),fullKey.size());
+		file->write<Misc::UInt32>(Misc::UInt32(binaryFormat));
+		file->write<Misc::UInt32>(Misc::UInt32(binaryLength));
+		file->write(&binary[0],size_t(binaryLength));
+		}
+		rename(tempFileName.c_str(),fileName.c_str());
+		}
+	catch(const std::runtime_error&)
+		{
+		/* Caching is optional; ignore the error */
+		}
+	}
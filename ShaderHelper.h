@@ -22,11 +22,15 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SHADERHELPER_INCLUDED
 #define SHADERHELPER_INCLUDED
 
+#include <string>
 #include <GL/gl.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
 
 GLhandleARB compileVertexShader(const char* vertexShaderFileName); // Returns a handle to a vertex shader compiled from the given source file in the SARndbox's shader directory
 GLhandleARB compileFragmentShader(const char* fragmentShaderFileName); // Returns a handle to a fragment shader compiled from the given source file in the SARndbox's shader directory
 GLhandleARB linkVertexAndFragmentShader(const char* shaderFileName); // Returns a handle to a shader program linked from a vertex shader and a fragment shader compiled from the given source files in the SARndbox's shader directory
+std::string readShaderSource(const char* shaderFileName); // Returns the contents of the given source file, including extension, in the SARndbox's shader directory
+GLhandleARB loadProgramBinary(const std::string& programKey); // Returns a shader program restored from the on-disk program binary cache entry for the given key, typically the program's complete source code, or 0 if there is no valid entry for the current OpenGL driver
+void saveProgramBinary(const std::string& programKey,GLhandleARB program); // Stores the given linked shader program in the on-disk program binary cache under the given key; does nothing if the current OpenGL driver does not support program binaries
 
 #endif
@@ -0,0 +1,335 @@
+/***********************************************************************
+SpriteAtlas - Class to write and memory-map baked sprite atlas files
+holding all dinosaur spritesheets as layers of pre-compressed texture
+data, with a metadata table describing each spritesheet.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "SpriteAtlas.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <Misc/Endianness.h>
+#include <IO/File.h>
+#include <IO/OpenFile.h>
+#include <Images/RGBAImage.h>
+#include <Images/ReadImageFile.h>
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+inline unsigned int packRGB565(const int rgb[3])
+	{
+	return ((rgb[0]>>3)<<11)|((rgb[1]>>2)<<5)|(rgb[2]>>3);
+	}
+
+inline void unpackRGB565(unsigned int packed,int rgb[3])
+	{
+	rgb[0]=((packed>>11)&0x1f)<<3;
+	rgb[0]|=rgb[0]>>5;
+	rgb[1]=((packed>>5)&0x3f)<<2;
+	rgb[1]|=rgb[1]>>6;
+	rgb[2]=(packed&0x1f)<<3;
+	rgb[2]|=rgb[2]>>5;
+	}
+
+void compressDXT5Block(const unsigned char* pixels[16],unsigned char block[16])
+	{
+	/* Find the alpha range and the color bounding box of all non-transparent pixels: */
+	int alphaMin=255,alphaMax=0;
+	int colorMin[3]={255,255,255},colorMax[3]={0,0,0};
+	bool haveColor=false;
+	for(int i=0;i<16;++i)
+		{
+		int alpha=pixels[i][3];
+		if(alphaMin>alpha)
+			alphaMin=alpha;
+		if(alphaMax<alpha)
+			alphaMax=alpha;
+		if(alpha>0)
+			{
+			for(int j=0;j<3;++j)
+				{
+				if(colorMin[j]>pixels[i][j])
+					colorMin[j]=pixels[i][j];
+				if(colorMax[j]<pixels[i][j])
+					colorMax[j]=pixels[i][j];
+				}
+			haveColor=true;
+			}
+		}
+	if(!haveColor)
+		{
+		for(int j=0;j<3;++j)
+			colorMin[j]=colorMax[j]=0;
+		}
+	
+	/* Write the alpha endpoints and build the eight-entry alpha palette: */
+	block[0]=(unsigned char)alphaMax;
+	block[1]=(unsigned char)alphaMin;
+	int alphaPalette[8];
+	alphaPalette[0]=alphaMax;
+	alphaPalette[1]=alphaMin;
+	for(int i=1;i<7;++i)
+		alphaPalette[i+1]=((7-i)*alphaMax+i*alphaMin)/7;
+	
+	/* Write the 3-bit alpha indices: */
+	unsigned long long alphaBits=0;
+	for(int i=0;i<16;++i)
+		{
+		int bestIndex=0;
+		int bestDist=256;
+		if(alphaMax>alphaMin)
+			{
+			for(int j=0;j<8;++j)
+				{
+				int dist=abs(int(pixels[i][3])-alphaPalette[j]);
+				if(bestDist>dist)
+					{
+					bestIndex=j;
+					bestDist=dist;
+					}
+				}
+			}
+		alphaBits|=(unsigned long long)(bestIndex)<<(3*i);
+		}
+	for(int i=0;i<6;++i)
+		block[2+i]=(unsigned char)((alphaBits>>(8*i))&0xffU);
+	
+	/* Write the color endpoints and build the four-entry color palette: */
+	unsigned int color0=packRGB565(colorMax);
+	unsigned int color1=packRGB565(colorMin);
+	block[8]=(unsigned char)(color0&0xffU);
+	block[9]=(unsigned char)(color0>>8);
+	block[10]=(unsigned char)(color1&0xffU);
+	block[11]=(unsigned char)(color1>>8);
+	int colorPalette[4][3];
+	unpackRGB565(color0,colorPalette[0]);
+	unpackRGB565(color1,colorPalette[1]);
+	for(int j=0;j<3;++j)
+		{
+		colorPalette[2][j]=(2*colorPalette[0][j]+colorPalette[1][j])/3;
+		colorPalette[3][j]=(colorPalette[0][j]+2*colorPalette[1][j])/3;
+		}
+	
+	/* Write the 2-bit color indices: */
+	unsigned int colorBits=0;
+	for(int i=0;i<16;++i)
+		{
+		int bestIndex=0;
+		int bestDist=3*256*256;
+		for(int k=0;k<4;++k)
+			{
+			int dist=0;
+			for(int j=0;j<3;++j)
+				{
+				int d=int(pixels[i][j])-colorPalette[k][j];
+				dist+=d*d;
+				}
+			if(bestDist>dist)
+				{
+				bestIndex=k;
+				bestDist=dist;
+				}
+			}
+		colorBits|=(unsigned int)(bestIndex)<<(2*i);
+		}
+	for(int i=0;i<4;++i)
+		block[12+i]=(unsigned char)((colorBits>>(8*i))&0xffU);
+	}
+
+}
+
+/****************************
+Methods of class SpriteAtlas:
+****************************/
+
+SpriteAtlas::SpriteAtlas(const char* atlasFileName)
+	:fd(-1),mapping(MAP_FAILED),mappingSize(0),
+	 header(0),layers(0)
+	{
+	/* Open and map the atlas file: */
+	fd=open(atlasFileName,O_RDONLY);
+	if(fd<0)
+		throw std::runtime_error(std::string("SpriteAtlas: Unable to open atlas file ")+atlasFileName);
+	struct stat fileStats;
+	if(fstat(fd,&fileStats)==0)
+		{
+		mappingSize=size_t(fileStats.st_size);
+		if(mappingSize>=sizeof(Header))
+			mapping=mmap(0,mappingSize,PROT_READ,MAP_SHARED,fd,0);
+		}
+	if(mapping==MAP_FAILED)
+		{
+		close(fd);
+		throw std::runtime_error(std::string("SpriteAtlas: Unable to map atlas file ")+atlasFileName);
+		}
+	
+	/* Validate the header and metadata table; the mapping is used in place, so a big-endian host will read a mismatching version number: */
+	header=static_cast<const Header*>(mapping);
+	layers=reinterpret_cast<const Layer*>(header+1);
+	bool valid=memcmp(header->magic,"SARndboxSprites",16)==0&&header->version==fileVersion;
+	valid=valid&&(header->format==RGBA8||header->format==DXT5)&&header->numLayers==DINO_NUM_SPECIES*ACTION_NUM_ACTIONS;
+	valid=valid&&sizeof(Header)+header->numLayers*sizeof(Layer)<=mappingSize;
+	for(unsigned int i=0;valid&&i<header->numLayers;++i)
+		valid=layers[i].dataOffset+header->layerDataSize<=mappingSize;
+	if(!valid)
+		{
+		munmap(mapping,mappingSize);
+		close(fd);
+		throw std::runtime_error(std::string("SpriteAtlas: Invalid atlas file ")+atlasFileName);
+		}
+	}
+
+SpriteAtlas::~SpriteAtlas(void)
+	{
+	munmap(mapping,mappingSize);
+	close(fd);
+	}
+
+std::string SpriteAtlas::getDefaultFileName(const std::string& spritesBasePath)
+	{
+	return spritesBasePath+"SpriteAtlas.dat";
+	}
+
+size_t SpriteAtlas::compressDXT5(const unsigned char* rgba,unsigned int width,unsigned int height,unsigned int stride,unsigned char* blocks)
+	{
+	unsigned char* blockPtr=blocks;
+	for(unsigned int by=0;by<height;by+=4)
+		for(unsigned int bx=0;bx<width;bx+=4)
+			{
+			/* Gather the block's pixels in row-major order: */
+			const unsigned char* pixels[16];
+			for(unsigned int y=0;y<4;++y)
+				for(unsigned int x=0;x<4;++x)
+					pixels[y*4+x]=rgba+((by+y)*stride+(bx+x))*4;
+			
+			compressDXT5Block(pixels,blockPtr);
+			blockPtr+=16;
+			}
+	
+	return size_t(blockPtr-blocks);
+	}
+
+void SpriteAtlas::bake(const std::string& spritesBasePath,const char* atlasFileName,SpriteAtlas::Format format)
+	{
+	/* Load all spritesheets and find the layer size, rounded up to whole compression blocks: */
+	const unsigned int numLayers=DINO_NUM_SPECIES*ACTION_NUM_ACTIONS;
+	std::vector<Images::RGBAImage> images(numLayers);
+	std::vector<bool> loaded(numLayers,false);
+	unsigned int layerSize[2]={4,4};
+	for(unsigned int layer=0;layer<numLayers;++layer)
+		{
+		std::string path=spritesBasePath+getSpritesheetPath(DinosaurSpecies(layer/ACTION_NUM_ACTIONS),DinosaurAction(layer%ACTION_NUM_ACTIONS));
+		try
+			{
+			images[layer]=Images::readTransparentImageFile(path.c_str());
+			loaded[layer]=true;
+			for(int i=0;i<2;++i)
+				if(layerSize[i]<images[layer].getSize(i))
+					layerSize[i]=images[layer].getSize(i);
+			}
+		catch(const std::exception& err)
+			{
+			std::cerr<<"SpriteAtlas: Skipping missing spritesheet "<<path<<" ("<<err.what()<<")"<<std::endl;
+			}
+		}
+	for(int i=0;i<2;++i)
+		layerSize[i]=(layerSize[i]+3)&~3U;
+	
+	/* Calculate the file layout: */
+	size_t layerDataSize=format==DXT5?size_t(layerSize[0])*size_t(layerSize[1]):size_t(layerSize[0])*size_t(layerSize[1])*4;
+	size_t tableEnd=sizeof(Header)+numLayers*sizeof(Layer);
+	size_t layerStride=(layerDataSize+dataAlignment-1)&~(dataAlignment-1);
+	size_t dataStart=(tableEnd+dataAlignment-1)&~(dataAlignment-1);
+	
+	/* Write the header: */
+	IO::FilePtr file=IO::openFile(atlasFileName,IO::File::WriteOnly);
+	file->setEndianness(Misc::LittleEndian);
+	char magic[16];
+	memset(magic,0,sizeof(magic));
+	strncpy(magic,"SARndboxSprites",sizeof(magic));
+	file->write(magic,sizeof(magic));
+	file->write<unsigned int>(fileVersion);
+	file->write<unsigned int>(format);
+	file->write<unsigned int>(layerSize,2);
+	file->write<unsigned int>(numLayers);
+	file->write<unsigned int>((unsigned int)layerDataSize);
+	for(int i=0;i<2;++i)
+		file->write<unsigned int>(0);
+	
+	/* Write the metadata table; spritesheets hold 8 rows of directions and 15 columns of frames: */
+	for(unsigned int layer=0;layer<numLayers;++layer)
+		{
+		unsigned int sheetSize[2]={0,0};
+		if(loaded[layer])
+			for(int i=0;i<2;++i)
+				sheetSize[i]=images[layer].getSize(i);
+		file->write<unsigned int>(layer/ACTION_NUM_ACTIONS);
+		file->write<unsigned int>(layer%ACTION_NUM_ACTIONS);
+		file->write<unsigned int>(loaded[layer]?1:0);
+		file->write<unsigned int>(sheetSize,2);
+		file->write<unsigned int>(sheetSize[0]/15);
+		file->write<unsigned int>(sheetSize[1]/8);
+		file->write<unsigned int>(15);
+		file->write<unsigned int>(8);
+		file->write<unsigned int>(0);
+		file->write<unsigned long long>((unsigned long long)(dataStart+layer*layerStride));
+		}
+	
+	/* Write each layer's pixel data, padded to the data alignment: */
+	std::vector<unsigned char> zeros(dataAlignment,0);
+	file->write(&zeros[0],dataStart-tableEnd);
+	std::vector<unsigned char> layerPixels(size_t(layerSize[0])*size_t(layerSize[1])*4);
+	std::vector<unsigned char> layerData(layerDataSize);
+	for(unsigned int layer=0;layer<numLayers;++layer)
+		{
+		/* Copy the spritesheet into the lower-left corner of an otherwise transparent layer: */
+		std::fill(layerPixels.begin(),layerPixels.end(),0);
+		if(loaded[layer])
+			{
+			const unsigned char* sheet=reinterpret_cast<const unsigned char*>(images[layer].getPixels());
+			size_t rowSize=size_t(images[layer].getSize(0))*4;
+			for(unsigned int y=0;y<images[layer].getSize(1);++y)
+				memcpy(&layerPixels[size_t(y)*size_t(layerSize[0])*4],sheet+y*rowSize,rowSize);
+			}
+		
+		/* Convert the layer to the atlas format: */
+		if(format==DXT5)
+			compressDXT5(&layerPixels[0],layerSize[0],layerSize[1],layerSize[0],&layerData[0]);
+		else
+			layerData=layerPixels;
+		file->write(&layerData[0],layerDataSize);
+		file->write(&zeros[0],layerStride-layerDataSize);
+		}
+	
+	std::cout<<"SpriteAtlas: Wrote "<<numLayers<<" layers of "<<layerSize[0]<<"x"<<layerSize[1]<<" pixels to "<<atlasFileName<<std::endl;
+	}
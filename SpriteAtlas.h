@@ -0,0 +1,108 @@
+/***********************************************************************
+SpriteAtlas - Class to write and memory-map baked sprite atlas files
+holding all dinosaur spritesheets as layers of pre-compressed texture
+data, with a metadata table describing each spritesheet.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef SPRITEATLAS_INCLUDED
+#define SPRITEATLAS_INCLUDED
+
+#include <stddef.h>
+#include <string>
+
+#include "Dinosaur.h"
+
+class SpriteAtlas
+	{
+	/* Embedded classes: */
+	public:
+	enum Format // Enumerated type for layer pixel formats
+		{
+		RGBA8=0, // Uncompressed 8-bit RGBA
+		DXT5=1 // S3TC DXT5 (BC3) compressed RGBA
+		};
+	
+	struct Header // Structure for the file header; all values are stored in little-endian byte order
+		{
+		/* Elements: */
+		public:
+		char magic[16]; // File type identifier "SARndboxSprites"
+		unsigned int version; // File format version
+		unsigned int format; // Pixel format of all layers
+		unsigned int layerSize[2]; // Width and height of every layer in pixels
+		unsigned int numLayers; // Number of layers; one per species and action
+		unsigned int layerDataSize; // Size of each layer's pixel data in bytes
+		unsigned int reserved[2]; // Padding to 48 bytes
+		};
+	
+	struct Layer // Structure for a metadata table entry, following the header
+		{
+		/* Elements: */
+		public:
+		unsigned int species; // Species of the layer's spritesheet
+		unsigned int action; // Action of the layer's spritesheet
+		unsigned int valid; // Non-zero if the spritesheet was found during baking
+		unsigned int sheetSize[2]; // Width and height of the spritesheet inside the layer, starting at the layer's origin
+		unsigned int frameSize[2]; // Width and height of a single animation frame in pixels
+		unsigned int numFrames; // Number of frames per direction (columns)
+		unsigned int numDirections; // Number of directions (rows)
+		unsigned int reserved; // Padding to 48 bytes
+		unsigned long long dataOffset; // Offset of the layer's pixel data from the beginning of the file; page-aligned
+		};
+	
+	static const unsigned int fileVersion=1; // Current file format version
+	static const size_t dataAlignment=4096; // Alignment of layer pixel data in the file
+	
+	/* Elements: */
+	private:
+	int fd; // File descriptor of the mapped atlas file, or -1
+	void* mapping; // Memory-mapped atlas file
+	size_t mappingSize; // Size of the memory mapping in bytes
+	const Header* header; // Pointer to the file header inside the mapping
+	const Layer* layers; // Pointer to the metadata table inside the mapping
+	
+	/* Constructors and destructors: */
+	public:
+	SpriteAtlas(const char* atlasFileName); // Memory-maps the given atlas file; throws an exception if the file is missing or invalid
+	~SpriteAtlas(void);
+	
+	/* Methods: */
+	static std::string getDefaultFileName(const std::string& spritesBasePath); // Returns the name of the atlas file baked from the sprites in the given directory
+	static int getLayerIndex(DinosaurSpecies species,DinosaurAction action) // Returns the layer index of the given spritesheet
+		{
+		return int(species)*ACTION_NUM_ACTIONS+int(action);
+		}
+	static size_t compressDXT5(const unsigned char* rgba,unsigned int width,unsigned int height,unsigned int stride,unsigned char* blocks); // Compresses an RGBA image whose size is a multiple of 4 into DXT5 blocks; stride is the image's row length in pixels; returns the compressed size in bytes
+	static void bake(const std::string& spritesBasePath,const char* atlasFileName,Format format); // Loads all spritesheets from the given directory and writes them into an atlas file of the given format
+	const Header& getHeader(void) const // Returns the atlas file header
+		{
+		return *header;
+		}
+	const Layer& getLayer(int layerIndex) const // Returns the metadata of the given layer
+		{
+		return layers[layerIndex];
+		}
+	const void* getLayerData(int layerIndex) const // Returns the memory-mapped pixel data of the given layer
+		{
+		return static_cast<const char*>(mapping)+layers[layerIndex].dataOffset;
+		}
+	};
+
+#endif
@@ -0,0 +1,106 @@
+/***********************************************************************
+StartupProfile - Class to record the wall-clock times of named, possibly
+concurrent, application startup phases and to print a timing breakdown.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include "StartupProfile.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "PerformanceProfiler.h"
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+struct RecordStartOrder // Functor to sort phase records by start time
+	{
+	/* Methods: */
+	template <class RecordParam>
+	bool operator()(const RecordParam& r1,const RecordParam& r2) const
+		{
+		return r1.start<r2.start;
+		}
+	};
+
+}
+
+/**************************************
+Methods of class StartupProfile::Phase:
+**************************************/
+
+StartupProfile::Phase::Phase(StartupProfile* sProfile,const char* sName)
+	:profile(sProfile),name(sName),
+	 startTime(profile!=0?PerformanceProfiler::getTime():0.0)
+	{
+	}
+
+StartupProfile::Phase::~Phase(void)
+	{
+	if(profile!=0)
+		profile->addPhase(name,startTime,PerformanceProfiler::getTime());
+	}
+
+/*******************************
+Methods of class StartupProfile:
+*******************************/
+
+StartupProfile::StartupProfile(void)
+	:startTime(PerformanceProfiler::getTime())
+	{
+	}
+
+void StartupProfile::addPhase(const char* name,double phaseStart,double phaseEnd)
+	{
+	Threads::Mutex::Lock recordLock(recordMutex);
+	
+	Record record;
+	record.name=name;
+	record.start=phaseStart-startTime;
+	record.end=phaseEnd-startTime;
+	records.push_back(record);
+	}
+
+void StartupProfile::print(std::ostream& os) const
+	{
+	/* Sort a copy of the phase list by start time so that concurrent phases appear next to each other: */
+	std::vector<Record> sorted;
+	double total=PerformanceProfiler::getTime()-startTime;
+	{
+	Threads::Mutex::Lock recordLock(recordMutex);
+	sorted=records;
+	}
+	std::stable_sort(sorted.begin(),sorted.end(),RecordStartOrder());
+	
+	/* Print one line per phase with its start offset and duration: */
+	os<<"Startup profile:"<<std::endl;
+	for(std::vector<Record>::const_iterator rIt=sorted.begin();rIt!=sorted.end();++rIt)
+		{
+		char line[256];
+		snprintf(line,sizeof(line),"  at %8.1f ms took %8.1f ms  %s",rIt->start*1000.0,(rIt->end-rIt->start)*1000.0,rIt->name.c_str());
+		os<<line<<std::endl;
+		}
+	char line[256];
+	snprintf(line,sizeof(line),"  Total startup time %.1f ms",total*1000.0);
+	os<<line<<std::endl;
+	}
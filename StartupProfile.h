@@ -0,0 +1,76 @@
+/***********************************************************************
+StartupProfile - Class to record the wall-clock times of named, possibly
+concurrent, application startup phases and to print a timing breakdown.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef STARTUPPROFILE_INCLUDED
+#define STARTUPPROFILE_INCLUDED
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <Threads/Mutex.h>
+
+class StartupProfile
+	{
+	/* Embedded classes: */
+	public:
+	class Phase // Helper class to record the time spent in a scope as a startup phase; does nothing if the profile is NULL
+		{
+		/* Elements: */
+		private:
+		StartupProfile* profile;
+		const char* name;
+		double startTime;
+		
+		/* Constructors and destructors: */
+		public:
+		Phase(StartupProfile* sProfile,const char* sName);
+		~Phase(void);
+		};
+	
+	private:
+	struct Record // Structure for a finished phase
+		{
+		/* Elements: */
+		public:
+		std::string name; // Phase name
+		double start,end; // Start and end times of the phase in seconds relative to the profile's start
+		};
+	
+	/* Elements: */
+	double startTime; // Monotonic time at which the profile was created
+	mutable Threads::Mutex recordMutex; // Mutex serializing access to the phase list from concurrent startup threads
+	std::vector<Record> records; // List of finished phases in order of completion
+	
+	/* Constructors and destructors: */
+	public:
+	StartupProfile(void); // Starts a profile at the current time
+	
+	/* Methods: */
+	double getStartTime(void) const // Returns the profile's start time
+		{
+		return startTime;
+		}
+	void addPhase(const char* name,double phaseStart,double phaseEnd); // Records a phase between the given absolute monotonic times
+	void print(std::ostream& os) const; // Prints all phases ordered by start time and the total elapsed time
+	};
+
+#endif
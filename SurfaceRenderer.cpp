@@ -44,6 +44,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DepthImageRenderer.h"
 #include "ElevationColorMap.h"
+#include "ElevationCache.h"
 #include "DEM.h"
 #include "WaterTable2.h"
 #include "ShaderHelper.h"
@@ -54,8 +55,8 @@ Methods of class SurfaceRenderer::DataItem:
 ******************************************/
 
 SurfaceRenderer::DataItem::DataItem(void)
-	:contourLineFramebufferObject(0),contourLineDepthBufferObject(0),contourLineColorTextureObject(0),contourLineVersion(0),
-	 heightMapShader(0),surfaceSettingsVersion(0),lightTrackerVersion(0),
+	:heightMapShader(0),surfaceSettingsVersion(0),lightTrackerVersion(0),
+	 numPrecompiledVariants(0),
 	 globalAmbientHeightMapShader(0),shadowedIlluminatedHeightMapShader(0)
 	{
 	/* Initialize all required extensions: */
@@ -72,10 +73,8 @@ SurfaceRenderer::DataItem::DataItem(void)
 SurfaceRenderer::DataItem::~DataItem(void)
 	{
 	/* Release all allocated buffers, textures, and shaders: */
-	glDeleteFramebuffersEXT(1,&contourLineFramebufferObject);
-	glDeleteRenderbuffersEXT(1,&contourLineDepthBufferObject);
-	glDeleteTextures(1,&contourLineColorTextureObject);
-	glDeleteObjectARB(heightMapShader);
+	for(std::map<std::string,ShaderVariant>::iterator svIt=shaderVariants.begin();svIt!=shaderVariants.end();++svIt)
+		glDeleteObjectARB(svIt->second.shader);
 	glDeleteObjectARB(globalAmbientHeightMapShader);
 	glDeleteObjectARB(shadowedIlluminatedHeightMapShader);
 	}
@@ -86,520 +85,585 @@ Methods of class SurfaceRenderer:
 
 void SurfaceRenderer::shaderSourceFileChanged(const IO::FileMonitor::Event& event)
 	{
-	/* Invalidate the single-pass surface shader: */
+	/* Invalidate the single-pass surface shader and all cached shader variants: */
+	++shaderSourceVersion;
 	++surfaceSettingsVersion;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
-GLhandleARB SurfaceRenderer::createSinglePassSurfaceShader(const GLLightTracker& lt,GLint* uniformLocations) const
+unsigned int SurfaceRenderer::getShaderFeatures(void) const
 	{
-	GLhandleARB result=0;
-	
-	std::vector<GLhandleARB> shaders;
-	try
+	unsigned int result=0x0U;
+	if(dem!=0)
+		result|=DEMMATCHING;
+	if(elevationColorMap!=0)
+		result|=ELEVATIONCOLORMAP;
+	if(drawContourLines)
+		result|=CONTOURLINES;
+	if(drawDippingBed)
 		{
-		/*********************************************************************
-		Assemble and compile the surface rendering vertex shader:
-		*********************************************************************/
-		
-		/* Assemble the function and declaration strings: */
-		std::string vertexFunctions="\
-			#extension GL_ARB_texture_rectangle : enable\n";
-		
-		std::string vertexUniforms="\
-			uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture\n\
-			uniform mat4 depthProjection; // Transformation from depth image space to camera space\n\
-			uniform mat4 projectionModelviewDepthProjection; // Transformation from depth image space to clip space\n";
-		
-		std::string vertexVaryings;
+		result|=DIPPINGBED;
+		if(dippingBedFolded)
+			result|=FOLDEDDIPPINGBED;
+		}
+	if(illuminate)
+		result|=ILLUMINATE;
+	if(waterTable!=0)
+		{
+		result|=WATER;
+		if(advectWaterTexture)
+			result|=ADVECTWATER;
+		}
+	if(comicStyle)
+		result|=COMICSTYLE;
+	return result;
+	}
+
+void SurfaceRenderer::assembleSinglePassSurfaceShader(unsigned int features,const GLLightTracker& lt,SurfaceRenderer::ShaderSource& source) const
+	{
+	/*********************************************************************
+	Assemble the surface rendering vertex shader:
+	*********************************************************************/
+	
+	/* Assemble the function and declaration strings: */
+	std::string vertexFunctions="\
+		#version 120\n\
+		#extension GL_ARB_texture_rectangle : enable\n\
+		\n\
+		invariant gl_Position; // Must match the depth prepass' vertex positions exactly\n";
+	
+	std::string vertexUniforms="\
+		uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture\n\
+		uniform mat4 depthProjection; // Transformation from depth image space to camera space\n\
+		uniform mat4 projectionModelviewDepthProjection; // Transformation from depth image space to clip space\n";
+	
+	std::string vertexVaryings;
+	
+	/* Assemble the vertex shader's main function: */
+	std::string vertexMain="\
+		void main()\n\
+			{\n\
+			/* Get the vertex' depth image-space z coordinate from the texture: */\n\
+			vec4 vertexDic=gl_Vertex;\n\
+			vertexDic.z=texture2DRect(depthSampler,gl_Vertex.xy).r;\n\
+			\n\
+			/* Transform the vertex from depth image space to camera space and normalize it: */\n\
+			vec4 vertexCc=depthProjection*vertexDic;\n\
+			vertexCc/=vertexCc.w;\n\
+			\n";
+	
+	if(features&DEMMATCHING)
+		{
+		/* Add declarations for DEM matching: */
+		vertexUniforms+="\
+			uniform mat4 demTransform; // Transformation from camera space to DEM space\n\
+			uniform sampler2DRect demSampler; // Sampler for the DEM texture\n\
+			uniform float demDistScale; // Distance from surface to DEM at which the color map saturates\n";
 		
-		/* Assemble the vertex shader's main function: */
-		std::string vertexMain="\
-			void main()\n\
-				{\n\
-				/* Get the vertex' depth image-space z coordinate from the texture: */\n\
-				vec4 vertexDic=gl_Vertex;\n\
-				vertexDic.z=texture2DRect(depthSampler,gl_Vertex.xy).r;\n\
-				\n\
-				/* Transform the vertex from depth image space to camera space and normalize it: */\n\
-				vec4 vertexCc=depthProjection*vertexDic;\n\
-				vertexCc/=vertexCc.w;\n\
-				\n";
+		vertexVaryings+="\
+			varying float demDist; // Scaled signed distance from surface to DEM\n";
 		
-		if(dem!=0)
+		/* Add DEM matching code to vertex shader's main function: */
+		vertexMain+="\
+			/* Transform the camera-space vertex to scaled DEM space: */\n\
+			vec4 vertexDem=demTransform*vertexCc;\n\
+			\n\
+			/* Calculate scaled DEM-surface distance: */\n\
+			demDist=(vertexDem.z-texture2DRect(demSampler,vertexDem.xy).r)*demDistScale;\n\
+			\n";
+		}
+	else
+		{
+		if(features&ELEVATIONCOLORMAP)
 			{
-			/* Add declarations for DEM matching: */
+			/* Add declarations for height mapping: */
 			vertexUniforms+="\
-				uniform mat4 demTransform; // Transformation from camera space to DEM space\n\
-				uniform sampler2DRect demSampler; // Sampler for the DEM texture\n\
-				uniform float demDistScale; // Distance from surface to DEM at which the color map saturates\n";
+				uniform vec4 heightColorMapPlaneEq; // Plane equation of the base plane in camera space, scaled for height map textures\n";
 			
 			vertexVaryings+="\
-				varying float demDist; // Scaled signed distance from surface to DEM\n";
+				varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
 			
-			/* Add DEM matching code to vertex shader's main function: */
+			/* Add height mapping code to vertex shader's main function: */
 			vertexMain+="\
-				/* Transform the camera-space vertex to scaled DEM space: */\n\
-				vec4 vertexDem=demTransform*vertexCc;\n\
-				\n\
-				/* Calculate scaled DEM-surface distance: */\n\
-				demDist=(vertexDem.z-texture2DRect(demSampler,vertexDem.xy).r)*demDistScale;\n\
+				/* Plug camera-space vertex into the scaled and offset base plane equation: */\n\
+				heightColorMapTexCoord=dot(heightColorMapPlaneEq,vertexCc);\n\
 				\n";
 			}
-		else
+		
+		if(features&DIPPINGBED)
 			{
-			if(elevationColorMap!=0)
+			/* Add declarations for dipping bed rendering: */
+			if(features&FOLDEDDIPPINGBED)
 				{
-				/* Add declarations for height mapping: */
 				vertexUniforms+="\
-					uniform vec4 heightColorMapPlaneEq; // Plane equation of the base plane in camera space, scaled for height map textures\n";
-				
-				vertexVaryings+="\
-					varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
-				
-				/* Add height mapping code to vertex shader's main function: */
+					uniform float dbc[5]; // Dipping bed coefficients\n";
+				}
+			else
+				{
+				vertexUniforms+="\
+					uniform vec4 dippingBedPlaneEq; // Plane equation of the dipping bed\n";
+				}
+			
+			vertexVaryings+="\
+				varying float dippingBedDistance; // Vertex distance to dipping bed\n";
+			
+			/* Add dipping bed code to vertex shader's main function: */
+			if(features&FOLDEDDIPPINGBED)
+				{
 				vertexMain+="\
-					/* Plug camera-space vertex into the scaled and offset base plane equation: */\n\
-					heightColorMapTexCoord=dot(heightColorMapPlaneEq,vertexCc);\n\
+					/* Calculate distance from camera-space vertex to dipping bed equation: */\n\
+					dippingBedDistance=vertexCc.z-(((1.0-dbc[3])+cos(dbc[0]*vertexCc.x)*dbc[3])*sin(dbc[1]*vertexCc.y)*dbc[2]+dbc[4]);\n\
 					\n";
 				}
-			
-			if(drawDippingBed)
+			else
 				{
-				/* Add declarations for dipping bed rendering: */
-				if(dippingBedFolded)
-					{
-					vertexUniforms+="\
-						uniform float dbc[5]; // Dipping bed coefficients\n";
-					}
-				else
-					{
-					vertexUniforms+="\
-						uniform vec4 dippingBedPlaneEq; // Plane equation of the dipping bed\n";
-					}
-				
-				vertexVaryings+="\
-					varying float dippingBedDistance; // Vertex distance to dipping bed\n";
-				
-				/* Add dipping bed code to vertex shader's main function: */
-				if(dippingBedFolded)
-					{
-					vertexMain+="\
-						/* Calculate distance from camera-space vertex to dipping bed equation: */\n\
-						dippingBedDistance=vertexCc.z-(((1.0-dbc[3])+cos(dbc[0]*vertexCc.x)*dbc[3])*sin(dbc[1]*vertexCc.y)*dbc[2]+dbc[4]);\n\
-						\n";
-					}
-				else
-					{
-					vertexMain+="\
-						/* Plug camera-space vertex into the dipping bed equation: */\n\
-						dippingBedDistance=dot(dippingBedPlaneEq,vertexCc);\n\
-						\n";
-					}
+				vertexMain+="\
+					/* Plug camera-space vertex into the dipping bed equation: */\n\
+					dippingBedDistance=dot(dippingBedPlaneEq,vertexCc);\n\
+					\n";
 				}
 			}
+		}
+	
+	if(features&ILLUMINATE)
+		{
+		/* Add declarations for illumination: */
+		vertexUniforms+="\
+			uniform mat4 modelview; // Transformation from camera space to eye space\n\
+			uniform mat4 tangentModelviewDepthProjection; // Transformation from depth image space to eye space for tangent planes\n";
 		
-		if(illuminate)
-			{
-			/* Add declarations for illumination: */
-			vertexUniforms+="\
-				uniform mat4 modelview; // Transformation from camera space to eye space\n\
-				uniform mat4 tangentModelviewDepthProjection; // Transformation from depth image space to eye space for tangent planes\n";
-			
-			vertexVaryings+="\
-				varying vec4 diffColor,specColor; // Diffuse and specular colors, interpolated separately for correct highlights\n";
-			
-			/* Add illumination code to vertex shader's main function: */
-			vertexMain+="\
-				/* Calculate the vertex' tangent plane equation in depth image space: */\n\
-				vec4 tangentDic;\n\
-				tangentDic.x=texture2DRect(depthSampler,vec2(vertexDic.x-1.0,vertexDic.y)).r-texture2DRect(depthSampler,vec2(vertexDic.x+1.0,vertexDic.y)).r;\n\
-				tangentDic.y=texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y-1.0)).r-texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y+1.0)).r;\n\
-				tangentDic.z=2.0;\n\
-				tangentDic.w=-dot(vertexDic.xyz,tangentDic.xyz)/vertexDic.w;\n\
-				\n\
-				/* Transform the vertex and its tangent plane from depth image space to eye space: */\n\
-				vec4 vertexEc=modelview*vertexCc;\n\
-				vec3 normalEc=normalize((tangentModelviewDepthProjection*tangentDic).xyz);\n\
-				\n\
-				/* Initialize the color accumulators: */\n\
-				diffColor=gl_LightModel.ambient*gl_FrontMaterial.ambient;\n\
-				specColor=vec4(0.0,0.0,0.0,0.0);\n\
-				\n";
-			
-			/* Call the appropriate light accumulation function for every enabled light source: */
-			bool firstLight=true;
-			for(int lightIndex=0;lightIndex<lt.getMaxNumLights();++lightIndex)
-				if(lt.getLightState(lightIndex).isEnabled())
+		vertexVaryings+="\
+			varying vec4 diffColor,specColor; // Diffuse and specular colors, interpolated separately for correct highlights\n";
+		
+		/* Add illumination code to vertex shader's main function: */
+		vertexMain+="\
+			/* Calculate the vertex' tangent plane equation in depth image space: */\n\
+			vec4 tangentDic;\n\
+			tangentDic.x=texture2DRect(depthSampler,vec2(vertexDic.x-1.0,vertexDic.y)).r-texture2DRect(depthSampler,vec2(vertexDic.x+1.0,vertexDic.y)).r;\n\
+			tangentDic.y=texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y-1.0)).r-texture2DRect(depthSampler,vec2(vertexDic.x,vertexDic.y+1.0)).r;\n\
+			tangentDic.z=2.0;\n\
+			tangentDic.w=-dot(vertexDic.xyz,tangentDic.xyz)/vertexDic.w;\n\
+			\n\
+			/* Transform the vertex and its tangent plane from depth image space to eye space: */\n\
+			vec4 vertexEc=modelview*vertexCc;\n\
+			vec3 normalEc=normalize((tangentModelviewDepthProjection*tangentDic).xyz);\n\
+			\n\
+			/* Initialize the color accumulators: */\n\
+			diffColor=gl_LightModel.ambient*gl_FrontMaterial.ambient;\n\
+			specColor=vec4(0.0,0.0,0.0,0.0);\n\
+			\n";
+		
+		/* Call the appropriate light accumulation function for every enabled light source: */
+		bool firstLight=true;
+		for(int lightIndex=0;lightIndex<lt.getMaxNumLights();++lightIndex)
+			if(lt.getLightState(lightIndex).isEnabled())
+				{
+				/* Create the light accumulation function: */
+				vertexFunctions.push_back('\n');
+				vertexFunctions+=lt.createAccumulateLightFunction(lightIndex);
+				
+				if(firstLight)
 					{
-					/* Create the light accumulation function: */
-					vertexFunctions.push_back('\n');
-					vertexFunctions+=lt.createAccumulateLightFunction(lightIndex);
-					
-					if(firstLight)
-						{
-						vertexMain+="\
-							/* Call the light accumulation functions for all enabled light sources: */\n";
-						firstLight=false;
-						}
-					
-					/* Call the light accumulation function from vertex shader's main function: */
 					vertexMain+="\
-						accumulateLight";
-					char liBuffer[12];
-					vertexMain.append(Misc::print(lightIndex,liBuffer+11));
-					vertexMain+="(vertexEc,normalEc,gl_FrontMaterial.ambient,gl_FrontMaterial.diffuse,gl_FrontMaterial.specular,gl_FrontMaterial.shininess,diffColor,specColor);\n";
+						/* Call the light accumulation functions for all enabled light sources: */\n";
+					firstLight=false;
 					}
-			if(!firstLight)
+				
+				/* Call the light accumulation function from vertex shader's main function: */
 				vertexMain+="\
-					\n";
-			}
-		
-		if(waterTable!=0&&dem==0)
-			{
-			/* Add declarations for water handling: */
-			vertexUniforms+="\
-				uniform mat4 waterTransform; // Transformation from camera space to water level texture coordinate space\n";
-			vertexVaryings+="\
-				varying vec2 waterTexCoord; // Texture coordinate for water level texture\n";
-			
-			/* Add water handling code to vertex shader's main function: */
+					accumulateLight";
+				char liBuffer[12];
+				vertexMain.append(Misc::print(lightIndex,liBuffer+11));
+				vertexMain+="(vertexEc,normalEc,gl_FrontMaterial.ambient,gl_FrontMaterial.diffuse,gl_FrontMaterial.specular,gl_FrontMaterial.shininess,diffColor,specColor);\n";
+				}
+		if(!firstLight)
 			vertexMain+="\
-				/* Transform the vertex from camera space to water level texture coordinate space: */\n\
-				waterTexCoord=(waterTransform*vertexCc).xy;\n\
 				\n";
-			}
+		}
+	
+	if((features&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Add declarations for water handling: */
+		vertexUniforms+="\
+			uniform mat4 waterTransform; // Transformation from camera space to water level texture coordinate space\n";
+		vertexVaryings+="\
+			varying vec2 waterTexCoord; // Texture coordinate for water level texture\n";
 		
-		/* Finish the vertex shader's main function: */
+		/* Add water handling code to vertex shader's main function: */
 		vertexMain+="\
-				/* Transform vertex from depth image space to clip space: */\n\
-				gl_Position=projectionModelviewDepthProjection*vertexDic;\n\
-				}\n";
-		
-		/* Compile the vertex shader: */
-		shaders.push_back(glCompileVertexShaderFromStrings(7,vertexFunctions.c_str(),"\t\t\n",vertexUniforms.c_str(),"\t\t\n",vertexVaryings.c_str(),"\t\t\n",vertexMain.c_str()));
-		
-		/*********************************************************************
-		Assemble and compile the surface rendering fragment shaders:
-		*********************************************************************/
-		
-		/* Assemble the fragment shader's function declarations: */
-		std::string fragmentDeclarations;
-		
-		/* Assemble the fragment shader's uniform and varying variables: */
-		std::string fragmentUniforms;
-		std::string fragmentVaryings;
-		
-		/* Assemble the fragment shader's main function: */
-		std::string fragmentMain="\
-			void main()\n\
-				{\n";
+			/* Transform the vertex from camera space to water level texture coordinate space: */\n\
+			waterTexCoord=(waterTransform*vertexCc).xy;\n\
+			\n";
+		}
+	
+	/* Finish the vertex shader's main function: */
+	vertexMain+="\
+			/* Transform vertex from depth image space to clip space: */\n\
+			gl_Position=projectionModelviewDepthProjection*vertexDic;\n\
+			}\n";
+	
+	/* Concatenate the vertex shader source: */
+	source.vertexSource=vertexFunctions+"\t\t\n"+vertexUniforms+"\t\t\n"+vertexVaryings+"\t\t\n"+vertexMain;
+	
+	/*********************************************************************
+	Assemble the surface rendering fragment shaders:
+	*********************************************************************/
+	
+	/* Assemble the fragment shader's function declarations: */
+	std::string fragmentDeclarations;
+	
+	/* Assemble the fragment shader's uniform and varying variables: */
+	std::string fragmentUniforms;
+	std::string fragmentVaryings;
+	
+	/* Assemble the fragment shader's main function: */
+	std::string fragmentMain="\
+		void main()\n\
+			{\n";
+	
+	if(features&DEMMATCHING)
+		{
+		/* Add declarations for DEM matching: */
+		fragmentVaryings+="\
+			varying float demDist; // Scaled signed distance from surface to DEM\n";
 		
-		if(dem!=0)
+		/* Add DEM matching code to the fragment shader's main function: */
+		fragmentMain+="\
+			/* Calculate the fragment's color from a double-ramp function: */\n\
+			vec4 baseColor;\n\
+			if(demDist<0.0)\n\
+				baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(1.0,0.0,0.0,1.0),min(-demDist,1.0));\n\
+			else\n\
+				baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(0.0,0.0,1.0,1.0),min(demDist,1.0));\n\
+			\n";
+		}
+	else
+		{
+		if(features&ELEVATIONCOLORMAP)
 			{
-			/* Add declarations for DEM matching: */
+			/* Add declarations for height mapping: */
+			fragmentUniforms+="\
+				uniform sampler1D heightColorMapSampler;\n";
 			fragmentVaryings+="\
-				varying float demDist; // Scaled signed distance from surface to DEM\n";
+				varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
 			
-			/* Add DEM matching code to the fragment shader's main function: */
+			/* Add height mapping code to the fragment shader's main function: */
 			fragmentMain+="\
-				/* Calculate the fragment's color from a double-ramp function: */\n\
-				vec4 baseColor;\n\
-				if(demDist<0.0)\n\
-					baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(1.0,0.0,0.0,1.0),min(-demDist,1.0));\n\
-				else\n\
-					baseColor=mix(vec4(1.0,1.0,1.0,1.0),vec4(0.0,0.0,1.0,1.0),min(demDist,1.0));\n\
+				/* Get the fragment's color from the height color map: */\n\
+				vec4 baseColor=texture1D(heightColorMapSampler,heightColorMapTexCoord);\n\
 				\n";
 			}
 		else
 			{
-			if(elevationColorMap!=0)
-				{
-				/* Add declarations for height mapping: */
-				fragmentUniforms+="\
-					uniform sampler1D heightColorMapSampler;\n";
-				fragmentVaryings+="\
-					varying float heightColorMapTexCoord; // Texture coordinate for the height color map\n";
-				
-				/* Add height mapping code to the fragment shader's main function: */
-				fragmentMain+="\
-					/* Get the fragment's color from the height color map: */\n\
-					vec4 baseColor=texture1D(heightColorMapSampler,heightColorMapTexCoord);\n\
-					\n";
-				}
-			else
-				{
-				fragmentMain+="\
-					/* Set the surface's base color to white: */\n\
-					vec4 baseColor=vec4(1.0,1.0,1.0,1.0);\n\
-					\n";
-				}
-			
-			if(drawDippingBed)
-				{
-				/* Add declarations for dipping bed rendering: */
-				fragmentUniforms+="\
-					uniform float dippingBedThickness; // Thickness of dipping bed in camera-space units\n";
-				
-				fragmentVaryings+="\
-					varying float dippingBedDistance; // Vertex distance to dipping bed plane\n";
-				
-				/* Add dipping bed code to fragment shader's main function: */
-				fragmentMain+="\
-					/* Check fragment's dipping plane distance against dipping bed thickness: */\n\
-					float w=fwidth(dippingBedDistance)*1.0;\n\
-					if(dippingBedDistance<0.0)\n\
-						baseColor=mix(baseColor,vec4(1.0,0.0,0.0,1.0),smoothstep(-dippingBedThickness*0.5-w,-dippingBedThickness*0.5+w,dippingBedDistance));\n\
-					else\n\
-						baseColor=mix(vec4(1.0,0.0,0.0,1.0),baseColor,smoothstep(dippingBedThickness*0.5-w,dippingBedThickness*0.5+w,dippingBedDistance));\n\
-					\n";
-				}
-			}
-		
-		if(drawContourLines)
-			{
-			/* Declare the contour line function: */
-			fragmentDeclarations+="\
-				void addContourLines(in vec2,inout vec4);\n";
-			
-			/* Compile the contour line shader: */
-			shaders.push_back(compileFragmentShader("SurfaceAddContourLines"));
-			
-			/* Call contour line function from fragment shader's main function: */
 			fragmentMain+="\
-				/* Modulate the base color by contour line color: */\n\
-				addContourLines(gl_FragCoord.xy,baseColor);\n\
+				/* Set the surface's base color to white: */\n\
+				vec4 baseColor=vec4(1.0,1.0,1.0,1.0);\n\
 				\n";
 			}
 		
-		if(illuminate)
+		if(features&DIPPINGBED)
 			{
-			/* Declare the illumination function: */
-			fragmentDeclarations+="\
-				void illuminate(inout vec4);\n";
+			/* Add declarations for dipping bed rendering: */
+			fragmentUniforms+="\
+				uniform float dippingBedThickness; // Thickness of dipping bed in camera-space units\n";
 			
-			/* Compile the illumination shader: */
-			shaders.push_back(compileFragmentShader("SurfaceIlluminate"));
+			fragmentVaryings+="\
+				varying float dippingBedDistance; // Vertex distance to dipping bed plane\n";
 			
-			/* Call illumination function from fragment shader's main function: */
-			fragmentMain+="\
-				/* Apply illumination to the base color: */\n\
-				illuminate(baseColor);\n\
-				\n";
-			}
-		
-		if(waterTable!=0&&dem==0)
-			{
-			/* Declare the water handling functions: */
-			fragmentDeclarations+="\
-				void addWaterColor(in vec2,inout vec4);\n\
-				void addWaterColorAdvected(inout vec4);\n";
-
-			/* Compile the water handling shader: */
-			shaders.push_back(compileFragmentShader("SurfaceAddWaterColor"));
-
-			/* Call water coloring function from fragment shader's main function: */
-			if(advectWaterTexture)
-				{
-				fragmentMain+="\
-					/* Modulate the base color with water color: */\n\
-					addWaterColorAdvected(baseColor);\n\
-					\n";
-				}
-			else
-				{
-				fragmentMain+="\
-					/* Modulate the base color with water color: */\n\
-					addWaterColor(gl_FragCoord.xy,baseColor);\n\
-					\n";
-				}
-			}
-
-		if(comicStyle)
-			{
-			/* Declare the comic style function: */
-			fragmentDeclarations+="\
-				void applyComicStyle(inout vec4);\n";
-
-			/* Compile the comic style shader: */
-			shaders.push_back(compileFragmentShader("SurfaceComicStyle"));
-
-			/* Call comic style function from fragment shader's main function: */
+			/* Add dipping bed code to fragment shader's main function: */
 			fragmentMain+="\
-				/* Apply comic/cartoon posterization effect: */\n\
-				applyComicStyle(baseColor);\n\
+				/* Check fragment's dipping plane distance against dipping bed thickness: */\n\
+				float w=fwidth(dippingBedDistance)*1.0;\n\
+				if(dippingBedDistance<0.0)\n\
+					baseColor=mix(baseColor,vec4(1.0,0.0,0.0,1.0),smoothstep(-dippingBedThickness*0.5-w,-dippingBedThickness*0.5+w,dippingBedDistance));\n\
+				else\n\
+					baseColor=mix(vec4(1.0,0.0,0.0,1.0),baseColor,smoothstep(dippingBedThickness*0.5-w,dippingBedThickness*0.5+w,dippingBedDistance));\n\
 				\n";
 			}
-
-		/* Finish the fragment shader's main function: */
-		fragmentMain+="\
-			/* Assign the final color to the fragment: */\n\
-			gl_FragColor=baseColor;\n\
-			}\n";
+		}
+	
+	if(features&CONTOURLINES)
+		{
+		/* Declare the contour line function: */
+		fragmentDeclarations+="\
+			void addContourLines(in vec2,inout vec4);\n";
+		fragmentUniforms+="\
+			uniform vec2 pixelCornerElevationScale; // Scale from window pixel to pixel corner elevation texel coordinates\n";
 		
-		/* Compile the fragment shader: */
-		shaders.push_back(glCompileFragmentShaderFromStrings(7,fragmentDeclarations.c_str(),"\t\t\n",fragmentUniforms.c_str(),"\t\t\n",fragmentVaryings.c_str(),"\t\t\n",fragmentMain.c_str()));
+		/* Add the contour line shader: */
+		source.fragmentShaderNames.push_back("SurfaceAddContourLines");
 		
-		/* Link the shader program: */
-		result=glLinkShader(shaders);
+		/* Call contour line function from fragment shader's main function: */
+		fragmentMain+="\
+			/* Modulate the base color by contour line color: */\n\
+			addContourLines((gl_FragCoord.xy-vec2(0.5))*pixelCornerElevationScale+vec2(0.5),baseColor);\n\
+			\n";
+		}
+	
+	if(features&ILLUMINATE)
+		{
+		/* Declare the illumination function: */
+		fragmentDeclarations+="\
+			void illuminate(inout vec4);\n";
 		
-		/* Release all compiled shaders: */
-		for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
-			glDeleteObjectARB(*shIt);
+		/* Add the illumination shader: */
+		source.fragmentShaderNames.push_back("SurfaceIlluminate");
 		
-		/*******************************************************************
-		Query the shader program's uniform locations:
-		*******************************************************************/
+		/* Call illumination function from fragment shader's main function: */
+		fragmentMain+="\
+			/* Apply illumination to the base color: */\n\
+			illuminate(baseColor);\n\
+			\n";
+		}
+	
+	if((features&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Declare the water handling functions: */
+		fragmentDeclarations+="\
+			void addWaterColor(in vec2,inout vec4);\n\
+			void addWaterColorAdvected(inout vec4);\n";
 		
-		GLint* ulPtr=uniformLocations;
+		/* Add the water handling shader: */
+		source.fragmentShaderNames.push_back("SurfaceAddWaterColor");
 		
-		/* Query common uniform variables: */
-		*(ulPtr++)=glGetUniformLocationARB(result,"depthSampler");
-		*(ulPtr++)=glGetUniformLocationARB(result,"depthProjection");
-		if(dem!=0)
-			{
-			/* Query DEM matching uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"demTransform");
-			*(ulPtr++)=glGetUniformLocationARB(result,"demSampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"demDistScale");
-			}
-		else if(elevationColorMap!=0)
-			{
-			/* Query height color mapping uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapPlaneEq");
-			*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapSampler");
-			}
-		if(drawContourLines)
-			{
-			*(ulPtr++)=glGetUniformLocationARB(result,"pixelCornerElevationSampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"contourLineFactor");
-			}
-		if(drawDippingBed)
+		/* Call water coloring function from fragment shader's main function: */
+		if(features&ADVECTWATER)
 			{
-			if(dippingBedFolded)
-				*(ulPtr++)=glGetUniformLocationARB(result,"dbc");
-			else
-				*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedPlaneEq");
-			*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedThickness");
+			fragmentMain+="\
+				/* Modulate the base color with water color: */\n\
+				addWaterColorAdvected(baseColor);\n\
+				\n";
 			}
-		if(illuminate)
+		else
 			{
-			/* Query illumination uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"modelview");
-			*(ulPtr++)=glGetUniformLocationARB(result,"tangentModelviewDepthProjection");
+			fragmentMain+="\
+				/* Modulate the base color with water color: */\n\
+				addWaterColor(gl_FragCoord.xy,baseColor);\n\
+				\n";
 			}
-		if(waterTable!=0&&dem==0)
+		}
+	
+	if(features&COMICSTYLE)
+		{
+		/* Declare the comic style function: */
+		fragmentDeclarations+="\
+			void applyComicStyle(inout vec4);\n";
+		
+		/* Add the comic style shader: */
+		source.fragmentShaderNames.push_back("SurfaceComicStyle");
+		
+		/* Call comic style function from fragment shader's main function: */
+		fragmentMain+="\
+			/* Apply comic/cartoon posterization effect: */\n\
+			applyComicStyle(baseColor);\n\
+			\n";
+		}
+	
+	/* Finish the fragment shader's main function: */
+	fragmentMain+="\
+		/* Assign the final color to the fragment: */\n\
+		gl_FragColor=baseColor;\n\
+		}\n";
+	
+	/* Concatenate the fragment shader source: */
+	source.fragmentSource=fragmentDeclarations+"\t\t\n"+fragmentUniforms+"\t\t\n"+fragmentVaryings+"\t\t\n"+fragmentMain;
+	}
+
+GLhandleARB SurfaceRenderer::createSinglePassSurfaceShader(unsigned int features,const SurfaceRenderer::ShaderSource& source,GLint* uniformLocations) const
+	{
+	/* Try restoring the shader program from the on-disk program binary cache, keyed by the complete shader source: */
+	std::string programKey=source.vertexSource;
+	programKey.append(source.fragmentSource);
+	for(std::vector<std::string>::const_iterator fsnIt=source.fragmentShaderNames.begin();fsnIt!=source.fragmentShaderNames.end();++fsnIt)
+		programKey.append(readShaderSource((*fsnIt+".fs").c_str()));
+	GLhandleARB result=loadProgramBinary(programKey);
+	
+	if(result==0)
+		{
+		std::vector<GLhandleARB> shaders;
+		try
 			{
-			/* Query water handling uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterTransform");
-			*(ulPtr++)=glGetUniformLocationARB(result,"bathymetrySampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"quantitySampler");
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterCellSize");
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterOpacity");
-			*(ulPtr++)=glGetUniformLocationARB(result,"waterAnimationTime");
-			*(ulPtr++)=glGetUniformLocationARB(result,"comicStyle");
+			/* Compile the vertex shader and all fragment shaders: */
+			shaders.push_back(glCompileVertexShaderFromString(source.vertexSource.c_str()));
+			for(std::vector<std::string>::const_iterator fsnIt=source.fragmentShaderNames.begin();fsnIt!=source.fragmentShaderNames.end();++fsnIt)
+				shaders.push_back(compileFragmentShader(fsnIt->c_str()));
+			shaders.push_back(glCompileFragmentShaderFromString(source.fragmentSource.c_str()));
+			
+			/* Link the shader program: */
+			result=glLinkShader(shaders);
 			}
-		if(comicStyle)
+		catch(...)
 			{
-			/* Query comic style uniform variables: */
-			*(ulPtr++)=glGetUniformLocationARB(result,"comicColorLevels");
+			/* Clean up and re-throw the exception: */
+			for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
+				glDeleteObjectARB(*shIt);
+			throw;
 			}
-		*(ulPtr++)=glGetUniformLocationARB(result,"projectionModelviewDepthProjection");
-		}
-	catch(...)
-		{
-		/* Clean up and re-throw the exception: */
+		
+		/* Release all compiled shaders: */
 		for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
 			glDeleteObjectARB(*shIt);
-		throw;
+		
+		/* Store the linked program for subsequent runs: */
+		saveProgramBinary(programKey,result);
+		}
+	
+	/*******************************************************************
+	Query the shader program's uniform locations:
+	*******************************************************************/
+	
+	GLint* ulPtr=uniformLocations;
+	
+	/* Query common uniform variables: */
+	*(ulPtr++)=glGetUniformLocationARB(result,"depthSampler");
+	*(ulPtr++)=glGetUniformLocationARB(result,"depthProjection");
+	if(features&DEMMATCHING)
+		{
+		/* Query DEM matching uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(result,"demTransform");
+		*(ulPtr++)=glGetUniformLocationARB(result,"demSampler");
+		*(ulPtr++)=glGetUniformLocationARB(result,"demDistScale");
+		}
+	else if(features&ELEVATIONCOLORMAP)
+		{
+		/* Query height color mapping uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapPlaneEq");
+		*(ulPtr++)=glGetUniformLocationARB(result,"heightColorMapSampler");
+		}
+	if(features&CONTOURLINES)
+		{
+		*(ulPtr++)=glGetUniformLocationARB(result,"pixelCornerElevationSampler");
+		*(ulPtr++)=glGetUniformLocationARB(result,"pixelCornerElevationScale");
+		*(ulPtr++)=glGetUniformLocationARB(result,"contourLineFactor");
+		}
+	if(features&DIPPINGBED)
+		{
+		if(features&FOLDEDDIPPINGBED)
+			*(ulPtr++)=glGetUniformLocationARB(result,"dbc");
+		else
+			*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedPlaneEq");
+		*(ulPtr++)=glGetUniformLocationARB(result,"dippingBedThickness");
+		}
+	if(features&ILLUMINATE)
+		{
+		/* Query illumination uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(result,"modelview");
+		*(ulPtr++)=glGetUniformLocationARB(result,"tangentModelviewDepthProjection");
+		}
+	if((features&(WATER|DEMMATCHING))==WATER)
+		{
+		/* Query water handling uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(result,"waterTransform");
+		*(ulPtr++)=glGetUniformLocationARB(result,"bathymetrySampler");
+		*(ulPtr++)=glGetUniformLocationARB(result,"quantitySampler");
+		*(ulPtr++)=glGetUniformLocationARB(result,"waterCellSize");
+		*(ulPtr++)=glGetUniformLocationARB(result,"waterOpacity");
+		*(ulPtr++)=glGetUniformLocationARB(result,"waterAnimationTime");
+		*(ulPtr++)=glGetUniformLocationARB(result,"comicStyle");
+		}
+	if(features&COMICSTYLE)
+		{
+		/* Query comic style uniform variables: */
+		*(ulPtr++)=glGetUniformLocationARB(result,"comicColorLevels");
 		}
+	*(ulPtr++)=glGetUniformLocationARB(result,"projectionModelviewDepthProjection");
 	
 	return result;
 	}
 
-void SurfaceRenderer::renderPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData,SurfaceRenderer::DataItem* dataItem) const
+const SurfaceRenderer::ShaderVariant& SurfaceRenderer::getShaderVariant(unsigned int features,const GLLightTracker& lt,SurfaceRenderer::DataItem* dataItem) const
 	{
-	/* Save the currently-bound frame buffer and clear color: */
-	GLint currentFrameBuffer;
-	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
-	GLfloat currentClearColor[4];
-	glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
-	
-	/* Check if the contour line rendering frame buffer needs to be created: */
-	if(dataItem->contourLineFramebufferObject==0)
+	/* Assemble the variant's shader source, which also serves as its cache key: */
+	ShaderSource source;
+	assembleSinglePassSurfaceShader(features,lt,source);
+	std::string variantKey=source.vertexSource;
+	variantKey.append(source.fragmentSource);
+	for(std::vector<std::string>::iterator fsnIt=source.fragmentShaderNames.begin();fsnIt!=source.fragmentShaderNames.end();++fsnIt)
+		variantKey.append(*fsnIt);
+	
+	/* Return a cached variant if it was built from the current external shader sources: */
+	std::map<std::string,ShaderVariant>::iterator svIt=dataItem->shaderVariants.find(variantKey);
+	if(svIt!=dataItem->shaderVariants.end()&&svIt->second.shaderSourceVersion==shaderSourceVersion)
+		return svIt->second;
+	
+	/* Build the variant: */
+	ShaderVariant newVariant;
+	newVariant.shader=createSinglePassSurfaceShader(features,source,newVariant.uniforms);
+	newVariant.shaderSourceVersion=shaderSourceVersion;
+	
+	if(svIt!=dataItem->shaderVariants.end())
 		{
-		/* Initialize the frame buffer: */
-		for(int i=0;i<2;++i)
-			dataItem->contourLineFramebufferSize[i]=0;
-		glGenFramebuffersEXT(1,&dataItem->contourLineFramebufferObject);
-		glGenRenderbuffersEXT(1,&dataItem->contourLineDepthBufferObject);
-		glGenTextures(1,&dataItem->contourLineColorTextureObject);
+		/* Replace the outdated variant in place: */
+		glDeleteObjectARB(svIt->second.shader);
+		svIt->second=newVariant;
+		return svIt->second;
 		}
-	
-	/* Bind the contour line rendering frame buffer object: */
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->contourLineFramebufferObject);
-	
-	/* Check if the contour line frame buffer needs to be resized: */
-	if(dataItem->contourLineFramebufferSize[0]!=(unsigned int)(viewport[2]+1)||dataItem->contourLineFramebufferSize[1]!=(unsigned int)(viewport[3]+1))
+	else
+		return dataItem->shaderVariants.insert(std::make_pair(variantKey,newVariant)).first->second;
+	}
+
+void SurfaceRenderer::precompileNextShaderVariant(const GLLightTracker& lt,SurfaceRenderer::DataItem* dataItem) const
+	{
+	/* Select the next variant reachable by toggling contour lines, comic style, and dipping bed mode at run time: */
+	static const unsigned int dippingBedModes[3]={0x0U,DIPPINGBED,DIPPINGBED|FOLDEDDIPPINGBED};
+	unsigned int toggles=dataItem->numPrecompiledVariants/3;
+	unsigned int variantFeatures=getShaderFeatures()&~(CONTOURLINES|COMICSTYLE|DIPPINGBED|FOLDEDDIPPINGBED);
+	variantFeatures|=dippingBedModes[dataItem->numPrecompiledVariants%3];
+	if(toggles&0x1U)
+		variantFeatures|=CONTOURLINES;
+	if(toggles&0x2U)
+		variantFeatures|=COMICSTYLE;
+	++dataItem->numPrecompiledVariants;
+	
+	/* Compile the variant unless it is already cached: */
+	try
 		{
-		/* Remember if the render buffers must still be attached to the frame buffer: */
-		bool mustAttachBuffers=dataItem->contourLineFramebufferSize[0]==0&&dataItem->contourLineFramebufferSize[1]==0;
-		
-		/* Update the frame buffer size: */
-		for(int i=0;i<2;++i)
-			dataItem->contourLineFramebufferSize[i]=(unsigned int)(viewport[2+i]+1);
-		
-		/* Resize the topographic contour line rendering depth buffer: */
-		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,dataItem->contourLineDepthBufferObject);
-		glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT,GL_DEPTH_COMPONENT,dataItem->contourLineFramebufferSize[0],dataItem->contourLineFramebufferSize[1]);
-		glBindRenderbufferEXT(GL_RENDERBUFFER_EXT,0);
-		
-		/* Resize the topographic contour line rendering color texture: */
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->contourLineColorTextureObject);
-		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
-		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,dataItem->contourLineFramebufferSize[0],dataItem->contourLineFramebufferSize[1],0,GL_LUMINANCE,GL_UNSIGNED_BYTE,0);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
-		
-		if(mustAttachBuffers)
-			{
-			glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,GL_DEPTH_ATTACHMENT_EXT,GL_RENDERBUFFER_EXT,dataItem->contourLineDepthBufferObject);
-			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->contourLineColorTextureObject,0);
-			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
-			glReadBuffer(GL_NONE);
-			}
+		getShaderVariant(variantFeatures,lt,dataItem);
 		}
-	
-	/* Extend the viewport to render the corners of all pixels: */
-	glViewport(0,0,viewport[2]+1,viewport[3]+1);
-	glClearColor(0.0f,0.0f,0.0f,1.0f);
-	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
-	
-	/* Shift the projection matrix by half a pixel to render the corners of the final pixels: */
-	PTransform shiftedProjectionModelview=projectionModelview;
-	PTransform::Matrix& spmm=shiftedProjectionModelview.getMatrix();
-	Scalar xs=Scalar(viewport[2])/Scalar(viewport[2]+1);
-	Scalar ys=Scalar(viewport[3])/Scalar(viewport[3]+1);
-	for(int j=0;j<4;++j)
+	catch(const std::runtime_error& err)
 		{
-		spmm(0,j)*=xs;
-		spmm(1,j)*=ys;
+		Misc::formattedUserError("SurfaceRenderer::precompileNextShaderVariant: Caught exception %s while precompiling surface shader variant",err.what());
 		}
-	
-	/* Render the surface elevation into the half-pixel offset frame buffer: */
-	depthImageRenderer->renderElevation(shiftedProjectionModelview,contextData);
-	
-	/* Restore the original viewport: */
-	glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
-	
-	/* Restore the original clear color and frame buffer binding: */
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
-	glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
 	}
 
-SurfaceRenderer::SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer)
+void SurfaceRenderer::createGlobalAmbientHeightMapShader(SurfaceRenderer::DataItem* dataItem) const
+	{
+	dataItem->globalAmbientHeightMapShader=linkVertexAndFragmentShader("SurfaceGlobalAmbientHeightMapShader");
+	dataItem->globalAmbientHeightMapShaderUniforms[0]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"depthSampler");
+	dataItem->globalAmbientHeightMapShaderUniforms[1]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"depthProjection");
+	dataItem->globalAmbientHeightMapShaderUniforms[2]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"basePlane");
+	dataItem->globalAmbientHeightMapShaderUniforms[3]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"pixelCornerElevationSampler");
+	dataItem->globalAmbientHeightMapShaderUniforms[4]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"contourLineFactor");
+	dataItem->globalAmbientHeightMapShaderUniforms[5]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"heightColorMapSampler");
+	dataItem->globalAmbientHeightMapShaderUniforms[6]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"heightColorMapTransformation");
+	dataItem->globalAmbientHeightMapShaderUniforms[7]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterLevelSampler");
+	dataItem->globalAmbientHeightMapShaderUniforms[8]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterLevelTextureTransformation");
+	dataItem->globalAmbientHeightMapShaderUniforms[9]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterOpacity");
+	}
+
+void SurfaceRenderer::createShadowedIlluminatedHeightMapShader(SurfaceRenderer::DataItem* dataItem) const
+	{
+	dataItem->shadowedIlluminatedHeightMapShader=linkVertexAndFragmentShader("SurfaceShadowedIlluminatedHeightMapShader");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[0]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"depthSampler");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[1]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"depthProjection");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[2]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"tangentDepthProjection");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[3]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"basePlane");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[4]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"pixelCornerElevationSampler");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[5]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"contourLineFactor");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[6]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"heightColorMapSampler");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[7]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"heightColorMapTransformation");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[8]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterLevelSampler");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[9]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterLevelTextureTransformation");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[10]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterOpacity");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[11]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"shadowTextureSampler");
+	dataItem->shadowedIlluminatedHeightMapShaderUniforms[12]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"shadowProjection");
+	}
+
+SurfaceRenderer::SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer,const ElevationCache* sElevationCache)
 	:depthImageRenderer(sDepthImageRenderer),
+	 elevationCache(sElevationCache),ownElevationCache(0),
 	 drawContourLines(true),contourLineFactor(1.0f),
 	 elevationColorMap(0),
 	 drawDippingBed(false),dippingBedFolded(false),
@@ -608,13 +672,20 @@ SurfaceRenderer::SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer)
 	 illuminate(false),
 	 waterTable(0),advectWaterTexture(false),waterOpacity(2.0f),
 	 comicStyle(false),comicColorLevels(6),
-	 surfaceSettingsVersion(1),
+	 surfaceSettingsVersion(1),shaderSourceVersion(1),settingsVersion(1),precompileShaderVariants(false),
 	 animationTime(0.0)
 	{
 	/* Copy the depth image size: */
 	for(int i=0;i<2;++i)
 		depthImageSize[i]=depthImageRenderer->getDepthImageSize(i);
 	
+	/* Create a private pixel-corner elevation cache if none was provided: */
+	if(elevationCache==0)
+		{
+		ownElevationCache=new ElevationCache(depthImageRenderer);
+		elevationCache=ownElevationCache;
+		}
+	
 	/* Check if the depth projection matrix retains right-handedness: */
 	const PTransform& depthProjection=depthImageRenderer->getDepthProjection();
 	Point p1=depthProjection.transform(Point(0,0,0));
@@ -636,6 +707,11 @@ SurfaceRenderer::SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer)
 	fileMonitor.startPolling();
 	}
 
+SurfaceRenderer::~SurfaceRenderer(void)
+	{
+	delete ownElevationCache;
+	}
+
 void SurfaceRenderer::initContext(GLContextData& contextData) const
 	{
 	/* Create a data item and add it to the context: */
@@ -643,50 +719,27 @@ void SurfaceRenderer::initContext(GLContextData& contextData) const
 	contextData.addDataItem(this,dataItem);
 	
 	/* Create the height map render shader: */
-	dataItem->heightMapShader=createSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem->heightMapShaderUniforms);
+	const GLLightTracker& lt=*contextData.getLightTracker();
+	unsigned int features=getShaderFeatures();
+	dataItem->heightMapShader=&getShaderVariant(features,lt,dataItem);
 	dataItem->surfaceSettingsVersion=surfaceSettingsVersion;
-	dataItem->lightTrackerVersion=contextData.getLightTracker()->getVersion();
-	
-	/* Create the global ambient height map render shader: */
-	dataItem->globalAmbientHeightMapShader=linkVertexAndFragmentShader("SurfaceGlobalAmbientHeightMapShader");
-	dataItem->globalAmbientHeightMapShaderUniforms[0]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"depthSampler");
-	dataItem->globalAmbientHeightMapShaderUniforms[1]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"depthProjection");
-	dataItem->globalAmbientHeightMapShaderUniforms[2]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"basePlane");
-	dataItem->globalAmbientHeightMapShaderUniforms[3]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"pixelCornerElevationSampler");
-	dataItem->globalAmbientHeightMapShaderUniforms[4]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"contourLineFactor");
-	dataItem->globalAmbientHeightMapShaderUniforms[5]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"heightColorMapSampler");
-	dataItem->globalAmbientHeightMapShaderUniforms[6]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"heightColorMapTransformation");
-	dataItem->globalAmbientHeightMapShaderUniforms[7]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterLevelSampler");
-	dataItem->globalAmbientHeightMapShaderUniforms[8]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterLevelTextureTransformation");
-	dataItem->globalAmbientHeightMapShaderUniforms[9]=glGetUniformLocationARB(dataItem->globalAmbientHeightMapShader,"waterOpacity");
-	
-	/* Create the shadowed illuminated height map render shader: */
-	dataItem->shadowedIlluminatedHeightMapShader=linkVertexAndFragmentShader("SurfaceShadowedIlluminatedHeightMapShader");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[0]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"depthSampler");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[1]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"depthProjection");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[2]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"tangentDepthProjection");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[3]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"basePlane");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[4]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"pixelCornerElevationSampler");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[5]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"contourLineFactor");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[6]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"heightColorMapSampler");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[7]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"heightColorMapTransformation");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[8]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterLevelSampler");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[9]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterLevelTextureTransformation");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[10]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"waterOpacity");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[11]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"shadowTextureSampler");
-	dataItem->shadowedIlluminatedHeightMapShaderUniforms[12]=glGetUniformLocationARB(dataItem->shadowedIlluminatedHeightMapShader,"shadowProjection");
+	dataItem->lightTrackerVersion=lt.getVersion();
 	}
 
 void SurfaceRenderer::setDrawContourLines(bool newDrawContourLines)
 	{
 	drawContourLines=newDrawContourLines;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setContourLineDistance(GLfloat newContourLineDistance)
 	{
 	/* Set the new contour line factor: */
 	contourLineFactor=1.0f/newContourLineDistance;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setElevationColorMap(ElevationColorMap* newElevationColorMap)
@@ -697,12 +750,16 @@ void SurfaceRenderer::setElevationColorMap(ElevationColorMap* newElevationColorM
 	
 	/* Set the elevation color map: */
 	elevationColorMap=newElevationColorMap;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDrawDippingBed(bool newDrawDippingBed)
 	{
 	drawDippingBed=newDrawDippingBed;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDippingBedPlane(const SurfaceRenderer::Plane& newDippingBedPlane)
@@ -716,6 +773,9 @@ void SurfaceRenderer::setDippingBedPlane(const SurfaceRenderer::Plane& newDippin
 	
 	/* Set the dipping bed's plane equation: */
 	dippingBedPlane=newDippingBedPlane;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDippingBedCoeffs(const GLfloat newDippingBedCoeffs[5])
@@ -730,11 +790,15 @@ void SurfaceRenderer::setDippingBedCoeffs(const GLfloat newDippingBedCoeffs[5])
 	/* Set the dipping bed's coefficients: */
 	for(int i=0;i<5;++i)
 		dippingBedCoeffs[i]=newDippingBedCoeffs[i];
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDippingBedThickness(GLfloat newDippingBedThickness)
 	{
 	dippingBedThickness=newDippingBedThickness;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDem(DEM* newDem)
@@ -745,42 +809,52 @@ void SurfaceRenderer::setDem(DEM* newDem)
 	
 	/* Set the new DEM: */
 	dem=newDem;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setDemDistScale(GLfloat newDemDistScale)
 	{
 	demDistScale=newDemDistScale;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setIlluminate(bool newIlluminate)
 	{
 	illuminate=newIlluminate;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setWaterTable(WaterTable2* newWaterTable)
 	{
 	waterTable=newWaterTable;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setAdvectWaterTexture(bool newAdvectWaterTexture)
 	{
 	advectWaterTexture=false; // newAdvectWaterTexture;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setWaterOpacity(GLfloat newWaterOpacity)
 	{
 	/* Set the new opacity factor: */
 	waterOpacity=newWaterOpacity;
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setAnimationTime(double newAnimationTime)
 	{
 	/* Set the new animation time: */
 	animationTime=newAnimationTime;
-
+	
 	/* Poll the file monitor: */
 	fileMonitor.processEvents();
 	}
@@ -789,12 +863,21 @@ void SurfaceRenderer::setComicStyle(bool newComicStyle)
 	{
 	comicStyle=newComicStyle;
 	++surfaceSettingsVersion;
+	++settingsVersion;
 	}
 
 void SurfaceRenderer::setComicColorLevels(int levels)
 	{
 	/* Clamp to valid range: */
 	comicColorLevels=levels<3?3:(levels>10?10:levels);
+	
+	/* Invalidate any re-usable renderings of the surface: */
+	++settingsVersion;
+	}
+
+void SurfaceRenderer::setPrecompileShaderVariants(bool newPrecompileShaderVariants)
+	{
+	precompileShaderVariants=newPrecompileShaderVariants;
 	}
 
 void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const
@@ -807,31 +890,21 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 	projectionModelview*=modelview;
 	
 	/* Check if contour line rendering is enabled: */
+	GLuint pixelCornerElevationTexture=0;
+	GLfloat pixelCornerElevationScale[2];
 	if(drawContourLines)
 		{
-		/* Run the first rendering pass to create a half-pixel offset texture of surface elevations: */
-		renderPixelCornerElevations(viewport,projectionModelview,contextData,dataItem);
-		}
-	else if(dataItem->contourLineFramebufferObject!=0)
-		{
-		/* Delete the contour line rendering frame buffer: */
-		glDeleteFramebuffersEXT(1,&dataItem->contourLineFramebufferObject);
-		dataItem->contourLineFramebufferObject=0;
-		glDeleteRenderbuffersEXT(1,&dataItem->contourLineDepthBufferObject);
-		dataItem->contourLineDepthBufferObject=0;
-		glDeleteTextures(1,&dataItem->contourLineColorTextureObject);
-		dataItem->contourLineColorTextureObject=0;
+		/* Get a half-pixel offset texture of surface elevations, rendered by the first surface renderer needing it for the current depth image and view: */
+		pixelCornerElevationTexture=elevationCache->getPixelCornerElevations(viewport,projectionModelview,pixelCornerElevationScale,contextData);
 		}
 	
 	/* Check if the single-pass surface shader is outdated: */
 	if(dataItem->surfaceSettingsVersion!=surfaceSettingsVersion||(illuminate&&dataItem->lightTrackerVersion!=contextData.getLightTracker()->getVersion()))
 		{
-		/* Rebuild the shader: */
+		/* Switch to the shader variant matching the current settings, building it if it is not yet cached: */
 		try
 			{
-			GLhandleARB newShader=createSinglePassSurfaceShader(*contextData.getLightTracker(),dataItem->heightMapShaderUniforms);
-			glDeleteObjectARB(dataItem->heightMapShader);
-			dataItem->heightMapShader=newShader;
+			dataItem->heightMapShader=&getShaderVariant(getShaderFeatures(),*contextData.getLightTracker(),dataItem);
 			}
 		catch(const std::runtime_error& err)
 			{
@@ -843,9 +916,15 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		dataItem->lightTrackerVersion=contextData.getLightTracker()->getVersion();
 		}
 	
+	if(precompileShaderVariants&&dataItem->numPrecompiledVariants<12)
+		{
+		/* Spread compiling the variants reachable by run-time toggles over the first frames instead of delaying the first one: */
+		precompileNextShaderVariant(*contextData.getLightTracker(),dataItem);
+		}
+	
 	/* Bind the single-pass surface shader: */
-	glUseProgramObjectARB(dataItem->heightMapShader);
-	const GLint* ulPtr=dataItem->heightMapShaderUniforms;
+	glUseProgramObjectARB(dataItem->heightMapShader->shader);
+	const GLint* ulPtr=dataItem->heightMapShader->uniforms;
 	
 	/* Bind the current depth image texture: */
 	glActiveTextureARB(GL_TEXTURE0_ARB);
@@ -883,9 +962,12 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		{
 		/* Bind the pixel corner elevation texture: */
 		glActiveTextureARB(GL_TEXTURE2_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->contourLineColorTextureObject);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,pixelCornerElevationTexture);
 		glUniform1iARB(*(ulPtr++),2);
 		
+		/* Upload the scale from window pixels to pixel corner elevation texels: */
+		glUniformARB<2>(*(ulPtr++),1,pixelCornerElevationScale);
+		
 		/* Upload the contour line distance factor: */
 		glUniform1fARB(*(ulPtr++),contourLineFactor);
 		}
@@ -958,17 +1040,17 @@ void SurfaceRenderer::renderSinglePass(const int viewport[4],const PTransform& p
 		
 		/* Upload the water animation time: */
 		glUniform1fARB(*(ulPtr++),GLfloat(animationTime));
-
+		
 		/* Upload the comic style flag for water shader: */
 		glUniform1iARB(*(ulPtr++),comicStyle?1:0);
 		}
-
+	
 	if(comicStyle)
 		{
 		/* Upload the comic style color levels: */
 		glUniform1iARB(*(ulPtr++),comicColorLevels);
 		}
-
+	
 	/* Upload the combined projection, modelview, and depth unprojection matrix: */
 	PTransform projectionModelviewDepthProjection=projectionModelview;
 	projectionModelviewDepthProjection*=depthImageRenderer->getDepthProjection();
@@ -1039,7 +1121,9 @@ void SurfaceRenderer::renderGlobalAmbientHeightMap(GLuint heightColorMapTexture,
 		dataItem->contourLineColorTextureObject=0;
 		}
 	
-	/* Bind the global ambient height map shader: */
+	/* Bind the global ambient height map shader, creating it on first use: */
+	if(dataItem->globalAmbientHeightMapShader==0)
+		createGlobalAmbientHeightMapShader(dataItem);
 	glUseProgramObjectARB(dataItem->globalAmbientHeightMapShader);
 	
 	/* Bind the vertex and index buffers: */
@@ -1135,7 +1219,9 @@ void SurfaceRenderer::renderShadowedIlluminatedHeightMap(GLuint heightColorMapTe
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
-	/* Bind the shadowed illuminated height map shader: */
+	/* Bind the shadowed illuminated height map shader, creating it on first use: */
+	if(dataItem->shadowedIlluminatedHeightMapShader==0)
+		createShadowedIlluminatedHeightMapShader(dataItem);
 	glUseProgramObjectARB(dataItem->shadowedIlluminatedHeightMapShader);
 	
 	/* Bind the vertex and index buffers: */
@@ -23,6 +23,9 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef SURFACERENDERER_INCLUDED
 #define SURFACERENDERER_INCLUDED
 
+#include <string>
+#include <vector>
+#include <map>
 #include <IO/FileMonitor.h>
 #include <Geometry/ProjectiveTransformation.h>
 #include <Geometry/Plane.h>
@@ -36,6 +39,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 /* Forward declarations: */
 class DepthImageRenderer;
 class ElevationColorMap;
+class ElevationCache;
 class GLLightTracker;
 class DEM;
 class WaterTable2;
@@ -47,22 +51,42 @@ class SurfaceRenderer:public GLObject
 	typedef Geometry::Plane<GLfloat,3> Plane; // Type for plane equations
 	
 	private:
+	enum ShaderFeatures // Enumerated type for surface settings selecting a single-pass surface shader variant
+		{
+		DEMMATCHING=0x1,ELEVATIONCOLORMAP=0x2,CONTOURLINES=0x4,DIPPINGBED=0x8,FOLDEDDIPPINGBED=0x10,
+		ILLUMINATE=0x20,WATER=0x40,ADVECTWATER=0x80,COMICSTYLE=0x100
+		};
+	
+	struct ShaderSource // Structure holding the assembled source code of a single-pass surface shader variant
+		{
+		/* Elements: */
+		public:
+		std::string vertexSource; // Generated vertex shader source
+		std::string fragmentSource; // Generated main fragment shader source
+		std::vector<std::string> fragmentShaderNames; // Names of external fragment shaders linked into the program
+		};
+	
+	struct ShaderVariant // Structure for a compiled single-pass surface shader variant
+		{
+		/* Elements: */
+		public:
+		GLhandleARB shader; // Shader program
+		GLint uniforms[24]; // Locations of the shader program's uniform variables
+		unsigned int shaderSourceVersion; // Version number of external shader source files from which the shader program was built
+		};
+	
 	struct DataItem:public GLObject::DataItem
 		{
 		/* Elements: */
 		public:
-		GLuint contourLineFramebufferSize[2]; // Current width and height of contour line rendering frame buffer
-		GLuint contourLineFramebufferObject; // Frame buffer object used to render topographic contour lines
-		GLuint contourLineDepthBufferObject; // Depth render buffer for topographic contour line frame buffer
-		GLuint contourLineColorTextureObject; // Color texture object for topographic contour line frame buffer
-		unsigned int contourLineVersion; // Version number of depth image used for contour line generation
-		GLhandleARB heightMapShader; // Shader program to render the surface using a height color map
-		GLint heightMapShaderUniforms[16]; // Locations of the height map shader's uniform variables
+		std::map<std::string,ShaderVariant> shaderVariants; // Map of compiled single-pass surface shader variants, keyed by generated shader source
+		const ShaderVariant* heightMapShader; // Shader variant to render the surface using the current surface settings
 		unsigned int surfaceSettingsVersion; // Version number of surface settings for which the height map shader was built
 		unsigned int lightTrackerVersion; // Version number of light tracker state for which the height map shader was built
-		GLhandleARB globalAmbientHeightMapShader; // Shader program to render the global ambient component of the surface using a height color map
+		unsigned int numPrecompiledVariants; // Number of shader variants reachable by run-time toggles that have been precompiled so far
+		GLhandleARB globalAmbientHeightMapShader; // Shader program to render the global ambient component of the surface using a height color map, or 0 until first used
 		GLint globalAmbientHeightMapShaderUniforms[13]; // Locations of the global ambient height map shader's uniform variables
-		GLhandleARB shadowedIlluminatedHeightMapShader; // Shader program to render the surface using illumination with shadows and a height color map
+		GLhandleARB shadowedIlluminatedHeightMapShader; // Shader program to render the surface using illumination with shadows and a height color map, or 0 until first used
 		GLint shadowedIlluminatedHeightMapShaderUniforms[14]; // Locations of the shadowed illuminated height map shader's uniform variables
 		
 		/* Constructors and destructors: */
@@ -75,6 +99,8 @@ class SurfaceRenderer:public GLObject
 	unsigned int depthImageSize[2]; // Size of depth image texture
 	PTransform tangentDepthProjection; // Transposed depth projection matrix for tangent planes, i.e., homogeneous normal vectors
 	IO::FileMonitor fileMonitor; // Monitor to watch the renderer's external shader source files
+	const ElevationCache* elevationCache; // Cache of pixel-corner elevation textures, shared with other surface renderers
+	ElevationCache* ownElevationCache; // Private cache of pixel-corner elevation textures if no shared cache was provided
 	
 	bool drawContourLines; // Flag if topographic contour lines are enabled
 	GLfloat contourLineFactor; // Inverse elevation distance between adjacent topographic contour lines
@@ -95,21 +121,30 @@ class SurfaceRenderer:public GLObject
 	WaterTable2* waterTable; // Pointer to the water table object; if NULL, water is ignored
 	bool advectWaterTexture; // Flag whether water texture coordinates are advected to visualize water flow
 	GLfloat waterOpacity; // Scaling factor for water opacity
-
+	
 	bool comicStyle; // Flag for comic/cartoon rendering style
 	int comicColorLevels; // Number of discrete color levels for posterization (default: 6)
-
+	
 	unsigned int surfaceSettingsVersion; // Version number of surface settings to invalidate surface rendering shader on changes
+	unsigned int shaderSourceVersion; // Version number of the external shader source files to invalidate cached shader variants on changes
+	unsigned int settingsVersion; // Version number of all surface settings, including those that only change shader uniforms
+	bool precompileShaderVariants; // Flag whether to compile the shader variants reachable by toggling contour lines, comic style, and dipping bed, one per frame after a context is initialized
 	double animationTime; // Time value for water animation
 	
 	/* Private methods: */
 	void shaderSourceFileChanged(const IO::FileMonitor::Event& event); // Callback called when one of the external shader source files is changed
-	GLhandleARB createSinglePassSurfaceShader(const GLLightTracker& lt,GLint* uniformLocations) const; // Creates a single-pass surface rendering shader based on current renderer settings
-	void renderPixelCornerElevations(const int viewport[4],const PTransform& projectionModelview,GLContextData& contextData,DataItem* dataItem) const; // Creates texture containing pixel-corner elevations based on the current depth image
+	unsigned int getShaderFeatures(void) const; // Returns the shader feature mask for the current renderer settings
+	void assembleSinglePassSurfaceShader(unsigned int features,const GLLightTracker& lt,ShaderSource& source) const; // Assembles the source code of a single-pass surface rendering shader for the given feature mask
+	GLhandleARB createSinglePassSurfaceShader(unsigned int features,const ShaderSource& source,GLint* uniformLocations) const; // Creates a single-pass surface rendering shader from the given source code, using the on-disk program binary cache if possible
+	const ShaderVariant& getShaderVariant(unsigned int features,const GLLightTracker& lt,DataItem* dataItem) const; // Returns a single-pass surface rendering shader for the given feature mask from the context's variant cache, creating it if necessary
+	void precompileNextShaderVariant(const GLLightTracker& lt,DataItem* dataItem) const; // Compiles the next not yet precompiled shader variant reachable by run-time toggles
+	void createGlobalAmbientHeightMapShader(DataItem* dataItem) const; // Creates the global ambient height map shader on its first use
+	void createShadowedIlluminatedHeightMapShader(DataItem* dataItem) const; // Creates the shadowed illuminated height map shader on its first use
 	
 	/* Constructors and destructors: */
 	public:
-	SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer); // Creates a renderer for the given depth image renderer
+	SurfaceRenderer(const DepthImageRenderer* sDepthImageRenderer,const ElevationCache* sElevationCache=0); // Creates a renderer for the given depth image renderer, sharing the given pixel-corner elevation cache or creating a private one
+	virtual ~SurfaceRenderer(void);
 	
 	/* Methods from GLObject: */
 	virtual void initContext(GLContextData& contextData) const;
@@ -131,7 +166,12 @@ class SurfaceRenderer:public GLObject
 	void setAnimationTime(double newAnimationTime); // Sets the time for water animation in seconds
 	void setComicStyle(bool newComicStyle); // Enables or disables comic/cartoon rendering style
 	void setComicColorLevels(int levels); // Sets the number of discrete color levels for posterization (3-10)
+	void setPrecompileShaderVariants(bool newPrecompileShaderVariants); // Sets whether shader variants for run-time toggles are compiled over the first frames after a context is initialized
 	bool getComicStyle(void) const { return comicStyle; } // Returns comic style state
+	unsigned int getSettingsVersion(void) const // Returns a version number that changes whenever any setting affecting the rendered surface changes
+		{
+		return settingsVersion;
+		}
 	void renderSinglePass(const int viewport[4],const PTransform& projection,const OGTransform& modelview,GLContextData& contextData) const; // Renders the surface in a single pass using the current surface settings
 	#if 0
 	void renderGlobalAmbientHeightMap(GLuint heightColorMapTexture,GLContextData& contextData) const; // Renders the global ambient component of the surface as an illuminated height map in the current OpenGL context using the given pixel-corner elevation texture and 1D height color map
@@ -26,75 +26,67 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <algorithm>
 #include <cmath>
 
-#include <GL/gl.h>
-#include <GL/Extensions/GLARBTextureRectangle.h>
-
-#include "WaterTable2.h"
+#include "GridSource.h"
 
 /*****************************
 Methods of class TerrainQuery:
 *****************************/
 
-TerrainQuery::TerrainQuery(const WaterTable2* sWaterTable)
-	:waterTable(sWaterTable),
-	 gridWidth(0),
-	 gridHeight(0),
+TerrainQuery::TerrainQuery(unsigned int sGridWidth, unsigned int sGridHeight, const Scalar sDomainMin[3], const Scalar sDomainMax[3])
+	:gridWidth(sGridWidth),
+	 gridHeight(sGridHeight),
+	 gridSource(0),
+	 snapshot(0),
+	 bathymetryGrid(0),
+	 waterLevelGrid(0),
 	 lavaThreshold(-10.0),
 	 waterDepthThreshold(0.5),
 	 dataValid(false),
+	 dataVersion(0),
 	 updateCounter(0),
 	 updateFrequency(5)
 	{
-	if(waterTable != 0)
+	/* Copy the domain bounds */
+	for(int i = 0; i < 3; ++i)
 		{
-		/* Get grid dimensions from water table */
-		const GLsizei* size = waterTable->getSize();
-		gridWidth = size[0];
-		gridHeight = size[1];
-
-		/* Allocate CPU-side grids */
-		terrainGrid.resize(gridWidth * gridHeight, 0.0f);
-		waterGrid.resize(gridWidth * gridHeight, 0.0f);
-
-		/* Get domain bounds */
-		const WaterTable2::Box& domain = waterTable->getDomain();
-		domainMin[0] = domain.min[0];
-		domainMin[1] = domain.min[1];
-		domainMin[2] = domain.min[2];
-		domainMax[0] = domain.max[0];
-		domainMax[1] = domain.max[1];
-		domainMax[2] = domain.max[2];
-
-		std::cout << "TerrainQuery: Initialized with grid " << gridWidth << "x" << gridHeight
-		          << ", domain X[" << domainMin[0] << " to " << domainMax[0] << "]"
-		          << " Y[" << domainMin[1] << " to " << domainMax[1] << "]"
-		          << " Z[" << domainMin[2] << " to " << domainMax[2] << "]" << std::endl;
+		domainMin[i] = sDomainMin[i];
+		domainMax[i] = sDomainMax[i];
 		}
+	domainScale[0] = Scalar(1) / (domainMax[0] - domainMin[0]);
+	domainScale[1] = Scalar(1) / (domainMax[1] - domainMin[1]);
+
+	std::cout << "TerrainQuery: Initialized with grid " << gridWidth << "x" << gridHeight
+	          << ", domain X[" << domainMin[0] << " to " << domainMax[0] << "]"
+	          << " Y[" << domainMin[1] << " to " << domainMax[1] << "]"
+	          << " Z[" << domainMin[2] << " to " << domainMax[2] << "]" << std::endl;
 	}
 
 TerrainQuery::~TerrainQuery(void)
 	{
+	/* Release the held snapshot */
+	if(snapshot != 0)
+		gridSource->releaseSnapshot(snapshot);
 	}
 
-float TerrainQuery::sampleBilinear(const std::vector<float>& grid, float x, float y) const
+float TerrainQuery::sampleBilinear(const float* grid, unsigned int width, unsigned int height, float x, float y) const
 	{
 	/* Clamp coordinates to grid bounds */
-	x = std::max(0.0f, std::min(x, float(gridWidth - 1)));
-	y = std::max(0.0f, std::min(y, float(gridHeight - 1)));
+	x = std::max(0.0f, std::min(x, float(width - 1)));
+	y = std::max(0.0f, std::min(y, float(height - 1)));
 
 	/* Get integer and fractional parts */
 	int x0 = int(x);
 	int y0 = int(y);
-	int x1 = std::min(x0 + 1, int(gridWidth - 1));
-	int y1 = std::min(y0 + 1, int(gridHeight - 1));
+	int x1 = std::min(x0 + 1, int(width - 1));
+	int y1 = std::min(y0 + 1, int(height - 1));
 	float fx = x - float(x0);
 	float fy = y - float(y0);
 
 	/* Sample four corners */
-	float v00 = grid[y0 * gridWidth + x0];
-	float v10 = grid[y0 * gridWidth + x1];
-	float v01 = grid[y1 * gridWidth + x0];
-	float v11 = grid[y1 * gridWidth + x1];
+	float v00 = grid[y0 * width + x0];
+	float v10 = grid[y0 * width + x1];
+	float v01 = grid[y1 * width + x0];
+	float v11 = grid[y1 * width + x1];
 
 	/* Bilinear interpolation */
 	float v0 = v00 * (1.0f - fx) + v10 * fx;
@@ -102,63 +94,63 @@ float TerrainQuery::sampleBilinear(const std::vector<float>& grid, float x, floa
 	return v0 * (1.0f - fy) + v1 * fy;
 	}
 
-void TerrainQuery::update(GLContextData& contextData)
-	{
-	if(waterTable == 0)
-		return;
-
-	/* Throttle updates */
-	if(++updateCounter < updateFrequency)
-		return;
-	updateCounter = 0;
-
-	/* Read back bathymetry texture (terrain heights) */
-	waterTable->bindBathymetryTexture(contextData);
-	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RED, GL_FLOAT, terrainGrid.data());
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, 0);
-
-	/* Read back water quantity texture (water surface elevation in RED channel) */
-	waterTable->bindQuantityTexture(contextData);
-	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB, 0, GL_RED, GL_FLOAT, waterGrid.data());
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, 0);
-
-	dataValid = true;
-	}
-
-TerrainQuery::TerrainInfo TerrainQuery::query(Scalar worldX, Scalar worldY) const
+void TerrainQuery::update(GridSource& newGridSource)
 	{
-	TerrainInfo info;
-	info.isValid = dataValid;
-	info.type = TERRAIN_NORMAL;
-	info.waterDepth = 0.0;
+	gridSource = &newGridSource;
 
-	if(!dataValid || waterTable == 0)
+	/* Throttle update requests; the snapshot is shared with all other consumers, so a fresh one may arrive more often */
+	if(++updateCounter >= updateFrequency)
 		{
-		/* Return fallback values */
-		info.terrainHeight = (domainMin[2] + domainMax[2]) * 0.5;
-		info.waterSurfaceHeight = info.terrainHeight;
-		return info;
+		gridSource->requestSnapshot();
+		updateCounter = 0;
 		}
 
-	/* Map world coordinates to normalized [0,1] range */
-	float nx = float((worldX - domainMin[0]) / (domainMax[0] - domainMin[0]));
-	float ny = float((worldY - domainMin[1]) / (domainMax[1] - domainMin[1]));
-
-	/* Check bounds */
-	if(nx < 0.0f || nx > 1.0f || ny < 0.0f || ny > 1.0f)
+	/* Switch to the most recent snapshot if it is newer than the held one */
+	if(snapshot == 0 || gridSource->getSnapshotGeneration() != snapshot->getGeneration())
 		{
-		/* Outside domain, return edge values */
-		nx = std::max(0.0f, std::min(1.0f, nx));
-		ny = std::max(0.0f, std::min(1.0f, ny));
+		const GridSource::Snapshot* newSnapshot = gridSource->acquireSnapshot();
+		if(snapshot != 0)
+			gridSource->releaseSnapshot(snapshot);
+		snapshot = newSnapshot;
+		dataValid = snapshot != 0;
+		if(dataValid)
+			{
+			bathymetryGrid = snapshot->getBathymetry();
+			waterLevelGrid = snapshot->getWaterLevel();
+			++dataVersion;
+			}
 		}
+	}
+
+void TerrainQuery::setGrids(const float* newBathymetry, const float* newWaterLevel)
+	{
+	/* Sample the given grids from now on */
+	bathymetryGrid = newBathymetry;
+	waterLevelGrid = newWaterLevel;
+	dataValid = bathymetryGrid != 0 && waterLevelGrid != 0;
+	++dataVersion;
+	}
 
-	/* Map to grid coordinates */
-	float gx = nx * float(gridWidth - 1);
-	float gy = ny * float(gridHeight - 1);
+void TerrainQuery::sample(Scalar worldX, Scalar worldY, const float* bathymetry, const float* waterLevel, TerrainInfo& info) const
+	{
+	/* Map world coordinates to normalized [0,1] range, clamping to return edge values outside the domain */
+	float nx = float((worldX - domainMin[0]) * domainScale[0]);
+	float ny = float((worldY - domainMin[1]) * domainScale[1]);
+	nx = std::max(0.0f, std::min(1.0f, nx));
+	ny = std::max(0.0f, std::min(1.0f, ny));
+
+	/* Map to grid coordinates like WaterTable2: water cell i is centered at domain min + (i + 0.5) cells, and the vertex-centered bathymetry grid's vertex i sits at domain min + (i + 1) cells */
+	float tx = nx * float(gridWidth);
+	float ty = ny * float(gridHeight);
+	float gx = tx - 0.5f;
+	float gy = ty - 0.5f;
+	float bx = tx - 1.0f;
+	float by = ty - 1.0f;
 
 	/* Sample with bilinear interpolation */
-	info.terrainHeight = Scalar(sampleBilinear(terrainGrid, gx, gy));
-	info.waterSurfaceHeight = Scalar(sampleBilinear(waterGrid, gx, gy));
+	info.isValid = true;
+	info.terrainHeight = Scalar(sampleBilinear(bathymetry, gridWidth - 1, gridHeight - 1, bx, by));
+	info.waterSurfaceHeight = Scalar(sampleBilinear(waterLevel, gridWidth, gridHeight, gx, gy));
 
 	/* Calculate water depth (water surface is above terrain) */
 	info.waterDepth = std::max(Scalar(0.0), info.waterSurfaceHeight - info.terrainHeight);
@@ -176,10 +168,46 @@ TerrainQuery::TerrainInfo TerrainQuery::query(Scalar worldX, Scalar worldY) cons
 		{
 		info.type = TERRAIN_NORMAL;
 		}
+	}
+
+void TerrainQuery::setFallback(TerrainInfo& info) const
+	{
+	info.isValid = false;
+	info.type = TERRAIN_NORMAL;
+	info.terrainHeight = (domainMin[2] + domainMax[2]) * 0.5;
+	info.waterSurfaceHeight = info.terrainHeight;
+	info.waterDepth = 0.0;
+	}
+
+TerrainQuery::TerrainInfo TerrainQuery::query(Scalar worldX, Scalar worldY) const
+	{
+	TerrainInfo info;
+	if(!dataValid)
+		{
+		/* Return fallback values */
+		setFallback(info);
+		return info;
+		}
 
+	sample(worldX, worldY, bathymetryGrid, waterLevelGrid, info);
 	return info;
 	}
 
+void TerrainQuery::queryBatch(const Point* points, size_t numPoints, TerrainInfo* infos) const
+	{
+	if(!dataValid)
+		{
+		/* Return fallback values for the entire batch */
+		for(size_t i = 0; i < numPoints; ++i)
+			setFallback(infos[i]);
+		return;
+		}
+
+	/* Sample all points from the same snapshot so that the batch is consistent */
+	for(size_t i = 0; i < numPoints; ++i)
+		sample(points[i][0], points[i][1], bathymetryGrid, waterLevelGrid, infos[i]);
+	}
+
 void TerrainQuery::setLavaThreshold(Scalar threshold)
 	{
 	lavaThreshold = threshold;
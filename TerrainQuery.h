@@ -23,14 +23,11 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef TERRAINQUERY_INCLUDED
 #define TERRAINQUERY_INCLUDED
 
+#include <stddef.h>
 #include <vector>
-#include <GL/gl.h>
-#include <GL/GLContextData.h>
 
 #include "Types.h"
-
-/* Forward declarations */
-class WaterTable2;
+#include "GridSource.h"
 
 class TerrainQuery
 	{
@@ -57,19 +54,20 @@ class TerrainQuery
 
 	/* Elements: */
 	private:
-	const WaterTable2* waterTable;  // Water table for texture access
-
 	/* Grid dimensions */
 	unsigned int gridWidth;         // Width of cached grids
 	unsigned int gridHeight;        // Height of cached grids
 
-	/* CPU-side cached grids */
-	std::vector<float> terrainGrid; // Bathymetry (terrain heights)
-	std::vector<float> waterGrid;   // Water surface elevations
+	/* Shared CPU-side grid snapshot */
+	GridSource* gridSource;                   // Grid source owning the snapshot
+	const GridSource::Snapshot* snapshot;     // Currently held snapshot of bathymetry (terrain heights) and water surface elevations, or 0
+	const float* bathymetryGrid;              // Bathymetry grid sampled by queries, from the held snapshot or the caller
+	const float* waterLevelGrid;              // Water surface elevation grid sampled by queries, from the held snapshot or the caller
 
 	/* World coordinate bounds */
 	Scalar domainMin[3];
 	Scalar domainMax[3];
+	Scalar domainScale[2];          // Reciprocal domain extents in x and y
 
 	/* Configuration */
 	Scalar lavaThreshold;           // Elevation below which is lava
@@ -77,29 +75,43 @@ class TerrainQuery
 
 	/* State */
 	bool dataValid;                 // True after first successful update
+	unsigned int dataVersion;       // Incremented whenever queries switch to new grids
 	int updateCounter;              // Throttle updates
 	int updateFrequency;            // Update every N frames
 
 	/* Private methods */
-	float sampleBilinear(const std::vector<float>& grid, float x, float y) const;
+	float sampleBilinear(const float* grid, unsigned int width, unsigned int height, float x, float y) const;
+	void sample(Scalar worldX, Scalar worldY, const float* bathymetry, const float* waterLevel, TerrainInfo& info) const;
+	void setFallback(TerrainInfo& info) const;
 
 	public:
 
 	/* Constructors and destructors */
-	TerrainQuery(const WaterTable2* sWaterTable);
+
+	/* Create a terrain query for cell-centered grids of the given size covering the given domain, e.g., the water table's */
+	TerrainQuery(unsigned int sGridWidth, unsigned int sGridHeight, const Scalar sDomainMin[3], const Scalar sDomainMax[3]);
 	~TerrainQuery(void);
 
 	/* Methods */
 
-	/* Update cached grids from GPU textures (call each frame) */
-	void update(GLContextData& contextData);
+	/* Request and pick up updated grid snapshots from the given grid source, e.g., the grid read-back service (call each frame) */
+	void update(GridSource& gridSource);
+
+	/* Query terrain from caller-owned grids instead of grid source snapshots, e.g., in offline tools; the grids must outlive the terrain query */
+	void setGrids(const float* newBathymetry, const float* newWaterLevel);
 
 	/* Query terrain at world coordinates */
 	TerrainInfo query(Scalar worldX, Scalar worldY) const;
 
+	/* Query terrain at the x and y coordinates of a batch of world points; all results are taken from the same snapshot */
+	void queryBatch(const Point* points, size_t numPoints, TerrainInfo* infos) const;
+
 	/* Check if data is available */
 	bool isDataValid(void) const { return dataValid; }
 
+	/* Get the version of the grids sampled by queries, to detect when derived data needs to be rebuilt */
+	unsigned int getDataVersion(void) const { return dataVersion; }
+
 	/* Configuration */
 	void setLavaThreshold(Scalar threshold);
 	void setWaterDepthThreshold(Scalar threshold);
@@ -36,4 +36,97 @@ typedef Geometry::Plane<Scalar,3> Plane; // Type for 3D affine planes
 typedef Geometry::OrthogonalTransformation<Scalar,3> OGTransform; // Type for 3D scaled rigid body transformations
 typedef Geometry::ProjectiveTransformation<Scalar,3> PTransform; // Type for 3D projective transformations (4x4 matrices)
 
+struct PixelRect // Structure for half-open axis-aligned rectangles of image pixels or grid cells
+	{
+	/* Elements: */
+	public:
+	int min[2],max[2]; // Inclusive lower and exclusive upper pixel indices; rectangle is empty if min>=max in either dimension
+	
+	/* Constructors and destructors: */
+	PixelRect(void) // Creates an empty rectangle
+		{
+		for(int i=0;i<2;++i)
+			{
+			min[i]=0;
+			max[i]=0;
+			}
+		}
+	PixelRect(int min0,int min1,int max0,int max1) // Creates a rectangle from the given pixel index ranges
+		{
+		min[0]=min0;
+		min[1]=min1;
+		max[0]=max0;
+		max[1]=max1;
+		}
+	
+	/* Methods: */
+	bool isEmpty(void) const // Returns true if the rectangle contains no pixels
+		{
+		return min[0]>=max[0]||min[1]>=max[1];
+		}
+	PixelRect& addPixel(int x,int y) // Extends the rectangle to contain the given pixel
+		{
+		if(isEmpty())
+			{
+			min[0]=x;
+			min[1]=y;
+			max[0]=x+1;
+			max[1]=y+1;
+			}
+		else
+			{
+			if(min[0]>x)
+				min[0]=x;
+			if(max[0]<=x)
+				max[0]=x+1;
+			if(min[1]>y)
+				min[1]=y;
+			if(max[1]<=y)
+				max[1]=y+1;
+			}
+		return *this;
+		}
+	PixelRect& addRect(const PixelRect& other) // Extends the rectangle to contain the given rectangle
+		{
+		if(!other.isEmpty())
+			{
+			if(isEmpty())
+				*this=other;
+			else
+				{
+				for(int i=0;i<2;++i)
+					{
+					if(min[i]>other.min[i])
+						min[i]=other.min[i];
+					if(max[i]<other.max[i])
+						max[i]=other.max[i];
+					}
+				}
+			}
+		return *this;
+		}
+	PixelRect& expand(int border) // Grows a non-empty rectangle by the given number of pixels on all sides
+		{
+		if(!isEmpty())
+			for(int i=0;i<2;++i)
+				{
+				min[i]-=border;
+				max[i]+=border;
+				}
+		return *this;
+		}
+	PixelRect& clamp(int width,int height) // Intersects the rectangle with the image of the given size
+		{
+		if(min[0]<0)
+			min[0]=0;
+		if(max[0]>width)
+			max[0]=width;
+		if(min[1]<0)
+			min[1]=0;
+		if(max[1]>height)
+			max[1]=height;
+		return *this;
+		}
+	};
+
 #endif
@@ -0,0 +1,192 @@
+/***********************************************************************
+ValidPixelProperty - Functor class to identify pixels in raw depth
+frames that lie between two planes in depth image space, using per-pixel
+lookup tables of the depth-independent terms of the plane equations and
+of the homography into the color image.
+Copyright (c) 2012-2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#ifndef VALIDPIXELPROPERTY_INCLUDED
+#define VALIDPIXELPROPERTY_INCLUDED
+
+#include <Math/Math.h>
+#include <Geometry/Matrix.h>
+
+class ValidPixelProperty // Functor class to identify valid pixels in raw depth frames
+	{
+	/* Embedded classes: */
+	private:
+	struct PlaneTerms // Structure holding the depth-independent terms of a pixel's plane equations
+		{
+		/* Elements: */
+		public:
+		float minD,maxD; // x and y terms of the min and max plane equations at the pixel's center
+		};
+	
+	struct ColorTerms // Structure holding the depth-independent terms of a pixel's color homography
+		{
+		/* Elements: */
+		public:
+		float color[3]; // x and y terms of the homogeneous color image position of the pixel's center
+		};
+	
+	/* Elements: */
+	float minPlane[4]; // Plane equation of the lower bound of valid depth values in depth image space
+	float maxPlane[4]; // Plane equation of the upper bound of valid depth values in depth image space
+	Geometry::Matrix<float,3,4> colorDepthHomography; // Homography from 3D depth image space into 2D color image space
+	unsigned int depthSize[2]; // Width and height of depth frames
+	unsigned int colorSize[2]; // Width and height of color frames
+	PlaneTerms* planeTerms; // Per-pixel lookup table of the plane equations' depth-independent terms
+	ColorTerms* colorTerms; // Per-pixel lookup table of the color homography's depth-independent terms
+	const unsigned char* colorFrame; // The current color frame
+	
+	/* Constructors and destructors: */
+	public:
+	ValidPixelProperty(const float sMinPlane[4],const float sMaxPlane[4],const Geometry::Matrix<float,3,4>& sColorDepthHomography,const unsigned int sDepthSize[2],const unsigned int sColorSize[2])
+		:planeTerms(0),colorTerms(0),
+		 colorFrame(0)
+		{
+		/* Copy the min and max plane equations: */
+		for(int i=0;i<4;++i)
+			minPlane[i]=sMinPlane[i];
+		for(int i=0;i<4;++i)
+			maxPlane[i]=sMaxPlane[i];
+		
+		/* Copy the depth and color image sizes: */
+		for(int i=0;i<2;++i)
+			depthSize[i]=sDepthSize[i];
+		for(int i=0;i<2;++i)
+			colorSize[i]=sColorSize[i];
+		
+		/* Evaluate the plane equations' x and y terms at all pixel centers in the same order as the full plane equations, so that adding the depth and constant terms later gives identical results: */
+		planeTerms=new PlaneTerms[depthSize[1]*depthSize[0]];
+		PlaneTerms* ptPtr=planeTerms;
+		for(unsigned int y=0;y<depthSize[1];++y)
+			{
+			float py=float(y)+0.5f;
+			for(unsigned int x=0;x<depthSize[0];++x,++ptPtr)
+				{
+				float px=float(x)+0.5f;
+				ptPtr->minD=minPlane[0]*px+minPlane[1]*py;
+				ptPtr->maxD=maxPlane[0]*px+maxPlane[1]*py;
+				}
+			}
+		
+		/* Evaluate the color homography's x and y terms: */
+		colorTerms=new ColorTerms[depthSize[1]*depthSize[0]];
+		setColorDepthHomography(sColorDepthHomography);
+		}
+	private:
+	ValidPixelProperty(const ValidPixelProperty& source); // Prohibit copy constructor
+	ValidPixelProperty& operator=(const ValidPixelProperty& source); // Prohibit assignment operator
+	public:
+	~ValidPixelProperty(void)
+		{
+		delete[] planeTerms;
+		delete[] colorTerms;
+		}
+	
+	/* Methods: */
+	void setColorDepthHomography(const Geometry::Matrix<float,3,4>& newColorDepthHomography) // Sets a new homography from depth image space to color image space and rebuilds its lookup table
+		{
+		colorDepthHomography=newColorDepthHomography;
+		
+		/* Evaluate the homography's x and y terms at all pixel centers: */
+		ColorTerms* ctPtr=colorTerms;
+		for(unsigned int y=0;y<depthSize[1];++y)
+			{
+			float py=float(y)+0.5f;
+			for(unsigned int x=0;x<depthSize[0];++x,++ctPtr)
+				{
+				float px=float(x)+0.5f;
+				for(int i=0;i<3;++i)
+					ctPtr->color[i]=colorDepthHomography(i,0)*px+colorDepthHomography(i,1)*py;
+				}
+			}
+		}
+	void setColorFrame(const unsigned char* newColorFrame) // Sets the color frame for the next blob extraction
+		{
+		colorFrame=newColorFrame;
+		}
+	bool isBetweenPlanes(unsigned int x,unsigned int y,float pz) const // Returns true if the given pixel at the given depth lies between the min and max planes
+		{
+		/* Add the pixel's depth and the constant terms to the plane equations' precomputed terms: */
+		const PlaneTerms& pt=planeTerms[y*depthSize[0]+x];
+		float minD=pt.minD+minPlane[2]*pz+minPlane[3];
+		float maxD=pt.maxD+maxPlane[2]*pz+maxPlane[3];
+		return !(minD<0.0f||maxD>0.0f);
+		}
+	bool projectToColor(unsigned int x,unsigned int y,float pz,int& cx,int& cy) const // Projects the given pixel at the given depth into the color frame; returns false if it falls outside
+		{
+		/* Add the pixel's depth and the constant terms to the homography's precomputed terms: */
+		const ColorTerms& ct=colorTerms[y*depthSize[0]+x];
+		float cw=ct.color[2]+colorDepthHomography(2,2)*pz+colorDepthHomography(2,3);
+		cx=int(Math::floor((ct.color[0]+colorDepthHomography(0,2)*pz+colorDepthHomography(0,3))/cw));
+		cy=int(Math::floor((ct.color[1]+colorDepthHomography(1,2)*pz+colorDepthHomography(1,3))/cw));
+		return cx>=0&&cx<int(colorSize[0])&&cy>=0&&cy<int(colorSize[1]);
+		}
+	bool operator()(unsigned int x,unsigned int y,const unsigned short& pixel) const
+		{
+		return operator()(x,y,float(pixel));
+		}
+	bool operator()(unsigned int x,unsigned int y,const float& pixel) const
+		{
+		/* Check the pixel against the plane equations: */
+		if(!isBetweenPlanes(x,y,pixel))
+			return false;
+		
+		#if 0
+		
+		/* Project the pixel into the color frame: */
+		int cx,cy;
+		if(!projectToColor(x,y,pixel,cx,cy))
+			return false;
+		
+		#if 0
+		
+		/* Check if the pixel is mostly black-ish: */
+		const unsigned char* rgb=colorFrame+((cy*colorSize[0]+cx)*3);
+		return rgb[0]<64U&&rgb[1]<64U&&rgb[2]<64U;
+		
+		#else
+		
+		/* Normalize the pixel's color: */
+		const unsigned char* rgb=colorFrame+((cy*colorSize[0]+cx)*3);
+		unsigned char max=rgb[0];
+		for(int i=1;i<3;++i)
+			if(max<rgb[i])
+				max=rgb[i];
+		float rgb0[3];
+		for(int i=0;i<3;++i)
+			rgb0[i]=float(rgb[i])/float(max);
+		
+		/* Check if the color is red-ish: */
+		return rgb0[0]>=0.8f&&rgb0[1]<0.25f&&rgb0[2]<0.25f;
+		
+		#endif
+		
+		#else
+		
+		return true;
+		
+		#endif
+		}
+	};
+
+#endif
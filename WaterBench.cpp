@@ -0,0 +1,589 @@
+/***********************************************************************
+WaterBench - Utility to benchmark the water flow simulation on recorded
+or synthetic bathymetry using the offline water table interface.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <iomanip>
+#include <Math/Math.h>
+#include <Math/Constants.h>
+#include <GL/gl.h>
+#include <GL/GLContextData.h>
+#include <GL/Extensions/GLARBTextureRectangle.h>
+#include <Vrui/Vrui.h>
+#include <Vrui/Application.h>
+
+#include "WaterTable2.h"
+#include "DEM.h"
+#include "PerformanceProfiler.h"
+
+class WaterBench:public Vrui::Application
+	{
+	/* Embedded classes: */
+	private:
+	enum Scenario // Enumerated type for benchmark scenarios
+		{
+		DAM_BREAK, // A reservoir of still water in one quarter of the domain released at time zero
+		RAIN_FLOOD // Uniform rain falling onto initially dry bathymetry
+		};
+	
+	struct CaseResult // Structure for the results of running the scenario on one grid size
+		{
+		/* Elements: */
+		public:
+		GLsizei size[2]; // Water table size
+		bool halfIntermediates; // Flag whether the water table stores temporal derivatives and maximum step sizes in 16-bit floats
+		bool reference; // Flag whether this case's final water columns are the reference for validating the next case
+		unsigned int numSteps; // Number of simulation steps taken
+		double simulatedTime; // Total simulated time in s
+		double wallTime; // Total wall-clock time in s, including waiting for the GPU to finish
+		double passTimes[4]; // Average GPU times of the derivative, integration, water adding, and tile activity passes in ms, or negative if not measured
+		double conservationError; // Relative difference between the final water volume and the initial water volume plus the added rain
+		double maxDepthError; // Largest difference between this case's final water columns and those of the preceding reference case, or negative if not validated
+		};
+	
+	/* Elements: */
+	Scenario scenario; // The benchmark scenario
+	double targetTime; // Simulated time to run for each grid size
+	unsigned int maxSteps; // Maximum number of simulation steps for each grid size
+	GLfloat cellSize[2]; // Water table cell size
+	GLfloat rainRate; // Water column height added per second in the rain flood scenario
+	GLfloat damDepth; // Height of the dam-break reservoir's water surface above the highest bathymetry vertex
+	bool fusedIntegration; // Flag whether to use fused Runge-Kutta integration
+	GLsizei tileSize; // Water table tile size, or 0 to simulate the full grid
+	unsigned int readbackLatency; // Latency of maximum step size readback in frames, where every simulation step is benchmarked as its own frame
+	bool halfIntermediates; // Flag whether to store temporal derivatives and maximum step sizes in 16-bit floats
+	bool validate; // Flag whether to validate reduced-precision storage against a full-precision run of each grid size
+	DEM* dem; // An optional DEM providing the bathymetry, or NULL for synthetic bathymetry
+	GLfloat demScale; // Scale factor from DEM elevations to simulation elevations
+	mutable std::vector<CaseResult> cases; // Grid sizes to benchmark and their results
+	unsigned int currentCase; // Index of the grid size currently being benchmarked
+	WaterTable2* waterTable; // Water table for the current grid size
+	PerformanceProfiler* profiler; // Profiler measuring the water table's passes for the current grid size
+	std::vector<GLfloat> bathymetry; // Vertex-centered bathymetry grid for the current grid size
+	std::vector<GLfloat> waterLevel; // Initial cell-centered water surface elevations for the current grid size
+	mutable std::vector<GLfloat> referenceDepths; // Final water columns of the most recent reference case
+	mutable bool caseDone; // Flag whether the current grid size has been benchmarked
+	
+	/* Private methods: */
+	void createBathymetry(const GLsizei size[2]); // Creates the bathymetry grid for the given water table size
+	void startCase(void); // Creates the water table and initial conditions for the current grid size
+	double calcWaterVolume(GLContextData& contextData,std::vector<GLfloat>* depths) const; // Reads back the current water table and returns its total water volume; stores the water columns of all cells in the given vector if it is not NULL
+	void printResults(void) const; // Prints the results of all benchmarked grid sizes
+	
+	/* Constructors and destructors: */
+	public:
+	WaterBench(int& argc,char**& argv);
+	virtual ~WaterBench(void);
+	
+	/* Methods from Vrui::Application: */
+	virtual void frame(void);
+	virtual void display(GLContextData& contextData) const;
+	};
+
+/***************************
+Methods of class WaterBench:
+***************************/
+
+void WaterBench::createBathymetry(const GLsizei size[2])
+	{
+	/* The bathymetry grid has one vertex less than the water table in each direction: */
+	GLsizei bSize[2]={size[0]-1,size[1]-1};
+	bathymetry.resize(size_t(bSize[1])*size_t(bSize[0]));
+	
+	GLfloat* bPtr=&bathymetry[0];
+	if(dem!=0)
+		{
+		/* Resample the DEM to the bathymetry grid: */
+		const int* demSize=dem->getDemSize();
+		const float* demGrid=dem->getDemGrid();
+		float demMin=demGrid[0];
+		for(int i=1;i<demSize[1]*demSize[0];++i)
+			if(demMin>demGrid[i])
+				demMin=demGrid[i];
+		for(GLsizei y=0;y<bSize[1];++y)
+			{
+			double dy=bSize[1]>1?double(y)*double(demSize[1]-1)/double(bSize[1]-1):0.0;
+			int y0=Math::min(int(dy),demSize[1]-2);
+			double wy=dy-double(y0);
+			for(GLsizei x=0;x<bSize[0];++x,++bPtr)
+				{
+				double dx=bSize[0]>1?double(x)*double(demSize[0]-1)/double(bSize[0]-1):0.0;
+				int x0=Math::min(int(dx),demSize[0]-2);
+				double wx=dx-double(x0);
+				
+				/* Interpolate bilinearly between the four surrounding DEM postings: */
+				const float* dPtr=demGrid+(y0*demSize[0]+x0);
+				double e0=double(dPtr[0])*(1.0-wx)+double(dPtr[1])*wx;
+				double e1=double(dPtr[demSize[0]])*(1.0-wx)+double(dPtr[demSize[0]+1])*wx;
+				*bPtr=GLfloat((e0*(1.0-wy)+e1*wy-double(demMin))*double(demScale));
+				}
+			}
+		}
+	else
+		{
+		/* Create a basin with gentle ripples that keeps all water inside the domain: */
+		double extent=Math::min(double(bSize[0])*double(cellSize[0]),double(bSize[1])*double(cellSize[1]));
+		for(GLsizei y=0;y<bSize[1];++y)
+			{
+			double fy=double(y)/double(bSize[1]-1);
+			for(GLsizei x=0;x<bSize[0];++x,++bPtr)
+				{
+				double fx=double(x)/double(bSize[0]-1);
+				double basin=1.0-Math::sin(Math::Constants<double>::pi*fx)*Math::sin(Math::Constants<double>::pi*fy);
+				double ripples=Math::cos(6.0*Math::Constants<double>::pi*fx)*Math::cos(4.0*Math::Constants<double>::pi*fy);
+				*bPtr=GLfloat(extent*(0.05*basin+0.005*ripples));
+				}
+			}
+		}
+	}
+
+void WaterBench::startCase(void)
+	{
+	CaseResult& c=cases[currentCase];
+	
+	/* Create the bathymetry and find its elevation range: */
+	createBathymetry(c.size);
+	GLfloat bMin=bathymetry[0];
+	GLfloat bMax=bathymetry[0];
+	for(std::vector<GLfloat>::iterator bIt=bathymetry.begin();bIt!=bathymetry.end();++bIt)
+		{
+		if(bMin>*bIt)
+			bMin=*bIt;
+		if(bMax<*bIt)
+			bMax=*bIt;
+		}
+	
+	/* Create the initial water surface: */
+	waterLevel.resize(size_t(c.size[1])*size_t(c.size[0]));
+	GLfloat* wPtr=&waterLevel[0];
+	for(GLsizei y=0;y<c.size[1];++y)
+		for(GLsizei x=0;x<c.size[0];++x,++wPtr)
+			{
+			/* Surface elevations below the bathymetry are adapted to dry cells: */
+			if(scenario==DAM_BREAK&&x<c.size[0]/4)
+				*wPtr=bMax+damDepth;
+			else
+				*wPtr=bMin;
+			}
+	
+	/* Create a profiler and a water table for the new grid size: */
+	profiler=new PerformanceProfiler;
+	waterTable=new WaterTable2(c.size[0],c.size[1],cellSize);
+	waterTable->setElevationRange(bMin,bMax+damDepth+GLfloat(targetTime)*rainRate);
+	waterTable->setDryBoundary(false);
+	waterTable->setWaterDeposit(scenario==RAIN_FLOOD?rainRate:0.0f);
+	waterTable->setFusedIntegration(fusedIntegration);
+	waterTable->setTileSize(tileSize,0.01f);
+	waterTable->setStepSizeReadback(readbackLatency,0.5f);
+	waterTable->setHalfPrecision(c.halfIntermediates);
+	waterTable->setProfiler(profiler);
+	
+	caseDone=false;
+	}
+
+double WaterBench::calcWaterVolume(GLContextData& contextData,std::vector<GLfloat>* depths) const
+	{
+	const GLsizei* size=waterTable->getSize();
+	GLsizei bSize[2]={size[0]-1,size[1]-1};
+	
+	/* Read back the bathymetry and water surface grids: */
+	std::vector<GLfloat> b(size_t(bSize[1])*size_t(bSize[0]));
+	std::vector<GLfloat> w(size_t(size[1])*size_t(size[0]));
+	glPixelStorei(GL_PACK_ALIGNMENT,1);
+	waterTable->bindBathymetryTexture(contextData);
+	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,&b[0]);
+	waterTable->bindQuantityTexture(contextData);
+	glGetTexImage(GL_TEXTURE_RECTANGLE_ARB,0,GL_RED,GL_FLOAT,&w[0]);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Sum the water columns above the cell-centered bathymetry the same way the simulation shaders sample it: */
+	if(depths!=0)
+		depths->assign(w.size(),0.0f);
+	double volume=0.0;
+	for(GLsizei y=0;y<size[1];++y)
+		{
+		GLsizei y0=Math::max(y-1,0);
+		GLsizei y1=Math::min(y,bSize[1]-1);
+		for(GLsizei x=0;x<size[0];++x)
+			{
+			GLsizei x0=Math::max(x-1,0);
+			GLsizei x1=Math::min(x,bSize[0]-1);
+			double cb=(double(b[y0*bSize[0]+x0])+double(b[y0*bSize[0]+x1])+double(b[y1*bSize[0]+x0])+double(b[y1*bSize[0]+x1]))*0.25;
+			double h=double(w[y*size[0]+x])-cb;
+			if(h>0.0)
+				{
+				volume+=h;
+				if(depths!=0)
+					(*depths)[y*size[0]+x]=GLfloat(h);
+				}
+			}
+		}
+	
+	return volume*double(cellSize[0])*double(cellSize[1]);
+	}
+
+void WaterBench::printResults(void) const
+	{
+	std::cout<<"Scenario "<<(scenario==DAM_BREAK?"dam break":"rain flood")<<", "<<targetTime<<" s simulated time"<<(dem!=0?" on DEM bathymetry":" on synthetic bathymetry")<<std::endl;
+	std::cout<<"       Grid  Storage    Steps   Steps/s  ms/step   Deriv.   Integ.  Sources    Tiles  Cons. error  Depth error"<<std::endl;
+	std::cout<<std::fixed;
+	for(std::vector<CaseResult>::const_iterator cIt=cases.begin();cIt!=cases.end();++cIt)
+		{
+		std::cout<<std::setw(6)<<cIt->size[0]<<'x'<<std::left<<std::setw(4)<<cIt->size[1]<<std::right;
+		std::cout<<' '<<std::setw(8)<<(cIt->halfIntermediates?"half":"full");
+		std::cout<<' '<<std::setw(8)<<cIt->numSteps;
+		std::cout<<' '<<std::setw(9)<<std::setprecision(1)<<double(cIt->numSteps)/cIt->wallTime;
+		std::cout<<' '<<std::setw(8)<<std::setprecision(3)<<cIt->wallTime*1000.0/double(cIt->numSteps);
+		for(int i=0;i<4;++i)
+			{
+			if(cIt->passTimes[i]>=0.0)
+				std::cout<<' '<<std::setw(8)<<std::setprecision(3)<<cIt->passTimes[i];
+			else
+				std::cout<<"        -";
+			}
+		std::cout<<' '<<std::setw(12)<<std::scientific<<std::setprecision(3)<<cIt->conservationError<<std::fixed;
+		if(cIt->maxDepthError>=0.0)
+			std::cout<<' '<<std::setw(12)<<std::scientific<<std::setprecision(3)<<cIt->maxDepthError<<std::fixed;
+		else
+			std::cout<<"            -";
+		if(cIt->simulatedTime<targetTime)
+			std::cout<<" (stopped at "<<std::setprecision(3)<<cIt->simulatedTime<<" s)";
+		std::cout<<std::endl;
+		}
+	}
+
+namespace {
+
+/****************
+Helper functions:
+****************/
+
+void printUsage(void)
+	{
+	std::cout<<"Usage: SARndboxWaterBench [option 1] ... [option n]"<<std::endl;
+	std::cout<<"  Options:"<<std::endl;
+	std::cout<<"  -h"<<std::endl;
+	std::cout<<"     Prints this help message"<<std::endl;
+	std::cout<<"  -size <width> <height>"<<std::endl;
+	std::cout<<"     Adds a water table size to benchmark; can be given multiple times"<<std::endl;
+	std::cout<<"     Default: 160 120, 320 240, 640 480"<<std::endl;
+	std::cout<<"  -cellSize <cell size>"<<std::endl;
+	std::cout<<"     Sets the width and height of water table cells"<<std::endl;
+	std::cout<<"     Default: 1.0"<<std::endl;
+	std::cout<<"  -dem <DEM file name>"<<std::endl;
+	std::cout<<"     Resamples the given DEM to the bathymetry grid instead of creating a"<<std::endl;
+	std::cout<<"     synthetic basin"<<std::endl;
+	std::cout<<"  -demScale <scale factor>"<<std::endl;
+	std::cout<<"     Scales DEM elevations relative to the DEM's lowest posting"<<std::endl;
+	std::cout<<"     Default: 1.0"<<std::endl;
+	std::cout<<"  -damBreak [<reservoir depth>]"<<std::endl;
+	std::cout<<"     Releases a reservoir filling the left quarter of the domain to the"<<std::endl;
+	std::cout<<"     given depth above the highest bathymetry point (default scenario)"<<std::endl;
+	std::cout<<"     Default reservoir depth: 10.0"<<std::endl;
+	std::cout<<"  -rainFlood [<rain rate>]"<<std::endl;
+	std::cout<<"     Rains onto the dry bathymetry at the given water height per second"<<std::endl;
+	std::cout<<"     Default rain rate: 0.5"<<std::endl;
+	std::cout<<"  -time <simulated time>"<<std::endl;
+	std::cout<<"     Sets the simulated time to run for each water table size in seconds"<<std::endl;
+	std::cout<<"     Default: 10.0"<<std::endl;
+	std::cout<<"  -maxSteps <maximum number of steps>"<<std::endl;
+	std::cout<<"     Stops each water table size after the given number of steps"<<std::endl;
+	std::cout<<"     Default: 100000"<<std::endl;
+	std::cout<<"  -fused"<<std::endl;
+	std::cout<<"     Uses fused Runge-Kutta integration"<<std::endl;
+	std::cout<<"  -tileSize <tile size>"<<std::endl;
+	std::cout<<"     Skips dry tiles of the given size"<<std::endl;
+	std::cout<<"     Default: 0 (simulate the full grid)"<<std::endl;
+	std::cout<<"  -readbackLatency <number of frames>"<<std::endl;
+	std::cout<<"     Reads back maximum step sizes asynchronously with the given latency,"<<std::endl;
+	std::cout<<"     treating every simulation step as its own frame"<<std::endl;
+	std::cout<<"     Default: 0 (blocking readback)"<<std::endl;
+	std::cout<<"  -halfIntermediates"<<std::endl;
+	std::cout<<"     Stores temporal derivatives and maximum step sizes in 16-bit floats"<<std::endl;
+	std::cout<<"  -validate"<<std::endl;
+	std::cout<<"     Runs each water table size at full precision first, and reports the"<<std::endl;
+	std::cout<<"     largest final water column difference of the reduced-precision run"<<std::endl;
+	}
+
+}
+
+WaterBench::WaterBench(int& argc,char**& argv)
+	:Vrui::Application(argc,argv),
+	 scenario(DAM_BREAK),targetTime(10.0),maxSteps(100000),
+	 rainRate(0.5f),damDepth(10.0f),
+	 fusedIntegration(false),tileSize(0),readbackLatency(0),
+	 halfIntermediates(false),validate(false),
+	 dem(0),demScale(1.0f),
+	 currentCase(0),waterTable(0),profiler(0),
+	 caseDone(false)
+	{
+	/* Parse the command line: */
+	cellSize[0]=cellSize[1]=1.0f;
+	const char* demFileName=0;
+	bool printHelp=false;
+	for(int i=1;i<argc;++i)
+		{
+		if(argv[i][0]=='-')
+			{
+			if(strcasecmp(argv[i]+1,"h")==0)
+				printHelp=true;
+			else if(strcasecmp(argv[i]+1,"size")==0&&i+2<argc)
+				{
+				CaseResult c;
+				for(int j=0;j<2;++j)
+					c.size[j]=GLsizei(atoi(argv[i+1+j]));
+				i+=2;
+				if(c.size[0]<3||c.size[1]<3)
+					throw std::runtime_error("SARndboxWaterBench: Water table sizes must be at least 3x3");
+				cases.push_back(c);
+				}
+			else if(strcasecmp(argv[i]+1,"cellSize")==0&&i+1<argc)
+				{
+				++i;
+				cellSize[0]=cellSize[1]=GLfloat(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"dem")==0&&i+1<argc)
+				{
+				++i;
+				demFileName=argv[i];
+				}
+			else if(strcasecmp(argv[i]+1,"demScale")==0&&i+1<argc)
+				{
+				++i;
+				demScale=GLfloat(atof(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"damBreak")==0)
+				{
+				scenario=DAM_BREAK;
+				if(i+1<argc&&argv[i+1][0]!='-')
+					{
+					++i;
+					damDepth=GLfloat(atof(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"rainFlood")==0)
+				{
+				scenario=RAIN_FLOOD;
+				if(i+1<argc&&argv[i+1][0]!='-')
+					{
+					++i;
+					rainRate=GLfloat(atof(argv[i]));
+					}
+				}
+			else if(strcasecmp(argv[i]+1,"time")==0&&i+1<argc)
+				{
+				++i;
+				targetTime=atof(argv[i]);
+				}
+			else if(strcasecmp(argv[i]+1,"maxSteps")==0&&i+1<argc)
+				{
+				++i;
+				maxSteps=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"fused")==0)
+				fusedIntegration=true;
+			else if(strcasecmp(argv[i]+1,"tileSize")==0&&i+1<argc)
+				{
+				++i;
+				tileSize=GLsizei(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"readbackLatency")==0&&i+1<argc)
+				{
+				++i;
+				readbackLatency=(unsigned int)(atoi(argv[i]));
+				}
+			else if(strcasecmp(argv[i]+1,"halfIntermediates")==0)
+				halfIntermediates=true;
+			else if(strcasecmp(argv[i]+1,"validate")==0)
+				validate=true;
+			else
+				std::cerr<<"Ignoring unrecognized command line switch "<<argv[i]<<std::endl;
+			}
+		else
+			std::cerr<<"Ignoring command line argument "<<argv[i]<<std::endl;
+		}
+	
+	/* Print usage help if requested: */
+	if(printHelp)
+		printUsage();
+	
+	/* Benchmark the default grid sizes if none were requested: */
+	if(cases.empty())
+		{
+		static const GLsizei defaultSizes[3][2]={{160,120},{320,240},{640,480}};
+		for(int i=0;i<3;++i)
+			{
+			CaseResult c;
+			for(int j=0;j<2;++j)
+				c.size[j]=defaultSizes[i][j];
+			cases.push_back(c);
+			}
+		}
+	
+	/* Set up the storage precision of all grid sizes, preceding each by a full-precision reference run if requested: */
+	std::vector<CaseResult> sizeCases;
+	std::swap(sizeCases,cases);
+	for(std::vector<CaseResult>::iterator scIt=sizeCases.begin();scIt!=sizeCases.end();++scIt)
+		{
+		scIt->maxDepthError=-1.0;
+		if(validate)
+			{
+			scIt->halfIntermediates=false;
+			scIt->reference=true;
+			cases.push_back(*scIt);
+			}
+		scIt->halfIntermediates=halfIntermediates;
+		scIt->reference=false;
+		cases.push_back(*scIt);
+		}
+	
+	if(demFileName!=0)
+		{
+		/* Load the bathymetry DEM: */
+		dem=new DEM;
+		dem->load(demFileName);
+		if(dem->getDemGrid()==0)
+			throw std::runtime_error("SARndboxWaterBench: DEM must be a grid file, not a tiled DEM file");
+		if(dem->getDemSize()[0]<2||dem->getDemSize()[1]<2)
+			throw std::runtime_error("SARndboxWaterBench: DEM must have at least 2x2 postings");
+		}
+	
+	/* Prepare the first grid size: */
+	startCase();
+	}
+
+WaterBench::~WaterBench(void)
+	{
+	delete waterTable;
+	delete profiler;
+	delete dem;
+	}
+
+void WaterBench::frame(void)
+	{
+	if(caseDone)
+		{
+		/* Release the finished grid size's water table: */
+		delete waterTable;
+		waterTable=0;
+		delete profiler;
+		profiler=0;
+		
+		if(++currentCase<cases.size())
+			{
+			/* Prepare the next grid size; its water table will be initialized before the next display call: */
+			startCase();
+			}
+		else
+			{
+			/* Report the results and exit: */
+			printResults();
+			Vrui::shutdown();
+			return;
+			}
+		}
+	
+	/* Keep the display loop running: */
+	Vrui::requestUpdate();
+	}
+
+void WaterBench::display(GLContextData& contextData) const
+	{
+	/* Bail out if the current grid size was already benchmarked, i.e., in a second window: */
+	if(caseDone||waterTable==0)
+		return;
+	
+	CaseResult& c=cases[currentCase];
+	
+	/* Upload the initial conditions and measure the initial water volume: */
+	waterTable->updateBathymetry(&bathymetry[0],contextData);
+	waterTable->setWaterLevel(&waterLevel[0],contextData);
+	double initialVolume=calcWaterVolume(contextData,0);
+	glFinish();
+	
+	/* Run the scenario: */
+	c.numSteps=0;
+	c.simulatedTime=0.0;
+	double startTime=PerformanceProfiler::getTime();
+	while(c.simulatedTime<targetTime&&c.numSteps<maxSteps)
+		{
+		waterTable->startFrame();
+		waterTable->setMaxStepSize(GLfloat(targetTime-c.simulatedTime));
+		GLfloat stepSize=waterTable->runSimulationStep(false,contextData);
+		++c.numSteps;
+		
+		/* Stop if the simulation stalls: */
+		if(stepSize<=1.0e-8f)
+			break;
+		c.simulatedTime+=double(stepSize);
+		
+		/* Collect finished GPU pass measurements without waiting: */
+		profiler->processGpuResults(contextData);
+		}
+	glFinish();
+	c.wallTime=PerformanceProfiler::getTime()-startTime;
+	profiler->processGpuResults(contextData);
+	
+	/* Retrieve the average times of the water table's passes, which were registered in order: */
+	for(unsigned int i=0;i<4;++i)
+		{
+		PerformanceProfiler::StageStats stats=profiler->getStageStats(i);
+		c.passTimes[i]=stats.numSamples>0?stats.average:-1.0;
+		}
+	
+	/* Compare the final water volume against the initial volume plus all rain: */
+	double expectedVolume=initialVolume;
+	if(scenario==RAIN_FLOOD)
+		{
+		const GLsizei* size=waterTable->getSize();
+		expectedVolume+=double(rainRate)*c.simulatedTime*double(size[0])*double(cellSize[0])*double(size[1])*double(cellSize[1]);
+		}
+	std::vector<GLfloat> finalDepths;
+	double finalVolume=calcWaterVolume(contextData,&finalDepths);
+	c.conservationError=expectedVolume>0.0?(finalVolume-expectedVolume)/expectedVolume:0.0;
+	
+	if(c.reference)
+		{
+		/* Keep the final water columns to validate the next case: */
+		std::swap(referenceDepths,finalDepths);
+		}
+	else if(validate)
+		{
+		/* Compare the final water columns against the preceding reference case: */
+		c.maxDepthError=0.0;
+		for(size_t i=0;i<finalDepths.size();++i)
+			c.maxDepthError=Math::max(c.maxDepthError,Math::abs(double(finalDepths[i])-double(referenceDepths[i])));
+		}
+	
+	caseDone=true;
+	}
+
+/*************
+Main function:
+*************/
+
+VRUI_APPLICATION_RUN(WaterBench)
@@ -33,10 +33,13 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <GL/Extensions/GLARBDrawBuffers.h>
 #include <GL/Extensions/GLARBFragmentShader.h>
 #include <GL/Extensions/GLARBMultitexture.h>
+#include <GL/Extensions/GLARBPixelBufferObject.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBSync.h>
 #include <GL/Extensions/GLARBTextureFloat.h>
 #include <GL/Extensions/GLARBTextureRectangle.h>
 #include <GL/Extensions/GLARBTextureRg.h>
+#include <GL/Extensions/GLARBVertexBufferObject.h>
 #include <GL/Extensions/GLARBVertexShader.h>
 #include <GL/Extensions/GLEXTFramebufferObject.h>
 #include <GL/GLContextData.h>
@@ -44,6 +47,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "DepthImageRenderer.h"
 #include "ShaderHelper.h"
+#include "PerformanceProfiler.h"
 
 // DEBUGGING
 // #include <iostream>
@@ -73,6 +77,14 @@ GLfloat* makeBuffer(int width,int height,int numComponents,...)
 	return buffer;
 	}
 
+GLhandleARB compileDerivativeFunctions(void)
+	{
+	/* Compile the temporal derivative shader without its main function, to be linked into fused integration step shaders: */
+	std::string source="#define WATER2_DERIVATIVE_NO_MAIN\n";
+	source.append(readShaderSource("Water2SlopeAndFluxAndDerivativeShader.fs"));
+	return glCompileFragmentShaderFromString(source.c_str());
+	}
+
 }
 
 /**************************************
@@ -80,27 +92,44 @@ Methods of class WaterTable2::DataItem:
 **************************************/
 
 WaterTable2::DataItem::DataItem(void)
-	:currentBathymetry(0),bathymetryVersion(0),currentQuantity(0),
-	 derivativeTextureObject(0),waterTextureObject(0),
-	 bathymetryFramebufferObject(0),derivativeFramebufferObject(0),maxStepSizeFramebufferObject(0),integrationFramebufferObject(0),waterFramebufferObject(0),
-	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0)
+	:currentBathymetry(0),bathymetryVersion(0),forceFullBathymetryUpdate(true),currentQuantity(0),
+	 derivativeTextureObject(0),
+	 numStepSizeReadbacks(0),numCompletedStepSizeReadbacks(0),haveReadbackStepSize(false),readbackStepSize(0.0f),
+	 currentStepSize(0),batchReadbackBuffer(0),batchReadbackFence(0),batchReadbackSteps(0),batchStepBudget(0),
+	 waterTextureObject(0),waterSourcesVersion(0),
+	 bathymetryFramebufferObject(0),derivativeFramebufferObject(0),maxStepSizeFramebufferObject(0),integrationFramebufferObject(0),waterFramebufferObject(0),stepSizeFramebufferObject(0),
+	 bathymetryShader(0),waterAdaptShader(0),derivativeShader(0),maxStepSizeShader(0),boundaryShader(0),eulerStepShader(0),rungeKuttaStepShader(0),waterAddShader(0),waterShader(0),
+	 stepSizeShader(0),controlledEulerStepShader(0),controlledRungeKuttaStepShader(0),
+	 fusedRungeKuttaStepShader(0),controlledFusedRungeKuttaStepShader(0),controlledWaterShader(0),
+	 tileActivityTextureObject(0),tileActivityFramebufferObject(0),tileActivityShader(0),
+	 tileActivityReadbackBuffer(0),tileActivityFence(0),allTilesActive(true)
 	{
 	for(int i=0;i<2;++i)
 		{
 		bathymetryTextureObjects[i]=0;
 		maxStepSizeTextureObjects[i]=0;
+		stepSizeTextureObjects[i]=0;
 		}
 	for(int i=0;i<3;++i)
 		quantityTextureObjects[i]=0;
+	for(unsigned int i=0;i<numStepSizeReadbackBuffers;++i)
+		{
+		stepSizeReadbackBuffers[i]=0;
+		stepSizeReadbackFences[i]=0;
+		stepSizeReadbackFrames[i]=0;
+		}
 	
 	/* Initialize all required OpenGL extensions: */
 	GLARBDrawBuffers::initExtension();
 	GLARBFragmentShader::initExtension();
 	GLARBMultitexture::initExtension();
+	GLARBPixelBufferObject::initExtension();
 	GLARBShaderObjects::initExtension();
+	GLARBSync::initExtension();
 	GLARBTextureFloat::initExtension();
 	GLARBTextureRectangle::initExtension();
 	GLARBTextureRg::initExtension();
+	GLARBVertexBufferObject::initExtension();
 	GLARBVertexShader::initExtension();
 	GLEXTFramebufferObject::initExtension();
 	}
@@ -112,12 +141,21 @@ WaterTable2::DataItem::~DataItem(void)
 	glDeleteTextures(3,quantityTextureObjects);
 	glDeleteTextures(1,&derivativeTextureObject);
 	glDeleteTextures(2,maxStepSizeTextureObjects);
+	for(unsigned int i=0;i<numStepSizeReadbackBuffers;++i)
+		if(stepSizeReadbackFences[i]!=0)
+			glDeleteSync(stepSizeReadbackFences[i]);
+	glDeleteBuffersARB(numStepSizeReadbackBuffers,stepSizeReadbackBuffers);
+	glDeleteTextures(2,stepSizeTextureObjects);
+	if(batchReadbackFence!=0)
+		glDeleteSync(batchReadbackFence);
+	glDeleteBuffersARB(1,&batchReadbackBuffer);
 	glDeleteTextures(1,&waterTextureObject);
 	glDeleteFramebuffersEXT(1,&bathymetryFramebufferObject);
 	glDeleteFramebuffersEXT(1,&derivativeFramebufferObject);
 	glDeleteFramebuffersEXT(1,&maxStepSizeFramebufferObject);
 	glDeleteFramebuffersEXT(1,&integrationFramebufferObject);
 	glDeleteFramebuffersEXT(1,&waterFramebufferObject);
+	glDeleteFramebuffersEXT(1,&stepSizeFramebufferObject);
 	glDeleteObjectARB(bathymetryShader);
 	glDeleteObjectARB(waterAdaptShader);
 	glDeleteObjectARB(derivativeShader);
@@ -127,6 +165,18 @@ WaterTable2::DataItem::~DataItem(void)
 	glDeleteObjectARB(rungeKuttaStepShader);
 	glDeleteObjectARB(waterAddShader);
 	glDeleteObjectARB(waterShader);
+	glDeleteObjectARB(stepSizeShader);
+	glDeleteObjectARB(controlledEulerStepShader);
+	glDeleteObjectARB(controlledRungeKuttaStepShader);
+	glDeleteObjectARB(fusedRungeKuttaStepShader);
+	glDeleteObjectARB(controlledFusedRungeKuttaStepShader);
+	glDeleteObjectARB(controlledWaterShader);
+	glDeleteTextures(1,&tileActivityTextureObject);
+	glDeleteFramebuffersEXT(1,&tileActivityFramebufferObject);
+	glDeleteObjectARB(tileActivityShader);
+	if(tileActivityFence!=0)
+		glDeleteSync(tileActivityFence);
+	glDeleteBuffersARB(1,&tileActivityReadbackBuffer);
 	}
 
 /****************************
@@ -197,6 +247,49 @@ void WaterTable2::calcTransformations(void)
 			*wttmPtr=GLfloat(wttm(i,j));
 	}
 
+int WaterTable2::reduceMaxStepSize(WaterTable2::DataItem* dataItem) const
+	{
+	/* Set up the maximum step size reduction shader: */
+	glUseProgramObjectARB(dataItem->maxStepSizeShader);
+	
+	/* Bind the maximum step size computation frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->maxStepSizeFramebufferObject);
+	
+	/* Reduce the maximum step size texture in a sequence of half-reduction steps: */
+	int reducedWidth=size[0];
+	int reducedHeight=size[1];
+	int currentMaxStepSizeTexture=0;
+	while(reducedWidth>1||reducedHeight>1)
+		{
+		/* Set up the simulation frame buffer for maximum step size reduction: */
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-currentMaxStepSizeTexture));
+		
+		/* Reduce the viewport by a factor of two: */
+		glViewport(0,0,(reducedWidth+1)/2,(reducedHeight+1)/2);
+		glUniformARB(dataItem->maxStepSizeShaderUniformLocations[0],GLfloat(reducedWidth-1),GLfloat(reducedHeight-1));
+		
+		/* Bind the current max step size texture: */
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->maxStepSizeTextureObjects[currentMaxStepSizeTexture]);
+		glUniform1iARB(dataItem->maxStepSizeShaderUniformLocations[1],0);
+		
+		/* Run the reduction step: */
+		glBegin(GL_QUADS);
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		glEnd();
+		
+		/* Go to the next step: */
+		reducedWidth=(reducedWidth+1)/2;
+		reducedHeight=(reducedHeight+1)/2;
+		currentMaxStepSizeTexture=1-currentMaxStepSizeTexture;
+		}
+	
+	return currentMaxStepSizeTexture;
+	}
+
 GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const
 	{
 	/*********************************************************************
@@ -222,12 +315,7 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 	glUniform1iARB(dataItem->derivativeShaderUniformLocations[5],1);
 	
 	/* Run the temporal derivative computation: */
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
+	renderActiveCells(dataItem);
 	
 	/* Unbind unneeded textures: */
 	glActiveTextureARB(GL_TEXTURE1_ARB);
@@ -242,65 +330,229 @@ GLfloat WaterTable2::calcDerivative(WaterTable2::DataItem* dataItem,GLuint quant
 	
 	if(calcMaxStepSize)
 		{
-		/* Set up the maximum step size reduction shader: */
-		glUseProgramObjectARB(dataItem->maxStepSizeShader);
-		
-		/* Bind the maximum step size computation frame buffer: */
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->maxStepSizeFramebufferObject);
+		/* Reduce the maximum step size texture to a single pixel: */
+		int currentMaxStepSizeTexture=reduceMaxStepSize(dataItem);
 		
-		/* Reduce the maximum step size texture in a sequence of half-reduction steps: */
-		int reducedWidth=size[0];
-		int reducedHeight=size[1];
-		int currentMaxStepSizeTexture=0;
-		while(reducedWidth>1||reducedHeight>1)
+		/* Read the final value written into the last reduced 1x1 frame buffer: */
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+currentMaxStepSizeTexture);
+		if(stepSizeReadbackLatency>0)
 			{
-			/* Set up the simulation frame buffer for maximum step size reduction: */
-			glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-currentMaxStepSizeTexture));
-			
-			/* Reduce the viewport by a factor of two: */
-			glViewport(0,0,(reducedWidth+1)/2,(reducedHeight+1)/2);
-			glUniformARB(dataItem->maxStepSizeShaderUniformLocations[0],GLfloat(reducedWidth-1),GLfloat(reducedHeight-1));
+			if(dataItem->numStepSizeReadbacks-dataItem->numCompletedStepSizeReadbacks<DataItem::numStepSizeReadbackBuffers)
+				{
+				/* Queue an asynchronous read of the final value into the next free pixel buffer in the ring: */
+				unsigned int writeIndex=dataItem->numStepSizeReadbacks%DataItem::numStepSizeReadbackBuffers;
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepSizeReadbackBuffers[writeIndex]);
+				glReadPixels(0,0,1,1,GL_LUMINANCE,GL_FLOAT,0);
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+				dataItem->stepSizeReadbackFences[writeIndex]=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+				dataItem->stepSizeReadbackFrames[writeIndex]=frameNumber;
+				++dataItem->numStepSizeReadbacks;
+				}
 			
-			/* Bind the current max step size texture: */
-			glActiveTextureARB(GL_TEXTURE0_ARB);
-			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->maxStepSizeTextureObjects[currentMaxStepSizeTexture]);
-			glUniform1iARB(dataItem->maxStepSizeShaderUniformLocations[1],0);
+			/* Retrieve pending readbacks in the order they were queued; wait only for readbacks queued at least the requested number of frames ago, and keep polling younger ones on later steps: */
+			while(dataItem->numCompletedStepSizeReadbacks!=dataItem->numStepSizeReadbacks)
+				{
+				unsigned int readIndex=dataItem->numCompletedStepSizeReadbacks%DataItem::numStepSizeReadbackBuffers;
+				GLsync& fence=dataItem->stepSizeReadbackFences[readIndex];
+				GLuint64 timeout=frameNumber-dataItem->stepSizeReadbackFrames[readIndex]>=stepSizeReadbackLatency?GLuint64(1000000000):GLuint64(0);
+				GLenum waitResult=glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,timeout);
+				if(waitResult!=GL_ALREADY_SIGNALED&&waitResult!=GL_CONDITION_SATISFIED)
+					break;
+				
+				/* Retrieve the completed step size from its pixel buffer: */
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepSizeReadbackBuffers[readIndex]);
+				const GLfloat* bufferPtr=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+				if(bufferPtr!=0)
+					{
+					dataItem->readbackStepSize=*bufferPtr;
+					dataItem->haveReadbackStepSize=true;
+					glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+					}
+				glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+				glDeleteSync(fence);
+				fence=0;
+				++dataItem->numCompletedStepSizeReadbacks;
+				}
 			
-			/* Run the reduction step: */
-			glBegin(GL_QUADS);
-			glVertex2i(0,0);
-			glVertex2i(size[0],0);
-			glVertex2i(size[0],size[1]);
-			glVertex2i(0,size[1]);
-			glEnd();
+			if(dataItem->haveReadbackStepSize)
+				{
+				/* Use the most recently completed step size, scaled down to account for flow changes since it was calculated: */
+				stepSize=dataItem->readbackStepSize*stepSizeReadbackSafety;
+				}
+			else
+				{
+				/* Fall back to a blocking readback until the first asynchronous readback arrives: */
+				glReadPixels(0,0,1,1,GL_LUMINANCE,GL_FLOAT,&stepSize);
+				}
+			}
+		else
+			glReadPixels(0,0,1,1,GL_LUMINANCE,GL_FLOAT,&stepSize);
+		
+		/* Shrink the step size to absorb reduced-precision rounding, and limit it to the client-specified range: */
+		stepSize=Math::min(stepSize*stepSizeGuard,maxStepSize);
+		}
+	
+	return stepSize;
+	}
+
+void WaterTable2::activateTiles(WaterTable2::DataItem* dataItem,const PixelRect& cellRegion) const
+	{
+	if(tileSize==0||cellRegion.isEmpty())
+		return;
+	
+	/* Reset the idle counts of all tiles overlapping the cell region: */
+	for(int ty=cellRegion.min[1]/tileSize;ty<=(cellRegion.max[1]-1)/tileSize&&ty<numTiles[1];++ty)
+		for(int tx=cellRegion.min[0]/tileSize;tx<=(cellRegion.max[0]-1)/tileSize&&tx<numTiles[0];++tx)
+			dataItem->tileIdleCounts[ty*numTiles[0]+tx]=0;
+	
+	updateActiveTileRuns(dataItem);
+	}
+
+void WaterTable2::updateActiveTileRuns(WaterTable2::DataItem* dataItem) const
+	{
+	dataItem->allTilesActive=true;
+	dataItem->activeTileRuns.clear();
+	for(int ty=0;ty<numTiles[1];++ty)
+		{
+		int runStart=-1;
+		for(int tx=0;tx<=numTiles[0];++tx)
+			{
+			/* A tile is simulated if it or any of its neighbors has recently been found active, so that water can flow into it before it is detected: */
+			bool active=false;
+			if(tx<numTiles[0])
+				{
+				for(int y=Math::max(ty-1,0);y<=Math::min(ty+1,numTiles[1]-1)&&!active;++y)
+					for(int x=Math::max(tx-1,0);x<=Math::min(tx+1,numTiles[0]-1)&&!active;++x)
+						active=dataItem->tileIdleCounts[y*numTiles[0]+x]<DataItem::maxTileIdleCount;
+				if(!active)
+					dataItem->allTilesActive=false;
+				}
 			
-			/* Go to the next step: */
-			reducedWidth=(reducedWidth+1)/2;
-			reducedHeight=(reducedHeight+1)/2;
-			currentMaxStepSizeTexture=1-currentMaxStepSizeTexture;
+			if(active&&runStart<0)
+				runStart=tx;
+			else if(!active&&runStart>=0)
+				{
+				/* Store the pixel-space rectangle covering the finished run of active tiles: */
+				dataItem->activeTileRuns.push_back(runStart*tileSize);
+				dataItem->activeTileRuns.push_back(ty*tileSize);
+				dataItem->activeTileRuns.push_back(Math::min(tx*tileSize,size[0]));
+				dataItem->activeTileRuns.push_back(Math::min((ty+1)*tileSize,size[1]));
+				runStart=-1;
+				}
 			}
+		}
+	}
+
+void WaterTable2::updateTileActivity(WaterTable2::DataItem* dataItem) const
+	{
+	if(tileSize==0)
+		return;
+	
+	if(dataItem->tileActivityFence!=0)
+		{
+		/* Check if the pending tile activity readback has completed, without waiting for it: */
+		GLenum waitResult=glClientWaitSync(dataItem->tileActivityFence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+		if(waitResult!=GL_ALREADY_SIGNALED&&waitResult!=GL_CONDITION_SATISFIED)
+			return;
+		glDeleteSync(dataItem->tileActivityFence);
+		dataItem->tileActivityFence=0;
 		
-		/* Read the final value written into the last reduced 1x1 frame buffer: */
-		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+currentMaxStepSizeTexture);
-		glReadPixels(0,0,1,1,GL_LUMINANCE,GL_FLOAT,&stepSize);
+		/* Update the tiles' idle counts from the completed activity flags: */
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->tileActivityReadbackBuffer);
+		const GLubyte* flags=static_cast<const GLubyte*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+		if(flags!=0)
+			{
+			GLsizei rowStride=(numTiles[0]+3)&~3; // Rows are padded to the default pack alignment of four
+			unsigned char* icPtr=&dataItem->tileIdleCounts[0];
+			for(int ty=0;ty<numTiles[1];++ty,flags+=rowStride)
+				for(int tx=0;tx<numTiles[0];++tx,++icPtr)
+					{
+					if(flags[tx]!=0)
+						*icPtr=0;
+					else if(*icPtr<DataItem::maxTileIdleCount)
+						++*icPtr;
+					}
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
 		
-		/* Limit the step size to the client-specified range: */
-		stepSize=Math::min(stepSize,maxStepSize);
+		updateActiveTileRuns(dataItem);
 		}
 	
-	return stepSize;
+	/* Set up the tile activity detection frame buffer: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->tileActivityFramebufferObject);
+	glViewport(0,0,numTiles[0],numTiles[1]);
+	
+	/* Set up the tile activity detection shader: */
+	glUseProgramObjectARB(dataItem->tileActivityShader);
+	glUniform1iARB(dataItem->tileActivityShaderUniformLocations[0],tileSize);
+	glUniformARB(dataItem->tileActivityShaderUniformLocations[1],GLfloat(size[0]),GLfloat(size[1]));
+	glUniformARB(dataItem->tileActivityShaderUniformLocations[2],tileMinDepth);
+	glUniform1iARB(dataItem->tileActivityShaderUniformLocations[3],waterDeposit!=0.0f||!renderFunctions.empty()?1:0);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glUniform1iARB(dataItem->tileActivityShaderUniformLocations[4],0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glUniform1iARB(dataItem->tileActivityShaderUniformLocations[5],1);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
+	glUniform1iARB(dataItem->tileActivityShaderUniformLocations[6],2);
+	
+	/* Run the tile activity detection: */
+	glBegin(GL_QUADS);
+	glVertex2i(0,0);
+	glVertex2i(size[0],0);
+	glVertex2i(size[0],size[1]);
+	glVertex2i(0,size[1]);
+	glEnd();
+	
+	/* Queue an asynchronous read of the activity flags: */
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->tileActivityReadbackBuffer);
+	glReadPixels(0,0,numTiles[0],numTiles[1],GL_RED,GL_UNSIGNED_BYTE,0);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	dataItem->tileActivityFence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	}
+
+void WaterTable2::renderActiveCells(const WaterTable2::DataItem* dataItem) const
+	{
+	glBegin(GL_QUADS);
+	if(tileSize==0||dataItem->allTilesActive)
+		{
+		/* Cover the entire grid: */
+		glVertex2i(0,0);
+		glVertex2i(size[0],0);
+		glVertex2i(size[0],size[1]);
+		glVertex2i(0,size[1]);
+		}
+	else
+		{
+		/* Cover all runs of active tiles: */
+		for(std::vector<GLint>::const_iterator rIt=dataItem->activeTileRuns.begin();rIt!=dataItem->activeTileRuns.end();rIt+=4)
+			{
+			glVertex2i(rIt[0],rIt[1]);
+			glVertex2i(rIt[2],rIt[1]);
+			glVertex2i(rIt[2],rIt[3]);
+			glVertex2i(rIt[0],rIt[3]);
+			}
+		}
+	glEnd();
 	}
 
 WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2])
 	:depthImageRenderer(0),
 	 baseTransform(ONTransform::identity),
-	 dryBoundary(true)
+	 waterSourcesVersion(1),
+	 dryBoundary(true),fusedIntegration(false),incrementalBathymetry(false),bathymetryLod(0),
+	 tileSize(0),tileMinDepth(0.01f),
+	 profiler(0)
 	{
 	/* Initialize the water table size and cell size: */
 	size[0]=width;
 	size[1]=height;
 	for(int i=0;i<2;++i)
 		cellSize[i]=sCellSize[i];
+	numTiles[0]=numTiles[1]=0;
 	
 	/* Calculate a simulation domain: */
 	for(int i=0;i<2;++i)
@@ -318,6 +570,11 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2]
 	epsilon=0.01f*Math::max(Math::max(cellSize[0],cellSize[1]),1.0f);
 	attenuation=127.0f/128.0f; // 31.0f/32.0f;
 	maxStepSize=1.0f;
+	stepSizeReadbackLatency=0;
+	stepSizeReadbackSafety=0.5f;
+	frameNumber=0;
+	halfIntermediates=false;
+	stepSizeGuard=1.0f;
 	
 	/* Initialize the water deposit amount: */
 	waterDeposit=0.0f;
@@ -325,11 +582,15 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const GLfloat sCellSize[2]
 
 WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer* sDepthImageRenderer,const Point basePlaneCorners[4])
 	:depthImageRenderer(sDepthImageRenderer),
-	 dryBoundary(true)
+	 waterSourcesVersion(1),
+	 dryBoundary(true),fusedIntegration(false),incrementalBathymetry(false),bathymetryLod(0),
+	 tileSize(0),tileMinDepth(0.01f),
+	 profiler(0)
 	{
 	/* Initialize the water table size: */
 	size[0]=width;
 	size[1]=height;
+	numTiles[0]=numTiles[1]=0;
 	
 	/* Project the corner points to the base plane and calculate their centroid: */
 	const Plane& basePlane=depthImageRenderer->getBasePlane();
@@ -374,6 +635,11 @@ WaterTable2::WaterTable2(GLsizei width,GLsizei height,const DepthImageRenderer*
 	epsilon=0.01f*Math::max(Math::max(cellSize[0],cellSize[1]),1.0f);
 	attenuation=127.0f/128.0f; // 31.0f/32.0f;
 	maxStepSize=1.0f;
+	stepSizeReadbackLatency=0;
+	stepSizeReadbackSafety=0.5f;
+	frameNumber=0;
+	halfIntermediates=false;
+	stepSizeGuard=1.0f;
 	
 	/* Initialize the water deposit amount: */
 	waterDeposit=0.0f;
@@ -432,7 +698,7 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
 	GLfloat* qt=makeBuffer(size[0],size[1],3,0.0,0.0,0.0);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB32F,size[0],size[1],0,GL_RGB,GL_FLOAT,qt);
+	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,halfIntermediates?GL_RGB16F:GL_RGB32F,size[0],size[1],0,GL_RGB,GL_FLOAT,qt);
 	delete[] qt;
 	}
 	
@@ -447,11 +713,43 @@ void WaterTable2::initContext(GLContextData& contextData) const
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
 		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
-		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R32F,size[0],size[1],0,GL_LUMINANCE,GL_FLOAT,mss);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,halfIntermediates?GL_R16F:GL_R32F,size[0],size[1],0,GL_LUMINANCE,GL_FLOAT,mss);
 		}
 	delete[] mss;
 	}
 	
+	{
+	/* Create the ring of pixel buffers for asynchronous maximum step size readback: */
+	glGenBuffersARB(DataItem::numStepSizeReadbackBuffers,dataItem->stepSizeReadbackBuffers);
+	for(unsigned int i=0;i<DataItem::numStepSizeReadbackBuffers;++i)
+		{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->stepSizeReadbackBuffers[i]);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+		}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+	
+	{
+	/* Create the step size, remaining time, and step count textures for GPU-controlled simulation steps: */
+	glGenTextures(2,dataItem->stepSizeTextureObjects);
+	GLfloat ss[3]={0.0f,0.0f,0.0f};
+	for(int i=0;i<2;++i)
+		{
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[i]);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_RGB32F,1,1,0,GL_RGB,GL_FLOAT,ss);
+		}
+	
+	/* Create the pixel buffer for asynchronous readback of a batch's final step size texture: */
+	glGenBuffersARB(1,&dataItem->batchReadbackBuffer);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->batchReadbackBuffer);
+	glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,3*sizeof(GLfloat),0,GL_STREAM_READ_ARB);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+	}
+	
 	{
 	/* Create the cell-centered water texture: */
 	glGenTextures(1,&dataItem->waterTextureObject);
@@ -465,6 +763,28 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	delete[] w;
 	}
 	
+	if(tileSize>0)
+		{
+		/* Create the per-tile activity flag texture: */
+		glGenTextures(1,&dataItem->tileActivityTextureObject);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->tileActivityTextureObject);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_S,GL_CLAMP);
+		glTexParameteri(GL_TEXTURE_RECTANGLE_ARB,GL_TEXTURE_WRAP_T,GL_CLAMP);
+		glTexImage2D(GL_TEXTURE_RECTANGLE_ARB,0,GL_R8,numTiles[0],numTiles[1],0,GL_RED,GL_UNSIGNED_BYTE,0);
+		
+		/* Create the pixel buffer receiving the activity flags, with rows padded to the default pack alignment: */
+		glGenBuffersARB(1,&dataItem->tileActivityReadbackBuffer);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->tileActivityReadbackBuffer);
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB,((numTiles[0]+3)&~3)*numTiles[1],0,GL_STREAM_READ_ARB);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		
+		/* Start with all tiles active: */
+		dataItem->tileIdleCounts.resize(numTiles[0]*numTiles[1],0);
+		updateActiveTileRuns(dataItem);
+		}
+	
 	/* Protect the newly-created textures: */
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
@@ -532,6 +852,30 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	glReadBuffer(GL_NONE);
 	}
 	
+	{
+	/* Create the step size selection frame buffer: */
+	glGenFramebuffersEXT(1,&dataItem->stepSizeFramebufferObject);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepSizeFramebufferObject);
+	
+	/* Attach the step size textures to the step size selection frame buffer: */
+	for(int i=0;i<2;++i)
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT+i,GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[i],0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	}
+	
+	if(tileSize>0)
+		{
+		/* Create the tile activity detection frame buffer: */
+		glGenFramebuffersEXT(1,&dataItem->tileActivityFramebufferObject);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->tileActivityFramebufferObject);
+		
+		/* Attach the tile activity texture to the tile activity detection frame buffer: */
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,GL_COLOR_ATTACHMENT0_EXT,GL_TEXTURE_RECTANGLE_ARB,dataItem->tileActivityTextureObject,0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+		}
+	
 	/* Restore the previously bound frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	
@@ -648,7 +992,124 @@ void WaterTable2::initContext(GLContextData& contextData) const
 	dataItem->waterShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->waterShader,"bathymetrySampler");
 	dataItem->waterShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->waterShader,"quantitySampler");
 	dataItem->waterShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->waterShader,"waterSampler");
+	dataItem->waterShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->waterShader,"stepSize");
 	}
+	
+	/* Create the step size selection shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("Water2StepSizeShader");
+	dataItem->stepSizeShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->stepSizeShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->stepSizeShader,"maxStepSize");
+	dataItem->stepSizeShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->stepSizeShader,"maxStepSizeSampler");
+	dataItem->stepSizeShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->stepSizeShader,"stepSizeSampler");
+	dataItem->stepSizeShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->stepSizeShader,"stepSizeGuard");
+	dataItem->stepSizeShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->stepSizeShader,"addedTime");
+	dataItem->stepSizeShaderUniformLocations[5]=glGetUniformLocationARB(dataItem->stepSizeShader,"maxRemainingTime");
+	dataItem->stepSizeShaderUniformLocations[6]=glGetUniformLocationARB(dataItem->stepSizeShader,"stepCountBase");
+	}
+	
+	/* Create the GPU-controlled Euler integration step shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("Water2ControlledEulerStepShader");
+	dataItem->controlledEulerStepShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->controlledEulerStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->controlledEulerStepShader,"attenuation");
+	dataItem->controlledEulerStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->controlledEulerStepShader,"quantitySampler");
+	dataItem->controlledEulerStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->controlledEulerStepShader,"derivativeSampler");
+	dataItem->controlledEulerStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->controlledEulerStepShader,"stepSizeSampler");
+	}
+	
+	/* Create the GPU-controlled Runge-Kutta integration step shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("Water2ControlledRungeKuttaStepShader");
+	dataItem->controlledRungeKuttaStepShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->controlledRungeKuttaStepShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->controlledRungeKuttaStepShader,"attenuation");
+	dataItem->controlledRungeKuttaStepShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->controlledRungeKuttaStepShader,"quantitySampler");
+	dataItem->controlledRungeKuttaStepShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->controlledRungeKuttaStepShader,"quantityStarSampler");
+	dataItem->controlledRungeKuttaStepShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->controlledRungeKuttaStepShader,"derivativeSampler");
+	dataItem->controlledRungeKuttaStepShaderUniformLocations[4]=glGetUniformLocationARB(dataItem->controlledRungeKuttaStepShader,"stepSizeSampler");
+	}
+	
+	/* Create the fused Runge-Kutta integration step shader: */
+	{
+	std::vector<GLhandleARB> shaders;
+	shaders.push_back(glCompileVertexShaderFromString(vertexShaderSource));
+	shaders.push_back(compileDerivativeFunctions());
+	shaders.push_back(compileFragmentShader("Water2FusedRungeKuttaStepShader"));
+	dataItem->fusedRungeKuttaStepShader=glLinkShader(shaders);
+	for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
+		glDeleteObjectARB(*shIt);
+	GLint* ulPtr=dataItem->fusedRungeKuttaStepShaderUniformLocations;
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"cellSize");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"theta");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"g");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"epsilon");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"bathymetrySampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"quantitySampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"quantityStarSampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"attenuation");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->fusedRungeKuttaStepShader,"stepSize");
+	}
+	
+	/* Create the GPU-controlled fused Runge-Kutta integration step shader: */
+	{
+	std::vector<GLhandleARB> shaders;
+	shaders.push_back(glCompileVertexShaderFromString(vertexShaderSource));
+	shaders.push_back(compileDerivativeFunctions());
+	shaders.push_back(compileFragmentShader("Water2ControlledFusedRungeKuttaStepShader"));
+	dataItem->controlledFusedRungeKuttaStepShader=glLinkShader(shaders);
+	for(std::vector<GLhandleARB>::iterator shIt=shaders.begin();shIt!=shaders.end();++shIt)
+		glDeleteObjectARB(*shIt);
+	GLint* ulPtr=dataItem->controlledFusedRungeKuttaStepShaderUniformLocations;
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"cellSize");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"theta");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"g");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"epsilon");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"bathymetrySampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"quantitySampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"quantityStarSampler");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"attenuation");
+	*(ulPtr++)=glGetUniformLocationARB(dataItem->controlledFusedRungeKuttaStepShader,"stepSizeSampler");
+	}
+	
+	/* Create the GPU-controlled water shader: */
+	{
+	GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+	GLhandleARB fragmentShader=compileFragmentShader("Water2ControlledWaterUpdateShader");
+	dataItem->controlledWaterShader=glLinkShader(vertexShader,fragmentShader);
+	glDeleteObjectARB(vertexShader);
+	glDeleteObjectARB(fragmentShader);
+	dataItem->controlledWaterShaderUniformLocations[0]=glGetUniformLocationARB(dataItem->controlledWaterShader,"bathymetrySampler");
+	dataItem->controlledWaterShaderUniformLocations[1]=glGetUniformLocationARB(dataItem->controlledWaterShader,"quantitySampler");
+	dataItem->controlledWaterShaderUniformLocations[2]=glGetUniformLocationARB(dataItem->controlledWaterShader,"waterSampler");
+	dataItem->controlledWaterShaderUniformLocations[3]=glGetUniformLocationARB(dataItem->controlledWaterShader,"stepSizeSampler");
+	}
+	
+	if(tileSize>0)
+		{
+		/* Create the tile activity detection shader: */
+		GLhandleARB vertexShader=glCompileVertexShaderFromString(vertexShaderSource);
+		GLhandleARB fragmentShader=compileFragmentShader("Water2TileActivityShader");
+		dataItem->tileActivityShader=glLinkShader(vertexShader,fragmentShader);
+		glDeleteObjectARB(vertexShader);
+		glDeleteObjectARB(fragmentShader);
+		GLint* ulPtr=dataItem->tileActivityShaderUniformLocations;
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"tileSize");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"gridSize");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"minDepth");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"checkWater");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"bathymetrySampler");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"quantitySampler");
+		*(ulPtr++)=glGetUniformLocationARB(dataItem->tileActivityShader,"waterSampler");
+		}
 	}
 
 void WaterTable2::setElevationRange(Scalar newMin,Scalar newMax)
@@ -671,10 +1132,25 @@ void WaterTable2::setMaxStepSize(GLfloat newMaxStepSize)
 	maxStepSize=newMaxStepSize;
 	}
 
+void WaterTable2::setStepSizeReadback(unsigned int newLatency,GLfloat newSafety)
+	{
+	stepSizeReadbackLatency=newLatency;
+	stepSizeReadbackSafety=newSafety;
+	}
+
+void WaterTable2::setHalfPrecision(bool newHalfIntermediates)
+	{
+	halfIntermediates=newHalfIntermediates;
+	
+	/* Shrink maximum step sizes by twice the relative rounding error of 16-bit maximum step sizes: */
+	stepSizeGuard=halfIntermediates?1.0f-1.0f/1024.0f:1.0f;
+	}
+
 void WaterTable2::addRenderFunction(const AddWaterFunction* newRenderFunction)
 	{
 	/* Store the new render function: */
 	renderFunctions.push_back(newRenderFunction);
+	++waterSourcesVersion;
 	}
 
 void WaterTable2::removeRenderFunction(const AddWaterFunction* removeRenderFunction)
@@ -685,6 +1161,7 @@ void WaterTable2::removeRenderFunction(const AddWaterFunction* removeRenderFunct
 			{
 			/* Remove the list element: */
 			renderFunctions.erase(rfIt);
+			++waterSourcesVersion;
 			break;
 			}
 	}
@@ -692,6 +1169,7 @@ void WaterTable2::removeRenderFunction(const AddWaterFunction* removeRenderFunct
 void WaterTable2::setWaterDeposit(GLfloat newWaterDeposit)
 	{
 	waterDeposit=newWaterDeposit;
+	++waterSourcesVersion;
 	}
 
 void WaterTable2::setDryBoundary(bool newDryBoundary)
@@ -699,6 +1177,99 @@ void WaterTable2::setDryBoundary(bool newDryBoundary)
 	dryBoundary=newDryBoundary;
 	}
 
+void WaterTable2::setIncrementalBathymetry(bool newIncrementalBathymetry)
+	{
+	incrementalBathymetry=newIncrementalBathymetry;
+	}
+
+void WaterTable2::setBathymetryLod(unsigned int newBathymetryLod)
+	{
+	bathymetryLod=newBathymetryLod<DepthImageRenderer::numLods?newBathymetryLod:DepthImageRenderer::numLods-1;
+	}
+
+void WaterTable2::setTileSize(GLsizei newTileSize,GLfloat newTileMinDepth)
+	{
+	tileSize=newTileSize;
+	tileMinDepth=newTileMinDepth;
+	for(int i=0;i<2;++i)
+		numTiles[i]=tileSize>0?(size[i]+tileSize-1)/tileSize:0;
+	}
+
+void WaterTable2::setFusedIntegration(bool newFusedIntegration)
+	{
+	fusedIntegration=newFusedIntegration;
+	}
+
+void WaterTable2::setProfiler(PerformanceProfiler* newProfiler)
+	{
+	profiler=newProfiler;
+	if(profiler!=0)
+		{
+		/* Register the simulation's passes: */
+		profilerStages[0]=profiler->addStage("WaterDerivative",true);
+		profilerStages[1]=profiler->addStage("WaterIntegration",true);
+		profilerStages[2]=profiler->addStage("WaterSources",true);
+		profilerStages[3]=profiler->addStage("WaterTiles",true);
+		}
+	}
+
+bool WaterTable2::calcBathymetryUpdateRegions(const PixelRect& dirtyRegion,PixelRect& cellRegion,PixelRect& meshRegion) const
+	{
+	/* Calculate the transformation from depth image space into the bathymetry grid's clip space: */
+	PTransform pmvdp=bathymetryPmv;
+	pmvdp*=depthImageRenderer->getDepthProjection();
+	const PTransform::Matrix& m=pmvdp.getMatrix();
+	
+	/* Project the corners of the dirty region at the lower and upper elevation limits of the domain into the bathymetry grid: */
+	cellRegion=PixelRect();
+	for(int corner=0;corner<4;++corner)
+		{
+		double x=double((corner&0x1)?dirtyRegion.max[0]:dirtyRegion.min[0]);
+		double y=double((corner&0x2)?dirtyRegion.max[1]:dirtyRegion.min[1]);
+		for(int z=-1;z<=1;z+=2)
+			{
+			/* Find the depth at which the pixel's line of sight crosses the clip plane: */
+			double a[4];
+			for(int i=0;i<4;++i)
+				a[i]=m(2,i)-double(z)*m(3,i);
+			if(a[2]==0.0)
+				return false;
+			double d=-(a[0]*x+a[1]*y+a[3])/a[2];
+			
+			/* Transform the point to bathymetry grid cell coordinates: */
+			double w=m(3,0)*x+m(3,1)*y+m(3,2)*d+m(3,3);
+			double cx=((m(0,0)*x+m(0,1)*y+m(0,2)*d+m(0,3))/w+1.0)*0.5*double(size[0]-1);
+			double cy=((m(1,0)*x+m(1,1)*y+m(1,2)*d+m(1,3))/w+1.0)*0.5*double(size[1]-1);
+			cellRegion.addPixel(int(Math::floor(cx)),int(Math::floor(cy)));
+			}
+		}
+	
+	/* Grow the cell region to account for lens distortion correction and rasterization, and clamp it to the grid: */
+	cellRegion.expand(2).clamp(size[0]-1,size[1]-1);
+	meshRegion=PixelRect();
+	if(cellRegion.isEmpty())
+		return true;
+	
+	/* Find all depth image pixels whose surface triangles can cover the cell region by unprojecting its corners: */
+	PTransform inversePmvdp=Geometry::invert(pmvdp);
+	for(int corner=0;corner<4;++corner)
+		{
+		double cx=double((corner&0x1)?cellRegion.max[0]:cellRegion.min[0])*2.0/double(size[0]-1)-1.0;
+		double cy=double((corner&0x2)?cellRegion.max[1]:cellRegion.min[1])*2.0/double(size[1]-1)-1.0;
+		for(int z=-1;z<=1;z+=2)
+			{
+			PTransform::HVector dic=inversePmvdp.transform(PTransform::HVector(cx,cy,double(z),1.0));
+			if(dic[3]==0.0)
+				return false;
+			meshRegion.addPixel(int(Math::floor(dic[0]/dic[3])),int(Math::floor(dic[1]/dic[3])));
+			}
+		}
+	meshRegion.addRect(dirtyRegion);
+	meshRegion.expand(2).clamp(depthImageRenderer->getDepthImageSize(0),depthImageRenderer->getDepthImageSize(1));
+	
+	return true;
+	}
+
 void WaterTable2::updateBathymetry(GLContextData& contextData) const
 	{
 	/* Get the data item: */
@@ -707,8 +1278,28 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 	/* Check if the current bathymetry texture is outdated: */
 	if(dataItem->bathymetryVersion!=depthImageRenderer->getDepthImageVersion())
 		{
+		/* Check if only a part of the bathymetry grid needs to be updated: */
+		PixelRect dirtyRegion,cellRegion,meshRegion;
+		bool incremental=incrementalBathymetry&&!dataItem->forceFullBathymetryUpdate&&depthImageRenderer->getDirtyRegion(dataItem->bathymetryVersion,dirtyRegion);
+		if(incremental)
+			{
+			if(dirtyRegion.isEmpty())
+				{
+				/* Nothing changed; the bathymetry grid is already up-to-date: */
+				dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
+				return;
+				}
+			incremental=calcBathymetryUpdateRegions(dirtyRegion,cellRegion,meshRegion);
+			if(incremental&&cellRegion.isEmpty())
+				{
+				/* The changed pixels do not touch the grid: */
+				dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
+				return;
+				}
+			}
+		
 		/* Save relevant OpenGL state: */
-		glPushAttrib(GL_VIEWPORT_BIT);
+		glPushAttrib(GL_VIEWPORT_BIT|GL_SCISSOR_BIT);
 		GLint currentFrameBuffer;
 		glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
 		GLfloat currentClearColor[4];
@@ -718,16 +1309,40 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->bathymetryFramebufferObject);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentBathymetry));
 		glViewport(0,0,size[0]-1,size[1]-1);
+		if(incremental)
+			{
+			/* Restrict rendering to the affected bathymetry cells: */
+			glEnable(GL_SCISSOR_TEST);
+			glScissor(cellRegion.min[0],cellRegion.min[1],cellRegion.max[0]-cellRegion.min[0],cellRegion.max[1]-cellRegion.min[1]);
+			}
+		else
+			glDisable(GL_SCISSOR_TEST);
 		glClearColor(GLfloat(domain.min[2]),0.0f,0.0f,1.0f);
 		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 		
-		/* Render the surface into the bathymetry grid: */
-		depthImageRenderer->renderElevation(bathymetryPmv,contextData);
+		/* Render the surface, or the part of it covering the affected cells, into the bathymetry grid: */
+		if(incremental)
+			depthImageRenderer->renderElevation(bathymetryPmv,meshRegion,bathymetryLod,contextData);
+		else
+			depthImageRenderer->renderElevation(bathymetryPmv,PixelRect(0,0,depthImageRenderer->getDepthImageSize(0),depthImageRenderer->getDepthImageSize(1)),bathymetryLod,contextData);
 		
 		/* Set up the integration frame buffer to update the conserved quantities based on bathymetry changes: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
 		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
 		glViewport(0,0,size[0],size[1]);
+		PixelRect quantityRegion=cellRegion;
+		if(incremental)
+			{
+			/* Only update cells whose four surrounding bathymetry vertices were all re-rendered, accounting for edge clamping: */
+			for(int i=0;i<2;++i)
+				{
+				if(quantityRegion.min[i]>0)
+					++quantityRegion.min[i];
+				if(quantityRegion.max[i]==size[i]-1)
+					++quantityRegion.max[i];
+				}
+			glScissor(quantityRegion.min[0],quantityRegion.min[1],quantityRegion.max[0]-quantityRegion.min[0],quantityRegion.max[1]-quantityRegion.min[1]);
+			}
 		
 		/* Set up the bathymetry update shader: */
 		glUseProgramObjectARB(dataItem->bathymetryShader);
@@ -759,15 +1374,39 @@ void WaterTable2::updateBathymetry(GLContextData& contextData) const
 		glActiveTextureARB(GL_TEXTURE0_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 		
+		if(incremental)
+			{
+			/* Copy the updated quantity cells back into the current quantity texture, which is correct everywhere else: */
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+			glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,quantityRegion.min[0],quantityRegion.min[1],quantityRegion.min[0],quantityRegion.min[1],quantityRegion.max[0]-quantityRegion.min[0],quantityRegion.max[1]-quantityRegion.min[1]);
+			glReadBuffer(GL_NONE);
+			
+			/* Copy the updated bathymetry cells back into the current bathymetry texture: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->bathymetryFramebufferObject);
+			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentBathymetry));
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+			glCopyTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,cellRegion.min[0],cellRegion.min[1],cellRegion.min[0],cellRegion.min[1],cellRegion.max[0]-cellRegion.min[0],cellRegion.max[1]-cellRegion.min[1]);
+			glReadBuffer(GL_NONE);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+			}
+		
 		/* Restore OpenGL state: */
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
 		glPopAttrib();
 		
-		/* Update the bathymetry and quantity grids: */
-		dataItem->currentBathymetry=1-dataItem->currentBathymetry;
+		/* Update the bathymetry and quantity grids; incremental updates copied their results into the current grids: */
+		if(!incremental)
+			{
+			dataItem->currentBathymetry=1-dataItem->currentBathymetry;
+			dataItem->currentQuantity=1-dataItem->currentQuantity;
+			}
 		dataItem->bathymetryVersion=depthImageRenderer->getDepthImageVersion();
-		dataItem->currentQuantity=1-dataItem->currentQuantity;
+		dataItem->forceFullBathymetryUpdate=false;
+		
+		/* Simulate all tiles affected by the bathymetry change until both quantity grids settle: */
+		activateTiles(dataItem,incremental?quantityRegion:PixelRect(0,0,size[0],size[1]));
 		}
 	}
 
@@ -816,14 +1455,20 @@ void WaterTable2::updateBathymetry(const GLfloat* bathymetryGrid,GLContextData&
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glUseProgramObjectARB(0);
-
+	
 	/* Restore OpenGL state: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
-
+	
 	/* Update the bathymetry and quantity grids: */
 	dataItem->currentBathymetry=1-dataItem->currentBathymetry;
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
+	
+	/* The bathymetry grid no longer matches the depth image: */
+	dataItem->forceFullBathymetryUpdate=true;
+	
+	/* Simulate all tiles until both quantity grids settle: */
+	activateTiles(dataItem,PixelRect(0,0,size[0],size[1]));
 	}
 
 void WaterTable2::setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const
@@ -869,95 +1514,178 @@ void WaterTable2::setWaterLevel(const GLfloat* waterGrid,GLContextData& contextD
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glUseProgramObjectARB(0);
-
+	
 	/* Restore OpenGL state: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
-
+	
 	/* Update the quantity grid: */
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
+	
+	/* Simulate all tiles until both quantity grids settle: */
+	activateTiles(dataItem,PixelRect(0,0,size[0],size[1]));
 	}
 
-GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& contextData) const
+void WaterTable2::setMirroredState(const GLfloat* bathymetryGrid,const GLfloat* waterGrid,GLContextData& contextData) const
 	{
 	/* Get the data item: */
 	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
 	
-	/* Save relevant OpenGL state: */
-	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
-	GLint currentFrameBuffer;
-	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
-	
-	/*********************************************************************
-	Step 1: Calculate temporal derivative of most recent quantities.
-	*********************************************************************/
-	
-	GLfloat stepSize=calcDerivative(dataItem,dataItem->quantityTextureObjects[dataItem->currentQuantity],!forceStepSize);
+	/* Upload the grids into the current textures without running any simulation passes; renderers only use the water level component: */
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0]-1,size[1]-1,GL_LUMINANCE,GL_FLOAT,bathymetryGrid);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+	glTexSubImage2D(GL_TEXTURE_RECTANGLE_ARB,0,0,0,size[0],size[1],GL_RED,GL_FLOAT,waterGrid);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	
+	/* The bathymetry grid no longer matches the depth image: */
+	dataItem->forceFullBathymetryUpdate=true;
+	}
+
+void WaterTable2::integrate(WaterTable2::DataItem* dataItem,GLfloat stepSize,bool controlledStepSize,GLContextData& contextData) const
+	{
 	/*********************************************************************
 	Step 2: Perform the tentative Euler integration step.
 	*********************************************************************/
 	
+	/* Measure the integration passes, including the intermediate derivative and the boundary condition: */
+	if(profiler!=0)
+		profiler->beginGpuStage(profilerStages[1],contextData);
+	
 	/* Set up the Euler step integration frame buffer: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
 	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+2);
 	glViewport(0,0,size[0],size[1]);
 	
 	/* Set up the Euler integration step shader: */
-	glUseProgramObjectARB(dataItem->eulerStepShader);
-	glUniformARB(dataItem->eulerStepShaderUniformLocations[0],stepSize);
-	glUniformARB(dataItem->eulerStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
-	glActiveTextureARB(GL_TEXTURE0_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-	glUniform1iARB(dataItem->eulerStepShaderUniformLocations[2],0);
-	glActiveTextureARB(GL_TEXTURE1_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
-	glUniform1iARB(dataItem->eulerStepShaderUniformLocations[3],1);
+	if(controlledStepSize)
+		{
+		glUseProgramObjectARB(dataItem->controlledEulerStepShader);
+		glUniformARB(dataItem->controlledEulerStepShaderUniformLocations[0],attenuation);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+		glUniform1iARB(dataItem->controlledEulerStepShaderUniformLocations[1],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+		glUniform1iARB(dataItem->controlledEulerStepShaderUniformLocations[2],1);
+		glActiveTextureARB(GL_TEXTURE3_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[dataItem->currentStepSize]);
+		glUniform1iARB(dataItem->controlledEulerStepShaderUniformLocations[3],3);
+		}
+	else
+		{
+		glUseProgramObjectARB(dataItem->eulerStepShader);
+		glUniformARB(dataItem->eulerStepShaderUniformLocations[0],stepSize);
+		glUniformARB(dataItem->eulerStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+		glUniform1iARB(dataItem->eulerStepShaderUniformLocations[2],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+		glUniform1iARB(dataItem->eulerStepShaderUniformLocations[3],1);
+		}
 	
 	/* Run the Euler integration step: */
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
-	
-	/*********************************************************************
-	Step 3: Calculate temporal derivative of intermediate quantities.
-	*********************************************************************/
-	
-	calcDerivative(dataItem,dataItem->quantityTextureObjects[2],false);
-	
-	/*********************************************************************
-	Step 4: Perform the final Runge-Kutta integration step.
-	*********************************************************************/
-	
-	/* Set up the Runge-Kutta step integration frame buffer: */
-	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
-	glViewport(0,0,size[0],size[1]);
+	renderActiveCells(dataItem);
 	
-	/* Set up the Runge-Kutta integration step shader: */
-	glUseProgramObjectARB(dataItem->rungeKuttaStepShader);
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[0],stepSize);
-	glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
-	glActiveTextureARB(GL_TEXTURE0_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[2],0);
-	glActiveTextureARB(GL_TEXTURE1_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[3],1);
-	glActiveTextureARB(GL_TEXTURE2_ARB);
-	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
-	glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[4],2);
+	if(fusedIntegration)
+		{
+		/*******************************************************************
+		Steps 3 and 4: Perform the final Runge-Kutta integration step,
+		calculating the temporal derivative of the intermediate quantities
+		on the fly.
+		*******************************************************************/
+		
+		/* Set up the Runge-Kutta step integration frame buffer: */
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+		
+		/* Set up the fused Runge-Kutta integration step shader: */
+		const GLint* ulPtr;
+		if(controlledStepSize)
+			{
+			glUseProgramObjectARB(dataItem->controlledFusedRungeKuttaStepShader);
+			ulPtr=dataItem->controlledFusedRungeKuttaStepShaderUniformLocations;
+			glActiveTextureARB(GL_TEXTURE3_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[dataItem->currentStepSize]);
+			glUniform1iARB(ulPtr[8],3);
+			glUniformARB(ulPtr[7],attenuation);
+			}
+		else
+			{
+			glUseProgramObjectARB(dataItem->fusedRungeKuttaStepShader);
+			ulPtr=dataItem->fusedRungeKuttaStepShaderUniformLocations;
+			glUniformARB(ulPtr[8],stepSize);
+			glUniformARB(ulPtr[7],Math::pow(attenuation,stepSize));
+			}
+		glUniformARB<2>(ulPtr[0],1,cellSize);
+		glUniformARB(ulPtr[1],theta);
+		glUniformARB(ulPtr[2],g);
+		glUniformARB(ulPtr[3],epsilon);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
+		glUniform1iARB(ulPtr[4],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+		glUniform1iARB(ulPtr[5],1);
+		glActiveTextureARB(GL_TEXTURE2_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
+		glUniform1iARB(ulPtr[6],2);
+		}
+	else
+		{
+		/*******************************************************************
+		Step 3: Calculate temporal derivative of intermediate quantities.
+		*******************************************************************/
+		
+		calcDerivative(dataItem,dataItem->quantityTextureObjects[2],false);
+		
+		/*******************************************************************
+		Step 4: Perform the final Runge-Kutta integration step.
+		*******************************************************************/
+		
+		/* Set up the Runge-Kutta step integration frame buffer: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->integrationFramebufferObject);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentQuantity));
+		glViewport(0,0,size[0],size[1]);
+		
+		/* Set up the Runge-Kutta integration step shader: */
+		if(controlledStepSize)
+			{
+			glUseProgramObjectARB(dataItem->controlledRungeKuttaStepShader);
+			glUniformARB(dataItem->controlledRungeKuttaStepShaderUniformLocations[0],attenuation);
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+			glUniform1iARB(dataItem->controlledRungeKuttaStepShaderUniformLocations[1],0);
+			glActiveTextureARB(GL_TEXTURE1_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
+			glUniform1iARB(dataItem->controlledRungeKuttaStepShaderUniformLocations[2],1);
+			glActiveTextureARB(GL_TEXTURE2_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+			glUniform1iARB(dataItem->controlledRungeKuttaStepShaderUniformLocations[3],2);
+			glActiveTextureARB(GL_TEXTURE3_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[dataItem->currentStepSize]);
+			glUniform1iARB(dataItem->controlledRungeKuttaStepShaderUniformLocations[4],3);
+			}
+		else
+			{
+			glUseProgramObjectARB(dataItem->rungeKuttaStepShader);
+			glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[0],stepSize);
+			glUniformARB(dataItem->rungeKuttaStepShaderUniformLocations[1],Math::pow(attenuation,stepSize));
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
+			glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[2],0);
+			glActiveTextureARB(GL_TEXTURE1_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[2]);
+			glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[3],1);
+			glActiveTextureARB(GL_TEXTURE2_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->derivativeTextureObject);
+			glUniform1iARB(dataItem->rungeKuttaStepShaderUniformLocations[4],2);
+			}
+		}
 	
 	/* Run the Runge-Kutta integration step: */
-	glBegin(GL_QUADS);
-	glVertex2i(0,0);
-	glVertex2i(size[0],0);
-	glVertex2i(size[0],size[1]);
-	glVertex2i(0,size[1]);
-	glEnd();
+	renderActiveCells(dataItem);
 	
 	if(dryBoundary)
 		{
@@ -978,47 +1706,61 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 		//glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
 		}
 	
+	if(profiler!=0)
+		profiler->endGpuStage(profilerStages[1],contextData);
+	
 	/* Update the current quantities: */
 	dataItem->currentQuantity=1-dataItem->currentQuantity;
 	
 	if(waterDeposit!=0.0f||!renderFunctions.empty())
 		{
-		/* Save OpenGL state: */
-		GLfloat currentClearColor[4];
-		glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
-		
-		/*******************************************************************
-		Step 5: Render all water sources and sinks additively into the water
-		texture.
-		*******************************************************************/
-		
-		/* Set up and clear the water frame buffer: */
-		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
-		glViewport(0,0,size[0],size[1]);
-		glClearColor(waterDeposit*stepSize,0.0f,0.0f,0.0f);
-		glClear(GL_COLOR_BUFFER_BIT);
-		
-		/* Enable additive rendering: */
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE,GL_ONE);
-		
-		/* Set up the water adding shader: */
-		glUseProgramObjectARB(dataItem->waterAddShader);
-		glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
-		glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],stepSize);
-		
-		/* Bind the water texture: */
-		glActiveTextureARB(GL_TEXTURE0_ARB);
-		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
-		glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
-		
-		/* Call all render functions: */
-		for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
-			(**rfIt)(contextData);
-		
-		/* Restore OpenGL state: */
-		glDisable(GL_BLEND);
-		glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+		if(dataItem->waterSourcesVersion!=waterSourcesVersion)
+			{
+			/* Measure the water adding passes: */
+			PerformanceProfiler::GpuTimer sourcesTimer(profiler,profilerStages[2],contextData);
+			
+			/* Save OpenGL state: */
+			GLfloat currentClearColor[4];
+			glGetFloatv(GL_COLOR_CLEAR_VALUE,currentClearColor);
+			
+			/*****************************************************************
+			Step 5: Render all water sources and sinks additively into the
+			water texture as per-time rates, once per version of the sources;
+			all simulation steps until the next change scale them by their own
+			step sizes.
+			*****************************************************************/
+			
+			/* Set up and clear the water frame buffer: */
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->waterFramebufferObject);
+			glViewport(0,0,size[0],size[1]);
+			glClearColor(waterDeposit,0.0f,0.0f,0.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			
+			/* Enable additive rendering: */
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE,GL_ONE);
+			
+			/* Set up the water adding shader: */
+			glUseProgramObjectARB(dataItem->waterAddShader);
+			glUniformMatrix4fvARB(dataItem->waterAddShaderUniformLocations[0],1,GL_FALSE,waterAddPmvMatrix);
+			glUniform1fARB(dataItem->waterAddShaderUniformLocations[1],1.0f);
+			
+			/* Bind the water texture: */
+			glActiveTextureARB(GL_TEXTURE0_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
+			glUniform1iARB(dataItem->waterAddShaderUniformLocations[2],0);
+			
+			/* Call all render functions: */
+			for(std::vector<const AddWaterFunction*>::const_iterator rfIt=renderFunctions.begin();rfIt!=renderFunctions.end();++rfIt)
+				(**rfIt)(contextData);
+			
+			/* Restore OpenGL state: */
+			glDisable(GL_BLEND);
+			glClearColor(currentClearColor[0],currentClearColor[1],currentClearColor[2],currentClearColor[3]);
+			
+			/* Mark the water texture as up-to-date: */
+			dataItem->waterSourcesVersion=waterSourcesVersion;
+			}
 		
 		/*******************************************************************
 		Step 6: Update the conserved quantities based on the water texture.
@@ -1030,18 +1772,165 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 		glViewport(0,0,size[0],size[1]);
 		
 		/* Set up the water update shader: */
-		glUseProgramObjectARB(dataItem->waterShader);
+		const GLint* wsul;
+		if(controlledStepSize)
+			{
+			glUseProgramObjectARB(dataItem->controlledWaterShader);
+			wsul=dataItem->controlledWaterShaderUniformLocations;
+			glActiveTextureARB(GL_TEXTURE3_ARB);
+			glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[dataItem->currentStepSize]);
+			glUniform1iARB(wsul[3],3);
+			}
+		else
+			{
+			glUseProgramObjectARB(dataItem->waterShader);
+			wsul=dataItem->waterShaderUniformLocations;
+			glUniformARB(wsul[3],stepSize);
+			}
 		glActiveTextureARB(GL_TEXTURE0_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->bathymetryTextureObjects[dataItem->currentBathymetry]);
-		glUniform1iARB(dataItem->waterShaderUniformLocations[0],0);
+		glUniform1iARB(wsul[0],0);
 		glActiveTextureARB(GL_TEXTURE1_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->quantityTextureObjects[dataItem->currentQuantity]);
-		glUniform1iARB(dataItem->waterShaderUniformLocations[1],1);
+		glUniform1iARB(wsul[1],1);
 		glActiveTextureARB(GL_TEXTURE2_ARB);
 		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->waterTextureObject);
-		glUniform1iARB(dataItem->waterShaderUniformLocations[2],2);
+		glUniform1iARB(wsul[2],2);
 		
 		/* Run the water update: */
+		renderActiveCells(dataItem);
+		
+		/* Update the current quantities: */
+		dataItem->currentQuantity=1-dataItem->currentQuantity;
+		}
+	}
+
+GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/*********************************************************************
+	Step 1: Calculate temporal derivative of most recent quantities.
+	*********************************************************************/
+	
+	GLfloat stepSize;
+	{
+	PerformanceProfiler::GpuTimer derivativeTimer(profiler,profilerStages[0],contextData);
+	stepSize=calcDerivative(dataItem,dataItem->quantityTextureObjects[dataItem->currentQuantity],!forceStepSize);
+	}
+	
+	/* Run the rest of the simulation step: */
+	integrate(dataItem,stepSize,false,contextData);
+	
+	/* Update the set of simulated tiles: */
+	{
+	PerformanceProfiler::GpuTimer tilesTimer(profiler,profilerStages[3],contextData);
+	updateTileActivity(dataItem);
+	}
+	
+	/* Unbind all shaders and textures: */
+	glUseProgramObjectARB(0);
+	glActiveTextureARB(GL_TEXTURE2_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	glActiveTextureARB(GL_TEXTURE0_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
+	
+	/* Restore OpenGL state: */
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
+	glPopAttrib();
+	
+	/* Return the Runge-Kutta step's step size: */
+	return stepSize;
+	}
+
+void WaterTable2::runSimulationSteps(double targetTime,unsigned int maxSteps,GLContextData& contextData) const
+	{
+	/* Get the data item: */
+	DataItem* dataItem=contextData.retrieveDataItem<DataItem>(this);
+	
+	/* Save relevant OpenGL state: */
+	glPushAttrib(GL_COLOR_BUFFER_BIT|GL_VIEWPORT_BIT);
+	GLint currentFrameBuffer;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT,&currentFrameBuffer);
+	
+	/* Check if the readback of an earlier batch has completed, without waiting for it: */
+	if(dataItem->batchReadbackFence!=0)
+		{
+		GLenum waitResult=glClientWaitSync(dataItem->batchReadbackFence,GL_SYNC_FLUSH_COMMANDS_BIT,0);
+		if(waitResult==GL_ALREADY_SIGNALED||waitResult==GL_CONDITION_SATISFIED)
+			{
+			/* Retrieve the batch's remaining time and number of advancing steps: */
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->batchReadbackBuffer);
+			const GLfloat* bufferPtr=static_cast<const GLfloat*>(glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB,GL_READ_ONLY_ARB));
+			if(bufferPtr!=0)
+				{
+				unsigned int usedSteps=(unsigned int)(bufferPtr[2]+0.5f);
+				if(bufferPtr[1]>0.0f)
+					{
+					/* The batch ran out of steps; grow the budget: */
+					dataItem->batchStepBudget=dataItem->batchReadbackSteps+dataItem->batchReadbackSteps/2U+1U;
+					}
+				else
+					{
+					/* Leave headroom above the number of steps the batch actually needed: */
+					dataItem->batchStepBudget=usedSteps+usedSteps/4U+2U;
+					}
+				glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+				}
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+			glDeleteSync(dataItem->batchReadbackFence);
+			dataItem->batchReadbackFence=0;
+			}
+		}
+	
+	/* Issue the estimated number of steps, or the maximum number until the first batch readback has completed: */
+	unsigned int numSteps=maxSteps;
+	if(dataItem->batchStepBudget!=0U&&numSteps>dataItem->batchStepBudget)
+		numSteps=dataItem->batchStepBudget;
+	
+	/* Issue all simulation steps back-to-back; steps after the remaining time has run out have a step size of zero and leave the quantities unchanged: */
+	for(unsigned int step=0;step<numSteps;++step)
+		{
+		/*******************************************************************
+		Step 1: Calculate temporal derivative of most recent quantities and
+		select the step size on the GPU.
+		*******************************************************************/
+		
+		if(profiler!=0)
+			profiler->beginGpuStage(profilerStages[0],contextData);
+		calcDerivative(dataItem,dataItem->quantityTextureObjects[dataItem->currentQuantity],false);
+		int currentMaxStepSizeTexture=reduceMaxStepSize(dataItem);
+		
+		/* Set up the step size selection frame buffer: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepSizeFramebufferObject);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT+(1-dataItem->currentStepSize));
+		glViewport(0,0,1,1);
+		
+		/* Set up the step size selection shader: */
+		glUseProgramObjectARB(dataItem->stepSizeShader);
+		glUniformARB(dataItem->stepSizeShaderUniformLocations[0],maxStepSize);
+		glActiveTextureARB(GL_TEXTURE0_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->maxStepSizeTextureObjects[currentMaxStepSizeTexture]);
+		glUniform1iARB(dataItem->stepSizeShaderUniformLocations[1],0);
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_RECTANGLE_ARB,dataItem->stepSizeTextureObjects[dataItem->currentStepSize]);
+		glUniform1iARB(dataItem->stepSizeShaderUniformLocations[2],1);
+		glUniformARB(dataItem->stepSizeShaderUniformLocations[3],stepSizeGuard);
+		
+		/* Add the target time to the time left unspent by the previous batch in the first step, capping any backlog at one additional target time: */
+		glUniformARB(dataItem->stepSizeShaderUniformLocations[4],step==0?GLfloat(targetTime):0.0f);
+		glUniformARB(dataItem->stepSizeShaderUniformLocations[5],GLfloat(targetTime*2.0));
+		glUniformARB(dataItem->stepSizeShaderUniformLocations[6],step==0?0.0f:1.0f);
+		
+		/* Run the step size selection: */
 		glBegin(GL_QUADS);
 		glVertex2i(0,0);
 		glVertex2i(size[0],0);
@@ -1049,12 +1938,38 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 		glVertex2i(0,size[1]);
 		glEnd();
 		
-		/* Update the current quantities: */
-		dataItem->currentQuantity=1-dataItem->currentQuantity;
+		/* Update the current step size: */
+		dataItem->currentStepSize=1-dataItem->currentStepSize;
+		
+		if(profiler!=0)
+			profiler->endGpuStage(profilerStages[0],contextData);
+		
+		/* Run the rest of the simulation step: */
+		integrate(dataItem,0.0f,true,contextData);
 		}
 	
+	if(dataItem->batchReadbackFence==0&&numSteps>0U)
+		{
+		/* Queue an asynchronous read of the batch's final step size texture to adjust the budget of a later batch: */
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,dataItem->stepSizeFramebufferObject);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT+dataItem->currentStepSize);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,dataItem->batchReadbackBuffer);
+		glReadPixels(0,0,1,1,GL_RGB,GL_FLOAT,0);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB,0);
+		dataItem->batchReadbackFence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+		dataItem->batchReadbackSteps=numSteps;
+		}
+	
+	/* Update the set of simulated tiles: */
+	{
+	PerformanceProfiler::GpuTimer tilesTimer(profiler,profilerStages[3],contextData);
+	updateTileActivity(dataItem);
+	}
+	
 	/* Unbind all shaders and textures: */
 	glUseProgramObjectARB(0);
+	glActiveTextureARB(GL_TEXTURE3_ARB);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glActiveTextureARB(GL_TEXTURE2_ARB);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB,0);
 	glActiveTextureARB(GL_TEXTURE1_ARB);
@@ -1065,9 +1980,6 @@ GLfloat WaterTable2::runSimulationStep(bool forceStepSize,GLContextData& context
 	/* Restore OpenGL state: */
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT,currentFrameBuffer);
 	glPopAttrib();
-	
-	/* Return the Runge-Kutta step's step size: */
-	return stepSize;
 	}
 
 void WaterTable2::bindBathymetryTexture(GLContextData& contextData) const
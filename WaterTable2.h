@@ -31,6 +31,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 #include <Geometry/OrthonormalTransformation.h>
 #include <GL/gl.h>
 #include <GL/Extensions/GLARBShaderObjects.h>
+#include <GL/Extensions/GLARBSync.h>
 #include <GL/GLObject.h>
 #include <GL/GLContextData.h>
 
@@ -38,6 +39,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 
 /* Forward declarations: */
 class DepthImageRenderer;
+class PerformanceProfiler;
 
 typedef Misc::FunctionCall<GLContextData&> AddWaterFunction; // Type for render functions called to locally add water to the water table
 
@@ -56,16 +58,33 @@ class WaterTable2:public GLObject
 		GLuint bathymetryTextureObjects[2]; // Double-buffered one-component float color texture object holding the vertex-centered bathymetry grid
 		int currentBathymetry; // Index of bathymetry texture containing the most recent bathymetry grid
 		unsigned int bathymetryVersion; // Version number of the most recent bathymetry grid
+		bool forceFullBathymetryUpdate; // Flag if the next bathymetry update from the depth image must re-render the entire grid
 		GLuint quantityTextureObjects[3]; // Double-buffered three-component color texture object holding the cell-centered conserved quantity grid (w, hu, hv)
 		int currentQuantity; // Index of quantity texture containing the most recent conserved quantity grid
 		GLuint derivativeTextureObject; // Three-component color texture object holding the cell-centered temporal derivative grid
 		GLuint maxStepSizeTextureObjects[2]; // Double-buffered one-component color texture objects to gather the maximum step size for Runge-Kutta integration steps
-		GLuint waterTextureObject; // One-component color texture object to add or remove water to/from the conserved quantity grid
+		static const unsigned int numStepSizeReadbackBuffers=8; // Length of the ring of pixel buffers used for asynchronous step size readback
+		GLuint stepSizeReadbackBuffers[numStepSizeReadbackBuffers]; // Ring of pixel buffer objects receiving reduced maximum step sizes
+		GLsync stepSizeReadbackFences[numStepSizeReadbackBuffers]; // Fences signaling completion of each pending step size readback, or 0
+		unsigned int stepSizeReadbackFrames[numStepSizeReadbackBuffers]; // Frame numbers in which each pending step size readback was queued
+		unsigned int numStepSizeReadbacks; // Total number of asynchronous step size readbacks issued so far
+		unsigned int numCompletedStepSizeReadbacks; // Total number of asynchronous step size readbacks retrieved so far; readbacks in between are pending
+		bool haveReadbackStepSize; // Flag whether at least one asynchronous step size readback has completed
+		GLfloat readbackStepSize; // Most recently completed asynchronously read back maximum step size
+		GLuint stepSizeTextureObjects[2]; // Double-buffered three-component 1x1 color texture objects holding the current step size, remaining simulation time, and number of advancing steps in the current batch for GPU-controlled simulation steps
+		int currentStepSize; // Index of step size texture containing the most recent step size
+		GLuint batchReadbackBuffer; // Pixel buffer object receiving the final step size texture of a batch of GPU-controlled simulation steps
+		GLsync batchReadbackFence; // Fence signaling completion of the pending batch readback, or 0
+		unsigned int batchReadbackSteps; // Number of steps issued in the batch whose readback is pending
+		unsigned int batchStepBudget; // Number of steps to issue in the next batch, estimated from completed batch readbacks, or 0 if no readback completed yet
+		GLuint waterTextureObject; // One-component color texture object holding the per-time rates at which water sources and sinks add or remove water to/from the conserved quantity grid
+		unsigned int waterSourcesVersion; // Version number of the water sources and sinks most recently rasterized into the water texture
 		GLuint bathymetryFramebufferObject; // Frame buffer used to render the bathymetry surface into the bathymetry grid
 		GLuint derivativeFramebufferObject; // Frame buffer used for temporal derivative computation
 		GLuint maxStepSizeFramebufferObject; // Frame buffer used to calculate the maximum integration step size
 		GLuint integrationFramebufferObject; // Frame buffer used for the Euler and Runge-Kutta integration steps
 		GLuint waterFramebufferObject; // Frame buffer used for the water rendering step
+		GLuint stepSizeFramebufferObject; // Frame buffer used to select step sizes for GPU-controlled simulation steps
 		GLhandleARB bathymetryShader; // Shader to update cell-centered conserved quantities after a change to the bathymetry grid
 		GLint bathymetryShaderUniformLocations[3];
 		GLhandleARB waterAdaptShader; // Shader to adapt a new conserved quantity grid to the current bathymetry grid
@@ -83,7 +102,29 @@ class WaterTable2:public GLObject
 		GLhandleARB waterAddShader; // Shader to render water adder objects
 		GLint waterAddShaderUniformLocations[3];
 		GLhandleARB waterShader; // Shader to add or remove water from the conserved quantities grid
-		GLint waterShaderUniformLocations[3];
+		GLint waterShaderUniformLocations[4];
+		GLhandleARB stepSizeShader; // Shader to select the step size of a GPU-controlled simulation step
+		GLint stepSizeShaderUniformLocations[7];
+		GLhandleARB controlledEulerStepShader; // Shader to compute an Euler integration step with a GPU-controlled step size
+		GLint controlledEulerStepShaderUniformLocations[4];
+		GLhandleARB controlledRungeKuttaStepShader; // Shader to compute a Runge-Kutta integration step with a GPU-controlled step size
+		GLint controlledRungeKuttaStepShaderUniformLocations[5];
+		GLhandleARB fusedRungeKuttaStepShader; // Shader to compute a Runge-Kutta integration step including the temporal derivative of the intermediate quantities
+		GLint fusedRungeKuttaStepShaderUniformLocations[9];
+		GLhandleARB controlledFusedRungeKuttaStepShader; // Shader to compute a Runge-Kutta integration step including the temporal derivative of the intermediate quantities with a GPU-controlled step size
+		GLint controlledFusedRungeKuttaStepShaderUniformLocations[9];
+		GLhandleARB controlledWaterShader; // Shader to add or remove water from the conserved quantities grid with a GPU-controlled step size
+		GLint controlledWaterShaderUniformLocations[4];
+		GLuint tileActivityTextureObject; // One-component color texture object holding per-tile activity flags
+		GLuint tileActivityFramebufferObject; // Frame buffer used to detect active tiles
+		GLhandleARB tileActivityShader; // Shader to flag tiles containing or receiving water
+		GLint tileActivityShaderUniformLocations[7];
+		GLuint tileActivityReadbackBuffer; // Pixel buffer object receiving per-tile activity flags
+		GLsync tileActivityFence; // Fence signaling completion of the pending tile activity readback, or 0
+		static const unsigned char maxTileIdleCount=8; // Number of consecutive inactive detections after which a tile is skipped
+		std::vector<unsigned char> tileIdleCounts; // Number of consecutive detections in which each tile was found inactive
+		bool allTilesActive; // Flag whether no tiles are currently skipped
+		std::vector<GLint> activeTileRuns; // List of pixel-space rectangles (x0, y0, x1, y1) covering horizontal runs of active tiles
 		
 		/* Constructors and destructors: */
 		DataItem(void);
@@ -104,15 +145,36 @@ class WaterTable2:public GLObject
 	GLfloat epsilon; // Coefficient for desingularizing division operator
 	GLfloat attenuation; // Attenuation factor for partial discharges
 	GLfloat maxStepSize; // Maximum step size for each Runge-Kutta integration step
+	unsigned int stepSizeReadbackLatency; // Number of frames by which the maximum step size readback may lag behind; 0 uses blocking readback
+	unsigned int frameNumber; // Number of frames started so far, to measure the age of pending step size readbacks
+	GLfloat stepSizeReadbackSafety; // Factor applied to lagging maximum step sizes to account for flow changes since they were calculated
+	bool halfIntermediates; // Flag whether the temporal derivative and maximum step size textures use 16-bit floats
+	GLfloat stepSizeGuard; // Factor applied to all reduced maximum step sizes to absorb rounding errors of reduced-precision textures
 	PTransform waterTextureTransform; // Projective transformation from camera space to water level texture space
 	GLfloat waterTextureTransformMatrix[16]; // Same in GLSL-compatible format
-	std::vector<const AddWaterFunction*> renderFunctions; // A list of functions that are called after each water flow simulation step to locally add or remove water from the water table
-	GLfloat waterDeposit; // A fixed amount of water added at every iteration of the flow simulation, for evaporation etc.
+	std::vector<const AddWaterFunction*> renderFunctions; // A list of functions that are called once per version of the water sources to locally add or remove water from the water table
+	GLfloat waterDeposit; // A fixed amount of water added per time unit of the flow simulation, for evaporation etc.
+	unsigned int waterSourcesVersion; // Version number of the water sources and sinks, to rasterize them once per change instead of on every simulation step
 	bool dryBoundary; // Flag whether to enforce dry boundary conditions at the end of each simulation step
+	bool fusedIntegration; // Flag whether to calculate the intermediate temporal derivative inside the Runge-Kutta integration step instead of in a separate pass
+	bool incrementalBathymetry; // Flag whether to only update the parts of the bathymetry grid affected by changed depth image pixels
+	unsigned int bathymetryLod; // Level of detail of the depth image renderer's template mesh used to render the bathymetry grid
+	GLsizei tileSize; // Width and height of the tiles into which the grid is divided to skip dry areas, or 0 to simulate the entire grid
+	GLsizei numTiles[2]; // Number of tiles in x and y
+	GLfloat tileMinDepth; // Minimum water column height to consider a cell wet for tile activity detection
+	PerformanceProfiler* profiler; // Profiler measuring the GPU time of the simulation's passes, or NULL
+	unsigned int profilerStages[4]; // Profiler stage indices of the derivative, integration, water adding, and tile activity passes
 	
 	/* Private methods: */
+	bool calcBathymetryUpdateRegions(const PixelRect& dirtyRegion,PixelRect& cellRegion,PixelRect& meshRegion) const; // Calculates the regions of bathymetry grid cells and depth image pixels affected by the given region of changed depth image pixels; returns false if the full grid needs to be updated
 	void calcTransformations(void); // Calculates derived transformations
+	int reduceMaxStepSize(DataItem* dataItem) const; // Reduces the maximum step size texture to a single pixel and returns the index of the maximum step size texture containing it
 	GLfloat calcDerivative(DataItem* dataItem,GLuint quantityTextureObject,bool calcMaxStepSize) const; // Calculates the temporal derivative of the conserved quantities in the given texture object and returns maximum step size if flag is true
+	void integrate(DataItem* dataItem,GLfloat stepSize,bool controlledStepSize,GLContextData& contextData) const; // Runs the integration, boundary, and water adding parts of a simulation step with the given step size, or the current step size texture if flag is true
+	void activateTiles(DataItem* dataItem,const PixelRect& cellRegion) const; // Marks all tiles overlapping the given region of grid cells as active
+	void updateActiveTileRuns(DataItem* dataItem) const; // Rebuilds the list of active tile runs from the per-tile idle counts
+	void updateTileActivity(DataItem* dataItem) const; // Retrieves the results of a completed tile activity detection and issues the next one
+	void renderActiveCells(const DataItem* dataItem) const; // Renders quads covering all grid cells that need to be simulated
 	
 	/* Constructors and destructors: */
 	public:
@@ -151,22 +213,63 @@ class WaterTable2:public GLObject
 	void setElevationRange(Scalar newMin,Scalar newMax); // Sets the range of possible elevations in the water table
 	void setAttenuation(GLfloat newAttenuation); // Sets the attenuation factor for partial discharges
 	void setMaxStepSize(GLfloat newMaxStepSize); // Sets the maximum step size for all subsequent integration steps
+	unsigned int getStepSizeReadbackLatency(void) const // Returns the number of frames by which the maximum step size readback may lag behind
+		{
+		return stepSizeReadbackLatency;
+		}
+	void setStepSizeReadback(unsigned int newLatency,GLfloat newSafety); // Enables asynchronous maximum step size readback with the given latency in frames and safety factor; latency 0 restores blocking readback
+	void startFrame(void) // Notifies the water table that a new frame started, to age pending step size readbacks; must be called once per frame
+		{
+		++frameNumber;
+		}
+	bool getHalfIntermediates(void) const // Returns true if the temporal derivative and maximum step size textures use 16-bit floats
+		{
+		return halfIntermediates;
+		}
+	void setHalfPrecision(bool newHalfIntermediates); // Selects 16-bit float storage for the temporal derivative and maximum step size textures; conserved quantities always use 32-bit floats, as the water surface elevation shares the bathymetry's absolute frame; must be called before the water table is initialized in any OpenGL context
 	const PTransform& getWaterTextureTransform(void) const // Returns the matrix transforming from camera space into water texture space
 		{
 		return waterTextureTransform;
 		}
 	void addRenderFunction(const AddWaterFunction* newRenderFunction); // Adds a render function to the list; object remains owned by caller
 	void removeRenderFunction(const AddWaterFunction* removeRenderFunction); // Removes the given render function from the list but does not delete it
+	void invalidateWaterSources(void) // Notifies the water table that the geometry rendered by its render functions changed; must be called once per frame while sources move
+		{
+		++waterSourcesVersion;
+		}
 	GLfloat getWaterDeposit(void) const // Returns the current amount of water deposited on every simulation step
 		{
 		return waterDeposit;
 		}
 	void setWaterDeposit(GLfloat newWaterDeposit); // Sets the amount of deposited water
 	void setDryBoundary(bool newDryBoundary); // Enables or disables enforcement of dry boundaries
+	bool getIncrementalBathymetry(void) const // Returns true if bathymetry updates are limited to the parts of the grid affected by changed depth image pixels
+		{
+		return incrementalBathymetry;
+		}
+	void setIncrementalBathymetry(bool newIncrementalBathymetry); // Enables or disables incremental bathymetry updates
+	unsigned int getBathymetryLod(void) const // Returns the level of detail of the template mesh used to render the bathymetry grid
+		{
+		return bathymetryLod;
+		}
+	void setBathymetryLod(unsigned int newBathymetryLod); // Sets the level of detail of the template mesh used to render the bathymetry grid; 0 uses one vertex per depth image pixel
+	GLsizei getTileSize(void) const // Returns the size of tiles used to skip dry areas, or 0 if the entire grid is simulated
+		{
+		return tileSize;
+		}
+	void setTileSize(GLsizei newTileSize,GLfloat newTileMinDepth); // Divides the grid into tiles of the given size and skips tiles without water columns higher than the given minimum; size 0 simulates the entire grid; must be called before the water table is initialized in any OpenGL context
+	bool getFusedIntegration(void) const // Returns true if the Runge-Kutta integration step calculates its own temporal derivative
+		{
+		return fusedIntegration;
+		}
+	void setFusedIntegration(bool newFusedIntegration); // Enables or disables fused derivative calculation in the Runge-Kutta integration step
+	void setProfiler(PerformanceProfiler* newProfiler); // Registers the simulation's passes as stages with the given profiler and measures their GPU time
 	void updateBathymetry(GLContextData& contextData) const; // Prepares the water table for subsequent calls to the runSimulationStep() method
 	void updateBathymetry(const GLfloat* bathymetryGrid,GLContextData& contextData) const; // Updates the bathymetry directly with a vertex-centered elevation grid of grid size minus 1
 	void setWaterLevel(const GLfloat* waterGrid,GLContextData& contextData) const; // Sets the current water level to the given grid, and resets flux components to zero
+	void setMirroredState(const GLfloat* bathymetryGrid,const GLfloat* waterGrid,GLContextData& contextData) const; // Overwrites the current bathymetry and water level grids with grids read back from a water table simulated in another context, for rendering only; resets flux components to zero
 	GLfloat runSimulationStep(bool forceStepSize,GLContextData& contextData) const; // Runs a water flow simulation step, always uses maxStepSize if flag is true (may lead to instability); returns step size taken by Runge-Kutta integration step
+	void runSimulationSteps(double targetTime,unsigned int maxSteps,GLContextData& contextData) const; // Advances the water flow simulation by the given time in at most the given number of steps, selecting step sizes on the GPU without blocking read-backs; time left unspent when the steps run out is carried over to the next call
 	void bindBathymetryTexture(GLContextData& contextData) const; // Binds the bathymetry texture object to the active texture unit
 	void bindQuantityTexture(GLContextData& contextData) const; // Binds the most recent conserved quantities texture object to the active texture unit
 	void uploadWaterTextureTransform(GLint location) const; // Uploads the water texture transformation into the GLSL 4x4 matrix at the given uniform location
@@ -0,0 +1,38 @@
+/***********************************************************************
+AdaptiveRenderPresentShader - Shader to upscale a frame rendered at
+reduced resolution into the current viewport, including its depth values.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect colorSampler; // Sampler for the rendered frame's color texture
+uniform sampler2DRect depthSampler; // Sampler for the rendered frame's depth texture
+uniform vec2 viewportOrigin; // Window position of the lower-left corner of the current viewport
+uniform vec2 renderScale; // Scale from viewport pixels to rendered frame texels
+
+void main()
+	{
+	/* Calculate the fragment's position in the rendered frame: */
+	vec2 frameCoord=(gl_FragCoord.xy-viewportOrigin)*renderScale;
+	
+	/* Copy the interpolated color and the nearest depth value: */
+	gl_FragColor=texture2DRect(colorSampler,frameCoord);
+	gl_FragDepth=texture2DRect(depthSampler,frameCoord).r;
+	}
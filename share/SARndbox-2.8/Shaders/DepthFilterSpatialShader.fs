@@ -0,0 +1,48 @@
+/***********************************************************************
+DepthFilterSpatialShader - Shader to run one pass of a separable
+low-pass filter over a filtered depth image.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect depthSampler; // Sampler for the depth image to filter
+uniform vec2 filterStep; // Pixel offset between filter taps, either (1, 0) or (0, 1)
+uniform vec2 depthImageSize; // Size of the depth image
+
+void main()
+	{
+	/* Weigh the center pixel twice and each existing neighbor once, like the CPU filter does at the image boundaries: */
+	float sum=texture2DRect(depthSampler,gl_FragCoord.xy).r*2.0;
+	float weightSum=2.0;
+	vec2 prev=gl_FragCoord.xy-filterStep;
+	if(prev.x>0.0&&prev.y>0.0)
+		{
+		sum+=texture2DRect(depthSampler,prev).r;
+		weightSum+=1.0;
+		}
+	vec2 next=gl_FragCoord.xy+filterStep;
+	if(next.x<depthImageSize.x&&next.y<depthImageSize.y)
+		{
+		sum+=texture2DRect(depthSampler,next).r;
+		weightSum+=1.0;
+		}
+	
+	gl_FragColor=vec4(sum/weightSum,0.0,0.0,1.0);
+	}
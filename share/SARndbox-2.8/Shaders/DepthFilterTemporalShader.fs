@@ -0,0 +1,83 @@
+/***********************************************************************
+DepthFilterTemporalShader - Shader to enter a raw depth frame into the
+per-pixel exponentially weighted depth statistics, and calculate the
+stable depth value of each pixel.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform sampler2DRect rawDepthSampler; // Sampler for the raw depth frame as normalized 16-bit values
+uniform sampler2DRect depthCorrectionSampler; // Sampler for per-pixel depth correction scales and offsets
+uniform sampler2DRect statSampler; // Sampler for the per-pixel weight, mean, deviation, and current stable value
+uniform vec4 minPlane; // Plane equation of the lower bound of valid depth values in depth image space
+uniform vec4 maxPlane; // Plane equation of the upper bound of valid depth values in depth image space
+uniform float alpha; // Weight of a new valid sample
+uniform float minWeight; // Minimum total weight of valid samples to consider a pixel stable
+uniform float maxVariance; // Maximum variance to consider a pixel stable
+uniform float hysteresis; // Amount by which a new stable value has to differ from the current value to update
+uniform bool retainValids; // Flag whether to retain previous stable values for instable pixels
+uniform float instableValue; // Value to assign to instable pixels if retainValids is false
+
+void main()
+	{
+	/* Get the raw and depth-corrected depth values of this pixel: */
+	float newVal=floor(texture2DRect(rawDepthSampler,gl_FragCoord.xy).r*65535.0+0.5);
+	vec2 pdc=texture2DRect(depthCorrectionSampler,gl_FragCoord.xy).rg;
+	float newCVal=newVal*pdc.x+pdc.y;
+	
+	/* Get the pixel's current statistics: */
+	vec4 stat=texture2DRect(statSampler,gl_FragCoord.xy);
+	
+	/* Plug the depth-corrected new value into the minimum and maximum plane equations to determine its validity: */
+	vec4 pDic=vec4(gl_FragCoord.xy,newCVal,1.0);
+	if(dot(minPlane,pDic)>=0.0&&dot(maxPlane,pDic)<=0.0)
+		{
+		/* Decay the pixel's statistics and add the new value with weight alpha: */
+		stat.x=stat.x*(1.0-alpha)+alpha;
+		float delta=newVal-stat.y;
+		stat.y+=delta*(alpha/stat.x);
+		stat.z=stat.z*(1.0-alpha)+delta*(newVal-stat.y)*alpha;
+		}
+	else if(!retainValids)
+		{
+		/* Decay the pixel's statistics without adding a new sample: */
+		stat.x*=1.0-alpha;
+		stat.z*=1.0-alpha;
+		}
+	
+	/* Check if the pixel is considered "stable": */
+	float result;
+	if(stat.x>=minWeight&&stat.z<=maxVariance*stat.x)
+		{
+		/* Update the stable value if the new depth-corrected mean is outside the previous value's envelope: */
+		float newFiltered=stat.y*pdc.x+pdc.y;
+		if(abs(newFiltered-stat.w)>=hysteresis)
+			stat.w=newFiltered;
+		result=stat.w;
+		}
+	else if(retainValids)
+		result=stat.w;
+	else
+		result=instableValue;
+	
+	/* Write the updated statistics and the filtered depth value: */
+	gl_FragData[0]=stat;
+	gl_FragData[1]=vec4(result,0.0,0.0,1.0);
+	}
@@ -0,0 +1,44 @@
+/***********************************************************************
+SpriteInstancedShader - Shader to render all animated dinosaur sprites
+on the sandbox surface with a single instanced draw call.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_EXT_texture_array : enable
+
+uniform sampler2DArray spriteArraySampler; // Texture array holding all spritesheets
+
+varying vec3 fragTexCoord;                 // Interpolated texture coordinate and layer
+varying float fragAlpha;                   // Sprite opacity (for fade effects)
+
+void main()
+	{
+	/* Sample the sprite's spritesheet layer */
+	vec4 texColor = texture2DArray(spriteArraySampler, fragTexCoord);
+
+	/* Discard fully transparent pixels (alpha cutoff for clean edges) */
+	if(texColor.a < 0.1)
+		discard;
+
+	/* Apply sprite alpha for fade effects */
+	texColor.a *= fragAlpha;
+
+	/* Output the final color */
+	gl_FragColor = texColor;
+	}
@@ -0,0 +1,46 @@
+/***********************************************************************
+SpriteInstancedShader - Shader to render all animated dinosaur sprites
+on the sandbox surface with a single instanced draw call.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+uniform mat4 projectionModelviewMatrix;  // Combined projection * modelview
+uniform vec2 spriteSize;                 // World-space size of sprite (width, height)
+
+attribute vec4 instancePosition;         // Per-instance world position of sprite center and sprite opacity
+attribute vec4 instanceFrame;            // Per-instance UV offset and UV size of current frame in its spritesheet layer
+attribute float instanceLayer;           // Per-instance spritesheet layer in the sprite texture array
+
+varying vec3 fragTexCoord;               // Output texture coordinate and layer
+varying float fragAlpha;                 // Output sprite opacity
+
+void main()
+	{
+	/* Sprites lie flat on the X-Y plane at the instance's elevation, as in SpriteShader */
+	vec3 worldPos = instancePosition.xyz;
+	worldPos.x += gl_Vertex.x * spriteSize.x;
+	worldPos.y += gl_Vertex.y * spriteSize.y;
+
+	/* Transform to clip space */
+	gl_Position = projectionModelviewMatrix * vec4(worldPos, 1.0);
+
+	/* Map the quad's texture coord (0-1) to the instance's frame and layer */
+	fragTexCoord = vec3(instanceFrame.xy + gl_MultiTexCoord0.xy * instanceFrame.zw, instanceLayer);
+	fragAlpha = instancePosition.w;
+	}
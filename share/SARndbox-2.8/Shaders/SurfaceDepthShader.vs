@@ -19,8 +19,11 @@ with the Augmented Reality Sandbox; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 ***********************************************************************/
 
+#version 120
 #extension GL_ARB_texture_rectangle : enable
 
+invariant gl_Position; // Must match the surface shader's vertex positions exactly for depth prepass rendering
+
 uniform sampler2DRect depthSampler; // Sampler for the depth image-space elevation texture
 uniform mat4 projectionModelviewDepthProjection; // Combined transformation from depth image space to clip space
 
@@ -28,7 +31,7 @@ void main()
 	{
 	/* Get the vertex' depth image-space z coordinate from the texture: */
 	vec4 vertexDic=gl_Vertex;
-	vertexDic.z=texture2DRect(depthSampler,vertexDic.xy).r;
+	vertexDic.z=texture2DRect(depthSampler,gl_Vertex.xy).r;
 	
 	/* Transform vertex directly from depth image space to clip space: */
 	gl_Position=projectionModelviewDepthProjection*vertexDic;
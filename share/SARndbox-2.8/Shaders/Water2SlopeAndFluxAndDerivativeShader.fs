@@ -1,7 +1,9 @@
 /***********************************************************************
 Water2SlopeAndFluxAndDerivativeShader - Shader to compute the temporal
 derivative of the conserved quantities directly from spatial partial
-derivatives, bypassing the separate partial flux computation.
+derivatives, bypassing the separate partial flux computation. When
+compiled with WATER2_DERIVATIVE_NO_MAIN defined, provides only the
+derivative function to be linked into fused integration step shaders.
 Copyright (c) 2012 Oliver Kreylos
 
 This file is part of the Augmented Reality Sandbox (SARndbox).
@@ -124,48 +126,47 @@ float calcPartialFluxY(in vec3 qn,in vec3 qs,in float bns,out vec3 fluxY)
 	return 0.5*cellSize.y/max(-an,as);
 	}
 
-void main()
+vec3 calcDerivative(in sampler2DRect quantitySampler,in vec2 cell,out float maxStepSize)
 	{
 	/* Calculate face-centered bathymetry elevations required for partial flux computations: */
-	float b00=texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-1.0)).r;
-	float b10=texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).r;
-	float b01=texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y)).r;
-	float b11=texture2DRect(bathymetrySampler,gl_FragCoord.xy).r;
-	float b0=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y-2.0)).r+texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-2.0)).r)*0.5;
+	float b00=texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y-1.0)).r;
+	float b10=texture2DRect(bathymetrySampler,vec2(cell.x,cell.y-1.0)).r;
+	float b01=texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y)).r;
+	float b11=texture2DRect(bathymetrySampler,cell.xy).r;
+	float b0=(texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y-2.0)).r+texture2DRect(bathymetrySampler,vec2(cell.x,cell.y-2.0)).r)*0.5;
 	float b1=(b00+b10)*0.5;
-	float b2=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-2.0,gl_FragCoord.y-1.0)).r+texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-2.0,gl_FragCoord.y)).r)*0.5;
+	float b2=(texture2DRect(bathymetrySampler,vec2(cell.x-2.0,cell.y-1.0)).r+texture2DRect(bathymetrySampler,vec2(cell.x-2.0,cell.y)).r)*0.5;
 	float b3=(b00+b01)*0.5;
 	float b4=(b10+b11)*0.5;
-	float b5=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x+1.0,gl_FragCoord.y-1.0)).r+texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x+1.0,gl_FragCoord.y)).r)*0.5;
+	float b5=(texture2DRect(bathymetrySampler,vec2(cell.x+1.0,cell.y-1.0)).r+texture2DRect(bathymetrySampler,vec2(cell.x+1.0,cell.y)).r)*0.5;
 	float b6=(b01+b11)*0.5;
-	float b7=(texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y+1.0)).r+texture2DRect(bathymetrySampler,vec2(gl_FragCoord.x,gl_FragCoord.y+1.0)).r)*0.5;
+	float b7=(texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y+1.0)).r+texture2DRect(bathymetrySampler,vec2(cell.x,cell.y+1.0)).r)*0.5;
 	
 	/* Get quantities required for partial flux computations: */
-	vec3 q1=texture2DRect(quantitySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-1.0)).rgb;
-	vec3 q3=texture2DRect(quantitySampler,vec2(gl_FragCoord.x-1.0,gl_FragCoord.y)).rgb;
-	vec3 q4=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
-	vec3 q5=texture2DRect(quantitySampler,vec2(gl_FragCoord.x+1.0,gl_FragCoord.y)).rgb;
-	vec3 q7=texture2DRect(quantitySampler,vec2(gl_FragCoord.x,gl_FragCoord.y+1.0)).rgb;
+	vec3 q1=texture2DRect(quantitySampler,vec2(cell.x,cell.y-1.0)).rgb;
+	vec3 q3=texture2DRect(quantitySampler,vec2(cell.x-1.0,cell.y)).rgb;
+	vec3 q4=texture2DRect(quantitySampler,cell.xy).rgb;
+	vec3 q5=texture2DRect(quantitySampler,vec2(cell.x+1.0,cell.y)).rgb;
+	vec3 q7=texture2DRect(quantitySampler,vec2(cell.x,cell.y+1.0)).rgb;
 	
 	/* Calculate one-sided quantities required for partial flux computations: */
-	vec3 q1n=q1+calcSlope(texture2DRect(quantitySampler,vec2(gl_FragCoord.x,gl_FragCoord.y-2.0)).rgb,q1,q4,cellSize.y,b0,b1)*(cellSize.y*0.5);
-	vec3 q3e=q3+calcSlope(texture2DRect(quantitySampler,vec2(gl_FragCoord.x-2.0,gl_FragCoord.y)).rgb,q3,q4,cellSize.x,b2,b3)*(cellSize.x*0.5);
+	vec3 q1n=q1+calcSlope(texture2DRect(quantitySampler,vec2(cell.x,cell.y-2.0)).rgb,q1,q4,cellSize.y,b0,b1)*(cellSize.y*0.5);
+	vec3 q3e=q3+calcSlope(texture2DRect(quantitySampler,vec2(cell.x-2.0,cell.y)).rgb,q3,q4,cellSize.x,b2,b3)*(cellSize.x*0.5);
 	vec3 q4x=calcSlope(q3,q4,q5,cellSize.x,b3,b4)*(cellSize.x*0.5);
 	vec3 q4w=q4-q4x;
 	vec3 q4e=q4+q4x;
 	vec3 q4y=calcSlope(q1,q4,q7,cellSize.y,b1,b6)*(cellSize.y*0.5);
 	vec3 q4s=q4-q4y;
 	vec3 q4n=q4+q4y;
-	vec3 q5w=q5-calcSlope(q4,q5,texture2DRect(quantitySampler,vec2(gl_FragCoord.x+2.0,gl_FragCoord.y)).rgb,cellSize.x,b4,b5)*(cellSize.x*0.5);
-	vec3 q7s=q7-calcSlope(q4,q7,texture2DRect(quantitySampler,vec2(gl_FragCoord.x,gl_FragCoord.y+2.0)).rgb,cellSize.y,b6,b7)*(cellSize.y*0.5);
+	vec3 q5w=q5-calcSlope(q4,q5,texture2DRect(quantitySampler,vec2(cell.x+2.0,cell.y)).rgb,cellSize.x,b4,b5)*(cellSize.x*0.5);
+	vec3 q7s=q7-calcSlope(q4,q7,texture2DRect(quantitySampler,vec2(cell.x,cell.y+2.0)).rgb,cellSize.y,b6,b7)*(cellSize.y*0.5);
 	
 	/* Calculate partial fluxes across the cell's faces and the maximum possible step size for this cell: */
 	vec3 fluxXw,fluxXe,fluxYs,fluxYn;
-	gl_FragData[1]=vec4(min(min(calcPartialFluxX(q3e,q4w,b3,fluxXw),
-	                           calcPartialFluxX(q4e,q5w,b4,fluxXe)),
-	                       min(calcPartialFluxY(q1n,q4s,b1,fluxYs),
-	                           calcPartialFluxY(q4n,q7s,b6,fluxYn))),
-	                    0.0,0.0,0.0);
+	maxStepSize=min(min(calcPartialFluxX(q3e,q4w,b3,fluxXw),
+	                    calcPartialFluxX(q4e,q5w,b4,fluxXe)),
+	                min(calcPartialFluxY(q1n,q4s,b1,fluxYs),
+	                    calcPartialFluxY(q4n,q7s,b6,fluxYn)));
 	
 	/* Calculate the water column height at the cell center: */
 	float h=max(q4.x-(b3+b4)*0.5,0.0);
@@ -173,6 +174,18 @@ void main()
 	/* Calculate equation source terms at the cell center: */
 	vec3 source=vec3(0.0,-g*h*(b4-b3)/cellSize.x,-g*h*(b6-b1)/cellSize.y);
 	
-	/* Calculate the temporal derivative: */
-	gl_FragData[0]=vec4(source-(fluxXe-fluxXw)/cellSize.x-(fluxYn-fluxYs)/cellSize.y,0.0);
+	/* Return the temporal derivative: */
+	return source-(fluxXe-fluxXw)/cellSize.x-(fluxYn-fluxYs)/cellSize.y;
 	}
+
+#ifndef WATER2_DERIVATIVE_NO_MAIN
+
+void main()
+	{
+	/* Calculate the temporal derivative and the maximum possible step size for this cell: */
+	float maxStepSize;
+	gl_FragData[0]=vec4(calcDerivative(quantitySampler,gl_FragCoord.xy,maxStepSize),0.0);
+	gl_FragData[1]=vec4(maxStepSize,0.0,0.0,0.0);
+	}
+
+#endif
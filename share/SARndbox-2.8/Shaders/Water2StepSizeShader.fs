@@ -0,0 +1,45 @@
+/***********************************************************************
+Water2StepSizeShader - Shader to select the step size of the next
+Runge-Kutta integration step and track the remaining simulation time on
+the GPU.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform float maxStepSize;
+uniform sampler2DRect maxStepSizeSampler;
+uniform sampler2DRect stepSizeSampler;
+uniform float stepSizeGuard;
+uniform float addedTime; // Simulation time added to the remaining time before this step; non-zero only for the first step of a batch
+uniform float maxRemainingTime; // Limit for the remaining time, including any time left unspent by previous batches
+uniform float stepCountBase; // 0.0 to restart the step count with this step, 1.0 to continue it
+
+void main()
+	{
+	/* Get the simulation time remaining after the previous step, carrying over time the previous batch left unspent: */
+	vec3 previous=texture2DRect(stepSizeSampler,vec2(0.5,0.5)).rgb;
+	float remainingTime=min(previous.g+addedTime,maxRemainingTime);
+	
+	/* Shrink the reduced maximum step size to absorb reduced-precision rounding, and limit it to the client-specified range and the remaining time: */
+	float stepSize=min(min(texture2DRect(maxStepSizeSampler,vec2(0.5,0.5)).r*stepSizeGuard,maxStepSize),remainingTime);
+	
+	/* Store the step size, the updated remaining time, and the number of steps in the current batch that advanced the simulation: */
+	gl_FragColor=vec4(stepSize,remainingTime-stepSize,previous.b*stepCountBase+(stepSize>0.0?1.0:0.0),0.0);
+	}
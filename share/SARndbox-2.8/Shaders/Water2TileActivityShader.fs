@@ -0,0 +1,62 @@
+/***********************************************************************
+Water2TileActivityShader - Shader to flag tiles of the water table grid
+that contain water or receive water from water sources.
+Copyright (c) 2024 Oliver Kreylos
+
+This file is part of the Augmented Reality Sandbox (SARndbox).
+
+The Augmented Reality Sandbox is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the
+License, or (at your option) any later version.
+
+The Augmented Reality Sandbox is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with the Augmented Reality Sandbox; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+***********************************************************************/
+
+#extension GL_ARB_texture_rectangle : enable
+
+uniform int tileSize; // Width and height of a tile in grid cells
+uniform vec2 gridSize; // Width and height of the conserved quantity grid
+uniform float minDepth; // Minimum water column height to consider a cell wet
+uniform bool checkWater; // Flag whether the water texture holds the water sources of the most recent simulation step
+uniform sampler2DRect bathymetrySampler;
+uniform sampler2DRect quantitySampler;
+uniform sampler2DRect waterSampler;
+
+void main()
+	{
+	/* Calculate the center of the tile's first cell: */
+	vec2 base=floor(gl_FragCoord.xy)*float(tileSize)+vec2(0.5,0.5);
+	
+	/* Check all cells of the tile: */
+	bool active=false;
+	for(int y=0;y<tileSize&&!active;++y)
+		for(int x=0;x<tileSize&&!active;++x)
+			{
+			vec2 cell=base+vec2(float(x),float(y));
+			if(cell.x<gridSize.x&&cell.y<gridSize.y)
+				{
+				/* Calculate the bathymetry elevation at the center of the cell: */
+				float b=(texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y-1.0)).r+
+				         texture2DRect(bathymetrySampler,vec2(cell.x,cell.y-1.0)).r+
+				         texture2DRect(bathymetrySampler,vec2(cell.x-1.0,cell.y)).r+
+				         texture2DRect(bathymetrySampler,cell).r)*0.25;
+				
+				/* Flag the tile if the cell is wet or receives water: */
+				if(texture2DRect(quantitySampler,cell).r-b>minDepth)
+					active=true;
+				if(checkWater&&texture2DRect(waterSampler,cell).r>0.0)
+					active=true;
+				}
+			}
+	
+	/* Write the tile's activity flag: */
+	gl_FragColor=vec4(active?1.0:0.0,0.0,0.0,0.0);
+	}
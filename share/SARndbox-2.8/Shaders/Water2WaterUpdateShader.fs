@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
 uniform sampler2DRect bathymetrySampler;
 uniform sampler2DRect quantitySampler;
 uniform sampler2DRect waterSampler;
+uniform float stepSize;
 
 void main()
 	{
@@ -37,9 +38,9 @@ void main()
 	/* Get the old quantity at the cell center: */
 	vec3 q=texture2DRect(quantitySampler,gl_FragCoord.xy).rgb;
 	
-	/* Calculate the old and new water column heights: */
+	/* Calculate the old and new water column heights, scaling the per-time water amount by the step size: */
 	float hOld=q.x-b;
-	float hNew=max(hOld+texture2DRect(waterSampler,gl_FragCoord.xy).r,0.0);
+	float hNew=max(hOld+texture2DRect(waterSampler,gl_FragCoord.xy).r*stepSize,0.0);
 	
 	/* Update the water surface height: */
 	q.x=hNew+b;